@@ -13,9 +13,9 @@
  * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
  */
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
-#include <poll.h>
 
 #include "libpirate.h"
 
@@ -25,10 +25,6 @@
 using namespace pirate;
 using namespace CameraDemo;
 
-#ifndef MIN
-#define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
-#endif
-
 RemoteCameraControlOutput::RemoteCameraControlOutput(
     std::unique_ptr<CameraControlOutput> delegate,
     const Options& options, const RemoteDescriptors& remotes) :
@@ -42,7 +38,8 @@ RemoteCameraControlOutput::RemoteCameraControlOutput(
         mGapsResponseWriteGds(remotes.mGapsResponseWriteGds),
         mClientLock(),
         mPollThread(nullptr),
-        mPoll(false)
+        mPoll(false),
+        mRequestPoll(nullptr)
         {
 
         }
@@ -75,29 +72,18 @@ void RemoteCameraControlOutput::term() {
 
 int RemoteCameraControlOutput::recvRequest(CameraDemo::CameraControlOutputRequest& request, int &clientId) {
     int rv;
-    struct pollfd fds[16];
+    pirate_poll_event_t event;
     std::vector<char> readBuf(sizeof(struct CameraControlOutputRequest_wire));
-    int nfds = MIN(mGapsRequestReadGds.size(), 16);
 
-    for (int i = 0; i < nfds; i++) {
-        fds[i].fd = mGapsRequestReadGds[i];
-        fds[i].events = POLLIN;
-    }
-    rv = poll(fds, nfds, 100);
+    rv = pirate_poll_wait(mRequestPoll, &event, 1, 100);
     if (rv == 0) {
         return 0;
     } else if (rv < 0) {
         std::perror("remote camera control output receive request poll error");
         return -1;
     }
-    int gd = -1;
-    for (int i = 0; i < nfds; i++) {
-        clientId = i;
-        if (fds[i].revents & POLLIN) {
-            gd = mGapsRequestReadGds[i];
-            break;
-        }
-    }
+    int gd = event.gd;
+    clientId = std::find(mGapsRequestReadGds.begin(), mGapsRequestReadGds.end(), gd) - mGapsRequestReadGds.begin();
     rv = pirate_read(gd, readBuf.data(), sizeof(struct CameraControlOutputRequest_wire));
     if (rv < 0) {
         std::perror("remote camera control output receive request read error");
@@ -240,11 +226,23 @@ void RemoteCameraControlOutput::pollThread() {
     CameraControlOutputResponse response;
     PanTilt angularPosition;
 
+    mRequestPoll = pirate_poll_create();
+    if (mRequestPoll == nullptr) {
+        std::perror("remote camera control output poll create error");
+        return;
+    }
+    for (int gd : mGapsRequestReadGds) {
+        if (pirate_poll_add(mRequestPoll, gd, PIRATE_POLLIN) < 0) {
+            std::perror("remote camera control output poll add error");
+            mPoll = false;
+        }
+    }
+
     while (mPoll) {
         int clientId = -1;
         int rv = recvRequest(request, clientId);
         if (rv < 0) {
-            return;
+            break;
         } else if (rv == 0) {
             continue;
         }
@@ -267,4 +265,7 @@ void RemoteCameraControlOutput::pollThread() {
                 break;
         }
     }
+
+    pirate_poll_close(mRequestPoll);
+    mRequestPoll = nullptr;
 }
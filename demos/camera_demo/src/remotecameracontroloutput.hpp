@@ -19,6 +19,7 @@
 #include <thread>
 #include <vector>
 
+#include "libpirate.h"
 #include "cameracontroloutput.hpp"
 #include "options.hpp"
 #include "remotes.hpp"
@@ -55,6 +56,7 @@ private:
     std::mutex mClientLock;
     std::thread *mPollThread;
     bool mPoll;
+    pirate_poll_t *mRequestPoll;
 
     void pollThread();
 
@@ -1184,10 +1184,11 @@ gaps_ilip_write_non_root
 
   msg = (struct ilip_message *)smb->data;
 
-  /* Check count is correct */
+  /* Check count is correct, the payload may follow the descriptor or only be referenced by it */
   if (channel != 0)
   {
-    if (count != (dev->block_size + ntohl(msg->u.pay.payload.payload_len)))
+    if ((count != dev->block_size) &&
+        (count != (dev->block_size + ntohl(msg->u.pay.payload.payload_len))))
     {
       rv = -EINVAL;
       goto out;
@@ -1227,6 +1228,19 @@ gaps_ilip_write_non_root
     offsetof(struct gaps_ilip_copy_workqueue, length) + sizeof(size_t),
     0x76543210u);
 
+  /* The device reads the payload from host_payload_address, pin the user pages while we have the user context */
+  if (channel != 0)
+  {
+    int err = gaps_ilip_pin_user_buffer(wq, msg->u.pay.payload.payload_adr,
+                                        ntohl(msg->u.pay.payload.payload_len));
+    if (err != 0)
+    {
+      rv = err;
+      gaps_ilip_message_write_reject_count[channel]++;
+      goto out;
+    }
+  }
+
   if (iops.write)
   {
     rv = iops.write(dev, wq, gaps_ilip_verbose_level);
@@ -1240,6 +1254,7 @@ gaps_ilip_write_non_root
 out:
   if (wq)
   {
+    gaps_ilip_unpin_user_buffer(wq);
     kfree(wq);
   }
   if (smb)
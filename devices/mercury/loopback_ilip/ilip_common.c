@@ -18,7 +18,13 @@
  * (DARPA).
  */
 
+#include <linux/version.h>
 #include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/highmem.h>
+#include <linux/bitops.h>
+#include <linux/string.h>
+#include <linux/stddef.h>
 
 #include "ilip_common.h"
 
@@ -693,3 +699,263 @@ jenkins_one_at_a_time_hash
   return hash;
 }
 
+
+#define SIPROUND \
+  do \
+  { \
+    v0 += v1; v1 = rol64(v1, 13); v1 ^= v0; v0 = rol64(v0, 32); \
+    v2 += v3; v3 = rol64(v3, 16); v3 ^= v2; \
+    v0 += v3; v3 = rol64(v3, 21); v3 ^= v0; \
+    v2 += v1; v1 = rol64(v1, 17); v1 ^= v2; v2 = rol64(v2, 32); \
+  } while (0)
+
+static uint64_t 
+gaps_ilip_load_le64
+(
+  const uint8_t * p
+)
+{
+  __le64 v;
+
+  memcpy(&v, p, sizeof(v));
+  return le64_to_cpu(v);
+}
+
+/**
+ * @brief SipHash-2-4 of Aumasson and Bernstein, must match the libpirate 
+ *        implementation.
+ */
+void 
+gaps_ilip_siphash
+(
+  const uint64_t key[2], 
+  const void * data, 
+  size_t len, 
+  uint64_t * out, 
+  unsigned int outlen
+)
+{
+  const uint8_t * in = (const uint8_t *)data;
+  const uint8_t * end = in + (len & ~(size_t)7);
+  uint64_t v0 = 0x736f6d6570736575ull ^ key[0];
+  uint64_t v1 = 0x646f72616e646f6dull ^ key[1];
+  uint64_t v2 = 0x6c7967656e657261ull ^ key[0];
+  uint64_t v3 = 0x7465646279746573ull ^ key[1];
+  uint64_t b = ((uint64_t)len) << 56;
+  uint64_t m;
+  uint8_t tail[8] = {0};
+
+  if (outlen == 2)
+  {
+    v1 ^= 0xee;
+  }
+  for (; in != end; in += 8)
+  {
+    m = gaps_ilip_load_le64(in);
+    v3 ^= m;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= m;
+  }
+  memcpy(tail, in, len & 7);
+  b |= gaps_ilip_load_le64(tail);
+  v3 ^= b;
+  SIPROUND;
+  SIPROUND;
+  v0 ^= b;
+
+  v2 ^= (outlen == 2) ? 0xee : 0xff;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  out[0] = v0 ^ v1 ^ v2 ^ v3;
+  if (outlen == 2)
+  {
+    v1 ^= 0xdd;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    out[1] = v0 ^ v1 ^ v2 ^ v3;
+  }
+}
+
+void 
+gaps_ilip_siphash_session_key
+(
+  const uint8_t channel_key[GAPS_ILIP_SIPHASH_KEY_SIZE], 
+  uint32_t session_tag, 
+  uint64_t key[2]
+)
+{
+  uint64_t k[2];
+
+  k[0] = gaps_ilip_load_le64(channel_key);
+  k[1] = gaps_ilip_load_le64(channel_key + 8);
+  /* The session tag is stored big endian in the message header */
+  gaps_ilip_siphash(k, &session_tag, sizeof(session_tag), key, 2);
+}
+
+bool 
+gaps_ilip_verify_desc_siphash
+(
+  const struct ilip_message * msg, 
+  const uint64_t key[2]
+)
+{
+  struct ilip_message desc;
+  uint64_t hash;
+
+  memcpy(&desc, msg, sizeof(desc));
+  desc.u.imm.time.ilip_time = 0;
+  gaps_ilip_siphash(key, &desc, offsetof(struct ilip_message, u.imm.payload.desc_siphash), &hash, 1);
+
+  return hash == le64_to_cpu((__force __le64)msg->u.imm.payload.desc_siphash);
+}
+
+bool 
+gaps_ilip_verify_msg_siphash
+(
+  const struct ilip_message * msg, 
+  const void * payload, 
+  size_t len, 
+  const uint64_t key[2]
+)
+{
+  uint64_t hash[2];
+
+  gaps_ilip_siphash(key, payload, len, hash, 2);
+
+  return (hash[0] == le64_to_cpu((__force __le64)msg->u.pay.payload.msg_siphash[0])) &&
+         (hash[1] == le64_to_cpu((__force __le64)msg->u.pay.payload.msg_siphash[1]));
+}
+
+void 
+gaps_ilip_sign_message
+(
+  struct ilip_message * msg, 
+  const void * payload, 
+  size_t len, 
+  const uint64_t key[2]
+)
+{
+  struct ilip_message desc;
+  uint64_t hash[2];
+
+  if (payload != NULL)
+  {
+    gaps_ilip_siphash(key, payload, len, hash, 2);
+    msg->u.pay.payload.msg_siphash[0] = (__force uint64_t)cpu_to_le64(hash[0]);
+    msg->u.pay.payload.msg_siphash[1] = (__force uint64_t)cpu_to_le64(hash[1]);
+  }
+
+  memcpy(&desc, msg, sizeof(desc));
+  desc.u.imm.time.ilip_time = 0;
+  gaps_ilip_siphash(key, &desc, offsetof(struct ilip_message, u.imm.payload.desc_siphash), hash, 1);
+  msg->u.imm.payload.desc_siphash = (__force uint64_t)cpu_to_le64(hash[0]);
+}
+
+int 
+gaps_ilip_pin_user_buffer
+(
+  struct gaps_ilip_copy_workqueue * wq, 
+  uint64_t address, 
+  size_t len
+)
+{
+  unsigned long start = (unsigned long)address & PAGE_MASK;
+  unsigned int npages;
+  int pinned;
+
+  wq->pages = NULL;
+  wq->npages = 0;
+  wq->page_offset = (unsigned long)address & ~PAGE_MASK;
+  wq->page_length = 0;
+  if (len == 0)
+  {
+    return 0;
+  }
+
+  npages = (wq->page_offset + len + PAGE_SIZE - 1) >> PAGE_SHIFT;
+  wq->pages = kmalloc_array(npages, sizeof(struct page *), GFP_KERNEL);
+  if (wq->pages == NULL)
+  {
+    return -ENOMEM;
+  }
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
+  pinned = pin_user_pages_fast(start, npages, 0, wq->pages);
+#else
+  pinned = get_user_pages_fast(start, npages, 0, wq->pages);
+#endif
+  if (pinned < 0)
+  {
+    kfree(wq->pages);
+    wq->pages = NULL;
+    return pinned;
+  }
+  wq->npages = pinned;
+  if (pinned != npages)
+  {
+    gaps_ilip_unpin_user_buffer(wq);
+    return -EFAULT;
+  }
+  wq->page_length = len;
+
+  return 0;
+}
+
+void 
+gaps_ilip_unpin_user_buffer
+(
+  struct gaps_ilip_copy_workqueue * wq
+)
+{
+  if (wq->pages == NULL)
+  {
+    return;
+  }
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
+  unpin_user_pages(wq->pages, wq->npages);
+#else
+  {
+    unsigned int i;
+
+    for (i = 0; i < wq->npages; i++)
+    {
+      put_page(wq->pages[i]);
+    }
+  }
+#endif
+  kfree(wq->pages);
+  wq->pages = NULL;
+  wq->npages = 0;
+  wq->page_length = 0;
+}
+
+void 
+gaps_ilip_copy_from_pages
+(
+  void * dst, 
+  struct gaps_ilip_copy_workqueue * wq, 
+  size_t len
+)
+{
+  unsigned long offset = wq->page_offset;
+  struct page ** page = wq->pages;
+  char * d = (char *)dst;
+
+  while (len > 0)
+  {
+    size_t n = min_t(size_t, len, PAGE_SIZE - offset);
+    char * src = kmap(*page);
+
+    memcpy(d, src + offset, n);
+    kunmap(*page);
+    d += n;
+    len -= n;
+    offset = 0;
+    page++;
+  }
+}
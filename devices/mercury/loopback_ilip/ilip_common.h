@@ -175,6 +175,11 @@ struct gaps_ilip_copy_workqueue
   size_t length;
   struct work_struct workqueue;
   struct workqueue_struct * wq;
+  /* User pages of the payload pinned by the write() call */
+  struct page ** pages;
+  unsigned int npages;
+  unsigned long page_offset;
+  size_t page_length;
   unsigned int end_marker;
 };
 
@@ -532,4 +537,101 @@ gaps_ilip_smb_match_fn
   void * arg
 );
 
+/** 
+ * @brief Length of the SipHash key in bytes 
+ */ 
+#define GAPS_ILIP_SIPHASH_KEY_SIZE (16)
+
+/**
+ * @brief SipHash-2-4 of the data, outlen is 1 for the 64-bit hash and 2 for 
+ *        the 128-bit hash. out[0] holds the first 8 bytes of the little 
+ *        endian encoded hash.
+ */
+extern void 
+gaps_ilip_siphash
+(
+  const uint64_t key[2], 
+  const void * data, 
+  size_t len, 
+  uint64_t * out, 
+  unsigned int outlen
+);
+
+/**
+ * @brief Derive the session key, the 128-bit SipHash of the big endian 
+ *        session tag under the key of the channel.
+ */
+extern void 
+gaps_ilip_siphash_session_key
+(
+  const uint8_t channel_key[GAPS_ILIP_SIPHASH_KEY_SIZE], 
+  uint32_t session_tag, 
+  uint64_t key[2]
+);
+
+/**
+ * @brief Verify the descriptor SipHash of a message. The hash covers the 
+ *        descriptor up to the hash with the ILIP time field as zero.
+ */
+extern bool 
+gaps_ilip_verify_desc_siphash
+(
+  const struct ilip_message * msg, 
+  const uint64_t key[2]
+);
+
+/**
+ * @brief Verify the 128-bit SipHash of the payload of a message 
+ */
+extern bool 
+gaps_ilip_verify_msg_siphash
+(
+  const struct ilip_message * msg, 
+  const void * payload, 
+  size_t len, 
+  const uint64_t key[2]
+);
+
+/**
+ * @brief Compute the hashes of a message, payload is NULL for an immediate 
+ *        message.
+ */
+extern void 
+gaps_ilip_sign_message
+(
+  struct ilip_message * msg, 
+  const void * payload, 
+  size_t len, 
+  const uint64_t key[2]
+);
+
+/**
+ * @brief Pin the user pages of a payload for the copy work queue. The copy 
+ *        runs in a kernel worker that cannot access the user address space.
+ */
+extern int 
+gaps_ilip_pin_user_buffer
+(
+  struct gaps_ilip_copy_workqueue * wq, 
+  uint64_t address, 
+  size_t len
+);
+
+extern void 
+gaps_ilip_unpin_user_buffer
+(
+  struct gaps_ilip_copy_workqueue * wq
+);
+
+/**
+ * @brief Copy len bytes of the pinned payload into dst 
+ */
+extern void 
+gaps_ilip_copy_from_pages
+(
+  void * dst, 
+  struct gaps_ilip_copy_workqueue * wq, 
+  size_t len
+);
+
 #endif /* !defined _MERCURY_ILIP_COMMON_H */
@@ -78,9 +78,19 @@ module_param(gaps_ilip_verbose_level, uint, S_IRUGO);
 MODULE_PARM_DESC(gaps_ilip_verbose_level, "ilip driver verbose mode, larger is more verbose, 0 is quiet");
 module_param(gaps_ilip_nt_verbose_level, uint, S_IRUGO);
 MODULE_PARM_DESC(gaps_ilip_nt_verbose_level, "ilip netlink driver verbose mode, larger is more verbose, 0 is quiet");
+static char * gaps_ilip_siphash_key = NULL;
+module_param(gaps_ilip_siphash_key, charp, S_IRUGO);
+MODULE_PARM_DESC(gaps_ilip_siphash_key, "SipHash key as 32 hex digits, messages must be authenticated when set");
 
 /* ================================================================ */
 
+/** 
+ * @brief Decoded gaps_ilip_siphash_key, messages are not authenticated when 
+ *        gaps_ilip_siphash_enabled is false 
+ */ 
+static uint8_t gaps_ilip_siphash_channel_key[GAPS_ILIP_SIPHASH_KEY_SIZE];
+static bool gaps_ilip_siphash_enabled = false;
+
 struct gaps_ilip_copy_workqueue gaps_ilip_queues[GAPS_ILIP_CHANNELS*GAPS_ILIP_MESSAGE_COUNT];
 EXPORT_SYMBOL(gaps_ilip_queues);
 
@@ -603,6 +613,9 @@ gaps_ilip_copy
   uint32_t read_driver_index_save; 
   uint32_t index;
   bool do_copy_first_time = false; 
+  uint64_t siphash_key[2]; 
+  void * payload_p = NULL; 
+  unsigned int payload_len = 0; 
   u64 t; 
 
   /* Cannot be NULL */ 
@@ -792,6 +805,19 @@ gaps_ilip_copy
     }
   }
 
+  /* Verify the descriptor hash when the messages are authenticated */ 
+  if (gaps_ilip_siphash_enabled == true)
+  { 
+    gaps_ilip_siphash_session_key(gaps_ilip_siphash_channel_key, 
+                                  msg->u.imm.header.session_tag, siphash_key); 
+    if (gaps_ilip_verify_desc_siphash(msg, siphash_key) == false)
+    { 
+      log_warn("ch %d - descriptor siphash invalid\n", channel);
+      gaps_ilip_copy_write_reject_count[channel]++; 
+      return; 
+    } 
+  } 
+
   /* Yes it can so set the ILIP time in the outgoing message, in microseconds to match the HW */ 
   msg->u.imm.time.ilip_time = (uint64_t)t/1000ul; 
   if (gaps_ilip_verbose_level > 8)
@@ -1004,64 +1030,38 @@ gaps_ilip_copy
     if ((channel >= 1) && (channel <= 3))
     {
       void * dst_p;
-      void * src_p;
       unsigned int len;
 
-      /* Calculate the source pointer */
-      src_p = (void *)(*(u64 *)(((char *)(cp->src_handle)->data) + 0x40));
-
       /* Calculate the destination pointer */
       dst_p = (void *)((char *)((cp->dst_handle)->data) + cp->dst->block_size);
 
       /* Calculate the length */
       len = ntohl(*(unsigned int *)((char *)((cp->src_handle)->data) + 0x3C));
 
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,3,0)
-      /* Ubuntu 19.10 */
-      if (access_ok(src_p, len) == 0)
-      {
-        log_warn("Address: %p, Count %d Invalid\n", src_p, len);
-        return;
-      }
-
-      if (access_ok(dst_p, len) == 0)
-      {
-        log_warn("Address: %p, Count %d Invalid\n", dst_p, len);
-        return;
-      }
-#else
-#if LINUX_VERSION_CODE == KERNEL_VERSION(4,18,0)
-      /* RedHat 8.x */
-      if (access_ok(src_p, len) == 0)
-      {
-        log_warn("Address: %p, Count %d Invalid\n", src_p, len);
-        return;
-      }
-
-      if (access_ok(dst_p, len) == 0)
-      {
-        log_warn("Address: %p, Count %d Invalid\n", dst_p, len);
-        return;
-      }
-#else
-      /* RedHat 7.x */
-      if (access_ok(VERIFY_READ, src_p, len) == 0)
+      /**
+       * Emulate the DMA from host_payload_address. The work queue has no 
+       * user address space so the write() call pinned the user pages.
+       */
+      if (len > cp->page_length)
       {
-        log_warn("Address: %p, Count %d Invalid\n", src_p, len);
+        log_warn("Count %u exceeds the pinned payload %lu\n", len, 
+                 (unsigned long)cp->page_length);
+        iops.free_buffer(cp->dst, cp->dst_handle);
+        gaps_ilip_copy_write_reject_count[channel]++;
         return;
       }
+      gaps_ilip_copy_from_pages(dst_p, cp, len);
 
-      if (access_ok(VERIFY_WRITE, dst_p, len) == 0)
-      {
-        log_warn("Address: %p, Count %d Invalid\n", dst_p, len);
-        return;
-      }
-#endif
-#endif
+      payload_p = dst_p;
+      payload_len = len;
 
-      /* Copy the payload data */
-      if (copy_from_user(dst_p, src_p, len) != 0)
+      /* Verify the payload hash of the copied data */
+      if ((gaps_ilip_siphash_enabled == true) &&
+          (gaps_ilip_verify_msg_siphash(msg, dst_p, len, siphash_key) == false))
       {
+        log_warn("ch %d - message siphash invalid\n", channel);
+        iops.free_buffer(cp->dst, cp->dst_handle);
+        gaps_ilip_copy_write_reject_count[channel]++;
         return;
       }
     }
@@ -1069,6 +1069,13 @@ gaps_ilip_copy
     if (index != 0xffffffffu)
     {
       gaps_ilip_redact((cp->dst_handle)->data, index);
+
+      /* Redaction changes the message so the hashes are computed again */
+      if (gaps_ilip_siphash_enabled == true)
+      {
+        gaps_ilip_sign_message((struct ilip_message *)(cp->dst_handle)->data, 
+                               payload_p, payload_len, siphash_key);
+      }
     }
 
     /**
@@ -1178,6 +1185,19 @@ gaps_loopback_init_module(void)
   int j = 0;
   int k = 0;
   char wq_name[32];
+
+  /* Decode the SipHash key */
+  if ((gaps_ilip_siphash_key != NULL) && (gaps_ilip_siphash_key[0] != '\0'))
+  {
+    if ((strlen(gaps_ilip_siphash_key) != 2*GAPS_ILIP_SIPHASH_KEY_SIZE) ||
+        (hex2bin(gaps_ilip_siphash_channel_key, gaps_ilip_siphash_key, 
+                 GAPS_ILIP_SIPHASH_KEY_SIZE) != 0))
+    {
+      log_warn("gaps_ilip_siphash_key must be %d hex digits\n", 2*GAPS_ILIP_SIPHASH_KEY_SIZE);
+      return -EINVAL;
+    }
+    gaps_ilip_siphash_enabled = true;
+  }
   
   /* Allocate the array of devices, each session has a read and a write minor device */
   gaps_ilip_devices = (struct gaps_ilip_dev *)kzalloc(
@@ -1669,21 +1689,59 @@ ilip_loopback_read
     msg = (struct ilip_message *)((smb_t *)gaps_ilip_read_completions_fifo
              [channel][gaps_ilip_read_user_index[channel]])->data;
 
-    if (channel != 0)
+    if ((channel != 0) && (count == gaps_ilip_block_size))
     {
-      /* Get the length of the payload */
-      len += ntohl(msg->u.pay.payload.payload_len);
+      /**
+       * The reader passes the payload buffer in the host_payload_address 
+       * and payload_len fields of the descriptor, emulate the DMA of the 
+       * payload into that buffer and return the descriptor of the writer.
+       */
+      struct ilip_message req;
+      void __user * payload_p;
+      uint32_t payload_len;
+
+      if (copy_from_user(&req, buf, sizeof(req)) != 0)
+      {
+        retval = -EFAULT;
+        gaps_ilip_message_read_reject_count[channel]++;
+        goto out;
+      }
+      payload_p = (void __user *)(uintptr_t)req.u.pay.payload.payload_adr;
+      payload_len = min(ntohl(req.u.pay.payload.payload_len), 
+                        ntohl(msg->u.pay.payload.payload_len));
+      if ((payload_p == NULL) && (payload_len > 0))
+      {
+        retval = -EFAULT;
+        gaps_ilip_message_read_reject_count[channel]++;
+        goto out;
+      }
+      if ((copy_to_user(payload_p, (char *)msg + gaps_ilip_block_size, payload_len) != 0) ||
+          (copy_to_user(buf, msg, gaps_ilip_block_size) != 0))
+      {
+        retval = -EFAULT;
+        gaps_ilip_message_read_reject_count[channel]++;
+        goto out;
+      }
+      count = gaps_ilip_block_size + payload_len;
     }
+    else
+    {
+      if (channel != 0)
+      {
+        /* Get the length of the payload */
+        len += ntohl(msg->u.pay.payload.payload_len);
+      }
 
-    /* Adjust count to be not greater than the total message length */
-    count = (count > len) ? len : count;
+      /* Adjust count to be not greater than the total message length */
+      count = (count > len) ? len : count;
 
-    if (copy_to_user(buf, (void *)((smb_t *)gaps_ilip_read_completions_fifo[channel][gaps_ilip_read_user_index[channel]])->data, count) != 0)
-    {
-      retval = -EFAULT;
-      gaps_ilip_message_read_reject_count[channel]++;
-      goto out;
-    } 
+      if (copy_to_user(buf, (void *)msg, count) != 0)
+      {
+        retval = -EFAULT;
+        gaps_ilip_message_read_reject_count[channel]++;
+        goto out;
+      } 
+    }
     
     /* Clear the entry in the FIFO */
     iops.free_buffer(gaps_dev, (smb_t *)gaps_ilip_read_completions_fifo[channel][gaps_ilip_read_user_index[channel]]);
@@ -1801,4 +1859,4 @@ module_init(gaps_loopback_init_module);
 module_exit(gaps_loopback_exit_module);
 
 /* ================================================================ */
-
+
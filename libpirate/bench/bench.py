@@ -38,6 +38,7 @@ def main():
     p.add_argument("-i", "--iterations", help="Number of iterations for each test size", type=int)
     p.add_argument("-d", "--packet_delay", help="Inter-packet delay in nanoseconds", type=float, default=0)
     p.add_argument("-w", "--receive_timeout", help="Receive timeout in seconds", type=int, default=2)
+    p.add_argument("-b", "--batch", help="Messages per read or write for thr", type=int, default=1)
     p.add_argument("-v", "--validate", help="Validate received packets", action="store_true")
     args = p.parse_args()
 
@@ -83,6 +84,9 @@ def main():
         if args.validate:
             test_args.append("-v")
 
+        if args.test_type == "thr" and args.batch > 1:
+            test_args += ["-b", str(args.batch)]
+
         for _ in range(args.iterations):
             if args.role == "both" or args.role == "writer":
                 writer_proc = subprocess.Popen(["./" + writer_app] + test_args)
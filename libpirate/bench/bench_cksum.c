@@ -0,0 +1,79 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+// Compares the Internet checksum kernels of the UDP_SHMEM channel type
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "checksum.h"
+
+static const char *cksum_names[] = { "scalar", "sse2", "avx2", "avx512" };
+
+static const size_t cksum_sizes[] = { 64, 256, 1024, 1500, 4096, 9216 };
+
+#define NUM_KERNELS (sizeof(cksum_names) / sizeof(cksum_names[0]))
+#define NUM_SIZES (sizeof(cksum_sizes) / sizeof(cksum_sizes[0]))
+
+// bytes processed by each measurement
+#define BENCH_CKSUM_BYTES (1024ull << 20)
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t total = BENCH_CKSUM_BYTES;
+    static uint8_t data[9216];
+    volatile uint16_t sink = 0;
+
+    if (argc > 1) {
+        total = strtoull(argv[1], NULL, 10) << 20;
+    }
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = rand();
+    }
+
+    printf("selected kernel: %s\n", cksum_kernel_name());
+    printf("%8s", "size");
+    for (size_t i = 0; i < NUM_KERNELS; i++) {
+        printf(" %12s", cksum_names[i]);
+    }
+    printf("   (MB/sec)\n");
+
+    for (size_t s = 0; s < NUM_SIZES; s++) {
+        const size_t len = cksum_sizes[s];
+        const uint64_t iter = total / len;
+        printf("%8zu", len);
+        for (size_t i = 0; i < NUM_KERNELS; i++) {
+            cksum_kernel_t kernel = cksum_get_kernel(cksum_names[i]);
+            if (kernel == NULL) {
+                printf(" %12s", "-");
+                continue;
+            }
+            uint64_t start = monotonic_ns();
+            for (uint64_t j = 0; j < iter; j++) {
+                sink ^= kernel(data, len);
+            }
+            uint64_t elapsed = monotonic_ns() - start;
+            printf(" %12.1f", (iter * len * 1000.0) / elapsed);
+        }
+        printf("\n");
+    }
+    (void) sink;
+    return 0;
+}
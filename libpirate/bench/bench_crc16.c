@@ -0,0 +1,84 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+// Compares the CRC-16 implementations of the GE_ETH channel type.
+// The byte-at-a-time implementation is the original implementation.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "crc16.h"
+
+typedef uint16_t (*crc16_func_t)(uint16_t crc, const void *data, size_t len);
+
+static const struct {
+    const char *name;
+    crc16_func_t func;
+} crc16_impls[] = {
+    { "bytewise", pirate_crc16_update_bytewise },
+    { "slice8", pirate_crc16_update_slice8 },
+    { "clmul", pirate_crc16_update_clmul },
+};
+
+static const size_t crc16_sizes[] = { 64, 256, 1024, 1454, 4096, 9216 };
+
+#define NUM_IMPLS (sizeof(crc16_impls) / sizeof(crc16_impls[0]))
+#define NUM_SIZES (sizeof(crc16_sizes) / sizeof(crc16_sizes[0]))
+
+// bytes processed by each measurement
+#define BENCH_CRC16_BYTES (256ull << 20)
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t total = BENCH_CRC16_BYTES;
+    static uint8_t data[9216];
+    volatile uint16_t sink = 0;
+
+    if (argc > 1) {
+        total = strtoull(argv[1], NULL, 10) << 20;
+    }
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = rand();
+    }
+
+    printf("pclmulqdq: %s\n", pirate_crc16_clmul_supported() ? "yes" : "no");
+    printf("%8s", "size");
+    for (size_t i = 0; i < NUM_IMPLS; i++) {
+        printf(" %12s", crc16_impls[i].name);
+    }
+    printf("   (MB/sec)\n");
+
+    for (size_t s = 0; s < NUM_SIZES; s++) {
+        const size_t len = crc16_sizes[s];
+        const uint64_t iter = total / len;
+        printf("%8zu", len);
+        for (size_t i = 0; i < NUM_IMPLS; i++) {
+            uint64_t start = monotonic_ns();
+            for (uint64_t j = 0; j < iter; j++) {
+                sink ^= crc16_impls[i].func(PIRATE_CRC16_INIT, data, len);
+            }
+            uint64_t elapsed = monotonic_ns() - start;
+            printf(" %12.1f", (iter * len * 1000.0) / elapsed);
+        }
+        printf("\n");
+    }
+    (void) sink;
+    return 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+// Compares the GF(2^8) implementations of the Reed-Solomon
+// encoder of the reliable=fec option, and measures the decoder.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "fec.h"
+
+typedef void (*gf256_func_t)(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+
+static const struct {
+    const char *name;
+    gf256_func_t func;
+} gf256_impls[] = {
+    { "table", pirate_gf256_mul_add_table },
+    { "ssse3", pirate_gf256_mul_add_ssse3 },
+    { "avx2", pirate_gf256_mul_add_avx2 },
+};
+
+static const struct {
+    unsigned k;
+    unsigned m;
+} fec_configs[] = { { 4, 1 }, { 4, 2 }, { 8, 2 }, { 16, 4 }, { 32, 8 } };
+
+#define NUM_IMPLS   (sizeof(gf256_impls) / sizeof(gf256_impls[0]))
+#define NUM_CONFIGS (sizeof(fec_configs) / sizeof(fec_configs[0]))
+
+// data bytes encoded by each measurement
+#define BENCH_FEC_BYTES (256ull << 20)
+#define BENCH_FEC_PACKET 1400
+
+static uint8_t data[32][BENCH_FEC_PACKET];
+static uint8_t parity[8][BENCH_FEC_PACKET];
+static uint8_t out[8][BENCH_FEC_PACKET];
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void encode(gf256_func_t func, unsigned k, unsigned m) {
+    for (unsigned row = 0; row < m; row++) {
+        for (unsigned col = 0; col < k; col++) {
+            func(parity[row], data[col], pirate_fec_coef(row, col), BENCH_FEC_PACKET);
+        }
+    }
+}
+
+// The first m data packets are lost
+static void decode(unsigned k, unsigned m) {
+    unsigned rows[8], cols[8];
+    uint8_t *synd[8], *outp[8];
+
+    for (unsigned i = 0; i < m; i++) {
+        rows[i] = i;
+        cols[i] = i;
+        synd[i] = parity[i];
+        outp[i] = out[i];
+        for (unsigned col = m; col < k; col++) {
+            pirate_gf256_mul_add(synd[i], data[col], pirate_fec_coef(i, col), BENCH_FEC_PACKET);
+        }
+    }
+    pirate_fec_solve(rows, cols, m, synd, outp, BENCH_FEC_PACKET);
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t total = BENCH_FEC_BYTES;
+
+    if (argc > 1) {
+        total = strtoull(argv[1], NULL, 10) << 20;
+    }
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i / BENCH_FEC_PACKET][i % BENCH_FEC_PACKET] = rand();
+    }
+
+    printf("gf256: %s\n", pirate_gf256_impl());
+    printf("%8s", "fec");
+    for (size_t i = 0; i < NUM_IMPLS; i++) {
+        printf(" %12s", gf256_impls[i].name);
+    }
+    printf(" %12s   (MB/sec of data)\n", "decode");
+
+    for (size_t c = 0; c < NUM_CONFIGS; c++) {
+        const unsigned k = fec_configs[c].k, m = fec_configs[c].m;
+        const uint64_t iter = total / (k * BENCH_FEC_PACKET);
+        char name[16];
+        snprintf(name, sizeof(name), "%u:%u", k, m);
+        printf("%8s", name);
+        for (size_t i = 0; i < NUM_IMPLS; i++) {
+            uint64_t start = monotonic_ns();
+            for (uint64_t j = 0; j < iter; j++) {
+                encode(gf256_impls[i].func, k, m);
+            }
+            uint64_t elapsed = monotonic_ns() - start;
+            printf(" %12.1f", (iter * k * BENCH_FEC_PACKET * 1000.0) / elapsed);
+        }
+        uint64_t start = monotonic_ns();
+        for (uint64_t j = 0; j < iter; j++) {
+            decode(k, m);
+        }
+        uint64_t elapsed = monotonic_ns() - start;
+        printf(" %12.1f\n", (iter * k * BENCH_FEC_PACKET * 1000.0) / elapsed);
+    }
+    return 0;
+}
@@ -184,7 +184,7 @@ static int bench_lat_open(bench_lat_t *bench, const char *config, int flags) {
     }
 
     gd = pirate_open_param(&param, flags);
-    if (gd < 0) {
+    if (gd == -1) {
         snprintf(bench->err_msg, sizeof(bench->err_msg),
                     "Unable to open test channel \"%s\"",
                     config);
@@ -276,10 +276,10 @@ int bench_lat_setup(bench_lat_t *bench, int test_flags1, int test_flags2, int sy
     }
 
     /* Open the test channels */
-    if ((bench->test_ch1.gd = bench_lat_open(bench, bench->test_ch1.config, test_flags1)) < 0) {
+    if ((bench->test_ch1.gd = bench_lat_open(bench, bench->test_ch1.config, test_flags1)) == -1) {
         return -1;
     }
-    if ((bench->test_ch2.gd = bench_lat_open(bench, bench->test_ch2.config, test_flags2)) < 0) {
+    if ((bench->test_ch2.gd = bench_lat_open(bench, bench->test_ch2.config, test_flags2)) == -1) {
         return -1;
     }
 
@@ -313,13 +313,13 @@ void bench_lat_close(bench_lat_t *bench) {
         bench->write_buffer = NULL;
     }
 
-    if ((bench->test_ch1.gd >= 0) && (pirate_close(bench->test_ch1.gd) < 0)) {
+    if ((bench->test_ch1.gd != -1) && (pirate_close(bench->test_ch1.gd) < 0)) {
         snprintf(bench->err_msg, sizeof(bench->err_msg),
                     "Unable to close test channel 1 %s", bench->test_ch1.config);
         perror(bench->err_msg);
     }
 
-    if ((bench->test_ch2.gd >= 0) && (pirate_close(bench->test_ch2.gd) < 0)) {
+    if ((bench->test_ch2.gd != -1) && (pirate_close(bench->test_ch2.gd) < 0)) {
         snprintf(bench->err_msg, sizeof(bench->err_msg),
                     "Unable to close test channel 2 %s", bench->test_ch2.config);
         perror(bench->err_msg);
@@ -0,0 +1,146 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+// Measures the throughput and the latency of a SHMEM_MPMC channel
+// with 1 to 8 producer processes and a single consumer. Each packet
+// carries the time at which it was written.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "libpirate.h"
+
+static const unsigned mpmc_producers[] = { 1, 2, 4, 8 };
+
+#define NUM_PRODUCERS (sizeof(mpmc_producers) / sizeof(mpmc_producers[0]))
+
+// packets written by each producer
+#define BENCH_MPMC_PACKETS 200000
+
+#define BENCH_MPMC_CONFIG "shmem_mpmc,/gaps.bench_mpmc,slots=1024,slot_size=1024"
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+static void producer(uint64_t packets, size_t len) {
+    uint8_t buf[1024];
+    int gd;
+
+    memset(buf, 0, sizeof(buf));
+    if ((gd = pirate_open_parse(BENCH_MPMC_CONFIG, O_WRONLY)) == -1) {
+        perror("pirate_open_parse writer");
+        _exit(1);
+    }
+    for (uint64_t i = 0; i < packets; i++) {
+        uint64_t now = monotonic_ns();
+        memcpy(buf, &now, sizeof(now));
+        if (pirate_write(gd, buf, len) != (ssize_t) len) {
+            perror("pirate_write");
+            _exit(1);
+        }
+    }
+    pirate_close(gd);
+    _exit(0);
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t packets = BENCH_MPMC_PACKETS;
+    size_t len = 64;
+    uint8_t buf[1024];
+    uint64_t *latency;
+
+    if (argc > 1) {
+        packets = strtoull(argv[1], NULL, 10);
+    }
+    if (argc > 2) {
+        len = strtoul(argv[2], NULL, 10);
+    }
+    if ((len < sizeof(uint64_t)) || (len > sizeof(buf))) {
+        fprintf(stderr, "packet size must be between %zu and %zu\n", sizeof(uint64_t), sizeof(buf));
+        return 1;
+    }
+    latency = malloc(packets * mpmc_producers[NUM_PRODUCERS - 1] * sizeof(uint64_t));
+    if (latency == NULL) {
+        perror("malloc");
+        return 1;
+    }
+
+    printf("%9s %12s %10s %10s %10s %10s\n", "producers", "packets/s", "MB/s", "p50", "p99", "max");
+    for (size_t p = 0; p < NUM_PRODUCERS; p++) {
+        const unsigned count = mpmc_producers[p];
+        const uint64_t total = packets * count;
+        uint64_t start, elapsed;
+        int gd, status, err = 0;
+
+        for (unsigned i = 0; i < count; i++) {
+            pid_t pid = fork();
+            if (pid < 0) {
+                perror("fork");
+                return 1;
+            } else if (pid == 0) {
+                producer(packets, len);
+            }
+        }
+        if ((gd = pirate_open_parse(BENCH_MPMC_CONFIG, O_RDONLY)) == -1) {
+            perror("pirate_open_parse reader");
+            return 1;
+        }
+        start = monotonic_ns();
+        for (uint64_t i = 0; i < total; i++) {
+            uint64_t sent;
+            if (pirate_read(gd, buf, sizeof(buf)) != (ssize_t) len) {
+                perror("pirate_read");
+                return 1;
+            }
+            memcpy(&sent, buf, sizeof(sent));
+            latency[i] = monotonic_ns() - sent;
+        }
+        elapsed = monotonic_ns() - start;
+        for (unsigned i = 0; i < count; i++) {
+            if ((wait(&status) < 0) || !WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+                err = 1;
+            }
+        }
+        pirate_close(gd);
+        if (err) {
+            fprintf(stderr, "producer failed\n");
+            return 1;
+        }
+
+        qsort(latency, total, sizeof(uint64_t), compare_u64);
+        printf("%9u %12.0f %10.1f %10lu %10lu %10lu\n", count,
+            (total * 1e9) / elapsed,
+            (total * len * 1000.0) / elapsed,
+            latency[total / 2], latency[(total * 99) / 100], latency[total - 1]);
+    }
+    printf("(latency in nanoseconds from pirate_write() to the return of pirate_read())\n");
+    free(latency);
+    return 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+// Compares the cost of packing a MERCURY payload with and without
+// authentication. The unauthenticated writer copies the payload
+// after the DMA descriptor. The authenticated writer also computes
+// the 128-bit SipHash of the payload and the 64-bit SipHash of the
+// descriptor.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "libpirate.h"
+#include "siphash.h"
+
+static const size_t siphash_sizes[] = { 64, 192, 1024, 4096, 16384, 65536 };
+
+#define NUM_SIZES (sizeof(siphash_sizes) / sizeof(siphash_sizes[0]))
+
+// bytes processed by each measurement
+#define BENCH_SIPHASH_BYTES (256ull << 20)
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t total = BENCH_SIPHASH_BYTES;
+    static uint8_t data[65536];
+    static uint8_t buf[PIRATE_MERCURY_DMA_DESCRIPTOR + 65536];
+    const size_t desc_len = PIRATE_MERCURY_DMA_DESCRIPTOR - sizeof(uint64_t);
+    pirate_siphash_key_t key = { 0x0706050403020100ull, 0x0f0e0d0c0b0a0908ull };
+    volatile uint64_t sink = 0;
+
+    if (argc > 1) {
+        total = strtoull(argv[1], NULL, 10) << 20;
+    }
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = rand();
+    }
+
+    printf("%8s %12s %12s %12s %8s\n", "size", "copy", "siphash", "copy+auth", "ratio");
+    for (size_t s = 0; s < NUM_SIZES; s++) {
+        const size_t len = siphash_sizes[s];
+        const uint64_t iter = total / len;
+        uint64_t start, copy_ns, hash_ns, auth_ns;
+        uint64_t hash[2];
+
+        start = monotonic_ns();
+        for (uint64_t j = 0; j < iter; j++) {
+            memcpy(buf + PIRATE_MERCURY_DMA_DESCRIPTOR, data, len);
+            sink ^= buf[j % len];
+        }
+        copy_ns = monotonic_ns() - start;
+
+        start = monotonic_ns();
+        for (uint64_t j = 0; j < iter; j++) {
+            pirate_siphash128(&key, data, len, hash);
+            sink ^= hash[0];
+        }
+        hash_ns = monotonic_ns() - start;
+
+        start = monotonic_ns();
+        for (uint64_t j = 0; j < iter; j++) {
+            memcpy(buf + PIRATE_MERCURY_DMA_DESCRIPTOR, data, len);
+            pirate_siphash128(&key, buf + PIRATE_MERCURY_DMA_DESCRIPTOR, len, hash);
+            memcpy(buf, hash, sizeof(hash));
+            sink ^= pirate_siphash64(&key, buf, desc_len);
+        }
+        auth_ns = monotonic_ns() - start;
+
+        printf("%8zu %12.1f %12.1f %12.1f %8.2f\n", len,
+            (iter * len * 1000.0) / copy_ns,
+            (iter * len * 1000.0) / hash_ns,
+            (iter * len * 1000.0) / auth_ns,
+            (double) auth_ns / copy_ns);
+    }
+    printf("(MB/sec, ratio is the time of copy+auth over copy)\n");
+    (void) sink;
+    return 0;
+}
@@ -39,6 +39,7 @@ typedef struct {
     bench_channel_t sync_ch2;
     uint64_t nbytes;
     size_t message_len;
+    unsigned batch;
     int validate;
     uint64_t tx_delay_ns;
     uint32_t rx_timeout_s;
@@ -31,6 +31,7 @@ static struct argp_option options[] = {
     { "sync2",       'S', "CONFIG", 0, "Sync channel 2 configuration",  0 },
     { "nbytes",      'n', "BYTES",  0, "Number of bytes to receive",    0 },
     { "message_len", 'm', "BYTES",  0, "Transfer message size",         0 },
+    { "batch",       'b', "N",      0, "Messages per read or write",    0 },
     { "validate",    'v', NULL,     0, "Validate received data",        0 },
     { "tx_delay",    'd', "NSEC",   0, "Inter-message delay",           0 },
     { "rx_timeout",  'w', "SEC",    0, "Message receive timeout",       0 },
@@ -70,6 +71,16 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
         }
         break;
 
+    case 'b':
+        bench->batch = strtol(arg, &endptr, 10);
+        if (*endptr != '\0') {
+            argp_error(state, "Unable to parse numeric value from \"%s\"\n", arg);
+        }
+        if ((bench->batch < 1) || (bench->batch > PIRATE_IOV_MAX)) {
+            argp_error(state, "Batch size must be between 1 and %d", PIRATE_IOV_MAX);
+        }
+        break;
+
     case 'v':
         bench->validate = 1;
         break;
@@ -129,6 +140,7 @@ void parse_args(int argc, char *argv[], bench_thr_t *bench) {
     bench->sync_ch2.gd     = -1;
     bench->nbytes          = 1024;
     bench->message_len     = 128;
+    bench->batch           = 1;
     bench->validate        = 0;
     bench->tx_delay_ns     = 0;
     bench->rx_timeout_s    = 2;
@@ -178,7 +190,7 @@ static int bench_thr_open(bench_thr_t *bench, int flags) {
     }
 
     bench->test_ch.gd = pirate_open_param(&param, flags);
-    if (bench->test_ch.gd < 0) {
+    if (bench->test_ch.gd == -1) {
         snprintf(bench->err_msg, sizeof(bench->err_msg),
                     "Unable to open test channel \"%s\"",
                     bench->test_ch.config);
@@ -295,7 +307,7 @@ void bench_thr_close(bench_thr_t *bench) {
         bench->buffer = NULL;
     }
 
-    if ((bench->test_ch.gd >= 0) && (pirate_close(bench->test_ch.gd) < 0)) {
+    if ((bench->test_ch.gd != -1) && (pirate_close(bench->test_ch.gd) < 0)) {
         snprintf(bench->err_msg, sizeof(bench->err_msg),
                     "Unable to close test channel %s", bench->test_ch.config);
         perror(bench->err_msg);
@@ -31,6 +31,7 @@ int run(bench_thr_t *bench) {
     uint64_t delta;
     int timeout = 0;
     uint8_t signal = 1;
+    pirate_stats_ex_t stats;
 
     /* Open and configure synchronization and test channels */
     if (bench_thr_setup(bench, O_RDONLY, O_RDONLY, O_WRONLY)) {
@@ -54,7 +55,7 @@ int run(bench_thr_t *bench) {
         return -1;
     }
 
-    for (uint32_t i = 0; i < iter && !timeout; i++) {
+    for (uint32_t i = 0; (bench->batch == 1) && (i < iter) && !timeout; i++) {
         size_t count = bench->message_len;
         while (count > 0) {
             rv = pirate_read(bench->test_ch.gd, bench->buffer + read_off, count);
@@ -73,6 +74,36 @@ int run(bench_thr_t *bench) {
         }
     }
 
+    while ((bench->batch > 1) && (read_off < bench->nbytes)) {
+        pirate_mmsg_t msgs[PIRATE_IOV_MAX];
+        uint64_t off = read_off;
+        unsigned n;
+        // each message ends at the next message boundary
+        for (n = 0; (n < bench->batch) && (off < bench->nbytes); n++) {
+            msgs[n].buf = bench->buffer + off;
+            msgs[n].count = bench->message_len - (off % bench->message_len);
+            off += msgs[n].count;
+        }
+        rv = pirate_read_batch(bench->test_ch.gd, msgs, n);
+        if (rv < 0) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                errno = 0;
+                timeout = 1;
+                break;
+            }
+            perror("Test channel read error");
+            return -1;
+        }
+        // short messages leave gaps that are closed up
+        for (n = 0; (ssize_t) n < rv; n++) {
+            if (msgs[n].buf != bench->buffer + read_off) {
+                memmove(bench->buffer + read_off, msgs[n].buf, msgs[n].len);
+            }
+            read_off += msgs[n].len;
+            packet_count++;
+        }
+    }
+
     if (clock_gettime(CLOCK_MONOTONIC, &stop) < 0) {
         perror("clock_gettime stop");
         return -1;
@@ -144,6 +175,11 @@ int run(bench_thr_t *bench) {
            (1e9 * packet_count) / delta);
     printf("drop rate: %f %%\n",
         ((bench->nbytes - read_off) / ((float) (bench->nbytes))) * 100.0);
+    if ((pirate_get_stats_ex(bench->test_ch.gd, &stats) == 0) &&
+        ((stats.recovered > 0) || (stats.lost > 0))) {
+        printf("recovered packets: %lu\n", stats.recovered);
+        printf("lost messages: %lu\n", stats.lost);
+    }
 
     return 0;
 }
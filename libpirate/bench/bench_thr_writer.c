@@ -105,7 +105,7 @@ int run(bench_thr_t *bench) {
         return -1;
     }
 
-    for (uint32_t i = 0; i < iter; i++) {
+    for (uint32_t i = 0; (bench->batch == 1) && (i < iter); i++) {
         size_t count = bench->message_len;
         while (count > 0) {
             rv = pirate_write(bench->test_ch.gd, bench->buffer + write_off, count);
@@ -123,6 +123,31 @@ int run(bench_thr_t *bench) {
         }
     }
 
+    while ((bench->batch > 1) && (write_off < bench->nbytes)) {
+        pirate_mmsg_t msgs[PIRATE_IOV_MAX];
+        uint64_t off = write_off;
+        unsigned n;
+        // each message ends at the next message boundary
+        for (n = 0; (n < bench->batch) && (off < bench->nbytes); n++) {
+            msgs[n].buf = bench->buffer + off;
+            msgs[n].count = bench->message_len - (off % bench->message_len);
+            off += msgs[n].count;
+        }
+        rv = pirate_write_batch(bench->test_ch.gd, msgs, n);
+        if (rv < 0) {
+            perror("Test channel write error");
+            return -1;
+        }
+        for (n = 0; (ssize_t) n < rv; n++) {
+            write_off += msgs[n].len;
+        }
+        if (bench->tx_delay_ns >= 1000000000) {
+            nanosleep(&ts, NULL);
+        } else if (bench->tx_delay_ns > 0) {
+            busysleep(bench->tx_delay_ns);
+        }
+    }
+
     /* Read sync from the reader */
     rv = pirate_read(bench->sync_ch2.gd, &signal, sizeof(signal));
     if (rv < 0) {
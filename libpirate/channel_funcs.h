@@ -16,6 +16,10 @@
 #ifndef __PIRATE_CHANNEL_FUNCS_H
 #define __PIRATE_CHANNEL_FUNCS_H
 
+#include <sys/uio.h>
+
+#include "libpirate.h"
+
 typedef int (*pirate_parse_param_t)(char *str, void *_param);
 typedef int (*pirate_get_channel_description_t)(const void *_param, char *desc, int len);
 typedef int (*pirate_open_t)(void *_param, void *ctx);
@@ -23,6 +27,14 @@ typedef int (*pirate_close_t)(void *_ctx);
 typedef ssize_t (*pirate_read_t)(const void *_param, void *_ctx, void *buf, size_t count);
 typedef ssize_t (*pirate_write_t)(const void *_param, void *_ctx, const void *buf, size_t count);
 typedef ssize_t (*pirate_write_mtu_t)(const void *_param, void *_ctx);
+typedef ssize_t (*pirate_write_reserve_t)(const void *_param, void *_ctx, size_t count, struct iovec *iov);
+typedef ssize_t (*pirate_write_commit_t)(const void *_param, void *_ctx, size_t count);
+typedef ssize_t (*pirate_read_acquire_t)(const void *_param, void *_ctx, struct iovec *iov);
+typedef int (*pirate_read_release_t)(const void *_param, void *_ctx);
+typedef ssize_t (*pirate_write_batch_t)(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen);
+typedef ssize_t (*pirate_read_batch_t)(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen);
+typedef ssize_t (*pirate_writev_t)(const void *_param, void *_ctx, const struct iovec *iov, int iovcnt);
+typedef ssize_t (*pirate_peek_len_t)(const void *_param, void *_ctx);
 
 typedef struct {
     pirate_parse_param_t parse_param;
@@ -32,6 +44,14 @@ typedef struct {
     pirate_read_t read;
     pirate_write_t write;
     pirate_write_mtu_t write_mtu;
+    pirate_write_reserve_t write_reserve;
+    pirate_write_commit_t write_commit;
+    pirate_read_acquire_t read_acquire;
+    pirate_read_release_t read_release;
+    pirate_write_batch_t write_batch;
+    pirate_read_batch_t read_batch;
+    pirate_writev_t writev;
+    pirate_peek_len_t peek_len;
 } pirate_channel_funcs_t;
 
 #endif // __PIRATE_CHANNEL_FUNCS_H
@@ -1,123 +1,228 @@
-/* Use of this source code is governed by the Apache 2.0 license; see COPYING.
- * Based on original SSE2 code by Tony Rogvall that is
- * copyright 2011 Teclo Networks AG. MIT licensed by Juho Snellman. */
-
-/* IP checksum routine for AVX2. Sources:
-   https://github.com/snabbco/snabb/blob/b9da7caa1928256a3b490867e9bc62dfbcd21ede/src/arch/avx2.c
-   https://github.com/snabbco/snabb/blob/9fdcb99934e46babf24b0cef0f375aab493fcfbe/src/lib/checksum.c
-*/
-
-#include <stdint.h>
-#include <arpa/inet.h>
-#include <x86intrin.h>
-
-uint16_t cksum_generic(unsigned char *p, size_t len, uint16_t initial) {
-  uint32_t sum = htons(initial);
-  const uint16_t *u16 = (const uint16_t *)p;
-
-  while (len >= (sizeof(*u16) * 4)) {
-    sum += u16[0];
-    sum += u16[1];
-    sum += u16[2];
-    sum += u16[3];
-    len -= sizeof(*u16) * 4;
-    u16 += 4;
-  }
-  while (len >= sizeof(*u16)) {
-    sum += *u16;
-    len -= sizeof(*u16);
-    u16 += 1;
-  }
-
-  /* if length is in odd bytes */
-  if (len == 1)
-    sum += *((const uint8_t *)u16);
-
-  while(sum>>16)
-    sum = (sum & 0xFFFF) + (sum>>16);
-  return ntohs((uint16_t)~sum);
-}
-
-static inline uint32_t cksum_ua_loop(unsigned char *p, uint16_t n) {
-  uint32_t s0 = 0;
-  uint32_t s1 = 0;
-
-  while (n) {
-    s0 += p[0];
-    s1 += p[1];
-    p += 2;
-    n--;
-  }
-  return (s0<<8)+s1;
-}
-
-static inline uint32_t cksum_avx2_loop(unsigned char *p, size_t n) {
-    __m256i sum0, sum1, zero;
-    uint32_t s[8] __attribute__((aligned(32))); // aligned for avx2 store
-    uint32_t sum2;
-
-    zero = _mm256_set_epi64x(0,0,0,0);
-    sum0 = zero;
-    sum1 = zero;
-
-    while(n) {
-        size_t k = (n >= 0xff) ? 0xff : n;
-        __m256i t0,t1;
-        __m256i s0 = zero;
-        __m256i s1 = zero;
-        n -= k;
-        while (k) {
-            __m256i src = _mm256_loadu_si256((__m256i const*) p);
-            __m256i t;
-
-            t = _mm256_unpacklo_epi8(src, zero);
-            s0 = _mm256_adds_epu16(s0, t);
-            t = _mm256_unpackhi_epi8(src, zero);
-            s1 = _mm256_adds_epu16(s1, t);
-            p += sizeof(src);
-            k--;
-        }
-
-        // LOW - combine S0 and S1 into sum0
-        t0 = _mm256_unpacklo_epi16(s0, zero);
-        sum0 = _mm256_add_epi32(sum0, t0);
-        t1 = _mm256_unpacklo_epi16(s1, zero);
-        sum1 = _mm256_add_epi32(sum1, t1);
-
-        // HIGH - combine S0 and S1 into sum1
-        t0 = _mm256_unpackhi_epi16(s0, zero);
-        sum0 = _mm256_add_epi32(sum0, t0);
-        t1 = _mm256_unpackhi_epi16(s1, zero);
-        sum1 = _mm256_add_epi32(sum1, t1);
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#include <string.h>
+#include "checksum.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define PIRATE_CKSUM_X86 1
+#include <immintrin.h>
+#endif
+
+// The vector kernels add 32-bit words into 64-bit lanes. The ones'
+// complement sum is independent of the word size and the byte order,
+// so the sum of little-endian 32-bit words is folded to 16 bits and
+// swapped to obtain the sum of big-endian 16-bit words.
+
+static cksum_kernel_t cksum_kernel = cksum_sum_scalar;
+static const char *cksum_name = "scalar";
+
+static inline uint16_t cksum_fold(uint64_t sum) {
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t) sum;
+}
+
+static inline uint16_t cksum_swap(uint16_t val) {
+    return (uint16_t) ((val >> 8) | (val << 8));
+}
+
+// Sum of the native 32-bit words of the tail, converted
+// to the sum of the big-endian 16-bit words.
+static inline uint16_t cksum_tail(const uint8_t *p, size_t n, uint64_t sum) {
+    uint64_t dword;
+    uint32_t word;
+    uint16_t half;
+
+    while (n >= sizeof(dword)) {
+        memcpy(&dword, p, sizeof(dword));
+        sum += (dword & 0xffffffff) + (dword >> 32);
+        p += sizeof(dword);
+        n -= sizeof(dword);
+    }
+    if (n >= sizeof(word)) {
+        memcpy(&word, p, sizeof(word));
+        sum += word;
+        p += sizeof(word);
+        n -= sizeof(word);
+    }
+    if (n >= sizeof(half)) {
+        memcpy(&half, p, sizeof(half));
+        sum += half;
+        p += sizeof(half);
+        n -= sizeof(half);
+    }
+    if (n > 0) {
+        // the odd byte is the high byte of a big-endian word
+        half = 0;
+        memcpy(&half, p, 1);
+        sum += half;
+    }
+    return ntohs(cksum_fold(sum));
+}
+
+uint16_t cksum_sum_scalar(const void *p, size_t n) {
+    return cksum_tail((const uint8_t *) p, n, 0);
+}
+
+#ifdef PIRATE_CKSUM_X86
+
+__attribute__((target("sse2")))
+uint16_t cksum_sum_sse2(const void *p, size_t n) {
+    const uint8_t *buf = (const uint8_t *) p;
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum0 = zero, sum1 = zero;
+    uint64_t s[2];
+
+    while (n >= 32) {
+        __m128i a = _mm_loadu_si128((const __m128i *) buf);
+        __m128i b = _mm_loadu_si128((const __m128i *) (buf + 16));
+        sum0 = _mm_add_epi64(sum0, _mm_unpacklo_epi32(a, zero));
+        sum1 = _mm_add_epi64(sum1, _mm_unpackhi_epi32(a, zero));
+        sum0 = _mm_add_epi64(sum0, _mm_unpacklo_epi32(b, zero));
+        sum1 = _mm_add_epi64(sum1, _mm_unpackhi_epi32(b, zero));
+        buf += 32;
+        n -= 32;
+    }
+    _mm_storeu_si128((__m128i *) s, _mm_add_epi64(sum0, sum1));
+    return cksum_tail(buf, n, (uint64_t) cksum_fold(s[0]) + cksum_fold(s[1]));
+}
+
+__attribute__((target("avx2")))
+uint16_t cksum_sum_avx2(const void *p, size_t n) {
+    const uint8_t *buf = (const uint8_t *) p;
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sum0 = zero, sum1 = zero;
+    uint64_t s[4];
+
+    while (n >= 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) buf);
+        __m256i b = _mm256_loadu_si256((const __m256i *) (buf + 32));
+        sum0 = _mm256_add_epi64(sum0, _mm256_unpacklo_epi32(a, zero));
+        sum1 = _mm256_add_epi64(sum1, _mm256_unpackhi_epi32(a, zero));
+        sum0 = _mm256_add_epi64(sum0, _mm256_unpacklo_epi32(b, zero));
+        sum1 = _mm256_add_epi64(sum1, _mm256_unpackhi_epi32(b, zero));
+        buf += 64;
+        n -= 64;
+    }
+    _mm256_storeu_si256((__m256i *) s, _mm256_add_epi64(sum0, sum1));
+    return cksum_tail(buf, n, (uint64_t) cksum_fold(s[0]) + cksum_fold(s[1]) +
+        cksum_fold(s[2]) + cksum_fold(s[3]));
+}
+
+__attribute__((target("avx512f")))
+uint16_t cksum_sum_avx512(const void *p, size_t n) {
+    const uint8_t *buf = (const uint8_t *) p;
+    const __m512i zero = _mm512_setzero_si512();
+    __m512i sum0 = zero, sum1 = zero;
+
+    while (n >= 128) {
+        __m512i a = _mm512_loadu_si512((const void *) buf);
+        __m512i b = _mm512_loadu_si512((const void *) (buf + 64));
+        sum0 = _mm512_add_epi64(sum0, _mm512_unpacklo_epi32(a, zero));
+        sum1 = _mm512_add_epi64(sum1, _mm512_unpackhi_epi32(a, zero));
+        sum0 = _mm512_add_epi64(sum0, _mm512_unpacklo_epi32(b, zero));
+        sum1 = _mm512_add_epi64(sum1, _mm512_unpackhi_epi32(b, zero));
+        buf += 128;
+        n -= 128;
+    }
+    return cksum_tail(buf, n, _mm512_reduce_add_epi64(_mm512_add_epi64(sum0, sum1)));
+}
+
+static void __attribute__((constructor)) cksum_select_kernel(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        cksum_kernel = cksum_sum_avx512;
+        cksum_name = "avx512";
+    } else if (__builtin_cpu_supports("avx2")) {
+        cksum_kernel = cksum_sum_avx2;
+        cksum_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        cksum_kernel = cksum_sum_sse2;
+        cksum_name = "sse2";
     }
-    // here we must sum the 4-32 bit sums into one 32 bit sum
-    _mm256_store_si256((__m256i*)s, sum0);
-    sum2 = (s[0]<<8) + s[1] + (s[2]<<8) + s[3] + (s[4]<<8) + s[5] + (s[6]<<8) + s[7];
-    _mm256_store_si256((__m256i*)s, sum1);
-    sum2 += (s[0]<<8) + s[1] + (s[2]<<8) + s[3] + (s[4]<<8) + s[5] + (s[6]<<8) + s[7];
+}
+
+cksum_kernel_t cksum_get_kernel(const char *name) {
+    __builtin_cpu_init();
+    if (strcmp(name, "scalar") == 0) {
+        return cksum_sum_scalar;
+    } else if ((strcmp(name, "sse2") == 0) && __builtin_cpu_supports("sse2")) {
+        return cksum_sum_sse2;
+    } else if ((strcmp(name, "avx2") == 0) && __builtin_cpu_supports("avx2")) {
+        return cksum_sum_avx2;
+    } else if ((strcmp(name, "avx512") == 0) && __builtin_cpu_supports("avx512f")) {
+        return cksum_sum_avx512;
+    }
+    return NULL;
+}
+
+#else
 
-    return sum2;
+uint16_t cksum_sum_sse2(const void *p, size_t n) {
+    return cksum_sum_scalar(p, n);
 }
 
-uint16_t cksum_avx2(unsigned char *p, size_t n, uint16_t initial) {
-    uint32_t sum = initial;
+uint16_t cksum_sum_avx2(const void *p, size_t n) {
+    return cksum_sum_scalar(p, n);
+}
 
-    if (n < 128) { return cksum_generic(p, n, initial); }
-    if (n >= 64) {
-        size_t k = (n >> 5);
-        sum += cksum_avx2_loop(p, k);
-        n -= (32*k);
-        p += (32*k);
+uint16_t cksum_sum_avx512(const void *p, size_t n) {
+    return cksum_sum_scalar(p, n);
+}
+
+cksum_kernel_t cksum_get_kernel(const char *name) {
+    if (strcmp(name, "scalar") == 0) {
+        return cksum_sum_scalar;
     }
-    if (n > 1) {
-        size_t k = (n>>1);   // number of 16-bit words
-        sum += cksum_ua_loop(p, k);
-        n -= (2*k);
-        p += (2*k);
+    return NULL;
+}
+
+#endif /* PIRATE_CKSUM_X86 */
+
+const char *cksum_kernel_name(void) {
+    return cksum_name;
+}
+
+void cksum_init(cksum_t *state, uint16_t initial) {
+    state->sum = initial;
+    state->odd = 0;
+}
+
+// A piece that starts at an odd offset contributes
+// its sum with the two bytes of each word swapped.
+void cksum_update(cksum_t *state, const void *p, size_t n) {
+    uint16_t sum = cksum_kernel(p, n);
+
+    if (state->odd) {
+        sum = cksum_swap(sum);
     }
-    if (n)       // take care of left over byte
-        sum += (p[0] << 8);
-    while(sum>>16)
-        sum = (sum & 0xFFFF) + (sum>>16);
-    return (uint16_t)~sum;
+    state->sum += sum;
+    state->odd ^= n & 1;
+}
+
+uint16_t cksum_final(const cksum_t *state) {
+    return (uint16_t) ~cksum_fold(state->sum);
+}
+
+uint16_t cksum(const void *p, size_t n, uint16_t initial) {
+    cksum_t state;
+
+    cksum_init(&state, initial);
+    cksum_update(&state, p, n);
+    return cksum_final(&state);
 }
@@ -13,12 +13,50 @@
  * Copyright 2019 Two Six Labs, LLC.  All rights reserved.
  */
 
+
 #ifndef __CHECKSUM_H
 #define __CHECKSUM_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <arpa/inet.h>
 
-uint16_t cksum_avx2(unsigned char *p, size_t n, uint16_t initial);
+// Internet checksum (RFC 1071). The checksum is returned in host byte
+// order, so the value is stored with htons() before it is written into
+// a packet header. The kernel is chosen when the library is loaded
+// from scalar, SSE2, AVX2, and AVX-512 implementations.
+
+// Running sum of a message that is checksummed in pieces.
+// A piece may have an odd length.
+typedef struct {
+    uint64_t sum;
+    unsigned odd;
+} cksum_t;
+
+// Returns the ones' complement sum of the 16-bit big-endian
+// words of p. An odd final byte is padded with zero.
+typedef uint16_t (*cksum_kernel_t)(const void *p, size_t n);
+
+uint16_t cksum_sum_scalar(const void *p, size_t n);
+uint16_t cksum_sum_sse2(const void *p, size_t n);
+uint16_t cksum_sum_avx2(const void *p, size_t n);
+uint16_t cksum_sum_avx512(const void *p, size_t n);
+
+// Returns the kernel with the given name ("scalar", "sse2",
+// "avx2", or "avx512"), or NULL when it is not supported by
+// the processor.
+cksum_kernel_t cksum_get_kernel(const char *name);
+
+// Returns the name of the kernel used by cksum_update()
+const char *cksum_kernel_name(void);
+
+// initial is the complement of a previous checksum, or 0
+void cksum_init(cksum_t *state, uint16_t initial);
+void cksum_update(cksum_t *state, const void *p, size_t n);
+uint16_t cksum_final(const cksum_t *state);
+
+// Checksum of n bytes starting at p. Equivalent to
+// cksum_init(), cksum_update(), and cksum_final().
+uint16_t cksum(const void *p, size_t n, uint16_t initial);
 
 #endif
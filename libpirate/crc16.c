@@ -0,0 +1,201 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#include <string.h>
+#include "crc16.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define PIRATE_CRC16_CLMUL 1
+#include <immintrin.h>
+#endif
+
+// Below this length the setup of the carry-less
+// multiplication is slower than table lookups
+#define PIRATE_CRC16_CLMUL_MIN 64
+
+static const uint16_t crc16_ccitt_table_reverse[256] =
+{
+ 0x0000, 0x1189, 0x2312, 0x329B, 0x4624, 0x57AD, 0x6536, 0x74BF,
+ 0x8C48, 0x9DC1, 0xAF5A, 0xBED3, 0xCA6C, 0xDBE5, 0xE97E, 0xF8F7,
+ 0x1081, 0x0108, 0x3393, 0x221A, 0x56A5, 0x472C, 0x75B7, 0x643E,
+ 0x9CC9, 0x8D40, 0xBFDB, 0xAE52, 0xDAED, 0xCB64, 0xF9FF, 0xE876,
+ 0x2102, 0x308B, 0x0210, 0x1399, 0x6726, 0x76AF, 0x4434, 0x55BD,
+ 0xAD4A, 0xBCC3, 0x8E58, 0x9FD1, 0xEB6E, 0xFAE7, 0xC87C, 0xD9F5,
+ 0x3183, 0x200A, 0x1291, 0x0318, 0x77A7, 0x662E, 0x54B5, 0x453C,
+ 0xBDCB, 0xAC42, 0x9ED9, 0x8F50, 0xFBEF, 0xEA66, 0xD8FD, 0xC974,
+ 0x4204, 0x538D, 0x6116, 0x709F, 0x0420, 0x15A9, 0x2732, 0x36BB,
+ 0xCE4C, 0xDFC5, 0xED5E, 0xFCD7, 0x8868, 0x99E1, 0xAB7A, 0xBAF3,
+ 0x5285, 0x430C, 0x7197, 0x601E, 0x14A1, 0x0528, 0x37B3, 0x263A,
+ 0xDECD, 0xCF44, 0xFDDF, 0xEC56, 0x98E9, 0x8960, 0xBBFB, 0xAA72,
+ 0x6306, 0x728F, 0x4014, 0x519D, 0x2522, 0x34AB, 0x0630, 0x17B9,
+ 0xEF4E, 0xFEC7, 0xCC5C, 0xDDD5, 0xA96A, 0xB8E3, 0x8A78, 0x9BF1,
+ 0x7387, 0x620E, 0x5095, 0x411C, 0x35A3, 0x242A, 0x16B1, 0x0738,
+ 0xFFCF, 0xEE46, 0xDCDD, 0xCD54, 0xB9EB, 0xA862, 0x9AF9, 0x8B70,
+ 0x8408, 0x9581, 0xA71A, 0xB693, 0xC22C, 0xD3A5, 0xE13E, 0xF0B7,
+ 0x0840, 0x19C9, 0x2B52, 0x3ADB, 0x4E64, 0x5FED, 0x6D76, 0x7CFF,
+ 0x9489, 0x8500, 0xB79B, 0xA612, 0xD2AD, 0xC324, 0xF1BF, 0xE036,
+ 0x18C1, 0x0948, 0x3BD3, 0x2A5A, 0x5EE5, 0x4F6C, 0x7DF7, 0x6C7E,
+ 0xA50A, 0xB483, 0x8618, 0x9791, 0xE32E, 0xF2A7, 0xC03C, 0xD1B5,
+ 0x2942, 0x38CB, 0x0A50, 0x1BD9, 0x6F66, 0x7EEF, 0x4C74, 0x5DFD,
+ 0xB58B, 0xA402, 0x9699, 0x8710, 0xF3AF, 0xE226, 0xD0BD, 0xC134,
+ 0x39C3, 0x284A, 0x1AD1, 0x0B58, 0x7FE7, 0x6E6E, 0x5CF5, 0x4D7C,
+ 0xC60C, 0xD785, 0xE51E, 0xF497, 0x8028, 0x91A1, 0xA33A, 0xB2B3,
+ 0x4A44, 0x5BCD, 0x6956, 0x78DF, 0x0C60, 0x1DE9, 0x2F72, 0x3EFB,
+ 0xD68D, 0xC704, 0xF59F, 0xE416, 0x90A9, 0x8120, 0xB3BB, 0xA232,
+ 0x5AC5, 0x4B4C, 0x79D7, 0x685E, 0x1CE1, 0x0D68, 0x3FF3, 0x2E7A,
+ 0xE70E, 0xF687, 0xC41C, 0xD595, 0xA12A, 0xB0A3, 0x8238, 0x93B1,
+ 0x6B46, 0x7ACF, 0x4854, 0x59DD, 0x2D62, 0x3CEB, 0x0E70, 0x1FF9,
+ 0xF78F, 0xE606, 0xD49D, 0xC514, 0xB1AB, 0xA022, 0x92B9, 0x8330,
+ 0x7BC7, 0x6A4E, 0x58D5, 0x495C, 0x3DE3, 0x2C6A, 0x1EF1, 0x0F78
+};
+
+// crc16_slice_table[k][i] is the contribution of byte i
+// followed by k zero bytes. Row 0 is crc16_ccitt_table_reverse.
+static uint16_t crc16_slice_table[8][256];
+
+typedef uint16_t (*pirate_crc16_func_t)(uint16_t crc, const void *data, size_t len);
+
+static pirate_crc16_func_t crc16_update_func = pirate_crc16_update_slice8;
+static int crc16_clmul = 0;
+
+static void __attribute__((constructor)) pirate_crc16_init(void) {
+    for (int i = 0; i < 256; i++) {
+        crc16_slice_table[0][i] = crc16_ccitt_table_reverse[i];
+    }
+    for (int k = 1; k < 8; k++) {
+        for (int i = 0; i < 256; i++) {
+            uint16_t prev = crc16_slice_table[k - 1][i];
+            crc16_slice_table[k][i] = (prev >> 8) ^ crc16_ccitt_table_reverse[prev & 0xff];
+        }
+    }
+#ifdef PIRATE_CRC16_CLMUL
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("pclmul")) {
+        crc16_clmul = 1;
+        crc16_update_func = pirate_crc16_update_clmul;
+    }
+#endif
+}
+
+uint16_t pirate_crc16_update(uint16_t crc, const void *data, size_t len) {
+    return crc16_update_func(crc, data, len);
+}
+
+int pirate_crc16_clmul_supported(void) {
+    return crc16_clmul;
+}
+
+uint16_t pirate_crc16_update_bytewise(uint16_t crc, const void *data, size_t len) {
+    const uint8_t *buf = (const uint8_t *) data;
+
+    while (len-- != 0) {
+        crc = crc16_ccitt_table_reverse[(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+uint16_t pirate_crc16_update_slice8(uint16_t crc, const void *data, size_t len) {
+    const uint8_t *buf = (const uint8_t *) data;
+
+    while (len >= 8) {
+        // The crc is xored into the first two bytes. Byte k
+        // is followed by 7 - k bytes in this block.
+        crc = crc16_slice_table[7][buf[0] ^ (crc & 0xff)] ^
+            crc16_slice_table[6][buf[1] ^ (crc >> 8)] ^
+            crc16_slice_table[5][buf[2]] ^
+            crc16_slice_table[4][buf[3]] ^
+            crc16_slice_table[3][buf[4]] ^
+            crc16_slice_table[2][buf[5]] ^
+            crc16_slice_table[1][buf[6]] ^
+            crc16_slice_table[0][buf[7]];
+        buf += 8;
+        len -= 8;
+    }
+    return pirate_crc16_update_bytewise(crc, buf, len);
+}
+
+#ifdef PIRATE_CRC16_CLMUL
+
+// Bit i of a 128-bit block is the coefficient of x^(127 - i) in the
+// reflected bit order. The constants are x^n mod P with the coefficient
+// of x^j in bit 63 - j. The product of two reflected operands is one
+// bit short of the block alignment, so each constant is x^(n - 1) mod P
+// where x^n is the distance that the folded block is moved.
+#define CRC16_X127_MOD_P 0x7eea000000000000ull
+#define CRC16_X191_MOD_P 0xa95d000000000000ull
+#define CRC16_X511_MOD_P 0x7f90000000000000ull
+#define CRC16_X575_MOD_P 0x9822000000000000ull
+
+// Returns a block congruent to x * x^128 mod P. The high half of
+// the constants register multiplies the low half of the block.
+__attribute__((target("pclmul,sse2")))
+static inline __m128i crc16_fold(__m128i x, __m128i k) {
+    return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x10),
+        _mm_clmulepi64_si128(x, k, 0x01));
+}
+
+__attribute__((target("pclmul,sse2")))
+uint16_t pirate_crc16_update_clmul(uint16_t crc, const void *data, size_t len) {
+    const uint8_t *buf = (const uint8_t *) data;
+    const __m128i k128 = _mm_set_epi64x(CRC16_X191_MOD_P, CRC16_X127_MOD_P);
+    const __m128i k512 = _mm_set_epi64x(CRC16_X575_MOD_P, CRC16_X511_MOD_P);
+    __m128i x0, x1, x2, x3;
+    uint8_t rem[16];
+
+    if (!crc16_clmul || (len < PIRATE_CRC16_CLMUL_MIN)) {
+        return pirate_crc16_update_slice8(crc, data, len);
+    }
+
+    // The initial crc is xored into the first two bytes of the
+    // message. The block is then congruent to the message so far.
+    x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) buf), _mm_cvtsi32_si128(crc));
+    x1 = _mm_loadu_si128((const __m128i *) (buf + 16));
+    x2 = _mm_loadu_si128((const __m128i *) (buf + 32));
+    x3 = _mm_loadu_si128((const __m128i *) (buf + 48));
+    buf += 64;
+    len -= 64;
+
+    // Four independent accumulators hide the latency of PCLMULQDQ
+    while (len >= 64) {
+        x0 = _mm_xor_si128(crc16_fold(x0, k512), _mm_loadu_si128((const __m128i *) buf));
+        x1 = _mm_xor_si128(crc16_fold(x1, k512), _mm_loadu_si128((const __m128i *) (buf + 16)));
+        x2 = _mm_xor_si128(crc16_fold(x2, k512), _mm_loadu_si128((const __m128i *) (buf + 32)));
+        x3 = _mm_xor_si128(crc16_fold(x3, k512), _mm_loadu_si128((const __m128i *) (buf + 48)));
+        buf += 64;
+        len -= 64;
+    }
+
+    x1 = _mm_xor_si128(crc16_fold(x0, k128), x1);
+    x2 = _mm_xor_si128(crc16_fold(x1, k128), x2);
+    x0 = _mm_xor_si128(crc16_fold(x2, k128), x3);
+    while (len >= 16) {
+        x0 = _mm_xor_si128(crc16_fold(x0, k128), _mm_loadu_si128((const __m128i *) buf));
+        buf += 16;
+        len -= 16;
+    }
+
+    // The remaining block and the tail are reduced with tables
+    _mm_storeu_si128((__m128i *) rem, x0);
+    crc = pirate_crc16_update_slice8(0, rem, sizeof(rem));
+    return pirate_crc16_update_slice8(crc, buf, len);
+}
+
+#else
+
+uint16_t pirate_crc16_update_clmul(uint16_t crc, const void *data, size_t len) {
+    return pirate_crc16_update_slice8(crc, data, len);
+}
+
+#endif /* PIRATE_CRC16_CLMUL */
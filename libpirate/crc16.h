@@ -0,0 +1,49 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#ifndef __PIRATE_CRC16_H
+#define __PIRATE_CRC16_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-16/CCITT with reflected input and output (CRC-16/X-25).
+// The update functions do not apply the initial value or the
+// final xor so that a message can be processed in pieces.
+#define PIRATE_CRC16_INIT   0xFFFF
+#define PIRATE_CRC16_XOROUT 0xFFFF
+
+// Uses the fastest implementation supported by the processor.
+uint16_t pirate_crc16_update(uint16_t crc, const void *data, size_t len);
+
+// One table lookup per byte
+uint16_t pirate_crc16_update_bytewise(uint16_t crc, const void *data, size_t len);
+
+// Eight table lookups per 8 bytes
+uint16_t pirate_crc16_update_slice8(uint16_t crc, const void *data, size_t len);
+
+// Folds 64 bytes per iteration with carry-less multiplication.
+// Falls back to pirate_crc16_update_slice8() when the processor
+// does not support the PCLMULQDQ instruction.
+uint16_t pirate_crc16_update_clmul(uint16_t crc, const void *data, size_t len);
+
+// Returns 1 when pirate_crc16_update() uses PCLMULQDQ
+int pirate_crc16_clmul_supported(void);
+
+static inline uint16_t pirate_crc16(const void *data, size_t len) {
+    return pirate_crc16_update(PIRATE_CRC16_INIT, data, len) ^ PIRATE_CRC16_XOROUT;
+}
+
+#endif /* __PIRATE_CRC16_H */
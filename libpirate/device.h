@@ -23,6 +23,7 @@ typedef struct {
     int flags;
     int fd;
     uint8_t *min_tx_buf;
+    int peeked;
 } device_ctx;
 
 int pirate_device_parse_param(char *str, void *_param);
@@ -32,7 +33,10 @@ int pirate_device_close(void *_ctx);
 ssize_t pirate_device_read(const void *_param, void *_ctx, void *buf, size_t count);
 ssize_t pirate_device_write(const void *_param, void *_ctx, const void *buf, size_t count);
 ssize_t pirate_device_write_mtu(const void *_param, void *_ctx);
+ssize_t pirate_device_write_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen);
+ssize_t pirate_device_writev(const void *_param, void *_ctx, const struct iovec *iov, int iovcnt);
+ssize_t pirate_device_peek_len(const void *_param, void *_ctx);
 
-#define PIRATE_DEVICE_CHANNEL_FUNCS { pirate_device_parse_param, pirate_device_get_channel_description, pirate_device_open, pirate_device_close, pirate_device_read, pirate_device_write, pirate_device_write_mtu }
+#define PIRATE_DEVICE_CHANNEL_FUNCS { pirate_device_parse_param, pirate_device_get_channel_description, pirate_device_open, pirate_device_close, pirate_device_read, pirate_device_write, pirate_device_write_mtu, NULL, NULL, NULL, NULL, pirate_device_write_batch, NULL, pirate_device_writev, pirate_device_peek_len }
 
 #endif /*__PIRATE_CHANNEL_DEVICE_H */
@@ -0,0 +1,259 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fec.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define PIRATE_GF256_SIMD 1
+#include <immintrin.h>
+#endif
+
+#define GF256_POLY 0x11D
+
+static uint8_t gf256_log[256];
+static uint8_t gf256_exp[512];
+static uint8_t gf256_mul_table[256][256];
+// gf256_nibble[c][0][x] is c * x and gf256_nibble[c][1][x] is c * (x << 4)
+static uint8_t gf256_nibble[256][2][16] __attribute__((aligned(16)));
+
+typedef void (*pirate_gf256_func_t)(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+
+static pirate_gf256_func_t gf256_mul_add_func = pirate_gf256_mul_add_table;
+static const char *gf256_impl = "table";
+static int gf256_ssse3 = 0;
+static int gf256_avx2 = 0;
+
+static void __attribute__((constructor)) pirate_gf256_init(void) {
+    unsigned x = 1;
+
+    for (int i = 0; i < 255; i++) {
+        gf256_exp[i] = x;
+        gf256_log[x] = i;
+        x <<= 1;
+        if (x & 0x100) {
+            x ^= GF256_POLY;
+        }
+    }
+    // the sum of two logarithms does not need a modulo
+    for (int i = 255; i < 512; i++) {
+        gf256_exp[i] = gf256_exp[i - 255];
+    }
+    for (int a = 1; a < 256; a++) {
+        for (int b = 1; b < 256; b++) {
+            gf256_mul_table[a][b] = gf256_exp[gf256_log[a] + gf256_log[b]];
+        }
+    }
+    for (int c = 0; c < 256; c++) {
+        for (int i = 0; i < 16; i++) {
+            gf256_nibble[c][0][i] = gf256_mul_table[c][i];
+            gf256_nibble[c][1][i] = gf256_mul_table[c][i << 4];
+        }
+    }
+#ifdef PIRATE_GF256_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3")) {
+        gf256_ssse3 = 1;
+        gf256_mul_add_func = pirate_gf256_mul_add_ssse3;
+        gf256_impl = "ssse3";
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        gf256_avx2 = 1;
+        gf256_mul_add_func = pirate_gf256_mul_add_avx2;
+        gf256_impl = "avx2";
+    }
+#endif
+}
+
+uint8_t pirate_gf256_mul(uint8_t a, uint8_t b) {
+    return gf256_mul_table[a][b];
+}
+
+uint8_t pirate_gf256_inv(uint8_t a) {
+    return gf256_exp[255 - gf256_log[a]];
+}
+
+void pirate_gf256_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len) {
+    gf256_mul_add_func(dst, src, c, len);
+}
+
+const char *pirate_gf256_impl(void) {
+    return gf256_impl;
+}
+
+void pirate_gf256_mul_add_table(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len) {
+    const uint8_t *row = gf256_mul_table[c];
+
+    if (c == 0) {
+        return;
+    }
+    if (c == 1) {
+        for (size_t i = 0; i < len; i++) {
+            dst[i] ^= src[i];
+        }
+        return;
+    }
+    for (size_t i = 0; i < len; i++) {
+        dst[i] ^= row[src[i]];
+    }
+}
+
+#ifdef PIRATE_GF256_SIMD
+
+// The product is the xor of the products of the low and the high
+// nibble of each byte, which are looked up with a byte shuffle
+__attribute__((target("ssse3")))
+void pirate_gf256_mul_add_ssse3(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len) {
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    __m128i lo, hi, x, p;
+
+    if (!gf256_ssse3 || (c == 0)) {
+        pirate_gf256_mul_add_table(dst, src, c, len);
+        return;
+    }
+    lo = _mm_load_si128((const __m128i *) gf256_nibble[c][0]);
+    hi = _mm_load_si128((const __m128i *) gf256_nibble[c][1]);
+    while (len >= 16) {
+        x = _mm_loadu_si128((const __m128i *) src);
+        p = _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(x, mask)),
+            _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(x, 4), mask)));
+        _mm_storeu_si128((__m128i *) dst, _mm_xor_si128(_mm_loadu_si128((const __m128i *) dst), p));
+        src += 16;
+        dst += 16;
+        len -= 16;
+    }
+    pirate_gf256_mul_add_table(dst, src, c, len);
+}
+
+__attribute__((target("avx2")))
+void pirate_gf256_mul_add_avx2(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len) {
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    __m256i lo, hi, x, p;
+
+    if (!gf256_avx2 || (c == 0)) {
+        pirate_gf256_mul_add_ssse3(dst, src, c, len);
+        return;
+    }
+    lo = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *) gf256_nibble[c][0]));
+    hi = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *) gf256_nibble[c][1]));
+    while (len >= 32) {
+        x = _mm256_loadu_si256((const __m256i *) src);
+        p = _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(x, mask)),
+            _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask)));
+        _mm256_storeu_si256((__m256i *) dst, _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) dst), p));
+        src += 32;
+        dst += 32;
+        len -= 32;
+    }
+    pirate_gf256_mul_add_ssse3(dst, src, c, len);
+}
+
+#else
+
+void pirate_gf256_mul_add_ssse3(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len) {
+    pirate_gf256_mul_add_table(dst, src, c, len);
+}
+
+void pirate_gf256_mul_add_avx2(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len) {
+    pirate_gf256_mul_add_table(dst, src, c, len);
+}
+
+#endif /* PIRATE_GF256_SIMD */
+
+// The Cauchy matrix 1 / (x_row + y_col) with x_row = row and
+// y_col = 128 + col. Each column is scaled by the inverse of its
+// coefficient in row 0, which keeps every square submatrix invertible.
+uint8_t pirate_fec_coef(unsigned row, unsigned col) {
+    uint8_t y = PIRATE_FEC_MAX_PARITY + col;
+    return pirate_gf256_mul(y, pirate_gf256_inv(row ^ y));
+}
+
+// Gauss-Jordan elimination of [A | I] into [I | A^-1]
+static int fec_invert(uint8_t *a, uint8_t *inv, unsigned n) {
+    unsigned i, j, k;
+    uint8_t c, tmp;
+
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < n; j++) {
+            inv[i * n + j] = (i == j);
+        }
+    }
+    for (i = 0; i < n; i++) {
+        for (k = i; (k < n) && (a[k * n + i] == 0); k++);
+        if (k == n) {
+            return -1;
+        }
+        if (k != i) {
+            for (j = 0; j < n; j++) {
+                tmp = a[i * n + j]; a[i * n + j] = a[k * n + j]; a[k * n + j] = tmp;
+                tmp = inv[i * n + j]; inv[i * n + j] = inv[k * n + j]; inv[k * n + j] = tmp;
+            }
+        }
+        c = pirate_gf256_inv(a[i * n + i]);
+        for (j = 0; j < n; j++) {
+            a[i * n + j] = pirate_gf256_mul(a[i * n + j], c);
+            inv[i * n + j] = pirate_gf256_mul(inv[i * n + j], c);
+        }
+        for (k = 0; k < n; k++) {
+            if ((k == i) || ((c = a[k * n + i]) == 0)) {
+                continue;
+            }
+            pirate_gf256_mul_add_table(&a[k * n], &a[i * n], c, n);
+            pirate_gf256_mul_add_table(&inv[k * n], &inv[i * n], c, n);
+        }
+    }
+    return 0;
+}
+
+int pirate_fec_solve(const unsigned *rows, const unsigned *cols, unsigned n,
+    uint8_t *const *synd, uint8_t *const *out, size_t len) {
+    uint8_t *a, *inv;
+    unsigned i, j;
+
+    if ((n == 0) || (n > PIRATE_FEC_MAX_PARITY)) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        if ((rows[i] >= PIRATE_FEC_MAX_PARITY) || (cols[i] >= PIRATE_FEC_MAX_DATA)) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    if ((a = malloc(2 * n * n)) == NULL) {
+        return -1;
+    }
+    inv = a + n * n;
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < n; j++) {
+            a[i * n + j] = pirate_fec_coef(rows[i], cols[j]);
+        }
+    }
+    if (fec_invert(a, inv, n) < 0) {
+        free(a);
+        errno = EINVAL;
+        return -1;
+    }
+    for (j = 0; j < n; j++) {
+        memset(out[j], 0, len);
+        for (i = 0; i < n; i++) {
+            pirate_gf256_mul_add(out[j], synd[i], inv[j * n + i], len);
+        }
+    }
+    free(a);
+    return 0;
+}
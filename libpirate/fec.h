@@ -0,0 +1,71 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#ifndef __PIRATE_FEC_H
+#define __PIRATE_FEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Reed-Solomon erasure code over GF(2^8) with the polynomial
+// x^8 + x^4 + x^3 + x^2 + 1. A block of at most 128 data packets
+// is protected by at most 128 parity packets. Parity packet row is
+// the sum of coef(row, col) times data packet col. Any square
+// submatrix of the coefficients is invertible, so that any lost
+// packets of a block can be recovered from as many parity packets.
+// The coefficients of row 0 are 1 and the first parity packet is
+// the xor of the data packets.
+#define PIRATE_FEC_MAX_DATA   128
+#define PIRATE_FEC_MAX_PARITY 128
+
+uint8_t pirate_gf256_mul(uint8_t a, uint8_t b);
+
+// a must be non-zero
+uint8_t pirate_gf256_inv(uint8_t a);
+
+// Adds c times src into dst. Uses the fastest
+// implementation supported by the processor.
+void pirate_gf256_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+
+// One table lookup per byte
+void pirate_gf256_mul_add_table(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+
+// Multiplies 16 (32) bytes per iteration with two nibble table
+// lookups. Falls back to pirate_gf256_mul_add_table() when the
+// processor does not support the SSSE3 (AVX2) instructions.
+void pirate_gf256_mul_add_ssse3(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+void pirate_gf256_mul_add_avx2(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+
+// Returns the name of the implementation of pirate_gf256_mul_add()
+const char *pirate_gf256_impl(void);
+
+uint8_t pirate_fec_coef(unsigned row, unsigned col);
+
+// Recovers the n data packets cols from the n parity packets rows.
+// The contribution of the data packets that were received must be
+// subtracted from the parity packets in synd first. Returns -1
+// and sets errno on error.
+int pirate_fec_solve(const unsigned *rows, const unsigned *cols, unsigned n,
+    uint8_t *const *synd, uint8_t *const *out, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PIRATE_FEC_H */
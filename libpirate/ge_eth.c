@@ -26,88 +26,52 @@
 #include <unistd.h>
 
 #include "pirate_common.h"
+#include "crc16.h"
 #include "ge_eth.h"
 #include "udp_socket.h"
 
-#pragma pack(1)
-typedef struct {
-    uint32_t message_id;
-    uint16_t data_len;
-    uint16_t crc16;
-} ge_header_t;
-#pragma pack()
-
-static const unsigned int crc16_ccitt_table_reverse[256] =
-{
- 0x0000, 0x1189, 0x2312, 0x329B, 0x4624, 0x57AD, 0x6536, 0x74BF,
- 0x8C48, 0x9DC1, 0xAF5A, 0xBED3, 0xCA6C, 0xDBE5, 0xE97E, 0xF8F7,
- 0x1081, 0x0108, 0x3393, 0x221A, 0x56A5, 0x472C, 0x75B7, 0x643E,
- 0x9CC9, 0x8D40, 0xBFDB, 0xAE52, 0xDAED, 0xCB64, 0xF9FF, 0xE876,
- 0x2102, 0x308B, 0x0210, 0x1399, 0x6726, 0x76AF, 0x4434, 0x55BD,
- 0xAD4A, 0xBCC3, 0x8E58, 0x9FD1, 0xEB6E, 0xFAE7, 0xC87C, 0xD9F5,
- 0x3183, 0x200A, 0x1291, 0x0318, 0x77A7, 0x662E, 0x54B5, 0x453C,
- 0xBDCB, 0xAC42, 0x9ED9, 0x8F50, 0xFBEF, 0xEA66, 0xD8FD, 0xC974,
- 0x4204, 0x538D, 0x6116, 0x709F, 0x0420, 0x15A9, 0x2732, 0x36BB,
- 0xCE4C, 0xDFC5, 0xED5E, 0xFCD7, 0x8868, 0x99E1, 0xAB7A, 0xBAF3,
- 0x5285, 0x430C, 0x7197, 0x601E, 0x14A1, 0x0528, 0x37B3, 0x263A,
- 0xDECD, 0xCF44, 0xFDDF, 0xEC56, 0x98E9, 0x8960, 0xBBFB, 0xAA72,
- 0x6306, 0x728F, 0x4014, 0x519D, 0x2522, 0x34AB, 0x0630, 0x17B9,
- 0xEF4E, 0xFEC7, 0xCC5C, 0xDDD5, 0xA96A, 0xB8E3, 0x8A78, 0x9BF1,
- 0x7387, 0x620E, 0x5095, 0x411C, 0x35A3, 0x242A, 0x16B1, 0x0738,
- 0xFFCF, 0xEE46, 0xDCDD, 0xCD54, 0xB9EB, 0xA862, 0x9AF9, 0x8B70,
- 0x8408, 0x9581, 0xA71A, 0xB693, 0xC22C, 0xD3A5, 0xE13E, 0xF0B7,
- 0x0840, 0x19C9, 0x2B52, 0x3ADB, 0x4E64, 0x5FED, 0x6D76, 0x7CFF,
- 0x9489, 0x8500, 0xB79B, 0xA612, 0xD2AD, 0xC324, 0xF1BF, 0xE036,
- 0x18C1, 0x0948, 0x3BD3, 0x2A5A, 0x5EE5, 0x4F6C, 0x7DF7, 0x6C7E,
- 0xA50A, 0xB483, 0x8618, 0x9791, 0xE32E, 0xF2A7, 0xC03C, 0xD1B5,
- 0x2942, 0x38CB, 0x0A50, 0x1BD9, 0x6F66, 0x7EEF, 0x4C74, 0x5DFD,
- 0xB58B, 0xA402, 0x9699, 0x8710, 0xF3AF, 0xE226, 0xD0BD, 0xC134,
- 0x39C3, 0x284A, 0x1AD1, 0x0B58, 0x7FE7, 0x6E6E, 0x5CF5, 0x4D7C,
- 0xC60C, 0xD785, 0xE51E, 0xF497, 0x8028, 0x91A1, 0xA33A, 0xB2B3,
- 0x4A44, 0x5BCD, 0x6956, 0x78DF, 0x0C60, 0x1DE9, 0x2F72, 0x3EFB,
- 0xD68D, 0xC704, 0xF59F, 0xE416, 0x90A9, 0x8120, 0xB3BB, 0xA232,
- 0x5AC5, 0x4B4C, 0x79D7, 0x685E, 0x1CE1, 0x0D68, 0x3FF3, 0x2E7A,
- 0xE70E, 0xF687, 0xC41C, 0xD595, 0xA12A, 0xB0A3, 0x8238, 0x93B1,
- 0x6B46, 0x7ACF, 0x4854, 0x59DD, 0x2D62, 0x3CEB, 0x0E70, 0x1FF9,
- 0xF78F, 0xE606, 0xD49D, 0xC514, 0xB1AB, 0xA022, 0x92B9, 0x8330,
- 0x7BC7, 0x6A4E, 0x58D5, 0x495C, 0x3DE3, 0x2C6A, 0x1EF1, 0x0F78
-};
-
-static uint16_t crc16_reflected(const uint8_t *buf, uint16_t len,
-                            uint16_t crc_in, const unsigned int table[])
-{
-    unsigned int crc16 = (unsigned int) crc_in;
-
-    while( len-- != 0 )
-       crc16 = table[(crc16 ^ *buf++) & 0xff] ^ (crc16 >> 8);
-
-    return (uint16_t) crc16;
+uint16_t pirate_ge_eth_crc16(const uint8_t *data, uint16_t len) {
+    return pirate_crc16(data, len);
 }
 
-static const uint16_t crc16_ccitt_start = 0xFFFF;
-static const uint16_t crc16_ccitt_xorout = 0xFFFF;
+// The CRC-16 always covers the message id and the data length.
+// With crc=payload it also covers the packet data.
+static uint16_t ge_message_crc16(const ge_header_t *msg_hdr, const struct iovec *iov, int iovcnt,
+    pirate_ge_eth_crc_t coverage) {
+    uint16_t crc = pirate_crc16_update(PIRATE_CRC16_INIT, msg_hdr, sizeof(ge_header_t)-sizeof(uint16_t));
+    if (coverage == PIRATE_GE_ETH_CRC_PAYLOAD) {
+        for (int i = 0; i < iovcnt; i++) {
+            crc = pirate_crc16_update(crc, iov[i].iov_base, iov[i].iov_len);
+        }
+    }
+    return crc ^ PIRATE_CRC16_XOROUT;
+}
 
-uint16_t pirate_ge_eth_crc16(const uint8_t *data, uint16_t len) {
-    return crc16_reflected(data, len, crc16_ccitt_start, crc16_ccitt_table_reverse)
-        ^ crc16_ccitt_xorout;
+void pirate_ge_eth_header_pack(ge_header_t *msg_hdr, const struct iovec *iov, int iovcnt,
+    uint32_t count, uint32_t message_id, pirate_ge_eth_crc_t crc) {
+    msg_hdr->message_id = htobe32(message_id);
+    msg_hdr->data_len = htobe16(count);
+    msg_hdr->crc16 = htobe16(ge_message_crc16(msg_hdr, iov, iovcnt, crc));
 }
 
-static ssize_t ge_message_pack(void *buf, const void *data, uint32_t count,
-    const pirate_ge_eth_param_t *param) {
-    ge_header_t *msg_hdr = (ge_header_t *)buf;
-    uint8_t *msg_data = (uint8_t *)buf + sizeof(ge_header_t);
+int pirate_ge_eth_header_verify(const ge_header_t *msg_hdr, const void *data, ssize_t len,
+    pirate_ge_eth_crc_t crc) {
+    struct iovec iov;
 
-    if (count > (param->mtu - sizeof(ge_header_t))) {
-        errno = EMSGSIZE;
+    if (crc != PIRATE_GE_ETH_CRC_PAYLOAD) {
+        return 0;
+    }
+    if ((len < 0) || ((size_t) len < be16toh(msg_hdr->data_len))) {
+        errno = EBADMSG;
         return -1;
     }
-
-    msg_hdr->message_id = htobe32(param->message_id);
-    msg_hdr->data_len = htobe16(count);
-    msg_hdr->crc16 = htobe16(pirate_ge_eth_crc16(buf, sizeof(ge_header_t)-sizeof(uint16_t)));
-
-    memcpy(msg_data, data, count);
-    return sizeof(ge_header_t) + count;
+    iov.iov_base = (void *) data;
+    iov.iov_len = be16toh(msg_hdr->data_len);
+    if (ge_message_crc16(msg_hdr, &iov, 1, crc) != be16toh(msg_hdr->crc16)) {
+        errno = EBADMSG;
+        return -1;
+    }
+    return 0;
 }
 
 static ssize_t ge_message_unpack(const void *buf, void *data,
@@ -126,6 +90,112 @@ static ssize_t ge_message_unpack(const void *buf, void *data,
     return copy_len;
 }
 
+// Arguments of the send calls that are retried
+// by pirate_send_retry_refused()
+typedef struct {
+    int sock;
+    struct msghdr *msg;
+    struct mmsghdr *hdrs;
+    unsigned vlen;
+} ge_eth_send_args;
+
+static ssize_t ge_eth_sendmsg(void *_args) {
+    ge_eth_send_args *args = (ge_eth_send_args *)_args;
+    return sendmsg(args->sock, args->msg, 0);
+}
+
+static ssize_t ge_eth_sendmmsg(void *_args) {
+    ge_eth_send_args *args = (ge_eth_send_args *)_args;
+    return sendmmsg(args->sock, args->hdrs, args->vlen, 0);
+}
+
+// Sends one packet with its header. to is NULL for the connected peer.
+static ssize_t ge_eth_send(int sock, const struct sockaddr *to, socklen_t tolen,
+    const struct iovec *iov, int iovcnt, const pirate_ge_eth_param_t *param) {
+    ge_header_t header;
+    struct iovec frame[PIRATE_IOV_MAX + 1];
+    struct msghdr msg;
+    ge_eth_send_args args;
+    size_t count = 0, wr_len;
+    ssize_t rv;
+    int i;
+
+    if ((iovcnt < 0) || (iovcnt > PIRATE_IOV_MAX)) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        count += iov[i].iov_len;
+    }
+    if (count > (param->mtu - sizeof(ge_header_t))) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    // The header is sent as a separate iovec so the
+    // packet data is not copied into ctx->buf.
+    pirate_ge_eth_header_pack(&header, iov, iovcnt, count, param->message_id, param->crc);
+    frame[0].iov_base = &header;
+    frame[0].iov_len = sizeof(ge_header_t);
+    memcpy(&frame[1], iov, iovcnt * sizeof(struct iovec));
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = (void *) to;
+    msg.msg_namelen = tolen;
+    msg.msg_iov = frame;
+    msg.msg_iovlen = iovcnt + 1;
+    wr_len = sizeof(ge_header_t) + count;
+
+    memset(&args, 0, sizeof(args));
+    args.sock = sock;
+    args.msg = &msg;
+    rv = pirate_send_retry_refused(ge_eth_sendmsg, &args);
+
+    if ((rv < 0) || ((size_t) rv != wr_len)) {
+        return -1;
+    }
+
+    return count;
+}
+
+// Receives one packet into rx_buf and copies its data into buf
+static ssize_t ge_eth_recv(int sock, uint8_t *rx_buf, void *buf, size_t count, int flags,
+    struct sockaddr *from, socklen_t *fromlen, const pirate_ge_eth_param_t *param) {
+    ssize_t rd_size;
+    ge_header_t hdr = { 0, 0, 0 };
+
+    rd_size = recvfrom(sock, rx_buf, param->mtu, flags, from, fromlen);
+    if (rd_size <= 0) {
+        return rd_size;
+    }
+    if (pirate_ge_eth_header_verify((ge_header_t *) rx_buf, rx_buf + sizeof(ge_header_t),
+            rd_size - (ssize_t) sizeof(ge_header_t), param->crc) < 0) {
+        return -1;
+    }
+
+    return ge_message_unpack(rx_buf, buf, count, &hdr);
+}
+
+// The reliable layer keeps a copy of the socket, the receive
+// buffer, and the parameters because the context is moved
+// after the channel is opened
+typedef struct {
+    int sock;
+    uint8_t *buf;
+    pirate_ge_eth_param_t param;
+} ge_eth_reliable_arg_t;
+
+static ssize_t ge_eth_reliable_send(void *_arg, const struct sockaddr *to, socklen_t tolen,
+    const struct iovec *iov, int iovcnt) {
+    const ge_eth_reliable_arg_t *arg = (const ge_eth_reliable_arg_t *) _arg;
+    return ge_eth_send(arg->sock, to, tolen, iov, iovcnt, &arg->param);
+}
+
+static ssize_t ge_eth_reliable_recv(void *_arg, void *buf, size_t count, int flags,
+    struct sockaddr *from, socklen_t *fromlen) {
+    const ge_eth_reliable_arg_t *arg = (const ge_eth_reliable_arg_t *) _arg;
+    return ge_eth_recv(arg->sock, arg->buf, buf, count, flags, from, fromlen, &arg->param);
+}
+
 static void pirate_ge_eth_init_param(pirate_ge_eth_param_t *param) {
     if (param->mtu == 0) {
         param->mtu = PIRATE_DEFAULT_GE_ETH_MTU;
@@ -187,7 +257,18 @@ int pirate_ge_eth_parse_param(char *str, void *_param) {
         }
         if (strncmp("mtu", key, strlen("mtu")) == 0) {
             param->mtu = strtol(val, NULL, 10);
-        } else {
+        } else if (strncmp("crc", key, strlen("crc")) == 0) {
+            if (strncmp("header", val, strlen("header")) == 0) {
+                param->crc = PIRATE_GE_ETH_CRC_HEADER;
+            } else if (strncmp("payload", val, strlen("payload")) == 0) {
+                param->crc = PIRATE_GE_ETH_CRC_PAYLOAD;
+            } else {
+                errno = EINVAL;
+                return -1;
+            }
+        } else if ((rv = pirate_reliable_parse_param(key, val, &param->reliable)) < 0) {
+            return -1;
+        } else if (rv == 0) {
             errno = EINVAL;
             return -1;
         }
@@ -198,15 +279,22 @@ int pirate_ge_eth_parse_param(char *str, void *_param) {
 int pirate_ge_eth_get_channel_description(const void *_param, char *desc, int len) {
     const pirate_ge_eth_param_t *param = (const pirate_ge_eth_param_t *)_param;
     char mtu_str[32];
+    char crc_str[32];
+    char reliable_str[96];
 
     mtu_str[0] = 0;
+    crc_str[0] = 0;
+    pirate_reliable_description(&param->reliable, reliable_str, sizeof(reliable_str));
     if (param->mtu != 0) {
         snprintf(mtu_str, 32, ",mtu=%u", param->mtu);
     }
-    return snprintf(desc, len, "ge_eth,%s,%u,%s,%u,%u%s",
+    if (param->crc == PIRATE_GE_ETH_CRC_PAYLOAD) {
+        snprintf(crc_str, 32, ",crc=payload");
+    }
+    return snprintf(desc, len, "ge_eth,%s,%u,%s,%u,%u%s%s%s",
         param->reader_addr, param->reader_port,
         param->writer_addr, param->writer_port,
-        param->message_id, mtu_str);
+        param->message_id, mtu_str, crc_str, reliable_str);
 }
 
 int pirate_ge_eth_open(void *_param, void *_ctx) {
@@ -242,6 +330,22 @@ int pirate_ge_eth_open(void *_param, void *_ctx) {
     } else if (access == O_WRONLY) {
         rv = pirate_udp_socket_writer_open(&udp_param, (common_ctx*) ctx);
     }
+    if ((rv >= 0) && (param->reliable.mode != PIRATE_RELIABLE_NONE)) {
+        ge_eth_reliable_arg_t arg;
+        arg.sock = ctx->sock;
+        arg.buf = ctx->buf;
+        arg.param = *param;
+        ctx->reliable = pirate_reliable_open(&param->reliable, ctx->flags, ctx->sock,
+            (param->mtu > sizeof(ge_header_t)) ? param->mtu - sizeof(ge_header_t) : 0,
+            ge_eth_reliable_send, ge_eth_reliable_recv, &arg, sizeof(arg));
+        if (ctx->reliable == NULL) {
+            int err = errno;
+            close(ctx->sock);
+            ctx->sock = -1;
+            errno = err;
+            return -1;
+        }
+    }
 
     return rv;
 }
@@ -250,6 +354,11 @@ int pirate_ge_eth_close(void *_ctx) {
     ge_eth_ctx *ctx = (ge_eth_ctx *)_ctx;
     int err, rv = -1;
 
+    if (ctx->reliable != NULL) {
+        pirate_reliable_close(ctx->reliable);
+        ctx->reliable = NULL;
+    }
+
     if (ctx->buf != NULL) {
         free(ctx->buf);
         ctx->buf = NULL;
@@ -273,20 +382,40 @@ int pirate_ge_eth_close(void *_ctx) {
 ssize_t pirate_ge_eth_read(const void *_param, void *_ctx, void *buf, size_t count) {
     const pirate_ge_eth_param_t *param = (const pirate_ge_eth_param_t *)_param;
     ge_eth_ctx *ctx = (ge_eth_ctx *)_ctx;
+
+    if (ctx->sock <= 0) {
+        errno = EBADF;
+        return -1;
+    }
+    if (ctx->reliable != NULL) {
+        return pirate_reliable_read(ctx->reliable, buf, count);
+    }
+
+    return ge_eth_recv(ctx->sock, ctx->buf, buf, count, 0, NULL, NULL, param);
+}
+
+ssize_t pirate_ge_eth_peek_len(const void *_param, void *_ctx) {
+    (void) _param;
+    ge_eth_ctx *ctx = (ge_eth_ctx *)_ctx;
+    ge_header_t hdr;
     ssize_t rd_size;
-    ge_header_t hdr = { 0, 0, 0 };
 
     if (ctx->sock <= 0) {
         errno = EBADF;
         return -1;
     }
+    if (ctx->reliable != NULL) {
+        return pirate_reliable_peek_len(ctx->reliable);
+    }
 
-    rd_size = recv(ctx->sock, ctx->buf, param->mtu, 0);
+    rd_size = recv(ctx->sock, &hdr, sizeof(hdr), MSG_PEEK);
     if (rd_size <= 0) {
         return rd_size;
     }
-
-    return ge_message_unpack(ctx->buf, buf, count, &hdr);
+    if ((size_t) rd_size < sizeof(hdr)) {
+        return 0;
+    }
+    return be16toh(hdr.data_len);
 }
 
 ssize_t pirate_ge_eth_write_mtu(const void *_param, void *_ctx) {
@@ -300,30 +429,157 @@ ssize_t pirate_ge_eth_write_mtu(const void *_param, void *_ctx) {
         errno = EINVAL;
         return -1;
     }
+    if (param->reliable.mode != PIRATE_RELIABLE_NONE) {
+        return pirate_reliable_write_mtu(&param->reliable, mtu - sizeof(ge_header_t));
+    }
     return mtu - sizeof(ge_header_t);
 }
 
+ssize_t pirate_ge_eth_writev(const void *_param, void *_ctx, const struct iovec *iov, int iovcnt) {
+    const pirate_ge_eth_param_t *param = (const pirate_ge_eth_param_t *)_param;
+    ge_eth_ctx *ctx = (ge_eth_ctx *)_ctx;
+
+    if (ctx->reliable != NULL) {
+        return pirate_reliable_writev(ctx->reliable, iov, iovcnt);
+    }
+    return ge_eth_send(ctx->sock, NULL, 0, iov, iovcnt, param);
+}
+
 ssize_t pirate_ge_eth_write(const void *_param, void *_ctx, const void *buf, size_t count) {
+    struct iovec iov;
+
+    iov.iov_base = (void*) buf;
+    iov.iov_len = count;
+    return pirate_ge_eth_writev(_param, _ctx, &iov, 1);
+}
+
+ssize_t pirate_ge_eth_write_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen) {
     const pirate_ge_eth_param_t *param = (const pirate_ge_eth_param_t *)_param;
     ge_eth_ctx *ctx = (ge_eth_ctx *)_ctx;
-    ssize_t rv, wr_len;
-    int err;
+    ge_header_t headers[PIRATE_IOV_MAX];
+    struct mmsghdr hdrs[PIRATE_IOV_MAX];
+    struct iovec iov[2 * PIRATE_IOV_MAX];
+    ge_eth_send_args args;
+    unsigned i;
+    int rv;
 
-    if ((wr_len = ge_message_pack(ctx->buf, buf, count, param)) < 0) {
+    if (ctx->sock <= 0) {
+        errno = EBADF;
         return -1;
     }
+    if (ctx->reliable != NULL) {
+        return pirate_reliable_write_batch(ctx->reliable, msgs, vlen);
+    }
 
-    err = errno;
-    rv = send(ctx->sock, ctx->buf, wr_len, 0);
-    if ((rv < 0) && (errno == ECONNREFUSED)) {
-        // TODO create a counter of undelivered messages
-        errno = err;
-        rv = send(ctx->sock, ctx->buf, wr_len, 0);
+    // The header and the packet data are sent as separate
+    // iovecs so the data is not copied into ctx->buf.
+    vlen = MIN(vlen, PIRATE_IOV_MAX);
+    memset(hdrs, 0, sizeof(hdrs));
+    for (i = 0; i < vlen; i++) {
+        if (msgs[i].count > (param->mtu - sizeof(ge_header_t))) {
+            break;
+        }
+        iov[2 * i].iov_base = &headers[i];
+        iov[2 * i].iov_len = sizeof(ge_header_t);
+        iov[2 * i + 1].iov_base = msgs[i].buf;
+        iov[2 * i + 1].iov_len = msgs[i].count;
+        pirate_ge_eth_header_pack(&headers[i], &iov[2 * i + 1], 1, msgs[i].count,
+            param->message_id, param->crc);
+        hdrs[i].msg_hdr.msg_iov = &iov[2 * i];
+        hdrs[i].msg_hdr.msg_iovlen = 2;
+    }
+    if (i == 0) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    vlen = i;
+
+    memset(&args, 0, sizeof(args));
+    args.sock = ctx->sock;
+    args.hdrs = hdrs;
+    args.vlen = vlen;
+    rv = pirate_send_retry_refused(ge_eth_sendmmsg, &args);
+
+    for (i = 0; (int) i < rv; i++) {
+        msgs[i].len = msgs[i].count;
     }
+    return rv;
+}
 
-    if (rv != wr_len) {
+ssize_t pirate_ge_eth_read_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen) {
+    const pirate_ge_eth_param_t *param = (const pirate_ge_eth_param_t *)_param;
+    ge_eth_ctx *ctx = (ge_eth_ctx *)_ctx;
+    ge_header_t headers[PIRATE_IOV_MAX];
+    struct mmsghdr hdrs[PIRATE_IOV_MAX];
+    struct iovec iov[2 * PIRATE_IOV_MAX];
+    size_t data_len, len;
+    unsigned i, j;
+    ssize_t rv;
+    int err;
+
+    if (ctx->sock <= 0) {
+        errno = EBADF;
         return -1;
     }
+    if (ctx->reliable != NULL) {
+        return pirate_reliable_read_batch(ctx->reliable, msgs, vlen);
+    }
 
-    return count;
+    vlen = MIN(vlen, PIRATE_IOV_MAX);
+    if (param->crc == PIRATE_GE_ETH_CRC_PAYLOAD) {
+        // A packet that is truncated by a short buffer can
+        // only be verified in ctx->buf by pirate_ge_eth_read()
+        for (i = 0; i < vlen; i++) {
+            if (msgs[i].count < param->mtu - sizeof(ge_header_t)) {
+                rv = pirate_ge_eth_read(_param, _ctx, msgs[0].buf, msgs[0].count);
+                if (rv < 0) {
+                    return rv;
+                }
+                msgs[0].len = rv;
+                return 1;
+            }
+        }
+    }
+
+    // The packet data is received directly into the
+    // caller's buffer and the header into headers[i].
+    memset(hdrs, 0, sizeof(hdrs));
+    for (i = 0; i < vlen; i++) {
+        iov[2 * i].iov_base = &headers[i];
+        iov[2 * i].iov_len = sizeof(ge_header_t);
+        iov[2 * i + 1].iov_base = msgs[i].buf;
+        iov[2 * i + 1].iov_len = msgs[i].count;
+        hdrs[i].msg_hdr.msg_iov = &iov[2 * i];
+        hdrs[i].msg_hdr.msg_iovlen = 2;
+    }
+
+    rv = recvmmsg(ctx->sock, hdrs, vlen, MSG_WAITFORONE, NULL);
+    if (rv <= 0) {
+        return rv;
+    }
+    // Packets that fail the crc=payload check are
+    // dropped and the remaining packets are moved up
+    err = errno;
+    for (i = 0, j = 0; (int) i < rv; i++) {
+        data_len = 0;
+        if (hdrs[i].msg_len > sizeof(ge_header_t)) {
+            data_len = hdrs[i].msg_len - sizeof(ge_header_t);
+        }
+        if (pirate_ge_eth_header_verify(&headers[i], msgs[i].buf,
+                (ssize_t) hdrs[i].msg_len - (ssize_t) sizeof(ge_header_t), param->crc) < 0) {
+            continue;
+        }
+        len = MIN(be16toh(headers[i].data_len), data_len);
+        if (j != i) {
+            len = MIN(len, msgs[j].count);
+            memmove(msgs[j].buf, msgs[i].buf, len);
+        }
+        msgs[j++].len = len;
+    }
+    if (j == 0) {
+        errno = EBADMSG;
+        return -1;
+    }
+    errno = err;
+    return j;
 }
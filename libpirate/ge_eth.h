@@ -17,13 +17,36 @@
 #define __PIRATE_CHANNEL_GE_ETH_H
 
 #include "libpirate.h"
+#include "reliable.h"
+
+#pragma pack(1)
+typedef struct {
+    uint32_t message_id;
+    uint16_t data_len;
+    uint16_t crc16;
+} ge_header_t;
+#pragma pack()
 
 typedef struct {
     int flags;
     int sock;
     uint8_t *buf;
+    // non-NULL with the reliable option
+    pirate_reliable_t *reliable;
 } ge_eth_ctx;
 
+// The GE_ETH framing is also used by the XDP type. The CRC-16
+// always covers the message id and the data length. With
+// crc=payload it also covers the packet data.
+void pirate_ge_eth_header_pack(ge_header_t *msg_hdr, const struct iovec *iov, int iovcnt,
+    uint32_t count, uint32_t message_id, pirate_ge_eth_crc_t crc);
+
+// Returns 0 when the packet passes the crc=payload check. len is
+// the length of the packet data that was received, which must not
+// be truncated. Sets errno to EBADMSG otherwise.
+int pirate_ge_eth_header_verify(const ge_header_t *msg_hdr, const void *data, ssize_t len,
+    pirate_ge_eth_crc_t crc);
+
 int pirate_ge_eth_parse_param(char *str, void *_param);
 int pirate_ge_eth_get_channel_description(const void *_param, char *desc, int len);
 int pirate_ge_eth_open(void *_param, void *_ctx);
@@ -31,7 +54,11 @@ int pirate_ge_eth_close(void *_ctx);
 ssize_t pirate_ge_eth_read(const void *_param, void *_ctx, void *buf, size_t count);
 ssize_t pirate_ge_eth_write(const void *_param, void *_ctx, const void *buf, size_t count);
 ssize_t pirate_ge_eth_write_mtu(const void *_param, void *_ctx);
+ssize_t pirate_ge_eth_write_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen);
+ssize_t pirate_ge_eth_read_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen);
+ssize_t pirate_ge_eth_writev(const void *_param, void *_ctx, const struct iovec *iov, int iovcnt);
+ssize_t pirate_ge_eth_peek_len(const void *_param, void *_ctx);
 
-#define PIRATE_GE_ETH_CHANNEL_FUNCS { pirate_ge_eth_parse_param, pirate_ge_eth_get_channel_description, pirate_ge_eth_open, pirate_ge_eth_close, pirate_ge_eth_read, pirate_ge_eth_write, pirate_ge_eth_write_mtu }
+#define PIRATE_GE_ETH_CHANNEL_FUNCS { pirate_ge_eth_parse_param, pirate_ge_eth_get_channel_description, pirate_ge_eth_open, pirate_ge_eth_close, pirate_ge_eth_read, pirate_ge_eth_write, pirate_ge_eth_write_mtu, NULL, NULL, NULL, NULL, pirate_ge_eth_write_batch, pirate_ge_eth_read_batch, pirate_ge_eth_writev, pirate_ge_eth_peek_len }
 
 #endif /* __PIRATE_CHANNEL_GE_ETH_H */
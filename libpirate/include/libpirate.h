@@ -22,13 +22,13 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #define PIRATE_LEN_NAME 64
-#define PIRATE_NUM_CHANNELS 32
 #define PIRATE_IOV_MAX 16
 
 #define PIRATE_DEFAULT_MIN_TX 512
@@ -81,6 +81,10 @@ typedef enum {
     //  - writer_addr  - IP address on write end (or 0.0.0.0)
     //  - writer_port  - IP port on write end (or 0)
     //  - buffer_size - UDP socket buffer size
+    //  - reliable    - delivery mode, 0 (default), 1, or fec
+    //  - window      - reliable window in packets, default 256
+    //  - rto_ms      - reliable retransmission timeout, default 20
+    //  - fec         - M parity packets per K data packets, fec=K:M
     UDP_SOCKET,
 
     // The gaps channel is implemented using shared memory.
@@ -89,6 +93,7 @@ typedef enum {
     // Configuration parameters - pirate_shmem_param_t
     //  - path        - location of the shared memory
     //  - buffer_size - shared memory buffer size
+    //  - fd          - descriptor of a region from pirate_shmem_create()
     SHMEM,
 
     // The gaps channel is implemented using UDP packets
@@ -115,6 +120,8 @@ typedef enum {
     //  - path - device path
     //  - buad - baud rate, default 230400
     //  - mtu  - max transmit chunk, 1024
+    //  - framing  - none, cobs, or slip, default none
+    //  - tx_queue - length of the write queue in bytes
     SERIAL,
 
     // The gaps channel for Mercury System PCI-E device
@@ -133,8 +140,39 @@ typedef enum {
     //  - writer_port  - IP port on write end (or 0)
     //  - message_id - send/receive message ID
     //  - mtu        - maximum frame length, default 1454
+    //  - crc        - CRC-16 coverage, header (default) or payload
+    //  - reliable   - delivery mode, 0 (default), 1, or fec
+    //  - window     - reliable window in packets, default 256
+    //  - rto_ms     - reliable retransmission timeout, default 20
+    //  - fec        - M parity packets per K data packets, fec=K:M
     GE_ETH,
 
+    // The gaps channel is implemented using a ring of fixed size
+    // slots in shared memory. Any number of readers and writers
+    // may open the channel. This feature is disabled by default.
+    // It must be enabled by setting PIRATE_SHMEM_FEATURE to ON
+    // Configuration parameters - pirate_shmem_mpmc_param_t
+    //  - path      - location of the shared memory
+    //  - slots     - number of slots
+    //  - slot_size - maximum packet length
+    SHMEM_MPMC,
+
+    // The gaps channel is implemented using AF_XDP sockets that
+    // send and receive raw Ethernet frames with the GE_ETH header,
+    // bypassing the kernel network stack. The reader attaches an
+    // XDP program to the interface. Requires CAP_NET_ADMIN and
+    // CAP_BPF (or CAP_SYS_ADMIN).
+    // Configuration parameters - pirate_xdp_param_t
+    //  - ifname     - network interface
+    //  - queue      - interface queue
+    //  - message_id - send/receive message ID
+    //  - mtu        - maximum frame length, default 1454
+    //  - crc        - CRC-16 coverage, header (default) or payload
+    //  - frames     - number of UMEM frames, default 4096
+    //  - busy_poll  - busy poll timeout in microseconds, default 0
+    //  - mode       - XDP attach mode, skb (default) or drv
+    XDP,
+
    // Number of GAPS channel types
     PIRATE_CHANNEL_TYPE_COUNT
 } channel_enum_t;
@@ -180,6 +218,39 @@ typedef struct {
     unsigned min_tx;
 } pirate_tcp_socket_param_t;
 
+// Delivery mode of the UDP_SOCKET and GE_ETH types
+typedef enum {
+    // datagrams are sent once and may be lost or reordered
+    PIRATE_RELIABLE_NONE = 0,
+    // sequence numbers, in-order delivery, fragmentation of
+    // messages larger than the MTU, and retransmission of the
+    // packets that the reader reports missing
+    PIRATE_RELIABLE_ARQ,
+    // sequence numbers, in-order delivery, and fragmentation
+    // without a reverse channel. With the fec option lost packets
+    // are recovered from parity packets. Messages with a missing
+    // fragment that cannot be recovered are skipped by the reader.
+    PIRATE_RELIABLE_FEC
+} pirate_reliable_mode_t;
+
+#define PIRATE_DEFAULT_RELIABLE_WINDOW             256u
+#define PIRATE_MAX_RELIABLE_WINDOW                 4096u
+#define PIRATE_DEFAULT_RELIABLE_RTO_MS             20u
+#define PIRATE_MAX_RELIABLE_FEC                    128u
+
+typedef struct {
+    pirate_reliable_mode_t mode;
+    // number of packets in flight, and the
+    // maximum number of fragments of a message
+    unsigned window;
+    // retransmission timeout in milliseconds
+    unsigned rto_ms;
+    // each block of fec_data packets is followed by fec_parity
+    // Reed-Solomon parity packets, or zero for no parity
+    unsigned fec_data;
+    unsigned fec_parity;
+} pirate_reliable_param_t;
+
 // UDP_SOCKET parameters
 #define PIRATE_DEFAULT_UDP_PACKET_SIZE             65535u
 typedef struct {
@@ -189,18 +260,73 @@ typedef struct {
     uint16_t writer_port;
     unsigned buffer_size;
     unsigned mtu;
+    pirate_reliable_param_t reliable;
 } pirate_udp_socket_param_t;
 
+// Wait policy of the shared memory channels when
+// the reader finds the channel empty or the writer
+// finds the channel full
+typedef enum {
+    // busy wait for spin_ns nanoseconds then sleep on a futex
+    PIRATE_WAIT_ADAPTIVE = 0,
+    // busy wait
+    PIRATE_WAIT_SPIN,
+    // sleep on a futex
+    PIRATE_WAIT_FUTEX,
+    // call sched_yield() between polls
+    PIRATE_WAIT_YIELD
+} pirate_wait_t;
+
+// Page size of the memory of the shared memory channels
+typedef enum {
+    PIRATE_HUGEPAGES_NONE = 0,
+    PIRATE_HUGEPAGES_2M,
+    PIRATE_HUGEPAGES_1G
+} pirate_hugepages_t;
+
+// Memory options of the SHMEM, SHMEM_MPMC, and UDP_SHMEM types
+//  - hugepages - back the memory with a file on a hugetlbfs mount
+//  - numa      - bind the memory to NUMA node numa_node
+//  - prefault  - fault in every page of the memory on open
+//  - mlock     - lock the memory into RAM on open
+typedef struct {
+    pirate_hugepages_t hugepages;
+    uint8_t numa;
+    unsigned numa_node;
+    uint8_t prefault;
+    uint8_t mlock;
+} pirate_shmem_mem_t;
+
 // SHMEM parameters
 #define PIRATE_DEFAULT_SMEM_BUF_LEN                (128u << 10)
 #define PIRATE_DEFAULT_SMEM_MAX_TX                 65536u
+#define PIRATE_DEFAULT_SMEM_SPIN_NS                50000u
 typedef struct {
     char path[PIRATE_LEN_NAME];
     unsigned buffer_size;
     unsigned mtu;
     unsigned max_tx;
+    pirate_wait_t wait;
+    unsigned spin_ns;
+    pirate_shmem_mem_t mem;
+    // when positive, the descriptor of a region created by
+    // pirate_shmem_create() that is opened in place of path
+    int fd;
 } pirate_shmem_param_t;
 
+// SHMEM_MPMC parameters
+#define PIRATE_DEFAULT_SHMEM_MPMC_SLOTS            1024u
+#define PIRATE_DEFAULT_SHMEM_MPMC_SLOT_SIZE        1024u
+typedef struct {
+    char path[PIRATE_LEN_NAME];
+    unsigned slots;
+    unsigned slot_size;
+    unsigned mtu;
+    pirate_wait_t wait;
+    unsigned spin_ns;
+    pirate_shmem_mem_t mem;
+} pirate_shmem_mpmc_param_t;
+
 // UDP_SHMEM parameters
 #define PIRATE_DEFAULT_UDP_SHMEM_PACKET_COUNT      1000u
 #define PIRATE_DEFAULT_UDP_SHMEM_PACKET_SIZE       1024u
@@ -210,6 +336,9 @@ typedef struct {
     size_t packet_size;
     size_t packet_count;
     unsigned mtu;
+    pirate_wait_t wait;
+    unsigned spin_ns;
+    pirate_shmem_mem_t mem;
 } pirate_udp_shmem_param_t;
 
 // UIO parameters
@@ -225,11 +354,29 @@ typedef struct {
 // SERIAL parameters
 #define PIRATE_SERIAL_DEFAULT_BAUD     B230400
 #define PIRATE_SERIAL_DEFAULT_MAX_TX   1024u
+#define PIRATE_SERIAL_DEFAULT_TX_QUEUE 65536u
+// Largest packet of a framed channel when mtu is not set
+#define PIRATE_SERIAL_FRAMED_MTU       65536u
+
+// Framing of the packets on the serial line. Without framing
+// a lost byte desynchronizes the length-prefixed stream. With
+// framing the reader discards the damaged packet and resumes
+// at the next frame delimiter.
+typedef enum {
+    PIRATE_SERIAL_FRAMING_NONE = 0,
+    // consistent overhead byte stuffing, zero delimited
+    PIRATE_SERIAL_FRAMING_COBS,
+    // RFC 1055 serial line IP encoding
+    PIRATE_SERIAL_FRAMING_SLIP
+} pirate_serial_framing_t;
+
 typedef struct {
     char path[PIRATE_LEN_NAME];
     speed_t baud;
     unsigned mtu;
     unsigned max_tx;
+    unsigned tx_queue;
+    pirate_serial_framing_t framing;
 } pirate_serial_param_t;
 
 typedef enum {
@@ -240,12 +387,14 @@ typedef enum {
 
 // MERCURY parameters
 #define PIRATE_MERCURY_ROOT_DEV             "/dev/gaps_ilip_0_root"
-// The mercury mtu is needed while the
-// read() API does not use host_payload_address
-// pointer. If that is changed then remove the mtu.
-#define PIRATE_MERCURY_DEFAULT_MTU          65536u
+// Length of the registered buffer of pirate_read_acquire()
+// in payload mode when no mtu is specified
+#define PIRATE_MERCURY_DEFAULT_BUFFER       65536u
 #define PIRATE_MERCURY_IMMEDIATE_SIZE       192u
 #define PIRATE_MERCURY_DMA_DESCRIPTOR       256u
+// Length of the SipHash key. A key of all zeros
+// disables the authentication of messages.
+#define PIRATE_MERCURY_KEY_SIZE             16u
 typedef struct {
     mercury_mode_t mode;
     uint32_t session_id;
@@ -253,10 +402,21 @@ typedef struct {
     uint32_t data_tag;
     uint32_t descriptor_tag;
     uint32_t mtu;
+    uint8_t key[PIRATE_MERCURY_KEY_SIZE];
 } pirate_mercury_param_t;
 
 // GE_ETH parameters
 #define PIRATE_DEFAULT_GE_ETH_MTU      1454u
+
+// Coverage of the CRC-16 in the GE_ETH header
+typedef enum {
+    // the message id and the data length
+    PIRATE_GE_ETH_CRC_HEADER = 0,
+    // the header and the packet data. The reader
+    // discards packets that fail the check.
+    PIRATE_GE_ETH_CRC_PAYLOAD
+} pirate_ge_eth_crc_t;
+
 typedef struct {
     char reader_addr[INET6_ADDRSTRLEN];
     char writer_addr[INET6_ADDRSTRLEN];
@@ -264,11 +424,39 @@ typedef struct {
     uint16_t writer_port;
     uint32_t message_id;
     uint32_t mtu;
+    pirate_ge_eth_crc_t crc;
+    pirate_reliable_param_t reliable;
 } pirate_ge_eth_param_t;
 
+// XDP parameters
+#define PIRATE_DEFAULT_XDP_FRAMES      4096u
+
+// Attach mode of the XDP program and copy mode of the socket
+typedef enum {
+    // generic XDP, packets are copied into the UMEM.
+    // Supported by every network interface.
+    PIRATE_XDP_MODE_SKB = 0,
+    // XDP in the network driver, zero copy when
+    // supported by the driver
+    PIRATE_XDP_MODE_DRV
+} pirate_xdp_mode_t;
+
+typedef struct {
+    char ifname[PIRATE_LEN_NAME];
+    unsigned queue;
+    uint32_t message_id;
+    unsigned mtu;
+    pirate_ge_eth_crc_t crc;
+    unsigned frames;
+    unsigned busy_poll;
+    pirate_xdp_mode_t mode;
+} pirate_xdp_param_t;
+
 typedef struct {
     channel_enum_t channel_type;
     uint8_t drop;
+    uint8_t trunc_stats;
+    uint8_t lat_stats;
     union {
         pirate_device_param_t           device;
         pirate_pipe_param_t             pipe;
@@ -282,6 +470,8 @@ typedef struct {
         pirate_serial_param_t           serial;
         pirate_mercury_param_t          mercury;
         pirate_ge_eth_param_t           ge_eth;
+        pirate_shmem_mpmc_param_t       shmem_mpmc;
+        pirate_xdp_param_t              xdp;
     } channel;
 } pirate_channel_param_t;
 
@@ -291,8 +481,84 @@ typedef struct {
     uint64_t errs; // EAGAIN and EWOULDBLOCK are not errors
     uint64_t fuzzed;
     uint64_t bytes; // bytes is incremented only on successful requests
+    uint64_t truncated; // incremented only when trunc_stats=1 is specified
+    uint64_t undelivered; // datagrams that the peer refused
 } pirate_stats_t;
 
+#define PIRATE_HISTOGRAM_BUCKETS 252
+
+// Log-linear histogram. Values below 8 have their own
+// bucket and every larger power of two is split into 4
+// buckets. Use pirate_histogram_value() to obtain the
+// smallest value counted by a bucket.
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[PIRATE_HISTOGRAM_BUCKETS];
+} pirate_histogram_t;
+
+typedef struct {
+    pirate_stats_t stats;
+    pirate_histogram_t latency; // nanoseconds per call, only when lat_stats=1 is specified
+    pirate_histogram_t size; // bytes per successfully transferred packet
+    // The following are reported by the SHMEM, UDP_SHMEM, and SHMEM_MPMC types
+    // for the currently open channel. waits counts the requests that
+    // found the channel empty (reader) or full (writer), wakeups counts
+    // the returns from a futex sleep, and blocked_ns is the time spent waiting.
+    uint64_t waits;
+    uint64_t wakeups;
+    uint64_t blocked_ns;
+    // The following are reported by the UDP_SOCKET and GE_ETH types
+    // with the reliable option. retransmits counts the packets that
+    // were sent again by the writer, and lost counts the gaps in the
+    // sequence of packets that were skipped by the reader. recovered
+    // counts the packets that the reader rebuilt from parity packets.
+    uint64_t retransmits;
+    uint64_t lost;
+    uint64_t recovered;
+} pirate_stats_ex_t;
+
+// A single message of a batched read or write. The caller
+// provides buf and count. On return len holds the number of
+// bytes transferred for the message.
+typedef struct {
+    void *buf;
+    size_t count;
+    size_t len;
+} pirate_mmsg_t;
+
+// Events of a gaps descriptor in a poll set. The
+// values match the corresponding EPOLL* flags.
+#define PIRATE_POLLIN  0x001
+#define PIRATE_POLLOUT 0x004
+#define PIRATE_POLLERR 0x008
+#define PIRATE_POLLHUP 0x010
+
+typedef struct pirate_poll pirate_poll_t;
+
+typedef struct {
+    int gd;
+    uint32_t events;
+} pirate_poll_event_t;
+
+// Operations of an asynchronous request queue
+#define PIRATE_ASYNC_READ  1
+#define PIRATE_ASYNC_WRITE 2
+
+typedef struct pirate_async pirate_async_t;
+
+// A completed asynchronous request. len is the number of bytes
+// transferred, or -1 and err holds the error number.
+typedef struct {
+    int gd;
+    int op;
+    ssize_t len;
+    int err;
+    void *user_data;
+} pirate_async_event_t;
+
 //
 // API
 //
@@ -347,12 +613,18 @@ int pirate_unparse_channel_param(const pirate_channel_param_t *param, char *str,
     "  UNIX SOCKET   unix_socket,path[,buffer_size=N,min_tx_size=N,mtu=N]\n"                   \
     "  TCP SOCKET    tcp_socket,reader addr,reader port,writer addr,writer port[,buffer_size=N,min_tx_size=N,mtu=N]\n" \
     "  UDP SOCKET    udp_socket,reader addr,reader port,writer addr,writer port[,buffer_size=N,mtu=N]\n"               \
-    "  SHMEM         shmem,path[,buffer_size=N,max_tx_size=N,mtu=N]\n"                         \
-    "  UDP_SHMEM     udp_shmem,path[,buffer_size=N,packet_size=N,packet_count=N,mtu=N]\n"      \
+    "  SHMEM         shmem,path[,buffer_size=N,max_tx_size=N,wait=W,spin_ns=N,mtu=N,fd=N]\n"   \
+    "  SHMEM_MPMC    shmem_mpmc,path[,slots=N,slot_size=N,wait=W,spin_ns=N,mtu=N]\n"               \
+    "  UDP_SHMEM     udp_shmem,path[,buffer_size=N,packet_size=N,packet_count=N,wait=W,spin_ns=N,mtu=N]\n" \
+    "                SHMEM, SHMEM_MPMC, and UDP_SHMEM also accept\n"                            \
+    "                [,hugepages=[2M|1G],numa_node=N,prefault=1,mlock=1]\n"                     \
     "  UIO           uio[,path=N,max_tx_size=N,mtu=N]\n"                                       \
-    "  SERIAL        serial,path[,baud=N,max_tx_size=N,mtu=N]\n"                               \
-    "  MERCURY       mercury,mode=[immediate|payload],session=N,message=N,data=N[,descriptor=N,mtu=N]\n"               \
-    "  GE_ETH        ge_eth,reader addr,reader port,writer addr,writer port,msg_id[,mtu=N]\n"
+    "  SERIAL        serial,path[,baud=N,max_tx_size=N,mtu=N,tx_queue=N,framing=[none|cobs|slip]]\n" \
+    "  MERCURY       mercury,mode=[immediate|payload],session=N,message=N,data=N[,descriptor=N,mtu=N,key=K]\n"         \
+    "  GE_ETH        ge_eth,reader addr,reader port,writer addr,writer port,msg_id[,mtu=N,crc=[header|payload]]\n"          \
+    "                UDP SOCKET and GE_ETH also accept\n"                                       \
+    "                [,reliable=[0|1|fec],window=N,rto_ms=N,fec=K:M]\n"                        \
+    "  XDP           xdp,ifname,queue[,msg_id=N,mtu=N,crc=[header|payload],frames=N,busy_poll=N,mode=[skb|drv]]\n"
 
 // Copies channel parameters from configuration into param argument.
 //
@@ -401,7 +673,8 @@ int pirate_get_channel_description(int gd, char *str, int len);
 // If the return value is a nonnegative integer then the gaps
 // descriptor is also a valid unix file descriptor.
 // If the return value is a negative integer less than -1 then
-// the gaps descriptor is not a file descriptor.
+// the gaps descriptor is not a file descriptor. Like a file
+// descriptor, it may be returned again after it is closed.
 
 int pirate_open_parse(const char *param, int flags);
 
@@ -419,23 +692,61 @@ int pirate_open_parse(const char *param, int flags);
 // If the return value is a nonnegative integer then the gaps
 // descriptor is also a valid unix file descriptor.
 // If the return value is a negative integer less than -1 then
-// the gaps descriptor is not a file descriptor.
+// the gaps descriptor is not a file descriptor. Like a file
+// descriptor, it may be returned again after it is closed.
 
 int pirate_open_param(pirate_channel_param_t *param, int flags);
 
+// Creates and initializes the shared memory region of a SHMEM
+// channel in a sealed anonymous file (memfd). The region has
+// no name in /dev/shm. A launcher creates the region and passes
+// the file descriptor to the reader and the writer, which open
+// the channel with the fd option. They open the channel without
+// waiting for each other, and a side that exits without closing
+// the channel may be replaced by a new process.
+//
+// The return value is the file descriptor, or -1 if an error
+// occurred (in which case, errno is set appropriately).
+
+int pirate_shmem_create(const pirate_channel_param_t *param);
+
 // Returns 1 if the channel type supports the
 // O_NONBLOCK flag to pirate_open(). Otherwise return 0.
 
 int pirate_nonblock_channel_type(channel_enum_t channel_type, size_t mtu);
 
 // Returns a reference to the read and write statistics
-// associated with the gaps descriptor.
+// associated with the gaps descriptor. The statistics are
+// counted separately by each thread and are summed by this
+// call. Concurrent calls on the same gaps descriptor return the
+// same reference. Each counter of the reference holds the total
+// of one call and is updated by later calls. The reference is
+// valid until the gaps descriptor is closed.
 //
-// On success, the file descriptor is returned.
+// On success, the reference is returned.
 // On error NULL is returned, and errno is set appropriately.
 
 const pirate_stats_t *pirate_get_stats(int gd);
 
+// Copies the statistics associated with the gaps descriptor
+// together with the latency and packet size histograms
+// into stats.
+//
+// On success, zero is returned. On error, -1 is returned,
+// and errno is set appropriately.
+
+int pirate_get_stats_ex(int gd, pirate_stats_ex_t *stats);
+
+// Returns the smallest value counted by the histogram bucket.
+
+uint64_t pirate_histogram_value(unsigned bucket);
+
+// Returns an estimate of the value below which the fraction
+// p (0.0 to 1.0) of the histogram samples fall. Returns zero
+// if the histogram is empty.
+
+uint64_t pirate_histogram_percentile(const pirate_histogram_t *hist, double p);
+
 // pirate_read() attempts to read the next packet of up
 // to count bytes from gaps descriptor gd to the buffer
 // starting at buf.
@@ -449,6 +760,17 @@ const pirate_stats_t *pirate_get_stats(int gd);
 
 ssize_t pirate_read(int gd, void *buf, size_t count);
 
+// pirate_peek_len() returns the length of the next packet
+// on the gaps descriptor gd without consuming the packet.
+// The call blocks until a packet is available. A buffer
+// of the returned length can hold the entire packet on
+// the following call to pirate_read().
+//
+// On success, the length of the next packet is returned.
+// On error, -1 is returned, and errno is set appropriately.
+
+ssize_t pirate_peek_len(int gd);
+
 // pirate_write() writes the next packet of count bytes
 // from the buffer starting at buf to the gaps descriptor
 // gd.
@@ -458,6 +780,18 @@ ssize_t pirate_read(int gd, void *buf, size_t count);
 
 ssize_t pirate_write(int gd, const void *buf, size_t count);
 
+// pirate_writev() writes the next packet from the iovcnt
+// buffers described by iov to the gaps descriptor gd.
+// The buffers are concatenated into a single packet,
+// so a header and a payload can be sent without first
+// copying them into a contiguous buffer. At most
+// PIRATE_IOV_MAX buffers can be specified.
+//
+// On success, the number of bytes written is returned.
+// On error, -1 is returned, and errno is set appropriately.
+
+ssize_t pirate_writev(int gd, const struct iovec *iov, int iovcnt);
+
 // pirate_write_mtu() returns the maximum data length
 // that can be send in a call to pirate_write() for
 // the given channel. A value of 0 indicates no maximum length.
@@ -467,6 +801,233 @@ ssize_t pirate_write(int gd, const void *buf, size_t count);
 
 ssize_t pirate_write_mtu(int gd);
 
+// pirate_write_batch() writes up to vlen independent packets
+// described by msgs to the gaps descriptor gd. At most
+// PIRATE_IOV_MAX packets are written per call. The number
+// of bytes written for each packet is stored in msgs[i].len.
+// Only the last packet written can be shorter than requested.
+//
+// The batch is sent with a single sendmmsg() for the UDP_SOCKET,
+// UNIX_SEQPACKET, and GE_ETH channel types, a single writev()
+// for the stream channel types, and a single index update for
+// the SHMEM and UDP_SHMEM channel types. Other channel types
+// write the packets one at a time.
+//
+// On success, the number of packets written is returned. This
+// can be less than vlen if an error occurs after the first
+// packet is written. On error, -1 is returned, and errno is
+// set appropriately.
+
+ssize_t pirate_write_batch(int gd, pirate_mmsg_t *msgs, unsigned vlen);
+
+// pirate_read_batch() reads up to vlen packets from the gaps
+// descriptor gd into the buffers described by msgs. The call
+// blocks until the first packet is available and then returns
+// the packets that can be read without blocking. At most
+// PIRATE_IOV_MAX packets are read per call. The length of each
+// packet is stored in msgs[i].len. As with pirate_read(),
+// a packet of length zero is returned when the writer has
+// closed the channel.
+//
+// On success, the number of packets read is returned.
+// On error, -1 is returned, and errno is set appropriately.
+
+ssize_t pirate_read_batch(int gd, pirate_mmsg_t *msgs, unsigned vlen);
+
+// pirate_write_reserve() reserves space for the next packet
+// of up to count bytes directly inside the channel. The
+// reserved region is returned in iov[0] and iov[1]. The
+// second segment is empty unless the region wraps around
+// the end of the channel buffer. The reservation is shorter
+// than count when the channel does not have enough free space.
+//
+// The packet is not visible to the reader until
+// pirate_write_commit() is called. At most one reservation
+// may be outstanding on a gaps descriptor. Zero-copy writes
+// are supported by the SHMEM and MERCURY channel types.
+//
+// On success, the number of bytes reserved is returned.
+// On error, -1 is returned, and errno is set appropriately.
+
+ssize_t pirate_write_reserve(int gd, size_t count, struct iovec iov[2]);
+
+// pirate_write_commit() transmits the first count bytes
+// of the region returned by pirate_write_reserve() as the
+// next packet. count must not exceed the reserved length.
+//
+// On success, the number of bytes written is returned.
+// On error, -1 is returned, and errno is set appropriately.
+
+ssize_t pirate_write_commit(int gd, size_t count);
+
+// pirate_read_acquire() returns the location of the next
+// packet inside the channel in iov[0] and iov[1]. The
+// second segment is empty unless the packet wraps around
+// the end of the channel buffer. The packet contents remain
+// valid until pirate_read_release() is called. At most one
+// packet may be acquired on a gaps descriptor. Zero-copy
+// reads are supported by the SHMEM and MERCURY channel types.
+//
+// On success, the packet length is returned.
+// On error, -1 is returned, and errno is set appropriately.
+
+ssize_t pirate_read_acquire(int gd, struct iovec iov[2]);
+
+// pirate_read_release() returns the packet acquired by
+// pirate_read_acquire() to the channel. Calling
+// pirate_read_release() with no acquired packet has no effect.
+//
+// pirate_read_release() returns zero on success. On error,
+// -1 is returned, and errno is set appropriately.
+
+int pirate_read_release(int gd);
+
+// pirate_poll_create() returns a new poll set that waits on
+// many gaps descriptors of any channel type from one thread.
+// The file descriptor channel types are waited on with epoll.
+// The SHMEM, UDP_SHMEM, and UIO channel types are waited on
+// by helper threads that sleep on the futexes of the shared
+// memory rings and signal an eventfd in the epoll set.
+// The UIO channel type does not wake up a sleeping peer so
+// it is polled every millisecond.
+//
+// A poll set must not be modified while a call to
+// pirate_poll_wait() is in progress. A gaps descriptor must
+// be removed from the poll set before it is closed.
+//
+// On success, the poll set is returned. On error,
+// NULL is returned, and errno is set appropriately.
+
+pirate_poll_t *pirate_poll_create(void);
+
+// pirate_poll_add() adds the gaps descriptor gd to the poll set.
+// events is PIRATE_POLLIN for a reader or PIRATE_POLLOUT for
+// a writer.
+//
+// pirate_poll_add() returns zero on success. On error,
+// -1 is returned, and errno is set appropriately.
+
+int pirate_poll_add(pirate_poll_t *poll, int gd, uint32_t events);
+
+// pirate_poll_del() removes the gaps descriptor gd from the poll set.
+//
+// pirate_poll_del() returns zero on success. On error,
+// -1 is returned, and errno is set appropriately.
+
+int pirate_poll_del(pirate_poll_t *poll, int gd);
+
+// pirate_poll_wait() waits until at least one gaps descriptor in
+// the poll set is ready and stores up to maxevents ready gaps
+// descriptors in events. Readiness is level-triggered. A reader
+// is ready when a packet is available or the writer has closed
+// the channel. A writer is ready when the channel is not full.
+// The timeout is in milliseconds, and -1 waits indefinitely.
+// The wait is not interrupted by signals.
+//
+// On success, the number of ready gaps descriptors is returned,
+// or zero if the timeout expired. On error, -1 is returned,
+// and errno is set appropriately.
+
+int pirate_poll_wait(pirate_poll_t *poll, pirate_poll_event_t *events,
+                     int maxevents, int timeout);
+
+// pirate_poll_close() stops the helper threads and
+// releases the poll set. The gaps descriptors in
+// the poll set are not closed.
+//
+// pirate_poll_close() returns zero on success. On error,
+// -1 is returned, and errno is set appropriately.
+
+int pirate_poll_close(pirate_poll_t *poll);
+
+// pirate_async_create() returns a new asynchronous request queue.
+// One thread can keep reads and writes in flight on many gaps
+// descriptors. The UDP_SOCKET, UNIX_SEQPACKET, PIPE, DEVICE,
+// UNIX_SOCKET, and TCP_SOCKET channel types are executed by io_uring
+// with the file descriptors registered as fixed files. The other
+// channel types, nonblocking gaps descriptors, and all channel types
+// on kernels without io_uring (Linux 5.11) use pirate_read() and
+// pirate_write() from pirate_async_wait() once a poll set reports
+// the gaps descriptor ready (see pirate_poll_wait()). A write that
+// is longer than the free space of the channel waits for the reader.
+// The SHMEM_MPMC type is not supported.
+//
+// At most entries requests may be outstanding. The requests of a
+// gaps descriptor are executed one at a time in the order they are
+// submitted, in each direction. A gaps descriptor with outstanding
+// requests must not be used with the synchronous API.
+//
+// On success, the queue is returned. On error,
+// NULL is returned, and errno is set appropriately.
+
+pirate_async_t *pirate_async_create(unsigned entries);
+
+// pirate_async_add() adds the gaps descriptor gd to the queue.
+// A gaps descriptor must be added before requests are submitted
+// and removed with pirate_async_del() before it is closed.
+//
+// pirate_async_add() returns zero on success. On error,
+// -1 is returned, and errno is set appropriately.
+
+int pirate_async_add(pirate_async_t *async, int gd);
+
+// pirate_async_del() removes the gaps descriptor gd from
+// the queue. The gaps descriptor must not have outstanding requests.
+//
+// pirate_async_del() returns zero on success. On error,
+// -1 is returned, and errno is set appropriately.
+
+int pirate_async_del(pirate_async_t *async, int gd);
+
+// pirate_async_register_buffers() registers nr buffers with the
+// kernel. Reads and datagram writes into a region of a registered
+// buffer avoid mapping the pages of the buffer on each request.
+// Buffers can be registered once per queue.
+//
+// pirate_async_register_buffers() returns zero on success.
+// On error, -1 is returned, and errno is set appropriately.
+
+int pirate_async_register_buffers(pirate_async_t *async, const struct iovec *iov, unsigned nr);
+
+// pirate_async_read() submits a read of the next packet of up to
+// count bytes from the gaps descriptor gd into buf. buf must remain
+// valid until the request completes. user_data is returned in the
+// completion event.
+//
+// pirate_async_read() returns zero on success. On error,
+// -1 is returned, and errno is set appropriately.
+
+int pirate_async_read(pirate_async_t *async, int gd, void *buf, size_t count, void *user_data);
+
+// pirate_async_write() submits a write of the packet of count bytes
+// from buf to the gaps descriptor gd. buf must remain valid until
+// the request completes. user_data is returned in the completion event.
+//
+// pirate_async_write() returns zero on success. On error,
+// -1 is returned, and errno is set appropriately.
+
+int pirate_async_write(pirate_async_t *async, int gd, const void *buf, size_t count, void *user_data);
+
+// pirate_async_wait() submits the queued requests to the kernel and
+// stores up to maxevents completed requests in events. It waits
+// for at least one completion, until the timeout in milliseconds
+// expires. A timeout of -1 waits indefinitely.
+//
+// On success, the number of completed requests is returned, or zero
+// if the timeout expired or no requests are outstanding. On error,
+// -1 is returned, and errno is set appropriately.
+
+int pirate_async_wait(pirate_async_t *async, pirate_async_event_t *events,
+                      int maxevents, int timeout);
+
+// pirate_async_close() releases the queue. The outstanding
+// requests are canceled. The gaps descriptors are not closed.
+//
+// pirate_async_close() returns zero on success. On error,
+// -1 is returned, and errno is set appropriately.
+
+int pirate_async_close(pirate_async_t *async);
+
 // Closes the gaps channel specified by the gaps descriptor.
 //
 // pirate_close() returns zero on success.  On error,
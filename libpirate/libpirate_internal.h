@@ -21,6 +21,7 @@ extern "C" {
 #endif
 
 void pirate_reset_stats();
+unsigned pirate_stats_thread_slot();
 ssize_t pirate_write_mtu_estimate(const pirate_channel_param_t *param);
 
 #ifdef __cplusplus
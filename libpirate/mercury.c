@@ -21,6 +21,8 @@
 #include <string.h>
 #include <unistd.h>
 #include <endian.h>
+#include <stddef.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include "pirate_common.h"
@@ -69,9 +71,34 @@ typedef struct ilip_long_message {
 
 #pragma pack()
 
-static int mercury_message_pack(void *buf, const void *data,
-        uint32_t data_len, const pirate_mercury_param_t *param) {
+// The descriptor hash is the last 8 bytes of the DMA descriptor
+// in both the immediate and the payload modes
+#define MERCURY_DESC_HASH_OFFSET offsetof(ilip_long_message_t, desc_hash)
+
+_Static_assert(MERCURY_DESC_HASH_OFFSET + sizeof(uint64_t) == PIRATE_MERCURY_DMA_DESCRIPTOR,
+    "descriptor hash must end the DMA descriptor");
+
+static void mercury_message_gather(uint8_t *dst, const struct iovec *iov, int iovcnt) {
+    for (int i = 0; i < iovcnt; i++) {
+        memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+        dst += iov[i].iov_len;
+    }
+}
+
+// The descriptor hash covers the DMA descriptor up to the hash
+// field. The ILIP sets the ilip_time field after the writer has
+// hashed the descriptor so the field is hashed as zero.
+static uint64_t mercury_desc_hash(void *buf, const pirate_siphash_key_t *key) {
     ilip_message_t *msg_hdr = (ilip_message_t *)buf;
+    msg_hdr->time.ilip_time = 0ul;
+    return pirate_siphash64(key, buf, MERCURY_DESC_HASH_OFFSET);
+}
+
+static int mercury_message_pack(void *buf, const struct iovec *iov,
+        int iovcnt, size_t data_len, const pirate_mercury_param_t *param,
+        const mercury_ctx *ctx) {
+    ilip_message_t *msg_hdr = (ilip_message_t *)buf;
+    ilip_long_message_t *long_msg_hdr = (ilip_long_message_t *)buf;
     struct timespec tv;
     uint64_t linux_time;
 
@@ -110,24 +137,145 @@ static int mercury_message_pack(void *buf, const void *data,
         uint8_t *immediate_data = (uint8_t *)buf + sizeof(ilip_message_t);
         msg_hdr->header.data_or_descriptor_tag = htobe32(param->data_tag);
         msg_hdr->immediate_length = htobe32(data_len);
-        memcpy(immediate_data, data, data_len);
+        mercury_message_gather(immediate_data, iov, iovcnt);
     } else {
-        ilip_long_message_t *long_msg_hdr = (ilip_long_message_t *)buf;
+        // The device reads the payload from host_payload_address
+        // so the payload must be a single buffer.
+        const uint8_t *payload_data = (iovcnt > 0) ? (const uint8_t *) iov[0].iov_base : NULL;
         msg_hdr->header.data_or_descriptor_tag = htobe32(param->descriptor_tag);
         long_msg_hdr->data_tag = htobe32(param->data_tag);
-        long_msg_hdr->host_payload_address = (uintptr_t) data;
+        long_msg_hdr->host_payload_address = (uintptr_t) payload_data;
         long_msg_hdr->data_length = htobe32(data_len);
-        // TODO calculate message data siphash
+        if (ctx->auth) {
+            uint64_t data_hash[2];
+            pirate_siphash128(&ctx->key, payload_data, data_len, data_hash);
+            long_msg_hdr->data_hash_lo = htole64(data_hash[0]);
+            long_msg_hdr->data_hash_hi = htole64(data_hash[1]);
+        }
+    }
+
+    if (ctx->auth) {
+        long_msg_hdr->desc_hash = htole64(mercury_desc_hash(buf, &ctx->key));
+    }
+    return 0;
+}
+
+// Verifies the hashes of the message in ctx->buf. The payload
+// of length data_len was placed at payload by the device.
+static int mercury_message_verify(mercury_ctx *ctx, const pirate_mercury_param_t *param,
+        const void *payload, size_t data_len) {
+    const ilip_long_message_t *long_msg_hdr = (const ilip_long_message_t *)ctx->buf;
+    uint64_t data_hash[2];
+
+    if (!ctx->auth) {
+        return 0;
+    }
+    if (mercury_desc_hash(ctx->buf, &ctx->key) != le64toh(long_msg_hdr->desc_hash)) {
+        errno = EBADMSG;
+        return -1;
     }
+    if (param->mode == MERCURY_PAYLOAD) {
+        pirate_siphash128(&ctx->key, payload, data_len, data_hash);
+        if ((data_hash[0] != le64toh(long_msg_hdr->data_hash_lo)) ||
+            (data_hash[1] != le64toh(long_msg_hdr->data_hash_hi))) {
+            errno = EBADMSG;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// The key of a session is the 128-bit SipHash of the
+// big-endian session id under the key of the channel.
+static void mercury_session_key(const pirate_mercury_param_t *param, mercury_ctx *ctx) {
+    pirate_siphash_key_t channel_key;
+    uint32_t session = htobe32(param->session_id);
+    uint64_t session_key[2];
+
+    ctx->auth = 0;
+    for (unsigned i = 0; i < PIRATE_MERCURY_KEY_SIZE; i++) {
+        if (param->key[i] != 0) {
+            ctx->auth = 1;
+        }
+    }
+    if (!ctx->auth) {
+        return;
+    }
+    pirate_siphash_key(&channel_key, param->key);
+    pirate_siphash128(&channel_key, &session, sizeof(session), session_key);
+    ctx->key.k0 = session_key[0];
+    ctx->key.k1 = session_key[1];
+}
+
+static int mercury_parse_key(const char *val, uint8_t *key) {
+    if ((val == NULL) || (strlen(val) != 2 * PIRATE_MERCURY_KEY_SIZE)) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (unsigned i = 0; i < 2 * PIRATE_MERCURY_KEY_SIZE; i++) {
+        char c = val[i];
+        uint8_t nibble;
+        if ((c >= '0') && (c <= '9')) {
+            nibble = c - '0';
+        } else if ((c >= 'a') && (c <= 'f')) {
+            nibble = c - 'a' + 10;
+        } else if ((c >= 'A') && (c <= 'F')) {
+            nibble = c - 'A' + 10;
+        } else {
+            errno = EINVAL;
+            return -1;
+        }
+        key[i / 2] = (key[i / 2] << 4) | nibble;
+    }
+    return 0;
+}
 
-    // TODO calculate DMA descriptor siphash
+// Grows the registered buffer of pirate_write_reserve() and
+// pirate_read_acquire() to at least len bytes. The buffer is
+// locked in memory so that the device can transfer the payload
+// directly into or out of it without faulting.
+static int mercury_register_buffer(mercury_ctx *ctx, size_t len) {
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    void *addr;
+
+    if ((ctx->reg_buf != NULL) && (ctx->reg_len >= len)) {
+        return 0;
+    }
+    len = (MAX(len, 1) + page_size - 1) & ~(page_size - 1);
+    addr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (addr == MAP_FAILED) {
+        return -1;
+    }
+    // Locking can fail under RLIMIT_MEMLOCK. The driver
+    // pins the pages of each transfer in either case.
+    if (mlock(addr, len) != 0) {
+        errno = 0;
+    }
+    if (ctx->reg_buf != NULL) {
+        munmap(ctx->reg_buf, ctx->reg_len);
+    }
+    ctx->reg_buf = (uint8_t *) addr;
+    ctx->reg_len = len;
     return 0;
 }
 
-static void pirate_mercury_init_param(pirate_mercury_param_t *param) {
-    if (param->mtu == 0) {
-        param->mtu = PIRATE_MERCURY_DEFAULT_MTU;
+static void mercury_release_buffers(mercury_ctx *ctx) {
+    if (ctx->buf != NULL) {
+        free(ctx->buf);
+        ctx->buf = NULL;
+    }
+    if (ctx->gather_buf != NULL) {
+        free(ctx->gather_buf);
+        ctx->gather_buf = NULL;
+        ctx->gather_len = 0;
     }
+    if (ctx->reg_buf != NULL) {
+        munmap(ctx->reg_buf, ctx->reg_len);
+        ctx->reg_buf = NULL;
+        ctx->reg_len = 0;
+    }
+    ctx->reg_pending = 0;
 }
 
 int pirate_mercury_parse_param(char *str, void *_param) {
@@ -166,6 +314,10 @@ int pirate_mercury_parse_param(char *str, void *_param) {
             param->descriptor_tag = strtol(val, NULL, 10);
         } else if (strncmp("mtu", key, strlen("mtu")) == 0) {
             param->mtu = strtol(val, NULL, 10);
+        } else if (strncmp("key", key, strlen("key")) == 0) {
+            if (mercury_parse_key(val, param->key) != 0) {
+                return -1;
+            }
         } else {
             errno = EINVAL;
             return -1;
@@ -177,7 +329,7 @@ int pirate_mercury_parse_param(char *str, void *_param) {
 int pirate_mercury_get_channel_description(const void *_param, char *desc, int len) {
     const pirate_mercury_param_t *param = (const pirate_mercury_param_t *)_param;
     int ret_sz = 0;
-    char mode[16], mtu_str[32];
+    char mode[16], mtu_str[32], key_str[8 + 2 * PIRATE_MERCURY_KEY_SIZE];
 
     switch (param->mode) {
         case MERCURY_IMMEDIATE:
@@ -196,13 +348,25 @@ int pirate_mercury_get_channel_description(const void *_param, char *desc, int l
         snprintf(mtu_str, 32, ",mtu=%u", param->mtu);
     }
 
-    ret_sz = snprintf(desc, len, "mercury,mode=%s,session=%u,message=%u,data=%u,descriptor=%u%s",
+    key_str[0] = 0;
+    for (unsigned i = 0; i < PIRATE_MERCURY_KEY_SIZE; i++) {
+        if (param->key[i] != 0) {
+            char *ptr = key_str + snprintf(key_str, sizeof(key_str), ",key=");
+            for (unsigned j = 0; j < PIRATE_MERCURY_KEY_SIZE; j++) {
+                ptr += sprintf(ptr, "%02x", param->key[j]);
+            }
+            break;
+        }
+    }
+
+    ret_sz = snprintf(desc, len, "mercury,mode=%s,session=%u,message=%u,data=%u,descriptor=%u%s%s",
                         mode,
                         param->session_id,
                         param->message_id,
                         param->data_tag,
                         param->descriptor_tag,
-                        mtu_str);
+                        mtu_str,
+                        key_str);
     return ret_sz;
 }
 
@@ -217,8 +381,6 @@ int pirate_mercury_open(void *_param, void *_ctx) {
     const mode_t mode = access == O_RDONLY ? S_IRUSR : S_IWUSR;
 
     /* Open the root device to configure and establish a session */
-    pirate_mercury_init_param(param);
-
     if ((param->mode != MERCURY_IMMEDIATE) && (param->mode != MERCURY_PAYLOAD)) {
         errno = EINVAL;
         return -1;
@@ -272,13 +434,10 @@ int pirate_mercury_open(void *_param, void *_ctx) {
         goto error;
     }
 
-    /* Allocate buffer for formatted messages */
-    if ((param->mode == MERCURY_PAYLOAD) && (access == O_RDONLY)) {
-        // this should go away when the read() API is fixed
-        ctx->buf = (uint8_t *) malloc(param->mtu + PIRATE_MERCURY_DMA_DESCRIPTOR);
-    } else {
-        ctx->buf = (uint8_t *) malloc(PIRATE_MERCURY_DMA_DESCRIPTOR);
-    }
+    mercury_session_key(param, ctx);
+
+    /* Allocate buffer for the DMA descriptor */
+    ctx->buf = (uint8_t *) malloc(PIRATE_MERCURY_DMA_DESCRIPTOR);
     if (ctx->buf == NULL) {
         goto error;
     }
@@ -295,10 +454,7 @@ error:
         ctx->fd = -1;
     }
 
-    if (ctx->buf != NULL) {
-        free(ctx->buf);
-        ctx->buf = NULL;
-    }
+    mercury_release_buffers(ctx);
 
     return -1;
 }
@@ -307,10 +463,7 @@ int pirate_mercury_close(void *_ctx) {
     mercury_ctx *ctx = (mercury_ctx *)_ctx;
     int rv = -1;
 
-    if (ctx->buf != NULL) {
-        free(ctx->buf);
-        ctx->buf = NULL;
-    }
+    mercury_release_buffers(ctx);
 
     if (ctx->fd <= 0) {
         errno = ENODEV;
@@ -322,10 +475,17 @@ int pirate_mercury_close(void *_ctx) {
     return rv;
 }
 
-ssize_t pirate_mercury_read(const void *_param, void *_ctx, void *buf, size_t count) {
-    const pirate_mercury_param_t *param = (const pirate_mercury_param_t *)_param;
-    mercury_ctx *ctx = (mercury_ctx *)_ctx;
+// Reads the next message. In payload mode the device places the
+// payload directly into buf. The reader passes the address and
+// the length of buf in the host_payload_address and data_length
+// fields of the descriptor buffer. The device returns the
+// descriptor of the writer and the read() return value is the
+// descriptor length plus the number of payload bytes placed.
+static ssize_t mercury_message_recv(const pirate_mercury_param_t *param, mercury_ctx *ctx,
+        void *buf, size_t count) {
     ilip_message_t *msg_hdr = (ilip_message_t *) ctx->buf;
+    ilip_long_message_t *long_msg_hdr = (ilip_long_message_t *) ctx->buf;
+    ssize_t rv;
 
     if (ctx->fd <= 0) {
         errno = ENODEV;
@@ -333,61 +493,212 @@ ssize_t pirate_mercury_read(const void *_param, void *_ctx, void *buf, size_t co
     }
 
     if (param->mode == MERCURY_IMMEDIATE) {
-        size_t rd_len = PIRATE_MERCURY_DMA_DESCRIPTOR;
-        ssize_t rv = read(ctx->fd, ctx->buf, rd_len);
+        rv = read(ctx->fd, ctx->buf, PIRATE_MERCURY_DMA_DESCRIPTOR);
         if (rv < 0) {
             return -1;
         }
+        if (ctx->auth && (rv < PIRATE_MERCURY_DMA_DESCRIPTOR)) {
+            errno = EBADMSG;
+            return -1;
+        }
+        if (mercury_message_verify(ctx, param, NULL, 0) != 0) {
+            return -1;
+        }
         const uint8_t *msg_data = (const uint8_t *) ctx->buf + sizeof(ilip_message_t);
         uint32_t payload_len = be32toh(msg_hdr->immediate_length);
+        payload_len = MIN(payload_len, PIRATE_MERCURY_IMMEDIATE_SIZE);
         count = MIN(payload_len, count);
         memcpy(buf, msg_data, count);
     } else {
-        // this is fine (ᓄ ᴥ ᓇ)
-        size_t rd_len = PIRATE_MERCURY_DMA_DESCRIPTOR + count;
-        ssize_t rv = read(ctx->fd, ctx->buf, rd_len);
+        memset(ctx->buf, 0, PIRATE_MERCURY_DMA_DESCRIPTOR);
+        long_msg_hdr->host_payload_address = (uintptr_t) buf;
+        long_msg_hdr->data_length = htobe32(count);
+        rv = read(ctx->fd, ctx->buf, PIRATE_MERCURY_DMA_DESCRIPTOR);
         if (rv < PIRATE_MERCURY_DMA_DESCRIPTOR) {
             return -1;
         }
-        // The data_length field of the descriptor is not set.
-        // Use the read() return value instead.
         count = MIN((size_t) (rv - PIRATE_MERCURY_DMA_DESCRIPTOR), count);
-        memcpy(buf, ctx->buf + PIRATE_MERCURY_DMA_DESCRIPTOR, count);
+        // The hash of a truncated payload cannot be verified
+        if (ctx->auth && (be32toh(long_msg_hdr->data_length) > count)) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        if (mercury_message_verify(ctx, param, buf, count) != 0) {
+            return -1;
+        }
     }
     return count;
 }
 
+ssize_t pirate_mercury_read(const void *_param, void *_ctx, void *buf, size_t count) {
+    const pirate_mercury_param_t *param = (const pirate_mercury_param_t *)_param;
+    mercury_ctx *ctx = (mercury_ctx *)_ctx;
+
+    return mercury_message_recv(param, ctx, buf, count);
+}
+
 ssize_t pirate_mercury_write_mtu(const void *_param, void *_ctx) {
     (void) _ctx;
     const pirate_mercury_param_t *param = (const pirate_mercury_param_t *)_param;
+    if (param->mode == MERCURY_IMMEDIATE) {
+        if ((param->mtu > 0) && (param->mtu < PIRATE_MERCURY_IMMEDIATE_SIZE)) {
+            return param->mtu;
+        }
+        return PIRATE_MERCURY_IMMEDIATE_SIZE;
+    }
     return param->mtu;
 }
 
-ssize_t pirate_mercury_write(const void *_param, void *_ctx, const void *buf, size_t count) {
+// Writes one message. In payload mode iov must be a single
+// buffer and the device reads the payload directly from it.
+static ssize_t mercury_message_send(const pirate_mercury_param_t *param, mercury_ctx *ctx,
+        const struct iovec *iov, int iovcnt, size_t count) {
+    ssize_t rv;
+
+    // The ILIP driver consumes one message per write() so the
+    // descriptor is formatted into ctx->buf.
+    if (mercury_message_pack(ctx->buf, iov, iovcnt, count, param, ctx)) {
+        return -1;
+    }
+
+    rv = write(ctx->fd, ctx->buf, PIRATE_MERCURY_DMA_DESCRIPTOR);
+    if (rv == PIRATE_MERCURY_DMA_DESCRIPTOR) {
+        return count;
+    }
+
+    return -1;
+}
+
+ssize_t pirate_mercury_writev(const void *_param, void *_ctx, const struct iovec *iov, int iovcnt) {
     const pirate_mercury_param_t *param = (const pirate_mercury_param_t *)_param;
     mercury_ctx *ctx = (mercury_ctx *)_ctx;
-    ssize_t wr_len, rv;
+    struct iovec gather;
+    size_t count = 0;
 
     if (ctx->fd <= 0) {
         errno = ENODEV;
         return -1;
     }
 
-    if (mercury_message_pack(ctx->buf, buf, count, param)) {
+    if ((iovcnt < 0) || (iovcnt > PIRATE_IOV_MAX)) {
+        errno = EINVAL;
         return -1;
     }
 
+    for (int i = 0; i < iovcnt; i++) {
+        count += iov[i].iov_len;
+    }
+
+    // The DMA descriptor holds a single payload address
+    // so multiple buffers are gathered into ctx->gather_buf.
+    if ((param->mode == MERCURY_PAYLOAD) && (iovcnt > 1)) {
+        if ((param->mtu > 0) && (count > param->mtu)) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        if (ctx->gather_len < count) {
+            uint8_t *gather_buf = (uint8_t *) realloc(ctx->gather_buf, count);
+            if (gather_buf == NULL) {
+                return -1;
+            }
+            ctx->gather_buf = gather_buf;
+            ctx->gather_len = count;
+        }
+        mercury_message_gather(ctx->gather_buf, iov, iovcnt);
+        gather.iov_base = ctx->gather_buf;
+        gather.iov_len = count;
+        iov = &gather;
+        iovcnt = 1;
+    }
+
+    return mercury_message_send(param, ctx, iov, iovcnt, count);
+}
+
+ssize_t pirate_mercury_write(const void *_param, void *_ctx, const void *buf, size_t count) {
+    struct iovec iov;
+
+    iov.iov_base = (void*) buf;
+    iov.iov_len = count;
+    return pirate_mercury_writev(_param, _ctx, &iov, 1);
+}
+
+ssize_t pirate_mercury_write_reserve(const void *_param, void *_ctx, size_t count, struct iovec *iov) {
+    const pirate_mercury_param_t *param = (const pirate_mercury_param_t *)_param;
+    mercury_ctx *ctx = (mercury_ctx *)_ctx;
+
+    if (ctx->fd <= 0) {
+        errno = ENODEV;
+        return -1;
+    }
+    if (ctx->reg_pending) {
+        errno = EBUSY;
+        return -1;
+    }
     if (param->mode == MERCURY_IMMEDIATE) {
-        wr_len = PIRATE_MERCURY_DMA_DESCRIPTOR;
-    } else {
-        // this is fine (ᓄ ᴥ ᓇ)
-        wr_len = PIRATE_MERCURY_DMA_DESCRIPTOR + count;
+        count = MIN(count, PIRATE_MERCURY_IMMEDIATE_SIZE);
+    }
+    if ((param->mtu > 0) && (count > param->mtu)) {
+        count = param->mtu;
     }
+    if (mercury_register_buffer(ctx, count) != 0) {
+        return -1;
+    }
+    iov[0].iov_base = ctx->reg_buf;
+    iov[0].iov_len = count;
+    iov[1].iov_base = NULL;
+    iov[1].iov_len = 0;
+    ctx->reg_pending = 1;
+    ctx->reg_pending_len = count;
+    return count;
+}
 
-    rv = write(ctx->fd, ctx->buf, wr_len);
-    if (rv == wr_len) {
-        return count;
+ssize_t pirate_mercury_write_commit(const void *_param, void *_ctx, size_t count) {
+    const pirate_mercury_param_t *param = (const pirate_mercury_param_t *)_param;
+    mercury_ctx *ctx = (mercury_ctx *)_ctx;
+    struct iovec iov;
+
+    if (!ctx->reg_pending || (count > ctx->reg_pending_len)) {
+        errno = EINVAL;
+        return -1;
     }
+    ctx->reg_pending = 0;
+    iov.iov_base = ctx->reg_buf;
+    iov.iov_len = count;
+    return mercury_message_send(param, ctx, &iov, 1, count);
+}
 
-    return -1;
+ssize_t pirate_mercury_read_acquire(const void *_param, void *_ctx, struct iovec *iov) {
+    const pirate_mercury_param_t *param = (const pirate_mercury_param_t *)_param;
+    mercury_ctx *ctx = (mercury_ctx *)_ctx;
+    size_t len = PIRATE_MERCURY_IMMEDIATE_SIZE;
+    ssize_t rv;
+
+    if (ctx->reg_pending) {
+        errno = EBUSY;
+        return -1;
+    }
+    if (param->mode == MERCURY_PAYLOAD) {
+        len = (param->mtu > 0) ? param->mtu : PIRATE_MERCURY_DEFAULT_BUFFER;
+    }
+    if (mercury_register_buffer(ctx, len) != 0) {
+        return -1;
+    }
+    rv = mercury_message_recv(param, ctx, ctx->reg_buf, ctx->reg_len);
+    if (rv < 0) {
+        return -1;
+    }
+    iov[0].iov_base = ctx->reg_buf;
+    iov[0].iov_len = rv;
+    iov[1].iov_base = NULL;
+    iov[1].iov_len = 0;
+    ctx->reg_pending = 1;
+    return rv;
+}
+
+int pirate_mercury_read_release(const void *_param, void *_ctx) {
+    (void) _param;
+    mercury_ctx *ctx = (mercury_ctx *)_ctx;
+
+    ctx->reg_pending = 0;
+    return 0;
 }
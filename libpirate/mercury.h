@@ -17,12 +17,26 @@
 #define __PIRATE_CHANNEL_MERCURY_H
 
 #include "libpirate.h"
+#include "siphash.h"
 
 typedef struct {
     int flags;
     int fd;
+    // DMA descriptor of the current message
     uint8_t *buf;
+    // payload of a pirate_writev() with more than one buffer
+    uint8_t *gather_buf;
+    size_t gather_len;
+    // locked buffer of pirate_write_reserve() and pirate_read_acquire()
+    uint8_t *reg_buf;
+    size_t reg_len;
+    int reg_pending;
+    size_t reg_pending_len;
     char path[PIRATE_LEN_NAME];
+    // nonzero when the messages are authenticated
+    int auth;
+    // SipHash key of the session
+    pirate_siphash_key_t key;
 } mercury_ctx;
 
 int pirate_mercury_parse_param(char *str, void *_param);
@@ -32,7 +46,12 @@ int pirate_mercury_close(void *_ctx);
 ssize_t pirate_mercury_read(const void *_param, void *_ctx, void *buf, size_t count);
 ssize_t pirate_mercury_write(const void *_param, void *_ctx, const void *buf, size_t count);
 ssize_t pirate_mercury_write_mtu(const void *_param, void *_ctx);
+ssize_t pirate_mercury_writev(const void *_param, void *_ctx, const struct iovec *iov, int iovcnt);
+ssize_t pirate_mercury_write_reserve(const void *_param, void *_ctx, size_t count, struct iovec *iov);
+ssize_t pirate_mercury_write_commit(const void *_param, void *_ctx, size_t count);
+ssize_t pirate_mercury_read_acquire(const void *_param, void *_ctx, struct iovec *iov);
+int pirate_mercury_read_release(const void *_param, void *_ctx);
 
-#define PIRATE_MERCURY_CHANNEL_FUNCS { pirate_mercury_parse_param, pirate_mercury_get_channel_description, pirate_mercury_open, pirate_mercury_close, pirate_mercury_read, pirate_mercury_write, pirate_mercury_write_mtu }
+#define PIRATE_MERCURY_CHANNEL_FUNCS { pirate_mercury_parse_param, pirate_mercury_get_channel_description, pirate_mercury_open, pirate_mercury_close, pirate_mercury_read, pirate_mercury_write, pirate_mercury_write_mtu, pirate_mercury_write_reserve, pirate_mercury_write_commit, pirate_mercury_read_acquire, pirate_mercury_read_release, NULL, NULL, pirate_mercury_writev, NULL }
 
 #endif /* __PIRATE_CHANNEL_MERCURY_H */
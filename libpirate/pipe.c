@@ -160,6 +160,11 @@ ssize_t pirate_pipe_read(const void *_param, void *_ctx, void *buf, size_t count
     return pirate_stream_read((common_ctx*) _ctx, param->min_tx, buf, count);
 }
 
+ssize_t pirate_pipe_peek_len(const void *_param, void *_ctx) {
+    const pirate_pipe_param_t *param = (const pirate_pipe_param_t *)_param;
+    return pirate_stream_peek_len((common_ctx*) _ctx, param->min_tx);
+}
+
 ssize_t pirate_pipe_write_mtu(const void *_param, void *_ctx) {
     (void) _ctx;
     const pirate_pipe_param_t *param = (const pirate_pipe_param_t *)_param;
@@ -179,3 +184,15 @@ ssize_t pirate_pipe_write(const void *_param, void *_ctx, const void *buf, size_
     ssize_t mtu = pirate_pipe_write_mtu(param, _ctx);
     return pirate_stream_write((common_ctx*)_ctx, param->min_tx, mtu, buf, count);
 }
+
+ssize_t pirate_pipe_write_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen) {
+    const pirate_pipe_param_t *param = (const pirate_pipe_param_t *)_param;
+    ssize_t mtu = pirate_pipe_write_mtu(param, _ctx);
+    return pirate_stream_write_batch((common_ctx*)_ctx, param->min_tx, mtu, msgs, vlen);
+}
+
+ssize_t pirate_pipe_writev(const void *_param, void *_ctx, const struct iovec *iov, int iovcnt) {
+    const pirate_pipe_param_t *param = (const pirate_pipe_param_t *)_param;
+    ssize_t mtu = pirate_pipe_write_mtu(param, _ctx);
+    return pirate_stream_writev((common_ctx*)_ctx, param->min_tx, mtu, iov, iovcnt);
+}
@@ -23,6 +23,7 @@ typedef struct {
     int flags;
     int fd;
     uint8_t *min_tx_buf;
+    int peeked;
  } pipe_ctx;
 
 int pirate_pipe_parse_param(char *str, void *_param);
@@ -32,7 +33,10 @@ int pirate_pipe_close(void *_ctx);
 ssize_t pirate_pipe_read(const void *_param, void *_ctx, void *buf, size_t count);
 ssize_t pirate_pipe_write(const void *_param, void *_ctx, const void *buf, size_t count);
 ssize_t pirate_pipe_write_mtu(const void *_param, void *_ctx);
+ssize_t pirate_pipe_write_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen);
+ssize_t pirate_pipe_writev(const void *_param, void *_ctx, const struct iovec *iov, int iovcnt);
+ssize_t pirate_pipe_peek_len(const void *_param, void *_ctx);
 
-#define PIRATE_PIPE_CHANNEL_FUNCS { pirate_pipe_parse_param, pirate_pipe_get_channel_description, pirate_pipe_open, pirate_pipe_close, pirate_pipe_read, pirate_pipe_write, pirate_pipe_write_mtu }
+#define PIRATE_PIPE_CHANNEL_FUNCS { pirate_pipe_parse_param, pirate_pipe_get_channel_description, pirate_pipe_open, pirate_pipe_close, pirate_pipe_read, pirate_pipe_write, pirate_pipe_write_mtu, NULL, NULL, NULL, NULL, pirate_pipe_write_batch, NULL, pirate_pipe_writev, pirate_pipe_peek_len }
 
 #endif /*__PIRATE_CHANNEL_PIPE_H */
@@ -0,0 +1,910 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "pirate_common.h"
+#include "pirate_async.h"
+#include "pirate_poll.h"
+
+// The timeout of io_uring_enter() requires Linux 5.11
+#if defined(__NR_io_uring_setup) && defined(IORING_FEAT_EXT_ARG)
+#define PIRATE_IO_URING 1
+#endif
+
+// Number of fixed file slots. A file descriptor below
+// this value is registered in the slot of the same number.
+#define PIRATE_ASYNC_FILES 1024
+
+// maximum number of ready gaps descriptors retrieved
+// per call to pirate_poll_wait()
+#define PIRATE_ASYNC_BATCH 64
+
+// user_data of the io_uring request that polls the poll set
+#define PIRATE_ASYNC_POLL_DATA 0
+
+// Phases of a read on a stream channel type. The first min_tx
+// bytes hold the header and the start of the packet, the
+// remainder of the packet is read into the caller's buffer,
+// and the end of a truncated packet is discarded.
+typedef enum {
+    PIRATE_ASYNC_HEADER = 0,
+    PIRATE_ASYNC_DATA,
+    PIRATE_ASYNC_DISCARD
+} pirate_async_phase_t;
+
+struct pirate_async_member;
+
+typedef struct pirate_async_op {
+    struct pirate_async_op *next;
+    struct pirate_async_member *member;
+    int op;
+    uint8_t *buf;
+    size_t count;
+    void *user_data;
+    // index of the registered buffer that holds buf, or -1
+    int buf_index;
+    // progress of a request that takes several system calls
+    pirate_async_phase_t phase;
+    size_t pos;
+    size_t len;
+    size_t discard;
+    int retried;
+    pirate_header_t header;
+    struct iovec frame[3];
+    int frame_start;
+    int framecnt;
+    ssize_t result;
+    int err;
+} pirate_async_op_t;
+
+typedef struct {
+    pirate_async_op_t *head;
+    pirate_async_op_t *tail;
+} pirate_async_queue_t;
+
+typedef struct pirate_async_member {
+    int gd;
+    int fixed;
+    pirate_async_channel_t channel;
+    // requests executed by io_uring or by pirate_async_wait().
+    // The first request is in flight, or waits until the gaps
+    // descriptor is ready.
+    pirate_async_queue_t pending;
+    unsigned outstanding;
+    // start of the packet on reads, and discarded bytes
+    uint8_t *scratch;
+    size_t scratch_len;
+    // pads writes that are shorter than min_tx
+    uint8_t *padding;
+} pirate_async_member_t;
+
+struct pirate_async {
+    int ring_fd;
+    unsigned entries;
+    unsigned outstanding;
+    pirate_async_op_t *ops;
+    pirate_async_op_t *free;
+    // completed requests that have not been returned
+    pirate_async_queue_t done;
+    // The gaps descriptors with requests executed by
+    // pirate_async_wait() are in the poll set.
+    pirate_poll_t *poll;
+    // number of requests executed by pirate_async_wait()
+    unsigned blocking;
+    // indexed by 2 * gd for file descriptors,
+    // and by 2 * -(gd + 2) + 1 otherwise
+    pirate_async_member_t **members;
+    size_t members_size;
+    struct iovec *buffers;
+    unsigned buffer_count;
+#ifdef PIRATE_IO_URING
+    int files_registered;
+    // number of requests in flight in the kernel
+    unsigned in_ring;
+    // non-zero when the epoll file descriptor of
+    // the poll set is polled by io_uring
+    int poll_in_ring;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_array;
+    unsigned sq_mask;
+    unsigned sq_local_tail;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_len;
+    void *cq_ring;
+    size_t cq_ring_len;
+    size_t sqes_len;
+#endif
+};
+
+static inline void pirate_async_push(pirate_async_queue_t *queue, pirate_async_op_t *op) {
+    op->next = NULL;
+    if (queue->tail == NULL) {
+        queue->head = op;
+    } else {
+        queue->tail->next = op;
+    }
+    queue->tail = op;
+}
+
+static inline pirate_async_op_t *pirate_async_pop(pirate_async_queue_t *queue) {
+    pirate_async_op_t *op = queue->head;
+    if (op != NULL) {
+        queue->head = op->next;
+        if (queue->head == NULL) {
+            queue->tail = NULL;
+        }
+    }
+    return op;
+}
+
+static inline size_t pirate_async_index(int gd) {
+    return (gd >= 0) ? 2 * (size_t) gd : 2 * (size_t) -(gd + 2) + 1;
+}
+
+static pirate_async_member_t *pirate_async_find(pirate_async_t *async, int gd) {
+    size_t index;
+
+    if (gd == -1) {
+        return NULL;
+    }
+    index = pirate_async_index(gd);
+    if (index >= async->members_size) {
+        return NULL;
+    }
+    return async->members[index];
+}
+
+static inline uint64_t monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+}
+
+// Moves a completed request to the done queue and
+// updates the statistics of the gaps descriptor.
+static void pirate_async_done(pirate_async_t *async, pirate_async_op_t *op, ssize_t result, int err) {
+    op->result = result;
+    op->err = err;
+    pirate_async_stats(op->member->gd, result, err, op->retried);
+    pirate_async_push(&async->done, op);
+}
+
+#ifdef PIRATE_IO_URING
+
+static int pirate_async_setup(pirate_async_t *async) {
+    struct io_uring_params params;
+    int fd, *files;
+
+    memset(&params, 0, sizeof(params));
+    fd = syscall(__NR_io_uring_setup, async->entries, &params);
+    if (fd < 0) {
+        return -1;
+    }
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+        close(fd);
+        errno = ENOSYS;
+        return -1;
+    }
+
+    async->sq_ring_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    async->cq_ring_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        async->sq_ring_len = MAX(async->sq_ring_len, async->cq_ring_len);
+        async->cq_ring_len = 0;
+    }
+    async->sq_ring = mmap(NULL, async->sq_ring_len, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (async->sq_ring == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    if (async->cq_ring_len > 0) {
+        async->cq_ring = mmap(NULL, async->cq_ring_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (async->cq_ring == MAP_FAILED) {
+            munmap(async->sq_ring, async->sq_ring_len);
+            close(fd);
+            return -1;
+        }
+    } else {
+        async->cq_ring = async->sq_ring;
+    }
+    async->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    async->sqes = mmap(NULL, async->sqes_len, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (async->sqes == MAP_FAILED) {
+        if (async->cq_ring_len > 0) {
+            munmap(async->cq_ring, async->cq_ring_len);
+        }
+        munmap(async->sq_ring, async->sq_ring_len);
+        close(fd);
+        return -1;
+    }
+
+    async->sq_head = (unsigned *) ((uint8_t *) async->sq_ring + params.sq_off.head);
+    async->sq_tail = (unsigned *) ((uint8_t *) async->sq_ring + params.sq_off.tail);
+    async->sq_array = (unsigned *) ((uint8_t *) async->sq_ring + params.sq_off.array);
+    async->sq_mask = *(unsigned *) ((uint8_t *) async->sq_ring + params.sq_off.ring_mask);
+    async->sq_local_tail = *async->sq_tail;
+    async->cq_head = (unsigned *) ((uint8_t *) async->cq_ring + params.cq_off.head);
+    async->cq_tail = (unsigned *) ((uint8_t *) async->cq_ring + params.cq_off.tail);
+    async->cq_mask = *(unsigned *) ((uint8_t *) async->cq_ring + params.cq_off.ring_mask);
+    async->cqes = (struct io_uring_cqe *) ((uint8_t *) async->cq_ring + params.cq_off.cqes);
+    async->ring_fd = fd;
+
+    // The fixed file table is sparse. Each gaps
+    // descriptor is registered by pirate_async_add().
+    if ((files = malloc(PIRATE_ASYNC_FILES * sizeof(int))) != NULL) {
+        for (int i = 0; i < PIRATE_ASYNC_FILES; i++) {
+            files[i] = -1;
+        }
+        if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_FILES, files, PIRATE_ASYNC_FILES) == 0) {
+            async->files_registered = 1;
+        }
+        free(files);
+    }
+    return 0;
+}
+
+static void pirate_async_teardown(pirate_async_t *async) {
+    munmap(async->sqes, async->sqes_len);
+    if (async->cq_ring_len > 0) {
+        munmap(async->cq_ring, async->cq_ring_len);
+    }
+    munmap(async->sq_ring, async->sq_ring_len);
+    close(async->ring_fd);
+}
+
+static int pirate_async_update_file(pirate_async_t *async, int slot, int fd) {
+    struct io_uring_files_update update;
+
+    memset(&update, 0, sizeof(update));
+    update.offset = slot;
+    update.fds = (uintptr_t) &fd;
+    return (syscall(__NR_io_uring_register, async->ring_fd, IORING_REGISTER_FILES_UPDATE, &update, 1) == 1) ? 0 : -1;
+}
+
+// A submission queue entry is always available because
+// each outstanding request holds at most one entry.
+static struct io_uring_sqe *pirate_async_get_sqe(pirate_async_t *async) {
+    unsigned index = async->sq_local_tail & async->sq_mask;
+    struct io_uring_sqe *sqe = &async->sqes[index];
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    async->sq_array[index] = index;
+    async->sq_local_tail++;
+    return sqe;
+}
+
+// Prepares the next system call of the request.
+static void pirate_async_issue(pirate_async_t *async, pirate_async_op_t *op) {
+    pirate_async_member_t *member = op->member;
+    struct io_uring_sqe *sqe = pirate_async_get_sqe(async);
+    int fixed_buf = 0;
+
+    sqe->fd = member->gd;
+    if (member->fixed) {
+        sqe->flags = IOSQE_FIXED_FILE;
+    }
+    sqe->off = (uint64_t) -1;
+    sqe->user_data = (uintptr_t) op;
+
+    if (op->op == PIRATE_ASYNC_WRITE) {
+        if (member->channel.mode == PIRATE_ASYNC_DATAGRAM) {
+            sqe->addr = (uintptr_t) op->buf;
+            sqe->len = op->count;
+            fixed_buf = 1;
+        } else {
+            sqe->opcode = IORING_OP_WRITEV;
+            sqe->addr = (uintptr_t) &op->frame[op->frame_start];
+            sqe->len = op->framecnt - op->frame_start;
+        }
+    } else if (member->channel.mode == PIRATE_ASYNC_DATAGRAM) {
+        sqe->addr = (uintptr_t) op->buf;
+        sqe->len = op->count;
+        fixed_buf = 1;
+    } else if (op->phase == PIRATE_ASYNC_HEADER) {
+        sqe->opcode = IORING_OP_READ;
+        sqe->addr = (uintptr_t) (member->scratch + op->pos);
+        sqe->len = member->channel.min_tx - op->pos;
+    } else if (op->phase == PIRATE_ASYNC_DATA) {
+        sqe->addr = (uintptr_t) (op->buf + op->pos);
+        sqe->len = op->len - op->pos;
+        fixed_buf = 1;
+    } else {
+        sqe->opcode = IORING_OP_READ;
+        sqe->addr = (uintptr_t) member->scratch;
+        sqe->len = MIN(op->discard - op->pos, member->scratch_len);
+    }
+
+    if (fixed_buf) {
+        if (op->buf_index >= 0) {
+            sqe->opcode = (op->op == PIRATE_ASYNC_WRITE) ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+            sqe->buf_index = op->buf_index;
+        } else {
+            sqe->opcode = (op->op == PIRATE_ASYNC_WRITE) ? IORING_OP_WRITE : IORING_OP_READ;
+        }
+    }
+}
+
+// Wakes up pirate_async_wait() when a gaps descriptor
+// in the poll set becomes ready. The poll set holds at
+// least one request, so a submission queue entry is available.
+static void pirate_async_issue_poll(pirate_async_t *async) {
+    struct io_uring_sqe *sqe = pirate_async_get_sqe(async);
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = pirate_poll_fd(async->poll);
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = PIRATE_ASYNC_POLL_DATA;
+    async->poll_in_ring = 1;
+}
+
+// Completes the request and starts the next
+// request of the same gaps descriptor.
+static void pirate_async_finish(pirate_async_t *async, pirate_async_op_t *op, ssize_t result, int err) {
+    pirate_async_member_t *member = op->member;
+
+    pirate_async_pop(&member->pending);
+    async->in_ring--;
+    pirate_async_done(async, op, result, err);
+    if (member->pending.head != NULL) {
+        pirate_async_issue(async, member->pending.head);
+    }
+}
+
+// Follows pirate_stream_read(). The packet is truncated
+// to the length of the buffer and the remainder is discarded.
+static void pirate_async_stream_read(pirate_async_t *async, pirate_async_op_t *op) {
+    pirate_async_member_t *member = op->member;
+    const size_t min_tx_data = member->channel.min_tx - sizeof(pirate_header_t);
+    size_t packet_count, copy, rx;
+
+    switch (op->phase) {
+    case PIRATE_ASYNC_HEADER:
+        if (op->pos < member->channel.min_tx) {
+            break;
+        }
+        packet_count = ntohl(((pirate_header_t *) member->scratch)->count);
+        op->len = MIN(op->count, packet_count);
+        copy = MIN(op->len, min_tx_data);
+        memcpy(op->buf, member->scratch + sizeof(pirate_header_t), copy);
+        rx = MAX(op->len, min_tx_data);
+        op->discard = (rx < packet_count) ? packet_count - rx : 0;
+        op->phase = PIRATE_ASYNC_DATA;
+        op->pos = copy;
+        /* fall through */
+    case PIRATE_ASYNC_DATA:
+        if (op->pos < op->len) {
+            break;
+        }
+        op->phase = PIRATE_ASYNC_DISCARD;
+        op->pos = 0;
+        /* fall through */
+    case PIRATE_ASYNC_DISCARD:
+        if (op->pos < op->discard) {
+            break;
+        }
+        pirate_async_finish(async, op, op->len, 0);
+        return;
+    }
+    pirate_async_issue(async, op);
+}
+
+static void pirate_async_complete(pirate_async_t *async, pirate_async_op_t *op, int res) {
+    pirate_async_member_t *member = op->member;
+    size_t n;
+
+    if (res < 0) {
+        if ((res == -ECONNREFUSED) && member->channel.retry_refused && !op->retried) {
+            // same as the retry of pirate_udp_socket_write()
+            op->retried = 1;
+            pirate_async_issue(async, op);
+            return;
+        }
+        pirate_async_finish(async, op, -1, -res);
+        return;
+    }
+
+    if (member->channel.mode == PIRATE_ASYNC_DATAGRAM) {
+        pirate_async_finish(async, op, res, 0);
+        return;
+    }
+
+    if (op->op == PIRATE_ASYNC_WRITE) {
+        // resume a partial write
+        n = res;
+        while ((op->frame_start < op->framecnt) && (n >= op->frame[op->frame_start].iov_len)) {
+            n -= op->frame[op->frame_start].iov_len;
+            op->frame_start++;
+        }
+        if (op->frame_start < op->framecnt) {
+            op->frame[op->frame_start].iov_base = (uint8_t *) op->frame[op->frame_start].iov_base + n;
+            op->frame[op->frame_start].iov_len -= n;
+            pirate_async_issue(async, op);
+            return;
+        }
+        pirate_async_finish(async, op, op->count, 0);
+        return;
+    }
+
+    // end of stream
+    if (res == 0) {
+        pirate_async_finish(async, op, 0, 0);
+        return;
+    }
+    op->pos += res;
+    pirate_async_stream_read(async, op);
+}
+
+static void pirate_async_reap(pirate_async_t *async) {
+    unsigned head = *async->cq_head;
+    unsigned tail = __atomic_load_n(async->cq_tail, __ATOMIC_ACQUIRE);
+    struct io_uring_cqe *cqe;
+
+    while (head != tail) {
+        cqe = &async->cqes[head & async->cq_mask];
+        if (cqe->user_data == PIRATE_ASYNC_POLL_DATA) {
+            async->poll_in_ring = 0;
+        } else {
+            pirate_async_complete(async, (pirate_async_op_t *) (uintptr_t) cqe->user_data, cqe->res);
+        }
+        head++;
+    }
+    __atomic_store_n(async->cq_head, head, __ATOMIC_RELEASE);
+}
+
+// Submits the prepared entries and waits for at least one
+// completion when wait is non-zero. A negative timeout waits
+// indefinitely.
+static int pirate_async_enter(pirate_async_t *async, int wait, int timeout) {
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned to_submit, flags = 0, min_complete = 0;
+    int err = errno;
+
+    __atomic_store_n(async->sq_tail, async->sq_local_tail, __ATOMIC_RELEASE);
+    to_submit = async->sq_local_tail - __atomic_load_n(async->sq_head, __ATOMIC_ACQUIRE);
+    memset(&arg, 0, sizeof(arg));
+    if (wait) {
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        min_complete = 1;
+        if (timeout >= 0) {
+            ts.tv_sec = timeout / 1000;
+            ts.tv_nsec = (timeout % 1000) * 1000000;
+            arg.ts = (uintptr_t) &ts;
+        }
+    } else if (to_submit == 0) {
+        return 0;
+    }
+    if (syscall(__NR_io_uring_enter, async->ring_fd, to_submit, min_complete,
+                flags, wait ? &arg : NULL, wait ? sizeof(arg) : 0) < 0) {
+        if ((errno == ETIME) || (errno == EINTR) || (errno == EAGAIN) || (errno == EBUSY)) {
+            errno = err;
+            return 0;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+#else
+
+static int pirate_async_setup(pirate_async_t *async) {
+    (void) async;
+    errno = ENOSYS;
+    return -1;
+}
+
+#endif /* PIRATE_IO_URING */
+
+pirate_async_t *pirate_async_create(unsigned entries) {
+    pirate_async_t *async;
+    int err = errno;
+
+    if (entries == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((async = calloc(1, sizeof(pirate_async_t))) == NULL) {
+        return NULL;
+    }
+    async->entries = entries;
+    if ((async->ops = calloc(entries, sizeof(pirate_async_op_t))) == NULL) {
+        free(async);
+        return NULL;
+    }
+    for (unsigned i = 0; i < entries; i++) {
+        async->ops[i].next = async->free;
+        async->free = &async->ops[i];
+    }
+
+    // Without io_uring every request uses the blocking path.
+    async->ring_fd = -1;
+    if (pirate_async_setup(async) < 0) {
+        async->ring_fd = -1;
+        errno = err;
+    }
+    return async;
+}
+
+// Returns the events of a gaps descriptor in the poll set
+static inline uint32_t pirate_async_poll_events(int access) {
+    return (access == O_RDONLY) ? PIRATE_POLLIN : PIRATE_POLLOUT;
+}
+
+int pirate_async_add(pirate_async_t *async, int gd) {
+    pirate_async_channel_t channel;
+    pirate_async_member_t *member, **members;
+    pirate_poll_ring_t ring;
+    size_t index, size;
+
+    if (async == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (pirate_get_async_channel(gd, &channel) < 0) {
+        return -1;
+    }
+    if (pirate_async_find(async, gd) != NULL) {
+        errno = EEXIST;
+        return -1;
+    }
+    if ((async->ring_fd < 0) ||
+        ((channel.mode == PIRATE_ASYNC_STREAM) && (channel.min_tx < sizeof(pirate_header_t)))) {
+        channel.mode = PIRATE_ASYNC_BLOCKING;
+    }
+    // The blocking requests wait until the poll set reports the gaps descriptor ready
+    if (channel.mode == PIRATE_ASYNC_BLOCKING) {
+        if (pirate_get_poll_ring(gd, pirate_async_poll_events(channel.access), &ring) < 0) {
+            return -1;
+        }
+        if ((async->poll == NULL) && ((async->poll = pirate_poll_create()) == NULL)) {
+            return -1;
+        }
+    }
+
+    index = pirate_async_index(gd);
+    if (index >= async->members_size) {
+        size = MAX(2 * async->members_size, index + 1);
+        members = realloc(async->members, size * sizeof(pirate_async_member_t*));
+        if (members == NULL) {
+            return -1;
+        }
+        memset(members + async->members_size, 0,
+            (size - async->members_size) * sizeof(pirate_async_member_t*));
+        async->members = members;
+        async->members_size = size;
+    }
+
+    if ((member = calloc(1, sizeof(pirate_async_member_t))) == NULL) {
+        return -1;
+    }
+    member->gd = gd;
+    memcpy(&member->channel, &channel, sizeof(pirate_async_channel_t));
+    if (channel.mode == PIRATE_ASYNC_STREAM) {
+        member->scratch_len = MAX(channel.min_tx, PIRATE_DISCARD_LEN);
+        member->scratch = malloc(member->scratch_len);
+        member->padding = calloc(channel.min_tx, 1);
+        if ((member->scratch == NULL) || (member->padding == NULL)) {
+            free(member->scratch);
+            free(member->padding);
+            free(member);
+            return -1;
+        }
+    }
+#ifdef PIRATE_IO_URING
+    if ((channel.mode != PIRATE_ASYNC_BLOCKING) && async->files_registered &&
+        (gd < PIRATE_ASYNC_FILES) && (pirate_async_update_file(async, gd, gd) == 0)) {
+        member->fixed = 1;
+    }
+#endif
+    async->members[index] = member;
+    return 0;
+}
+
+int pirate_async_del(pirate_async_t *async, int gd) {
+    pirate_async_member_t *member;
+
+    if (async == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((member = pirate_async_find(async, gd)) == NULL) {
+        errno = ENOENT;
+        return -1;
+    }
+    if (member->outstanding > 0) {
+        errno = EBUSY;
+        return -1;
+    }
+#ifdef PIRATE_IO_URING
+    if (member->fixed) {
+        pirate_async_update_file(async, gd, -1);
+    }
+#endif
+    async->members[pirate_async_index(gd)] = NULL;
+    free(member->scratch);
+    free(member->padding);
+    free(member);
+    return 0;
+}
+
+int pirate_async_register_buffers(pirate_async_t *async, const struct iovec *iov, unsigned nr) {
+    if ((async == NULL) || (iov == NULL) || (nr == 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (async->buffer_count > 0) {
+        errno = EBUSY;
+        return -1;
+    }
+    // The blocking path does not use registered buffers.
+    if (async->ring_fd < 0) {
+        return 0;
+    }
+#ifdef PIRATE_IO_URING
+    if (syscall(__NR_io_uring_register, async->ring_fd, IORING_REGISTER_BUFFERS, iov, nr) < 0) {
+        return -1;
+    }
+#endif
+    if ((async->buffers = malloc(nr * sizeof(struct iovec))) == NULL) {
+        return -1;
+    }
+    memcpy(async->buffers, iov, nr * sizeof(struct iovec));
+    async->buffer_count = nr;
+    return 0;
+}
+
+static int pirate_async_buffer_index(const pirate_async_t *async, const uint8_t *buf, size_t count) {
+    for (unsigned i = 0; i < async->buffer_count; i++) {
+        const uint8_t *base = (const uint8_t *) async->buffers[i].iov_base;
+        if ((buf >= base) && (buf + count <= base + async->buffers[i].iov_len)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int pirate_async_submit(pirate_async_t *async, int gd, int type,
+                                void *buf, size_t count, void *user_data) {
+    pirate_async_member_t *member;
+    pirate_async_op_t *op;
+    size_t min_tx_data;
+
+    if (async == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((member = pirate_async_find(async, gd)) == NULL) {
+        errno = ENOENT;
+        return -1;
+    }
+    if (member->channel.access != ((type == PIRATE_ASYNC_READ) ? O_RDONLY : O_WRONLY)) {
+        errno = EBADF;
+        return -1;
+    }
+    if ((type == PIRATE_ASYNC_WRITE) && (member->channel.mode != PIRATE_ASYNC_BLOCKING) &&
+        (((member->channel.write_mtu > 0) && (count > member->channel.write_mtu)) || (count > UINT32_MAX))) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if ((op = async->free) == NULL) {
+        errno = EAGAIN;
+        return -1;
+    }
+    if ((member->channel.mode == PIRATE_ASYNC_BLOCKING) && (member->pending.head == NULL) &&
+        (pirate_poll_add(async->poll, gd, pirate_async_poll_events(member->channel.access)) < 0)) {
+        return -1;
+    }
+    async->free = op->next;
+    memset(op, 0, sizeof(pirate_async_op_t));
+    op->member = member;
+    op->op = type;
+    op->buf = (uint8_t *) buf;
+    op->count = count;
+    op->user_data = user_data;
+    op->buf_index = pirate_async_buffer_index(async, op->buf, count);
+    async->outstanding++;
+    member->outstanding++;
+
+    if (member->channel.mode == PIRATE_ASYNC_BLOCKING) {
+        pirate_async_push(&member->pending, op);
+        async->blocking++;
+        return 0;
+    }
+
+#ifdef PIRATE_IO_URING
+    // The frame is built as in pirate_stream_writev()
+    if ((type == PIRATE_ASYNC_WRITE) && (member->channel.mode == PIRATE_ASYNC_STREAM)) {
+        op->header.count = htonl(count);
+        op->frame[0].iov_base = &op->header;
+        op->frame[0].iov_len = sizeof(pirate_header_t);
+        op->framecnt = 1;
+        if (count > 0) {
+            op->frame[op->framecnt].iov_base = buf;
+            op->frame[op->framecnt].iov_len = count;
+            op->framecnt++;
+        }
+        min_tx_data = MIN(count, member->channel.min_tx - sizeof(pirate_header_t));
+        if (min_tx_data < member->channel.min_tx - sizeof(pirate_header_t)) {
+            op->frame[op->framecnt].iov_base = member->padding;
+            op->frame[op->framecnt].iov_len = member->channel.min_tx - sizeof(pirate_header_t) - min_tx_data;
+            op->framecnt++;
+        }
+    }
+    pirate_async_push(&member->pending, op);
+    async->in_ring++;
+    if (member->pending.head == op) {
+        pirate_async_issue(async, op);
+    }
+#else
+    (void) min_tx_data;
+#endif
+    return 0;
+}
+
+int pirate_async_read(pirate_async_t *async, int gd, void *buf, size_t count, void *user_data) {
+    return pirate_async_submit(async, gd, PIRATE_ASYNC_READ, buf, count, user_data);
+}
+
+int pirate_async_write(pirate_async_t *async, int gd, const void *buf, size_t count, void *user_data) {
+    return pirate_async_submit(async, gd, PIRATE_ASYNC_WRITE, (void *) buf, count, user_data);
+}
+
+// Runs the first request of each gaps descriptor that the poll set
+// reports ready, waiting up to timeout milliseconds. A gaps descriptor
+// is in the poll set while it has requests. The blocking path updates
+// the statistics in pirate_read() and pirate_write(). errno is
+// preserved on success.
+static int pirate_async_run_ready(pirate_async_t *async, int maxevents, int timeout) {
+    pirate_poll_event_t ready[PIRATE_ASYNC_BATCH];
+    pirate_async_member_t *member;
+    pirate_async_op_t *op;
+    int i, rv, err = errno;
+
+    rv = pirate_poll_wait(async->poll, ready, MIN(maxevents, PIRATE_ASYNC_BATCH), timeout);
+    if (rv < 0) {
+        return -1;
+    }
+    for (i = 0; i < rv; i++) {
+        member = pirate_async_find(async, ready[i].gd);
+        op = pirate_async_pop(&member->pending);
+        if (op->op == PIRATE_ASYNC_READ) {
+            op->result = pirate_read(member->gd, op->buf, op->count);
+        } else {
+            op->result = pirate_write(member->gd, op->buf, op->count);
+        }
+        op->err = (op->result < 0) ? errno : 0;
+        async->blocking--;
+        pirate_async_push(&async->done, op);
+        if ((member->pending.head == NULL) && (pirate_poll_del(async->poll, member->gd) < 0)) {
+            return -1;
+        }
+    }
+    errno = err;
+    return 0;
+}
+
+int pirate_async_wait(pirate_async_t *async, pirate_async_event_t *events,
+                      int maxevents, int timeout) {
+    pirate_async_op_t *op;
+    uint64_t deadline = 0, now;
+    int n = 0;
+
+    if ((async == NULL) || (events == NULL) || (maxevents <= 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (timeout > 0) {
+        deadline = monotonic_ms() + timeout;
+    }
+
+    for (;;) {
+#ifdef PIRATE_IO_URING
+        if (async->ring_fd >= 0) {
+            if (pirate_async_enter(async, 0, 0) < 0) {
+                return -1;
+            }
+            pirate_async_reap(async);
+        }
+#endif
+        if ((async->blocking > 0) && (pirate_async_run_ready(async, maxevents, 0) < 0)) {
+            return -1;
+        }
+        while ((n < maxevents) && ((op = pirate_async_pop(&async->done)) != NULL)) {
+            events[n].gd = op->member->gd;
+            events[n].op = op->op;
+            events[n].len = op->result;
+            events[n].err = op->err;
+            events[n].user_data = op->user_data;
+            n++;
+            op->member->outstanding--;
+            async->outstanding--;
+            op->next = async->free;
+            async->free = op;
+        }
+        if ((n > 0) || (timeout == 0)) {
+            return n;
+        }
+        if (timeout > 0) {
+            now = monotonic_ms();
+            if (now >= deadline) {
+                return 0;
+            }
+            timeout = deadline - now;
+        }
+#ifdef PIRATE_IO_URING
+        // io_uring also completes a request when the poll set is ready
+        if (async->in_ring > 0) {
+            if ((async->blocking > 0) && !async->poll_in_ring) {
+                pirate_async_issue_poll(async);
+            }
+            if (pirate_async_enter(async, 1, timeout) < 0) {
+                return -1;
+            }
+            continue;
+        }
+#endif
+        if (async->blocking == 0) {
+            return 0;
+        }
+        if (pirate_async_run_ready(async, maxevents, timeout) < 0) {
+            return -1;
+        }
+    }
+}
+
+int pirate_async_close(pirate_async_t *async) {
+    if (async == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+#ifdef PIRATE_IO_URING
+    if (async->ring_fd >= 0) {
+        pirate_async_teardown(async);
+    }
+#endif
+    for (size_t i = 0; i < async->members_size; i++) {
+        if (async->members[i] != NULL) {
+            free(async->members[i]->scratch);
+            free(async->members[i]->padding);
+            free(async->members[i]);
+        }
+    }
+    if (async->poll != NULL) {
+        pirate_poll_close(async->poll);
+    }
+    free(async->members);
+    free(async->buffers);
+    free(async->ops);
+    free(async);
+    return 0;
+}
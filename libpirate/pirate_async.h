@@ -0,0 +1,63 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#ifndef __PIRATE_ASYNC_H
+#define __PIRATE_ASYNC_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "libpirate.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// How the requests of a gaps descriptor are executed
+// by an asynchronous request queue.
+typedef enum {
+    // pirate_read() and pirate_write() are called by pirate_async_wait()
+    PIRATE_ASYNC_BLOCKING = 0,
+    // each packet is a single read() or write() of the file descriptor
+    PIRATE_ASYNC_DATAGRAM,
+    // packets are framed by pirate_stream_read() and pirate_stream_write()
+    PIRATE_ASYNC_STREAM
+} pirate_async_mode_t;
+
+typedef struct {
+    int access;
+    pirate_async_mode_t mode;
+    // the stream types read and write at least min_tx bytes per packet
+    size_t min_tx;
+    // 0 indicates no maximum length
+    size_t write_mtu;
+    // retry a write once when the previous datagram was refused
+    int retry_refused;
+} pirate_async_channel_t;
+
+// Returns 0 and fills in channel on success. On error,
+// -1 is returned, and errno is set appropriately.
+int pirate_get_async_channel(int gd, pirate_async_channel_t *channel);
+
+// Updates the statistics of gd for a request that completed
+// asynchronously. rv is the number of bytes transferred or -1,
+// and err is the error number when rv is -1. undelivered is the
+// number of datagrams that the peer refused during the request.
+void pirate_async_stats(int gd, ssize_t rv, int err, unsigned undelivered);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PIRATE_ASYNC_H */
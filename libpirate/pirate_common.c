@@ -13,10 +13,12 @@
  * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
  */
 
+#define _GNU_SOURCE
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/socket.h>
 #include <sys/uio.h>
 #include "libpirate.h"
 #include "pirate_common.h"
@@ -34,6 +36,22 @@ static ssize_t pirate_stream_do_read(int fd, uint8_t *buf, size_t count) {
     return rx;
 }
 
+// Reads and discards count bytes from fd. The scratch
+// buffer avoids an allocation for each truncated packet.
+static ssize_t pirate_stream_do_discard(int fd, size_t count) {
+    uint8_t scratch[PIRATE_DISCARD_LEN];
+    size_t rx = 0;
+    ssize_t rv;
+    while (rx < count) {
+        rv = pirate_stream_do_read(fd, scratch, MIN(count - rx, sizeof(scratch)));
+        if (rv <= 0) {
+            return rv;
+        }
+        rx += rv;
+    }
+    return rx;
+}
+
 ssize_t pirate_stream_read(common_ctx *ctx, size_t min_tx, void *buf, size_t count) {
     pirate_header_t *header = (pirate_header_t*) ctx->min_tx_buf;
     int fd = ctx->fd;
@@ -46,9 +64,13 @@ ssize_t pirate_stream_read(common_ctx *ctx, size_t min_tx, void *buf, size_t cou
         return -1;
     }
 
-    rv = pirate_stream_do_read(fd, ctx->min_tx_buf, min_tx);
-    if (rv <= 0) {
-        return rv;
+    if (ctx->peeked) {
+        ctx->peeked = 0;
+    } else {
+        rv = pirate_stream_do_read(fd, ctx->min_tx_buf, min_tx);
+        if (rv <= 0) {
+            return rv;
+        }
     }
     packet_count = ntohl(header->count);
     count = MIN(count, packet_count);
@@ -62,10 +84,7 @@ ssize_t pirate_stream_read(common_ctx *ctx, size_t min_tx, void *buf, size_t cou
     }
     rx = MAX(count, min_tx - sizeof(pirate_header_t));
     if (rx < packet_count) {
-        // slow path
-        uint8_t *temp = malloc(packet_count - rx);
-        rv = pirate_stream_do_read(fd, temp, packet_count - rx);
-        free(temp);
+        rv = pirate_stream_do_discard(fd, packet_count - rx);
         if (rv <= 0) {
             return rv;
         }
@@ -73,16 +92,69 @@ ssize_t pirate_stream_read(common_ctx *ctx, size_t min_tx, void *buf, size_t cou
     return count;
 }
 
-ssize_t pirate_stream_write(common_ctx *ctx, size_t min_tx, size_t write_mtu, const void *buf, size_t count) {
+ssize_t pirate_stream_peek_len(common_ctx *ctx, size_t min_tx) {
     pirate_header_t *header = (pirate_header_t*) ctx->min_tx_buf;
-    int fd = ctx->fd;
-    size_t tx = 0;
     ssize_t rv;
 
+    if (ctx->fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+
+    // The start of the packet is kept in min_tx_buf
+    // for the next call to pirate_stream_read().
+    if (!ctx->peeked) {
+        rv = pirate_stream_do_read(ctx->fd, ctx->min_tx_buf, min_tx);
+        if (rv <= 0) {
+            return rv;
+        }
+        ctx->peeked = 1;
+    }
+    return ntohl(header->count);
+}
+
+// Writes the iovec array to fd. The iovec array
+// is modified when writev() returns a partial write.
+static ssize_t pirate_stream_do_writev(int fd, struct iovec *iov, int iovcnt) {
+    ssize_t rv;
+    size_t len;
+
+    while (iovcnt > 0) {
+        rv = writev(fd, iov, iovcnt);
+        if (rv < 0) {
+            return rv;
+        }
+        while ((iovcnt > 0) && ((size_t) rv >= iov->iov_len)) {
+            rv -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            len = rv;
+            iov->iov_base = ((uint8_t*) iov->iov_base) + len;
+            iov->iov_len -= len;
+        }
+    }
+    return 0;
+}
+
+ssize_t pirate_stream_writev(common_ctx *ctx, size_t min_tx, size_t write_mtu, const struct iovec *iov, int iovcnt) {
+    pirate_header_t header;
+    struct iovec frame[PIRATE_IOV_MAX + 2];
+    int fd = ctx->fd, framecnt = 0, i;
+    size_t count = 0;
+
     if (fd < 0) {
         errno = EBADF;
         return -1;
     }
+    if ((iovcnt < 0) || (iovcnt > PIRATE_IOV_MAX)) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        count += iov[i].iov_len;
+    }
     if ((write_mtu > 0) && (count > write_mtu)) {
         errno = EMSGSIZE;
         return -1;
@@ -91,25 +163,191 @@ ssize_t pirate_stream_write(common_ctx *ctx, size_t min_tx, size_t write_mtu, co
         errno = EMSGSIZE;
         return -1;
     }
-    header->count = htonl(count);
+    // The header and the packet are sent with a single
+    // writev(). Packets shorter than min_tx are padded
+    // from the min_tx buffer.
+    header.count = htonl(count);
+    frame[framecnt].iov_base = &header;
+    frame[framecnt].iov_len = sizeof(pirate_header_t);
+    framecnt++;
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len > 0) {
+            frame[framecnt++] = iov[i];
+        }
+    }
     size_t min_tx_data = MIN(count, min_tx - sizeof(pirate_header_t));
-    memcpy(ctx->min_tx_buf + sizeof(pirate_header_t), buf, min_tx_data);
-    while (tx < min_tx) {
-        rv = write(fd, ctx->min_tx_buf + tx, min_tx - tx);
-        if (rv < 0) {
-            return rv;
+    if (min_tx_data < min_tx - sizeof(pirate_header_t)) {
+        frame[framecnt].iov_base = ctx->min_tx_buf;
+        frame[framecnt].iov_len = min_tx - sizeof(pirate_header_t) - min_tx_data;
+        framecnt++;
+    }
+    if (pirate_stream_do_writev(fd, frame, framecnt) < 0) {
+        return -1;
+    }
+    return count;
+}
+
+ssize_t pirate_stream_write(common_ctx *ctx, size_t min_tx, size_t write_mtu, const void *buf, size_t count) {
+    struct iovec iov;
+
+    iov.iov_base = (void*) buf;
+    iov.iov_len = count;
+    return pirate_stream_writev(ctx, min_tx, write_mtu, &iov, 1);
+}
+
+ssize_t pirate_stream_write_batch(common_ctx *ctx, size_t min_tx, size_t write_mtu, pirate_mmsg_t *msgs, unsigned vlen) {
+    pirate_header_t headers[PIRATE_IOV_MAX];
+    struct iovec iov[3 * PIRATE_IOV_MAX];
+    int fd = ctx->fd, iovcnt = 0;
+    size_t min_tx_data;
+    unsigned i;
+
+    if (fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    vlen = MIN(vlen, PIRATE_IOV_MAX);
+    for (i = 0; i < vlen; i++) {
+        size_t count = msgs[i].count;
+        if (((write_mtu > 0) && (count > write_mtu)) || (count > UINT32_MAX)) {
+            break;
         }
-        tx += rv;
+        // Each packet is framed exactly as pirate_stream_write()
+        // frames it. Packets shorter than min_tx are padded from
+        // the min_tx buffer.
+        headers[i].count = htonl(count);
+        iov[iovcnt].iov_base = &headers[i];
+        iov[iovcnt].iov_len = sizeof(pirate_header_t);
+        iovcnt++;
+        iov[iovcnt].iov_base = msgs[i].buf;
+        iov[iovcnt].iov_len = count;
+        iovcnt++;
+        min_tx_data = MIN(count, min_tx - sizeof(pirate_header_t));
+        if (min_tx_data < min_tx - sizeof(pirate_header_t)) {
+            iov[iovcnt].iov_base = ctx->min_tx_buf;
+            iov[iovcnt].iov_len = min_tx - sizeof(pirate_header_t) - min_tx_data;
+            iovcnt++;
+        }
+        msgs[i].len = count;
     }
-    tx = min_tx_data;
-    while (tx < count) {
-        rv = write(fd, ((uint8_t*) buf) + tx, count - tx);
-        if (rv < 0) {
-            return rv;
+    if (i == 0) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if (pirate_stream_do_writev(fd, iov, iovcnt) < 0) {
+        return -1;
+    }
+    return i;
+}
+
+__thread unsigned pirate_undelivered __attribute__((tls_model("initial-exec")));
+
+ssize_t pirate_send_retry_refused(pirate_send_func_t send_func, void *args) {
+    int err = errno;
+    ssize_t rv;
+
+    rv = send_func(args);
+    if ((rv < 0) && (errno == ECONNREFUSED)) {
+        pirate_undelivered++;
+        errno = err;
+        rv = send_func(args);
+    }
+    return rv;
+}
+
+ssize_t pirate_socket_writev(int sock, size_t write_mtu, const struct iovec *iov, int iovcnt) {
+    struct msghdr msg;
+    size_t count = 0;
+    int i;
+
+    if (sock <= 0) {
+        errno = EBADF;
+        return -1;
+    }
+    if ((iovcnt < 0) || (iovcnt > PIRATE_IOV_MAX)) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        count += iov[i].iov_len;
+    }
+    if ((write_mtu > 0) && (count > write_mtu)) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = (struct iovec*) iov;
+    msg.msg_iovlen = iovcnt;
+    return sendmsg(sock, &msg, 0);
+}
+
+ssize_t pirate_socket_write_batch(int sock, size_t write_mtu, pirate_mmsg_t *msgs, unsigned vlen) {
+    struct mmsghdr hdrs[PIRATE_IOV_MAX];
+    struct iovec iov[PIRATE_IOV_MAX];
+    unsigned i;
+    int rv;
+
+    if (sock <= 0) {
+        errno = EBADF;
+        return -1;
+    }
+    vlen = MIN(vlen, PIRATE_IOV_MAX);
+    memset(hdrs, 0, sizeof(hdrs));
+    for (i = 0; i < vlen; i++) {
+        if ((write_mtu > 0) && (msgs[i].count > write_mtu)) {
+            break;
         }
-        tx += rv;
+        iov[i].iov_base = msgs[i].buf;
+        iov[i].iov_len = msgs[i].count;
+        hdrs[i].msg_hdr.msg_iov = &iov[i];
+        hdrs[i].msg_hdr.msg_iovlen = 1;
     }
-    return count;
+    if (i == 0) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    rv = sendmmsg(sock, hdrs, i, 0);
+    for (i = 0; (int) i < rv; i++) {
+        msgs[i].len = hdrs[i].msg_len;
+    }
+    return rv;
+}
+
+ssize_t pirate_socket_read_batch(int sock, pirate_mmsg_t *msgs, unsigned vlen) {
+    struct mmsghdr hdrs[PIRATE_IOV_MAX];
+    struct iovec iov[PIRATE_IOV_MAX];
+    unsigned i;
+    int rv;
+
+    if (sock <= 0) {
+        errno = EBADF;
+        return -1;
+    }
+    vlen = MIN(vlen, PIRATE_IOV_MAX);
+    memset(hdrs, 0, sizeof(hdrs));
+    for (i = 0; i < vlen; i++) {
+        iov[i].iov_base = msgs[i].buf;
+        iov[i].iov_len = msgs[i].count;
+        hdrs[i].msg_hdr.msg_iov = &iov[i];
+        hdrs[i].msg_hdr.msg_iovlen = 1;
+    }
+    // block for the first packet and then
+    // return the packets that are available
+    rv = recvmmsg(sock, hdrs, vlen, MSG_WAITFORONE, NULL);
+    for (i = 0; (int) i < rv; i++) {
+        msgs[i].len = hdrs[i].msg_len;
+    }
+    return rv;
+}
+
+ssize_t pirate_socket_peek_len(int sock) {
+    if (sock <= 0) {
+        errno = EBADF;
+        return -1;
+    }
+    // MSG_TRUNC returns the length of the datagram
+    // even though no bytes are copied
+    return recv(sock, NULL, 0, MSG_PEEK | MSG_TRUNC);
 }
 
 int pirate_parse_key_value(char **key, char **val, char *ptr, char **saveptr) {
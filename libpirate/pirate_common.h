@@ -42,10 +42,37 @@ typedef struct {
     int fd;
     // exists for stream-based file descriptor channel types
     uint8_t *min_tx_buf;
+    // min_tx_buf holds the start of the next packet
+    // that was read by pirate_peek_len()
+    int peeked;
 } common_ctx;
 
+// length of the scratch buffer used to discard
+// the remainder of a truncated packet
+#define PIRATE_DISCARD_LEN 4096
+
 ssize_t pirate_stream_read(common_ctx *ctx, size_t min_tx, void *buf, size_t count);
+ssize_t pirate_stream_peek_len(common_ctx *ctx, size_t min_tx);
 ssize_t pirate_stream_write(common_ctx *ctx, size_t min_tx, size_t write_mtu, const void *buf, size_t count);
+ssize_t pirate_stream_writev(common_ctx *ctx, size_t min_tx, size_t write_mtu, const struct iovec *iov, int iovcnt);
+ssize_t pirate_stream_write_batch(common_ctx *ctx, size_t min_tx, size_t write_mtu, pirate_mmsg_t *msgs, unsigned vlen);
+ssize_t pirate_socket_writev(int sock, size_t write_mtu, const struct iovec *iov, int iovcnt);
+ssize_t pirate_socket_write_batch(int sock, size_t write_mtu, pirate_mmsg_t *msgs, unsigned vlen);
+ssize_t pirate_socket_read_batch(int sock, pirate_mmsg_t *msgs, unsigned vlen);
+ssize_t pirate_socket_peek_len(int sock);
+
+// Number of datagrams that the peer refused during the current
+// write of the calling thread. pirate_write(), pirate_writev(), and
+// pirate_write_batch() move it to the statistics of the gaps descriptor.
+extern __thread unsigned pirate_undelivered __attribute__((tls_model("initial-exec")));
+
+typedef ssize_t (*pirate_send_func_t)(void *args);
+
+// Calls send_func(args), and calls it again when it fails with
+// ECONNREFUSED. A connected datagram socket reports with ECONNREFUSED
+// that the peer refused an earlier datagram, and the current datagram
+// was not sent. The refused datagram is counted in pirate_undelivered.
+ssize_t pirate_send_retry_refused(pirate_send_func_t send_func, void *args);
 int pirate_parse_is_common_key(const char *key);
 int pirate_parse_key_value(char **key, char **val, char *ptr, char **saveptr);
 int pirate_next_gd();
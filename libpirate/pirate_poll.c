@@ -0,0 +1,630 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#ifdef PIRATE_SHMEM_FEATURE
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#endif
+#include "pirate_common.h"
+#include "pirate_poll.h"
+
+#define PIRATE_POLL_EVENTS (PIRATE_POLLIN | PIRATE_POLLOUT | PIRATE_POLLERR | PIRATE_POLLHUP)
+
+// maximum number of epoll events retrieved per call to epoll_wait()
+#define PIRATE_POLL_BATCH 64
+
+// Number of rings watched by each helper thread. The
+// helper thread also waits on the control word of the poll set.
+#ifdef FUTEX_WAITV_MAX
+#define PIRATE_POLL_WATCH (FUTEX_WAITV_MAX - 1)
+#else
+#define PIRATE_POLL_WATCH 127
+#endif
+
+// interval between the checks of rings that do not
+// wake up the sleeping side, such as the UIO channel type
+#define PIRATE_POLL_INTERVAL_NS 1000000
+
+typedef struct {
+    int gd;
+    pirate_poll_ring_t ring;
+} pirate_poll_member_t;
+
+typedef struct {
+    pirate_poll_t *poll;
+    // index of the first ring watched by the helper thread
+    size_t first;
+#ifdef PIRATE_SHMEM_FEATURE
+    pthread_t thread;
+#endif
+} pirate_poll_watcher_t;
+
+// The file descriptor channels are registered in the epoll set. The
+// rings of the in-memory channels are watched by helper threads. A
+// helper thread that observes a ready ring sets the bit of the ring
+// in the ready bitmap, stops watching the ring, and writes to event_fd.
+// event_fd is registered in the epoll set with data.fd = -1.
+// pirate_poll_wait() only checks the rings whose bit is set, and
+// clears the bit of a ring that is no longer ready.
+//
+// The helper threads are armed while ctl is odd. pirate_poll_wait()
+// moves ctl to the next odd value after it clears a bit, so the
+// helper threads watch the ring again. The members are modified
+// only after the helper threads are disarmed and active has dropped
+// to zero.
+struct pirate_poll {
+    int epoll_fd;
+    int event_fd;
+    pirate_poll_member_t *members;
+    // bit i is set when member i may be ready
+    uint64_t *ready;
+    size_t count;
+    size_t size;
+    // rotating start of the ready bitmap
+    size_t next;
+    pirate_poll_watcher_t **watchers;
+    size_t watcher_count;
+    uint32_t ctl;
+    uint32_t active;
+    int closing;
+};
+
+static inline uint64_t monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+}
+
+#ifdef PIRATE_SHMEM_FEATURE
+
+// Loads the pid of the other side before its position,
+// in the same order as shmem_buffer_wait().
+static uint32_t pirate_poll_ring_events(const pirate_poll_ring_t *ring) {
+    shmem_buffer_t *buf = ring->buf;
+    uint64_t reader, writer;
+
+    if (ring->access == O_RDONLY) {
+        if (atomic_load(&buf->writer_pid) == 0) {
+            return PIRATE_POLLIN | PIRATE_POLLHUP;
+        }
+        writer = atomic_load(&buf->writer);
+        reader = atomic_load_explicit(&buf->reader, memory_order_relaxed);
+        return (writer != reader) ? PIRATE_POLLIN : 0;
+    }
+    if (atomic_load(&buf->reader_pid) == 0) {
+        return PIRATE_POLLERR | PIRATE_POLLHUP;
+    }
+    reader = atomic_load(&buf->reader);
+    writer = atomic_load_explicit(&buf->writer, memory_order_relaxed);
+    return ((writer - reader) + ring->reserve < ring->capacity) ? PIRATE_POLLOUT : 0;
+}
+
+static inline int pirate_poll_is_ready(pirate_poll_t *poll, size_t index) {
+    return (__atomic_load_n(&poll->ready[index / 64], __ATOMIC_ACQUIRE) >> (index % 64)) & 1;
+}
+
+static inline void pirate_poll_set_ready(pirate_poll_t *poll, size_t index) {
+    __atomic_fetch_or(&poll->ready[index / 64], 1ull << (index % 64), __ATOMIC_RELEASE);
+}
+
+// Stores up to maxevents ready rings in events, starting after
+// the last ring reported by the previous call. Only the rings
+// whose bit is set are checked. The bit of a ring that is not
+// ready is cleared and *rewatch is set.
+static int pirate_poll_drain(pirate_poll_t *poll, pirate_poll_event_t *events,
+                                int maxevents, int *rewatch) {
+    size_t words = (poll->count + 63) / 64, start, word, index;
+    uint64_t bits;
+    uint32_t ready;
+    int n = 0;
+
+    if (poll->count == 0) {
+        return 0;
+    }
+    start = poll->next % poll->count;
+    // the first word is visited from the start and again up to the start
+    for (size_t k = 0; (k <= words) && (n < maxevents); k++) {
+        word = (start / 64 + k) % words;
+        bits = __atomic_load_n(&poll->ready[word], __ATOMIC_ACQUIRE);
+        if (k == 0) {
+            bits &= ~0ull << (start % 64);
+        } else if (k == words) {
+            bits &= (1ull << (start % 64)) - 1;
+        }
+        for (; (bits != 0) && (n < maxevents); bits &= bits - 1) {
+            index = word * 64 + __builtin_ctzll(bits);
+            ready = pirate_poll_ring_events(&poll->members[index].ring);
+            if (ready != 0) {
+                events[n].gd = poll->members[index].gd;
+                events[n].events = ready;
+                n++;
+                poll->next = index + 1;
+            } else {
+                __atomic_fetch_and(&poll->ready[word], ~(1ull << (index % 64)), __ATOMIC_RELAXED);
+                *rewatch = 1;
+            }
+        }
+    }
+    return n;
+}
+
+static inline long futex_private(uint32_t *uaddr, int op, uint32_t val, const struct timespec *timeout) {
+    return syscall(SYS_futex, uaddr, op | FUTEX_PRIVATE_FLAG, val, timeout, NULL, 0);
+}
+
+// Sleeps until a ring of the helper thread or the control word
+// of the poll set is woken up. Rings that do not wake up the
+// sleeping side are checked again after PIRATE_POLL_INTERVAL_NS.
+// Without futex_waitv() (Linux 5.16) every ring is checked
+// after PIRATE_POLL_INTERVAL_NS.
+static void pirate_poll_sleep(pirate_poll_t *poll, void *waiters, unsigned n,
+                                uint32_t ctl, int interval) {
+    struct timespec ts = {0, PIRATE_POLL_INTERVAL_NS};
+#ifdef FUTEX_WAITV_MAX
+    struct futex_waitv *waitv = (struct futex_waitv *) waiters;
+    struct timespec deadline, *timeout = NULL;
+
+    if (interval) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_nsec += PIRATE_POLL_INTERVAL_NS;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        timeout = &deadline;
+    }
+    waitv[n].val = ctl;
+    waitv[n].uaddr = (uintptr_t) &poll->ctl;
+    waitv[n].flags = FUTEX_32 | FUTEX_PRIVATE_FLAG;
+    waitv[n].__reserved = 0;
+    if ((syscall(SYS_futex_waitv, waitv, n + 1, 0, timeout, CLOCK_MONOTONIC) == 0) ||
+        (errno != ENOSYS)) {
+        return;
+    }
+#else
+    (void) waiters;
+    (void) n;
+    (void) interval;
+#endif
+    futex_private(&poll->ctl, FUTEX_WAIT, ctl, &ts);
+}
+
+static inline pirate_atomic_uint64 *pirate_poll_pollers(const pirate_poll_ring_t *ring) {
+    return (ring->access == O_RDONLY) ? &ring->buf->reader_pollers : &ring->buf->writer_pollers;
+}
+
+// Watches the rings of the helper thread whose bit is not set, and
+// sleeps until one of them is woken up. Sets the bits of the rings
+// that are ready and signals event_fd.
+static void pirate_poll_watch_rings(pirate_poll_watcher_t *watcher, uint32_t ctl) {
+    pirate_poll_t *poll = watcher->poll;
+    pirate_poll_ring_t *ring;
+    pirate_atomic_uint32 *wake;
+#ifdef FUTEX_WAITV_MAX
+    struct futex_waitv waiters[PIRATE_POLL_WATCH + 1];
+#else
+    void *waiters = NULL;
+#endif
+    size_t watched[PIRATE_POLL_WATCH];
+    size_t i, count = 0, last = MIN(poll->count, watcher->first + PIRATE_POLL_WATCH);
+    uint64_t one = 1;
+    unsigned n = 0;
+    int interval = 0, found = 0;
+
+    // The poller count is incremented before the position is loaded,
+    // as the waiting flag in shmem_buffer_wait(), so either the ring
+    // is observed to be ready or the other side wakes up its futex.
+    for (i = watcher->first; i < last; i++) {
+        if (pirate_poll_is_ready(poll, i)) {
+            continue;
+        }
+        ring = &poll->members[i].ring;
+        watched[count++] = i;
+        if (!ring->futex) {
+            interval = 1;
+            continue;
+        }
+        atomic_fetch_add(pirate_poll_pollers(ring), 1);
+        wake = (ring->access == O_RDONLY) ? &ring->buf->reader_wake : &ring->buf->writer_wake;
+#ifdef FUTEX_WAITV_MAX
+        waiters[n].val = atomic_load(wake);
+        waiters[n].uaddr = (uintptr_t) wake;
+        waiters[n].flags = FUTEX_32;
+        waiters[n].__reserved = 0;
+        n++;
+#else
+        (void) wake;
+        interval = 1;
+#endif
+    }
+
+    for (i = 0; i < count; i++) {
+        if (pirate_poll_ring_events(&poll->members[watched[i]].ring) != 0) {
+            pirate_poll_set_ready(poll, watched[i]);
+            found = 1;
+        }
+    }
+    if (!found) {
+        pirate_poll_sleep(poll, waiters, n, ctl, interval);
+    }
+
+    for (i = 0; i < count; i++) {
+        ring = &poll->members[watched[i]].ring;
+        if (ring->futex) {
+            atomic_fetch_sub(pirate_poll_pollers(ring), 1);
+        }
+    }
+    // The ready rings are not watched again until
+    // pirate_poll_wait() finds them not ready
+    if (found) {
+        (void)!write(poll->event_fd, &one, sizeof(one));
+    }
+}
+
+static void *pirate_poll_watch(void *arg) {
+    pirate_poll_watcher_t *watcher = (pirate_poll_watcher_t *) arg;
+    pirate_poll_t *poll = watcher->poll;
+    uint32_t ctl;
+
+    for (;;) {
+        // active is incremented before ctl is loaded, so
+        // pirate_poll_disarm() either observes the increment
+        // or this thread observes the disarmed control word.
+        __atomic_add_fetch(&poll->active, 1, __ATOMIC_SEQ_CST);
+        ctl = __atomic_load_n(&poll->ctl, __ATOMIC_SEQ_CST);
+        if (ctl & 1) {
+            pirate_poll_watch_rings(watcher, ctl);
+        }
+        if (__atomic_sub_fetch(&poll->active, 1, __ATOMIC_SEQ_CST) == 0) {
+            futex_private(&poll->active, FUTEX_WAKE, INT_MAX, NULL);
+        }
+        if ((ctl & 1) == 0) {
+            if (__atomic_load_n(&poll->closing, __ATOMIC_SEQ_CST)) {
+                return NULL;
+            }
+            futex_private(&poll->ctl, FUTEX_WAIT, ctl, NULL);
+        }
+    }
+}
+
+// Moves the helper threads to the next generation
+// so they watch their rings again.
+static void pirate_poll_arm(pirate_poll_t *poll) {
+    uint32_t ctl = __atomic_load_n(&poll->ctl, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&poll->ctl, (ctl & 1) ? ctl + 2 : ctl + 1, __ATOMIC_SEQ_CST);
+    futex_private(&poll->ctl, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+// Returns once no helper thread is accessing the members.
+static void pirate_poll_disarm(pirate_poll_t *poll) {
+    uint32_t ctl = __atomic_load_n(&poll->ctl, __ATOMIC_RELAXED);
+    uint32_t active;
+
+    __atomic_store_n(&poll->ctl, (ctl & 1) ? ctl + 1 : ctl + 2, __ATOMIC_SEQ_CST);
+    futex_private(&poll->ctl, FUTEX_WAKE, INT_MAX, NULL);
+    while ((active = __atomic_load_n(&poll->active, __ATOMIC_SEQ_CST)) != 0) {
+        futex_private(&poll->active, FUTEX_WAIT, active, NULL);
+    }
+}
+
+// The helper threads do not handle signals
+// that are directed at the process.
+static int pirate_poll_start_watcher(pirate_poll_t *poll) {
+    pirate_poll_watcher_t *watcher, **watchers;
+    sigset_t all, prev;
+    int rv;
+
+    watchers = realloc(poll->watchers, (poll->watcher_count + 1) * sizeof(pirate_poll_watcher_t*));
+    if (watchers == NULL) {
+        return -1;
+    }
+    poll->watchers = watchers;
+    if ((watcher = calloc(1, sizeof(pirate_poll_watcher_t))) == NULL) {
+        return -1;
+    }
+    watcher->poll = poll;
+    watcher->first = poll->watcher_count * PIRATE_POLL_WATCH;
+
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &prev);
+    rv = pthread_create(&watcher->thread, NULL, pirate_poll_watch, watcher);
+    pthread_sigmask(SIG_SETMASK, &prev, NULL);
+    if (rv != 0) {
+        free(watcher);
+        errno = rv;
+        return -1;
+    }
+    poll->watchers[poll->watcher_count++] = watcher;
+    return 0;
+}
+
+static int pirate_poll_add_ring(pirate_poll_t *poll, int gd, const pirate_poll_ring_t *ring) {
+    pirate_poll_member_t *members;
+    struct epoll_event ev;
+    uint64_t *ready;
+    size_t size, words;
+
+    for (size_t i = 0; i < poll->count; i++) {
+        if (poll->members[i].gd == gd) {
+            errno = EEXIST;
+            return -1;
+        }
+    }
+
+    if (poll->event_fd < 0) {
+        poll->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (poll->event_fd < 0) {
+            return -1;
+        }
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = -1;
+        if (epoll_ctl(poll->epoll_fd, EPOLL_CTL_ADD, poll->event_fd, &ev) < 0) {
+            close(poll->event_fd);
+            poll->event_fd = -1;
+            return -1;
+        }
+    }
+
+    // The helper threads read the members and the ready bitmap
+    pirate_poll_disarm(poll);
+
+    if (poll->count == poll->size) {
+        size = (poll->size == 0) ? 64 : 2 * poll->size;
+        members = realloc(poll->members, size * sizeof(pirate_poll_member_t));
+        if (members == NULL) {
+            return -1;
+        }
+        poll->members = members;
+        words = size / 64;
+        ready = realloc(poll->ready, words * sizeof(uint64_t));
+        if (ready == NULL) {
+            return -1;
+        }
+        memset(ready + poll->size / 64, 0, (words - poll->size / 64) * sizeof(uint64_t));
+        poll->ready = ready;
+        poll->size = size;
+    }
+
+    if (poll->count == poll->watcher_count * PIRATE_POLL_WATCH) {
+        if (pirate_poll_start_watcher(poll) < 0) {
+            return -1;
+        }
+    }
+
+    // The new ring is checked by the next call to pirate_poll_wait()
+    poll->members[poll->count].gd = gd;
+    memcpy(&poll->members[poll->count].ring, ring, sizeof(pirate_poll_ring_t));
+    pirate_poll_set_ready(poll, poll->count);
+    poll->count++;
+    return 0;
+}
+
+static int pirate_poll_del_ring(pirate_poll_t *poll, int gd) {
+    size_t last;
+
+    for (size_t i = 0; i < poll->count; i++) {
+        if (poll->members[i].gd == gd) {
+            pirate_poll_disarm(poll);
+            // the last member and its bit are moved to index i
+            last = --poll->count;
+            poll->members[i] = poll->members[last];
+            poll->ready[i / 64] &= ~(1ull << (i % 64));
+            if (poll->ready[last / 64] & (1ull << (last % 64))) {
+                poll->ready[i / 64] |= 1ull << (i % 64);
+            }
+            poll->ready[last / 64] &= ~(1ull << (last % 64));
+            return 0;
+        }
+    }
+    errno = ENOENT;
+    return -1;
+}
+
+#else
+
+static int pirate_poll_drain(pirate_poll_t *poll, pirate_poll_event_t *events,
+                                int maxevents, int *rewatch) {
+    (void) poll;
+    (void) events;
+    (void) maxevents;
+    (void) rewatch;
+    return 0;
+}
+
+static void pirate_poll_arm(pirate_poll_t *poll) {
+    (void) poll;
+}
+
+#endif /* PIRATE_SHMEM_FEATURE */
+
+pirate_poll_t *pirate_poll_create(void) {
+    pirate_poll_t *poll;
+
+    if ((poll = calloc(1, sizeof(pirate_poll_t))) == NULL) {
+        return NULL;
+    }
+    poll->event_fd = -1;
+    poll->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (poll->epoll_fd < 0) {
+        free(poll);
+        return NULL;
+    }
+    return poll;
+}
+
+int pirate_poll_add(pirate_poll_t *poll, int gd, uint32_t events) {
+    pirate_poll_ring_t ring;
+    struct epoll_event ev;
+    int rv;
+
+    if (poll == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    rv = pirate_get_poll_ring(gd, events, &ring);
+    if (rv < 0) {
+        return -1;
+    }
+    if (rv == 1) {
+        memset(&ev, 0, sizeof(ev));
+        ev.events = events;
+        ev.data.fd = gd;
+        return epoll_ctl(poll->epoll_fd, EPOLL_CTL_ADD, gd, &ev);
+    }
+#ifdef PIRATE_SHMEM_FEATURE
+    return pirate_poll_add_ring(poll, gd, &ring);
+#else
+    errno = ESOCKTNOSUPPORT;
+    return -1;
+#endif
+}
+
+int pirate_poll_del(pirate_poll_t *poll, int gd) {
+    if (poll == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (gd >= 0) {
+        return epoll_ctl(poll->epoll_fd, EPOLL_CTL_DEL, gd, NULL);
+    }
+#ifdef PIRATE_SHMEM_FEATURE
+    return pirate_poll_del_ring(poll, gd);
+#else
+    errno = ENOENT;
+    return -1;
+#endif
+}
+
+int pirate_poll_fd(const pirate_poll_t *poll) {
+    return poll->epoll_fd;
+}
+
+// Re-arms the helper threads when they are disarmed or
+// when a ring must be watched again.
+static void pirate_poll_rearm(pirate_poll_t *poll, int rewatch) {
+    uint32_t ctl = __atomic_load_n(&poll->ctl, __ATOMIC_RELAXED);
+
+    if ((poll->count > 0) && (rewatch || ((ctl & 1) == 0))) {
+        pirate_poll_arm(poll);
+    }
+}
+
+// The rings whose bit is set are checked before blocking, and
+// again after a helper thread has written to event_fd. The
+// helper threads stay armed between calls so that a ring that
+// becomes ready is also reported with a zero timeout.
+int pirate_poll_wait(pirate_poll_t *poll, pirate_poll_event_t *events,
+                     int maxevents, int timeout) {
+    struct epoll_event ready[PIRATE_POLL_BATCH];
+    uint64_t deadline = 0, now, value;
+    int i, n, rv, err, wait, signaled, rewatch, rings;
+
+    if ((poll == NULL) || (events == NULL) || (maxevents <= 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (timeout > 0) {
+        deadline = monotonic_ms() + timeout;
+    }
+
+    for (;;) {
+        rewatch = 0;
+        n = rings = pirate_poll_drain(poll, events, maxevents, &rewatch);
+        pirate_poll_rearm(poll, rewatch);
+        if (n == maxevents) {
+            return n;
+        }
+        wait = (n > 0) ? 0 : timeout;
+
+        // The exit of an io_uring instance interrupts the
+        // next wait of its thread, as pirate_async_enter()
+        err = errno;
+        rv = epoll_wait(poll->epoll_fd, ready, MIN(maxevents - n, PIRATE_POLL_BATCH), wait);
+        if ((rv < 0) && (errno == EINTR)) {
+            errno = err;
+            rv = 0;
+        } else if (rv < 0) {
+            return -1;
+        }
+        signaled = 0;
+        for (i = 0; i < rv; i++) {
+            if (ready[i].data.fd == -1) {
+                signaled = 1;
+                continue;
+            }
+            events[n].gd = ready[i].data.fd;
+            events[n].events = ready[i].events & PIRATE_POLL_EVENTS;
+            n++;
+        }
+        if (signaled) {
+            if (read(poll->event_fd, &value, sizeof(value)) < 0) {
+                return -1;
+            }
+            // a ring is reported at most once per call
+            if ((rings == 0) && (n < maxevents)) {
+                rewatch = 0;
+                n += pirate_poll_drain(poll, events + n, maxevents - n, &rewatch);
+                pirate_poll_rearm(poll, rewatch);
+            }
+        }
+        if ((n > 0) || (wait == 0)) {
+            return n;
+        }
+        if (timeout > 0) {
+            now = monotonic_ms();
+            if (now >= deadline) {
+                return 0;
+            }
+            timeout = deadline - now;
+        }
+    }
+}
+
+int pirate_poll_close(pirate_poll_t *poll) {
+    if (poll == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+#ifdef PIRATE_SHMEM_FEATURE
+    __atomic_store_n(&poll->closing, 1, __ATOMIC_SEQ_CST);
+    pirate_poll_disarm(poll);
+    for (size_t i = 0; i < poll->watcher_count; i++) {
+        pthread_join(poll->watchers[i]->thread, NULL);
+        free(poll->watchers[i]);
+    }
+    if (poll->event_fd >= 0) {
+        close(poll->event_fd);
+    }
+#endif
+    close(poll->epoll_fd);
+    free(poll->watchers);
+    free(poll->members);
+    free(poll->ready);
+    free(poll);
+    return 0;
+}
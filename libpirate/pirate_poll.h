@@ -0,0 +1,55 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#ifndef __PIRATE_POLL_H
+#define __PIRATE_POLL_H
+
+#include <stdint.h>
+#include "libpirate.h"
+#include "shmem_buffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The shared memory ring of an in-memory gaps channel.
+// The ring is writable when (writer - reader + reserve)
+// is less than capacity.
+typedef struct {
+    int access;
+    shmem_buffer_t *buf;
+    uint64_t capacity;
+    uint64_t reserve;
+    // non-zero when the other side wakes up the futex
+    // of this side after it updates its position
+    int futex;
+} pirate_poll_ring_t;
+
+// Checks that events match the access mode of the gaps descriptor.
+// Returns 0 and fills in ring for the SHMEM, UDP_SHMEM, and UIO
+// channel types, or 1 when the gaps descriptor is a file descriptor.
+// On error, -1 is returned, and errno is set appropriately.
+int pirate_get_poll_ring(int gd, uint32_t events, pirate_poll_ring_t *ring);
+
+// Returns the epoll file descriptor of the poll set. The file
+// descriptor is readable when pirate_poll_wait() may find a
+// ready gaps descriptor.
+int pirate_poll_fd(const pirate_poll_t *poll);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PIRATE_POLL_H */
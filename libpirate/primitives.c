@@ -19,21 +19,15 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sched.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <unistd.h>
 
-#if HAVE_STD_ATOMIC
-#include <stdatomic.h>
-typedef atomic_int pirate_atomic_int;
-#define ATOMIC_DEC(PTR) atomic_fetch_sub(PTR, 1)
-#else
-typedef int pirate_atomic_int;
-#define ATOMIC_DEC(PTR) __atomic_fetch_sub(PTR, 1, __ATOMIC_SEQ_CST)
-#endif
 
 #include "libpirate.h"
 #include "libpirate_internal.h"
@@ -49,8 +43,14 @@ typedef int pirate_atomic_int;
 #include "serial.h"
 #include "mercury.h"
 #include "ge_eth.h"
+#include "reliable.h"
+#include "shmem_mpmc.h"
+#include "xdp.h"
 #include "pirate_common.h"
 #include "channel_funcs.h"
+#include "stats.h"
+#include "pirate_poll.h"
+#include "pirate_async.h"
 
 typedef union {
     common_ctx         common;
@@ -66,6 +66,8 @@ typedef union {
     serial_ctx         serial;
     mercury_ctx        mercury;
     ge_eth_ctx         ge_eth;
+    shmem_mpmc_ctx     shmem_mpmc;
+    xdp_ctx            xdp;
 } pirate_channel_ctx_t;
 
 typedef struct {
@@ -73,16 +75,140 @@ typedef struct {
     pirate_channel_ctx_t ctx;
 } pirate_channel_t;
 
-static pirate_channel_t gaps_channels[PIRATE_NUM_CHANNELS];
-static pirate_stats_t gaps_stats[PIRATE_NUM_CHANNELS];
+typedef struct {
+    pirate_channel_t channel;
+    pirate_channel_stats_t stats;
+} pirate_channel_entry_t;
+
+// number of gaps descriptors per chunk of the descriptor table
+#define PIRATE_TABLE_CHUNK 64
+// initial number of chunks in the directory of the descriptor table
+#define PIRATE_TABLE_DIR_MIN 16
+
+typedef struct pirate_table_dir {
+    size_t size;
+    struct pirate_table_dir *retired; // previous directory
+    pirate_channel_entry_t *chunks[];
+} pirate_table_dir_t;
+
+// The descriptor table is a directory of fixed size chunks.
+// Lookups do not take a lock. Chunks are never freed so an entry
+// never moves. The directory is replaced by a larger copy when
+// it fills up. Readers may still hold the previous directory
+// so it is never freed. The directory doubles in size so the
+// retired directories are smaller in total than the current one.
+typedef struct {
+    pirate_table_dir_t *dir;
+} pirate_table_t;
+
+// gaps descriptors that are file descriptors
+static pirate_table_t gaps_fd_table;
+// gaps descriptors -2, -3, ... that are not file descriptors
+static pirate_table_t gaps_nofd_table;
+
+// Serializes the growth of the descriptor tables
+// and the allocation of gaps descriptors that
+// are not file descriptors.
+static int gaps_table_lock = 0;
+static int gaps_nofd_next = 0;
+static int *gaps_nofd_free = NULL;
+static size_t gaps_nofd_free_count = 0, gaps_nofd_free_size = 0;
+
+static void pirate_table_lock() {
+    while (__atomic_exchange_n(&gaps_table_lock, 1, __ATOMIC_ACQUIRE)) {
+        sched_yield();
+    }
+}
+
+static void pirate_table_unlock() {
+    __atomic_store_n(&gaps_table_lock, 0, __ATOMIC_RELEASE);
+}
+
+static inline pirate_channel_entry_t *pirate_table_get(pirate_table_t *table, size_t index) {
+    pirate_table_dir_t *dir = __atomic_load_n(&table->dir, __ATOMIC_ACQUIRE);
+    pirate_channel_entry_t *chunk;
+    size_t offset = index / PIRATE_TABLE_CHUNK;
+
+    if ((dir == NULL) || (offset >= dir->size)) {
+        return NULL;
+    }
+    chunk = __atomic_load_n(&dir->chunks[offset], __ATOMIC_ACQUIRE);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    return &chunk[index % PIRATE_TABLE_CHUNK];
+}
+
+// Allocates the chunk that contains index. Must be called
+// with the table lock held. The chunks are mapped anonymously
+// so the pages of the statistics shards are not allocated
+// until they are used.
+static pirate_channel_entry_t *pirate_table_reserve_locked(pirate_table_t *table, size_t index) {
+    pirate_table_dir_t *dir = table->dir, *next;
+    pirate_channel_entry_t *chunk;
+    size_t offset = index / PIRATE_TABLE_CHUNK, size;
+
+    if ((dir == NULL) || (offset >= dir->size)) {
+        size = (dir == NULL) ? PIRATE_TABLE_DIR_MIN : dir->size;
+        while (size <= offset) {
+            size *= 2;
+        }
+        next = calloc(1, sizeof(pirate_table_dir_t) + size * sizeof(pirate_channel_entry_t*));
+        if (next == NULL) {
+            return NULL;
+        }
+        next->size = size;
+        next->retired = dir;
+        if (dir != NULL) {
+            memcpy(next->chunks, dir->chunks, dir->size * sizeof(pirate_channel_entry_t*));
+        }
+        __atomic_store_n(&table->dir, next, __ATOMIC_RELEASE);
+        dir = next;
+    }
+    chunk = dir->chunks[offset];
+    if (chunk == NULL) {
+        chunk = mmap(NULL, PIRATE_TABLE_CHUNK * sizeof(pirate_channel_entry_t),
+            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (chunk == MAP_FAILED) {
+            return NULL;
+        }
+        __atomic_store_n(&dir->chunks[offset], chunk, __ATOMIC_RELEASE);
+    }
+    return &chunk[index % PIRATE_TABLE_CHUNK];
+}
+
+static pirate_channel_entry_t *pirate_table_reserve(pirate_table_t *table, size_t index) {
+    pirate_channel_entry_t *entry = pirate_table_get(table, index);
+
+    if (entry == NULL) {
+        pirate_table_lock();
+        entry = pirate_table_reserve_locked(table, index);
+        pirate_table_unlock();
+        if (entry == NULL) {
+            errno = ENOMEM;
+        }
+    }
+    return entry;
+}
 
-static pirate_channel_t gaps_nofd_channels[PIRATE_NUM_CHANNELS];
-static pirate_stats_t gaps_nofd_stats[PIRATE_NUM_CHANNELS];
+// Returns the entry of the gaps descriptor whether
+// or not the gaps descriptor is open.
+static inline pirate_channel_entry_t *pirate_get_entry(int gd) {
+    pirate_channel_entry_t *entry = NULL;
 
-#define PIRATE_NOFD_CHANNELS_LIMIT (-PIRATE_NUM_CHANNELS - 2)
+    if (gd >= 0) {
+        entry = pirate_table_get(&gaps_fd_table, gd);
+    } else if (gd < -1) {
+        entry = pirate_table_get(&gaps_nofd_table, -(gd + 2));
+    }
+    if (entry == NULL) {
+        errno = EBADF;
+    }
+    return entry;
+}
 
 static const pirate_channel_funcs_t gaps_channel_funcs[PIRATE_CHANNEL_TYPE_COUNT] = {
-    {NULL, NULL, NULL, NULL, NULL, NULL, NULL},
+    {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL},
     PIRATE_DEVICE_CHANNEL_FUNCS,
     PIRATE_PIPE_CHANNEL_FUNCS,
     PIRATE_UNIX_SOCKET_CHANNEL_FUNCS,
@@ -94,30 +220,25 @@ static const pirate_channel_funcs_t gaps_channel_funcs[PIRATE_CHANNEL_TYPE_COUNT
     PIRATE_UIO_CHANNEL_FUNCS,
     PIRATE_SERIAL_CHANNEL_FUNCS,
     PIRATE_MERCURY_CHANNEL_FUNCS,
-    PIRATE_GE_ETH_CHANNEL_FUNCS
+    PIRATE_GE_ETH_CHANNEL_FUNCS,
+    PIRATE_SHMEM_MPMC_CHANNEL_FUNCS,
+    PIRATE_XDP_CHANNEL_FUNCS
 };
 
 int pirate_close_channel(pirate_channel_t *channel);
 
 static inline pirate_channel_t *pirate_get_channel(int gd) {
-    pirate_channel_t *channel;
+    pirate_channel_entry_t *entry;
 
-    if ((gd == -1) || (gd >= PIRATE_NUM_CHANNELS) || (gd <= PIRATE_NOFD_CHANNELS_LIMIT)) {
-        errno = EBADF;
+    if ((entry = pirate_get_entry(gd)) == NULL) {
         return NULL;
     }
-
-    if (gd >= 0) {
-        channel = &gaps_channels[gd];
-    } else {
-        channel = &gaps_nofd_channels[-gd - 2];
-    }
-    if (channel->param.channel_type == INVALID) {
+    if (__atomic_load_n(&entry->channel.param.channel_type, __ATOMIC_RELAXED) == INVALID) {
         errno = EBADF;
         return NULL;
     }
 
-    return channel;
+    return &entry->channel;
 }
 
 static inline int pirate_channel_type_valid(channel_enum_t t) {
@@ -133,7 +254,7 @@ void pirate_init_channel_param(channel_enum_t channel_type, pirate_channel_param
     param->channel_type = channel_type;
 }
 
-static const char* pirate_common_keys[] = {"drop", NULL};
+static const char* pirate_common_keys[] = {"drop", "trunc_stats", "lat_stats", NULL};
 
 int pirate_parse_is_common_key(const char *key) {
     for (int i = 0; pirate_common_keys[i] != NULL; i++) {
@@ -147,6 +268,10 @@ int pirate_parse_is_common_key(const char *key) {
 static int pirate_parse_common_kv(const char *key, const char *val, pirate_channel_param_t *param) {
     if (strncmp("drop", key, strlen("drop")) == 0) {
         param->drop = atoi(val);
+    } else if (strncmp("trunc_stats", key, strlen("trunc_stats")) == 0) {
+        param->trunc_stats = atoi(val);
+    } else if (strncmp("lat_stats", key, strlen("lat_stats")) == 0) {
+        param->lat_stats = atoi(val);
     }
     return 0;
 }
@@ -215,6 +340,8 @@ int pirate_parse_channel_param(const char *str, pirate_channel_param_t *param) {
         param->channel_type = TCP_SOCKET;
     } else if (strncmp("udp_socket", opt, strlen("udp_socket")) == 0) {
         param->channel_type = UDP_SOCKET;
+    } else if (strncmp("shmem_mpmc", opt, strlen("shmem_mpmc")) == 0) {
+        param->channel_type = SHMEM_MPMC;
     } else if (strncmp("shmem", opt, strlen("shmem")) == 0) {
         param->channel_type = SHMEM;
     } else if (strncmp("udp_shmem", opt, strlen("udp_shmem")) == 0) {
@@ -227,6 +354,8 @@ int pirate_parse_channel_param(const char *str, pirate_channel_param_t *param) {
         param->channel_type = MERCURY;
     } else if (strncmp("ge_eth", opt, strlen("ge_eth")) == 0) {
         param->channel_type = GE_ETH;
+    } else if (strncmp("xdp", opt, strlen("xdp")) == 0) {
+        param->channel_type = XDP;
     }
 
     if (pirate_channel_type_valid(param->channel_type) != 0) {
@@ -253,20 +382,98 @@ int pirate_get_channel_param(int gd, pirate_channel_param_t *param) {
     return 0;
 }
 
-pirate_stats_t *pirate_get_stats_internal(int gd) {
-    if (gd >= 0) {
-        return &gaps_stats[gd];
-    } else {
-        return &gaps_nofd_stats[-gd - 2];
+// Returns the statistics shard of the calling thread.
+static inline pirate_stats_shard_t *pirate_get_stats_shard(pirate_channel_t *channel) {
+    return pirate_stats_shard(&((pirate_channel_entry_t*) channel)->stats);
+}
+
+static inline uint64_t pirate_latency_start(const pirate_channel_param_t *param) {
+    return param->lat_stats ? pirate_stats_ticks() : 0;
+}
+
+static inline void pirate_latency_end(pirate_stats_shard_t *stats,
+    const pirate_channel_param_t *param, uint64_t start) {
+    pirate_stats_hist_t *hist;
+    if (param->lat_stats && ((hist = pirate_stats_hist(stats)) != NULL)) {
+        pirate_histogram_record(&hist->latency, pirate_stats_ticks() - start);
+    }
+}
+
+// Moves the datagrams that the peer refused during
+// the write of the calling thread to the statistics.
+static inline void pirate_stats_undelivered(pirate_stats_shard_t *stats) {
+    if (pirate_undelivered > 0) {
+        pirate_stats_add(&stats->undelivered, pirate_undelivered);
+        pirate_undelivered = 0;
+    }
+}
+
+static inline void pirate_stats_success(pirate_stats_shard_t *stats, size_t len) {
+    pirate_stats_hist_t *hist;
+    pirate_stats_add(&stats->success, 1);
+    pirate_stats_add(&stats->bytes, len);
+    if ((hist = pirate_stats_hist(stats)) != NULL) {
+        pirate_histogram_record(&hist->size, len);
     }
 }
 
 const pirate_stats_t *pirate_get_stats(int gd) {
-    if ((gd == -1) || (gd >= PIRATE_NUM_CHANNELS) || (gd <= PIRATE_NOFD_CHANNELS_LIMIT)) {
-        errno = EBADF;
+    pirate_channel_entry_t *entry;
+
+    if ((entry = pirate_get_entry(gd)) == NULL) {
         return NULL;
     }
-    return pirate_get_stats_internal(gd);
+    return pirate_stats_merge(&entry->stats);
+}
+
+// Returns the reliable layer of a UDP_SOCKET or GE_ETH
+// channel that was opened with the reliable option
+static pirate_reliable_t *pirate_get_reliable(pirate_channel_t *channel) {
+    switch (channel->param.channel_type) {
+    case UDP_SOCKET:
+        return channel->ctx.udp_socket.reliable;
+    case GE_ETH:
+        return channel->ctx.ge_eth.reliable;
+    default:
+        return NULL;
+    }
+}
+
+int pirate_get_stats_ex(int gd, pirate_stats_ex_t *stats) {
+    const shmem_wait_stats_t *wait_stats = NULL;
+    pirate_channel_entry_t *entry;
+    pirate_channel_t *channel;
+    pirate_reliable_t *reliable;
+
+    if ((entry = pirate_get_entry(gd)) == NULL) {
+        return -1;
+    }
+    pirate_stats_merge_ex(&entry->stats, stats);
+
+    channel = &entry->channel;
+    switch (channel->param.channel_type) {
+    case SHMEM:
+        wait_stats = &channel->ctx.shmem.wait_stats;
+        break;
+    case UDP_SHMEM:
+        wait_stats = &channel->ctx.udp_shmem.wait_stats;
+        break;
+    case SHMEM_MPMC:
+        wait_stats = &channel->ctx.shmem_mpmc.wait_stats;
+        break;
+    default:
+        break;
+    }
+    if (wait_stats != NULL) {
+        stats->waits = __atomic_load_n(&wait_stats->waits, __ATOMIC_RELAXED);
+        stats->wakeups = __atomic_load_n(&wait_stats->wakeups, __ATOMIC_RELAXED);
+        stats->blocked_ns = __atomic_load_n(&wait_stats->blocked_ns, __ATOMIC_RELAXED);
+    }
+    if ((reliable = pirate_get_reliable(channel)) != NULL) {
+        pirate_reliable_stats(reliable, &stats->retransmits, &stats->lost,
+            &stats->recovered);
+    }
+    return 0;
 }
 
 int pirate_unparse_channel_param(const pirate_channel_param_t *param, char *desc, int len) {
@@ -282,7 +489,23 @@ int pirate_unparse_channel_param(const pirate_channel_param_t *param, char *desc
         return -1;
     }
 
-    return unparse_func(&param->channel, desc, len);
+    int rv = unparse_func(&param->channel, desc, len);
+    if (rv < 0) {
+        return rv;
+    }
+
+    // common parameters are appended when they
+    // are not set to their default values
+    if (param->drop > 0) {
+        rv += snprintf(desc + MIN(rv, len), len - MIN(rv, len), OPT_DELIM "drop=%u", param->drop);
+    }
+    if (param->trunc_stats > 0) {
+        rv += snprintf(desc + MIN(rv, len), len - MIN(rv, len), OPT_DELIM "trunc_stats=%u", param->trunc_stats);
+    }
+    if (param->lat_stats > 0) {
+        rv += snprintf(desc + MIN(rv, len), len - MIN(rv, len), OPT_DELIM "lat_stats=%u", param->lat_stats);
+    }
+    return rv;
 }
 
 int pirate_get_channel_description(int gd, char *desc, int len) {
@@ -295,17 +518,183 @@ int pirate_get_channel_description(int gd, char *desc, int len) {
     return pirate_unparse_channel_param(&channel->param, desc, len);
 }
 
-static pirate_atomic_int next_gd = -2;
+int pirate_get_poll_ring(int gd, uint32_t events, pirate_poll_ring_t *ring) {
+    pirate_channel_t *channel;
+    int access;
+
+    if ((channel = pirate_get_channel(gd)) == NULL) {
+        return -1;
+    }
+
+    access = channel->ctx.common.flags & O_ACCMODE;
+    if (((events != PIRATE_POLLIN) || (access != O_RDONLY)) &&
+        ((events != PIRATE_POLLOUT) || (access != O_WRONLY))) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (gd >= 0) {
+        return 1;
+    }
+
+    memset(ring, 0, sizeof(pirate_poll_ring_t));
+    ring->access = access;
+    switch (channel->param.channel_type) {
+    case SHMEM:
+        ring->buf = channel->ctx.shmem.buf;
+        ring->capacity = ring->buf->size;
+        ring->reserve = sizeof(pirate_header_t);
+        ring->futex = 1;
+        return 0;
+    case UDP_SHMEM:
+        ring->buf = channel->ctx.udp_shmem.buf;
+        ring->capacity = ring->buf->packet_count;
+        ring->futex = 1;
+        return 0;
+    case UIO_DEVICE:
+        ring->buf = channel->ctx.uio.buf;
+        ring->capacity = ring->buf->size;
+        return 0;
+    default:
+        errno = ESOCKTNOSUPPORT;
+        return -1;
+    }
+}
+
+int pirate_get_async_channel(int gd, pirate_async_channel_t *async) {
+    pirate_channel_t *channel;
+    pirate_channel_param_t *param;
+    ssize_t mtu;
+
+    if ((channel = pirate_get_channel(gd)) == NULL) {
+        return -1;
+    }
+    param = &channel->param;
+
+    memset(async, 0, sizeof(pirate_async_channel_t));
+    async->access = channel->ctx.common.flags & O_ACCMODE;
+    if ((gd < 0) || (channel->ctx.common.flags & O_NONBLOCK)) {
+        return 0;
+    }
+
+    switch (param->channel_type) {
+    case UDP_SOCKET:
+        async->mode = PIRATE_ASYNC_DATAGRAM;
+        async->retry_refused = 1;
+        break;
+    case UNIX_SEQPACKET:
+        async->mode = PIRATE_ASYNC_DATAGRAM;
+        break;
+    case DEVICE:
+        async->mode = PIRATE_ASYNC_STREAM;
+        async->min_tx = param->channel.device.min_tx;
+        break;
+    case PIPE:
+        async->mode = PIRATE_ASYNC_STREAM;
+        async->min_tx = param->channel.pipe.min_tx;
+        break;
+    case UNIX_SOCKET:
+        async->mode = PIRATE_ASYNC_STREAM;
+        async->min_tx = param->channel.unix_socket.min_tx;
+        break;
+    case TCP_SOCKET:
+        async->mode = PIRATE_ASYNC_STREAM;
+        async->min_tx = param->channel.tcp_socket.min_tx;
+        break;
+    default:
+        return 0;
+    }
+
+    // The start of the next packet may have been read by pirate_peek_len().
+    if ((async->mode == PIRATE_ASYNC_STREAM) && channel->ctx.common.peeked) {
+        async->mode = PIRATE_ASYNC_BLOCKING;
+    }
+
+    mtu = gaps_channel_funcs[param->channel_type].write_mtu(&param->channel, &channel->ctx);
+    if (mtu < 0) {
+        return -1;
+    }
+    async->write_mtu = mtu;
+    return 0;
+}
+
+void pirate_async_stats(int gd, ssize_t rv, int err, unsigned undelivered) {
+    pirate_channel_t *channel;
+    pirate_stats_shard_t *stats;
+
+    if ((channel = pirate_get_channel(gd)) == NULL) {
+        return;
+    }
+    stats = pirate_get_stats_shard(channel);
+    pirate_stats_add(&stats->requests, 1);
+    if (undelivered > 0) {
+        pirate_stats_add(&stats->undelivered, undelivered);
+    }
+    if (rv < 0) {
+        if ((err != EAGAIN) && (err != EWOULDBLOCK)) {
+            pirate_stats_add(&stats->errs, 1);
+        }
+    } else {
+        pirate_stats_success(stats, rv);
+    }
+}
 
+// Returns the smallest gaps descriptor that is not a file
+// descriptor and is not in use. The gaps descriptor is
+// returned to the free list by pirate_close().
 int pirate_next_gd() {
-    int next = ATOMIC_DEC(&next_gd);
-    return next;
+    int next;
+
+    pirate_table_lock();
+    if (gaps_nofd_free_count > 0) {
+        next = gaps_nofd_free[--gaps_nofd_free_count];
+    } else {
+        next = gaps_nofd_next++;
+    }
+    pirate_table_unlock();
+    return -(next + 2);
+}
+
+static void pirate_release_gd(int gd) {
+    int *next_free;
+    size_t next_size;
+
+    pirate_table_lock();
+    if (gaps_nofd_free_count == gaps_nofd_free_size) {
+        next_size = (gaps_nofd_free_size == 0) ? PIRATE_TABLE_CHUNK : 2 * gaps_nofd_free_size;
+        next_free = realloc(gaps_nofd_free, next_size * sizeof(int));
+        if (next_free == NULL) {
+            // the gaps descriptor is not reused
+            pirate_table_unlock();
+            return;
+        }
+        gaps_nofd_free = next_free;
+        gaps_nofd_free_size = next_size;
+    }
+    gaps_nofd_free[gaps_nofd_free_count++] = -(gd + 2);
+    pirate_table_unlock();
 }
 
 // Declared in libpirate_internal.h for testing purposes only
 void pirate_reset_stats() {
-    memset(gaps_stats, 0, sizeof(gaps_stats));
-    memset(gaps_nofd_stats, 0, sizeof(gaps_nofd_stats));
+    pirate_table_t *tables[] = {&gaps_fd_table, &gaps_nofd_table};
+    pirate_table_dir_t *dir;
+
+    pirate_table_lock();
+    for (int i = 0; i < 2; i++) {
+        if ((dir = tables[i]->dir) == NULL) {
+            continue;
+        }
+        for (size_t j = 0; j < dir->size; j++) {
+            if (dir->chunks[j] == NULL) {
+                continue;
+            }
+            for (size_t k = 0; k < PIRATE_TABLE_CHUNK; k++) {
+                pirate_stats_reset(&dir->chunks[j][k].stats);
+            }
+        }
+    }
+    pirate_table_unlock();
 }
 
 static int pirate_open(pirate_channel_t *channel) {
@@ -344,29 +733,49 @@ static int pirate_open(pirate_channel_t *channel) {
     return open_func(&param->channel, ctx);
 }
 
-// gaps descriptors must be opened from smallest to largest
+// Gaps descriptors may be opened in any order. The table chunk
+// that holds the entry is allocated on first use, and the channel
+// is closed again if the allocation fails.
 int pirate_open_param(pirate_channel_param_t *param, int flags) {
     pirate_channel_t channel;
+    pirate_channel_entry_t *entry;
+    channel_enum_t channel_type = param->channel_type;
     int gd;
 
     memcpy(&channel.param, param, sizeof(pirate_channel_param_t));
+    memset(&channel.ctx, 0, sizeof(pirate_channel_ctx_t));
     channel.ctx.common.flags = flags;
 
     gd = pirate_open(&channel);
-    if ((gd >= PIRATE_NUM_CHANNELS) || (gd <= PIRATE_NOFD_CHANNELS_LIMIT)) {
-        pirate_close_channel(&channel);
-        errno = EMFILE;
-        return -1;
-    }
     if (gd == -1) {
         return -1;
     }
 
+    // The reliable layer recovers from the packets that
+    // are dropped so they are dropped below the layer
+    if ((channel.param.drop > 0) && (pirate_get_reliable(&channel) != NULL)) {
+        pirate_reliable_set_drop(pirate_get_reliable(&channel), channel.param.drop);
+    }
+
     if (gd >= 0) {
-        memcpy(&gaps_channels[gd], &channel, sizeof(pirate_channel_t));
+        entry = pirate_table_reserve(&gaps_fd_table, gd);
     } else {
-        memcpy(&gaps_nofd_channels[-gd - 2], &channel, sizeof(pirate_channel_t));
+        entry = pirate_table_reserve(&gaps_nofd_table, -(gd + 2));
+    }
+    if (entry == NULL) {
+        pirate_close_channel(&channel);
+        if (gd < -1) {
+            pirate_release_gd(gd);
+        }
+        errno = ENOMEM;
+        return -1;
     }
+
+    // The channel type is stored last so that
+    // the entry is valid once it is observed.
+    channel.param.channel_type = INVALID;
+    memcpy(&entry->channel, &channel, sizeof(pirate_channel_t));
+    __atomic_store_n(&entry->channel.param.channel_type, channel_type, __ATOMIC_RELEASE);
     return gd;
 }
 
@@ -380,10 +789,25 @@ int pirate_open_parse(const char *param, int flags) {
     return pirate_open_param(&vals, flags);
 }
 
+int pirate_shmem_create(const pirate_channel_param_t *param) {
+    if (param->channel_type != SHMEM) {
+        errno = EINVAL;
+        return -1;
+    }
+#ifdef PIRATE_SHMEM_FEATURE
+    pirate_shmem_param_t shmem_param = param->channel.shmem;
+    return shmem_buffer_create(&shmem_param);
+#else
+    errno = ESOCKTNOSUPPORT;
+    return -1;
+#endif
+}
+
 int pirate_nonblock_channel_type(channel_enum_t channel_type, size_t mtu) {
     switch (channel_type) {
     case UDP_SOCKET:
     case GE_ETH:
+    case XDP:
     case UNIX_SEQPACKET:
         return 1;
     case PIPE:
@@ -393,13 +817,34 @@ int pirate_nonblock_channel_type(channel_enum_t channel_type, size_t mtu) {
     }
 }
 
+// The entry is released before the channel is closed. A file
+// descriptor can be reused by a concurrent pirate_open() as
+// soon as it is closed. The gaps descriptor is released even
+// when the channel type returns an error on close.
 int pirate_close(int gd) {
-    pirate_channel_t *channel;
+    pirate_channel_t *channel, closing;
+    channel_enum_t channel_type;
+    int rv;
 
     if ((channel = pirate_get_channel(gd)) == NULL) {
         return -1;
     }
-    return pirate_close_channel(channel);
+    memcpy(&closing, channel, sizeof(pirate_channel_t));
+    channel_type = closing.param.channel_type;
+
+    // Only one of the concurrent calls to pirate_close() succeeds.
+    if ((channel_type == INVALID) ||
+        !__atomic_compare_exchange_n(&channel->param.channel_type, &channel_type, INVALID,
+            0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        errno = EBADF;
+        return -1;
+    }
+
+    rv = pirate_close_channel(&closing);
+    if (gd < -1) {
+        pirate_release_gd(gd);
+    }
+    return rv;
 }
 
 int pirate_close_channel(pirate_channel_t *channel) {
@@ -427,8 +872,10 @@ int pirate_close_channel(pirate_channel_t *channel) {
 
 ssize_t pirate_read(int gd, void *buf, size_t count) {
     pirate_channel_t *channel = NULL;
-    ssize_t rv;
+    ssize_t rv, packet_len = -1;
+    uint64_t start;
     pirate_read_t read_func;
+    pirate_peek_len_t peek_len_func;
 
     if ((channel = pirate_get_channel(gd)) == NULL) {
         return -1;
@@ -439,7 +886,7 @@ ssize_t pirate_read(int gd, void *buf, size_t count) {
         return -1;
     }
 
-    pirate_stats_t *stats = pirate_get_stats_internal(gd);
+    pirate_stats_shard_t *stats = pirate_get_stats_shard(channel);
     pirate_channel_param_t *param = &channel->param;
 
     if (pirate_channel_type_valid(param->channel_type) != 0) {
@@ -453,23 +900,72 @@ ssize_t pirate_read(int gd, void *buf, size_t count) {
         return -1;
     }
 
-    stats->requests += 1;
+    peek_len_func = gaps_channel_funcs[param->channel_type].peek_len;
+
+    pirate_stats_add(&stats->requests, 1);
+    start = pirate_latency_start(param);
+
+    // The truncation counter needs the length of the packet
+    // before it is read. This costs an additional system call
+    // for the socket channel types so it must be requested.
+    if (param->trunc_stats && (peek_len_func != NULL)) {
+        packet_len = peek_len_func(&param->channel, &channel->ctx);
+        if (packet_len < 0) {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+                pirate_stats_add(&stats->errs, 1);
+            }
+            return -1;
+        }
+    }
 
     rv = read_func(&param->channel, &channel->ctx, buf, count);
     if (rv < 0) {
         if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
-            stats->errs += 1;
+            pirate_stats_add(&stats->errs, 1);
         }
     } else {
-        stats->success += 1;
-        stats->bytes += rv;
+        pirate_latency_end(stats, param, start);
+        pirate_stats_success(stats, rv);
+        if (packet_len > rv) {
+            pirate_stats_add(&stats->truncated, 1);
+        }
     }
     return rv;
 }
 
+ssize_t pirate_peek_len(int gd) {
+    pirate_channel_t *channel = NULL;
+    pirate_peek_len_t peek_len_func;
+
+    if ((channel = pirate_get_channel(gd)) == NULL) {
+        return -1;
+    }
+
+    if ((channel->ctx.common.flags & O_ACCMODE) != O_RDONLY) {
+        errno = EBADF;
+        return -1;
+    }
+
+    pirate_channel_param_t *param = &channel->param;
+
+    if (pirate_channel_type_valid(param->channel_type) != 0) {
+        return -1;
+    }
+
+    peek_len_func = gaps_channel_funcs[param->channel_type].peek_len;
+
+    if (peek_len_func == NULL) {
+        errno = ESOCKTNOSUPPORT;
+        return -1;
+    }
+
+    return peek_len_func(&param->channel, &channel->ctx);
+}
+
 ssize_t pirate_write(int gd, const void *buf, size_t count) {
     pirate_channel_t *channel = NULL;
     ssize_t rv;
+    uint64_t start;
     pirate_write_t write_func;
 
     if ((channel = pirate_get_channel(gd)) == NULL) {
@@ -481,7 +977,7 @@ ssize_t pirate_write(int gd, const void *buf, size_t count) {
         return -1;
     }
 
-    pirate_stats_t *stats = pirate_get_stats_internal(gd);
+    pirate_stats_shard_t *stats = pirate_get_stats_shard(channel);
     pirate_channel_param_t *param = &channel->param;
 
     if (pirate_channel_type_valid(param->channel_type) != 0) {
@@ -494,23 +990,114 @@ ssize_t pirate_write(int gd, const void *buf, size_t count) {
         return -1;
     }
 
-    if ((param->drop > 0) && ((stats->requests % param->drop) == 0)) {
-        stats->requests += 1;
-        stats->fuzzed += 1;
+    if ((param->drop > 0) && (pirate_get_reliable(channel) == NULL) &&
+        ((__atomic_load_n(&stats->requests, __ATOMIC_RELAXED) % param->drop) == 0)) {
+        pirate_stats_add(&stats->requests, 1);
+        pirate_stats_add(&stats->fuzzed, 1);
         return count;
     } else {
-        stats->requests += 1;
+        pirate_stats_add(&stats->requests, 1);
     }
 
+    start = pirate_latency_start(param);
+
     rv = write_func(&param->channel, &channel->ctx, buf, count);
+    pirate_stats_undelivered(stats);
 
     if (rv < 0) {
         if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
-            stats->errs += 1;
+            pirate_stats_add(&stats->errs, 1);
         }
     } else {
-        stats->success += 1;
-        stats->bytes += rv;
+        pirate_latency_end(stats, param, start);
+        pirate_stats_success(stats, rv);
+    }
+
+    return rv;
+}
+
+ssize_t pirate_writev(int gd, const struct iovec *iov, int iovcnt) {
+    pirate_channel_t *channel = NULL;
+    ssize_t rv;
+    size_t count = 0;
+    uint64_t start;
+    unsigned char *buf, *ptr;
+    int i;
+    pirate_write_t write_func;
+    pirate_writev_t writev_func;
+
+    if ((channel = pirate_get_channel(gd)) == NULL) {
+        return -1;
+    }
+
+    if ((channel->ctx.common.flags & O_ACCMODE) != O_WRONLY) {
+        errno = EBADF;
+        return -1;
+    }
+
+    if ((iovcnt < 0) || (iovcnt > PIRATE_IOV_MAX)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pirate_stats_shard_t *stats = pirate_get_stats_shard(channel);
+    pirate_channel_param_t *param = &channel->param;
+
+    if (pirate_channel_type_valid(param->channel_type) != 0) {
+        return -1;
+    }
+
+    write_func = gaps_channel_funcs[param->channel_type].write;
+    writev_func = gaps_channel_funcs[param->channel_type].writev;
+    if (write_func == NULL) {
+        errno = ESOCKTNOSUPPORT;
+        return -1;
+    }
+
+    for (i = 0; i < iovcnt; i++) {
+        count += iov[i].iov_len;
+    }
+
+    if ((param->drop > 0) && (pirate_get_reliable(channel) == NULL) &&
+        ((__atomic_load_n(&stats->requests, __ATOMIC_RELAXED) % param->drop) == 0)) {
+        pirate_stats_add(&stats->requests, 1);
+        pirate_stats_add(&stats->fuzzed, 1);
+        return count;
+    } else {
+        pirate_stats_add(&stats->requests, 1);
+    }
+
+    start = pirate_latency_start(param);
+
+    if (writev_func != NULL) {
+        rv = writev_func(&param->channel, &channel->ctx, iov, iovcnt);
+    } else if (iovcnt == 1) {
+        rv = write_func(&param->channel, &channel->ctx, iov[0].iov_base, iov[0].iov_len);
+    } else {
+        // Channel types without scatter-gather support
+        // receive a contiguous copy of the packet.
+        buf = malloc(count);
+        if ((buf == NULL) && (count > 0)) {
+            pirate_stats_add(&stats->errs, 1);
+            return -1;
+        }
+        ptr = buf;
+        for (i = 0; i < iovcnt; i++) {
+            memcpy(ptr, iov[i].iov_base, iov[i].iov_len);
+            ptr += iov[i].iov_len;
+        }
+        rv = write_func(&param->channel, &channel->ctx, buf, count);
+        free(buf);
+    }
+    pirate_stats_undelivered(stats);
+
+    if (rv < 0) {
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+            pirate_stats_add(&stats->errs, 1);
+        }
+    } else {
+        pirate_latency_end(stats, param, start);
+        pirate_stats_success(stats, rv);
     }
 
     return rv;
@@ -556,3 +1143,277 @@ ssize_t pirate_write_mtu(int gd) {
 
     return write_mtu_func(&param->channel, &channel->ctx);
 }
+
+ssize_t pirate_write_batch(int gd, pirate_mmsg_t *msgs, unsigned vlen) {
+    pirate_channel_t *channel = NULL;
+    ssize_t rv;
+    uint64_t start;
+    unsigned i;
+    pirate_write_batch_t write_batch_func;
+
+    if ((channel = pirate_get_channel(gd)) == NULL) {
+        return -1;
+    }
+
+    if ((channel->ctx.common.flags & O_ACCMODE) != O_WRONLY) {
+        errno = EBADF;
+        return -1;
+    }
+
+    pirate_stats_shard_t *stats = pirate_get_stats_shard(channel);
+    pirate_channel_param_t *param = &channel->param;
+
+    if (pirate_channel_type_valid(param->channel_type) != 0) {
+        return -1;
+    }
+
+    if (gaps_channel_funcs[param->channel_type].write == NULL) {
+        errno = ESOCKTNOSUPPORT;
+        return -1;
+    }
+
+    vlen = MIN(vlen, PIRATE_IOV_MAX);
+    write_batch_func = gaps_channel_funcs[param->channel_type].write_batch;
+
+    // Packets are written one at a time when the channel type
+    // does not support batching or when packets are being dropped.
+    if ((write_batch_func == NULL) || (param->drop > 0)) {
+        for (i = 0; i < vlen; i++) {
+            rv = pirate_write(gd, msgs[i].buf, msgs[i].count);
+            if (rv < 0) {
+                return (i > 0) ? (ssize_t) i : -1;
+            }
+            msgs[i].len = rv;
+        }
+        return vlen;
+    }
+
+    if (vlen == 0) {
+        return 0;
+    }
+
+    start = pirate_latency_start(param);
+    rv = write_batch_func(&param->channel, &channel->ctx, msgs, vlen);
+    pirate_stats_undelivered(stats);
+
+    if (rv < 0) {
+        pirate_stats_add(&stats->requests, 1);
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+            pirate_stats_add(&stats->errs, 1);
+        }
+    } else {
+        pirate_latency_end(stats, param, start);
+        pirate_stats_add(&stats->requests, rv);
+        for (i = 0; i < (unsigned) rv; i++) {
+            pirate_stats_success(stats, msgs[i].len);
+        }
+    }
+
+    return rv;
+}
+
+ssize_t pirate_read_batch(int gd, pirate_mmsg_t *msgs, unsigned vlen) {
+    pirate_channel_t *channel = NULL;
+    ssize_t rv;
+    uint64_t start;
+    unsigned i;
+    pirate_read_batch_t read_batch_func;
+
+    if ((channel = pirate_get_channel(gd)) == NULL) {
+        return -1;
+    }
+
+    if ((channel->ctx.common.flags & O_ACCMODE) != O_RDONLY) {
+        errno = EBADF;
+        return -1;
+    }
+
+    pirate_stats_shard_t *stats = pirate_get_stats_shard(channel);
+    pirate_channel_param_t *param = &channel->param;
+
+    if (pirate_channel_type_valid(param->channel_type) != 0) {
+        return -1;
+    }
+
+    if (gaps_channel_funcs[param->channel_type].read == NULL) {
+        errno = ESOCKTNOSUPPORT;
+        return -1;
+    }
+
+    if (vlen == 0) {
+        return 0;
+    }
+
+    vlen = MIN(vlen, PIRATE_IOV_MAX);
+    read_batch_func = gaps_channel_funcs[param->channel_type].read_batch;
+
+    // A single packet is read when the channel type
+    // does not support batching or when truncated
+    // packets are being counted.
+    if ((read_batch_func == NULL) || param->trunc_stats) {
+        rv = pirate_read(gd, msgs[0].buf, msgs[0].count);
+        if (rv < 0) {
+            return -1;
+        }
+        msgs[0].len = rv;
+        return 1;
+    }
+
+    start = pirate_latency_start(param);
+    rv = read_batch_func(&param->channel, &channel->ctx, msgs, vlen);
+
+    if (rv < 0) {
+        pirate_stats_add(&stats->requests, 1);
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+            pirate_stats_add(&stats->errs, 1);
+        }
+    } else {
+        pirate_latency_end(stats, param, start);
+        pirate_stats_add(&stats->requests, rv);
+        for (i = 0; i < (unsigned) rv; i++) {
+            pirate_stats_success(stats, msgs[i].len);
+        }
+    }
+
+    return rv;
+}
+
+ssize_t pirate_write_reserve(int gd, size_t count, struct iovec iov[2]) {
+    pirate_channel_t *channel = NULL;
+    pirate_write_reserve_t write_reserve_func;
+
+    if ((channel = pirate_get_channel(gd)) == NULL) {
+        return -1;
+    }
+
+    if ((channel->ctx.common.flags & O_ACCMODE) != O_WRONLY) {
+        errno = EBADF;
+        return -1;
+    }
+
+    pirate_channel_param_t *param = &channel->param;
+
+    if (pirate_channel_type_valid(param->channel_type) != 0) {
+        return -1;
+    }
+
+    write_reserve_func = gaps_channel_funcs[param->channel_type].write_reserve;
+    if (write_reserve_func == NULL) {
+        errno = ESOCKTNOSUPPORT;
+        return -1;
+    }
+
+    return write_reserve_func(&param->channel, &channel->ctx, count, iov);
+}
+
+ssize_t pirate_write_commit(int gd, size_t count) {
+    pirate_channel_t *channel = NULL;
+    ssize_t rv;
+    uint64_t start;
+    pirate_write_commit_t write_commit_func;
+
+    if ((channel = pirate_get_channel(gd)) == NULL) {
+        return -1;
+    }
+
+    if ((channel->ctx.common.flags & O_ACCMODE) != O_WRONLY) {
+        errno = EBADF;
+        return -1;
+    }
+
+    pirate_stats_shard_t *stats = pirate_get_stats_shard(channel);
+    pirate_channel_param_t *param = &channel->param;
+
+    if (pirate_channel_type_valid(param->channel_type) != 0) {
+        return -1;
+    }
+
+    write_commit_func = gaps_channel_funcs[param->channel_type].write_commit;
+    if (write_commit_func == NULL) {
+        errno = ESOCKTNOSUPPORT;
+        return -1;
+    }
+
+    pirate_stats_add(&stats->requests, 1);
+    start = pirate_latency_start(param);
+
+    rv = write_commit_func(&param->channel, &channel->ctx, count);
+    if (rv < 0) {
+        pirate_stats_add(&stats->errs, 1);
+    } else {
+        pirate_latency_end(stats, param, start);
+        pirate_stats_success(stats, rv);
+    }
+
+    return rv;
+}
+
+ssize_t pirate_read_acquire(int gd, struct iovec iov[2]) {
+    pirate_channel_t *channel = NULL;
+    ssize_t rv;
+    uint64_t start;
+    pirate_read_acquire_t read_acquire_func;
+
+    if ((channel = pirate_get_channel(gd)) == NULL) {
+        return -1;
+    }
+
+    if ((channel->ctx.common.flags & O_ACCMODE) != O_RDONLY) {
+        errno = EBADF;
+        return -1;
+    }
+
+    pirate_stats_shard_t *stats = pirate_get_stats_shard(channel);
+    pirate_channel_param_t *param = &channel->param;
+
+    if (pirate_channel_type_valid(param->channel_type) != 0) {
+        return -1;
+    }
+
+    read_acquire_func = gaps_channel_funcs[param->channel_type].read_acquire;
+    if (read_acquire_func == NULL) {
+        errno = ESOCKTNOSUPPORT;
+        return -1;
+    }
+
+    pirate_stats_add(&stats->requests, 1);
+    start = pirate_latency_start(param);
+
+    rv = read_acquire_func(&param->channel, &channel->ctx, iov);
+    if (rv < 0) {
+        pirate_stats_add(&stats->errs, 1);
+    } else {
+        pirate_latency_end(stats, param, start);
+        pirate_stats_success(stats, rv);
+    }
+
+    return rv;
+}
+
+int pirate_read_release(int gd) {
+    pirate_channel_t *channel = NULL;
+    pirate_read_release_t read_release_func;
+
+    if ((channel = pirate_get_channel(gd)) == NULL) {
+        return -1;
+    }
+
+    if ((channel->ctx.common.flags & O_ACCMODE) != O_RDONLY) {
+        errno = EBADF;
+        return -1;
+    }
+
+    pirate_channel_param_t *param = &channel->param;
+
+    if (pirate_channel_type_valid(param->channel_type) != 0) {
+        return -1;
+    }
+
+    read_release_func = gaps_channel_funcs[param->channel_type].read_release;
+    if (read_release_func == NULL) {
+        errno = ESOCKTNOSUPPORT;
+        return -1;
+    }
+
+    return read_release_func(&param->channel, &channel->ctx);
+}
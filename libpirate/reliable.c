@@ -0,0 +1,1137 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fec.h"
+#include "pirate_common.h"
+#include "reliable.h"
+
+// The writer waits this long for the packets in
+// flight to be acknowledged when the channel is closed
+#define PIRATE_RELIABLE_LINGER_MS 2000
+
+// The reader keeps the parity packets of this many blocks
+// until enough of them arrive to recover the lost packets
+#define PIRATE_RELIABLE_FEC_BLOCKS 4
+
+typedef struct {
+    // header and fragment
+    uint8_t *data;
+    uint32_t len;
+    // reader: the packet has been received
+    uint8_t present;
+    // writer: time of the last retransmission, or 0
+    // reader: time the packet was received
+    uint64_t time_ns;
+} reliable_slot_t;
+
+typedef struct {
+    uint32_t seq;
+    // number of data packets, or 0 when the entry is unused
+    uint32_t count;
+    // length of the parity packets without the header
+    size_t len;
+    unsigned received;
+    uint8_t *present;
+    uint8_t *data;
+    uint64_t time_ns;
+} reliable_block_t;
+
+// The writer keeps the packets from base to next in its window until
+// the reader reports that they were delivered. The reader keeps the
+// packets from deliver to highest until their message is complete.
+// Both windows are indexed by the sequence number modulo the window.
+struct pirate_reliable {
+    pirate_reliable_param_t param;
+    int flags;
+    int sock;
+    size_t mtu;
+    size_t payload;
+    uint64_t rto_ns;
+    pirate_reliable_send_t send;
+    pirate_reliable_recv_t recv;
+    reliable_slot_t *slots;
+    uint8_t *storage;
+    // scratch datagram
+    uint8_t *buf;
+    uint32_t session;
+    // writer state that is shared with the writer thread
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    int running;
+    int stop;
+    uint32_t base;
+    uint32_t next;
+    uint64_t progress_ns;
+    unsigned drop;
+    uint64_t sent;
+    // reader state
+    int synced;
+    uint32_t deliver;
+    uint32_t highest;
+    // time of the last status packet
+    uint64_t status_ns;
+    // time of the last packet that was received
+    uint64_t arrival_ns;
+    uint32_t delivered;
+    struct sockaddr_storage peer;
+    socklen_t peer_len;
+    // writer: the parity packets of the open block
+    // reader: the parity packets of the incomplete blocks
+    uint8_t *parity;
+    uint8_t *parity_present;
+    reliable_block_t blocks[PIRATE_RELIABLE_FEC_BLOCKS];
+    uint32_t block_seq;
+    uint32_t block_count;
+    size_t block_len;
+    uint64_t block_ns;
+    uint64_t flush_ns;
+    uint64_t retransmits;
+    uint64_t lost;
+    uint64_t recovered;
+    uint8_t arg[];
+};
+
+static uint64_t reliable_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Sequence numbers wrap around. Returns a negative
+// value if a precedes b and a positive value if a follows b.
+static inline int32_t seq_cmp(uint32_t a, uint32_t b) {
+    return (int32_t) (a - b);
+}
+
+static void reliable_deadline(struct timespec *ts, uint64_t ns) {
+    ts->tv_sec = ns / 1000000000ull;
+    ts->tv_nsec = ns % 1000000000ull;
+}
+
+static inline reliable_slot_t *reliable_slot(pirate_reliable_t *rel, uint32_t seq) {
+    return &rel->slots[seq & (rel->param.window - 1)];
+}
+
+// The window is rounded up to a power of two so that
+// the slot index does not jump when the sequence wraps
+static unsigned reliable_window(const pirate_reliable_param_t *param) {
+    unsigned window = param->window;
+    if (window == 0) {
+        window = PIRATE_DEFAULT_RELIABLE_WINDOW;
+    }
+    if (window > PIRATE_MAX_RELIABLE_WINDOW) {
+        return 0;
+    }
+    if ((window & (window - 1)) != 0) {
+        window = 1u << (32 - __builtin_clz(window));
+    }
+    return window;
+}
+
+// Length of the headers of a data packet. The parity packets
+// also encode the flags and the length of each data packet.
+static size_t reliable_overhead(const pirate_reliable_param_t *param) {
+    return sizeof(pirate_reliable_header_t) +
+        ((param->fec_data > 0) ? PIRATE_RELIABLE_FEC_PREFIX : 0);
+}
+
+int pirate_reliable_parse_param(const char *key, const char *val, pirate_reliable_param_t *param) {
+    if (strncmp("reliable", key, strlen("reliable")) == 0) {
+        if (strcmp("0", val) == 0) {
+            param->mode = PIRATE_RELIABLE_NONE;
+        } else if (strcmp("1", val) == 0) {
+            param->mode = PIRATE_RELIABLE_ARQ;
+        } else if (strcmp("fec", val) == 0) {
+            param->mode = PIRATE_RELIABLE_FEC;
+        } else {
+            errno = EINVAL;
+            return -1;
+        }
+        return 1;
+    } else if (strncmp("window", key, strlen("window")) == 0) {
+        param->window = strtol(val, NULL, 10);
+        return 1;
+    } else if (strncmp("rto_ms", key, strlen("rto_ms")) == 0) {
+        param->rto_ms = strtol(val, NULL, 10);
+        return 1;
+    } else if (strncmp("fec", key, strlen("fec")) == 0) {
+        char *end;
+        param->fec_data = strtoul(val, &end, 10);
+        if (*end == ':') {
+            param->fec_parity = strtoul(end + 1, &end, 10);
+        }
+        if ((*end != 0) || (param->fec_data == 0) || (param->fec_parity == 0) ||
+            (param->fec_data > PIRATE_MAX_RELIABLE_FEC) ||
+            (param->fec_parity > PIRATE_MAX_RELIABLE_FEC)) {
+            errno = EINVAL;
+            return -1;
+        }
+        // parity packets imply the one-way mode
+        if (param->mode == PIRATE_RELIABLE_NONE) {
+            param->mode = PIRATE_RELIABLE_FEC;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+int pirate_reliable_description(const pirate_reliable_param_t *param, char *desc, int len) {
+    char window_str[32];
+    char rto_str[32];
+    char fec_str[32];
+
+    if (param->mode == PIRATE_RELIABLE_NONE) {
+        if (len > 0) {
+            desc[0] = 0;
+        }
+        return 0;
+    }
+    window_str[0] = 0;
+    rto_str[0] = 0;
+    fec_str[0] = 0;
+    if ((param->window != 0) && (param->window != PIRATE_DEFAULT_RELIABLE_WINDOW)) {
+        snprintf(window_str, 32, ",window=%u", param->window);
+    }
+    if ((param->rto_ms != 0) && (param->rto_ms != PIRATE_DEFAULT_RELIABLE_RTO_MS)) {
+        snprintf(rto_str, 32, ",rto_ms=%u", param->rto_ms);
+    }
+    if (param->fec_data > 0) {
+        snprintf(fec_str, 32, ",fec=%u:%u", param->fec_data, param->fec_parity);
+    }
+    return snprintf(desc, len, ",reliable=%s%s%s%s",
+        (param->mode == PIRATE_RELIABLE_FEC) ? "fec" : "1",
+        window_str, rto_str, fec_str);
+}
+
+ssize_t pirate_reliable_write_mtu(const pirate_reliable_param_t *param, size_t mtu) {
+    unsigned window = reliable_window(param);
+    if ((window == 0) || (mtu <= reliable_overhead(param))) {
+        errno = EINVAL;
+        return -1;
+    }
+    return window * (mtu - reliable_overhead(param));
+}
+
+// Sends one packet. Every drop-th packet is discarded
+// when the channel is fuzzed. Called with the lock held.
+static ssize_t reliable_transmit(pirate_reliable_t *rel, void *data, size_t len) {
+    struct iovec iov;
+
+    rel->sent++;
+    if ((rel->drop > 0) && ((rel->sent % rel->drop) == 0)) {
+        return len;
+    }
+    iov.iov_base = data;
+    iov.iov_len = len;
+    return rel->send(rel->arg, NULL, 0, &iov, 1);
+}
+
+// A packet is sent again at most once per retransmission timeout
+// unless the writer is polling the reader. Called with the lock held.
+static void reliable_retransmit(pirate_reliable_t *rel, uint32_t seq, uint64_t now, int poll) {
+    reliable_slot_t *slot = reliable_slot(rel, seq);
+    pirate_reliable_header_t *hdr = (pirate_reliable_header_t *) slot->data;
+    int err;
+
+    if (!poll && (slot->time_ns != 0) && (now - slot->time_ns < rel->rto_ns)) {
+        return;
+    }
+    if (poll) {
+        hdr->flags |= PIRATE_RELIABLE_POLL;
+    }
+    slot->time_ns = now;
+    err = errno;
+    reliable_transmit(rel, slot->data, slot->len);
+    errno = err;
+    __atomic_add_fetch(&rel->retransmits, 1, __ATOMIC_RELAXED);
+}
+
+// The status packet acknowledges every packet before its sequence
+// number and carries a bitmap of the missing packets that follow.
+static void reliable_writer_status(pirate_reliable_t *rel, ssize_t len, uint64_t now) {
+    const pirate_reliable_header_t *hdr = (const pirate_reliable_header_t *) rel->buf;
+    const uint8_t *bitmap = rel->buf + sizeof(pirate_reliable_header_t);
+    uint32_t ack, seq;
+    size_t nbytes;
+
+    if ((len < (ssize_t) sizeof(pirate_reliable_header_t)) ||
+        (hdr->type != PIRATE_RELIABLE_STATUS) ||
+        (ntohl(hdr->session) != rel->session)) {
+        return;
+    }
+    ack = ntohl(hdr->seq);
+    nbytes = MIN(ntohs(hdr->len), len - sizeof(pirate_reliable_header_t));
+    pthread_mutex_lock(&rel->lock);
+    if ((seq_cmp(ack, rel->base) > 0) && (seq_cmp(ack, rel->next) <= 0)) {
+        rel->base = ack;
+        rel->progress_ns = now;
+        pthread_cond_broadcast(&rel->cond);
+    }
+    for (size_t i = 0; i < nbytes * 8; i++) {
+        if ((bitmap[i / 8] & (1 << (i % 8))) == 0) {
+            continue;
+        }
+        seq = ack + i;
+        if ((seq_cmp(seq, rel->base) >= 0) && (seq_cmp(seq, rel->next) < 0)) {
+            reliable_retransmit(rel, seq, now, 0);
+        }
+    }
+    pthread_mutex_unlock(&rel->lock);
+}
+
+// Polls the reader with the newest packet in flight when no packet
+// has been acknowledged for a retransmission timeout. The reader
+// then reports the missing packets at the tail of the window.
+static void reliable_writer_timer(pirate_reliable_t *rel, uint64_t now) {
+    pthread_mutex_lock(&rel->lock);
+    if ((rel->base != rel->next) && (now - rel->progress_ns >= rel->rto_ns)) {
+        reliable_retransmit(rel, rel->next - 1, now, 1);
+        rel->progress_ns = now;
+    }
+    pthread_mutex_unlock(&rel->lock);
+}
+
+static void *reliable_writer_run(void *arg) {
+    pirate_reliable_t *rel = (pirate_reliable_t *) arg;
+    struct pollfd pfd;
+    int timeout = MAX((int) rel->param.rto_ms / 2, 1);
+    ssize_t len;
+    int stop;
+
+    pfd.fd = rel->sock;
+    pfd.events = POLLIN;
+    for (;;) {
+        pthread_mutex_lock(&rel->lock);
+        stop = rel->stop;
+        pthread_mutex_unlock(&rel->lock);
+        if (stop) {
+            break;
+        }
+        if (poll(&pfd, 1, timeout) > 0) {
+            while ((len = rel->recv(rel->arg, rel->buf, rel->mtu, MSG_DONTWAIT, NULL, NULL)) >= 0) {
+                reliable_writer_status(rel, len, reliable_now_ns());
+            }
+        }
+        reliable_writer_timer(rel, reliable_now_ns());
+    }
+    return NULL;
+}
+
+// Adds a data packet to the parity packets of the open
+// block. Called with the lock held.
+static void reliable_fec_encode(pirate_reliable_t *rel, uint32_t seq, const uint8_t *data, size_t len) {
+    const pirate_reliable_header_t *hdr = (const pirate_reliable_header_t *) data;
+    size_t flen = len - sizeof(pirate_reliable_header_t);
+    uint8_t prefix[PIRATE_RELIABLE_FEC_PREFIX];
+    uint8_t *parity;
+    uint8_t coef;
+
+    if (rel->block_count == 0) {
+        rel->block_seq = seq;
+        rel->block_ns = reliable_now_ns();
+    }
+    prefix[0] = hdr->flags;
+    prefix[1] = flen >> 8;
+    prefix[2] = flen & 0xff;
+    for (unsigned row = 0; row < rel->param.fec_parity; row++) {
+        parity = rel->parity + row * rel->mtu + sizeof(pirate_reliable_header_t);
+        coef = pirate_fec_coef(row, rel->block_count);
+        pirate_gf256_mul_add(parity, prefix, coef, PIRATE_RELIABLE_FEC_PREFIX);
+        pirate_gf256_mul_add(parity + PIRATE_RELIABLE_FEC_PREFIX,
+            data + sizeof(pirate_reliable_header_t), coef, flen);
+    }
+    rel->block_len = MAX(rel->block_len, flen);
+    rel->block_count++;
+}
+
+// Sends the parity packets of the open block. The parity
+// is as long as the longest data packet of the block.
+// Called with the lock held.
+static void reliable_fec_flush(pirate_reliable_t *rel) {
+    size_t len = PIRATE_RELIABLE_FEC_PREFIX + rel->block_len;
+    pirate_reliable_header_t *hdr;
+    int err = errno;
+
+    if (rel->block_count == 0) {
+        return;
+    }
+    for (unsigned row = 0; row < rel->param.fec_parity; row++) {
+        hdr = (pirate_reliable_header_t *) (rel->parity + row * rel->mtu);
+        hdr->type = PIRATE_RELIABLE_PARITY;
+        hdr->flags = row;
+        hdr->len = htons(rel->block_count);
+        hdr->session = htonl(rel->session);
+        hdr->seq = htonl(rel->block_seq);
+        reliable_transmit(rel, hdr, sizeof(pirate_reliable_header_t) + len);
+        memset(hdr + 1, 0, len);
+    }
+    errno = err;
+    rel->block_count = 0;
+    rel->block_len = 0;
+}
+
+// Closes the block that has been open for a quarter of the
+// retransmission timeout, so that the reader recovers its
+// packets before it skips the incomplete messages
+static void *reliable_fec_run(void *arg) {
+    pirate_reliable_t *rel = (pirate_reliable_t *) arg;
+    struct timespec deadline;
+    uint64_t now;
+
+    pthread_mutex_lock(&rel->lock);
+    while (!rel->stop) {
+        now = reliable_now_ns();
+        if ((rel->block_count > 0) && (now - rel->block_ns >= rel->flush_ns)) {
+            reliable_fec_flush(rel);
+        }
+        reliable_deadline(&deadline,
+            ((rel->block_count > 0) ? rel->block_ns : now) + rel->flush_ns);
+        pthread_cond_timedwait(&rel->cond, &rel->lock, &deadline);
+    }
+    pthread_mutex_unlock(&rel->lock);
+    return NULL;
+}
+
+static int reliable_writer_start(pirate_reliable_t *rel, void *(*run)(void *)) {
+    sigset_t all, prev;
+    int rv;
+
+    // signals are delivered to the application threads
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &prev);
+    rv = pthread_create(&rel->thread, NULL, run, rel);
+    pthread_sigmask(SIG_SETMASK, &prev, NULL);
+    if (rv != 0) {
+        errno = rv;
+        return -1;
+    }
+    rel->running = 1;
+    return 0;
+}
+
+static void reliable_free(pirate_reliable_t *rel) {
+    pthread_cond_destroy(&rel->cond);
+    pthread_mutex_destroy(&rel->lock);
+    free(rel->slots);
+    free(rel->storage);
+    free(rel->buf);
+    free(rel->parity);
+    free(rel->parity_present);
+    free(rel);
+}
+
+pirate_reliable_t *pirate_reliable_open(const pirate_reliable_param_t *param, int flags,
+    int sock, size_t mtu, pirate_reliable_send_t send, pirate_reliable_recv_t recv,
+    const void *arg, size_t arg_len) {
+    pirate_reliable_t *rel;
+    pthread_condattr_t attr;
+    unsigned window = reliable_window(param);
+    int access = flags & O_ACCMODE;
+    int err;
+
+    if ((window == 0) || (mtu <= reliable_overhead(param))) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((param->fec_data > 0) && ((param->mode != PIRATE_RELIABLE_FEC) ||
+        (param->fec_data > window) || (param->fec_data > PIRATE_MAX_RELIABLE_FEC) ||
+        (param->fec_parity == 0) || (param->fec_parity > PIRATE_MAX_RELIABLE_FEC))) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((rel = calloc(1, sizeof(pirate_reliable_t) + arg_len)) == NULL) {
+        return NULL;
+    }
+    rel->param = *param;
+    rel->param.window = window;
+    if (rel->param.rto_ms == 0) {
+        rel->param.rto_ms = PIRATE_DEFAULT_RELIABLE_RTO_MS;
+    }
+    rel->flags = flags;
+    rel->sock = sock;
+    rel->mtu = mtu;
+    rel->payload = mtu - reliable_overhead(param);
+    rel->rto_ns = rel->param.rto_ms * 1000000ull;
+    rel->flush_ns = MAX(rel->rto_ns / 4, 1000000ull);
+    rel->send = send;
+    rel->recv = recv;
+    memcpy(rel->arg, arg, arg_len);
+    pthread_mutex_init(&rel->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&rel->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    if ((rel->buf = malloc(mtu)) == NULL) {
+        goto error;
+    }
+    // the writer without a reverse channel does not keep its packets
+    if ((access == O_RDONLY) || (param->mode == PIRATE_RELIABLE_ARQ)) {
+        rel->slots = calloc(window, sizeof(reliable_slot_t));
+        rel->storage = malloc(window * mtu);
+        if ((rel->slots == NULL) || (rel->storage == NULL)) {
+            goto error;
+        }
+        for (unsigned i = 0; i < window; i++) {
+            rel->slots[i].data = rel->storage + i * mtu;
+        }
+    }
+    if ((access == O_WRONLY) && (param->fec_data > 0)) {
+        if ((rel->parity = calloc(param->fec_parity, mtu)) == NULL) {
+            goto error;
+        }
+    } else if (param->fec_data > 0) {
+        // followed by the scratch space of the decoder
+        rel->parity = malloc((PIRATE_RELIABLE_FEC_BLOCKS + 1) * param->fec_parity * mtu);
+        rel->parity_present = calloc(PIRATE_RELIABLE_FEC_BLOCKS, param->fec_parity);
+        if ((rel->parity == NULL) || (rel->parity_present == NULL)) {
+            goto error;
+        }
+        for (unsigned i = 0; i < PIRATE_RELIABLE_FEC_BLOCKS; i++) {
+            rel->blocks[i].data = rel->parity + i * param->fec_parity * mtu;
+            rel->blocks[i].present = rel->parity_present + i * param->fec_parity;
+        }
+    }
+    if (getrandom(&rel->session, sizeof(rel->session), GRND_NONBLOCK) != sizeof(rel->session)) {
+        rel->session = reliable_now_ns() ^ getpid();
+    }
+    if ((access == O_WRONLY) && (param->mode == PIRATE_RELIABLE_ARQ) &&
+        (reliable_writer_start(rel, reliable_writer_run) < 0)) {
+        goto error;
+    }
+    if ((access == O_WRONLY) && (param->fec_data > 0) &&
+        (reliable_writer_start(rel, reliable_fec_run) < 0)) {
+        goto error;
+    }
+    return rel;
+error:
+    err = errno;
+    reliable_free(rel);
+    errno = err;
+    return NULL;
+}
+
+// Reports the next packet to be delivered and the
+// packets that are missing after it to the writer
+static void reliable_reader_status(pirate_reliable_t *rel) {
+    pirate_reliable_header_t *hdr = (pirate_reliable_header_t *) rel->buf;
+    uint8_t *bitmap = rel->buf + sizeof(pirate_reliable_header_t);
+    size_t nbits, nbytes;
+    struct iovec iov;
+    int err;
+
+    nbits = MIN((uint32_t) (rel->highest - rel->deliver), rel->param.window);
+    nbits = MIN(nbits, rel->payload * 8);
+    nbytes = (nbits + 7) / 8;
+    memset(bitmap, 0, nbytes);
+    for (size_t i = 0; i < nbits; i++) {
+        if (!reliable_slot(rel, rel->deliver + i)->present) {
+            bitmap[i / 8] |= 1 << (i % 8);
+        }
+    }
+    hdr->type = PIRATE_RELIABLE_STATUS;
+    hdr->flags = 0;
+    hdr->len = htons(nbytes);
+    hdr->session = htonl(rel->session);
+    hdr->seq = htonl(rel->deliver);
+    iov.iov_base = rel->buf;
+    iov.iov_len = sizeof(pirate_reliable_header_t) + nbytes;
+    err = errno;
+    rel->send(rel->arg, (rel->peer_len > 0) ? (struct sockaddr *) &rel->peer : NULL,
+        rel->peer_len, &iov, 1);
+    errno = err;
+    rel->delivered = 0;
+    rel->status_ns = reliable_now_ns();
+}
+
+// Starts the reassembly of a new session. The reader that joins
+// a session in progress starts at the first packet it receives.
+static void reliable_reader_reset(pirate_reliable_t *rel, uint32_t session, uint32_t seq) {
+    for (unsigned i = 0; i < rel->param.window; i++) {
+        rel->slots[i].present = 0;
+    }
+    for (unsigned i = 0; i < PIRATE_RELIABLE_FEC_BLOCKS; i++) {
+        rel->blocks[i].count = 0;
+    }
+    rel->session = session;
+    rel->synced = 1;
+    if ((rel->param.mode == PIRATE_RELIABLE_ARQ) && (seq < rel->param.window)) {
+        rel->deliver = 0;
+    } else {
+        rel->deliver = seq;
+    }
+    rel->highest = rel->deliver;
+    rel->status_ns = 0;
+    rel->delivered = 0;
+}
+
+// Discards the packets before seq. Without a reverse
+// channel the messages that they belong to are lost.
+static void reliable_reader_skip(pirate_reliable_t *rel, uint32_t seq) {
+    while (seq_cmp(rel->deliver, seq) < 0) {
+        reliable_slot(rel, rel->deliver)->present = 0;
+        rel->deliver++;
+    }
+    if (seq_cmp(rel->highest, rel->deliver) < 0) {
+        rel->highest = rel->deliver;
+    }
+    __atomic_add_fetch(&rel->lost, 1, __ATOMIC_RELAXED);
+}
+
+// Skips the incomplete message at rel->deliver
+static void reliable_reader_skip_message(pirate_reliable_t *rel) {
+    uint32_t seq = rel->deliver + 1;
+    reliable_slot_t *slot;
+
+    for (; seq != rel->highest; seq++) {
+        slot = reliable_slot(rel, seq);
+        if (slot->present &&
+            (((pirate_reliable_header_t *) slot->data)->flags & PIRATE_RELIABLE_FIRST)) {
+            break;
+        }
+    }
+    reliable_reader_skip(rel, seq);
+}
+
+// Returns the slot of a data packet that was received. The
+// packets before rel->deliver remain in their slot until the
+// slot is reused and are needed to recover the later packets.
+static reliable_slot_t *reliable_reader_received(pirate_reliable_t *rel, uint32_t seq) {
+    reliable_slot_t *slot = reliable_slot(rel, seq);
+    const pirate_reliable_header_t *hdr = (const pirate_reliable_header_t *) slot->data;
+
+    if (seq_cmp(seq, rel->deliver) >= 0) {
+        return slot->present ? slot : NULL;
+    }
+    if ((slot->len >= sizeof(pirate_reliable_header_t)) &&
+        (hdr->type == PIRATE_RELIABLE_DATA) && (ntohl(hdr->seq) == seq) &&
+        (ntohl(hdr->session) == rel->session)) {
+        return slot;
+    }
+    return NULL;
+}
+
+// Recovers the lost data packets of the block when as many
+// parity packets have been received. The contribution of the
+// data packets that were received is subtracted from the parity
+// packets and the lost packets are decoded into their slots.
+static void reliable_reader_recover(pirate_reliable_t *rel, reliable_block_t *block) {
+    const size_t hdr_len = sizeof(pirate_reliable_header_t);
+    unsigned rows[PIRATE_MAX_RELIABLE_FEC], cols[PIRATE_MAX_RELIABLE_FEC];
+    uint8_t *synd[PIRATE_MAX_RELIABLE_FEC], *out[PIRATE_MAX_RELIABLE_FEC];
+    uint8_t prefix[PIRATE_RELIABLE_FEC_PREFIX];
+    pirate_reliable_header_t *hdr;
+    reliable_slot_t *slot;
+    unsigned i, j, n = 0, pending = 0;
+    uint32_t seq;
+    size_t flen;
+    uint8_t coef;
+    int err;
+
+    for (i = 0; i < block->count; i++) {
+        seq = block->seq + i;
+        if (reliable_reader_received(rel, seq) == NULL) {
+            if (n == PIRATE_MAX_RELIABLE_FEC) {
+                return;
+            }
+            cols[n++] = i;
+            pending += seq_cmp(seq, rel->deliver) >= 0;
+        }
+    }
+    if ((n == 0) || (pending == 0)) {
+        block->count = 0;
+        return;
+    } else if (n > block->received) {
+        return;
+    }
+    for (i = 0, j = 0; j < n; i++) {
+        if (block->present[i]) {
+            rows[j++] = i;
+        }
+    }
+    for (j = 0; j < n; j++) {
+        synd[j] = block->data + rows[j] * rel->mtu;
+        for (i = 0; i < block->count; i++) {
+            if ((slot = reliable_reader_received(rel, block->seq + i)) == NULL) {
+                continue;
+            }
+            flen = slot->len - hdr_len;
+            prefix[0] = ((pirate_reliable_header_t *) slot->data)->flags;
+            prefix[1] = flen >> 8;
+            prefix[2] = flen & 0xff;
+            coef = pirate_fec_coef(rows[j], i);
+            pirate_gf256_mul_add(synd[j], prefix, coef, PIRATE_RELIABLE_FEC_PREFIX);
+            pirate_gf256_mul_add(synd[j] + PIRATE_RELIABLE_FEC_PREFIX, slot->data + hdr_len,
+                coef, MIN(flen, block->len - PIRATE_RELIABLE_FEC_PREFIX));
+        }
+    }
+    // The prefix is decoded in front of the fragment and is then
+    // overwritten by the packet header. The packets that were
+    // lost before rel->deliver are decoded into scratch space.
+    for (j = 0; j < n; j++) {
+        seq = block->seq + cols[j];
+        if (seq_cmp(seq, rel->deliver) >= 0) {
+            out[j] = reliable_slot(rel, seq)->data + hdr_len - PIRATE_RELIABLE_FEC_PREFIX;
+        } else {
+            out[j] = rel->parity +
+                (PIRATE_RELIABLE_FEC_BLOCKS * rel->param.fec_parity + j) * rel->mtu;
+        }
+    }
+    block->count = 0;
+    err = errno;
+    if (pirate_fec_solve(rows, cols, n, synd, out, block->len) < 0) {
+        errno = err;
+        return;
+    }
+    for (j = 0; j < n; j++) {
+        seq = block->seq + cols[j];
+        flen = (out[j][1] << 8) | out[j][2];
+        if ((seq_cmp(seq, rel->deliver) < 0) || (flen > block->len - PIRATE_RELIABLE_FEC_PREFIX)) {
+            continue;
+        }
+        slot = reliable_slot(rel, seq);
+        hdr = (pirate_reliable_header_t *) slot->data;
+        hdr->flags = out[j][0];
+        hdr->type = PIRATE_RELIABLE_DATA;
+        hdr->len = 0;
+        hdr->session = htonl(rel->session);
+        hdr->seq = htonl(seq);
+        slot->len = hdr_len + flen;
+        slot->present = 1;
+        slot->time_ns = reliable_now_ns();
+        if (seq_cmp(seq, rel->highest) >= 0) {
+            rel->highest = seq + 1;
+        }
+        __atomic_add_fetch(&rel->recovered, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Stores a parity packet of a block whose packets have
+// not all been delivered and tries to recover the block
+static void reliable_reader_parity(pirate_reliable_t *rel, ssize_t len) {
+    const pirate_reliable_header_t *hdr = (const pirate_reliable_header_t *) rel->buf;
+    size_t plen = len - sizeof(pirate_reliable_header_t);
+    reliable_block_t *block = NULL, *victim = &rel->blocks[0], *entry;
+    unsigned row = hdr->flags, count = ntohs(hdr->len);
+    uint32_t seq = ntohl(hdr->seq);
+
+    if ((rel->param.fec_data == 0) || !rel->synced || (ntohl(hdr->session) != rel->session) ||
+        (row >= rel->param.fec_parity) || (count == 0) || (count > rel->param.fec_data) ||
+        (plen <= PIRATE_RELIABLE_FEC_PREFIX) || (seq_cmp(seq + count, rel->deliver) <= 0) ||
+        (seq_cmp(seq + count, rel->deliver) > (int32_t) rel->param.window)) {
+        return;
+    }
+    for (unsigned i = 0; i < PIRATE_RELIABLE_FEC_BLOCKS; i++) {
+        entry = &rel->blocks[i];
+        if ((entry->count > 0) && (entry->seq == seq)) {
+            block = entry;
+            break;
+        }
+        // reuse an unused entry or the oldest block
+        if ((victim->count > 0) && ((entry->count == 0) || (entry->time_ns < victim->time_ns))) {
+            victim = entry;
+        }
+    }
+    if (block == NULL) {
+        block = victim;
+        block->seq = seq;
+        block->count = count;
+        block->len = plen;
+        block->received = 0;
+        memset(block->present, 0, rel->param.fec_parity);
+    }
+    if ((block->count != count) || (block->len != plen) || block->present[row]) {
+        return;
+    }
+    memcpy(block->data + row * rel->mtu, rel->buf + sizeof(pirate_reliable_header_t), plen);
+    block->present[row] = 1;
+    block->received++;
+    block->time_ns = reliable_now_ns();
+    reliable_reader_recover(rel, block);
+}
+
+static void reliable_reader_data(pirate_reliable_t *rel, ssize_t len,
+    const struct sockaddr_storage *from, socklen_t fromlen) {
+    const pirate_reliable_header_t *hdr = (const pirate_reliable_header_t *) rel->buf;
+    int arq = rel->param.mode == PIRATE_RELIABLE_ARQ;
+    uint32_t session, seq;
+    reliable_slot_t *slot;
+    uint8_t flags;
+    int gap = 0;
+
+    if (len < (ssize_t) sizeof(pirate_reliable_header_t)) {
+        return;
+    } else if (hdr->type == PIRATE_RELIABLE_PARITY) {
+        reliable_reader_parity(rel, len);
+        return;
+    } else if (hdr->type != PIRATE_RELIABLE_DATA) {
+        return;
+    }
+    session = ntohl(hdr->session);
+    seq = ntohl(hdr->seq);
+    flags = hdr->flags;
+    if (!rel->synced || (session != rel->session)) {
+        reliable_reader_reset(rel, session, seq);
+    }
+    memcpy(&rel->peer, from, fromlen);
+    rel->peer_len = fromlen;
+    rel->arrival_ns = reliable_now_ns();
+    if (seq_cmp(seq, rel->deliver) < 0) {
+        // the status packet was lost
+        if (arq) {
+            reliable_reader_status(rel);
+        }
+        return;
+    }
+    if (seq_cmp(seq, rel->deliver) >= (int32_t) rel->param.window) {
+        if (arq) {
+            return;
+        }
+        reliable_reader_skip(rel, seq - rel->param.window + 1);
+    }
+    slot = reliable_slot(rel, seq);
+    if (!slot->present) {
+        memcpy(slot->data, rel->buf, len);
+        slot->len = len;
+        slot->present = 1;
+        slot->time_ns = rel->arrival_ns;
+        if (seq_cmp(seq, rel->highest) >= 0) {
+            gap = seq_cmp(seq, rel->highest) > 0;
+            rel->highest = seq + 1;
+        }
+    }
+    if (arq && (gap || (flags & PIRATE_RELIABLE_POLL))) {
+        reliable_reader_status(rel);
+    }
+}
+
+// Returns the length of the message at rel->deliver and
+// stores its number of fragments into nfrag. Returns -1
+// if the message is not complete.
+static ssize_t reliable_reader_message(pirate_reliable_t *rel, uint32_t *nfrag) {
+    const pirate_reliable_header_t *hdr;
+    reliable_slot_t *slot;
+    size_t total = 0;
+    uint32_t i;
+
+    for (i = 0; seq_cmp(rel->deliver + i, rel->highest) < 0; i++) {
+        slot = reliable_slot(rel, rel->deliver + i);
+        if (!slot->present) {
+            return -1;
+        }
+        hdr = (const pirate_reliable_header_t *) slot->data;
+        if ((i == 0) && !(hdr->flags & PIRATE_RELIABLE_FIRST)) {
+            // a fragment of a message whose beginning was skipped
+            slot->present = 0;
+            rel->deliver++;
+            i = -1;
+            continue;
+        }
+        if ((i > 0) && (hdr->flags & PIRATE_RELIABLE_FIRST)) {
+            // the end of the message was lost
+            reliable_reader_skip(rel, rel->deliver + i);
+            i = -1;
+            total = 0;
+            continue;
+        }
+        total += slot->len - sizeof(pirate_reliable_header_t);
+        if (hdr->flags & PIRATE_RELIABLE_LAST) {
+            *nfrag = i + 1;
+            return total;
+        }
+    }
+    return -1;
+}
+
+// Receives packets until the message at rel->deliver is complete.
+// Returns the time that the first missing packet was overtaken by
+// a later packet, or the time of the last packet when the message
+// at rel->deliver is waiting for its remaining fragments
+static uint64_t reliable_reader_hole_ns(pirate_reliable_t *rel) {
+    uint32_t seq = rel->deliver;
+
+    while ((seq != rel->highest) && reliable_slot(rel, seq)->present) {
+        seq++;
+    }
+    for (; seq != rel->highest; seq++) {
+        if (reliable_slot(rel, seq)->present) {
+            return reliable_slot(rel, seq)->time_ns;
+        }
+    }
+    return rel->arrival_ns;
+}
+
+// With reliable=1 the missing packets are reported again after each
+// retransmission timeout. With reliable=fec the incomplete message is
+// skipped a retransmission timeout after its missing packet was
+// overtaken, or when no packet has been received for that long.
+static ssize_t reliable_reader_next(pirate_reliable_t *rel, uint32_t *nfrag) {
+    int arq = rel->param.mode == PIRATE_RELIABLE_ARQ;
+    int nonblock = rel->flags & O_NONBLOCK;
+    struct sockaddr_storage from;
+    socklen_t fromlen;
+    struct pollfd pfd;
+    uint64_t now, expires;
+    ssize_t len;
+    int gap, timeout, rv, err = errno;
+
+    pfd.fd = rel->sock;
+    pfd.events = POLLIN;
+    for (;;) {
+        if ((len = reliable_reader_message(rel, nfrag)) >= 0) {
+            return len;
+        }
+        now = reliable_now_ns();
+        gap = rel->deliver != rel->highest;
+        expires = (arq ? rel->status_ns : reliable_reader_hole_ns(rel)) + rel->rto_ns;
+        if (gap && (now >= expires)) {
+            if (!arq) {
+                reliable_reader_skip_message(rel);
+                continue;
+            }
+            reliable_reader_status(rel);
+            expires = rel->status_ns + rel->rto_ns;
+        } else if (arq && !gap && (rel->delivered > 0)) {
+            // acknowledge the delivered messages before waiting
+            reliable_reader_status(rel);
+        }
+        if (!nonblock) {
+            timeout = gap ? (int) ((expires - MIN(now, expires) + 999999) / 1000000) : -1;
+            rv = poll(&pfd, 1, timeout);
+            if (rv < 0) {
+                return -1;
+            } else if (rv == 0) {
+                continue;
+            }
+        }
+        fromlen = sizeof(from);
+        len = rel->recv(rel->arg, rel->buf, rel->mtu, MSG_DONTWAIT,
+            (struct sockaddr *) &from, &fromlen);
+        if (len < 0) {
+            if (nonblock && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+                return -1;
+            }
+            // packets that fail the check of the
+            // channel are recovered as lost packets
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK) ||
+                (errno == EBADMSG) || (errno == ECONNREFUSED)) {
+                errno = err;
+                continue;
+            }
+            return -1;
+        }
+        reliable_reader_data(rel, len, &from, fromlen);
+    }
+}
+
+ssize_t pirate_reliable_read(pirate_reliable_t *rel, void *buf, size_t count) {
+    reliable_slot_t *slot;
+    size_t copied = 0, len;
+    uint32_t nfrag;
+
+    if (reliable_reader_next(rel, &nfrag) < 0) {
+        return -1;
+    }
+    // a message that does not fit is truncated
+    for (uint32_t i = 0; i < nfrag; i++) {
+        slot = reliable_slot(rel, rel->deliver);
+        len = MIN(slot->len - sizeof(pirate_reliable_header_t), count - copied);
+        memcpy((uint8_t *) buf + copied, slot->data + sizeof(pirate_reliable_header_t), len);
+        copied += len;
+        slot->present = 0;
+        rel->deliver++;
+    }
+    rel->delivered += nfrag;
+    if ((rel->param.mode == PIRATE_RELIABLE_ARQ) && (rel->delivered >= rel->param.window / 4)) {
+        reliable_reader_status(rel);
+    }
+    return copied;
+}
+
+ssize_t pirate_reliable_peek_len(pirate_reliable_t *rel) {
+    uint32_t nfrag;
+    return reliable_reader_next(rel, &nfrag);
+}
+
+ssize_t pirate_reliable_writev(pirate_reliable_t *rel, const struct iovec *iov, int iovcnt) {
+    int arq = rel->param.mode == PIRATE_RELIABLE_ARQ;
+    pirate_reliable_header_t *hdr;
+    reliable_slot_t *slot = NULL;
+    size_t end = sizeof(pirate_reliable_header_t) + rel->payload;
+    size_t count = 0, len, n, off = 0;
+    uint32_t nfrag, seq;
+    uint8_t *data;
+    ssize_t rv;
+    int i, j = 0, err;
+
+    if ((iovcnt < 0) || (iovcnt > PIRATE_IOV_MAX)) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        count += iov[i].iov_len;
+    }
+    if (count > rel->param.window * rel->payload) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    nfrag = MAX((count + rel->payload - 1) / rel->payload, 1);
+
+    pthread_mutex_lock(&rel->lock);
+    if (arq) {
+        while ((uint32_t) (rel->next - rel->base) + nfrag > rel->param.window) {
+            if (rel->flags & O_NONBLOCK) {
+                pthread_mutex_unlock(&rel->lock);
+                errno = EAGAIN;
+                return -1;
+            }
+            pthread_cond_wait(&rel->cond, &rel->lock);
+        }
+        if (rel->base == rel->next) {
+            rel->progress_ns = reliable_now_ns();
+        }
+    }
+    for (uint32_t f = 0; f < nfrag; f++) {
+        seq = rel->next++;
+        if (arq) {
+            slot = reliable_slot(rel, seq);
+            data = slot->data;
+        } else {
+            data = rel->buf;
+        }
+        hdr = (pirate_reliable_header_t *) data;
+        hdr->type = PIRATE_RELIABLE_DATA;
+        hdr->flags = ((f == 0) ? PIRATE_RELIABLE_FIRST : 0) |
+            ((f == nfrag - 1) ? PIRATE_RELIABLE_LAST : 0);
+        hdr->len = 0;
+        hdr->session = htonl(rel->session);
+        hdr->seq = htonl(seq);
+        // gather the fragment from the iovecs
+        len = sizeof(pirate_reliable_header_t);
+        while ((len < end) && (j < iovcnt)) {
+            n = MIN(iov[j].iov_len - off, end - len);
+            memcpy(data + len, (const uint8_t *) iov[j].iov_base + off, n);
+            len += n;
+            off += n;
+            if (off == iov[j].iov_len) {
+                j++;
+                off = 0;
+            }
+        }
+        if (arq) {
+            slot->len = len;
+            slot->time_ns = 0;
+        }
+        if (rel->param.fec_data > 0) {
+            reliable_fec_encode(rel, seq, data, len);
+        }
+        err = errno;
+        rv = reliable_transmit(rel, data, len);
+        // packets in the window are sent again when they are lost
+        if ((rv < 0) && !arq && (errno != ECONNREFUSED)) {
+            pthread_mutex_unlock(&rel->lock);
+            return -1;
+        }
+        errno = err;
+        if ((rel->param.fec_data > 0) && (rel->block_count == rel->param.fec_data)) {
+            reliable_fec_flush(rel);
+        }
+    }
+    pthread_mutex_unlock(&rel->lock);
+    return count;
+}
+
+ssize_t pirate_reliable_write_batch(pirate_reliable_t *rel, pirate_mmsg_t *msgs, unsigned vlen) {
+    struct iovec iov;
+    unsigned i;
+
+    vlen = MIN(vlen, PIRATE_IOV_MAX);
+    for (i = 0; i < vlen; i++) {
+        iov.iov_base = msgs[i].buf;
+        iov.iov_len = msgs[i].count;
+        if (pirate_reliable_writev(rel, &iov, 1) < 0) {
+            if (i == 0) {
+                return -1;
+            }
+            break;
+        }
+        msgs[i].len = msgs[i].count;
+    }
+    return i;
+}
+
+// The messages are reassembled one at a time
+ssize_t pirate_reliable_read_batch(pirate_reliable_t *rel, pirate_mmsg_t *msgs, unsigned vlen) {
+    ssize_t rv;
+
+    if (vlen == 0) {
+        return 0;
+    }
+    if ((rv = pirate_reliable_read(rel, msgs[0].buf, msgs[0].count)) < 0) {
+        return -1;
+    }
+    msgs[0].len = rv;
+    return 1;
+}
+
+void pirate_reliable_close(pirate_reliable_t *rel) {
+    struct timespec deadline;
+    int access = rel->flags & O_ACCMODE;
+
+    if (rel->running) {
+        reliable_deadline(&deadline, reliable_now_ns() + PIRATE_RELIABLE_LINGER_MS * 1000000ull);
+        pthread_mutex_lock(&rel->lock);
+        while ((rel->param.mode == PIRATE_RELIABLE_ARQ) && (rel->base != rel->next) &&
+            (pthread_cond_timedwait(&rel->cond, &rel->lock, &deadline) == 0));
+        rel->stop = 1;
+        pthread_cond_broadcast(&rel->cond);
+        pthread_mutex_unlock(&rel->lock);
+        pthread_join(rel->thread, NULL);
+    } else if ((access == O_RDONLY) && (rel->param.mode == PIRATE_RELIABLE_ARQ) &&
+        rel->synced && (rel->delivered > 0)) {
+        reliable_reader_status(rel);
+    }
+    if ((access == O_WRONLY) && (rel->param.fec_data > 0)) {
+        reliable_fec_flush(rel);
+    }
+    reliable_free(rel);
+}
+
+void pirate_reliable_set_drop(pirate_reliable_t *rel, unsigned drop) {
+    pthread_mutex_lock(&rel->lock);
+    rel->drop = drop;
+    pthread_mutex_unlock(&rel->lock);
+}
+
+void pirate_reliable_stats(pirate_reliable_t *rel, uint64_t *retransmits, uint64_t *lost,
+    uint64_t *recovered) {
+    *retransmits = __atomic_load_n(&rel->retransmits, __ATOMIC_RELAXED);
+    *lost = __atomic_load_n(&rel->lost, __ATOMIC_RELAXED);
+    *recovered = __atomic_load_n(&rel->recovered, __ATOMIC_RELAXED);
+}
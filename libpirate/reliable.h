@@ -0,0 +1,121 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#ifndef __PIRATE_RELIABLE_H
+#define __PIRATE_RELIABLE_H
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "libpirate.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Reliable delivery layer of the datagram channels. Each message
+// is split into fragments that carry a header with a sequence
+// number. The reader reassembles the fragments and delivers the
+// messages in order. With reliable=1 the reader reports the
+// packets that are missing and the writer sends them again. With
+// reliable=fec there is no reverse channel and the reader skips
+// the messages that are missing a fragment. With fec=K:M each block
+// of K data packets is followed by M parity packets and the reader
+// recovers up to M lost packets of the block. A block is closed
+// early when the writer is idle.
+
+#pragma pack(1)
+typedef struct {
+    uint8_t type;
+    // the row of a parity packet
+    uint8_t flags;
+    // length of the missing packet bitmap of a status packet,
+    // or the number of data packets in the block of a parity packet
+    uint16_t len;
+    // chosen at random by the writer on each open
+    uint32_t session;
+    // sequence number of a data packet, the next sequence number
+    // to be delivered of a status packet, or the sequence number of
+    // the first data packet in the block of a parity packet
+    uint32_t seq;
+} pirate_reliable_header_t;
+#pragma pack()
+
+#define PIRATE_RELIABLE_DATA        1
+#define PIRATE_RELIABLE_STATUS      2
+#define PIRATE_RELIABLE_PARITY      3
+
+// A parity packet encodes the flags and the length of each
+// data packet followed by its fragment padded with zeros
+#define PIRATE_RELIABLE_FEC_PREFIX  3
+
+#define PIRATE_RELIABLE_FIRST       0x1
+#define PIRATE_RELIABLE_LAST        0x2
+// the writer requests a status packet
+#define PIRATE_RELIABLE_POLL        0x4
+
+typedef struct pirate_reliable pirate_reliable_t;
+
+// Sends one datagram on the underlying channel. to is NULL
+// for the connected peer. Returns the number of bytes sent.
+typedef ssize_t (*pirate_reliable_send_t)(void *arg, const struct sockaddr *to, socklen_t tolen,
+    const struct iovec *iov, int iovcnt);
+
+// Receives one datagram from the underlying channel. The framing
+// of the channel is removed. from may be NULL. Returns the number
+// of bytes copied into buf.
+typedef ssize_t (*pirate_reliable_recv_t)(void *arg, void *buf, size_t count, int flags,
+    struct sockaddr *from, socklen_t *fromlen);
+
+// Returns 1 if the key is an option of the reliable layer and
+// stores its value into param. Returns 0 if the key is unknown.
+// Returns -1 and sets errno on an invalid value.
+int pirate_reliable_parse_param(const char *key, const char *val, pirate_reliable_param_t *param);
+
+// Appends the non-default options of the reliable layer
+int pirate_reliable_description(const pirate_reliable_param_t *param, char *desc, int len);
+
+// Returns the largest message for fragments of mtu bytes
+ssize_t pirate_reliable_write_mtu(const pirate_reliable_param_t *param, size_t mtu);
+
+// Starts the reliable layer on an open socket. mtu is the largest
+// datagram of the underlying channel. The arg_len bytes at arg are
+// copied and the copy is passed to the send and recv functions.
+pirate_reliable_t *pirate_reliable_open(const pirate_reliable_param_t *param, int flags,
+    int sock, size_t mtu, pirate_reliable_send_t send, pirate_reliable_recv_t recv,
+    const void *arg, size_t arg_len);
+
+// Waits for the packets in flight to be acknowledged and
+// releases the layer. The socket is not closed.
+void pirate_reliable_close(pirate_reliable_t *rel);
+
+ssize_t pirate_reliable_read(pirate_reliable_t *rel, void *buf, size_t count);
+ssize_t pirate_reliable_peek_len(pirate_reliable_t *rel);
+ssize_t pirate_reliable_writev(pirate_reliable_t *rel, const struct iovec *iov, int iovcnt);
+ssize_t pirate_reliable_write_batch(pirate_reliable_t *rel, pirate_mmsg_t *msgs, unsigned vlen);
+ssize_t pirate_reliable_read_batch(pirate_reliable_t *rel, pirate_mmsg_t *msgs, unsigned vlen);
+
+// Drops every drop-th datagram that is sent by the layer
+void pirate_reliable_set_drop(pirate_reliable_t *rel, unsigned drop);
+
+void pirate_reliable_stats(pirate_reliable_t *rel, uint64_t *retransmits, uint64_t *lost,
+    uint64_t *recovered);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PIRATE_RELIABLE_H */
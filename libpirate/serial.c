@@ -14,8 +14,10 @@
  */
 
 #include <time.h>
+#include <poll.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,10 +25,33 @@
 #include <stdint.h>
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <sys/ioctl.h>
+#include <pthread.h>
 #include "pirate_common.h"
 #include "serial.h"
 
+#define SLIP_END     0xC0
+#define SLIP_ESC     0xDB
+#define SLIP_ESC_END 0xDC
+#define SLIP_ESC_ESC 0xDD
+
+// The writer thread drains the write queue into the
+// tty. head and tail are free running byte counters.
+struct serial_writer {
+    int fd;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    uint8_t *txq;
+    size_t txq_len;
+    size_t head;
+    size_t tail;
+    unsigned max_tx;
+    int stop;
+    // errno of a failed write on the writer thread
+    int err;
+};
+
 static void pirate_serial_init_param(pirate_serial_param_t *param) {
     if (param->baud == 0) {
         param->baud = PIRATE_SERIAL_DEFAULT_BAUD;
@@ -34,6 +59,30 @@ static void pirate_serial_init_param(pirate_serial_param_t *param) {
     if (param->max_tx == 0) {
         param->max_tx = PIRATE_SERIAL_DEFAULT_MAX_TX;
     }
+    if (param->tx_queue == 0) {
+        param->tx_queue = PIRATE_SERIAL_DEFAULT_TX_QUEUE;
+    }
+}
+
+// The mtu includes the packet header. A framed channel
+// has a bounded frame buffer on the reader.
+static size_t serial_mtu(const pirate_serial_param_t *param) {
+    if ((param->mtu == 0) && (param->framing != PIRATE_SERIAL_FRAMING_NONE)) {
+        return PIRATE_SERIAL_FRAMED_MTU;
+    }
+    return param->mtu;
+}
+
+// Longest encoding of a frame of len bytes
+static size_t serial_frame_encoded_len(const pirate_serial_param_t *param, size_t len) {
+    switch (param->framing) {
+    case PIRATE_SERIAL_FRAMING_COBS:
+        return len + (len / 254) + 2;
+    case PIRATE_SERIAL_FRAMING_SLIP:
+        return (2 * len) + 2;
+    default:
+        return len;
+    }
 }
 
 int pirate_serial_parse_param(char *str, void *_param) {
@@ -86,6 +135,19 @@ int pirate_serial_parse_param(char *str, void *_param) {
             param->mtu = strtol(val, NULL, 10);
         } else if (strncmp("max_tx_size", key, strlen("max_tx_size")) == 0) {
             param->max_tx = strtol(val, NULL, 10);
+        } else if (strncmp("tx_queue", key, strlen("tx_queue")) == 0) {
+            param->tx_queue = strtol(val, NULL, 10);
+        } else if (strncmp("framing", key, strlen("framing")) == 0) {
+            if (strncmp("none", val, strlen("none")) == 0) {
+                param->framing = PIRATE_SERIAL_FRAMING_NONE;
+            } else if (strncmp("cobs", val, strlen("cobs")) == 0) {
+                param->framing = PIRATE_SERIAL_FRAMING_COBS;
+            } else if (strncmp("slip", val, strlen("slip")) == 0) {
+                param->framing = PIRATE_SERIAL_FRAMING_SLIP;
+            } else {
+                errno = EINVAL;
+                return -1;
+            }
         } else {
             errno = EINVAL;
             return -1;
@@ -99,6 +161,8 @@ int pirate_serial_get_channel_description(const void *_param, char *desc, int le
     char baud_str[32];
     char mtu_str[32];
     char max_tx_str[32];
+    char tx_queue_str[32];
+    char framing_str[32];
     const char *baud_val = NULL;
     
     switch (param->baud) {
@@ -117,6 +181,8 @@ int pirate_serial_get_channel_description(const void *_param, char *desc, int le
     baud_str[0] = 0;
     mtu_str[0] = 0;
     max_tx_str[0] = 0;
+    tx_queue_str[0] = 0;
+    framing_str[0] = 0;
     if ((param->baud != 0) && (param->baud != PIRATE_SERIAL_DEFAULT_BAUD)) {
         snprintf(baud_str, 32, ",baud=%s", baud_val);
     }
@@ -126,20 +192,163 @@ int pirate_serial_get_channel_description(const void *_param, char *desc, int le
     if ((param->max_tx != 0) && (param->max_tx != PIRATE_SERIAL_DEFAULT_MAX_TX)) {
         snprintf(max_tx_str, 32, ",max_tx_size=%u", param->max_tx);
     }
-    return snprintf(desc, len, "serial,%s%s%s%s", param->path, baud_str, mtu_str, max_tx_str);
+    if ((param->tx_queue != 0) && (param->tx_queue != PIRATE_SERIAL_DEFAULT_TX_QUEUE)) {
+        snprintf(tx_queue_str, 32, ",tx_queue=%u", param->tx_queue);
+    }
+    switch (param->framing) {
+    case PIRATE_SERIAL_FRAMING_NONE:
+        break;
+    case PIRATE_SERIAL_FRAMING_COBS:
+        snprintf(framing_str, 32, ",framing=cobs");
+        break;
+    case PIRATE_SERIAL_FRAMING_SLIP:
+        snprintf(framing_str, 32, ",framing=slip");
+        break;
+    default:
+        return -1;
+    }
+    return snprintf(desc, len, "serial,%s%s%s%s%s%s", param->path, baud_str, mtu_str,
+        max_tx_str, tx_queue_str, framing_str);
+}
+
+// Keeps the tty output queue full with nonblocking writes.
+// The thread waits in poll() while the output queue is full.
+static void *serial_writer_run(void *arg) {
+    serial_writer_t *writer = (serial_writer_t *)arg;
+
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        size_t off, len;
+        ssize_t rv;
+
+        while ((writer->head == writer->tail) && !writer->stop) {
+            pthread_cond_wait(&writer->not_empty, &writer->lock);
+        }
+        if (writer->head == writer->tail) {
+            break;
+        }
+        off = writer->tail % writer->txq_len;
+        len = MIN(writer->head - writer->tail, writer->txq_len - off);
+        len = MIN(len, writer->max_tx);
+        pthread_mutex_unlock(&writer->lock);
+
+        rv = write(writer->fd, writer->txq + off, len);
+        if ((rv < 0) && (errno == EAGAIN)) {
+            struct pollfd pfd = { .fd = writer->fd, .events = POLLOUT, .revents = 0 };
+            poll(&pfd, 1, -1);
+            rv = 0;
+        } else if ((rv < 0) && (errno == EINTR)) {
+            rv = 0;
+        }
+
+        pthread_mutex_lock(&writer->lock);
+        if (rv < 0) {
+            // the queued packets are dropped and
+            // the next write returns the error
+            writer->err = errno;
+            writer->tail = writer->head;
+        } else {
+            writer->tail += rv;
+        }
+        pthread_cond_broadcast(&writer->not_full);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+static int serial_writer_start(const pirate_serial_param_t *param, serial_ctx *ctx) {
+    serial_writer_t *writer;
+    sigset_t all, prev;
+    size_t mtu = serial_mtu(param);
+    int rv;
+
+    if ((param->framing != PIRATE_SERIAL_FRAMING_NONE) &&
+        ((ctx->tx_frame = malloc(serial_frame_encoded_len(param, mtu))) == NULL)) {
+        return -1;
+    }
+    if ((writer = calloc(1, sizeof(serial_writer_t))) == NULL) {
+        return -1;
+    }
+    writer->fd = ctx->fd;
+    writer->txq_len = param->tx_queue;
+    writer->max_tx = param->max_tx;
+    if ((writer->txq = malloc(writer->txq_len)) == NULL) {
+        free(writer);
+        return -1;
+    }
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->not_empty, NULL);
+    pthread_cond_init(&writer->not_full, NULL);
+    // signals are delivered to the application threads
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &prev);
+    rv = pthread_create(&writer->thread, NULL, serial_writer_run, writer);
+    pthread_sigmask(SIG_SETMASK, &prev, NULL);
+    if (rv != 0) {
+        pthread_cond_destroy(&writer->not_full);
+        pthread_cond_destroy(&writer->not_empty);
+        pthread_mutex_destroy(&writer->lock);
+        free(writer->txq);
+        free(writer);
+        errno = rv;
+        return -1;
+    }
+    ctx->writer = writer;
+    return 0;
+}
+
+// Waits for the queue to drain and for the tty to transmit
+// the contents of its output queue. Returns the errno status
+// of a failed write.
+static int serial_writer_stop(serial_writer_t *writer) {
+    int err;
+
+    pthread_mutex_lock(&writer->lock);
+    writer->stop = 1;
+    pthread_cond_signal(&writer->not_empty);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+    err = writer->err;
+    if ((err == 0) && (tcdrain(writer->fd) != 0)) {
+        err = errno;
+    }
+    pthread_cond_destroy(&writer->not_full);
+    pthread_cond_destroy(&writer->not_empty);
+    pthread_mutex_destroy(&writer->lock);
+    free(writer->txq);
+    free(writer);
+    return err;
+}
+
+static void serial_release(serial_ctx *ctx) {
+    free(ctx->tx_frame);
+    free(ctx->rx_buf);
+    free(ctx->frame);
+    ctx->tx_frame = NULL;
+    ctx->rx_buf = NULL;
+    ctx->frame = NULL;
 }
 
 int pirate_serial_open(void *_param, void *_ctx) {
     pirate_serial_param_t *param = (pirate_serial_param_t *)_param;
     serial_ctx *ctx = (serial_ctx *)_ctx;
     struct termios attr;
+    int access = ctx->flags & O_ACCMODE;
+    int flags = ctx->flags | O_NOCTTY;
 
     pirate_serial_init_param(param);
     if (strnlen(param->path, 1) == 0) {
         errno = EINVAL;
         return -1;
     }
-    ctx->fd = open(param->path, ctx->flags | O_NOCTTY);
+    if ((param->mtu != 0) && (param->mtu < sizeof(pirate_header_t))) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (access == O_WRONLY) {
+        flags |= O_NONBLOCK;
+    }
+    ctx->fd = open(param->path, flags);
     if (ctx->fd < 0) {
         return -1;
     }
@@ -159,20 +368,50 @@ int pirate_serial_open(void *_param, void *_ctx) {
         return -1;
     }
 
+    if (access == O_WRONLY) {
+        if (serial_writer_start(param, ctx) < 0) {
+            serial_release(ctx);
+            return -1;
+        }
+    } else if (param->framing != PIRATE_SERIAL_FRAMING_NONE) {
+        ctx->frame_max = serial_mtu(param);
+        ctx->rx_buf = malloc(PIRATE_DISCARD_LEN);
+        ctx->frame = malloc(ctx->frame_max);
+        if ((ctx->rx_buf == NULL) || (ctx->frame == NULL)) {
+            serial_release(ctx);
+            return -1;
+        }
+        ctx->rx_pos = ctx->rx_len = 0;
+        ctx->frame_len = 0;
+        ctx->frame_bad = 0;
+        ctx->cobs_left = 0;
+        ctx->cobs_zero = 0;
+        ctx->slip_esc = 0;
+    }
+
     return ctx->fd;
 }
 
 int pirate_serial_close(void *_ctx) {
     serial_ctx *ctx = (serial_ctx *)_ctx;
-    int rv = -1;
+    int rv = -1, err = 0;
 
     if (ctx->fd <= 0) {
         errno = ENODEV;
         return -1;
     }
 
+    if (ctx->writer != NULL) {
+        err = serial_writer_stop(ctx->writer);
+        ctx->writer = NULL;
+    }
+    serial_release(ctx);
     rv = close(ctx->fd);
     ctx->fd = -1;
+    if ((rv == 0) && (err != 0)) {
+        errno = err;
+        rv = -1;
+    }
     return rv;
 }
 
@@ -191,73 +430,251 @@ static ssize_t serial_do_read(serial_ctx *ctx, uint8_t *buf, size_t count) {
     return rx;
 }
 
-static ssize_t serial_do_write(const pirate_serial_param_t *param, serial_ctx *ctx, const void *buf, size_t count) {
+// Copies the bytes into the write queue. Blocks
+// while the queue is full.
+static ssize_t serial_do_write(serial_writer_t *writer, const void *buf, size_t count) {
     const uint8_t *wr_buf = (const uint8_t *) buf;
     size_t remain = count;
-    do {
-        int rv;
-        uint32_t tx_buf_bytes = 0;
-        size_t wr_len = MIN(remain, param->max_tx);
-        rv = write(ctx->fd, wr_buf, wr_len);
-        if (rv < 0) {
+
+    pthread_mutex_lock(&writer->lock);
+    while (remain > 0) {
+        size_t off, len;
+
+        while ((writer->err == 0) && (writer->head - writer->tail == writer->txq_len)) {
+            pthread_cond_wait(&writer->not_full, &writer->lock);
+        }
+        if (writer->err != 0) {
+            pthread_mutex_unlock(&writer->lock);
+            errno = writer->err;
             return -1;
         }
+        off = writer->head % writer->txq_len;
+        len = MIN(remain, writer->txq_len - (writer->head - writer->tail));
+        len = MIN(len, writer->txq_len - off);
+        // the writer thread does not access the free space of the queue
+        pthread_mutex_unlock(&writer->lock);
+        memcpy(writer->txq + off, wr_buf, len);
+        pthread_mutex_lock(&writer->lock);
+        writer->head += len;
+        pthread_cond_signal(&writer->not_empty);
+        remain -= len;
+        wr_buf += len;
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return count;
+}
+
+// COBS replaces each zero byte with the distance to the
+// next zero byte. A zero byte delimits the frames.
+static size_t serial_cobs_put(uint8_t *out, size_t len, size_t *code_pos, const uint8_t *buf, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (buf[i] != 0) {
+            out[len++] = buf[i];
+        }
+        if ((buf[i] == 0) || (len - *code_pos == 0xFF)) {
+            out[*code_pos] = len - *code_pos;
+            *code_pos = len++;
+        }
+    }
+    return len;
+}
 
-        do {
-            if (ioctl(ctx->fd, TIOCOUTQ, &tx_buf_bytes)) {
-                return -1;
-            }
+static size_t serial_slip_put(uint8_t *out, size_t len, const uint8_t *buf, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        switch (buf[i]) {
+        case SLIP_END:
+            out[len++] = SLIP_ESC;
+            out[len++] = SLIP_ESC_END;
+            break;
+        case SLIP_ESC:
+            out[len++] = SLIP_ESC;
+            out[len++] = SLIP_ESC_ESC;
+            break;
+        default:
+            out[len++] = buf[i];
+        }
+    }
+    return len;
+}
+
+static size_t serial_frame_encode(const pirate_serial_param_t *param, uint8_t *out,
+    const pirate_header_t *header, const void *buf, size_t count) {
+    size_t len, code_pos = 0;
+
+    switch (param->framing) {
+    case PIRATE_SERIAL_FRAMING_COBS:
+        len = serial_cobs_put(out, 1, &code_pos, (const uint8_t*) header, sizeof(pirate_header_t));
+        len = serial_cobs_put(out, len, &code_pos, (const uint8_t*) buf, count);
+        out[code_pos] = len - code_pos;
+        out[len++] = 0;
+        return len;
+    case PIRATE_SERIAL_FRAMING_SLIP:
+        // the leading delimiter flushes any line noise
+        out[0] = SLIP_END;
+        len = serial_slip_put(out, 1, (const uint8_t*) header, sizeof(pirate_header_t));
+        len = serial_slip_put(out, len, (const uint8_t*) buf, count);
+        out[len++] = SLIP_END;
+        return len;
+    default:
+        return 0;
+    }
+}
 
-            if (tx_buf_bytes) {
-                const struct timespec one_ms = {
-                    .tv_sec = 0,
-                    .tv_nsec = 1000000
-                };
-                nanosleep(&one_ms, NULL);
+static void serial_frame_append(serial_ctx *ctx, uint8_t c) {
+    if (ctx->frame_len < ctx->frame_max) {
+        ctx->frame[ctx->frame_len++] = c;
+    } else {
+        ctx->frame_bad = 1;
+    }
+}
+
+// Decodes one byte from the tty. Returns 1 at the end of a frame.
+static int serial_frame_decode(const pirate_serial_param_t *param, serial_ctx *ctx, uint8_t c) {
+    if (param->framing == PIRATE_SERIAL_FRAMING_COBS) {
+        if (c == 0) {
+            if (ctx->cobs_left != 0) {
+                ctx->frame_bad = 1;
             }
+            ctx->cobs_left = 0;
+            ctx->cobs_zero = 0;
+            return 1;
+        }
+        if (ctx->cobs_left > 0) {
+            serial_frame_append(ctx, c);
+            ctx->cobs_left--;
+            return 0;
+        }
+        // the zero at the end of the previous
+        // block is implied by a following block
+        if (ctx->cobs_zero) {
+            serial_frame_append(ctx, 0);
+        }
+        ctx->cobs_zero = (c < 0xFF);
+        ctx->cobs_left = c - 1;
+        return 0;
+    }
+    if (c == SLIP_END) {
+        if (ctx->slip_esc) {
+            ctx->frame_bad = 1;
+        }
+        ctx->slip_esc = 0;
+        return 1;
+    }
+    if (ctx->slip_esc) {
+        ctx->slip_esc = 0;
+        if (c == SLIP_ESC_END) {
+            c = SLIP_END;
+        } else if (c == SLIP_ESC_ESC) {
+            c = SLIP_ESC;
+        } else {
+            ctx->frame_bad = 1;
+            return 0;
+        }
+    } else if (c == SLIP_ESC) {
+        ctx->slip_esc = 1;
+        return 0;
+    }
+    serial_frame_append(ctx, c);
+    return 0;
+}
 
-        } while(tx_buf_bytes > 0);
+// Reads frames until a frame decodes to a packet header followed
+// by the number of bytes in the header. Damaged frames are discarded.
+static ssize_t serial_frame_read(const pirate_serial_param_t *param, serial_ctx *ctx) {
+    pirate_header_t header;
 
-        remain -= rv;
-        wr_buf += rv;
-    } while(remain > 0);
+    for (;;) {
+        size_t len;
+        int bad;
 
-    return count;
+        if (ctx->rx_pos == ctx->rx_len) {
+            ssize_t rv = read(ctx->fd, ctx->rx_buf, PIRATE_DISCARD_LEN);
+            if (rv < 0) {
+                return rv;
+            }
+            ctx->rx_pos = 0;
+            ctx->rx_len = rv;
+            continue;
+        }
+        if (!serial_frame_decode(param, ctx, ctx->rx_buf[ctx->rx_pos++])) {
+            continue;
+        }
+        len = ctx->frame_len;
+        bad = ctx->frame_bad;
+        ctx->frame_len = 0;
+        ctx->frame_bad = 0;
+        if (bad || (len < sizeof(header))) {
+            continue;
+        }
+        memcpy(&header, ctx->frame, sizeof(header));
+        if (ntohl(header.count) != len - sizeof(header)) {
+            continue;
+        }
+        return len - sizeof(header);
+    }
 }
 
 ssize_t pirate_serial_read(const void *_param, void *_ctx, void *buf, size_t count) {
+    const pirate_serial_param_t *param = (const pirate_serial_param_t *)_param;
     serial_ctx *ctx = (serial_ctx *)_ctx;
-    (void) _param;
-    pirate_header_t header;
+    uint8_t scratch[PIRATE_DISCARD_LEN];
     ssize_t rv;
-    size_t packet_count;
+    size_t packet_count, remain;
 
-    rv = serial_do_read(ctx, (uint8_t*) &header, sizeof(header));
-    if (rv < 0) {
+    if ((rv = pirate_serial_peek_len(_param, _ctx)) < 0) {
         return rv;
     }
-    packet_count = ntohl(header.count);
+    ctx->peeked = 0;
+    packet_count = rv;
     count = MIN(count, packet_count);
+    if (param->framing != PIRATE_SERIAL_FRAMING_NONE) {
+        memcpy(buf, ctx->frame + sizeof(pirate_header_t), count);
+        return count;
+    }
     rv = serial_do_read(ctx, buf, count);
     if (rv < 0) {
         return rv;
     }
-    if (count < packet_count) {
-        // slow path
-        uint8_t *temp = malloc(packet_count - count);
-        rv = serial_do_read(ctx, temp, packet_count - count);
-        free(temp);
+    remain = packet_count - count;
+    while (remain > 0) {
+        rv = serial_do_read(ctx, scratch, MIN(remain, sizeof(scratch)));
         if (rv < 0) {
             return rv;
         }
+        remain -= rv;
     }
     return count;
 }
 
+ssize_t pirate_serial_peek_len(const void *_param, void *_ctx) {
+    const pirate_serial_param_t *param = (const pirate_serial_param_t *)_param;
+    serial_ctx *ctx = (serial_ctx *)_ctx;
+    pirate_header_t header;
+    ssize_t rv;
+
+    if (!ctx->peeked) {
+        if (param->framing != PIRATE_SERIAL_FRAMING_NONE) {
+            rv = serial_frame_read(param, ctx);
+            if (rv < 0) {
+                return rv;
+            }
+            ctx->peeked_count = rv;
+        } else {
+            rv = serial_do_read(ctx, (uint8_t*) &header, sizeof(header));
+            if (rv < 0) {
+                return rv;
+            }
+            ctx->peeked_count = ntohl(header.count);
+        }
+        ctx->peeked = 1;
+    }
+    return ctx->peeked_count;
+}
+
 ssize_t pirate_serial_write_mtu(const void *_param, void *_ctx) {
     (void) _ctx;
     const pirate_serial_param_t *param = (const pirate_serial_param_t *)_param;
-    size_t mtu = param->mtu;
+    size_t mtu = serial_mtu(param);
     if (mtu == 0) {
         return 0;
     }
@@ -281,11 +698,19 @@ ssize_t pirate_serial_write(const void *_param, void *_ctx, const void *buf, siz
         return -1;
     }
 
-    rv = serial_do_write(param, ctx, &header, sizeof(header));
+    if (param->framing != PIRATE_SERIAL_FRAMING_NONE) {
+        size_t len = serial_frame_encode(param, ctx->tx_frame, &header, buf, count);
+        rv = serial_do_write(ctx->writer, ctx->tx_frame, len);
+        if (rv < 0) {
+            return rv;
+        }
+        return count;
+    }
+    rv = serial_do_write(ctx->writer, &header, sizeof(header));
     if (rv < 0) {
         return rv;
     }
-    rv = serial_do_write(param, ctx, buf, count);
+    rv = serial_do_write(ctx->writer, buf, count);
     if (rv < 0) {
         return rv;
     }
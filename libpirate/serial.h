@@ -18,9 +18,33 @@
 
 #include "libpirate.h"
 
+// Write queue and writer thread. The queue is allocated
+// separately because the context is copied after open.
+typedef struct serial_writer serial_writer_t;
+
 typedef struct {
     int flags;
     int fd;
+    // header of the next packet that was
+    // read by pirate_peek_len()
+    uint32_t peeked_count;
+    int peeked;
+    serial_writer_t *writer;
+    // encoded frame of the packet being written
+    uint8_t *tx_frame;
+    // bytes read from the tty and not yet decoded
+    uint8_t *rx_buf;
+    size_t rx_pos;
+    size_t rx_len;
+    // decoded frame of the packet being read
+    uint8_t *frame;
+    size_t frame_len;
+    size_t frame_max;
+    int frame_bad;
+    // decoder state of the framing
+    unsigned cobs_left;
+    int cobs_zero;
+    int slip_esc;
 } serial_ctx;
 
 int pirate_serial_parse_param(char *str, void *_param);
@@ -30,7 +54,8 @@ int pirate_serial_close(void *_ctx);
 ssize_t pirate_serial_read(const void *_param, void *_ctx, void *buf, size_t count);
 ssize_t pirate_serial_write(const void *_param, void *_ctx, const void *buf, size_t count);
 ssize_t pirate_serial_write_mtu(const void *_param, void *_ctx);
+ssize_t pirate_serial_peek_len(const void *_param, void *_ctx);
 
-#define PIRATE_SERIAL_CHANNEL_FUNCS { pirate_serial_parse_param, pirate_serial_get_channel_description, pirate_serial_open, pirate_serial_close, pirate_serial_read, pirate_serial_write, pirate_serial_write_mtu }
+#define PIRATE_SERIAL_CHANNEL_FUNCS { pirate_serial_parse_param, pirate_serial_get_channel_description, pirate_serial_open, pirate_serial_close, pirate_serial_read, pirate_serial_write, pirate_serial_write_mtu, NULL, NULL, NULL, NULL, NULL, NULL, NULL, pirate_serial_peek_len }
 
 #endif /* __PIRATE_CHANNEL_SERIAL_H */
@@ -13,6 +13,7 @@
  * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
  */
 
+#define _GNU_SOURCE
 #include <signal.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -20,68 +21,28 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include "pirate_common.h"
 #include "shmem_interface.h"
 
 #include <stdio.h>
 
-#define SPIN_ITERATIONS 100000
-
-// TODO: replace reader and writer with BipBuffer
-// https://ferrous-systems.com/blog/lock-free-ring-buffer/
-// use 20 bits for reader, 20 bits for writer, 20 bits for watermark
-// use remaining 4 bits for status
-// use status bits to indicate whether empty or full
-
-static inline uint8_t get_status(uint64_t value) {
-    return (value & 0xff00000000000000) >> 56;
-}
-
-static inline uint32_t get_write(uint64_t value) {
-    return (value & 0x00fffffff0000000) >> 28;
-}
-
-static inline uint32_t get_read(uint64_t value) {
-    return (value & 0x000000000fffffff);
-}
-  
-static inline uint64_t create_position(uint32_t write, uint32_t read,
-                                       int bufsize, int writer) {
-    uint8_t status = 1;
-
-    if (writer) {
-        if (((write - read + bufsize) % bufsize) <= sizeof(pirate_header_t)) {
-            status = 2;
-        }
-    } else {
-        if (read == write) {
-            status = 0;
-        }
-    }
-    return (((uint64_t)status) << 56) | (((uint64_t)write) << 28) | read;
-}
-
-static inline int is_empty(uint64_t value) {
-    return get_status(value) == 0;
-}
-
-static inline int is_full(uint64_t value) {
-    return get_status(value) == 2;
-}
+// Seals of a region created by pirate_shmem_create(). The size
+// of the region cannot change while it is mapped.
+#define SHMEM_BUFFER_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
 
 static inline unsigned char* shared_buffer(shmem_buffer_t *shmem_buffer) {
     return (unsigned char*)(shmem_buffer + 1);
 }
 
-static shmem_buffer_t *shmem_buffer_init(int fd, int buffer_size) {
+static shmem_buffer_t *shmem_buffer_init(int fd, size_t buffer_size, size_t alloc_size,
+                                         const pirate_shmem_mem_t *mem) {
     int err, rv;
     int success = 0;
     shmem_buffer_t *shmem_buffer = NULL;
-    pthread_mutexattr_t mutex_attr;
-    pthread_condattr_t cond_attr;
 
-    const size_t alloc_size = sizeof(shmem_buffer_t) + buffer_size;
     if ((rv = ftruncate(fd, alloc_size)) != 0) {
         err = errno;
         close(fd);
@@ -89,19 +50,11 @@ static shmem_buffer_t *shmem_buffer_init(int fd, int buffer_size) {
         return NULL;
     }
 
-    shmem_buffer = (shmem_buffer_t *)mmap(NULL, alloc_size,
-        PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-
+    shmem_buffer = (shmem_buffer_t *)shmem_buffer_mem_map(fd, alloc_size, mem);
     if (shmem_buffer == MAP_FAILED) {
-        err = errno;
-        close(fd);
-        errno = err;
         return NULL;
     }
 
-    close(fd);
-    fd = -1;
-
     while (!success) {
         uint64_t init = atomic_load(&shmem_buffer->init);
         switch (init) {
@@ -135,44 +88,6 @@ static shmem_buffer_t *shmem_buffer_init(int fd, int buffer_size) {
         goto error;
     }
 
-    if ((rv = pthread_mutexattr_init(&mutex_attr)) != 0) {
-        errno = rv;
-        goto error;
-    }
-
-    if ((rv = pthread_mutexattr_setpshared(&mutex_attr,
-                                         PTHREAD_PROCESS_SHARED)) != 0) {
-        errno = rv;
-        goto error;
-    }
-
-    if ((rv = pthread_mutex_init(&shmem_buffer->mutex, &mutex_attr)) != 0) {
-        errno = rv;
-        goto error;
-    }
-
-    if ((rv = pthread_condattr_init(&cond_attr)) != 0) {
-        errno = rv;
-        goto error;
-    }
-
-    if ((rv = pthread_condattr_setpshared(&cond_attr,
-                                        PTHREAD_PROCESS_SHARED)) != 0) {
-        errno = rv;
-        goto error;
-    }
-
-    if ((rv = pthread_cond_init(&shmem_buffer->is_not_empty,
-                                        &cond_attr)) != 0) {
-        errno = rv;
-        goto error;
-    }
-
-    if ((rv = pthread_cond_init(&shmem_buffer->is_not_full, &cond_attr)) != 0) {
-        errno = rv;
-        goto error;
-    }
-
     atomic_store(&shmem_buffer->init, 2);
     return shmem_buffer;
 error:
@@ -190,6 +105,9 @@ static void shmem_buffer_init_param(pirate_shmem_param_t *param) {
     if (param->max_tx == 0) {
         param->max_tx = PIRATE_DEFAULT_SMEM_MAX_TX;
     }
+    if (param->spin_ns == 0) {
+        param->spin_ns = PIRATE_DEFAULT_SMEM_SPIN_NS;
+    }
 }
 
 int shmem_buffer_parse_param(char *str, void *_param) {
@@ -215,10 +133,24 @@ int shmem_buffer_parse_param(char *str, void *_param) {
         } else if (rv == 0) {
             continue;
         }
+        rv = shmem_buffer_parse_mem(key, val, &param->mem);
+        if (rv < 0) {
+            return rv;
+        } else if (rv > 0) {
+            continue;
+        }
         if (strncmp("buffer_size", key, strlen("buffer_size")) == 0) {
             param->buffer_size = strtol(val, NULL, 10);
         } else if (strncmp("max_tx_size", key, strlen("max_tx_size")) == 0) {
             param->max_tx = strtol(val, NULL, 10);
+        } else if (strncmp("wait", key, strlen("wait")) == 0) {
+            if (shmem_buffer_parse_wait(val, &param->wait) < 0) {
+                return -1;
+            }
+        } else if (strncmp("spin_ns", key, strlen("spin_ns")) == 0) {
+            param->spin_ns = strtol(val, NULL, 10);
+        } else if (strncmp("fd", key, strlen("fd")) == 0) {
+            param->fd = strtol(val, NULL, 10);
         } else {
             errno = EINVAL;
             return -1;
@@ -231,17 +163,146 @@ int shmem_buffer_get_channel_description(const void *_param, char *desc, int len
     const pirate_shmem_param_t *param = (const pirate_shmem_param_t *)_param;
     char max_tx_str[32];
     char buffer_size_str[32];
+    char wait_str[32];
+    char spin_ns_str[32];
+    char mem_str[96];
+    char fd_str[32];
 
     max_tx_str[0] = 0;
     buffer_size_str[0] = 0;
+    wait_str[0] = 0;
+    spin_ns_str[0] = 0;
+    fd_str[0] = 0;
     if ((param->max_tx != 0) && (param->max_tx != PIRATE_DEFAULT_SMEM_MAX_TX)) {
         snprintf(max_tx_str, 32, ",max_tx_size=%u", param->max_tx);
     }
     if ((param->buffer_size != 0) && (param->buffer_size != PIRATE_DEFAULT_SMEM_BUF_LEN)) {
         snprintf(buffer_size_str, 32, ",buffer_size=%u", param->buffer_size);
     }
+    if ((param->wait != PIRATE_WAIT_ADAPTIVE) && (shmem_buffer_wait_name(param->wait) != NULL)) {
+        snprintf(wait_str, 32, ",wait=%s", shmem_buffer_wait_name(param->wait));
+    }
+    if ((param->spin_ns != 0) && (param->spin_ns != PIRATE_DEFAULT_SMEM_SPIN_NS)) {
+        snprintf(spin_ns_str, 32, ",spin_ns=%u", param->spin_ns);
+    }
+    if (param->fd > 0) {
+        snprintf(fd_str, 32, ",fd=%d", param->fd);
+    }
+    shmem_buffer_mem_description(&param->mem, mem_str, sizeof(mem_str));
+
+    return snprintf(desc, len, "shmem,%s%s%s%s%s%s%s", param->path, buffer_size_str, max_tx_str,
+        wait_str, spin_ns_str, mem_str, fd_str);
+}
 
-    return snprintf(desc, len, "shmem,%s%s%s", param->path, buffer_size_str, max_tx_str);
+int shmem_buffer_create(void *_param) {
+    pirate_shmem_param_t *param = (pirate_shmem_param_t *)_param;
+    pirate_shmem_mem_t mem = param->mem;
+    shmem_buffer_t *buf;
+    size_t alloc_size;
+    int err, fd, map_fd;
+
+    shmem_buffer_init_param(param);
+    alloc_size = shmem_buffer_mem_size(sizeof(shmem_buffer_t) + param->buffer_size, &param->mem);
+    if ((fd = shmem_buffer_mem_create(&param->mem)) < 0) {
+        return -1;
+    }
+    if (ftruncate(fd, alloc_size) != 0) {
+        goto error;
+    }
+    // only the first page is touched here, the reader
+    // and the writer prefault and lock their own mappings
+    mem.prefault = 0;
+    mem.mlock = 0;
+    if ((map_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0)) < 0) {
+        goto error;
+    }
+    buf = (shmem_buffer_t *)shmem_buffer_mem_map(map_fd, alloc_size, &mem);
+    if (buf == MAP_FAILED) {
+        goto error;
+    }
+    buf->size = param->buffer_size;
+    atomic_store(&buf->reader_pid, SHMEM_BUFFER_PID_RESERVED);
+    atomic_store(&buf->writer_pid, SHMEM_BUFFER_PID_RESERVED);
+    atomic_store(&buf->init, 2);
+    munmap(buf, alloc_size);
+    if (fcntl(fd, F_ADD_SEALS, SHMEM_BUFFER_SEALS) != 0) {
+        goto error;
+    }
+    return fd;
+error:
+    err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+}
+
+// Returns 1 if the side of the channel that stored pid has
+// neither closed the channel nor exited.
+static int shmem_buffer_pid_alive(uint64_t pid) {
+    int err = errno;
+    int alive;
+
+    if ((pid == 0) || (pid == SHMEM_BUFFER_PID_RESERVED)) {
+        return 0;
+    }
+    alive = (kill((pid_t) pid, 0) == 0) || (errno != ESRCH);
+    errno = err;
+    return alive;
+}
+
+// Opens a region created by pirate_shmem_create(). The side is
+// reserved for this process or was left by a process that closed
+// the channel or exited, so there is no wait for the other side.
+static int shmem_buffer_open_fd(pirate_shmem_param_t *param, shmem_ctx *ctx, int access) {
+    pirate_atomic_uint64 *pid;
+    shmem_buffer_t *buf;
+    struct stat st;
+    uint64_t cur;
+    int fd, seals;
+
+    if ((seals = fcntl(param->fd, F_GET_SEALS)) < 0) {
+        return -1;
+    }
+    if ((seals & SHMEM_BUFFER_SEALS) != SHMEM_BUFFER_SEALS) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (fstat(param->fd, &st) != 0) {
+        return -1;
+    }
+    if ((size_t) st.st_size <= sizeof(shmem_buffer_t)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((fd = fcntl(param->fd, F_DUPFD_CLOEXEC, 0)) < 0) {
+        return -1;
+    }
+    buf = (shmem_buffer_t *)shmem_buffer_mem_map(fd, st.st_size, &param->mem);
+    if (buf == MAP_FAILED) {
+        return -1;
+    }
+    if ((atomic_load(&buf->init) != 2) ||
+        (buf->size > (size_t) st.st_size - sizeof(shmem_buffer_t))) {
+        munmap(buf, st.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+
+    pid = (access == O_RDONLY) ? &buf->reader_pid : &buf->writer_pid;
+    cur = atomic_load(pid);
+    do {
+        if (shmem_buffer_pid_alive(cur)) {
+            munmap(buf, st.st_size);
+            errno = EBUSY;
+            return -1;
+        }
+    } while (!atomic_compare_exchange_weak(pid, &cur, (uint64_t)getpid()));
+
+    param->buffer_size = buf->size;
+    ctx->alloc_size = st.st_size;
+    ctx->cached = atomic_load((access == O_RDONLY) ? &buf->writer : &buf->reader);
+    ctx->buf = buf;
+    return pirate_next_gd();
 }
 
 int shmem_buffer_open(void *_param, void *_ctx) {
@@ -253,15 +314,22 @@ int shmem_buffer_open(void *_param, void *_ctx) {
     int access = ctx->flags & O_ACCMODE;
 
     shmem_buffer_init_param(param);
+    ctx->cached = 0;
+    ctx->pending = 0;
+    ctx->buf = NULL;
+    if (param->fd > 0) {
+        return shmem_buffer_open_fd(param, ctx, access);
+    }
     // on successful shm_open (fd > 0) we must shm_unlink before exiting
     // this function
-    int fd = shm_open(param->path, O_RDWR | O_CREAT, 0660);
+    int fd = shmem_buffer_mem_open(param->path, &param->mem);
     if (fd < 0) {
         ctx->buf = NULL;
         return -1;
     }
 
-    buf = shmem_buffer_init(fd, param->buffer_size);
+    ctx->alloc_size = shmem_buffer_mem_size(sizeof(shmem_buffer_t) + param->buffer_size, &param->mem);
+    buf = shmem_buffer_init(fd, param->buffer_size, ctx->alloc_size, &param->mem);
     ctx->buf = buf;
     if (ctx->buf == NULL) {
         goto error;
@@ -283,6 +351,7 @@ int shmem_buffer_open(void *_param, void *_ctx) {
             atomic_store(&buf->reader_pid, 0);
             goto error;
         }
+        ctx->cached = atomic_load(&buf->writer);
     } else {
         if (!atomic_compare_exchange_strong(&buf->writer_pid, &init_pid,
                                         (uint64_t)getpid())) {
@@ -299,9 +368,10 @@ int shmem_buffer_open(void *_param, void *_ctx) {
             atomic_store(&buf->writer_pid, 0);
             goto error;
         }
+        ctx->cached = atomic_load(&buf->reader);
     }
     err = errno;
-    if (shm_unlink(param->path) == -1) {
+    if (shmem_buffer_mem_unlink(param->path, &param->mem) == -1) {
         if (errno == ENOENT) {
             errno = err;
         } else {
@@ -313,7 +383,7 @@ int shmem_buffer_open(void *_param, void *_ctx) {
 error:
     err = errno;
     ctx->buf = NULL;
-    shm_unlink(param->path);
+    shmem_buffer_mem_unlink(param->path, &param->mem);
     errno = err;
     return -1;
 }
@@ -321,53 +391,103 @@ error:
 int shmem_buffer_close(void *_ctx) {
     shmem_ctx *ctx = (shmem_ctx *)_ctx;
     shmem_buffer_t* buf = ctx->buf;
-    const size_t alloc_size = sizeof(shmem_buffer_t) + buf->size;
     int access = ctx->flags & O_ACCMODE;
 
     if (access == O_RDONLY) {
         atomic_store(&buf->reader_pid, 0);
-        pthread_mutex_lock(&buf->mutex);
-        pthread_cond_signal(&buf->is_not_full);
-        pthread_mutex_unlock(&buf->mutex);
+        shmem_buffer_wake(buf, O_WRONLY);
     } else {
         atomic_store(&buf->writer_pid, 0);
-        pthread_mutex_lock(&buf->mutex);
-        pthread_cond_signal(&buf->is_not_empty);
-        pthread_mutex_unlock(&buf->mutex);
+        shmem_buffer_wake(buf, O_RDONLY);
     }
 
-    return munmap(buf, alloc_size);
+    return munmap(buf, ctx->alloc_size);
 }
 
-static uint32_t shmem_buffer_do_read(const pirate_shmem_param_t *param, shmem_buffer_t* buf, uint8_t *dst, size_t len, uint32_t reader, size_t nbytes) {
-    size_t nbytes1, nbytes2;
+// Copies len bytes starting at offset out of the ring buffer.
+// Returns the offset following the last byte copied.
+static size_t shmem_buffer_do_read(const pirate_shmem_param_t *param, shmem_buffer_t* buf, uint8_t *dst, size_t len, size_t offset) {
+    size_t nbytes, nbytes1, nbytes2;
     size_t copy_len = 0;
-    size_t copy_total = MIN(nbytes, len);
 
-    while (copy_len < copy_total) {
-        nbytes = MIN(copy_total - copy_len, param->max_tx);
-        nbytes1 = MIN(buf->size - reader, nbytes);
+    while (copy_len < len) {
+        nbytes = MIN(len - copy_len, param->max_tx);
+        nbytes1 = MIN(buf->size - offset, nbytes);
         nbytes2 = nbytes - nbytes1;
-        memcpy(dst, shared_buffer(buf) + reader, nbytes1);
+        memcpy(dst, shared_buffer(buf) + offset, nbytes1);
         if (nbytes2 > 0) {
             memcpy(dst + nbytes1, shared_buffer(buf), nbytes2);
         }
-        reader = (reader + nbytes) % buf->size;
+        offset += nbytes;
+        if (offset >= buf->size) {
+            offset -= buf->size;
+        }
         dst += nbytes;
         copy_len += nbytes;
     }
-    return reader;
+    return offset;
+}
+
+// Describes len bytes of the ring buffer starting at offset.
+// The second segment is non-empty when the region wraps around
+// the end of the ring buffer.
+static void shmem_buffer_segments(shmem_buffer_t* buf, size_t offset, size_t len, struct iovec *iov) {
+    size_t len1 = MIN(buf->size - offset, len);
+
+    iov[0].iov_base = shared_buffer(buf) + offset;
+    iov[0].iov_len = len1;
+    iov[1].iov_base = shared_buffer(buf);
+    iov[1].iov_len = len - len1;
+}
+
+// Waits until the ring buffer is not empty and sets reader
+// to the position of the reader. Returns 1 when data is available
+// and 0 when the writer has closed the channel and the channel is empty.
+static int shmem_buffer_read_wait(const pirate_shmem_param_t *param, shmem_ctx *ctx, uint64_t *reader) {
+    shmem_buffer_t* buf = ctx->buf;
+
+    *reader = atomic_load_explicit(&buf->reader, memory_order_relaxed);
+    // Only read the writer cache line when every packet
+    // observed on the previous load has been consumed.
+    if (ctx->cached != *reader) {
+        return 1;
+    }
+
+    // The reader returns 0 when the writer has closed
+    // the channel and the channel is empty. If the writer
+    // has closed the channel and the buffer has content
+    // then return the contents of the buffer.
+    ctx->cached = shmem_buffer_wait(buf, O_RDONLY, *reader, param->wait, param->spin_ns, &ctx->wait_stats);
+    return ctx->cached != *reader;
+}
+
+// Moves the reader position to the start of the next packet
+// and wakes up the writer if it is sleeping. The sequentially
+// consistent store is ordered before the load of writer_waiting
+// and writer_pollers.
+static void shmem_buffer_read_publish(shmem_buffer_t* buf, uint64_t reader) {
+    atomic_store(&buf->reader, reader);
+
+    if (atomic_load(&buf->writer_waiting) || atomic_load(&buf->writer_pollers)) {
+        shmem_buffer_wake(buf, O_WRONLY);
+    }
+}
+
+// Reads the header of the next packet. Returns the packet
+// length and moves offset to the start of the packet data.
+static uint32_t shmem_buffer_read_header(const pirate_shmem_param_t *param, shmem_buffer_t* buf, size_t *offset) {
+    pirate_header_t header;
+
+    *offset = shmem_buffer_do_read(param, buf, (uint8_t*) &header, sizeof(header), *offset);
+    return ntohl(header.count);
 }
 
 ssize_t shmem_buffer_read(const void *_param, void *_ctx, void *buffer, size_t count) {
     const pirate_shmem_param_t *param = (const pirate_shmem_param_t *)_param;
     shmem_ctx *ctx = (shmem_ctx *)_ctx;
 
-    uint64_t position;
-    int was_full;
-    size_t nbytes;
-    uint32_t reader, writer;
-    pirate_header_t header;
+    uint64_t reader;
+    size_t offset;
     uint32_t packet_count;
 
     shmem_buffer_t* buf = ctx->buf;
@@ -376,84 +496,120 @@ ssize_t shmem_buffer_read(const void *_param, void *_ctx, void *buffer, size_t c
         return -1;
     }
 
-    position = atomic_load(&buf->position);
-    for (int spin = 0; (spin < SPIN_ITERATIONS) && is_empty(position); spin++) {
-        position = atomic_load(&buf->position);
+    if (ctx->pending) {
+        errno = EBUSY;
+        return -1;
     }
 
-    if (is_empty(position)) {
-        pthread_mutex_lock(&buf->mutex);
-        position = atomic_load(&buf->position);
-        while (is_empty(position)) {
-            // The reader returns 0 when the writer has closed
-            // the channel and the channel is empty. If the writer
-            // has closed the channel and the buffer has content
-            // then return the contents of the buffer.
-            if (atomic_load(&buf->writer_pid) == 0) {
-                pthread_mutex_unlock(&buf->mutex);
-                return 0;
-            }
-            pthread_cond_wait(&buf->is_not_empty, &buf->mutex);
-            position = atomic_load(&buf->position);
-        }
-        pthread_mutex_unlock(&buf->mutex);
+    if (shmem_buffer_read_wait(param, ctx, &reader) == 0) {
+        return 0;
     }
 
-    reader = get_read(position);
-    writer = get_write(position);
+    offset = reader % buf->size;
+    packet_count = shmem_buffer_read_header(param, buf, &offset);
+    shmem_buffer_do_read(param, buf, buffer, MIN(count, packet_count), offset);
+    shmem_buffer_read_publish(buf, reader + sizeof(pirate_header_t) + packet_count);
 
-    if (reader < writer) {
-        nbytes = writer - reader;
-    } else {
-        nbytes = buf->size + writer - reader;
+    return MIN(count, packet_count);
+}
+
+ssize_t shmem_buffer_peek_len(const void *_param, void *_ctx) {
+    const pirate_shmem_param_t *param = (const pirate_shmem_param_t *)_param;
+    shmem_ctx *ctx = (shmem_ctx *)_ctx;
+
+    uint64_t reader;
+    size_t offset;
+
+    shmem_buffer_t* buf = ctx->buf;
+    if (buf == NULL) {
+        errno = EBADF;
+        return -1;
     }
 
-    atomic_thread_fence(memory_order_acquire);
-    reader = shmem_buffer_do_read(param, buf, (uint8_t*) &header, sizeof(header), reader, nbytes);
-    nbytes -= sizeof(header);
-    packet_count = ntohl(header.count);
-    reader = shmem_buffer_do_read(param, buf, buffer, MIN(count, packet_count), reader, nbytes);
-    if (count < packet_count) {
-        reader = (reader + packet_count - count) % buf->size;
+    if (shmem_buffer_read_wait(param, ctx, &reader) == 0) {
+        return 0;
     }
 
-    for (;;) {
-        uint64_t update = create_position(writer, reader, buf->size, 0);
-        if (atomic_compare_exchange_weak(&buf->position, &position,
-                update)) {
-            was_full = is_full(position);
-            break;
-        }
-        writer = get_write(position);
+    offset = reader % buf->size;
+    return shmem_buffer_read_header(param, buf, &offset);
+}
+
+ssize_t shmem_buffer_read_acquire(const void *_param, void *_ctx, struct iovec *iov) {
+    const pirate_shmem_param_t *param = (const pirate_shmem_param_t *)_param;
+    shmem_ctx *ctx = (shmem_ctx *)_ctx;
+
+    uint64_t reader;
+    size_t offset;
+    uint32_t packet_count;
+
+    shmem_buffer_t* buf = ctx->buf;
+    if (buf == NULL) {
+        errno = EBADF;
+        return -1;
     }
 
-    if (was_full) {
-        pthread_mutex_lock(&buf->mutex);
-        pthread_cond_signal(&buf->is_not_full);
-        pthread_mutex_unlock(&buf->mutex);
+    if (ctx->pending) {
+        errno = EBUSY;
+        return -1;
     }
 
-    return MIN(count, packet_count);
+    if (shmem_buffer_read_wait(param, ctx, &reader) == 0) {
+        shmem_buffer_segments(buf, 0, 0, iov);
+        return 0;
+    }
+
+    offset = reader % buf->size;
+    packet_count = shmem_buffer_read_header(param, buf, &offset);
+    shmem_buffer_segments(buf, offset, packet_count, iov);
+
+    ctx->pending = 1;
+    ctx->pending_position = reader + sizeof(pirate_header_t) + packet_count;
+    ctx->pending_len = packet_count;
+
+    return packet_count;
 }
 
-static uint32_t shmem_buffer_do_write(const pirate_shmem_param_t *param, shmem_buffer_t* buf, const uint8_t *src, size_t len, uint32_t writer, size_t nbytes) {
-    size_t nbytes1, nbytes2;
+int shmem_buffer_read_release(const void *_param, void *_ctx) {
+    (void) _param;
+    shmem_ctx *ctx = (shmem_ctx *)_ctx;
+
+    shmem_buffer_t* buf = ctx->buf;
+    if (buf == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (!ctx->pending) {
+        return 0;
+    }
+
+    shmem_buffer_read_publish(buf, ctx->pending_position);
+    ctx->pending = 0;
+    return 0;
+}
+
+// Copies len bytes starting at offset into the ring buffer.
+// Returns the offset following the last byte copied.
+static size_t shmem_buffer_do_write(const pirate_shmem_param_t *param, shmem_buffer_t* buf, const uint8_t *src, size_t len, size_t offset) {
+    size_t nbytes, nbytes1, nbytes2;
     size_t copy_len = 0;
-    size_t copy_total = MIN(nbytes, len);
 
-    while (copy_len < copy_total) {
-        nbytes = MIN(copy_total - copy_len, param->max_tx);
-        nbytes1 = MIN(buf->size - writer, nbytes);
+    while (copy_len < len) {
+        nbytes = MIN(len - copy_len, param->max_tx);
+        nbytes1 = MIN(buf->size - offset, nbytes);
         nbytes2 = nbytes - nbytes1;
-        memcpy(shared_buffer(buf) + writer, src, nbytes1);
+        memcpy(shared_buffer(buf) + offset, src, nbytes1);
         if (nbytes2 > 0) {
             memcpy(shared_buffer(buf), src + nbytes1, nbytes2);
         }
-        writer = (writer + nbytes) % buf->size;
+        offset += nbytes;
+        if (offset >= buf->size) {
+            offset -= buf->size;
+        }
         src += nbytes;
         copy_len += nbytes;
     }
-    return writer;
+    return offset;
 }
 
 ssize_t shmem_buffer_write_mtu(const void *_param, void *_ctx) {
@@ -470,15 +626,64 @@ ssize_t shmem_buffer_write_mtu(const void *_param, void *_ctx) {
     return mtu - sizeof(pirate_header_t);
 }
 
-ssize_t shmem_buffer_write(const void *_param, void *_ctx, const void *buffer,
-                            size_t count) {
+// The ring buffer is full when it does not have room
+// for a packet header and at least one byte of data.
+static inline int is_full(shmem_buffer_t* buf, uint64_t writer, uint64_t reader) {
+    return (writer - reader) + sizeof(pirate_header_t) >= buf->size;
+}
+
+// Waits until the ring buffer is not full and sets writer
+// to the position of the writer. Returns the number of free bytes
+// in the ring buffer, or -1 when the reader has closed the channel.
+static ssize_t shmem_buffer_write_wait(const pirate_shmem_param_t *param, shmem_ctx *ctx, size_t count, uint64_t *writer) {
+    shmem_buffer_t* buf = ctx->buf;
+    size_t nbytes;
+
+    *writer = atomic_load_explicit(&buf->writer, memory_order_relaxed);
+    nbytes = buf->size - (*writer - ctx->cached);
+    // Only read the reader cache line when the free space
+    // observed on the previous load is not sufficient.
+    if ((nbytes <= sizeof(pirate_header_t)) ||
+        (nbytes - sizeof(pirate_header_t) < count)) {
+        ctx->cached = atomic_load_explicit(&buf->reader, memory_order_acquire);
+        while (is_full(buf, *writer, ctx->cached) && (atomic_load(&buf->reader_pid) != 0)) {
+            ctx->cached = shmem_buffer_wait(buf, O_WRONLY, ctx->cached, param->wait, param->spin_ns, &ctx->wait_stats);
+        }
+    }
+
+    // The writer returns -1 when the reader has closed the channel.
+    // The reader returns 0 when the writer has closed the channel AND
+    // the channel is empty.
+    if (atomic_load(&buf->reader_pid) == 0) {
+        kill(getpid(), SIGPIPE);
+        errno = EPIPE;
+        return -1;
+    }
+
+    return buf->size - (*writer - ctx->cached);
+}
+
+// Moves the writer position past the end of the packet
+// and wakes up the reader if it is sleeping. The sequentially
+// consistent store is ordered after the packet contents
+// and before the load of reader_waiting and reader_pollers.
+static void shmem_buffer_write_publish(shmem_buffer_t* buf, uint64_t writer) {
+    atomic_store(&buf->writer, writer);
+
+    if (atomic_load(&buf->reader_waiting) || atomic_load(&buf->reader_pollers)) {
+        shmem_buffer_wake(buf, O_RDONLY);
+    }
+}
+
+ssize_t shmem_buffer_writev(const void *_param, void *_ctx, const struct iovec *iov,
+                            int iovcnt) {
     const pirate_shmem_param_t *param = (const pirate_shmem_param_t *)_param;
     shmem_ctx *ctx = (shmem_ctx *)_ctx;
-    uint64_t position;
-    int was_empty;
-    size_t nbytes;
-    uint32_t reader, writer;
+    ssize_t nbytes;
+    uint64_t writer;
+    size_t offset, count = 0, remain, len;
     pirate_header_t header;
+    int i;
 
     shmem_buffer_t* buf = ctx->buf;
     if (buf == NULL) {
@@ -486,69 +691,214 @@ ssize_t shmem_buffer_write(const void *_param, void *_ctx, const void *buffer,
         return -1;
     }
 
-    position = atomic_load(&buf->position);
-    for (int spin = 0; (spin < SPIN_ITERATIONS) && is_full(position); spin++) {
-        position = atomic_load(&buf->position);
+    if (ctx->pending) {
+        errno = EBUSY;
+        return -1;
     }
 
-    if (is_full(position)) {
-        pthread_mutex_lock(&buf->mutex);
-        position = atomic_load(&buf->position);
-        while (is_full(position)) {
-            if (atomic_load(&buf->reader_pid) == 0) {
-                pthread_mutex_unlock(&buf->mutex);
-                kill(getpid(), SIGPIPE);
-                errno = EPIPE;
-                return -1;
-            }
-            pthread_cond_wait(&buf->is_not_full, &buf->mutex);
-            position = atomic_load(&buf->position);
-        }
-
-        pthread_mutex_unlock(&buf->mutex);
+    if ((iovcnt < 0) || (iovcnt > PIRATE_IOV_MAX)) {
+        errno = EINVAL;
+        return -1;
     }
 
-    // The writer returns -1 when the reader has closed the channel.
-    // The reader returns 0 when the writer has closed the channel AND
-    // the channel is empty.
-    if (atomic_load(&buf->reader_pid) == 0) {
-        kill(getpid(), SIGPIPE);
-        errno = EPIPE;
-        return -1;
+    for (i = 0; i < iovcnt; i++) {
+        count += iov[i].iov_len;
     }
 
-    reader = get_read(position);
-    writer = get_write(position);
-    if (writer < reader) {
-        nbytes = reader - writer;
-    } else {
-        nbytes = buf->size + reader - writer;
+    if ((nbytes = shmem_buffer_write_wait(param, ctx, count, &writer)) < 0) {
+        return -1;
     }
 
     // shmem will truncate a write if the buffer
     // does not have avialable space for the entire packet
     count = MIN(count, nbytes - sizeof(header));
     header.count = htonl(count);
-    writer = shmem_buffer_do_write(param, buf, (uint8_t*) &header, sizeof(header), writer, nbytes);
-    nbytes -= sizeof(header);
-    writer = shmem_buffer_do_write(param, buf, buffer, count, writer, nbytes);
-
-    atomic_thread_fence(memory_order_release);
-    for (;;) {
-        uint64_t update = create_position(writer, reader, buf->size, 1);
-        if (atomic_compare_exchange_weak(&buf->position, &position,
-                                            update)) {
-            was_empty = is_empty(position);
+    offset = shmem_buffer_do_write(param, buf, (uint8_t*) &header, sizeof(header), writer % buf->size);
+    remain = count;
+    for (i = 0; (i < iovcnt) && (remain > 0); i++) {
+        len = MIN(iov[i].iov_len, remain);
+        offset = shmem_buffer_do_write(param, buf, iov[i].iov_base, len, offset);
+        remain -= len;
+    }
+
+    shmem_buffer_write_publish(buf, writer + sizeof(header) + count);
+
+    return count;
+}
+
+ssize_t shmem_buffer_write(const void *_param, void *_ctx, const void *buffer,
+                            size_t count) {
+    struct iovec iov;
+
+    iov.iov_base = (void*) buffer;
+    iov.iov_len = count;
+    return shmem_buffer_writev(_param, _ctx, &iov, 1);
+}
+
+ssize_t shmem_buffer_write_reserve(const void *_param, void *_ctx, size_t count, struct iovec *iov) {
+    const pirate_shmem_param_t *param = (const pirate_shmem_param_t *)_param;
+    shmem_ctx *ctx = (shmem_ctx *)_ctx;
+    ssize_t nbytes;
+    uint64_t writer;
+
+    shmem_buffer_t* buf = ctx->buf;
+    if (buf == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+    if (ctx->pending) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    if ((nbytes = shmem_buffer_write_wait(param, ctx, count, &writer)) < 0) {
+        return -1;
+    }
+
+    // the header is written on commit when the
+    // length of the packet is known
+    count = MIN(count, nbytes - sizeof(pirate_header_t));
+    shmem_buffer_segments(buf, (writer + sizeof(pirate_header_t)) % buf->size, count, iov);
+
+    ctx->pending = 1;
+    ctx->pending_position = writer;
+    ctx->pending_len = count;
+
+    return count;
+}
+
+ssize_t shmem_buffer_write_commit(const void *_param, void *_ctx, size_t count) {
+    const pirate_shmem_param_t *param = (const pirate_shmem_param_t *)_param;
+    shmem_ctx *ctx = (shmem_ctx *)_ctx;
+    pirate_header_t header;
+
+    shmem_buffer_t* buf = ctx->buf;
+    if (buf == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (!ctx->pending || (count > ctx->pending_len)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    header.count = htonl(count);
+    shmem_buffer_do_write(param, buf, (uint8_t*) &header, sizeof(header),
+        ctx->pending_position % buf->size);
+
+    shmem_buffer_write_publish(buf, ctx->pending_position + sizeof(header) + count);
+    ctx->pending = 0;
+
+    return count;
+}
+
+ssize_t shmem_buffer_write_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen) {
+    const pirate_shmem_param_t *param = (const pirate_shmem_param_t *)_param;
+    shmem_ctx *ctx = (shmem_ctx *)_ctx;
+    ssize_t nbytes;
+    uint64_t writer, position;
+    size_t offset, count;
+    pirate_header_t header;
+    unsigned i;
+
+    shmem_buffer_t* buf = ctx->buf;
+    if (buf == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (ctx->pending) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    if ((nbytes = shmem_buffer_write_wait(param, ctx, msgs[0].count, &writer)) < 0) {
+        return -1;
+    }
+
+    // The first packet is truncated as in shmem_buffer_write()
+    // and a truncated packet ends the batch. The following packets
+    // are written only if they fit in the available space. All the
+    // packets are published with a single update of the writer position.
+    position = writer;
+    offset = writer % buf->size;
+    for (i = 0; i < vlen; i++) {
+        count = msgs[i].count;
+        if ((size_t) nbytes < sizeof(header) + count) {
+            if (i > 0) {
+                ctx->cached = atomic_load_explicit(&buf->reader, memory_order_acquire);
+                nbytes = buf->size - (position - ctx->cached);
+                if ((size_t) nbytes < sizeof(header) + count) {
+                    break;
+                }
+            } else {
+                count = nbytes - sizeof(header);
+            }
+        }
+        header.count = htonl(count);
+        offset = shmem_buffer_do_write(param, buf, (uint8_t*) &header, sizeof(header), offset);
+        offset = shmem_buffer_do_write(param, buf, msgs[i].buf, count, offset);
+        position += sizeof(header) + count;
+        nbytes -= sizeof(header) + count;
+        msgs[i].len = count;
+        if (count < msgs[i].count) {
+            i++;
             break;
         }
-        reader = get_read(position);
     }
 
-    if (was_empty) {
-        pthread_mutex_lock(&buf->mutex);
-        pthread_cond_signal(&buf->is_not_empty);
-        pthread_mutex_unlock(&buf->mutex);
+    shmem_buffer_write_publish(buf, position);
+
+    return i;
+}
+
+ssize_t shmem_buffer_read_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen) {
+    const pirate_shmem_param_t *param = (const pirate_shmem_param_t *)_param;
+    shmem_ctx *ctx = (shmem_ctx *)_ctx;
+
+    uint64_t reader;
+    size_t offset;
+    uint32_t packet_count;
+    unsigned i;
+
+    shmem_buffer_t* buf = ctx->buf;
+    if (buf == NULL) {
+        errno = EBADF;
+        return -1;
     }
 
-    return count;
+    if (ctx->pending) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    if (shmem_buffer_read_wait(param, ctx, &reader) == 0) {
+        msgs[0].len = 0;
+        return 1;
+    }
+
+    // Reads the packets that are available without blocking
+    // and releases them with a single update of the reader position.
+    offset = reader % buf->size;
+    for (i = 0; i < vlen; i++) {
+        if (ctx->cached == reader) {
+            ctx->cached = atomic_load_explicit(&buf->writer, memory_order_acquire);
+            if (ctx->cached == reader) {
+                break;
+            }
+        }
+        packet_count = shmem_buffer_read_header(param, buf, &offset);
+        shmem_buffer_do_read(param, buf, msgs[i].buf, MIN(msgs[i].count, packet_count), offset);
+        offset += packet_count;
+        if (offset >= buf->size) {
+            offset -= buf->size;
+        }
+        reader += sizeof(pirate_header_t) + packet_count;
+        msgs[i].len = MIN(msgs[i].count, packet_count);
+    }
+
+    shmem_buffer_read_publish(buf, reader);
+
+    return i;
 }
@@ -0,0 +1,397 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <mntent.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <linux/memfd.h>
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/statfs.h>
+#include <sys/syscall.h>
+#include "shmem_buffer.h"
+
+// number of polls between reads of the clock
+#define SPIN_CLOCK_INTERVAL 64
+
+// size of the node mask passed to mbind()
+#define SHMEM_BUFFER_MAX_NUMA_NODES 1024
+
+static const char *wait_names[] = {
+    [PIRATE_WAIT_ADAPTIVE] = "adaptive",
+    [PIRATE_WAIT_SPIN] = "spin",
+    [PIRATE_WAIT_FUTEX] = "futex",
+    [PIRATE_WAIT_YIELD] = "yield",
+};
+
+// The futex words are in memory shared between processes
+// so the FUTEX_PRIVATE_FLAG must not be used.
+static inline long futex(pirate_atomic_uint32 *uaddr, int op, uint32_t val) {
+    return syscall(SYS_futex, uaddr, op, val, NULL, NULL, 0);
+}
+
+static inline uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+int shmem_buffer_parse_wait(const char *str, pirate_wait_t *wait) {
+    for (size_t i = 0; i < sizeof(wait_names) / sizeof(wait_names[0]); i++) {
+        if (strcmp(str, wait_names[i]) == 0) {
+            *wait = (pirate_wait_t) i;
+            return 0;
+        }
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+const char *shmem_buffer_wait_name(pirate_wait_t wait) {
+    if ((unsigned) wait >= sizeof(wait_names) / sizeof(wait_names[0])) {
+        return NULL;
+    }
+    return wait_names[wait];
+}
+
+static inline void shmem_wait_stats_add(uint64_t *counter, uint64_t val) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + val, __ATOMIC_RELAXED);
+}
+
+static uint64_t shmem_buffer_do_wait(shmem_buffer_t *buf, int access, uint64_t expected,
+                                        pirate_wait_t wait, unsigned spin_ns, shmem_wait_stats_t *stats) {
+    pirate_atomic_uint64 *position, *peer_pid, *waiting;
+    pirate_atomic_uint32 *wake;
+    uint64_t value, deadline = 0;
+    uint32_t seq;
+    int closed;
+
+    if (access == O_RDONLY) {
+        position = &buf->writer;
+        peer_pid = &buf->writer_pid;
+        waiting = &buf->reader_waiting;
+        wake = &buf->reader_wake;
+    } else {
+        position = &buf->reader;
+        peer_pid = &buf->reader_pid;
+        waiting = &buf->writer_waiting;
+        wake = &buf->writer_wake;
+    }
+
+    if (wait != PIRATE_WAIT_FUTEX) {
+        if (wait == PIRATE_WAIT_ADAPTIVE) {
+            deadline = monotonic_ns() + spin_ns;
+        }
+        for (unsigned spin = 1; ; spin++) {
+            closed = atomic_load_explicit(peer_pid, memory_order_acquire) == 0;
+            value = atomic_load_explicit(position, memory_order_acquire);
+            if ((value != expected) || closed) {
+                return value;
+            }
+            if (wait == PIRATE_WAIT_YIELD) {
+                sched_yield();
+            } else {
+                cpu_relax();
+            }
+            if ((wait == PIRATE_WAIT_ADAPTIVE) && ((spin % SPIN_CLOCK_INTERVAL) == 0) &&
+                (monotonic_ns() >= deadline)) {
+                break;
+            }
+        }
+    }
+
+    // The waiting flag is stored before the position is loaded, and
+    // the other side stores its position before it loads the waiting flag.
+    // Either the other side observes the flag and increments the futex word,
+    // or this side observes the new position. The futex word is loaded
+    // before the position, so an increment after the load of the
+    // position fails the FUTEX_WAIT comparison.
+    for (;;) {
+        atomic_store(waiting, 1);
+        seq = atomic_load(wake);
+        closed = atomic_load(peer_pid) == 0;
+        value = atomic_load(position);
+        if ((value != expected) || closed) {
+            break;
+        }
+        futex(wake, FUTEX_WAIT, seq);
+        shmem_wait_stats_add(&stats->wakeups, 1);
+    }
+    atomic_store(waiting, 0);
+    return value;
+}
+
+// The clock is read only when the other side has not moved its
+// position, so refreshing the cached position is not slowed down.
+uint64_t shmem_buffer_wait(shmem_buffer_t *buf, int access, uint64_t expected,
+                            pirate_wait_t wait, unsigned spin_ns, shmem_wait_stats_t *stats) {
+    pirate_atomic_uint64 *position, *peer_pid;
+    uint64_t start, value;
+    int closed;
+
+    if (access == O_RDONLY) {
+        position = &buf->writer;
+        peer_pid = &buf->writer_pid;
+    } else {
+        position = &buf->reader;
+        peer_pid = &buf->reader_pid;
+    }
+
+    closed = atomic_load_explicit(peer_pid, memory_order_acquire) == 0;
+    value = atomic_load_explicit(position, memory_order_acquire);
+    if ((value != expected) || closed) {
+        return value;
+    }
+
+    start = monotonic_ns();
+    value = shmem_buffer_do_wait(buf, access, expected, wait, spin_ns, stats);
+    shmem_wait_stats_add(&stats->waits, 1);
+    shmem_wait_stats_add(&stats->blocked_ns, monotonic_ns() - start);
+    return value;
+}
+
+void shmem_buffer_wake(shmem_buffer_t *buf, int access) {
+    pirate_atomic_uint64 *waiting;
+    pirate_atomic_uint32 *wake;
+
+    if (access == O_RDONLY) {
+        waiting = &buf->reader_waiting;
+        wake = &buf->reader_wake;
+    } else {
+        waiting = &buf->writer_waiting;
+        wake = &buf->writer_wake;
+    }
+
+    // Subsequent updates do not make the system call
+    // until the sleeping side sets the waiting flag again.
+    atomic_store(waiting, 0);
+    atomic_fetch_add(wake, 1);
+    futex(wake, FUTEX_WAKE, INT_MAX);
+}
+
+static const char *hugepages_names[] = {
+    [PIRATE_HUGEPAGES_NONE] = "none",
+    [PIRATE_HUGEPAGES_2M] = "2M",
+    [PIRATE_HUGEPAGES_1G] = "1G",
+};
+
+static size_t hugepages_size(pirate_hugepages_t hugepages) {
+    switch (hugepages) {
+    case PIRATE_HUGEPAGES_2M:
+        return 2ul << 20;
+    case PIRATE_HUGEPAGES_1G:
+        return 1ul << 30;
+    default:
+        return sysconf(_SC_PAGESIZE);
+    }
+}
+
+int shmem_buffer_parse_mem(const char *key, const char *val, pirate_shmem_mem_t *mem) {
+    if (strncmp("hugepages", key, strlen("hugepages")) == 0) {
+        for (size_t i = 0; i < sizeof(hugepages_names) / sizeof(hugepages_names[0]); i++) {
+            if (strcmp(val, hugepages_names[i]) == 0) {
+                mem->hugepages = (pirate_hugepages_t) i;
+                return 1;
+            }
+        }
+        errno = EINVAL;
+        return -1;
+    } else if (strncmp("numa_node", key, strlen("numa_node")) == 0) {
+        mem->numa = 1;
+        mem->numa_node = strtol(val, NULL, 10);
+    } else if (strncmp("prefault", key, strlen("prefault")) == 0) {
+        mem->prefault = strtol(val, NULL, 10) != 0;
+    } else if (strncmp("mlock", key, strlen("mlock")) == 0) {
+        mem->mlock = strtol(val, NULL, 10) != 0;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+int shmem_buffer_mem_description(const pirate_shmem_mem_t *mem, char *desc, int len) {
+    char hugepages_str[32];
+    char numa_str[32];
+
+    hugepages_str[0] = 0;
+    numa_str[0] = 0;
+    if ((mem->hugepages != PIRATE_HUGEPAGES_NONE) &&
+        ((unsigned) mem->hugepages < sizeof(hugepages_names) / sizeof(hugepages_names[0]))) {
+        snprintf(hugepages_str, 32, ",hugepages=%s", hugepages_names[mem->hugepages]);
+    }
+    if (mem->numa) {
+        snprintf(numa_str, 32, ",numa_node=%u", mem->numa_node);
+    }
+    return snprintf(desc, len, "%s%s%s%s", hugepages_str, numa_str,
+        mem->prefault ? ",prefault=1" : "", mem->mlock ? ",mlock=1" : "");
+}
+
+// Finds a hugetlbfs mount whose page size is the requested size.
+// The page size of a hugetlbfs mount is its block size.
+static int shmem_buffer_hugetlbfs_path(const char *path, pirate_hugepages_t hugepages,
+                                        char *buf, size_t len) {
+    const size_t page_size = hugepages_size(hugepages);
+    struct mntent ent, *mnt;
+    struct statfs st;
+    char strings[PATH_MAX * 2];
+    int found = 0;
+    FILE *fp;
+
+    if ((fp = setmntent("/proc/mounts", "r")) == NULL) {
+        return -1;
+    }
+    while (!found && ((mnt = getmntent_r(fp, &ent, strings, sizeof(strings))) != NULL)) {
+        if ((strcmp(mnt->mnt_type, "hugetlbfs") == 0) &&
+            (statfs(mnt->mnt_dir, &st) == 0) &&
+            ((size_t) st.f_bsize == page_size)) {
+            found = 1;
+            if (snprintf(buf, len, "%s/%s", mnt->mnt_dir,
+                    path + strspn(path, "/")) >= (int) len) {
+                endmntent(fp);
+                errno = ENAMETOOLONG;
+                return -1;
+            }
+        }
+    }
+    endmntent(fp);
+    if (!found) {
+        errno = ENODEV;
+        return -1;
+    }
+    return 0;
+}
+
+int shmem_buffer_mem_open(const char *path, const pirate_shmem_mem_t *mem) {
+    char hugetlbfs_path[PATH_MAX];
+
+    if (mem->hugepages == PIRATE_HUGEPAGES_NONE) {
+        return shm_open(path, O_RDWR | O_CREAT, 0660);
+    }
+    if (shmem_buffer_hugetlbfs_path(path, mem->hugepages,
+            hugetlbfs_path, sizeof(hugetlbfs_path)) < 0) {
+        return -1;
+    }
+    return open(hugetlbfs_path, O_RDWR | O_CREAT | O_CLOEXEC, 0660);
+}
+
+int shmem_buffer_mem_create(const pirate_shmem_mem_t *mem) {
+    unsigned flags = MFD_CLOEXEC | MFD_ALLOW_SEALING;
+
+    switch (mem->hugepages) {
+    case PIRATE_HUGEPAGES_2M:
+        flags |= MFD_HUGETLB | MFD_HUGE_2MB;
+        break;
+    case PIRATE_HUGEPAGES_1G:
+        flags |= MFD_HUGETLB | MFD_HUGE_1GB;
+        break;
+    default:
+        break;
+    }
+    return memfd_create("pirate_shmem", flags);
+}
+
+int shmem_buffer_mem_unlink(const char *path, const pirate_shmem_mem_t *mem) {
+    char hugetlbfs_path[PATH_MAX];
+
+    if (mem->hugepages == PIRATE_HUGEPAGES_NONE) {
+        return shm_unlink(path);
+    }
+    if (shmem_buffer_hugetlbfs_path(path, mem->hugepages,
+            hugetlbfs_path, sizeof(hugetlbfs_path)) < 0) {
+        return -1;
+    }
+    return unlink(hugetlbfs_path);
+}
+
+size_t shmem_buffer_mem_size(size_t size, const pirate_shmem_mem_t *mem) {
+    const size_t page_size = hugepages_size(mem->hugepages);
+    return (size + page_size - 1) & ~(page_size - 1);
+}
+
+// Binds the memory with MPOL_BIND. A kernel built without NUMA
+// support has only node 0, so ENOSYS is ignored for node 0.
+static int shmem_buffer_mbind(void *addr, size_t size, unsigned node) {
+    unsigned long nodemask[SHMEM_BUFFER_MAX_NUMA_NODES / (sizeof(unsigned long) * CHAR_BIT)];
+    const size_t bits = sizeof(unsigned long) * CHAR_BIT;
+
+    if (node >= SHMEM_BUFFER_MAX_NUMA_NODES) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(nodemask, 0, sizeof(nodemask));
+    nodemask[node / bits] = 1ul << (node % bits);
+    // the kernel reads maxnode - 1 bits of the node mask
+    if (syscall(SYS_mbind, addr, size, MPOL_BIND, nodemask,
+            SHMEM_BUFFER_MAX_NUMA_NODES + 1, 0) != 0) {
+        if ((errno == ENOSYS) && (node == 0)) {
+            return 0;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+// MADV_POPULATE_WRITE requires Linux 5.14. Older kernels
+// fault in each page with an atomic add of zero.
+static void shmem_buffer_prefault(void *addr, size_t size, size_t page_size) {
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(addr, size, MADV_POPULATE_WRITE) == 0) {
+        return;
+    }
+#endif
+    for (size_t offset = 0; offset < size; offset += page_size) {
+        __atomic_fetch_add((unsigned char *) addr + offset, 0, __ATOMIC_RELAXED);
+    }
+}
+
+void *shmem_buffer_mem_map(int fd, size_t size, const pirate_shmem_mem_t *mem) {
+    void *addr;
+    int err;
+
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    err = errno;
+    close(fd);
+    if (addr == MAP_FAILED) {
+        errno = err;
+        return MAP_FAILED;
+    }
+    if ((mem->numa && (shmem_buffer_mbind(addr, size, mem->numa_node) != 0)) ||
+        (mem->mlock && (mlock(addr, size) != 0))) {
+        err = errno;
+        munmap(addr, size);
+        errno = err;
+        return MAP_FAILED;
+    }
+    // mlock() faults in the memory
+    if (mem->prefault && !mem->mlock) {
+        shmem_buffer_prefault(addr, size, hugepages_size(mem->hugepages));
+    }
+    return addr;
+}
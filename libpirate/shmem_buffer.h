@@ -16,36 +16,131 @@
 #ifndef __PIRATE_SHMEM_BUFFER_H
 #define __PIRATE_SHMEM_BUFFER_H
 
-#include <pthread.h>
 #include <semaphore.h>
 #include <stdint.h>
 #include <sys/types.h>
+#include "libpirate.h"
 
 #ifdef __cplusplus
 #include <atomic>
 typedef std::atomic_uint_fast64_t pirate_atomic_uint64;
+typedef std::atomic_uint_least32_t pirate_atomic_uint32;
 #elif HAVE_STD_ATOMIC
 #include <stdatomic.h>
 typedef atomic_uint_fast64_t pirate_atomic_uint64;
+typedef atomic_uint_least32_t pirate_atomic_uint32;
 #else
 // This is a workaround.
 // Do not use shmem_buffer_t when atomics are not available
 typedef uint_fast64_t pirate_atomic_uint64;
+typedef uint_least32_t pirate_atomic_uint32;
 #endif
 
+#define PIRATE_CACHE_LINE_SIZE 64
+
+// The reader and writer positions are 64-bit sequence numbers
+// that increase monotonically and never wrap around. They count
+// bytes for the SHMEM and UIO channels and packets for the UDP_SHMEM
+// channel. The ring buffer is empty when writer == reader and
+// holds (writer - reader) units otherwise. The offset into the
+// ring buffer is the sequence number modulo the buffer size.
+//
+// Each position is placed on its own cache line so that the
+// producer and consumer cores do not invalidate each other's
+// cache line on every operation. The remaining fields are
+// written only on open, close, and when a side goes to sleep.
 typedef struct {
-    pirate_atomic_uint64    position;
-    pirate_atomic_uint64    init;
+    pirate_atomic_uint64    writer __attribute__((aligned(PIRATE_CACHE_LINE_SIZE)));
+    pirate_atomic_uint64    reader __attribute__((aligned(PIRATE_CACHE_LINE_SIZE)));
+    pirate_atomic_uint64    init __attribute__((aligned(PIRATE_CACHE_LINE_SIZE)));
     pirate_atomic_uint64    reader_pid;
     pirate_atomic_uint64    writer_pid;
+    // non-zero when the reader (writer) is sleeping on its futex
+    pirate_atomic_uint64    reader_waiting;
+    pirate_atomic_uint64    writer_waiting;
+    // number of poll set helper threads sleeping on the futex of the
+    // reader (writer). Kept apart from the waiting flag, which the
+    // reader (writer) clears when it returns from its own wait.
+    pirate_atomic_uint64    reader_pollers;
+    pirate_atomic_uint64    writer_pollers;
+    // futex words of the reader (writer), incremented on each wakeup
+    pirate_atomic_uint32    reader_wake;
+    pirate_atomic_uint32    writer_wake;
     sem_t                   reader_open_wait;
     sem_t                   writer_open_wait;
-    pthread_mutex_t         mutex;
-    pthread_cond_t          is_not_empty;
-    pthread_cond_t          is_not_full;
-    int                     size;
+    uint64_t                size;
     size_t                  packet_size;
     size_t                  packet_count;
 } shmem_buffer_t;
 
+// The pid of a side of a channel created by pirate_shmem_create()
+// before the side opens the channel. The other side waits for a
+// reserved side as if it were open.
+#define SHMEM_BUFFER_PID_RESERVED UINT64_MAX
+
+// Statistics of the calls to shmem_buffer_wait() on one
+// side of a channel. Read by pirate_get_stats_ex().
+typedef struct {
+    uint64_t waits;
+    uint64_t wakeups;
+    uint64_t blocked_ns;
+} shmem_wait_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Called by the reader (access == O_RDONLY) to wait until the writer
+// moves its position away from expected, or by the writer
+// (access == O_WRONLY) to wait until the reader moves its position.
+// Also returns when the other side has closed the channel.
+// Returns the last observed position of the other side. The position
+// is loaded after the pid of the other side so all packets published
+// before the channel was closed are observed. The call is counted in stats.
+uint64_t shmem_buffer_wait(shmem_buffer_t *buf, int access, uint64_t expected,
+                            pirate_wait_t wait, unsigned spin_ns, shmem_wait_stats_t *stats);
+
+// Wakes up the reader (access == O_RDONLY) or the
+// writer (access == O_WRONLY) sleeping in shmem_buffer_wait()
+// and the poll set helper threads watching it, and clears its
+// waiting flag.
+void shmem_buffer_wake(shmem_buffer_t *buf, int access);
+
+int shmem_buffer_parse_wait(const char *str, pirate_wait_t *wait);
+const char *shmem_buffer_wait_name(pirate_wait_t wait);
+
+// Parses the memory options (hugepages, numa_node, prefault, mlock).
+// Returns 1 when key is a memory option, 0 when it is not,
+// and -1 with errno set when the value is invalid.
+int shmem_buffer_parse_mem(const char *key, const char *val, pirate_shmem_mem_t *mem);
+
+// Writes the memory options that are set as ",key=value" pairs.
+int shmem_buffer_mem_description(const pirate_shmem_mem_t *mem, char *desc, int len);
+
+// Opens the shared memory object named path, and creates it if it
+// does not exist. With hugepages the object is a file on a hugetlbfs
+// mount whose page size is the requested size. Fails with ENODEV
+// when no such mount exists.
+int shmem_buffer_mem_open(const char *path, const pirate_shmem_mem_t *mem);
+
+// Creates an anonymous shared memory file that can be sealed.
+// With hugepages the file is backed by huge pages of the requested size.
+int shmem_buffer_mem_create(const pirate_shmem_mem_t *mem);
+
+// Removes the shared memory object named path.
+int shmem_buffer_mem_unlink(const char *path, const pirate_shmem_mem_t *mem);
+
+// Rounds size up to a multiple of the page size of the memory.
+size_t shmem_buffer_mem_size(size_t size, const pirate_shmem_mem_t *mem);
+
+// Maps size bytes of the shared memory object fd and closes fd.
+// The memory is bound to its NUMA node before it is first touched,
+// then prefaulted and locked as requested. Returns MAP_FAILED
+// with errno set on failure.
+void *shmem_buffer_mem_map(int fd, size_t size, const pirate_shmem_mem_t *mem);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* __PIRATE_SHMEM_BUFFER_H */
@@ -16,12 +16,24 @@
 #ifndef __PIRATE_CHANNEL_SHMEM_INTERFACE_H
 #define __PIRATE_CHANNEL_SHMEM_INTERFACE_H
 
+#include <sys/uio.h>
 #include "libpirate.h"
 #include "shmem_buffer.h"
 
 typedef struct {
     int flags;
     shmem_buffer_t *buf;
+    // length of the mapping of buf
+    size_t alloc_size;
+    // last observed position of the reader (for the writer)
+    // or of the writer (for the reader)
+    uint64_t cached;
+    // outstanding zero-copy reservation (writer)
+    // or acquisition (reader)
+    int pending;
+    uint64_t pending_position;
+    size_t pending_len;
+    shmem_wait_stats_t wait_stats;
 } shmem_ctx;
 
 #ifdef PIRATE_SHMEM_FEATURE
@@ -33,12 +45,24 @@ int shmem_buffer_close(void *_ctx);
 ssize_t shmem_buffer_read(const void *_param, void *_ctx, void *buf, size_t count);
 ssize_t shmem_buffer_write(const void *_param, void *_ctx, const void *buf, size_t count);
 ssize_t shmem_buffer_write_mtu(const void *_param, void *_ctx);
+ssize_t shmem_buffer_write_reserve(const void *_param, void *_ctx, size_t count, struct iovec *iov);
+ssize_t shmem_buffer_write_commit(const void *_param, void *_ctx, size_t count);
+ssize_t shmem_buffer_read_acquire(const void *_param, void *_ctx, struct iovec *iov);
+int shmem_buffer_read_release(const void *_param, void *_ctx);
+ssize_t shmem_buffer_write_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen);
+ssize_t shmem_buffer_read_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen);
+ssize_t shmem_buffer_writev(const void *_param, void *_ctx, const struct iovec *iov, int iovcnt);
+ssize_t shmem_buffer_peek_len(const void *_param, void *_ctx);
 
-#define PIRATE_SHMEM_CHANNEL_FUNCS { shmem_buffer_parse_param, shmem_buffer_get_channel_description, shmem_buffer_open, shmem_buffer_close, shmem_buffer_read, shmem_buffer_write, shmem_buffer_write_mtu }
+// Creates the region of a channel in a sealed memfd.
+// Returns the file descriptor or -1 with errno set.
+int shmem_buffer_create(void *_param);
+
+#define PIRATE_SHMEM_CHANNEL_FUNCS { shmem_buffer_parse_param, shmem_buffer_get_channel_description, shmem_buffer_open, shmem_buffer_close, shmem_buffer_read, shmem_buffer_write, shmem_buffer_write_mtu, shmem_buffer_write_reserve, shmem_buffer_write_commit, shmem_buffer_read_acquire, shmem_buffer_read_release, shmem_buffer_write_batch, shmem_buffer_read_batch, shmem_buffer_writev, shmem_buffer_peek_len }
 
 #else
 
-#define PIRATE_SHMEM_CHANNEL_FUNCS { NULL, NULL, NULL, NULL, NULL, NULL, NULL }
+#define PIRATE_SHMEM_CHANNEL_FUNCS { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL }
 
 #endif
 
@@ -0,0 +1,719 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "pirate_common.h"
+#include "shmem_mpmc.h"
+
+// number of polls between reads of the clock
+#define SPIN_CLOCK_INTERVAL 64
+
+// A process sleeping on a slot that is claimed by another
+// process checks at this interval whether the owner has exited
+#define SHMEM_MPMC_LIVENESS_NS 10000000
+
+// A process waiting on the ring checks at this interval whether
+// any reader or writer has exited without closing the channel
+#define SHMEM_MPMC_REAP_NS 100000000
+
+// pid of this process, stored in the state of the claimed slots
+static uint64_t shmem_mpmc_pid;
+
+static void shmem_mpmc_atfork_child(void) {
+    shmem_mpmc_pid = getpid();
+}
+
+static void __attribute__((constructor)) shmem_mpmc_init_pid(void) {
+    shmem_mpmc_pid = getpid();
+    pthread_atfork(NULL, NULL, shmem_mpmc_atfork_child);
+}
+
+// The futex words are in memory shared between processes
+// so the FUTEX_PRIVATE_FLAG must not be used.
+static inline long futex(pirate_atomic_uint32 *uaddr, int op, uint32_t val, const struct timespec *timeout) {
+    return syscall(SYS_futex, uaddr, op, val, timeout, NULL, 0);
+}
+
+static inline uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static inline void shmem_wait_stats_add(uint64_t *counter, uint64_t val) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + val, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t shmem_mpmc_state(uint64_t seq, uint64_t owner) {
+    return (seq << SHMEM_MPMC_OWNER_BITS) | owner;
+}
+
+// Difference between the sequence number of a state and seq.
+// The sequence numbers of the states wrap around at 2^40.
+static inline int64_t shmem_mpmc_diff(uint64_t state, uint64_t seq) {
+    uint64_t diff = (state >> SHMEM_MPMC_OWNER_BITS) - seq;
+    return ((int64_t) (diff << SHMEM_MPMC_OWNER_BITS)) >> SHMEM_MPMC_OWNER_BITS;
+}
+
+static inline shmem_mpmc_slot_t *shmem_mpmc_slot(shmem_mpmc_t *ring, uint64_t pos) {
+    unsigned char *slots = (unsigned char *)(ring + 1);
+    return (shmem_mpmc_slot_t *)(slots + (pos % ring->slots) * ring->stride);
+}
+
+static inline unsigned char *shmem_mpmc_data(shmem_mpmc_slot_t *slot) {
+    return (unsigned char *)(slot + 1);
+}
+
+static inline size_t shmem_mpmc_alloc_size(uint64_t slots, uint64_t stride) {
+    return sizeof(shmem_mpmc_t) + slots * stride;
+}
+
+static inline uint64_t shmem_mpmc_stride(uint64_t slot_size) {
+    uint64_t len = sizeof(shmem_mpmc_slot_t) + slot_size;
+    return (len + PIRATE_CACHE_LINE_SIZE - 1) & ~((uint64_t) PIRATE_CACHE_LINE_SIZE - 1);
+}
+
+static void shmem_mpmc_init_param(pirate_shmem_mpmc_param_t *param) {
+    if (param->slots == 0) {
+        param->slots = PIRATE_DEFAULT_SHMEM_MPMC_SLOTS;
+    }
+    if (param->slot_size == 0) {
+        param->slot_size = PIRATE_DEFAULT_SHMEM_MPMC_SLOT_SIZE;
+    }
+    if (param->spin_ns == 0) {
+        param->spin_ns = PIRATE_DEFAULT_SMEM_SPIN_NS;
+    }
+}
+
+int shmem_mpmc_parse_param(char *str, void *_param) {
+    pirate_shmem_mpmc_param_t *param = (pirate_shmem_mpmc_param_t *)_param;
+    char *ptr = NULL, *key, *val;
+    char *saveptr1, *saveptr2;
+
+    if (((ptr = strtok_r(str, OPT_DELIM, &saveptr1)) == NULL) ||
+        (strcmp(ptr, "shmem_mpmc") != 0)) {
+        return -1;
+    }
+
+    if ((ptr = strtok_r(NULL, OPT_DELIM, &saveptr1)) == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    strncpy(param->path, ptr, sizeof(param->path) - 1);
+
+    while ((ptr = strtok_r(NULL, OPT_DELIM, &saveptr1)) != NULL) {
+        int rv = pirate_parse_key_value(&key, &val, ptr, &saveptr2);
+        if (rv < 0) {
+            return rv;
+        } else if (rv == 0) {
+            continue;
+        }
+        rv = shmem_buffer_parse_mem(key, val, &param->mem);
+        if (rv < 0) {
+            return rv;
+        } else if (rv > 0) {
+            continue;
+        }
+        if (strncmp("slot_size", key, strlen("slot_size")) == 0) {
+            param->slot_size = strtol(val, NULL, 10);
+        } else if (strncmp("slots", key, strlen("slots")) == 0) {
+            param->slots = strtol(val, NULL, 10);
+        } else if (strncmp("mtu", key, strlen("mtu")) == 0) {
+            param->mtu = strtol(val, NULL, 10);
+        } else if (strncmp("wait", key, strlen("wait")) == 0) {
+            if (shmem_buffer_parse_wait(val, &param->wait) < 0) {
+                return -1;
+            }
+        } else if (strncmp("spin_ns", key, strlen("spin_ns")) == 0) {
+            param->spin_ns = strtol(val, NULL, 10);
+        } else {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int shmem_mpmc_get_channel_description(const void *_param, char *desc, int len) {
+    const pirate_shmem_mpmc_param_t *param = (const pirate_shmem_mpmc_param_t *)_param;
+    char slots_str[32];
+    char slot_size_str[32];
+    char mtu_str[32];
+    char wait_str[32];
+    char spin_ns_str[32];
+    char mem_str[96];
+
+    slots_str[0] = 0;
+    slot_size_str[0] = 0;
+    mtu_str[0] = 0;
+    wait_str[0] = 0;
+    spin_ns_str[0] = 0;
+    if ((param->slots != 0) && (param->slots != PIRATE_DEFAULT_SHMEM_MPMC_SLOTS)) {
+        snprintf(slots_str, 32, ",slots=%u", param->slots);
+    }
+    if ((param->slot_size != 0) && (param->slot_size != PIRATE_DEFAULT_SHMEM_MPMC_SLOT_SIZE)) {
+        snprintf(slot_size_str, 32, ",slot_size=%u", param->slot_size);
+    }
+    if (param->mtu != 0) {
+        snprintf(mtu_str, 32, ",mtu=%u", param->mtu);
+    }
+    if ((param->wait != PIRATE_WAIT_ADAPTIVE) && (shmem_buffer_wait_name(param->wait) != NULL)) {
+        snprintf(wait_str, 32, ",wait=%s", shmem_buffer_wait_name(param->wait));
+    }
+    if ((param->spin_ns != 0) && (param->spin_ns != PIRATE_DEFAULT_SMEM_SPIN_NS)) {
+        snprintf(spin_ns_str, 32, ",spin_ns=%u", param->spin_ns);
+    }
+    shmem_buffer_mem_description(&param->mem, mem_str, sizeof(mem_str));
+    return snprintf(desc, len, "shmem_mpmc,%s%s%s%s%s%s%s", param->path, slots_str,
+        slot_size_str, mtu_str, wait_str, spin_ns_str, mem_str);
+}
+
+// The shared memory is initialized by the first process that
+// opens the channel. The following processes must use the same
+// number of slots and slot size.
+static shmem_mpmc_t *shmem_mpmc_init(int fd, const pirate_shmem_mpmc_param_t *param, size_t alloc_size) {
+    const uint64_t stride = shmem_mpmc_stride(param->slot_size);
+    shmem_mpmc_t *ring;
+    struct stat st;
+    int err, success = 0;
+
+    if ((fstat(fd, &st) != 0) ||
+        (((size_t) st.st_size < alloc_size) && (ftruncate(fd, alloc_size) != 0))) {
+        err = errno;
+        close(fd);
+        errno = err;
+        return NULL;
+    }
+
+    ring = (shmem_mpmc_t *)shmem_buffer_mem_map(fd, alloc_size, &param->mem);
+    if (ring == MAP_FAILED) {
+        return NULL;
+    }
+
+    while (!success) {
+        uint64_t init = atomic_load(&ring->init);
+        switch (init) {
+
+        case 0:
+            if (atomic_compare_exchange_weak(&ring->init, &init, 1)) {
+                success = 1;
+            }
+            break;
+
+        case 1:
+            // wait for initialization
+            break;
+
+        case 2:
+            if ((ring->slots != param->slots) || (ring->slot_size != param->slot_size)) {
+                munmap(ring, alloc_size);
+                errno = EINVAL;
+                return NULL;
+            }
+            return ring;
+
+        default:
+            munmap(ring, alloc_size);
+            errno = EINVAL;
+            return NULL;
+        }
+    }
+
+    ring->slots = param->slots;
+    ring->slot_size = param->slot_size;
+    ring->stride = stride;
+    memcpy(ring->path, param->path, sizeof(ring->path));
+    // the slot at position i is free for the writer at position i
+    for (uint64_t i = 0; i < ring->slots; i++) {
+        atomic_store_explicit(&shmem_mpmc_slot(ring, i)->state,
+            shmem_mpmc_state(i, 0), memory_order_relaxed);
+    }
+    atomic_store(&ring->init, 2);
+    return ring;
+}
+
+static void shmem_mpmc_wake(shmem_mpmc_t *ring, int access) {
+    pirate_atomic_uint32 *wake = (access == O_RDONLY) ? &ring->reader_wake : &ring->writer_wake;
+
+    atomic_fetch_add(wake, 1);
+    futex(wake, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+static inline int shmem_mpmc_alive(uint64_t owner) {
+    int err = errno, alive;
+
+    alive = (kill(owner & SHMEM_MPMC_PID_MASK, 0) == 0) || (errno != ESRCH);
+    errno = err;
+    return alive;
+}
+
+// Removes the readers and writers that have exited without closing
+// the channel from the counts, and wakes up both sides to observe
+// the new counts. Returns 1 when a participant was removed.
+static int shmem_mpmc_reap(shmem_mpmc_t *ring) {
+    int reaped = 0;
+
+    for (int i = 0; i < SHMEM_MPMC_PARTICIPANTS; i++) {
+        uint64_t owner = atomic_load(&ring->participants[i]);
+        if ((owner == 0) || shmem_mpmc_alive(owner)) {
+            continue;
+        }
+        if (atomic_compare_exchange_strong(&ring->participants[i], &owner, 0)) {
+            atomic_fetch_sub((owner & SHMEM_MPMC_OWNER_READER) ? &ring->readers : &ring->writers, 1);
+            reaped = 1;
+        }
+    }
+    if (reaped) {
+        shmem_mpmc_wake(ring, O_RDONLY);
+        shmem_mpmc_wake(ring, O_WRONLY);
+    }
+    return reaped;
+}
+
+// Records a reader or writer in a free participant slot. The count
+// is incremented first so that it is never decremented by a reap
+// before it is incremented. Returns the index of the slot or -1.
+static int shmem_mpmc_join(shmem_mpmc_t *ring, int access) {
+    pirate_atomic_uint64 *count = (access == O_RDONLY) ? &ring->readers : &ring->writers;
+    uint64_t owner = shmem_mpmc_pid;
+
+    if (access == O_RDONLY) {
+        owner |= SHMEM_MPMC_OWNER_READER;
+    }
+    atomic_fetch_add(count, 1);
+    for (int i = 0; i < SHMEM_MPMC_PARTICIPANTS; i++) {
+        uint64_t expected = 0;
+        if (atomic_compare_exchange_strong(&ring->participants[i], &expected, owner)) {
+            return i;
+        }
+    }
+    atomic_fetch_sub(count, 1);
+    return -1;
+}
+
+// Returns 1 when the participant slot was still held by this
+// process and the reader or writer has been removed from the count.
+static int shmem_mpmc_leave(shmem_mpmc_t *ring, int access, int participant) {
+    pirate_atomic_uint64 *count = (access == O_RDONLY) ? &ring->readers : &ring->writers;
+    uint64_t owner = shmem_mpmc_pid;
+
+    if (access == O_RDONLY) {
+        owner |= SHMEM_MPMC_OWNER_READER;
+    }
+    // a child process that has inherited the gaps descriptor
+    // does not hold the participant slot of its parent
+    if (!atomic_compare_exchange_strong(&ring->participants[participant], &owner, 0)) {
+        return 0;
+    }
+    atomic_fetch_sub(count, 1);
+    return 1;
+}
+
+static void shmem_mpmc_wait_opened(pirate_atomic_uint32 *opened) {
+    while (atomic_load(opened) == 0) {
+        futex(opened, FUTEX_WAIT, 0, NULL);
+    }
+}
+
+int shmem_mpmc_open(void *_param, void *_ctx) {
+    pirate_shmem_mpmc_param_t *param = (pirate_shmem_mpmc_param_t *)_param;
+    shmem_mpmc_ctx *ctx = (shmem_mpmc_ctx *)_ctx;
+    int access = ctx->flags & O_ACCMODE;
+    shmem_mpmc_t *ring;
+    int fd;
+
+    shmem_mpmc_init_param(param);
+    ctx->ring = NULL;
+    if ((strnlen(param->path, 1) == 0) || (param->slots < 2) ||
+        (shmem_mpmc_pid > SHMEM_MPMC_PID_MASK)) {
+        errno = EINVAL;
+        return -1;
+    }
+    // The shared memory is unlinked by the last process to close the
+    // channel so that readers and writers can join at any time.
+    fd = shmem_buffer_mem_open(param->path, &param->mem);
+    if (fd < 0) {
+        return -1;
+    }
+    ctx->alloc_size = shmem_buffer_mem_size(shmem_mpmc_alloc_size(param->slots,
+        shmem_mpmc_stride(param->slot_size)), &param->mem);
+    ctx->mem = param->mem;
+    if ((ring = shmem_mpmc_init(fd, param, ctx->alloc_size)) == NULL) {
+        return -1;
+    }
+
+    // The participants left by processes that have exited are
+    // reaped so that their slots are available
+    shmem_mpmc_reap(ring);
+    if ((ctx->participant = shmem_mpmc_join(ring, access)) < 0) {
+        munmap(ring, ctx->alloc_size);
+        errno = EBUSY;
+        return -1;
+    }
+
+    // The first reader waits for the first writer and vice versa
+    if (access == O_RDONLY) {
+        atomic_store(&ring->reader_opened, 1);
+        futex(&ring->reader_opened, FUTEX_WAKE, INT_MAX, NULL);
+        shmem_mpmc_wait_opened(&ring->writer_opened);
+    } else {
+        atomic_store(&ring->writer_opened, 1);
+        futex(&ring->writer_opened, FUTEX_WAKE, INT_MAX, NULL);
+        shmem_mpmc_wait_opened(&ring->reader_opened);
+    }
+    ctx->ring = ring;
+    return pirate_next_gd();
+}
+
+int shmem_mpmc_close(void *_ctx) {
+    shmem_mpmc_ctx *ctx = (shmem_mpmc_ctx *)_ctx;
+    shmem_mpmc_t *ring = ctx->ring;
+    int access = ctx->flags & O_ACCMODE;
+    int err = errno;
+
+    if (ring == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+
+    // Wakes up the other side to observe that the channel is closed
+    if (shmem_mpmc_leave(ring, access, ctx->participant)) {
+        shmem_mpmc_wake(ring, (access == O_RDONLY) ? O_WRONLY : O_RDONLY);
+    }
+    if ((atomic_load(&ring->readers) == 0) && (atomic_load(&ring->writers) == 0)) {
+        if ((shmem_buffer_mem_unlink(ring->path, &ctx->mem) != 0) && (errno == ENOENT)) {
+            errno = err;
+        }
+    }
+    ctx->ring = NULL;
+    return munmap(ring, ctx->alloc_size);
+}
+
+int shmem_mpmc_try_claim(shmem_mpmc_t *ring, int access, uint64_t *pos, uint64_t *state) {
+    pirate_atomic_uint64 *head;
+    uint64_t offset, owner = shmem_mpmc_pid;
+
+    // The writer at position p expects sequence number p
+    // and the reader at position p expects p + 1
+    if (access == O_RDONLY) {
+        head = &ring->dequeue;
+        offset = 1;
+        owner |= SHMEM_MPMC_OWNER_READER;
+    } else {
+        head = &ring->enqueue;
+        offset = 0;
+    }
+
+    for (;;) {
+        uint64_t p = atomic_load_explicit(head, memory_order_acquire);
+        shmem_mpmc_slot_t *slot = shmem_mpmc_slot(ring, p);
+        uint64_t s = atomic_load_explicit(&slot->state, memory_order_acquire);
+        int64_t diff = shmem_mpmc_diff(s, p + offset);
+
+        if ((diff == 0) && ((s & SHMEM_MPMC_OWNER_MASK) == 0)) {
+            if (atomic_compare_exchange_weak_explicit(&slot->state, &s,
+                    shmem_mpmc_state(p + offset, owner),
+                    memory_order_acquire, memory_order_relaxed)) {
+                atomic_compare_exchange_strong(head, &p, p + 1);
+                *pos = p;
+                return 1;
+            }
+        } else if (diff >= 0) {
+            // The slot at position p has been claimed. The position
+            // is moved forward on behalf of the owner, which may have
+            // exited before moving it.
+            atomic_compare_exchange_strong(head, &p, p + 1);
+        } else {
+            *pos = p;
+            *state = s;
+            return 0;
+        }
+    }
+}
+
+// Skips the slot at position pos when the process that has claimed
+// it has exited. A writer claim is skipped as if the packet was read,
+// a reader claim is released. Returns 1 when the slot was skipped.
+static int shmem_mpmc_reclaim(shmem_mpmc_t *ring, uint64_t pos, uint64_t state) {
+    uint64_t owner = state & SHMEM_MPMC_OWNER_MASK;
+    uint64_t seq = state >> SHMEM_MPMC_OWNER_BITS;
+
+    if ((owner == 0) || shmem_mpmc_alive(owner)) {
+        return 0;
+    }
+    seq += ring->slots;
+    if (owner & SHMEM_MPMC_OWNER_READER) {
+        seq -= 1;
+    }
+    if (atomic_compare_exchange_strong(&shmem_mpmc_slot(ring, pos)->state, &state,
+            shmem_mpmc_state(seq, 0))) {
+        atomic_fetch_add(&ring->abandoned, 1);
+        shmem_mpmc_wake(ring, O_RDONLY);
+        shmem_mpmc_wake(ring, O_WRONLY);
+    }
+    return 1;
+}
+
+// Returns non-zero when the slot at position pos no longer holds
+// state, the position has moved, or the other side has closed the channel.
+static inline int shmem_mpmc_changed(shmem_mpmc_t *ring, int access, uint64_t pos, uint64_t state) {
+    pirate_atomic_uint64 *head = (access == O_RDONLY) ? &ring->dequeue : &ring->enqueue;
+    pirate_atomic_uint64 *peers = (access == O_RDONLY) ? &ring->writers : &ring->readers;
+
+    return (atomic_load(peers) == 0) || (atomic_load(head) != pos) ||
+        (atomic_load(&shmem_mpmc_slot(ring, pos)->state) != state);
+}
+
+// The waiting counter is incremented before the state is loaded,
+// and the other side stores the state before it loads the counter.
+// Either the other side observes the counter and increments the
+// futex word, or this side observes the new state. A slot that is
+// claimed by another process is polled at SHMEM_MPMC_LIVENESS_NS
+// to check whether its owner has exited, and any other slot at
+// SHMEM_MPMC_REAP_NS to check whether a peer has exited.
+static void shmem_mpmc_wait(const pirate_shmem_mpmc_param_t *param, shmem_mpmc_ctx *ctx,
+                            int access, uint64_t pos, uint64_t state) {
+    shmem_mpmc_t *ring = ctx->ring;
+    pirate_atomic_uint64 *waiting;
+    pirate_atomic_uint32 *wake;
+    struct timespec liveness = { 0, SHMEM_MPMC_LIVENESS_NS };
+    struct timespec reap = { 0, SHMEM_MPMC_REAP_NS };
+    uint64_t deadline = 0;
+    uint32_t seq;
+    int err = errno;
+
+    if (param->wait != PIRATE_WAIT_FUTEX) {
+        if (param->wait == PIRATE_WAIT_ADAPTIVE) {
+            deadline = monotonic_ns() + param->spin_ns;
+        }
+        for (unsigned spin = 1; ; spin++) {
+            if (shmem_mpmc_changed(ring, access, pos, state)) {
+                return;
+            }
+            if (param->wait == PIRATE_WAIT_YIELD) {
+                sched_yield();
+            } else {
+                cpu_relax();
+            }
+            if ((spin % SPIN_CLOCK_INTERVAL) == 0) {
+                if ((param->wait == PIRATE_WAIT_ADAPTIVE) && (monotonic_ns() >= deadline)) {
+                    break;
+                }
+                if (param->wait != PIRATE_WAIT_ADAPTIVE) {
+                    return;
+                }
+            }
+        }
+    }
+
+    if (access == O_RDONLY) {
+        waiting = &ring->readers_waiting;
+        wake = &ring->reader_wake;
+    } else {
+        waiting = &ring->writers_waiting;
+        wake = &ring->writer_wake;
+    }
+    atomic_fetch_add(waiting, 1);
+    seq = atomic_load(wake);
+    if (!shmem_mpmc_changed(ring, access, pos, state)) {
+        futex(wake, FUTEX_WAIT, seq, (state & SHMEM_MPMC_OWNER_MASK) ? &liveness : &reap);
+        shmem_wait_stats_add(&ctx->wait_stats.wakeups, 1);
+    }
+    atomic_fetch_sub(waiting, 1);
+    // a timeout or an interrupted wait is not an error
+    errno = err;
+}
+
+// Publishes (writer) or releases (reader) a slot and wakes
+// up the other side if it is sleeping. The sequentially consistent
+// store is ordered before the load of the waiting counter.
+static void shmem_mpmc_publish(shmem_mpmc_t *ring, int access, uint64_t pos) {
+    shmem_mpmc_slot_t *slot = shmem_mpmc_slot(ring, pos);
+
+    if (access == O_RDONLY) {
+        atomic_store(&slot->state, shmem_mpmc_state(pos + ring->slots, 0));
+        if (atomic_load(&ring->writers_waiting)) {
+            shmem_mpmc_wake(ring, O_WRONLY);
+        }
+    } else {
+        atomic_store(&slot->state, shmem_mpmc_state(pos + 1, 0));
+        if (atomic_load(&ring->readers_waiting)) {
+            shmem_mpmc_wake(ring, O_RDONLY);
+        }
+    }
+}
+
+// Claims a slot and sets pos to its position. Returns 1 on
+// success. The reader returns 0 when every writer has closed the
+// channel and the ring is empty. The writer returns -1 when every
+// reader has closed the channel.
+static int shmem_mpmc_claim(const pirate_shmem_mpmc_param_t *param, shmem_mpmc_ctx *ctx,
+                            int access, uint64_t *pos) {
+    shmem_mpmc_t *ring = ctx->ring;
+    pirate_atomic_uint64 *peers = (access == O_RDONLY) ? &ring->writers : &ring->readers;
+    uint64_t state, start = 0, reaped = 0, now;
+    int rv = 1;
+
+    for (;;) {
+        // the number of writers is loaded before the slot so
+        // all packets published before the close are observed
+        int closed = atomic_load(peers) == 0;
+        if (closed && (access == O_WRONLY)) {
+            kill(getpid(), SIGPIPE);
+            errno = EPIPE;
+            rv = -1;
+            break;
+        }
+        if (shmem_mpmc_try_claim(ring, access, pos, &state)) {
+            break;
+        }
+        if (closed) {
+            rv = 0;
+            break;
+        }
+        if (shmem_mpmc_reclaim(ring, *pos, state)) {
+            continue;
+        }
+        now = monotonic_ns();
+        if (start == 0) {
+            start = reaped = now;
+        } else if (now - reaped >= SHMEM_MPMC_REAP_NS) {
+            // every peer may have exited without closing the channel
+            reaped = now;
+            if (shmem_mpmc_reap(ring)) {
+                continue;
+            }
+        }
+        shmem_mpmc_wait(param, ctx, access, *pos, state);
+    }
+    if (start != 0) {
+        shmem_wait_stats_add(&ctx->wait_stats.waits, 1);
+        shmem_wait_stats_add(&ctx->wait_stats.blocked_ns, monotonic_ns() - start);
+    }
+    return rv;
+}
+
+ssize_t shmem_mpmc_read(const void *_param, void *_ctx, void *buf, size_t count) {
+    const pirate_shmem_mpmc_param_t *param = (const pirate_shmem_mpmc_param_t *)_param;
+    shmem_mpmc_ctx *ctx = (shmem_mpmc_ctx *)_ctx;
+    shmem_mpmc_t *ring = ctx->ring;
+    shmem_mpmc_slot_t *slot;
+    uint64_t pos;
+    int rv;
+
+    if (ring == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+    if ((rv = shmem_mpmc_claim(param, ctx, O_RDONLY, &pos)) <= 0) {
+        return rv;
+    }
+    slot = shmem_mpmc_slot(ring, pos);
+    count = MIN(count, slot->len);
+    memcpy(buf, shmem_mpmc_data(slot), count);
+    shmem_mpmc_publish(ring, O_RDONLY, pos);
+    return count;
+}
+
+ssize_t shmem_mpmc_write_mtu(const void *_param, void *_ctx) {
+    (void) _ctx;
+    const pirate_shmem_mpmc_param_t *param = (const pirate_shmem_mpmc_param_t *)_param;
+    size_t slot_size = param->slot_size;
+    size_t mtu = param->mtu;
+
+    if (slot_size == 0) {
+        slot_size = PIRATE_DEFAULT_SHMEM_MPMC_SLOT_SIZE;
+    }
+    if (mtu == 0) {
+        return slot_size;
+    }
+    if (mtu < sizeof(pirate_header_t)) {
+        errno = EINVAL;
+        return -1;
+    }
+    return MIN(slot_size, mtu - sizeof(pirate_header_t));
+}
+
+ssize_t shmem_mpmc_writev(const void *_param, void *_ctx, const struct iovec *iov, int iovcnt) {
+    const pirate_shmem_mpmc_param_t *param = (const pirate_shmem_mpmc_param_t *)_param;
+    shmem_mpmc_ctx *ctx = (shmem_mpmc_ctx *)_ctx;
+    shmem_mpmc_t *ring = ctx->ring;
+    shmem_mpmc_slot_t *slot;
+    unsigned char *data;
+    size_t count = 0;
+    ssize_t mtu;
+    uint64_t pos;
+
+    if (ring == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+    if ((iovcnt < 0) || (iovcnt > PIRATE_IOV_MAX)) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (int i = 0; i < iovcnt; i++) {
+        count += iov[i].iov_len;
+    }
+    if ((mtu = shmem_mpmc_write_mtu(param, ctx)) < 0) {
+        return -1;
+    }
+    if (count > (size_t) mtu) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if (shmem_mpmc_claim(param, ctx, O_WRONLY, &pos) < 0) {
+        return -1;
+    }
+    slot = shmem_mpmc_slot(ring, pos);
+    data = shmem_mpmc_data(slot);
+    for (int i = 0; i < iovcnt; i++) {
+        memcpy(data, iov[i].iov_base, iov[i].iov_len);
+        data += iov[i].iov_len;
+    }
+    slot->len = count;
+    shmem_mpmc_publish(ring, O_WRONLY, pos);
+    return count;
+}
+
+ssize_t shmem_mpmc_write(const void *_param, void *_ctx, const void *buf, size_t count) {
+    struct iovec iov;
+
+    iov.iov_base = (void *) buf;
+    iov.iov_len = count;
+    return shmem_mpmc_writev(_param, _ctx, &iov, 1);
+}
@@ -0,0 +1,127 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#ifndef __PIRATE_CHANNEL_SHMEM_MPMC_H
+#define __PIRATE_CHANNEL_SHMEM_MPMC_H
+
+#include <sys/uio.h>
+#include "libpirate.h"
+#include "shmem_buffer.h"
+
+// The state of a slot holds a sequence number in the upper
+// 40 bits and the owner of the slot in the lower 24 bits.
+// The owner is the pid of the process that has claimed the
+// slot and has not yet published (writer) or released (reader)
+// it, or 0. SHMEM_MPMC_OWNER_READER is set on a reader claim.
+#define SHMEM_MPMC_OWNER_BITS   24
+#define SHMEM_MPMC_OWNER_MASK   ((1ull << SHMEM_MPMC_OWNER_BITS) - 1)
+#define SHMEM_MPMC_OWNER_READER (1ull << (SHMEM_MPMC_OWNER_BITS - 1))
+#define SHMEM_MPMC_PID_MASK     (SHMEM_MPMC_OWNER_READER - 1)
+
+// Maximum number of open readers and writers. Each holds a
+// participant slot with its owner value (as above) until it
+// closes the channel or is found to have exited.
+#define SHMEM_MPMC_PARTICIPANTS 128
+
+// A bounded multi-producer multi-consumer queue (D. Vyukov).
+// The writer claims the slot at position enqueue when the
+// sequence number of the slot equals enqueue, and publishes it by
+// storing enqueue + 1. The reader claims the slot at position
+// dequeue when its sequence number equals dequeue + 1, and releases
+// it by storing dequeue + slots. A slot is claimed with a compare
+// and swap of its state, then the position is moved forward.
+// Any process that observes a claimed slot moves the position
+// forward on behalf of the owner. A slot whose owner has exited
+// without publishing or releasing it is skipped.
+typedef struct {
+    pirate_atomic_uint64    enqueue __attribute__((aligned(PIRATE_CACHE_LINE_SIZE)));
+    pirate_atomic_uint64    dequeue __attribute__((aligned(PIRATE_CACHE_LINE_SIZE)));
+    pirate_atomic_uint64    init __attribute__((aligned(PIRATE_CACHE_LINE_SIZE)));
+    // number of open readers (writers), including the
+    // ones that have exited and have not been reaped
+    pirate_atomic_uint64    readers;
+    pirate_atomic_uint64    writers;
+    // number of readers (writers) sleeping on their futex
+    pirate_atomic_uint64    readers_waiting;
+    pirate_atomic_uint64    writers_waiting;
+    // number of slots skipped because their owner has exited
+    pirate_atomic_uint64    abandoned;
+    // futex words of the readers (writers), incremented on each wakeup
+    pirate_atomic_uint32    reader_wake;
+    pirate_atomic_uint32    writer_wake;
+    // non-zero once a reader (writer) has opened the channel
+    pirate_atomic_uint32    reader_opened;
+    pirate_atomic_uint32    writer_opened;
+    uint64_t                slots;
+    uint64_t                slot_size;
+    // distance between slots, a multiple of the cache line size
+    uint64_t                stride;
+    char                    path[PIRATE_LEN_NAME];
+    // owner values of the open readers and writers, or 0
+    pirate_atomic_uint64    participants[SHMEM_MPMC_PARTICIPANTS];
+} shmem_mpmc_t;
+
+typedef struct {
+    pirate_atomic_uint64    state;
+    uint32_t                len;
+    uint32_t                reserved;
+} shmem_mpmc_slot_t;
+
+typedef struct {
+    int flags;
+    shmem_mpmc_t *ring;
+    // index of the participant slot of this gaps descriptor
+    int participant;
+    // length of the mapping of ring
+    size_t alloc_size;
+    pirate_shmem_mem_t mem;
+    shmem_wait_stats_t wait_stats;
+} shmem_mpmc_ctx;
+
+#ifdef PIRATE_SHMEM_FEATURE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Claims the next slot for the reader (access == O_RDONLY) or the
+// writer (access == O_WRONLY) without waiting. Returns 1 and sets
+// pos on success. Returns 0 when the ring is empty (reader) or full
+// (writer), and sets pos and state to the position and the state of
+// the slot that is not available. Declared for testing purposes.
+int shmem_mpmc_try_claim(shmem_mpmc_t *ring, int access, uint64_t *pos, uint64_t *state);
+
+int shmem_mpmc_parse_param(char *str, void *_param);
+int shmem_mpmc_get_channel_description(const void *_param, char *desc, int len);
+int shmem_mpmc_open(void *_param, void *_ctx);
+int shmem_mpmc_close(void *_ctx);
+ssize_t shmem_mpmc_read(const void *_param, void *_ctx, void *buf, size_t count);
+ssize_t shmem_mpmc_write(const void *_param, void *_ctx, const void *buf, size_t count);
+ssize_t shmem_mpmc_write_mtu(const void *_param, void *_ctx);
+ssize_t shmem_mpmc_writev(const void *_param, void *_ctx, const struct iovec *iov, int iovcnt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define PIRATE_SHMEM_MPMC_CHANNEL_FUNCS { shmem_mpmc_parse_param, shmem_mpmc_get_channel_description, shmem_mpmc_open, shmem_mpmc_close, shmem_mpmc_read, shmem_mpmc_write, shmem_mpmc_write_mtu, NULL, NULL, NULL, NULL, NULL, NULL, shmem_mpmc_writev, NULL }
+
+#else
+
+#define PIRATE_SHMEM_MPMC_CHANNEL_FUNCS { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL }
+
+#endif
+
+#endif /* __PIRATE_CHANNEL_SHMEM_MPMC_H */
@@ -0,0 +1,96 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#include <endian.h>
+#include <string.h>
+#include "siphash.h"
+
+// SipRound is a chain of dependent additions, rotations, and xors
+// on four 64-bit words. A vector implementation needs a lane swap
+// between each half round and is slower than the scalar code.
+#define ROTL64(x, b) (uint64_t) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND                                                            \
+    do {                                                                    \
+        v0 += v1; v1 = ROTL64(v1, 13); v1 ^= v0; v0 = ROTL64(v0, 32);       \
+        v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2;                            \
+        v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0;                            \
+        v2 += v1; v1 = ROTL64(v1, 17); v1 ^= v2; v2 = ROTL64(v2, 32);       \
+    } while (0)
+
+static inline uint64_t load_le64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return le64toh(v);
+}
+
+void pirate_siphash_key(pirate_siphash_key_t *key, const uint8_t bytes[PIRATE_SIPHASH_KEY_SIZE]) {
+    key->k0 = load_le64(bytes);
+    key->k1 = load_le64(bytes + 8);
+}
+
+static void siphash(const pirate_siphash_key_t *key, const void *data, size_t len,
+        uint64_t *out, int outlen) {
+    const uint8_t *in = (const uint8_t *) data;
+    const uint8_t *end = in + (len & ~(size_t) 7);
+    uint64_t v0 = 0x736f6d6570736575ull ^ key->k0;
+    uint64_t v1 = 0x646f72616e646f6dull ^ key->k1;
+    uint64_t v2 = 0x6c7967656e657261ull ^ key->k0;
+    uint64_t v3 = 0x7465646279746573ull ^ key->k1;
+    uint64_t m, b = ((uint64_t) len) << 56;
+    uint8_t tail[8] = { 0 };
+
+    if (outlen == 2) {
+        v1 ^= 0xee;
+    }
+    for (; in != end; in += 8) {
+        m = load_le64(in);
+        v3 ^= m;
+        SIPROUND;
+        SIPROUND;
+        v0 ^= m;
+    }
+    memcpy(tail, in, len & 7);
+    b |= load_le64(tail);
+    v3 ^= b;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= b;
+
+    v2 ^= (outlen == 2) ? 0xee : 0xff;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    out[0] = v0 ^ v1 ^ v2 ^ v3;
+    if (outlen == 2) {
+        v1 ^= 0xdd;
+        SIPROUND;
+        SIPROUND;
+        SIPROUND;
+        SIPROUND;
+        out[1] = v0 ^ v1 ^ v2 ^ v3;
+    }
+}
+
+uint64_t pirate_siphash64(const pirate_siphash_key_t *key, const void *data, size_t len) {
+    uint64_t out;
+    siphash(key, data, len, &out, 1);
+    return out;
+}
+
+void pirate_siphash128(const pirate_siphash_key_t *key, const void *data, size_t len, uint64_t out[2]) {
+    siphash(key, data, len, out, 2);
+}
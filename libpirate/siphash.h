@@ -0,0 +1,42 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#ifndef __PIRATE_SIPHASH_H
+#define __PIRATE_SIPHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// SipHash-2-4 keyed hash function of Aumasson and Bernstein.
+// The 128-bit variant uses the same compression function with
+// a different initialization and finalization.
+#define PIRATE_SIPHASH_KEY_SIZE 16
+
+typedef struct {
+    uint64_t k0;
+    uint64_t k1;
+} pirate_siphash_key_t;
+
+// Loads a key from its 16 byte little-endian encoding
+void pirate_siphash_key(pirate_siphash_key_t *key, const uint8_t bytes[PIRATE_SIPHASH_KEY_SIZE]);
+
+// Returns the 64-bit SipHash-2-4 of the data
+uint64_t pirate_siphash64(const pirate_siphash_key_t *key, const void *data, size_t len);
+
+// Stores the 128-bit SipHash-2-4 of the data. out[0] holds the
+// first 8 bytes of the little-endian encoded hash.
+void pirate_siphash128(const pirate_siphash_key_t *key, const void *data, size_t len, uint64_t out[2]);
+
+#endif /* __PIRATE_SIPHASH_H */
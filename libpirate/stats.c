@@ -0,0 +1,287 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+// time stamp counter ticks are calibrated against
+// CLOCK_MONOTONIC for at least this interval
+#define PIRATE_STATS_CALIBRATION_NS 1000000
+
+__thread unsigned pirate_stats_slot __attribute__((tls_model("initial-exec")));
+
+// bit i is set when the shard of slot i + 1 is not owned by a thread
+static unsigned free_slots = (1u << (PIRATE_STATS_SHARDS - 1)) - 1;
+static pthread_key_t slot_key;
+static pthread_once_t slot_key_once = PTHREAD_ONCE_INIT;
+static uint64_t base_ticks, base_ns;
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void __attribute__((constructor)) pirate_stats_init(void) {
+    base_ns = monotonic_ns();
+    base_ticks = pirate_stats_ticks();
+}
+
+// Returns the shard of an exiting thread to the free slots. The
+// release pairs with the acquire of the next owner, which continues
+// from the final values of the counters with plain stores.
+static void pirate_stats_release_slot(void *value) {
+    unsigned slot = (unsigned) (uintptr_t) value;
+    pirate_stats_slot = 0;
+    __atomic_fetch_or(&free_slots, 1u << (slot - 1), __ATOMIC_RELEASE);
+}
+
+static void pirate_stats_key_init(void) {
+    if (pthread_key_create(&slot_key, pirate_stats_release_slot) != 0) {
+        // shards cannot be released so none are handed out
+        __atomic_store_n(&free_slots, 0, __ATOMIC_RELAXED);
+    }
+}
+
+unsigned pirate_stats_assign_slot(void) {
+    unsigned slot = PIRATE_STATS_SHARDS;
+    unsigned free = __atomic_load_n(&free_slots, __ATOMIC_RELAXED);
+
+    pthread_once(&slot_key_once, pirate_stats_key_init);
+    while (free != 0) {
+        unsigned bit = __builtin_ctz(free);
+        if (__atomic_compare_exchange_n(&free_slots, &free, free & ~(1u << bit),
+                1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            if (pthread_setspecific(slot_key, (void *) (uintptr_t) (bit + 1)) != 0) {
+                __atomic_fetch_or(&free_slots, 1u << bit, __ATOMIC_RELEASE);
+                break;
+            }
+            slot = bit + 1;
+            break;
+        }
+    }
+    pirate_stats_slot = slot;
+    return slot;
+}
+
+pirate_stats_hist_t *pirate_stats_hist_alloc(pirate_stats_shard_t *shard) {
+    pirate_stats_hist_t *hist, *prev = NULL;
+
+    // the threads of the shared shard may race to allocate
+    if ((hist = calloc(1, sizeof(pirate_stats_hist_t))) == NULL) {
+        return NULL;
+    }
+    if (!__atomic_compare_exchange_n(&shard->hist, &prev, hist, 0,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free(hist);
+        hist = prev;
+    }
+    return hist;
+}
+
+void pirate_stats_reset(pirate_channel_stats_t *stats) {
+    for (int i = 0; i < PIRATE_STATS_SHARDS; i++) {
+        pirate_stats_shard_t *shard = &stats->shards[i];
+        pirate_stats_hist_t *hist = shard->hist;
+        memset(shard, 0, sizeof(pirate_stats_shard_t));
+        if (hist != NULL) {
+            memset(hist, 0, sizeof(pirate_stats_hist_t));
+        }
+        shard->hist = hist;
+    }
+    memset(&stats->snapshot, 0, sizeof(pirate_stats_t));
+}
+
+// Declared in libpirate_internal.h for testing purposes only
+unsigned pirate_stats_thread_slot() {
+    unsigned slot = pirate_stats_slot;
+    if (slot == 0) {
+        slot = pirate_stats_assign_slot();
+    }
+    return slot;
+}
+
+static double pirate_stats_ns_per_tick(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t ns = monotonic_ns();
+    if (ns < base_ns + PIRATE_STATS_CALIBRATION_NS) {
+        struct timespec ts = {0, base_ns + PIRATE_STATS_CALIBRATION_NS - ns};
+        nanosleep(&ts, NULL);
+        ns = monotonic_ns();
+    }
+    uint64_t ticks = pirate_stats_ticks();
+    if (ticks <= base_ticks) {
+        return 1.0;
+    }
+    return (double) (ns - base_ns) / (double) (ticks - base_ticks);
+#else
+    return 1.0;
+#endif
+}
+
+static inline uint64_t load(const uint64_t *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static inline void store(uint64_t *counter, uint64_t value) {
+    __atomic_store_n(counter, value, __ATOMIC_RELAXED);
+}
+
+// The counters are summed into a local copy and published while
+// snapshot_seq is odd, so concurrent callers take turns and each
+// counter of the snapshot always holds a complete total. The sums
+// are taken after the turn begins so the published totals never
+// go backwards.
+const pirate_stats_t *pirate_stats_merge(pirate_channel_stats_t *stats) {
+    pirate_stats_t *snapshot = &stats->snapshot;
+    pirate_stats_t merged;
+    uint32_t seq;
+
+    for (;;) {
+        seq = __atomic_load_n(&stats->snapshot_seq, __ATOMIC_RELAXED);
+        if (((seq & 1) == 0) && __atomic_compare_exchange_n(&stats->snapshot_seq, &seq, seq + 1,
+                0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+        sched_yield();
+    }
+
+    memset(&merged, 0, sizeof(pirate_stats_t));
+    for (int i = 0; i < PIRATE_STATS_SHARDS; i++) {
+        const pirate_stats_shard_t *shard = &stats->shards[i];
+        merged.requests += load(&shard->requests);
+        merged.success += load(&shard->success);
+        merged.errs += load(&shard->errs);
+        merged.fuzzed += load(&shard->fuzzed);
+        merged.bytes += load(&shard->bytes);
+        merged.truncated += load(&shard->truncated);
+        merged.undelivered += load(&shard->undelivered);
+    }
+    store(&snapshot->requests, merged.requests);
+    store(&snapshot->success, merged.success);
+    store(&snapshot->errs, merged.errs);
+    store(&snapshot->fuzzed, merged.fuzzed);
+    store(&snapshot->bytes, merged.bytes);
+    store(&snapshot->truncated, merged.truncated);
+    store(&snapshot->undelivered, merged.undelivered);
+
+    __atomic_store_n(&stats->snapshot_seq, seq + 2, __ATOMIC_RELEASE);
+    return snapshot;
+}
+
+static void pirate_histogram_merge(pirate_histogram_t *dst, const pirate_histogram_t *src) {
+    uint64_t complement = load(&src->min);
+    dst->count += load(&src->count);
+    dst->sum += load(&src->sum);
+    if (complement > dst->min) {
+        dst->min = complement;
+    }
+    if (load(&src->max) > dst->max) {
+        dst->max = load(&src->max);
+    }
+    for (int i = 0; i < PIRATE_HISTOGRAM_BUCKETS; i++) {
+        dst->buckets[i] += load(&src->buckets[i]);
+    }
+}
+
+static void pirate_histogram_scale(pirate_histogram_t *dst, const pirate_histogram_t *src, double scale) {
+    dst->count = src->count;
+    dst->sum = src->sum * scale;
+    dst->min = src->min * scale;
+    dst->max = src->max * scale;
+    for (int i = 0; i < PIRATE_HISTOGRAM_BUCKETS; i++) {
+        if (src->buckets[i] > 0) {
+            dst->buckets[pirate_histogram_bucket(pirate_histogram_value(i) * scale)] += src->buckets[i];
+        }
+    }
+}
+
+void pirate_stats_merge_ex(const pirate_channel_stats_t *stats, pirate_stats_ex_t *ex) {
+    pirate_histogram_t latency;
+
+    memset(ex, 0, sizeof(pirate_stats_ex_t));
+    memset(&latency, 0, sizeof(latency));
+    for (int i = 0; i < PIRATE_STATS_SHARDS; i++) {
+        const pirate_stats_shard_t *shard = &stats->shards[i];
+        ex->stats.requests += load(&shard->requests);
+        ex->stats.success += load(&shard->success);
+        ex->stats.errs += load(&shard->errs);
+        ex->stats.fuzzed += load(&shard->fuzzed);
+        ex->stats.bytes += load(&shard->bytes);
+        ex->stats.truncated += load(&shard->truncated);
+        ex->stats.undelivered += load(&shard->undelivered);
+        const pirate_stats_hist_t *hist = __atomic_load_n(&shard->hist, __ATOMIC_ACQUIRE);
+        if (hist != NULL) {
+            pirate_histogram_merge(&latency, &hist->latency);
+            pirate_histogram_merge(&ex->size, &hist->size);
+        }
+    }
+    if (ex->size.count > 0) {
+        ex->size.min = ~ex->size.min;
+    }
+    if (latency.count > 0) {
+        latency.min = ~latency.min;
+        pirate_histogram_scale(&ex->latency, &latency, pirate_stats_ns_per_tick());
+    }
+}
+
+uint64_t pirate_histogram_value(unsigned bucket) {
+    unsigned exp;
+    if (bucket < 8) {
+        return bucket;
+    }
+    if (bucket >= PIRATE_HISTOGRAM_BUCKETS) {
+        return UINT64_MAX;
+    }
+    exp = (bucket >> 2) + 1;
+    return (uint64_t) (4 + (bucket & 3)) << (exp - 2);
+}
+
+uint64_t pirate_histogram_percentile(const pirate_histogram_t *hist, double p) {
+    uint64_t rank, total = 0, value;
+
+    if (hist->count == 0) {
+        return 0;
+    }
+    if (p <= 0.0) {
+        return hist->min;
+    }
+    if (p >= 1.0) {
+        return hist->max;
+    }
+    // rank is the ceiling of p * count
+    rank = (uint64_t) (p * hist->count);
+    if (rank < p * hist->count) {
+        rank++;
+    }
+    for (unsigned i = 0; i < PIRATE_HISTOGRAM_BUCKETS; i++) {
+        total += hist->buckets[i];
+        if (total >= rank) {
+            value = pirate_histogram_value(i);
+            if (value < hist->min) {
+                return hist->min;
+            }
+            if (value > hist->max) {
+                return hist->max;
+            }
+            return value;
+        }
+    }
+    return hist->max;
+}
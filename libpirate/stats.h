@@ -0,0 +1,152 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#ifndef __PIRATE_STATS_H
+#define __PIRATE_STATS_H
+
+#include <stdint.h>
+#include <time.h>
+#include "libpirate.h"
+
+// Number of counter shards per gaps descriptor. Up to
+// PIRATE_STATS_SHARDS - 1 live threads that use libpirate each own a
+// shard and update it with plain loads and stores. A shard is released
+// when its thread exits and is reused by the next thread. All remaining
+// threads share the last shard and update it with atomic read-modify-write.
+#define PIRATE_STATS_SHARDS 8
+
+typedef struct {
+    pirate_histogram_t latency; // in ticks of pirate_stats_ticks()
+    pirate_histogram_t size;
+} pirate_stats_hist_t;
+
+// The histograms are 4 KB per shard and are allocated the first time
+// a thread records a packet on the gaps descriptor. A table entry that
+// is never used holds only the counters.
+typedef struct {
+    uint64_t requests;
+    uint64_t success;
+    uint64_t errs;
+    uint64_t fuzzed;
+    uint64_t bytes;
+    uint64_t truncated;
+    uint64_t undelivered;
+    pirate_stats_hist_t *hist; // NULL until first use, never freed
+} __attribute__((aligned(64))) pirate_stats_shard_t;
+
+typedef struct {
+    pirate_stats_shard_t shards[PIRATE_STATS_SHARDS];
+    // merged counters returned by pirate_get_stats()
+    pirate_stats_t snapshot;
+    // odd while a call to pirate_get_stats() updates the snapshot
+    uint32_t snapshot_seq;
+} pirate_channel_stats_t;
+
+// shard index + 1 of the current thread, or 0 when unassigned
+extern __thread unsigned pirate_stats_slot __attribute__((tls_model("initial-exec")));
+
+unsigned pirate_stats_assign_slot(void);
+
+static inline pirate_stats_shard_t *pirate_stats_shard(pirate_channel_stats_t *stats) {
+    unsigned slot = pirate_stats_slot;
+    if (slot == 0) {
+        slot = pirate_stats_assign_slot();
+    }
+    return &stats->shards[slot - 1];
+}
+
+static inline int pirate_stats_shared(void) {
+    return pirate_stats_slot == PIRATE_STATS_SHARDS;
+}
+
+// The relaxed load and store of an owned shard compiles to a plain
+// add. Readers on other threads never observe a torn value.
+static inline void pirate_stats_add(uint64_t *counter, uint64_t val) {
+    if (pirate_stats_shared()) {
+        __atomic_fetch_add(counter, val, __ATOMIC_RELAXED);
+    } else {
+        __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + val, __ATOMIC_RELAXED);
+    }
+}
+
+static inline void pirate_stats_max(uint64_t *counter, uint64_t val) {
+    uint64_t prev = __atomic_load_n(counter, __ATOMIC_RELAXED);
+    while (val > prev) {
+        if (!pirate_stats_shared()) {
+            __atomic_store_n(counter, val, __ATOMIC_RELAXED);
+            return;
+        }
+        if (__atomic_compare_exchange_n(counter, &prev, val, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            return;
+        }
+    }
+}
+
+// Values below 8 have their own bucket. Every larger
+// power of two is split into 4 buckets.
+static inline unsigned pirate_histogram_bucket(uint64_t val) {
+    unsigned exp;
+    if (val < 8) {
+        return val;
+    }
+    exp = 63 - __builtin_clzll(val);
+    return ((exp - 1) << 2) + ((val >> (exp - 2)) & 3);
+}
+
+// The minimum is stored as its bitwise complement
+// so that a zeroed histogram is empty.
+static inline void pirate_histogram_record(pirate_histogram_t *hist, uint64_t val) {
+    pirate_stats_add(&hist->buckets[pirate_histogram_bucket(val)], 1);
+    pirate_stats_add(&hist->count, 1);
+    pirate_stats_add(&hist->sum, val);
+    pirate_stats_max(&hist->min, ~val);
+    pirate_stats_max(&hist->max, val);
+}
+
+pirate_stats_hist_t *pirate_stats_hist_alloc(pirate_stats_shard_t *shard);
+
+// Returns the histograms of the shard or NULL if they
+// cannot be allocated.
+static inline pirate_stats_hist_t *pirate_stats_hist(pirate_stats_shard_t *shard) {
+    pirate_stats_hist_t *hist = __atomic_load_n(&shard->hist, __ATOMIC_ACQUIRE);
+    if (hist == NULL) {
+        hist = pirate_stats_hist_alloc(shard);
+    }
+    return hist;
+}
+
+// Timestamp source for the latency histogram. The time stamp
+// counter is converted to nanoseconds when the statistics are read.
+static inline uint64_t pirate_stats_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+// Zeroes the counters and histograms of every shard.
+void pirate_stats_reset(pirate_channel_stats_t *stats);
+
+// Merges the shards into stats->snapshot and returns it.
+const pirate_stats_t *pirate_stats_merge(pirate_channel_stats_t *stats);
+
+// Merges the shards into ex. The latency histogram is
+// converted from ticks to nanoseconds.
+void pirate_stats_merge_ex(const pirate_channel_stats_t *stats, pirate_stats_ex_t *ex);
+
+#endif /* __PIRATE_STATS_H */
@@ -22,6 +22,7 @@ typedef struct {
     int flags;
     int sock;
     uint8_t *min_tx_buf;
+    int peeked;
 } tcp_socket_ctx;
 
 int pirate_tcp_socket_parse_param(char *str, void *_param);
@@ -31,8 +32,11 @@ int pirate_tcp_socket_close(void *_ctx);
 ssize_t pirate_tcp_socket_read(const void *_param, void *_ctx, void *buf, size_t count);
 ssize_t pirate_tcp_socket_write(const void *_param, void *_ctx, const void *buf, size_t count);
 ssize_t pirate_tcp_socket_write_mtu(const void *_param, void *_ctx);
+ssize_t pirate_tcp_socket_write_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen);
+ssize_t pirate_tcp_socket_writev(const void *_param, void *_ctx, const struct iovec *iov, int iovcnt);
+ssize_t pirate_tcp_socket_peek_len(const void *_param, void *_ctx);
 
-#define PIRATE_TCP_SOCKET_CHANNEL_FUNCS { pirate_tcp_socket_parse_param, pirate_tcp_socket_get_channel_description, pirate_tcp_socket_open, pirate_tcp_socket_close, pirate_tcp_socket_read, pirate_tcp_socket_write, pirate_tcp_socket_write_mtu }
+#define PIRATE_TCP_SOCKET_CHANNEL_FUNCS { pirate_tcp_socket_parse_param, pirate_tcp_socket_get_channel_description, pirate_tcp_socket_open, pirate_tcp_socket_close, pirate_tcp_socket_read, pirate_tcp_socket_write, pirate_tcp_socket_write_mtu, NULL, NULL, NULL, NULL, pirate_tcp_socket_write_batch, NULL, pirate_tcp_socket_writev, pirate_tcp_socket_peek_len }
 
 
 #endif /* __PIRATE_CHANNEL_TCP_SOCKET_H */
@@ -0,0 +1,403 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#include <climits>
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <gtest/gtest.h>
+#include "libpirate.h"
+
+namespace GAPS {
+
+// Waits until count requests are complete
+static void async_wait_all(pirate_async_t *async, pirate_async_event_t *events, int count)
+{
+    int rv, n = 0;
+    while (n < count) {
+        rv = pirate_async_wait(async, events + n, count - n, 1000);
+        ASSERT_EQ(0, errno);
+        ASSERT_GT(rv, 0);
+        n += rv;
+    }
+}
+
+TEST(AsyncTest, UdpSocket)
+{
+    const int num_channels = 4;
+    const size_t len = 1000;
+    int rv, read_gds[num_channels], write_gds[num_channels];
+    char opt[128];
+    static uint8_t rx[num_channels][len], tx[num_channels][len];
+    pirate_async_event_t events[2 * num_channels];
+    pirate_async_t *async;
+    struct iovec iov[2];
+    errno = 0;
+
+    async = pirate_async_create(2 * num_channels);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(nullptr, async);
+
+    iov[0].iov_base = rx;
+    iov[0].iov_len = sizeof(rx);
+    iov[1].iov_base = tx;
+    iov[1].iov_len = sizeof(tx);
+    rv = pirate_async_register_buffers(async, iov, 2);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+
+    rv = pirate_async_register_buffers(async, iov, 2);
+    ASSERT_EQ(EBUSY, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    for (int i = 0; i < num_channels; i++) {
+        snprintf(opt, sizeof(opt), "udp_socket,127.0.0.1,%d,0.0.0.0,0", 26270 + i);
+        read_gds[i] = pirate_open_parse(opt, O_RDONLY);
+        ASSERT_EQ(0, errno);
+        ASSERT_NE(-1, read_gds[i]);
+        write_gds[i] = pirate_open_parse(opt, O_WRONLY);
+        ASSERT_EQ(0, errno);
+        ASSERT_NE(-1, write_gds[i]);
+        rv = pirate_async_add(async, read_gds[i]);
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ(0, rv);
+        rv = pirate_async_add(async, write_gds[i]);
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ(0, rv);
+        memset(tx[i], 'a' + i, len);
+    }
+
+    rv = pirate_async_add(async, read_gds[0]);
+    ASSERT_EQ(EEXIST, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    rv = pirate_async_read(async, write_gds[0], rx[0], len, NULL);
+    ASSERT_EQ(EBADF, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    rv = pirate_async_write(async, INT_MAX, tx[0], len, NULL);
+    ASSERT_EQ(ENOENT, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    rv = pirate_async_write(async, write_gds[0], tx[0], pirate_write_mtu(write_gds[0]) + 1, NULL);
+    ASSERT_EQ(EMSGSIZE, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    rv = pirate_async_wait(async, events, 2 * num_channels, 0);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+
+    for (int i = 0; i < num_channels; i++) {
+        rv = pirate_async_read(async, read_gds[i], rx[i], len, &rx[i]);
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ(0, rv);
+    }
+
+    rv = pirate_async_wait(async, events, 2 * num_channels, 20);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+
+    rv = pirate_async_del(async, read_gds[0]);
+    ASSERT_EQ(EBUSY, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    for (int i = 0; i < num_channels; i++) {
+        rv = pirate_async_write(async, write_gds[i], tx[i], len, &tx[i]);
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ(0, rv);
+    }
+
+    rv = pirate_async_write(async, write_gds[0], tx[0], len, NULL);
+    ASSERT_EQ(EAGAIN, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    async_wait_all(async, events, 2 * num_channels);
+    for (int i = 0; i < 2 * num_channels; i++) {
+        ASSERT_EQ(0, events[i].err);
+        ASSERT_EQ((ssize_t) len, events[i].len);
+        if (events[i].op == PIRATE_ASYNC_WRITE) {
+            int j = (uint8_t (*)[len]) events[i].user_data - tx;
+            ASSERT_EQ(write_gds[j], events[i].gd);
+        } else {
+            ASSERT_EQ(PIRATE_ASYNC_READ, events[i].op);
+            int j = (uint8_t (*)[len]) events[i].user_data - rx;
+            ASSERT_EQ(read_gds[j], events[i].gd);
+            ASSERT_EQ(0, memcmp(tx[j], rx[j], len));
+        }
+    }
+
+    const pirate_stats_t *stats = pirate_get_stats(read_gds[1]);
+    ASSERT_NE(nullptr, stats);
+    ASSERT_EQ(1u, stats->success);
+    ASSERT_EQ(len, stats->bytes);
+
+    for (int i = 0; i < num_channels; i++) {
+        ASSERT_EQ(0, pirate_async_del(async, read_gds[i]));
+        ASSERT_EQ(0, pirate_async_del(async, write_gds[i]));
+        ASSERT_EQ(0, pirate_close(read_gds[i]));
+        ASSERT_EQ(0, pirate_close(write_gds[i]));
+    }
+
+    rv = pirate_async_del(async, read_gds[0]);
+    ASSERT_EQ(ENOENT, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    rv = pirate_async_close(async);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+}
+
+typedef struct {
+    const char *opt;
+    int gd;
+} async_open_args_t;
+
+static void *async_open_reader(void *arg)
+{
+    async_open_args_t *args = (async_open_args_t *) arg;
+    args->gd = pirate_open_parse(args->opt, O_RDONLY);
+    return NULL;
+}
+
+// The reader and the writer of some channel types
+// wait for each other in pirate_open()
+static void async_open_channel(const char *opt, int *read_gd, int *write_gd)
+{
+    async_open_args_t args = { opt, -1 };
+    pthread_t tid;
+
+    ASSERT_EQ(0, pthread_create(&tid, NULL, async_open_reader, &args));
+    *write_gd = pirate_open_parse(opt, O_WRONLY);
+    ASSERT_EQ(0, pthread_join(tid, NULL));
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, *write_gd);
+    ASSERT_NE(-1, args.gd);
+    *read_gd = args.gd;
+}
+
+TEST(AsyncTest, Pipe)
+{
+    const size_t sizes[] = { 0, 1, 100, 508, 509, 4000, 20000 };
+    const int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+    const size_t max_len = 20000;
+    int rv, read_gd, write_gd;
+    static uint8_t tx[max_len], rx[num_sizes + 1][max_len];
+    pirate_async_event_t events[2 * num_sizes + 2];
+    pirate_async_t *async;
+    errno = 0;
+
+    for (size_t i = 0; i < max_len; i++) {
+        tx[i] = i * 7;
+    }
+
+    unlink("/tmp/gaps.async.test");
+    errno = 0;
+    async_open_channel("pipe,/tmp/gaps.async.test", &read_gd, &write_gd);
+
+    async = pirate_async_create(2 * num_sizes + 2);
+    ASSERT_NE(nullptr, async);
+    ASSERT_EQ(0, pirate_async_add(async, read_gd));
+    ASSERT_EQ(0, pirate_async_add(async, write_gd));
+
+    // The reads are queued before the packets arrive
+    for (int i = 0; i < num_sizes; i++) {
+        rv = pirate_async_read(async, read_gd, rx[i], max_len, NULL);
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ(0, rv);
+    }
+    for (int i = 0; i < num_sizes; i++) {
+        rv = pirate_async_write(async, write_gd, tx, sizes[i], NULL);
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ(0, rv);
+    }
+    async_wait_all(async, events, 2 * num_sizes);
+
+    // Completions are in order for each gaps descriptor
+    int r = 0, w = 0;
+    for (int i = 0; i < 2 * num_sizes; i++) {
+        ASSERT_EQ(0, events[i].err);
+        if (events[i].op == PIRATE_ASYNC_READ) {
+            ASSERT_EQ(read_gd, events[i].gd);
+            ASSERT_EQ((ssize_t) sizes[r], events[i].len);
+            ASSERT_EQ(0, memcmp(tx, rx[r], sizes[r]));
+            r++;
+        } else {
+            ASSERT_EQ(write_gd, events[i].gd);
+            ASSERT_EQ((ssize_t) sizes[w], events[i].len);
+            w++;
+        }
+    }
+
+    // A short buffer truncates the packet and
+    // the next packet is read from its start
+    ASSERT_EQ(0, pirate_async_write(async, write_gd, tx, max_len, NULL));
+    ASSERT_EQ(0, pirate_async_write(async, write_gd, tx + 1, 600, NULL));
+    ASSERT_EQ(0, pirate_async_read(async, read_gd, rx[0], 1000, NULL));
+    async_wait_all(async, events, 3);
+    for (int i = 0; i < 3; i++) {
+        ASSERT_EQ(0, events[i].err);
+        if (events[i].op == PIRATE_ASYNC_READ) {
+            ASSERT_EQ(1000, events[i].len);
+        }
+    }
+    ASSERT_EQ(0, memcmp(tx, rx[0], 1000));
+
+    // The asynchronous writes are compatible with pirate_read()
+    ASSERT_EQ(600, pirate_read(read_gd, rx[1], max_len));
+    ASSERT_EQ(0, memcmp(tx + 1, rx[1], 600));
+    ASSERT_EQ(50, pirate_write(write_gd, tx + 2, 50));
+    ASSERT_EQ(0, pirate_async_read(async, read_gd, rx[2], max_len, NULL));
+    async_wait_all(async, events, 1);
+    ASSERT_EQ(50, events[0].len);
+    ASSERT_EQ(0, memcmp(tx + 2, rx[2], 50));
+
+    // end of stream
+    ASSERT_EQ(0, pirate_async_del(async, write_gd));
+    ASSERT_EQ(0, pirate_close(write_gd));
+    ASSERT_EQ(0, pirate_async_read(async, read_gd, rx[0], max_len, NULL));
+    async_wait_all(async, events, 1);
+    ASSERT_EQ(0, events[0].len);
+    ASSERT_EQ(0, events[0].err);
+
+    ASSERT_EQ(0, pirate_async_del(async, read_gd));
+    ASSERT_EQ(0, pirate_close(read_gd));
+    ASSERT_EQ(0, pirate_async_close(async));
+    unlink("/tmp/gaps.async.test");
+}
+
+#if PIRATE_SHMEM_FEATURE
+TEST(AsyncTest, ShmemBlocking)
+{
+    const char *opt = "shmem,/gaps.async.test,buffer_size=4096";
+    int rv, read_gd, write_gd;
+    uint8_t tx[100], rx[100];
+    pirate_async_event_t events[2];
+    pirate_async_t *async;
+    errno = 0;
+
+    async_open_channel(opt, &read_gd, &write_gd);
+    memset(tx, 0x5A, sizeof(tx));
+
+    async = pirate_async_create(2);
+    ASSERT_NE(nullptr, async);
+    ASSERT_EQ(0, pirate_async_add(async, read_gd));
+    ASSERT_EQ(0, pirate_async_add(async, write_gd));
+
+    // The SHMEM type is executed by pirate_async_wait()
+    ASSERT_EQ(0, pirate_async_write(async, write_gd, tx, sizeof(tx), &tx));
+    ASSERT_EQ(0, pirate_async_read(async, read_gd, rx, sizeof(rx), &rx));
+    async_wait_all(async, events, 2);
+    ASSERT_EQ(PIRATE_ASYNC_WRITE, events[0].op);
+    ASSERT_EQ(&tx, events[0].user_data);
+    ASSERT_EQ(PIRATE_ASYNC_READ, events[1].op);
+    ASSERT_EQ(&rx, events[1].user_data);
+    ASSERT_EQ((ssize_t) sizeof(rx), events[1].len);
+    ASSERT_EQ(0, memcmp(tx, rx, sizeof(rx)));
+
+    rv = pirate_async_wait(async, events, 2, 0);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+
+    ASSERT_EQ(0, pirate_async_del(async, read_gd));
+    ASSERT_EQ(0, pirate_async_del(async, write_gd));
+    ASSERT_EQ(0, pirate_close(read_gd));
+    ASSERT_EQ(0, pirate_close(write_gd));
+    ASSERT_EQ(0, pirate_async_close(async));
+}
+
+static void *async_shmem_writer(void *arg)
+{
+    int gd = *(int *) arg;
+    uint8_t tx[100];
+
+    memset(tx, 0xA5, sizeof(tx));
+    usleep(50000);
+    if (pirate_write(gd, tx, sizeof(tx)) != (ssize_t) sizeof(tx)) {
+        return (void *) 1;
+    }
+    return NULL;
+}
+
+TEST(AsyncTest, ShmemIdle)
+{
+    int rv, shmem_read_gd, shmem_write_gd, pipe_read_gd, pipe_write_gd;
+    uint8_t rx[100], pipe_rx[100];
+    pirate_async_event_t events[2];
+    pirate_async_t *async;
+    pthread_t thread;
+    void *status;
+    errno = 0;
+
+    async_open_channel("shmem,/gaps.async.idle,buffer_size=4096", &shmem_read_gd, &shmem_write_gd);
+    unlink("/tmp/gaps.async.idle");
+    errno = 0;
+    async_open_channel("pipe,/tmp/gaps.async.idle", &pipe_read_gd, &pipe_write_gd);
+
+    async = pirate_async_create(2);
+    ASSERT_NE(nullptr, async);
+    ASSERT_EQ(0, pirate_async_add(async, shmem_read_gd));
+    ASSERT_EQ(0, pirate_async_add(async, pipe_read_gd));
+
+    // An idle SHMEM read does not block pirate_async_wait()
+    ASSERT_EQ(0, pirate_async_read(async, shmem_read_gd, rx, sizeof(rx), &rx));
+    rv = pirate_async_wait(async, events, 2, 0);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    rv = pirate_async_wait(async, events, 2, 20);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+
+    // The SHMEM read completes while a pipe read is in flight
+    ASSERT_EQ(0, pirate_async_read(async, pipe_read_gd, pipe_rx, sizeof(pipe_rx), &pipe_rx));
+    rv = pirate_async_wait(async, events, 2, 20);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(0, pthread_create(&thread, NULL, async_shmem_writer, &shmem_write_gd));
+    rv = pirate_async_wait(async, events, 2, 5000);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(1, rv);
+    ASSERT_EQ(shmem_read_gd, events[0].gd);
+    ASSERT_EQ(&rx, events[0].user_data);
+    ASSERT_EQ((ssize_t) sizeof(rx), events[0].len);
+    ASSERT_EQ(0, pthread_join(thread, &status));
+    ASSERT_EQ(nullptr, status);
+
+    ASSERT_EQ(10, pirate_write(pipe_write_gd, rx, 10));
+    async_wait_all(async, events, 1);
+    ASSERT_EQ(pipe_read_gd, events[0].gd);
+    ASSERT_EQ(10, events[0].len);
+
+    ASSERT_EQ(0, pirate_async_del(async, shmem_read_gd));
+    ASSERT_EQ(0, pirate_async_del(async, pipe_read_gd));
+    ASSERT_EQ(0, pirate_close(shmem_read_gd));
+    ASSERT_EQ(0, pirate_close(shmem_write_gd));
+    ASSERT_EQ(0, pirate_close(pipe_read_gd));
+    ASSERT_EQ(0, pirate_close(pipe_write_gd));
+    ASSERT_EQ(0, pirate_async_close(async));
+    unlink("/tmp/gaps.async.idle");
+}
+#endif
+
+} // namespace
@@ -432,5 +432,219 @@ void ClosedReaderTest::RunTestCase()
 #endif
 }
 
+#ifndef _WIN32
+void BatchTest::WriterTest()
+{
+    uint8_t data[len_size][buf_size];
+    pirate_mmsg_t msgs[len_size];
+    size_t off = 0;
+    uint64_t success;
+    int rv;
+
+    WriterChannelOpen();
+    success = pirate_get_stats(Writer.gd)->success;
+
+    for (size_t i = 0; i < len_size; i++)
+    {
+        for (size_t j = 0; j < buf_size; j++)
+        {
+            data[i][j] = (i + j) & 0xFF;
+        }
+        msgs[i].buf = data[i];
+        msgs[i].count = len_arr[i].writer;
+        msgs[i].len = 0;
+    }
+
+    while (off < len_size)
+    {
+        ssize_t nmsgs = pirate_write_batch(Writer.gd, &msgs[off],
+            MIN(batch_size, len_size - off));
+        ASSERT_EQ(0, errno);
+        ASSERT_GT(nmsgs, 0);
+        for (ssize_t i = 0; i < nmsgs; i++)
+        {
+            EXPECT_EQ(msgs[off + i].count, msgs[off + i].len);
+        }
+        off += nmsgs;
+    }
+
+    EXPECT_EQ(success + len_size, pirate_get_stats(Writer.gd)->success);
+
+    if (nonblocking_IO)
+    {
+        rv = sem_post(&nonblocking_sem);
+        EXPECT_EQ(0, errno);
+        EXPECT_EQ(0, rv);
+    }
+
+    BarrierWait();
+
+    WriterChannelClose();
+}
+
+void BatchTest::ReaderTest()
+{
+    uint8_t data[len_size][buf_size];
+    pirate_mmsg_t msgs[len_size];
+    size_t off = 0;
+    uint64_t success;
+    int rv;
+
+    ReaderChannelOpen();
+    success = pirate_get_stats(Reader.gd)->success;
+
+    for (size_t i = 0; i < len_size; i++)
+    {
+        memset(data[i], 0xFA, buf_size);
+        msgs[i].buf = data[i];
+        msgs[i].count = len_arr[i].reader;
+        msgs[i].len = 0;
+    }
+
+    if (nonblocking_IO)
+    {
+        rv = sem_wait(&nonblocking_sem);
+        EXPECT_EQ(0, errno);
+        EXPECT_EQ(0, rv);
+    }
+
+    while (off < len_size)
+    {
+        ssize_t nmsgs = pirate_read_batch(Reader.gd, &msgs[off], len_size - off);
+        ASSERT_EQ(0, errno);
+        ASSERT_GT(nmsgs, 0);
+        for (ssize_t i = 0; i < nmsgs; i++)
+        {
+            size_t idx = off + i;
+            size_t exp = MIN(len_arr[idx].reader, len_arr[idx].writer);
+            EXPECT_EQ(exp, msgs[idx].len);
+            for (size_t j = 0; j < exp; j++)
+            {
+                EXPECT_EQ((idx + j) & 0xFF, data[idx][j]);
+            }
+        }
+        off += nmsgs;
+    }
+
+    EXPECT_EQ(success + len_size, pirate_get_stats(Reader.gd)->success);
+
+    BarrierWait();
+
+    ReaderChannelClose();
+}
+
+void WritevTest::WriterTest()
+{
+    ssize_t offset = 0;
+    int rv_sem;
+
+    WriterChannelOpen();
+
+    memset(&stats_wr, 0, sizeof(stats_wr));
+
+    for (size_t i = 0; i < len_size; i++)
+    {
+        ssize_t rv;
+        ssize_t wl = len_arr[i].writer;
+        struct iovec iov[3];
+
+        WriteDataInit(offset, wl);
+        offset += wl + 1;
+
+        // the first iovec is empty for short packets
+        iov[0].iov_base = Writer.buf;
+        iov[0].iov_len = wl / 3;
+        iov[1].iov_base = Writer.buf + iov[0].iov_len;
+        iov[1].iov_len = wl / 2;
+        iov[2].iov_base = Writer.buf + iov[0].iov_len + iov[1].iov_len;
+        iov[2].iov_len = wl - iov[0].iov_len - iov[1].iov_len;
+
+        rv = pirate_writev(Writer.gd, iov, 3);
+        EXPECT_EQ(wl, rv);
+        ASSERT_EQ(0, errno);
+
+        if (nonblocking_IO)
+        {
+            rv_sem = sem_post(&nonblocking_sem);
+            EXPECT_EQ(0, errno);
+            EXPECT_EQ(0, rv_sem);
+        }
+
+        stats_wr.packets++;
+        stats_wr.bytes += wl;
+
+        BarrierWait();
+    }
+
+    // barrier for nonblocking read test
+    BarrierWait();
+
+    WriterChannelClose();
+}
+
+void PeekTest::ReaderTest()
+{
+    uint64_t truncated, exp_truncated = 0;
+
+    Reader.param.trunc_stats = 1;
+    ReaderChannelOpen();
+    truncated = pirate_get_stats(Reader.gd)->truncated;
+
+    memset(&stats_rd, 0, sizeof(stats_rd));
+
+    for (size_t i = 0; i < len_size; i++)
+    {
+        ssize_t rv;
+        ssize_t rl = len_arr[i].reader;
+        ssize_t exp = MIN(len_arr[i].reader, len_arr[i].writer);
+
+        memset(Reader.buf, 0xFA, rl);
+
+        if (nonblocking_IO)
+        {
+            rv = sem_wait(&nonblocking_sem);
+            EXPECT_EQ(0, errno);
+            EXPECT_EQ(0, rv);
+        }
+
+        // peeking twice does not consume the packet
+        rv = pirate_peek_len(Reader.gd);
+        ASSERT_EQ(0, errno);
+        EXPECT_EQ(len_arr[i].writer, rv);
+        rv = pirate_peek_len(Reader.gd);
+        ASSERT_EQ(0, errno);
+        EXPECT_EQ(len_arr[i].writer, rv);
+
+        rv = pirate_read(Reader.gd, Reader.buf, rl);
+        ASSERT_EQ(0, errno);
+        EXPECT_EQ(rv, exp);
+        EXPECT_TRUE(0 == std::memcmp(Writer.buf, Reader.buf, exp));
+
+        if (len_arr[i].writer > len_arr[i].reader)
+        {
+            exp_truncated++;
+        }
+        stats_rd.packets++;
+        stats_rd.bytes += exp;
+
+        BarrierWait();
+    }
+
+    EXPECT_EQ(truncated + exp_truncated, pirate_get_stats(Reader.gd)->truncated);
+
+    if (nonblocking_IO)
+    {
+        ssize_t rv = pirate_peek_len(Reader.gd);
+        EXPECT_TRUE((errno == EAGAIN) || (errno == EWOULDBLOCK));
+        EXPECT_EQ(rv, -1);
+        errno = 0;
+    }
+
+    // barrier for nonblocking read test
+    BarrierWait();
+
+    ReaderChannelClose();
+}
+#endif
 
 } // namespace
@@ -142,6 +142,35 @@ public:
     virtual void RunTestCase() override;
 };
 
+#ifndef _WIN32
+// Transfers the test packets with
+// pirate_write_batch() and pirate_read_batch()
+class BatchTest : public ChannelTest
+{
+protected:
+    virtual void WriterTest() override;
+    virtual void ReaderTest() override;
+
+    static const unsigned batch_size = 5;
+};
+
+// Reads the length of each test packet with
+// pirate_peek_len() and counts truncated packets
+class PeekTest : public ChannelTest
+{
+protected:
+    virtual void ReaderTest() override;
+};
+
+// Writes each test packet with pirate_writev()
+// split across several iovecs
+class WritevTest : public ChannelTest
+{
+protected:
+    virtual void WriterTest() override;
+};
+#endif
+
 static const unsigned TEST_MIN_TX_LEN = 16;
 
 } // namespace GAPS
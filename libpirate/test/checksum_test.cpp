@@ -0,0 +1,87 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "checksum.h"
+}
+
+namespace GAPS {
+
+TEST(ChecksumTest, Rfc1071)
+{
+    const uint8_t data[] = { 0x00, 0x01, 0xf2, 0x03, 0xf4, 0xf5, 0xf6, 0xf7 };
+    ASSERT_EQ(0x220d, cksum(data, sizeof(data), 0));
+    ASSERT_EQ(0xddf2, cksum_sum_scalar(data, sizeof(data)));
+    // odd length pads the final byte with zero
+    ASSERT_EQ(0xf201, cksum_sum_scalar(data, 3));
+}
+
+// Every kernel supported by the processor must match the scalar
+// kernel for every length and alignment
+TEST(ChecksumTest, Kernels)
+{
+    const char *names[] = { "scalar", "sse2", "avx2", "avx512" };
+    const size_t max_len = 1500;
+    static uint8_t data[max_len + 8];
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (i * 167) ^ (i >> 3);
+    }
+    ASSERT_NE(nullptr, cksum_get_kernel("scalar"));
+    ASSERT_EQ(nullptr, cksum_get_kernel("mmx"));
+    ASSERT_NE(nullptr, cksum_get_kernel(cksum_kernel_name()));
+    for (const char *name : names) {
+        cksum_kernel_t kernel = cksum_get_kernel(name);
+        if (kernel == NULL) {
+            continue;
+        }
+        for (size_t offset = 0; offset < 8; offset++) {
+            for (size_t len = 0; len <= max_len; len++) {
+                ASSERT_EQ(cksum_sum_scalar(data + offset, len), kernel(data + offset, len))
+                    << name << " offset " << offset << " length " << len;
+            }
+        }
+    }
+}
+
+// A message that is split at odd offsets has the
+// checksum of the contiguous message
+TEST(ChecksumTest, Incremental)
+{
+    const size_t len = 999;
+    uint8_t data[len];
+    cksum_t state;
+
+    for (size_t i = 0; i < len; i++) {
+        data[i] = i * 31;
+    }
+    for (size_t split1 = 0; split1 < 40; split1++) {
+        for (size_t split2 = split1; split2 < len; split2 += 37) {
+            cksum_init(&state, 0x1234);
+            cksum_update(&state, data, split1);
+            cksum_update(&state, data + split1, split2 - split1);
+            cksum_update(&state, data + split2, len - split2);
+            ASSERT_EQ(cksum(data, len, 0x1234), cksum_final(&state));
+        }
+    }
+
+    // the complement of a checksum continues the sum
+    uint16_t csum = cksum(data, 100, 0);
+    ASSERT_EQ(cksum(data, len, 0), cksum(data + 100, len - 100, ~csum));
+}
+
+} // namespace
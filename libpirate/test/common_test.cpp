@@ -13,8 +13,12 @@
  * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
  */
 
+#include <algorithm>
+#include <climits>
 #include <cstring>
 #include <errno.h>
+#include <pthread.h>
+#include <vector>
 #include <gtest/gtest.h>
 #include "libpirate.h"
 #include "libpirate_internal.h"
@@ -47,8 +51,13 @@ TEST(CommonChannel, InvalidCLose)
     ASSERT_EQ(-1, rv);
     errno = 0;
 
-    // Invalid channel number - exceeds bound
-    rv = pirate_close(PIRATE_NUM_CHANNELS);
+    // Invalid channel number - outside of the descriptor table
+    rv = pirate_close(INT_MAX);
+    ASSERT_EQ(EBADF, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    rv = pirate_close(INT_MIN);
     ASSERT_EQ(EBADF, errno);
     ASSERT_EQ(-1, rv);
     errno = 0;
@@ -214,4 +223,425 @@ TEST(CommonChannel, Drop)
 
 }
 
+TEST(CommonChannel, StatsEx)
+{
+    int rv, read_gd, write_gd;
+    char temp[128];
+    pirate_stats_ex_t stats_r, stats_w;
+    const size_t lengths[] = {1, 12, 100};
+    ssize_t nbytes;
+    errno = 0;
+
+    pirate_reset_stats();
+
+    read_gd = pirate_open_parse("udp_socket,127.0.0.1,26261,0.0.0.0,0,lat_stats=1", O_RDONLY);
+    ASSERT_EQ(errno, 0);
+    ASSERT_NE(read_gd, -1);
+
+    write_gd = pirate_open_parse("udp_socket,127.0.0.1,26261,0.0.0.0,0", O_WRONLY);
+    ASSERT_EQ(errno, 0);
+    ASSERT_NE(write_gd, -1);
+
+    memset(temp, 0, sizeof(temp));
+    for (size_t len : lengths) {
+        nbytes = pirate_write(write_gd, temp, len);
+        ASSERT_EQ(errno, 0);
+        ASSERT_EQ((ssize_t) len, nbytes);
+    }
+    for (size_t len : lengths) {
+        nbytes = pirate_read(read_gd, temp, sizeof(temp));
+        ASSERT_EQ(errno, 0);
+        ASSERT_EQ((ssize_t) len, nbytes);
+    }
+
+    rv = pirate_get_stats_ex(read_gd, &stats_r);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+    rv = pirate_get_stats_ex(write_gd, &stats_w);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+
+    ASSERT_EQ(3u, stats_r.stats.requests);
+    ASSERT_EQ(3u, stats_w.stats.requests);
+    ASSERT_EQ(3u, stats_r.size.count);
+    ASSERT_EQ(3u, stats_w.size.count);
+    ASSERT_EQ(113u, stats_w.stats.bytes);
+    ASSERT_EQ(113u, stats_w.size.sum);
+    ASSERT_EQ(1u, stats_w.size.min);
+    ASSERT_EQ(100u, stats_w.size.max);
+    ASSERT_EQ(1u, stats_w.size.buckets[1]);
+    ASSERT_EQ(1u, pirate_histogram_percentile(&stats_w.size, 0.0));
+    ASSERT_EQ(12u, pirate_histogram_percentile(&stats_w.size, 0.5));
+    ASSERT_EQ(100u, pirate_histogram_percentile(&stats_w.size, 1.0));
+    ASSERT_EQ(pirate_get_stats(write_gd)->success, stats_w.stats.success);
+
+    // latency is recorded only when lat_stats=1 is specified
+    ASSERT_EQ(3u, stats_r.latency.count);
+    ASSERT_EQ(0u, stats_w.latency.count);
+    ASSERT_LE(stats_r.latency.min, stats_r.latency.max);
+    ASSERT_GT(stats_r.latency.sum, 0u);
+
+    // the wait statistics are reported by shared memory channels
+    ASSERT_EQ(0u, stats_r.waits);
+    ASSERT_EQ(0u, stats_r.wakeups);
+    ASSERT_EQ(0u, stats_r.blocked_ns);
+
+    rv = pirate_get_stats_ex(-1, &stats_r);
+    ASSERT_EQ(EBADF, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    rv = pirate_close(read_gd);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+
+    rv = pirate_close(write_gd);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+}
+
+struct StatsThreadArgs {
+    int gd;
+    int count;
+};
+
+static void *StatsWriterThread(void *arg) {
+    const StatsThreadArgs *args = (const StatsThreadArgs *) arg;
+    char data[8] = {0};
+
+    for (int i = 0; i < args->count; i++) {
+        if (pirate_write(args->gd, data, sizeof(data)) != sizeof(data)) {
+            return (void *) 1;
+        }
+    }
+    return NULL;
+}
+
+// More threads than statistics shards write to the same
+// gaps descriptor. No update can be lost.
+TEST(CommonChannel, StatsThreads)
+{
+    int rv, read_gd, write_gd;
+    const int num_threads = 16;
+    pthread_t threads[num_threads];
+    StatsThreadArgs args;
+    pirate_stats_ex_t before, after;
+    void *status;
+    errno = 0;
+
+    read_gd = pirate_open_parse("udp_socket,127.0.0.1,26262,0.0.0.0,0", O_RDONLY);
+    ASSERT_EQ(errno, 0);
+    ASSERT_NE(read_gd, -1);
+
+    write_gd = pirate_open_parse("udp_socket,127.0.0.1,26262,0.0.0.0,0", O_WRONLY);
+    ASSERT_EQ(errno, 0);
+    ASSERT_NE(write_gd, -1);
+
+    rv = pirate_get_stats_ex(write_gd, &before);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+
+    args.gd = write_gd;
+    args.count = 1000;
+    for (int i = 0; i < num_threads; i++) {
+        rv = pthread_create(&threads[i], NULL, StatsWriterThread, &args);
+        ASSERT_EQ(0, rv);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        rv = pthread_join(threads[i], &status);
+        ASSERT_EQ(0, rv);
+        ASSERT_EQ(NULL, status);
+    }
+
+    rv = pirate_get_stats_ex(write_gd, &after);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+
+    const uint64_t total = num_threads * args.count;
+    ASSERT_EQ(before.stats.requests + total, after.stats.requests);
+    ASSERT_EQ(before.stats.success + total, after.stats.success);
+    ASSERT_EQ(before.stats.bytes + total * 8, after.stats.bytes);
+    ASSERT_EQ(before.size.count + total, after.size.count);
+    ASSERT_EQ(before.size.buckets[8] + total, after.size.buckets[8]);
+
+    rv = pirate_close(read_gd);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+
+    rv = pirate_close(write_gd);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+}
+
+struct StatsSlotArgs {
+    StatsThreadArgs writer;
+    unsigned slot;
+};
+
+static void *StatsSlotThread(void *arg) {
+    StatsSlotArgs *args = (StatsSlotArgs *) arg;
+
+    args->slot = pirate_stats_thread_slot();
+    return StatsWriterThread(&args->writer);
+}
+
+// Threads that start after others have exited reuse their
+// statistics shards instead of sharing the last one. The
+// counters of the exited threads are kept.
+TEST(CommonChannel, StatsSlotReuse)
+{
+    int rv, read_gd, write_gd;
+    const int num_threads = 32;
+    pthread_t thread;
+    StatsSlotArgs args;
+    pirate_stats_ex_t before, after;
+    unsigned first_slot = 0;
+    void *status;
+    errno = 0;
+
+    read_gd = pirate_open_parse("udp_socket,127.0.0.1,26266,0.0.0.0,0", O_RDONLY);
+    ASSERT_EQ(errno, 0);
+    ASSERT_NE(read_gd, -1);
+
+    write_gd = pirate_open_parse("udp_socket,127.0.0.1,26266,0.0.0.0,0", O_WRONLY);
+    ASSERT_EQ(errno, 0);
+    ASSERT_NE(write_gd, -1);
+
+    rv = pirate_get_stats_ex(write_gd, &before);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+
+    args.writer.gd = write_gd;
+    args.writer.count = 10;
+    for (int i = 0; i < num_threads; i++) {
+        rv = pthread_create(&thread, NULL, StatsSlotThread, &args);
+        ASSERT_EQ(0, rv);
+        rv = pthread_join(thread, &status);
+        ASSERT_EQ(0, rv);
+        ASSERT_EQ(NULL, status);
+        if (i == 0) {
+            first_slot = args.slot;
+        }
+        ASSERT_EQ(first_slot, args.slot);
+    }
+    ASSERT_NE(pirate_stats_thread_slot(), first_slot);
+
+    rv = pirate_get_stats_ex(write_gd, &after);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+
+    const uint64_t total = num_threads * args.writer.count;
+    ASSERT_EQ(before.stats.requests + total, after.stats.requests);
+    ASSERT_EQ(before.stats.success + total, after.stats.success);
+    ASSERT_EQ(before.size.count + total, after.size.count);
+
+    rv = pirate_close(read_gd);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+
+    rv = pirate_close(write_gd);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+}
+
+struct StatsQueryArgs {
+    int gd;
+    uint64_t success;
+};
+
+static void *StatsQueryThread(void *arg) {
+    const StatsQueryArgs *args = (const StatsQueryArgs *) arg;
+
+    for (int i = 0; i < 100000; i++) {
+        const pirate_stats_t *stats = pirate_get_stats(args->gd);
+        if ((stats == NULL) || (__atomic_load_n(&stats->success, __ATOMIC_RELAXED) != args->success)) {
+            return (void *) 1;
+        }
+    }
+    return NULL;
+}
+
+// Concurrent queries of the same gaps descriptor
+// always observe the complete totals.
+TEST(CommonChannel, StatsConcurrentQuery)
+{
+    int rv, read_gd, write_gd;
+    const int num_threads = 4;
+    pthread_t threads[num_threads];
+    StatsThreadArgs writer;
+    StatsQueryArgs args;
+    void *status;
+    errno = 0;
+
+    read_gd = pirate_open_parse("udp_socket,127.0.0.1,26267,0.0.0.0,0", O_RDONLY);
+    ASSERT_EQ(errno, 0);
+    ASSERT_NE(read_gd, -1);
+
+    write_gd = pirate_open_parse("udp_socket,127.0.0.1,26267,0.0.0.0,0", O_WRONLY);
+    ASSERT_EQ(errno, 0);
+    ASSERT_NE(write_gd, -1);
+
+    args.gd = write_gd;
+    args.success = pirate_get_stats(write_gd)->success;
+    writer.gd = write_gd;
+    writer.count = 100;
+    ASSERT_EQ(NULL, StatsWriterThread(&writer));
+    args.success += writer.count;
+    ASSERT_EQ(args.success, pirate_get_stats(write_gd)->success);
+    for (int i = 0; i < num_threads; i++) {
+        rv = pthread_create(&threads[i], NULL, StatsQueryThread, &args);
+        ASSERT_EQ(0, rv);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        rv = pthread_join(threads[i], &status);
+        ASSERT_EQ(0, rv);
+        ASSERT_EQ(NULL, status);
+    }
+
+    rv = pirate_close(read_gd);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+
+    rv = pirate_close(write_gd);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+}
+
+TEST(CommonChannel, StatsUndelivered)
+{
+    int rv, gd;
+    uint64_t undelivered;
+    char buf[8] = {0};
+    errno = 0;
+
+    // no reader listens on the port so the peer refuses the datagrams
+    gd = pirate_open_parse("udp_socket,127.0.0.1,26268,0.0.0.0,0", O_WRONLY);
+    ASSERT_EQ(errno, 0);
+    ASSERT_NE(gd, -1);
+
+    undelivered = pirate_get_stats(gd)->undelivered;
+    for (int i = 0; i < 10; i++) {
+        rv = pirate_write(gd, buf, sizeof(buf));
+        ASSERT_EQ(errno, 0);
+        ASSERT_EQ(rv, (int) sizeof(buf));
+    }
+    ASSERT_LT(undelivered, pirate_get_stats(gd)->undelivered);
+
+    rv = pirate_close(gd);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+}
+
+TEST(CommonChannel, HistogramBuckets)
+{
+    ASSERT_EQ(0u, pirate_histogram_value(0));
+    ASSERT_EQ(7u, pirate_histogram_value(7));
+    ASSERT_EQ(8u, pirate_histogram_value(8));
+    ASSERT_EQ(10u, pirate_histogram_value(9));
+    ASSERT_EQ(16u, pirate_histogram_value(12));
+    ASSERT_EQ(7ull << 61, pirate_histogram_value(PIRATE_HISTOGRAM_BUCKETS - 1));
+    for (unsigned i = 1; i < PIRATE_HISTOGRAM_BUCKETS; i++) {
+        ASSERT_LT(pirate_histogram_value(i - 1), pirate_histogram_value(i));
+    }
+}
+
+// File descriptors above the initial size of the
+// descriptor table are valid gaps descriptors.
+TEST(CommonChannel, DescriptorTableGrowth)
+{
+    const int num_channels = 512;
+    std::vector<int> gds;
+    pirate_channel_param_t param;
+    int rv, gd, max_gd = -1;
+    errno = 0;
+
+    for (int i = 0; i < num_channels; i++) {
+        gd = pirate_open_parse("udp_socket,127.0.0.1,26263,0.0.0.0,0", O_WRONLY);
+        ASSERT_EQ(errno, 0);
+        ASSERT_NE(gd, -1);
+        gds.push_back(gd);
+        max_gd = std::max(max_gd, gd);
+    }
+    ASSERT_GE(max_gd, num_channels);
+
+    for (int gd : gds) {
+        rv = pirate_get_channel_param(gd, &param);
+        ASSERT_EQ(errno, 0);
+        ASSERT_EQ(rv, 0);
+        ASSERT_EQ(UDP_SOCKET, param.channel_type);
+        ASSERT_TRUE(pirate_get_stats(gd) != NULL);
+    }
+
+    for (int gd : gds) {
+        rv = pirate_close(gd);
+        ASSERT_EQ(errno, 0);
+        ASSERT_EQ(rv, 0);
+    }
+
+    rv = pirate_close(max_gd);
+    ASSERT_EQ(EBADF, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+}
+
+struct DescriptorThreadArgs {
+    int count;
+    int failures;
+};
+
+static void *DescriptorThread(void *arg) {
+    DescriptorThreadArgs *args = (DescriptorThreadArgs *) arg;
+    pirate_channel_param_t param;
+    const char data[] = "data";
+
+    for (int i = 0; i < args->count; i++) {
+        int gd = pirate_open_parse("udp_socket,127.0.0.1,26264,0.0.0.0,0", O_WRONLY);
+        if (gd == -1) {
+            args->failures++;
+            continue;
+        }
+        if ((pirate_get_channel_param(gd, &param) != 0) || (param.channel_type != UDP_SOCKET)) {
+            args->failures++;
+        }
+        if (pirate_write(gd, data, sizeof(data)) != sizeof(data)) {
+            args->failures++;
+        }
+        if (pirate_close(gd) != 0) {
+            args->failures++;
+        }
+    }
+    return NULL;
+}
+
+// Concurrent opens and closes reuse file descriptors
+// while other threads are looking up their channels.
+TEST(CommonChannel, DescriptorTableStress)
+{
+    const int num_threads = 8;
+    pthread_t threads[num_threads];
+    DescriptorThreadArgs args[num_threads];
+    int rv, read_gd;
+    errno = 0;
+
+    read_gd = pirate_open_parse("udp_socket,127.0.0.1,26264,0.0.0.0,0", O_RDONLY);
+    ASSERT_EQ(errno, 0);
+    ASSERT_NE(read_gd, -1);
+
+    for (int i = 0; i < num_threads; i++) {
+        args[i].count = 10000 / num_threads;
+        args[i].failures = 0;
+        rv = pthread_create(&threads[i], NULL, DescriptorThread, &args[i]);
+        ASSERT_EQ(0, rv);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        rv = pthread_join(threads[i], NULL);
+        ASSERT_EQ(0, rv);
+        ASSERT_EQ(0, args[i].failures);
+    }
+
+    rv = pirate_close(read_gd);
+    ASSERT_EQ(errno, 0);
+    ASSERT_EQ(rv, 0);
+}
+
 } // namespace
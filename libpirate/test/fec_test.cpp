@@ -0,0 +1,131 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "fec.h"
+}
+
+namespace GAPS {
+
+TEST(FecTest, Field)
+{
+    // x^8 = x^4 + x^3 + x^2 + 1
+    ASSERT_EQ(0x1d, pirate_gf256_mul(0x80, 0x02));
+    ASSERT_EQ(0, pirate_gf256_mul(0, 0x53));
+    for (int a = 1; a < 256; a++) {
+        ASSERT_EQ(1, pirate_gf256_mul(a, pirate_gf256_inv(a)));
+        ASSERT_EQ(a, pirate_gf256_mul(a, 1));
+    }
+    // the first parity packet is the xor of the data packets
+    for (unsigned col = 0; col < PIRATE_FEC_MAX_DATA; col++) {
+        ASSERT_EQ(1, pirate_fec_coef(0, col));
+    }
+}
+
+// Every implementation must match the table implementation
+// for every length and multiplier
+TEST(FecTest, Implementations)
+{
+    typedef void (*mul_add_func_t)(uint8_t *, const uint8_t *, uint8_t, size_t);
+    const mul_add_func_t funcs[] = {
+        pirate_gf256_mul_add,
+        pirate_gf256_mul_add_ssse3,
+        pirate_gf256_mul_add_avx2,
+    };
+    static uint8_t src[100], expect[100], dst[100];
+
+    for (size_t i = 0; i < sizeof(src); i++) {
+        src[i] = rand();
+    }
+    for (int c = 0; c < 256; c++) {
+        for (size_t len = 0; len <= sizeof(src); len += 7) {
+            for (size_t i = 0; i < sizeof(expect); i++) {
+                expect[i] = i;
+            }
+            pirate_gf256_mul_add_table(expect, src, c, len);
+            for (size_t i = 0; i < len; i++) {
+                ASSERT_EQ(expect[i], i ^ pirate_gf256_mul(c, src[i]));
+            }
+            for (auto func : funcs) {
+                for (size_t i = 0; i < sizeof(dst); i++) {
+                    dst[i] = i;
+                }
+                func(dst, src, c, len);
+                ASSERT_EQ(0, memcmp(expect, dst, sizeof(dst)));
+            }
+        }
+    }
+}
+
+// Any 3 lost packets of a block of 10 data packets and
+// 3 parity packets are recovered from the remaining packets
+TEST(FecTest, Recovery)
+{
+    const unsigned k = 10, m = 3;
+    const size_t len = 64;
+    static uint8_t data[k][len], parity[m][len], out[m][len];
+    unsigned lost[m], rows[m], cols[m];
+    uint8_t *synd[m], *outp[m];
+
+    for (unsigned i = 0; i < k; i++) {
+        for (size_t j = 0; j < len; j++) {
+            data[i][j] = rand();
+        }
+    }
+    for (unsigned iter = 0; iter < 100; iter++) {
+        // lost data packets and parity packets
+        unsigned ndata = iter % (m + 1), n = 0;
+        for (unsigned i = 0; i < ndata; i++) {
+            unsigned col;
+            do {
+                col = rand() % k;
+            } while (std::find(lost, lost + i, col) != lost + i);
+            lost[i] = col;
+        }
+        memset(parity, 0, sizeof(parity));
+        for (unsigned row = 0; row < m; row++) {
+            for (unsigned col = 0; col < k; col++) {
+                pirate_gf256_mul_add(parity[row], data[col], pirate_fec_coef(row, col), len);
+            }
+        }
+        if (ndata == 0) {
+            continue;
+        }
+        // the rows that were not lost, starting at a different row
+        for (unsigned i = 0; i < ndata; i++) {
+            rows[i] = (iter + i) % m;
+            cols[i] = lost[i];
+            synd[i] = parity[rows[i]];
+            outp[i] = out[i];
+            for (unsigned col = 0; col < k; col++) {
+                if (std::find(lost, lost + ndata, col) == lost + ndata) {
+                    pirate_gf256_mul_add(synd[i], data[col], pirate_fec_coef(rows[i], col), len);
+                }
+            }
+        }
+        ASSERT_EQ(0, pirate_fec_solve(rows, cols, ndata, synd, outp, len));
+        for (unsigned i = 0; i < ndata; i++) {
+            ASSERT_EQ(0, memcmp(data[cols[i]], out[i], len));
+            n++;
+        }
+        ASSERT_EQ(ndata, n);
+    }
+}
+
+} // namespace
@@ -20,9 +20,18 @@
 #endif
 #include "channel_test.hpp"
 #include "cross_platform_test.hpp"
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 
 extern "C" {
     uint16_t pirate_ge_eth_crc16(const uint8_t *data, uint16_t len);
+#ifndef _WIN32
+#include "crc16.h"
+#endif
 }
 
 namespace GAPS
@@ -39,6 +48,39 @@ TEST(ChannelGeEthTest, CRC16X25)
     ASSERT_EQ(0xE5CB, crc);
 }
 
+#ifndef _WIN32
+TEST(ChannelGeEthTest, CRC16Check)
+{
+    const char *check = "123456789";
+    ASSERT_EQ(0x906E, pirate_ge_eth_crc16((const uint8_t *) check, 9));
+}
+
+// The table and carry-less multiplication implementations
+// must match the byte-at-a-time implementation for every
+// length and alignment, including messages split in pieces
+TEST(ChannelGeEthTest, CRC16Implementations)
+{
+    const size_t max_len = 2048;
+    static uint8_t data[max_len + 16];
+    uint16_t expect;
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (i * 131) ^ (i >> 5);
+    }
+    for (size_t offset = 0; offset < 16; offset += 3) {
+        for (size_t len = 0; len <= max_len; len++) {
+            const uint8_t *buf = data + offset;
+            expect = pirate_crc16_update_bytewise(PIRATE_CRC16_INIT, buf, len);
+            ASSERT_EQ(expect, pirate_crc16_update_slice8(PIRATE_CRC16_INIT, buf, len));
+            ASSERT_EQ(expect, pirate_crc16_update_clmul(PIRATE_CRC16_INIT, buf, len));
+            ASSERT_EQ(expect, pirate_crc16_update(PIRATE_CRC16_INIT, buf, len));
+            uint16_t crc = pirate_crc16_update(PIRATE_CRC16_INIT, buf, len / 3);
+            ASSERT_EQ(expect, pirate_crc16_update(crc, buf + len / 3, len - len / 3));
+        }
+    }
+}
+#endif
+
 TEST(ChannelGeEthTest, ConfigurationParser) {
     int rv;
     pirate_channel_param_t param;
@@ -111,6 +153,33 @@ TEST(ChannelGeEthTest, ConfigurationParser) {
     ASSERT_EQ(port2, ge_eth_param->writer_port);
     ASSERT_EQ(message_id, ge_eth_param->message_id);
     ASSERT_EQ(mtu, ge_eth_param->mtu);
+
+#ifndef _WIN32
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,%d,%s,%d,%u,crc=payload", name, addr1, port1, addr2, port2, message_id);
+    rv  = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(PIRATE_GE_ETH_CRC_PAYLOAD, ge_eth_param->crc);
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,%d,%s,%d,%u,crc=header", name, addr1, port1, addr2, port2, message_id);
+    rv  = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(PIRATE_GE_ETH_CRC_HEADER, ge_eth_param->crc);
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,%d,%s,%d,%u,crc=all", name, addr1, port1, addr2, port2, message_id);
+    rv  = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(EINVAL, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,%d,%s,%d,%u,reliable=fec,window=1024", name, addr1, port1, addr2, port2, message_id);
+    rv  = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(PIRATE_RELIABLE_FEC, ge_eth_param->reliable.mode);
+    ASSERT_EQ(1024u, ge_eth_param->reliable.window);
+#endif
 }
 
 class GeEthTest : public ChannelTest, public WithParamInterface<unsigned>
@@ -155,4 +224,212 @@ TEST_P(GeEthTest, Run)
 INSTANTIATE_TEST_SUITE_P(GeEthFunctionalTest, GeEthTest,
                         Values(0, GeEthTest::TEST_MTU_LEN));
 
+#ifndef _WIN32
+class GeEthBatchTest : public BatchTest
+{
+public:
+    void ChannelInit()
+    {
+        pirate_ge_eth_param_t *param = &Reader.param.channel.ge_eth;
+
+        pirate_init_channel_param(GE_ETH, &Reader.param);
+        snprintf(param->reader_addr, sizeof(param->reader_addr) - 1, "127.0.0.1");
+        snprintf(param->writer_addr, sizeof(param->writer_addr) - 1, "0.0.0.0");
+        param->reader_port = 0x4746;
+        param->writer_port = 0;
+        param->message_id = 0x5F475243;
+        Writer.param = Reader.param;
+    }
+};
+
+TEST_F(GeEthBatchTest, Run)
+{
+    Run();
+}
+
+class GeEthWritevTest : public WritevTest
+{
+public:
+    void ChannelInit()
+    {
+        pirate_ge_eth_param_t *param = &Reader.param.channel.ge_eth;
+
+        pirate_init_channel_param(GE_ETH, &Reader.param);
+        snprintf(param->reader_addr, sizeof(param->reader_addr) - 1, "127.0.0.1");
+        snprintf(param->writer_addr, sizeof(param->writer_addr) - 1, "0.0.0.0");
+        param->reader_port = 0x4747;
+        param->writer_port = 0;
+        param->message_id = 0x5F475243;
+        Writer.param = Reader.param;
+    }
+};
+
+TEST_F(GeEthWritevTest, Run)
+{
+    Run();
+}
+
+class GeEthCrcPayloadTest : public ChannelTest
+{
+public:
+    void ChannelInit()
+    {
+        pirate_ge_eth_param_t *param = &Reader.param.channel.ge_eth;
+
+        pirate_init_channel_param(GE_ETH, &Reader.param);
+        snprintf(param->reader_addr, sizeof(param->reader_addr) - 1, "127.0.0.1");
+        snprintf(param->writer_addr, sizeof(param->writer_addr) - 1, "0.0.0.0");
+        param->reader_port = 0x4748;
+        param->writer_port = 0;
+        param->message_id = 0x5F475243;
+        param->crc = PIRATE_GE_ETH_CRC_PAYLOAD;
+        Writer.param = Reader.param;
+    }
+
+    void TearDown()
+    {
+        ChannelTest::TearDown();
+        ASSERT_EQ(1, nonblocking_IO_attempt);
+    }
+};
+
+TEST_F(GeEthCrcPayloadTest, Run)
+{
+    Run();
+}
+
+class GeEthCrcPayloadBatchTest : public BatchTest
+{
+public:
+    void ChannelInit()
+    {
+        pirate_ge_eth_param_t *param = &Reader.param.channel.ge_eth;
+
+        pirate_init_channel_param(GE_ETH, &Reader.param);
+        snprintf(param->reader_addr, sizeof(param->reader_addr) - 1, "127.0.0.1");
+        snprintf(param->writer_addr, sizeof(param->writer_addr) - 1, "0.0.0.0");
+        param->reader_port = 0x4749;
+        param->writer_port = 0;
+        param->message_id = 0x5F475243;
+        param->crc = PIRATE_GE_ETH_CRC_PAYLOAD;
+        Writer.param = Reader.param;
+    }
+};
+
+TEST_F(GeEthCrcPayloadBatchTest, Run)
+{
+    Run();
+}
+
+// Messages are split into fragments of 10 bytes. Packets
+// that fail the CRC check are recovered as lost packets.
+class GeEthReliableTest : public ChannelTest,
+    public WithParamInterface<pirate_reliable_mode_t>
+{
+public:
+    void ChannelInit()
+    {
+        pirate_ge_eth_param_t *param = &Reader.param.channel.ge_eth;
+
+        pirate_init_channel_param(GE_ETH, &Reader.param);
+        snprintf(param->reader_addr, sizeof(param->reader_addr) - 1, "127.0.0.1");
+        snprintf(param->writer_addr, sizeof(param->writer_addr) - 1, "0.0.0.0");
+        param->reader_port = 0x474A;
+        param->writer_port = 0;
+        param->message_id = 0x5F475243;
+        param->mtu = 8 + 12 + 10;
+        param->crc = PIRATE_GE_ETH_CRC_PAYLOAD;
+        param->reliable.mode = GetParam();
+        Writer.param = Reader.param;
+    }
+
+    void TearDown()
+    {
+        ChannelTest::TearDown();
+        ASSERT_EQ(1, nonblocking_IO_attempt);
+    }
+};
+
+TEST_P(GeEthReliableTest, Run)
+{
+    Run();
+}
+
+INSTANTIATE_TEST_SUITE_P(GeEthReliableFunctionalTest, GeEthReliableTest,
+    Values(PIRATE_RELIABLE_ARQ, PIRATE_RELIABLE_FEC));
+
+// A corrupted packet is discarded by the reader
+TEST(ChannelGeEthTest, CrcPayloadCorruption)
+{
+    int rv, read_gd, write_gd, sock;
+    uint8_t data[64], packet[8 + sizeof(data)], rx[sizeof(data)];
+    struct sockaddr_in addr;
+    pirate_mmsg_t msgs[2];
+    uint16_t crc;
+    errno = 0;
+
+    read_gd = pirate_open_parse("ge_eth,127.0.0.1,18250,0.0.0.0,0,1,crc=payload", O_RDONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, read_gd);
+    write_gd = pirate_open_parse("ge_eth,127.0.0.1,18250,0.0.0.0,0,1,crc=payload", O_WRONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, write_gd);
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_NE(-1, sock);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(18250);
+
+    // header: message id, data length, CRC-16 over the
+    // header and the data. The last data byte is flipped.
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = i;
+    }
+    memset(packet, 0, sizeof(packet));
+    packet[3] = 1;
+    packet[5] = sizeof(data);
+    memcpy(packet + 8, data, sizeof(data));
+    crc = pirate_crc16_update(PIRATE_CRC16_INIT, packet, 6);
+    crc = pirate_crc16_update(crc, data, sizeof(data)) ^ PIRATE_CRC16_XOROUT;
+    packet[6] = crc >> 8;
+    packet[7] = crc & 0xff;
+    packet[sizeof(packet) - 1] ^= 0x01;
+
+    ASSERT_EQ((ssize_t) sizeof(packet), sendto(sock, packet, sizeof(packet), 0,
+        (struct sockaddr *) &addr, sizeof(addr)));
+    ASSERT_EQ((ssize_t) sizeof(data), pirate_write(write_gd, data, sizeof(data)));
+    rv = pirate_read(read_gd, rx, sizeof(rx));
+    ASSERT_EQ(EBADMSG, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+    ASSERT_EQ((ssize_t) sizeof(data), pirate_read(read_gd, rx, sizeof(rx)));
+    ASSERT_EQ(0, memcmp(data, rx, sizeof(data)));
+
+    // The intact packet is moved into the first message
+    ASSERT_EQ((ssize_t) sizeof(packet), sendto(sock, packet, sizeof(packet), 0,
+        (struct sockaddr *) &addr, sizeof(addr)));
+    ASSERT_EQ((ssize_t) sizeof(data), pirate_write(write_gd, data, sizeof(data)));
+    usleep(10000);
+
+    static uint8_t bufs[2][PIRATE_DEFAULT_GE_ETH_MTU];
+    for (int i = 0; i < 2; i++) {
+        msgs[i].buf = bufs[i];
+        msgs[i].count = sizeof(bufs[i]);
+    }
+    ASSERT_EQ(1, pirate_read_batch(read_gd, msgs, 2));
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(sizeof(data), msgs[0].len);
+    ASSERT_EQ(0, memcmp(data, bufs[0], sizeof(data)));
+
+    const pirate_stats_t *stats = pirate_get_stats(read_gd);
+    ASSERT_NE(nullptr, stats);
+    ASSERT_EQ(1u, stats->errs);
+
+    close(sock);
+    ASSERT_EQ(0, pirate_close(read_gd));
+    ASSERT_EQ(0, pirate_close(write_gd));
+}
+#endif
+
 } // namespace
@@ -17,6 +17,11 @@
 #include "libpirate.h"
 #include "channel_test.hpp"
 
+extern "C" {
+#include "libpirate_internal.h"
+#include "siphash.h"
+}
+
 namespace GAPS
 {
 
@@ -72,6 +77,82 @@ TEST(ChannelMercuryTest, UnparseChannelParam)
     free(output);
 }
 
+TEST(ChannelMercuryTest, ConfigurationParserKey)
+{
+    int rv;
+    pirate_channel_param_t param;
+    char *output;
+    const uint8_t key[PIRATE_MERCURY_KEY_SIZE] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0xff
+    };
+
+    rv = pirate_parse_channel_param("mercury,mode=payload,session=1,message=2,data=3,descriptor=4,key=000102030405060708090a0b0c0d0eFF", &param);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(0, errno);
+    EXPECT_EQ(0, std::memcmp(key, param.channel.mercury.key, sizeof(key)));
+
+    output = (char*) calloc(128, sizeof(char));
+    rv = pirate_unparse_channel_param(&param, output, 128);
+    ASSERT_EQ(97, rv);
+    ASSERT_STREQ("mercury,mode=payload,session=1,message=2,data=3,descriptor=4,key=000102030405060708090a0b0c0d0eff", output);
+    free(output);
+
+    rv = pirate_parse_channel_param("mercury,mode=payload,session=1,message=2,data=3,key=0001", &param);
+    ASSERT_EQ(-1, rv);
+    ASSERT_EQ(EINVAL, errno);
+    errno = 0;
+
+    rv = pirate_parse_channel_param("mercury,mode=payload,session=1,message=2,data=3,key=000102030405060708090a0b0c0d0e0g", &param);
+    ASSERT_EQ(-1, rv);
+    ASSERT_EQ(EINVAL, errno);
+    errno = 0;
+}
+
+// The payload is transferred directly from the buffer of the
+// writer so only the immediate mode has a maximum length.
+TEST(ChannelMercuryTest, WriteMtu)
+{
+    pirate_channel_param_t param;
+
+    pirate_init_channel_param(MERCURY, &param);
+    param.channel.mercury.mode = MERCURY_IMMEDIATE;
+    ASSERT_EQ(PIRATE_MERCURY_IMMEDIATE_SIZE, pirate_write_mtu_estimate(&param));
+    param.channel.mercury.mtu = 64;
+    ASSERT_EQ(64, pirate_write_mtu_estimate(&param));
+
+    pirate_init_channel_param(MERCURY, &param);
+    param.channel.mercury.mode = MERCURY_PAYLOAD;
+    ASSERT_EQ(0, pirate_write_mtu_estimate(&param));
+    param.channel.mercury.mtu = 1 << 20;
+    ASSERT_EQ(1 << 20, pirate_write_mtu_estimate(&param));
+}
+
+// Reference test vectors of the SipHash paper and implementation.
+// The key is 00 01 .. 0f and the message is 00 01 .. (len - 1).
+TEST(ChannelMercuryTest, SipHash)
+{
+    uint8_t key_bytes[PIRATE_SIPHASH_KEY_SIZE], msg[64];
+    pirate_siphash_key_t key;
+    uint64_t hash[2];
+
+    for (unsigned i = 0; i < sizeof(key_bytes); i++) {
+        key_bytes[i] = i;
+    }
+    for (unsigned i = 0; i < sizeof(msg); i++) {
+        msg[i] = i;
+    }
+    pirate_siphash_key(&key, key_bytes);
+
+    EXPECT_EQ(0x726fdb47dd0e0e31ull, pirate_siphash64(&key, msg, 0));
+    EXPECT_EQ(0xa129ca6149be45e5ull, pirate_siphash64(&key, msg, 15));
+    EXPECT_EQ(0x958a324ceb064572ull, pirate_siphash64(&key, msg, 63));
+
+    pirate_siphash128(&key, msg, 0, hash);
+    EXPECT_EQ(0xe6a825ba047f81a3ull, hash[0]);
+    EXPECT_EQ(0x930255c71472f66dull, hash[1]);
+}
+
 class MercuryTest : public ChannelTest, public WithParamInterface<pirate_mercury_param_t>
 {
 public:
@@ -99,26 +180,33 @@ TEST_P(MercuryTest, Run)
 
 #define IMM MERCURY_IMMEDIATE
 #define PAY MERCURY_PAYLOAD
+#define KEY { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f }
 
 static pirate_mercury_param_t MercuryParams [] =
 {
 // these are the values that work
-// MODE, SESS, MSG, DATA, DESC, MTU
-{  IMM,    1,    1,   1,    0,    0},
-{  IMM,    1,    1,   3,    0,    0},
-{  IMM,    1,    2,   3,    0,    0},
-{  IMM,    1,    3,   3,    0,    0},
-{  IMM,    2,    2,   1,    0,    0},
-{  IMM,    2,    2,   2,    0,    0},
-{  IMM,    2,    3,   3,    0,    0},
-
-{  PAY,    1,    1,   1,    1,    0},
-{  PAY,    1,    1,   3,    3,    0},
-{  PAY,    1,    2,   3,    3,    0},
-{  PAY,    1,    3,   3,    3,    0},
-{  PAY,    2,    2,   1,    1,    0},
-{  PAY,    2,    2,   2,    2,    0},
-{  PAY,    2,    3,   3,    3,    0},
+// MODE, SESS, MSG, DATA, DESC, MTU, KEY
+{  IMM,    1,    1,   1,    0,    0, {}},
+{  IMM,    1,    1,   3,    0,    0, {}},
+{  IMM,    1,    2,   3,    0,    0, {}},
+{  IMM,    1,    3,   3,    0,    0, {}},
+{  IMM,    2,    2,   1,    0,    0, {}},
+{  IMM,    2,    2,   2,    0,    0, {}},
+{  IMM,    2,    3,   3,    0,    0, {}},
+
+{  PAY,    1,    1,   1,    1,    0, {}},
+{  PAY,    1,    1,   3,    3,    0, {}},
+{  PAY,    1,    2,   3,    3,    0, {}},
+{  PAY,    1,    3,   3,    3,    0, {}},
+{  PAY,    2,    2,   1,    1,    0, {}},
+{  PAY,    2,    2,   2,    2,    0, {}},
+{  PAY,    2,    3,   3,    3,    0, {}},
+
+// authenticated with SipHash
+{  IMM,    1,    1,   1,    0,    0, KEY},
+{  IMM,    2,    2,   2,    0,    0, KEY},
+{  PAY,    1,    1,   1,    1,    0, KEY},
+{  PAY,    2,    2,   2,    2,    0, KEY},
 };
 
 INSTANTIATE_TEST_SUITE_P(MercuryFunctionalTest, MercuryTest,
@@ -95,6 +95,72 @@ TEST_P(PipeTest, Run)
 INSTANTIATE_TEST_SUITE_P(PipeFunctionalTest, PipeTest,
     Combine(Values(0, 512), Values(0, TEST_MIN_TX_LEN)));
 
+class PipeBatchTest : public BatchTest, public WithParamInterface<int>
+{
+public:
+    void ChannelInit()
+    {
+        pirate_pipe_param_t *param = &Reader.param.channel.pipe;
+
+        pirate_init_channel_param(PIPE, &Reader.param);
+        strncpy(param->path, "/tmp/gaps.channel.test", PIRATE_LEN_NAME);
+        param->min_tx = GetParam();
+        Writer.param = Reader.param;
+    }
+};
+
+TEST_P(PipeBatchTest, Run)
+{
+    Run();
+}
+
+INSTANTIATE_TEST_SUITE_P(PipeBatchFunctionalTest, PipeBatchTest,
+    Values(0, TEST_MIN_TX_LEN));
+
+class PipeWritevTest : public WritevTest, public WithParamInterface<int>
+{
+public:
+    void ChannelInit()
+    {
+        pirate_pipe_param_t *param = &Reader.param.channel.pipe;
+
+        pirate_init_channel_param(PIPE, &Reader.param);
+        strncpy(param->path, "/tmp/gaps.channel.test", PIRATE_LEN_NAME);
+        param->min_tx = GetParam();
+        Writer.param = Reader.param;
+    }
+};
+
+TEST_P(PipeWritevTest, Run)
+{
+    Run();
+}
+
+INSTANTIATE_TEST_SUITE_P(PipeWritevFunctionalTest, PipeWritevTest,
+    Values(0, TEST_MIN_TX_LEN));
+
+class PipePeekTest : public PeekTest, public WithParamInterface<int>
+{
+public:
+    void ChannelInit()
+    {
+        pirate_pipe_param_t *param = &Reader.param.channel.pipe;
+
+        pirate_init_channel_param(PIPE, &Reader.param);
+        strncpy(param->path, "/tmp/gaps.channel.test", PIRATE_LEN_NAME);
+        param->min_tx = GetParam();
+        Writer.param = Reader.param;
+    }
+};
+
+TEST_P(PipePeekTest, Run)
+{
+    Run();
+}
+
+INSTANTIATE_TEST_SUITE_P(PipePeekFunctionalTest, PipePeekTest,
+    Values(0, TEST_MIN_TX_LEN));
+
 class PipeCloseWriterTest : public ClosedWriterTest
 {
 public:
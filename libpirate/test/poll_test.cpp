@@ -0,0 +1,330 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#include <climits>
+#include <errno.h>
+#include <pthread.h>
+#include <set>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "libpirate.h"
+
+namespace GAPS {
+
+TEST(PollTest, UdpSocket)
+{
+    const int num_channels = 4;
+    int rv, read_gds[num_channels], write_gds[num_channels];
+    char opt[128];
+    char data = 0x5A;
+    pirate_poll_event_t events[num_channels];
+    pirate_poll_t *poll;
+    errno = 0;
+
+    poll = pirate_poll_create();
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(nullptr, poll);
+
+    for (int i = 0; i < num_channels; i++) {
+        snprintf(opt, sizeof(opt), "udp_socket,127.0.0.1,%d,0.0.0.0,0", 26265 + i);
+        read_gds[i] = pirate_open_parse(opt, O_RDONLY);
+        ASSERT_EQ(0, errno);
+        ASSERT_NE(-1, read_gds[i]);
+        write_gds[i] = pirate_open_parse(opt, O_WRONLY);
+        ASSERT_EQ(0, errno);
+        ASSERT_NE(-1, write_gds[i]);
+        rv = pirate_poll_add(poll, read_gds[i], PIRATE_POLLIN);
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ(0, rv);
+    }
+
+    rv = pirate_poll_add(poll, read_gds[0], PIRATE_POLLIN);
+    ASSERT_EQ(EEXIST, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    rv = pirate_poll_add(poll, write_gds[0], PIRATE_POLLIN);
+    ASSERT_EQ(EINVAL, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    rv = pirate_poll_add(poll, INT_MAX, PIRATE_POLLIN);
+    ASSERT_EQ(EBADF, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    rv = pirate_poll_wait(poll, events, num_channels, 0);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+
+    rv = pirate_poll_wait(poll, events, num_channels, 20);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+
+    ASSERT_EQ(1, pirate_write(write_gds[1], &data, 1));
+    ASSERT_EQ(1, pirate_write(write_gds[3], &data, 1));
+
+    std::set<int> ready;
+    while (ready.size() < 2) {
+        rv = pirate_poll_wait(poll, events, num_channels, -1);
+        ASSERT_EQ(0, errno);
+        ASSERT_GT(rv, 0);
+        for (int i = 0; i < rv; i++) {
+            ASSERT_EQ((uint32_t) PIRATE_POLLIN, events[i].events);
+            ready.insert(events[i].gd);
+        }
+    }
+    ASSERT_EQ(std::set<int>({read_gds[1], read_gds[3]}), ready);
+
+    // readiness is level-triggered
+    rv = pirate_poll_wait(poll, events, 1, 0);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(1, rv);
+
+    for (int gd : ready) {
+        ASSERT_EQ(1, pirate_read(gd, &data, 1));
+    }
+    rv = pirate_poll_wait(poll, events, num_channels, 0);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+
+    for (int i = 0; i < num_channels; i++) {
+        rv = pirate_poll_del(poll, read_gds[i]);
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ(0, rv);
+    }
+    rv = pirate_poll_del(poll, read_gds[0]);
+    ASSERT_EQ(ENOENT, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    rv = pirate_poll_close(poll);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+
+    for (int i = 0; i < num_channels; i++) {
+        ASSERT_EQ(0, pirate_close(read_gds[i]));
+        ASSERT_EQ(0, pirate_close(write_gds[i]));
+    }
+}
+
+#if PIRATE_SHMEM_FEATURE
+
+// more rings than a single helper thread can watch
+#define POLL_SHMEM_CHANNELS 160
+#define POLL_SHMEM_BUFFER_SIZE 256
+
+struct PollOpenArgs {
+    const char *opt;
+    int gd;
+};
+
+static void *PollOpenReader(void *arg)
+{
+    PollOpenArgs *args = (PollOpenArgs *) arg;
+    args->gd = pirate_open_parse(args->opt, O_RDONLY);
+    return NULL;
+}
+
+struct PollWriteArgs {
+    int gd;
+    size_t count;
+};
+
+static void *PollDelayedWrite(void *arg)
+{
+    PollWriteArgs *args = (PollWriteArgs *) arg;
+    char data[POLL_SHMEM_BUFFER_SIZE] = {0};
+    usleep(20000);
+    if (pirate_write(args->gd, data, args->count) != (ssize_t) args->count) {
+        return (void *) 1;
+    }
+    return NULL;
+}
+
+static void *PollDelayedRead(void *arg)
+{
+    PollWriteArgs *args = (PollWriteArgs *) arg;
+    char data[POLL_SHMEM_BUFFER_SIZE];
+    usleep(20000);
+    if (pirate_read(args->gd, data, sizeof(data)) != (ssize_t) args->count) {
+        return (void *) 1;
+    }
+    return NULL;
+}
+
+static void PollOpenShmem(const char *opt, int *read_gd, int *write_gd)
+{
+    pthread_t reader_id;
+    PollOpenArgs args = {opt, -1};
+
+    ASSERT_EQ(0, pthread_create(&reader_id, NULL, PollOpenReader, &args));
+    *write_gd = pirate_open_parse(opt, O_WRONLY);
+    ASSERT_EQ(0, pthread_join(reader_id, NULL));
+    ASSERT_EQ(0, errno);
+    ASSERT_LT(args.gd, -1);
+    ASSERT_LT(*write_gd, -1);
+    *read_gd = args.gd;
+}
+
+// A single poll set waits on many shared memory
+// channels and a file descriptor channel.
+TEST(PollTest, Shmem)
+{
+    int rv, read_gds[POLL_SHMEM_CHANNELS], write_gds[POLL_SHMEM_CHANNELS];
+    int udp_read_gd, udp_write_gd;
+    char opt[128], data[POLL_SHMEM_BUFFER_SIZE];
+    pirate_poll_event_t events[8];
+    pirate_poll_t *poll;
+    pthread_t thread_id;
+    PollWriteArgs args;
+    void *status;
+    ssize_t nbytes;
+    errno = 0;
+
+    poll = pirate_poll_create();
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(nullptr, poll);
+
+    for (int i = 0; i < POLL_SHMEM_CHANNELS; i++) {
+        snprintf(opt, sizeof(opt), "shmem,/gaps.poll_test_%d,buffer_size=%d,wait=futex",
+            i, POLL_SHMEM_BUFFER_SIZE);
+        PollOpenShmem(opt, &read_gds[i], &write_gds[i]);
+        rv = pirate_poll_add(poll, read_gds[i], PIRATE_POLLIN);
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ(0, rv);
+    }
+
+    udp_read_gd = pirate_open_parse("udp_socket,127.0.0.1,26269,0.0.0.0,0", O_RDONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, udp_read_gd);
+    udp_write_gd = pirate_open_parse("udp_socket,127.0.0.1,26269,0.0.0.0,0", O_WRONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, udp_write_gd);
+    rv = pirate_poll_add(poll, udp_read_gd, PIRATE_POLLIN);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+
+    rv = pirate_poll_add(poll, read_gds[0], PIRATE_POLLIN);
+    ASSERT_EQ(EEXIST, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    rv = pirate_poll_wait(poll, events, 8, 20);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+
+    // the reader is woken up by a packet written while it is blocked
+    const int channels[] = {0, 100, POLL_SHMEM_CHANNELS - 1};
+    for (int i : channels) {
+        args.gd = write_gds[i];
+        args.count = 4;
+        ASSERT_EQ(0, pthread_create(&thread_id, NULL, PollDelayedWrite, &args));
+        rv = pirate_poll_wait(poll, events, 8, -1);
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ(1, rv);
+        ASSERT_EQ(read_gds[i], events[0].gd);
+        ASSERT_EQ((uint32_t) PIRATE_POLLIN, events[0].events);
+        ASSERT_EQ(0, pthread_join(thread_id, &status));
+        ASSERT_EQ(nullptr, status);
+        nbytes = pirate_read(read_gds[i], data, sizeof(data));
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ(4, nbytes);
+    }
+
+    args.gd = udp_write_gd;
+    args.count = 4;
+    ASSERT_EQ(0, pthread_create(&thread_id, NULL, PollDelayedWrite, &args));
+    rv = pirate_poll_wait(poll, events, 8, -1);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(1, rv);
+    ASSERT_EQ(udp_read_gd, events[0].gd);
+    ASSERT_EQ(0, pthread_join(thread_id, &status));
+    ASSERT_EQ(nullptr, status);
+    ASSERT_EQ(4, pirate_read(udp_read_gd, data, sizeof(data)));
+
+    // a packet written while no one waits is reported with a zero timeout
+    ASSERT_EQ(4, pirate_write(write_gds[3], data, 4));
+    rv = 0;
+    for (int i = 0; (i < 1000) && (rv == 0); i++) {
+        rv = pirate_poll_wait(poll, events, 8, 0);
+        if (rv == 0) {
+            usleep(1000);
+        }
+    }
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(1, rv);
+    ASSERT_EQ(read_gds[3], events[0].gd);
+    ASSERT_EQ(4, pirate_read(read_gds[3], data, sizeof(data)));
+
+    // the writer is woken up when the reader drains a full channel
+    rv = pirate_poll_del(poll, read_gds[1]);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    rv = pirate_poll_add(poll, write_gds[1], PIRATE_POLLOUT);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    rv = pirate_poll_wait(poll, events, 8, 0);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(1, rv);
+    ASSERT_EQ(write_gds[1], events[0].gd);
+    ASSERT_EQ((uint32_t) PIRATE_POLLOUT, events[0].events);
+
+    memset(data, 0, sizeof(data));
+    nbytes = pirate_write(write_gds[1], data, POLL_SHMEM_BUFFER_SIZE - 8);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(POLL_SHMEM_BUFFER_SIZE - 8, nbytes);
+    rv = pirate_poll_wait(poll, events, 8, 0);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+
+    args.gd = read_gds[1];
+    args.count = POLL_SHMEM_BUFFER_SIZE - 8;
+    ASSERT_EQ(0, pthread_create(&thread_id, NULL, PollDelayedRead, &args));
+    rv = pirate_poll_wait(poll, events, 8, -1);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(1, rv);
+    ASSERT_EQ(write_gds[1], events[0].gd);
+    ASSERT_EQ((uint32_t) PIRATE_POLLOUT, events[0].events);
+    ASSERT_EQ(0, pthread_join(thread_id, &status));
+    ASSERT_EQ(nullptr, status);
+
+    // closing the writer wakes up the reader
+    rv = pirate_poll_del(poll, write_gds[1]);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(0, pirate_close(write_gds[2]));
+    rv = pirate_poll_wait(poll, events, 8, -1);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(1, rv);
+    ASSERT_EQ(read_gds[2], events[0].gd);
+    ASSERT_EQ((uint32_t) (PIRATE_POLLIN | PIRATE_POLLHUP), events[0].events);
+
+    rv = pirate_poll_close(poll);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+
+    for (int i = 0; i < POLL_SHMEM_CHANNELS; i++) {
+        if (i != 2) {
+            ASSERT_EQ(0, pirate_close(write_gds[i]));
+        }
+        ASSERT_EQ(0, pirate_close(read_gds[i]));
+    }
+    ASSERT_EQ(0, pirate_close(udp_read_gd));
+    ASSERT_EQ(0, pirate_close(udp_write_gd));
+}
+#endif
+
+} // namespace
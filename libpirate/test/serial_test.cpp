@@ -13,6 +13,14 @@
  * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
  */
 
+#include <algorithm>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
 #include "libpirate.h"
 #include "channel_test.hpp"
 
@@ -76,8 +84,165 @@ TEST(ChannelSerialTest, ConfigurationParser) {
     ASSERT_EQ(EINVAL, errno);
     ASSERT_EQ(-1, rv);
     errno = 0;
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,tx_queue=%u,framing=cobs", name, path, 512);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(512u, serial_param->tx_queue);
+    ASSERT_EQ(PIRATE_SERIAL_FRAMING_COBS, serial_param->framing);
+    rv = pirate_unparse_channel_param(&param, opt, sizeof(opt));
+    ASSERT_STREQ("serial,/tmp/test_serial,tx_queue=512,framing=cobs", opt);
+    ASSERT_EQ(49, rv);
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,framing=slip", name, path);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ((unsigned)PIRATE_SERIAL_DEFAULT_TX_QUEUE, serial_param->tx_queue);
+    ASSERT_EQ(PIRATE_SERIAL_FRAMING_SLIP, serial_param->framing);
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,framing=hdlc", name, path);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(EINVAL, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
 }
 
+// Copies the output of one pseudoterminal to the input
+// of another. The byte at offset drop is discarded.
+struct SerialRelay {
+    int from;
+    int to;
+    long drop;
+    int stop;
+};
+
+static void *SerialRelayRun(void *arg) {
+    SerialRelay *relay = (SerialRelay *) arg;
+    uint8_t buf[256];
+    long offset = 0;
+
+    while (!__atomic_load_n(&relay->stop, __ATOMIC_ACQUIRE)) {
+        struct pollfd pfd = { relay->from, POLLIN, 0 };
+        if (poll(&pfd, 1, 10) <= 0) {
+            continue;
+        }
+        ssize_t rv = read(relay->from, buf, sizeof(buf));
+        if (rv <= 0) {
+            break;
+        }
+        for (ssize_t i = 0; i < rv; i++, offset++) {
+            if ((offset != relay->drop) && (write(relay->to, &buf[i], 1) != 1)) {
+                return NULL;
+            }
+        }
+    }
+    return NULL;
+}
+
+static int SerialOpenPty(std::string &path) {
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        return -1;
+    }
+    if ((grantpt(fd) != 0) || (unlockpt(fd) != 0) || (ptsname(fd) == NULL)) {
+        close(fd);
+        return -1;
+    }
+    path = ptsname(fd);
+    return fd;
+}
+
+struct SerialWriterArgs {
+    int gd;
+    const std::vector<std::vector<uint8_t>> *packets;
+    int rv;
+};
+
+static void *SerialWriterRun(void *arg) {
+    SerialWriterArgs *args = (SerialWriterArgs *) arg;
+    args->rv = 0;
+    for (const auto &packet : *args->packets) {
+        if (pirate_write(args->gd, packet.data(), packet.size()) != (ssize_t) packet.size()) {
+            args->rv = -1;
+            return NULL;
+        }
+    }
+    args->rv = pirate_close(args->gd);
+    return NULL;
+}
+
+class SerialPtyTest : public TestWithParam<std::tuple<const char*, long>>
+{
+};
+
+// The writer and the reader are connected through a pair of
+// pseudoterminals. A small write queue wraps around and blocks
+// the writer while the pseudoterminal is full.
+TEST_P(SerialPtyTest, Run)
+{
+    const char *framing = std::get<0>(GetParam());
+    long drop = std::get<1>(GetParam());
+    std::string writer_path, reader_path;
+    std::vector<std::vector<uint8_t>> packets;
+    char opt[256];
+
+    // the packet bytes include the COBS and SLIP delimiters
+    const size_t sizes[] = { 16, 1, 0, 300, 3000, 255, 254, 1024 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        std::vector<uint8_t> packet(sizes[i]);
+        for (size_t j = 0; j < sizes[i]; j++) {
+            const uint8_t pattern[] = { 0x00, 0xC0, 0xDB, 0xDC, 0xDD, 0xFF };
+            packet[j] = (j % 3) ? pattern[(i + j) % sizeof(pattern)] : (uint8_t) (i + j);
+        }
+        packets.push_back(packet);
+    }
+
+    SerialRelay relay;
+    relay.from = SerialOpenPty(writer_path);
+    ASSERT_GE(relay.from, 0);
+    relay.to = SerialOpenPty(reader_path);
+    ASSERT_GE(relay.to, 0);
+    relay.drop = drop;
+    relay.stop = 0;
+
+    snprintf(opt, sizeof(opt), "serial,%s,mtu=4096,tx_queue=512%s", reader_path.c_str(), framing);
+    int reader = pirate_open_parse(opt, O_RDONLY);
+    ASSERT_GE(reader, 0);
+    snprintf(opt, sizeof(opt), "serial,%s,mtu=4096,tx_queue=512%s", writer_path.c_str(), framing);
+    int writer = pirate_open_parse(opt, O_WRONLY);
+    ASSERT_GE(writer, 0);
+
+    pthread_t relay_id, writer_id;
+    SerialWriterArgs args = { writer, &packets, -1 };
+    ASSERT_EQ(0, pthread_create(&relay_id, NULL, SerialRelayRun, &relay));
+    ASSERT_EQ(0, pthread_create(&writer_id, NULL, SerialWriterRun, &args));
+
+    // a dropped byte damages the first packet
+    std::vector<uint8_t> buf(4096);
+    for (size_t i = (drop < 0) ? 0 : 1; i < packets.size(); i++) {
+        ssize_t rv = pirate_read(reader, buf.data(), buf.size());
+        ASSERT_EQ((ssize_t) packets[i].size(), rv);
+        ASSERT_TRUE(std::equal(packets[i].begin(), packets[i].end(), buf.begin()));
+    }
+
+    ASSERT_EQ(0, pthread_join(writer_id, NULL));
+    ASSERT_EQ(0, args.rv);
+    __atomic_store_n(&relay.stop, 1, __ATOMIC_RELEASE);
+    ASSERT_EQ(0, pthread_join(relay_id, NULL));
+    ASSERT_EQ(0, pirate_close(reader));
+    close(relay.from);
+    close(relay.to);
+}
+
+INSTANTIATE_TEST_SUITE_P(SerialPtyFunctionalTest, SerialPtyTest,
+    Values(std::make_tuple("", -1L),
+           std::make_tuple(",framing=cobs", -1L),
+           std::make_tuple(",framing=slip", -1L),
+           std::make_tuple(",framing=cobs", 9L),
+           std::make_tuple(",framing=slip", 9L)));
+
 class SerialTest : public ChannelTest,
     public WithParamInterface<std::tuple<speed_t, int>>
 {
@@ -0,0 +1,424 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <vector>
+#include "libpirate.h"
+#include "channel_test.hpp"
+#include "shmem_mpmc.h"
+
+namespace GAPS
+{
+using ::testing::WithParamInterface;
+using ::testing::TestWithParam;
+using ::testing::Values;
+using ::testing::Combine;
+
+TEST(ChannelShmemMpmcTest, ConfigurationParser) {
+    int rv;
+    pirate_channel_param_t param;
+
+    char opt[256];
+    char desc[256];
+    const char *name = "shmem_mpmc";
+    const char *path = "/tmp/test_shmem_mpmc";
+    const unsigned slots = 42;
+
+#if PIRATE_SHMEM_FEATURE
+    const pirate_shmem_mpmc_param_t *mpmc_param = &param.channel.shmem_mpmc;
+    const unsigned slot_size = 4242;
+
+    snprintf(opt, sizeof(opt) - 1, "%s", name);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(EINVAL, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s", name, path);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(SHMEM_MPMC, param.channel_type);
+    ASSERT_STREQ(path, mpmc_param->path);
+    ASSERT_EQ(0u, mpmc_param->slots);
+    ASSERT_EQ(0u, mpmc_param->slot_size);
+    ASSERT_EQ(PIRATE_WAIT_ADAPTIVE, mpmc_param->wait);
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,slots=%u,slot_size=%u,wait=futex", name, path,
+                slots, slot_size);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(SHMEM_MPMC, param.channel_type);
+    ASSERT_STREQ(path, mpmc_param->path);
+    ASSERT_EQ(slots, mpmc_param->slots);
+    ASSERT_EQ(slot_size, mpmc_param->slot_size);
+    ASSERT_EQ(PIRATE_WAIT_FUTEX, mpmc_param->wait);
+
+    rv = pirate_unparse_channel_param(&param, desc, sizeof(desc));
+    ASSERT_STREQ("shmem_mpmc,/tmp/test_shmem_mpmc,slots=42,slot_size=4242,wait=futex", desc);
+    ASSERT_EQ((int) strlen(desc), rv);
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,slot=%u", name, path, slots);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(EINVAL, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+#else
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,slots=%u", name, path, slots);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(-1, rv);
+    ASSERT_EQ(ESOCKTNOSUPPORT, errno);
+    errno = 0;
+    (void) desc;
+#endif
+}
+
+#if PIRATE_SHMEM_FEATURE
+class ShmemMpmcTest : public ChannelTest,
+    public WithParamInterface<std::tuple<int, int, pirate_wait_t>>
+{
+public:
+    void ChannelInit()
+    {
+        pirate_shmem_mpmc_param_t *param = &Reader.param.channel.shmem_mpmc;
+
+        pirate_init_channel_param(SHMEM_MPMC, &Reader.param);
+        strncpy(param->path, "/gaps.shmem_mpmc_test", PIRATE_LEN_NAME - 1);
+        auto test_param = GetParam();
+        param->slots = std::get<0>(test_param);
+        param->slot_size = std::get<1>(test_param);
+        param->wait = std::get<2>(test_param);
+        Writer.param = Reader.param;
+    }
+
+    static const int TEST_SLOTS = 2;
+    static const int TEST_SLOT_SIZE = 32;
+};
+
+TEST_P(ShmemMpmcTest, Run)
+{
+    Run();
+}
+
+INSTANTIATE_TEST_SUITE_P(ShmemMpmcFunctionalTest, ShmemMpmcTest,
+    Combine(Values(0, ShmemMpmcTest::TEST_SLOTS),
+            Values(0, ShmemMpmcTest::TEST_SLOT_SIZE),
+            Values(PIRATE_WAIT_ADAPTIVE, PIRATE_WAIT_FUTEX)));
+
+class ShmemMpmcCloseWriterTest : public ClosedWriterTest
+{
+public:
+    void ChannelInit()
+    {
+        pirate_init_channel_param(SHMEM_MPMC, &Reader.param);
+        strncpy(Reader.param.channel.shmem_mpmc.path, "/gaps.shmem_mpmc_close_test", PIRATE_LEN_NAME - 1);
+        Writer.param = Reader.param;
+    }
+};
+
+TEST_F(ShmemMpmcCloseWriterTest, Run)
+{
+    Run();
+}
+
+class ShmemMpmcCloseReaderTest : public ClosedReaderTest
+{
+public:
+    void ChannelInit()
+    {
+        pirate_init_channel_param(SHMEM_MPMC, &Reader.param);
+        strncpy(Reader.param.channel.shmem_mpmc.path, "/gaps.shmem_mpmc_close_test", PIRATE_LEN_NAME - 1);
+        Writer.param = Reader.param;
+    }
+};
+
+TEST_F(ShmemMpmcCloseReaderTest, Run)
+{
+    Run();
+}
+
+static const unsigned MPMC_PRODUCERS = 4;
+static const unsigned MPMC_CONSUMERS = 4;
+static const unsigned MPMC_MESSAGES = 10000;
+static const char *MPMC_CONFIG = "shmem_mpmc,/gaps.shmem_mpmc_many_test,slots=16,slot_size=64";
+
+struct ShmemMpmcArgs {
+    unsigned id;
+    int rv;
+    std::vector<unsigned> *received;
+    pthread_barrier_t *opened;
+};
+
+static void *ShmemMpmcProducer(void *arg)
+{
+    ShmemMpmcArgs *args = (ShmemMpmcArgs *) arg;
+    uint32_t msg[2];
+    int gd;
+
+    args->rv = -1;
+    gd = pirate_open_parse(MPMC_CONFIG, O_WRONLY);
+    // The consumers observe the end of file once every open
+    // producer has closed the channel.
+    pthread_barrier_wait(args->opened);
+    if (gd == -1) {
+        return NULL;
+    }
+    msg[0] = args->id;
+    for (unsigned i = 0; i < MPMC_MESSAGES; i++) {
+        msg[1] = i;
+        if (pirate_write(gd, msg, sizeof(msg)) != sizeof(msg)) {
+            pirate_close(gd);
+            return NULL;
+        }
+    }
+    args->rv = pirate_close(gd);
+    return NULL;
+}
+
+static void *ShmemMpmcConsumer(void *arg)
+{
+    ShmemMpmcArgs *args = (ShmemMpmcArgs *) arg;
+    uint32_t msg[2];
+    ssize_t rv;
+    int gd;
+
+    args->rv = -1;
+    if ((gd = pirate_open_parse(MPMC_CONFIG, O_RDONLY)) == -1) {
+        return NULL;
+    }
+    while ((rv = pirate_read(gd, msg, sizeof(msg))) == sizeof(msg)) {
+        if ((msg[0] >= MPMC_PRODUCERS) || (msg[1] >= MPMC_MESSAGES)) {
+            break;
+        }
+        __atomic_fetch_add(&args->received[msg[0]][msg[1]], 1, __ATOMIC_RELAXED);
+    }
+    if (rv != 0) {
+        pirate_close(gd);
+        return NULL;
+    }
+    args->rv = pirate_close(gd);
+    return NULL;
+}
+
+// Each producer and each consumer opens its own gaps descriptor.
+// Every message is received exactly once.
+TEST(ChannelShmemMpmcTest, ManyProducersManyConsumers)
+{
+    std::vector<unsigned> received[MPMC_PRODUCERS];
+    ShmemMpmcArgs producers[MPMC_PRODUCERS], consumers[MPMC_CONSUMERS];
+    pthread_t producer_ids[MPMC_PRODUCERS], consumer_ids[MPMC_CONSUMERS];
+    pthread_barrier_t opened;
+
+    ASSERT_EQ(0, pthread_barrier_init(&opened, NULL, MPMC_PRODUCERS));
+    for (unsigned i = 0; i < MPMC_PRODUCERS; i++) {
+        received[i].resize(MPMC_MESSAGES, 0);
+    }
+    for (unsigned i = 0; i < MPMC_CONSUMERS; i++) {
+        consumers[i].id = i;
+        consumers[i].received = received;
+        ASSERT_EQ(0, pthread_create(&consumer_ids[i], NULL, ShmemMpmcConsumer, &consumers[i]));
+    }
+    for (unsigned i = 0; i < MPMC_PRODUCERS; i++) {
+        producers[i].id = i;
+        producers[i].received = received;
+        producers[i].opened = &opened;
+        ASSERT_EQ(0, pthread_create(&producer_ids[i], NULL, ShmemMpmcProducer, &producers[i]));
+    }
+    for (unsigned i = 0; i < MPMC_PRODUCERS; i++) {
+        ASSERT_EQ(0, pthread_join(producer_ids[i], NULL));
+        ASSERT_EQ(0, producers[i].rv);
+    }
+    for (unsigned i = 0; i < MPMC_CONSUMERS; i++) {
+        ASSERT_EQ(0, pthread_join(consumer_ids[i], NULL));
+        ASSERT_EQ(0, consumers[i].rv);
+    }
+    for (unsigned i = 0; i < MPMC_PRODUCERS; i++) {
+        for (unsigned j = 0; j < MPMC_MESSAGES; j++) {
+            ASSERT_EQ(1u, received[i][j]) << "producer " << i << " message " << j;
+        }
+    }
+    ASSERT_EQ(0, pthread_barrier_destroy(&opened));
+}
+
+static const char *MPMC_CRASH_PATH = "/gaps.shmem_mpmc_crash_test";
+static const unsigned MPMC_CRASH_SLOTS = 4;
+
+static void *ShmemMpmcOpenWriter(void *arg)
+{
+    int *gd = (int *) arg;
+    *gd = pirate_open_parse("shmem_mpmc,/gaps.shmem_mpmc_crash_test,slots=4", O_WRONLY);
+    return NULL;
+}
+
+// The process that has claimed a slot is
+// terminated before it publishes or releases the slot.
+class ShmemMpmcCrashTest : public testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        pthread_t writer_id;
+        struct stat st;
+        int fd;
+
+        errno = 0;
+        ASSERT_EQ(0, pthread_create(&writer_id, NULL, ShmemMpmcOpenWriter, &writer));
+        reader = pirate_open_parse("shmem_mpmc,/gaps.shmem_mpmc_crash_test,slots=4", O_RDONLY);
+        ASSERT_EQ(0, pthread_join(writer_id, NULL));
+        ASSERT_EQ(0, errno);
+        ASSERT_LT(reader, -1);
+        ASSERT_LT(writer, -1);
+
+        fd = shm_open(MPMC_CRASH_PATH, O_RDWR, 0);
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(0, fstat(fd, &st));
+        size = st.st_size;
+        ring = (shmem_mpmc_t *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        ASSERT_NE(MAP_FAILED, ring);
+    }
+
+    void TearDown() override
+    {
+        munmap(ring, size);
+        ASSERT_EQ(0, pirate_close(writer));
+        ASSERT_EQ(0, pirate_close(reader));
+    }
+
+    // Claims a slot in a child process that exits without publishing
+    // or releasing it. The child inherits the mapping of the ring.
+    void ChildClaim(int access)
+    {
+        uint64_t pos, state;
+        int status;
+        pid_t pid = fork();
+        ASSERT_GE(pid, 0);
+        if (pid == 0) {
+            _exit(shmem_mpmc_try_claim(ring, access, &pos, &state) == 1 ? 0 : 1);
+        }
+        ASSERT_EQ(pid, waitpid(pid, &status, 0));
+        ASSERT_TRUE(WIFEXITED(status));
+        ASSERT_EQ(0, WEXITSTATUS(status));
+    }
+
+    void Write(uint32_t val)
+    {
+        ASSERT_EQ((ssize_t) sizeof(val), pirate_write(writer, &val, sizeof(val)));
+    }
+
+    void Read(uint32_t expected)
+    {
+        uint32_t val = 0;
+        ASSERT_EQ((ssize_t) sizeof(val), pirate_read(reader, &val, sizeof(val)));
+        ASSERT_EQ(expected, val);
+    }
+
+    int reader, writer;
+    shmem_mpmc_t *ring;
+    size_t size;
+};
+
+TEST_F(ShmemMpmcCrashTest, Writer)
+{
+    Write(1);
+    ChildClaim(O_WRONLY);
+    Write(2);
+    Read(1);
+    Read(2);
+    ASSERT_EQ(1u, atomic_load(&ring->abandoned));
+    Write(3);
+    Read(3);
+}
+
+TEST_F(ShmemMpmcCrashTest, Reader)
+{
+    for (uint32_t i = 0; i < MPMC_CRASH_SLOTS; i++) {
+        Write(i);
+    }
+    ChildClaim(O_RDONLY);
+    // the slot of the first packet is released
+    // when the writer observes that the ring is full
+    Write(MPMC_CRASH_SLOTS);
+    ASSERT_EQ(1u, atomic_load(&ring->abandoned));
+    for (uint32_t i = 1; i <= MPMC_CRASH_SLOTS; i++) {
+        Read(i);
+    }
+}
+
+// The only writer is killed after it has claimed a slot and before
+// it has published it. The reader observes the end of the channel
+// once the writer is reaped, and the region is removed on close.
+TEST(ChannelShmemMpmcTest, WriterKilled)
+{
+    const char *opt = "shmem_mpmc,/gaps.shmem_mpmc_killed_test,slots=4";
+    uint32_t val = 0;
+    int fds[2], status, reader, rv;
+    shmem_mpmc_t *ring;
+    struct stat st;
+    char c;
+    errno = 0;
+
+    ASSERT_EQ(0, pipe(fds));
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        uint64_t pos, state;
+        uint32_t one = 1;
+        int writer = pirate_open_parse(opt, O_WRONLY);
+        int fd = shm_open("/gaps.shmem_mpmc_killed_test", O_RDWR, 0);
+        if ((writer >= -1) || (fd < 0) || (fstat(fd, &st) != 0) ||
+            (pirate_write(writer, &one, sizeof(one)) != sizeof(one))) {
+            _exit(1);
+        }
+        ring = (shmem_mpmc_t *) mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if ((ring == MAP_FAILED) || (shmem_mpmc_try_claim(ring, O_WRONLY, &pos, &state) != 1) ||
+            (write(fds[1], "c", 1) != 1)) {
+            _exit(1);
+        }
+        pause();
+        _exit(1);
+    }
+    close(fds[1]);
+
+    reader = pirate_open_parse(opt, O_RDONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_LT(reader, -1);
+    ASSERT_EQ(1, read(fds[0], &c, 1));
+    close(fds[0]);
+    ASSERT_EQ(0, kill(pid, SIGKILL));
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFSIGNALED(status));
+
+    ASSERT_EQ((ssize_t) sizeof(val), pirate_read(reader, &val, sizeof(val)));
+    ASSERT_EQ(1u, val);
+    rv = pirate_read(reader, &val, sizeof(val));
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+
+    ASSERT_EQ(0, pirate_close(reader));
+    ASSERT_EQ(-1, shm_open("/gaps.shmem_mpmc_killed_test", O_RDWR, 0));
+    ASSERT_EQ(ENOENT, errno);
+    errno = 0;
+}
+#endif
+
+} // namespace
@@ -13,6 +13,12 @@
  * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
  */
 
+#include <algorithm>
+#include <set>
+#include <time.h>
+#include <mntent.h>
+#include <sys/statfs.h>
+#include <sys/wait.h>
 #include "libpirate.h"
 #include "channel_test.hpp"
 
@@ -56,6 +62,21 @@ TEST(ChannelShmemTest, ConfigurationParser) {
     ASSERT_EQ(SHMEM, param.channel_type);
     ASSERT_STREQ(path, shmem_param->path);
     ASSERT_EQ(buffer_size, shmem_param->buffer_size);
+    ASSERT_EQ(PIRATE_WAIT_ADAPTIVE, shmem_param->wait);
+    ASSERT_EQ(0u, shmem_param->spin_ns);
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,wait=futex,spin_ns=1000", name, path);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(PIRATE_WAIT_FUTEX, shmem_param->wait);
+    ASSERT_EQ(1000u, shmem_param->spin_ns);
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,wait=sleep", name, path);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(-1, rv);
+    ASSERT_EQ(EINVAL, errno);
+    errno = 0;
 #else
     snprintf(opt, sizeof(opt) - 1, "%s,%s,buffer_size=%u", name, path, buffer_size);
     rv = pirate_parse_channel_param(opt, &param);
@@ -66,7 +87,7 @@ TEST(ChannelShmemTest, ConfigurationParser) {
 }
 
 #if PIRATE_SHMEM_FEATURE
-class ShmemTest : public ChannelTest, public WithParamInterface<std::tuple<int, int>>
+class ShmemTest : public ChannelTest, public WithParamInterface<std::tuple<int, int, pirate_wait_t>>
 {
 public:
     void ChannelInit()
@@ -85,6 +106,7 @@ public:
             buffer_size = PIRATE_DEFAULT_SMEM_BUF_LEN;
         }
         param->max_tx = std::get<1>(test_param);
+        param->wait = std::get<2>(test_param);
         Writer.param = Reader.param;
     }
 
@@ -99,8 +121,446 @@ static const int TEST_BUF_LEN = PIRATE_DEFAULT_SMEM_BUF_LEN / 2;
 static const int TEST_MAX_TX_LEN = 16;
 
 INSTANTIATE_TEST_SUITE_P(ShmemFunctionalTest, ShmemTest,
-    Values(std::make_tuple(0, 0),
-        std::make_tuple(TEST_BUF_LEN, TEST_MAX_TX_LEN)));
+    Values(std::make_tuple(0, 0, PIRATE_WAIT_ADAPTIVE),
+        std::make_tuple(TEST_BUF_LEN, TEST_MAX_TX_LEN, PIRATE_WAIT_ADAPTIVE),
+        std::make_tuple(0, 0, PIRATE_WAIT_SPIN),
+        std::make_tuple(0, 0, PIRATE_WAIT_FUTEX),
+        std::make_tuple(0, 0, PIRATE_WAIT_YIELD)));
+
+class ShmemZeroCopyTest : public ChannelTest
+{
+public:
+    void ChannelInit()
+    {
+        pirate_shmem_param_t *param = &Reader.param.channel.shmem;
+
+        const char *testPath = "/gaps.shmem_zero_copy_test";
+        pirate_init_channel_param(SHMEM, &Reader.param);
+        strncpy(param->path, testPath, PIRATE_LEN_NAME - 1);
+        // small buffer to force wrap around of packets
+        param->buffer_size = 2 * buf_size;
+        Writer.param = Reader.param;
+    }
+
+    void WriterTest() override
+    {
+        ssize_t offset = 0;
+
+        WriterChannelOpen();
+
+        for (size_t i = 0; i < len_size; i++)
+        {
+            ssize_t rv;
+            ssize_t wl = len_arr[i].writer;
+            struct iovec iov[2];
+
+            WriteDataInit(offset, wl);
+            offset += wl + 1;
+
+            rv = pirate_write_reserve(Writer.gd, wl, iov);
+            EXPECT_EQ(0, errno);
+            EXPECT_EQ(wl, rv);
+            EXPECT_EQ((size_t) wl, iov[0].iov_len + iov[1].iov_len);
+
+            // second reservation before the commit
+            struct iovec iov2[2];
+            rv = pirate_write_reserve(Writer.gd, wl, iov2);
+            EXPECT_EQ(EBUSY, errno);
+            EXPECT_EQ(-1, rv);
+            errno = 0;
+
+            memcpy(iov[0].iov_base, Writer.buf, iov[0].iov_len);
+            memcpy(iov[1].iov_base, Writer.buf + iov[0].iov_len, iov[1].iov_len);
+
+            rv = pirate_write_commit(Writer.gd, wl);
+            EXPECT_EQ(0, errno);
+            EXPECT_EQ(wl, rv);
+
+            BarrierWait();
+        }
+
+        // commit without a reservation
+        ssize_t rv = pirate_write_commit(Writer.gd, 1);
+        EXPECT_EQ(EINVAL, errno);
+        EXPECT_EQ(-1, rv);
+        errno = 0;
+
+        BarrierWait();
+
+        WriterChannelClose();
+    }
+
+    void ReaderTest() override
+    {
+        ReaderChannelOpen();
+
+        for (size_t i = 0; i < len_size; i++)
+        {
+            ssize_t rv;
+            ssize_t rl = len_arr[i].reader;
+            ssize_t wl = len_arr[i].writer;
+            struct iovec iov[2];
+
+            memset(Reader.buf, 0xFA, buf_size);
+
+            // alternate between zero-copy and copying reads
+            if ((i % 2) == 0)
+            {
+                rv = pirate_read_acquire(Reader.gd, iov);
+                EXPECT_EQ(0, errno);
+                EXPECT_EQ(wl, rv);
+                EXPECT_EQ((size_t) wl, iov[0].iov_len + iov[1].iov_len);
+                memcpy(Reader.buf, iov[0].iov_base, iov[0].iov_len);
+                memcpy(Reader.buf + iov[0].iov_len, iov[1].iov_base, iov[1].iov_len);
+                EXPECT_TRUE(0 == std::memcmp(Writer.buf, Reader.buf, wl));
+
+                rv = pirate_read_release(Reader.gd);
+                EXPECT_EQ(0, errno);
+                EXPECT_EQ(0, rv);
+            }
+            else
+            {
+                ssize_t exp = std::min(rl, wl);
+                rv = pirate_read(Reader.gd, Reader.buf, rl);
+                EXPECT_EQ(0, errno);
+                EXPECT_EQ(exp, rv);
+                EXPECT_TRUE(0 == std::memcmp(Writer.buf, Reader.buf, exp));
+            }
+
+            BarrierWait();
+        }
+
+        BarrierWait();
+
+        ReaderChannelClose();
+    }
+};
+
+TEST_F(ShmemZeroCopyTest, Run)
+{
+    Run();
+}
+
+class ShmemBatchTest : public BatchTest
+{
+public:
+    void ChannelInit()
+    {
+        pirate_shmem_param_t *param = &Reader.param.channel.shmem;
+
+        const char *testPath = "/gaps.shmem_batch_test";
+        pirate_init_channel_param(SHMEM, &Reader.param);
+        strncpy(param->path, testPath, PIRATE_LEN_NAME - 1);
+        Writer.param = Reader.param;
+    }
+};
+
+TEST_F(ShmemBatchTest, Run)
+{
+    Run();
+}
+
+// A reader blocked on an empty channel with the futex
+// wait policy must not consume CPU time.
+class ShmemIdleReaderTest : public ChannelTest
+{
+public:
+    void ChannelInit()
+    {
+        pirate_shmem_param_t *param = &Reader.param.channel.shmem;
+
+        const char *testPath = "/gaps.shmem_idle_reader_test";
+        pirate_init_channel_param(SHMEM, &Reader.param);
+        strncpy(param->path, testPath, PIRATE_LEN_NAME - 1);
+        param->wait = PIRATE_WAIT_FUTEX;
+        Writer.param = Reader.param;
+    }
+
+    static const long IDLE_NS = 200000000;
+
+    void WriterTest() override
+    {
+        struct timespec idle = { 0, IDLE_NS };
+        uint8_t value = 0x5A;
+
+        WriterChannelOpen();
+        nanosleep(&idle, NULL);
+        ssize_t rv = pirate_write(Writer.gd, &value, sizeof(value));
+        EXPECT_EQ(0, errno);
+        EXPECT_EQ(1, rv);
+        BarrierWait();
+        WriterChannelClose();
+    }
+
+    void ReaderTest() override
+    {
+        struct timespec start, stop;
+        uint8_t value = 0;
+
+        ReaderChannelOpen();
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+        ssize_t rv = pirate_read(Reader.gd, &value, sizeof(value));
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &stop);
+        EXPECT_EQ(0, errno);
+        EXPECT_EQ(1, rv);
+        EXPECT_EQ(0x5A, value);
+        long cpu_ns = (stop.tv_sec - start.tv_sec) * 1000000000L +
+            (stop.tv_nsec - start.tv_nsec);
+        EXPECT_LT(cpu_ns, IDLE_NS / 4);
+        BarrierWait();
+        ReaderChannelClose();
+    }
+};
+
+TEST_F(ShmemIdleReaderTest, Run)
+{
+    Run();
+}
+
+static void *ShmemOpenReader(void *arg)
+{
+    int *gd = (int *) arg;
+    *gd = pirate_open_parse("shmem,/gaps.shmem_reuse_test", O_RDONLY);
+    return NULL;
+}
+
+// gaps descriptors that are not file descriptors
+// are reused after they are closed.
+TEST(ChannelShmemTest, DescriptorReuse)
+{
+    std::set<int> gds;
+    pthread_t reader_id;
+    int rv, reader_gd, writer_gd;
+    errno = 0;
+
+    for (int i = 0; i < 100; i++) {
+        rv = pthread_create(&reader_id, NULL, ShmemOpenReader, &reader_gd);
+        ASSERT_EQ(0, rv);
+        writer_gd = pirate_open_parse("shmem,/gaps.shmem_reuse_test", O_WRONLY);
+        rv = pthread_join(reader_id, NULL);
+        ASSERT_EQ(0, rv);
+        ASSERT_EQ(0, errno);
+        ASSERT_LT(reader_gd, -1);
+        ASSERT_LT(writer_gd, -1);
+        gds.insert(reader_gd);
+        gds.insert(writer_gd);
+
+        rv = pirate_close(writer_gd);
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ(0, rv);
+        rv = pirate_close(reader_gd);
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ(0, rv);
+    }
+    ASSERT_EQ(2u, gds.size());
+}
+
+TEST(ChannelShmemTest, MemoryOptions)
+{
+    pirate_channel_param_t param;
+    const pirate_shmem_mem_t *mem = &param.channel.shmem.mem;
+    char opt[128], desc[128];
+    int rv;
+
+    errno = 0;
+    strncpy(opt, "shmem,/gaps.shmem_mem_test,hugepages=1G,numa_node=1,prefault=1,mlock=1", sizeof(opt));
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(PIRATE_HUGEPAGES_1G, mem->hugepages);
+    ASSERT_EQ(1, mem->numa);
+    ASSERT_EQ(1u, mem->numa_node);
+    ASSERT_EQ(1, mem->prefault);
+    ASSERT_EQ(1, mem->mlock);
+
+    rv = pirate_unparse_channel_param(&param, desc, sizeof(desc));
+    ASSERT_STREQ(opt, desc);
+    ASSERT_EQ((int) strlen(opt), rv);
+
+    strncpy(opt, "udp_shmem,/gaps.shmem_mem_test,numa_node=0", sizeof(opt));
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(PIRATE_HUGEPAGES_NONE, param.channel.udp_shmem.mem.hugepages);
+    ASSERT_EQ(1, param.channel.udp_shmem.mem.numa);
+    ASSERT_EQ(0u, param.channel.udp_shmem.mem.numa_node);
+    rv = pirate_unparse_channel_param(&param, desc, sizeof(desc));
+    ASSERT_STREQ(opt, desc);
+
+    strncpy(opt, "shmem,/gaps.shmem_mem_test,hugepages=4K", sizeof(opt));
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(EINVAL, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+}
+
+class ShmemMemTest : public ChannelTest
+{
+public:
+    void ChannelInit()
+    {
+        pirate_shmem_param_t *param = &Reader.param.channel.shmem;
+
+        pirate_init_channel_param(SHMEM, &Reader.param);
+        strncpy(param->path, "/gaps.shmem_mem_test", PIRATE_LEN_NAME - 1);
+        param->mem.numa = 1;
+        param->mem.numa_node = 0;
+        param->mem.prefault = 1;
+        Writer.param = Reader.param;
+        Writer.param.channel.shmem.mem.mlock = 1;
+    }
+};
+
+TEST_F(ShmemMemTest, Run)
+{
+    Run();
+}
+
+static int HugetlbfsMounted(size_t page_size)
+{
+    struct mntent *mnt;
+    struct statfs st;
+    int found = 0;
+    FILE *fp = setmntent("/proc/mounts", "r");
+
+    if (fp == NULL) {
+        return 0;
+    }
+    while (!found && ((mnt = getmntent(fp)) != NULL)) {
+        found = (strcmp(mnt->mnt_type, "hugetlbfs") == 0) &&
+            (statfs(mnt->mnt_dir, &st) == 0) && ((size_t) st.f_bsize == page_size);
+    }
+    endmntent(fp);
+    return found;
+}
+
+// The region of the channel is created up front and
+// passed to the reader and the writer as a file descriptor
+class ShmemFdTest : public ChannelTest
+{
+public:
+    void ChannelInit()
+    {
+        pirate_shmem_param_t *param = &Reader.param.channel.shmem;
+
+        pirate_init_channel_param(SHMEM, &Reader.param);
+        strncpy(param->path, "/gaps.shmem_fd_test", PIRATE_LEN_NAME - 1);
+        param->buffer_size = TEST_BUF_LEN;
+        param->fd = pirate_shmem_create(&Reader.param);
+        ASSERT_EQ(0, errno);
+        ASSERT_GT(param->fd, 0);
+        Writer.param = Reader.param;
+    }
+
+    void TearDown() override
+    {
+        if (Reader.param.channel.shmem.fd > 0) {
+            close(Reader.param.channel.shmem.fd);
+        }
+        ChannelTest::TearDown();
+    }
+};
+
+TEST_F(ShmemFdTest, Run)
+{
+    Run();
+    ASSERT_NE(0, access("/dev/shm/gaps.shmem_fd_test", F_OK));
+    errno = 0;
+}
+
+TEST(ChannelShmemTest, FdOpen)
+{
+    pirate_channel_param_t param;
+    char opt[128];
+    uint8_t value = 0;
+    int rv, fd, reader, writer;
+    pid_t pid;
+
+    errno = 0;
+    rv = pirate_parse_channel_param("shmem,/gaps.shmem_fd_open_test,fd=7", &param);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(7, param.channel.shmem.fd);
+
+    pirate_init_channel_param(UDP_SHMEM, &param);
+    rv = pirate_shmem_create(&param);
+    ASSERT_EQ(EINVAL, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    fd = open("/dev/null", O_RDWR);
+    ASSERT_GT(fd, 0);
+    snprintf(opt, sizeof(opt), "shmem,/gaps.shmem_fd_open_test,fd=%d", fd);
+    rv = pirate_open_parse(opt, O_RDONLY);
+    ASSERT_EQ(EINVAL, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+    close(fd);
+
+    rv = pirate_parse_channel_param("shmem,/gaps.shmem_fd_open_test", &param);
+    ASSERT_EQ(0, rv);
+    fd = pirate_shmem_create(&param);
+    ASSERT_EQ(0, errno);
+    ASSERT_GT(fd, 0);
+    snprintf(opt, sizeof(opt), "shmem,/gaps.shmem_fd_open_test,fd=%d", fd);
+
+    // the writer does not wait for the reader
+    writer = pirate_open_parse(opt, O_WRONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_LT(writer, -1);
+    value = 1;
+    ASSERT_EQ(1, pirate_write(writer, &value, 1));
+
+    reader = pirate_open_parse(opt, O_RDONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_LT(reader, -1);
+    rv = pirate_open_parse(opt, O_RDONLY);
+    ASSERT_EQ(EBUSY, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+    ASSERT_EQ(1, pirate_read(reader, &value, 1));
+    ASSERT_EQ(1, value);
+    ASSERT_EQ(0, pirate_close(reader));
+
+    // a reader that exits without closing the channel is replaced
+    pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        _exit(pirate_open_parse(opt, O_RDONLY) == -1);
+    }
+    ASSERT_EQ(pid, waitpid(pid, &rv, 0));
+    ASSERT_EQ(0, WEXITSTATUS(rv));
+
+    reader = pirate_open_parse(opt, O_RDONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_LT(reader, -1);
+    value = 2;
+    ASSERT_EQ(1, pirate_write(writer, &value, 1));
+    value = 0;
+    ASSERT_EQ(1, pirate_read(reader, &value, 1));
+    ASSERT_EQ(2, value);
+
+    ASSERT_EQ(0, pirate_close(writer));
+    ASSERT_EQ(0, pirate_close(reader));
+    ASSERT_EQ(0, close(fd));
+    ASSERT_EQ(0, errno);
+}
+
+// The channel cannot be opened without a hugetlbfs mount
+// of the requested page size.
+TEST(ChannelShmemTest, HugepagesUnavailable)
+{
+    int gd;
+
+    if (HugetlbfsMounted(1ul << 30)) {
+        return;
+    }
+    errno = 0;
+    gd = pirate_open_parse("shmem,/gaps.shmem_huge_test,hugepages=1G", O_WRONLY);
+    ASSERT_EQ(ENODEV, errno);
+    ASSERT_EQ(-1, gd);
+    errno = 0;
+}
 #endif
 
 } // namespace
@@ -148,6 +148,25 @@ INSTANTIATE_TEST_SUITE_P(ShmemFunctionalTest, UdpShmemTest,
     Combine(Values(0, UdpShmemTest::TEST_BUF_LEN),
             Values(0, UdpShmemTest::TEST_PKT_CNT),
             Values(0, UdpShmemTest::TEST_PKT_SIZE)));
+
+class UdpShmemBatchTest : public BatchTest
+{
+public:
+    void ChannelInit()
+    {
+        pirate_udp_shmem_param_t *param = &Reader.param.channel.udp_shmem;
+
+        const char *testPath = "/gaps.udp_shmem_batch_test";
+        pirate_init_channel_param(UDP_SHMEM, &Reader.param);
+        strncpy(param->path, testPath, PIRATE_LEN_NAME - 1);
+        Writer.param = Reader.param;
+    }
+};
+
+TEST_F(UdpShmemBatchTest, Run)
+{
+    Run();
+}
 #endif
 
 } // namespace
@@ -92,6 +92,42 @@ TEST(ChannelUdpSocketTest, ConfigurationParser) {
     ASSERT_STREQ(addr2, udp_socket_param->writer_addr);
     ASSERT_EQ(port2, udp_socket_param->writer_port);
     ASSERT_EQ(buffer_size, udp_socket_param->buffer_size);
+
+#ifndef _WIN32
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,%u,%s,%u,reliable=1,window=64,rto_ms=5", name, addr1, port1, addr2, port2);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(PIRATE_RELIABLE_ARQ, udp_socket_param->reliable.mode);
+    ASSERT_EQ(64u, udp_socket_param->reliable.window);
+    ASSERT_EQ(5u, udp_socket_param->reliable.rto_ms);
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,%u,%s,%u,reliable=fec", name, addr1, port1, addr2, port2);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(PIRATE_RELIABLE_FEC, udp_socket_param->reliable.mode);
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,%u,%s,%u,fec=8:2", name, addr1, port1, addr2, port2);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(PIRATE_RELIABLE_FEC, udp_socket_param->reliable.mode);
+    ASSERT_EQ(8u, udp_socket_param->reliable.fec_data);
+    ASSERT_EQ(2u, udp_socket_param->reliable.fec_parity);
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,%u,%s,%u,fec=8", name, addr1, port1, addr2, port2);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(EINVAL, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,%u,%s,%u,reliable=2", name, addr1, port1, addr2, port2);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(EINVAL, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+#endif
 }
 
 class UdpSocketTest : public ChannelTest,
@@ -129,6 +165,272 @@ TEST_P(UdpSocketTest, Run)
 INSTANTIATE_TEST_SUITE_P(UdpSocketFunctionalTest, UdpSocketTest,
     Values(0, UdpSocketTest::TEST_BUF_LEN));
 
+#ifndef _WIN32
+class UdpSocketBatchTest : public BatchTest
+{
+public:
+    void ChannelInit()
+    {
+        pirate_udp_socket_param_t *param = &Reader.param.channel.udp_socket;
+
+        pirate_init_channel_param(UDP_SOCKET, &Reader.param);
+        snprintf(param->reader_addr, sizeof(param->reader_addr) - 1, "127.0.0.1");
+        snprintf(param->writer_addr, sizeof(param->writer_addr) - 1, "0.0.0.0");
+        param->reader_port = 26428;
+        param->writer_port = 0;
+        Writer.param = Reader.param;
+    }
+};
+
+TEST_F(UdpSocketBatchTest, Run)
+{
+    Run();
+}
+
+class UdpSocketWritevTest : public WritevTest
+{
+public:
+    void ChannelInit()
+    {
+        pirate_udp_socket_param_t *param = &Reader.param.channel.udp_socket;
+
+        pirate_init_channel_param(UDP_SOCKET, &Reader.param);
+        snprintf(param->reader_addr, sizeof(param->reader_addr) - 1, "127.0.0.1");
+        snprintf(param->writer_addr, sizeof(param->writer_addr) - 1, "0.0.0.0");
+        param->reader_port = 26429;
+        param->writer_port = 0;
+        Writer.param = Reader.param;
+    }
+};
+
+TEST_F(UdpSocketWritevTest, Run)
+{
+    Run();
+}
+
+class UdpSocketPeekTest : public PeekTest
+{
+public:
+    void ChannelInit()
+    {
+        pirate_udp_socket_param_t *param = &Reader.param.channel.udp_socket;
+
+        pirate_init_channel_param(UDP_SOCKET, &Reader.param);
+        snprintf(param->reader_addr, sizeof(param->reader_addr) - 1, "127.0.0.1");
+        snprintf(param->writer_addr, sizeof(param->writer_addr) - 1, "0.0.0.0");
+        param->reader_port = 26430;
+        param->writer_port = 0;
+        Writer.param = Reader.param;
+    }
+};
+
+TEST_F(UdpSocketPeekTest, Run)
+{
+    Run();
+}
+#endif
+
+#ifndef _WIN32
+// Messages are split into fragments of 8 bytes
+class UdpSocketReliableTest : public ChannelTest,
+    public WithParamInterface<pirate_reliable_mode_t>
+{
+public:
+    void ChannelInit()
+    {
+        pirate_udp_socket_param_t *param = &Reader.param.channel.udp_socket;
+
+        pirate_init_channel_param(UDP_SOCKET, &Reader.param);
+        snprintf(param->reader_addr, sizeof(param->reader_addr) - 1, "127.0.0.1");
+        snprintf(param->writer_addr, sizeof(param->writer_addr) - 1, "0.0.0.0");
+        param->reader_port = 26431;
+        param->writer_port = 0;
+        param->mtu = 28 + 12 + 8;
+        param->reliable.mode = GetParam();
+        Writer.param = Reader.param;
+    }
+
+    void TearDown()
+    {
+        ChannelTest::TearDown();
+        ASSERT_EQ(1, nonblocking_IO_attempt);
+    }
+};
+
+TEST_P(UdpSocketReliableTest, Run)
+{
+    Run();
+}
+
+INSTANTIATE_TEST_SUITE_P(UdpSocketReliableFunctionalTest, UdpSocketReliableTest,
+    Values(PIRATE_RELIABLE_ARQ, PIRATE_RELIABLE_FEC));
+
+struct UdpSocketReliableArgs {
+    int gd;
+    int count;
+    int delay_us;
+    pirate_stats_ex_t stats;
+};
+
+static void udp_socket_reliable_message(uint8_t *buf, size_t len, int index) {
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (index + i) & 0xFF;
+    }
+}
+
+static size_t udp_socket_reliable_len(int index) {
+    return (index * 997) % 20000;
+}
+
+static void *udp_socket_reliable_writer(void *arg) {
+    UdpSocketReliableArgs *args = (UdpSocketReliableArgs *) arg;
+    static uint8_t buf[20000];
+
+    for (int i = 0; i < args->count; i++) {
+        size_t len = udp_socket_reliable_len(i);
+        udp_socket_reliable_message(buf, len, i);
+        if (pirate_write(args->gd, buf, len) != (ssize_t) len) {
+            return (void *) -1;
+        }
+    }
+    if (pirate_get_stats_ex(args->gd, &args->stats) != 0) {
+        return (void *) -1;
+    }
+    if (pirate_close(args->gd) != 0) {
+        return (void *) -1;
+    }
+    return NULL;
+}
+
+static void *udp_socket_reliable_fec_writer(void *arg) {
+    UdpSocketReliableArgs *args = (UdpSocketReliableArgs *) arg;
+    static uint8_t buf[4000];
+
+    for (int i = 0; i < args->count; i++) {
+        udp_socket_reliable_message(buf, sizeof(buf), i);
+        if (pirate_write(args->gd, buf, sizeof(buf)) != (ssize_t) sizeof(buf)) {
+            return (void *) -1;
+        }
+        usleep(args->delay_us);
+    }
+    if (pirate_close(args->gd) != 0) {
+        return (void *) -1;
+    }
+    return NULL;
+}
+
+// Every fifth packet is dropped in both directions. The
+// messages of up to 20 fragments are delivered in order.
+TEST(ChannelUdpSocketTest, ReliableDrop) {
+    const char *config = "udp_socket,127.0.0.1,26432,0.0.0.0,0,mtu=1028,reliable=1,rto_ms=5,drop=5";
+    static uint8_t expect[20000], buf[20000];
+    UdpSocketReliableArgs args;
+    pthread_t writer;
+    void *status;
+    int gd_r;
+
+    gd_r = pirate_open_parse(config, O_RDONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, gd_r);
+    args.gd = pirate_open_parse(config, O_WRONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, args.gd);
+    ASSERT_EQ(256 * (1000 - 12), pirate_write_mtu(args.gd));
+    args.count = 200;
+    ASSERT_EQ(0, pthread_create(&writer, NULL, udp_socket_reliable_writer, &args));
+
+    for (int i = 0; i < args.count; i++) {
+        size_t len = udp_socket_reliable_len(i);
+        udp_socket_reliable_message(expect, len, i);
+        ASSERT_EQ((ssize_t) len, pirate_read(gd_r, buf, sizeof(buf)));
+        ASSERT_EQ(0, errno);
+        ASSERT_EQ(0, memcmp(expect, buf, len));
+    }
+    ASSERT_EQ(0, pirate_close(gd_r));
+    ASSERT_EQ(0, pthread_join(writer, &status));
+    ASSERT_EQ(nullptr, status);
+    ASSERT_GT(args.stats.retransmits, 0u);
+    ASSERT_EQ(0u, args.stats.stats.fuzzed);
+}
+
+// Without a reverse channel the messages that lose a fragment
+// are skipped. Each fragment of 1000 bytes is a separate packet.
+TEST(ChannelUdpSocketTest, ReliableFecDrop) {
+    const char *config = "udp_socket,127.0.0.1,26433,0.0.0.0,0,mtu=1040,reliable=fec,rto_ms=50,drop=7";
+    static uint8_t expect[4000], buf[4000];
+    UdpSocketReliableArgs args;
+    pirate_stats_ex_t stats;
+    pthread_t writer;
+    void *status;
+    int gd_r, received = 0;
+
+    gd_r = pirate_open_parse(config, O_RDONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, gd_r);
+    args.gd = pirate_open_parse(config, O_WRONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, args.gd);
+    // 4 packets per message and every 7th packet is dropped
+    // so 28 of the 50 messages are lost
+    args.count = 50;
+    args.delay_us = 1000;
+    ASSERT_EQ(0, pthread_create(&writer, NULL, udp_socket_reliable_fec_writer, &args));
+
+    memset(&stats, 0, sizeof(stats));
+    while (received + (int) stats.lost < args.count) {
+        ASSERT_EQ((ssize_t) sizeof(buf), pirate_read(gd_r, buf, sizeof(buf)));
+        ASSERT_EQ(0, errno);
+        // the first byte identifies the message
+        udp_socket_reliable_message(expect, sizeof(expect), buf[0]);
+        ASSERT_EQ(0, memcmp(expect, buf, sizeof(buf)));
+        received++;
+        ASSERT_EQ(0, pirate_get_stats_ex(gd_r, &stats));
+    }
+    ASSERT_EQ(22, received);
+    ASSERT_EQ(28u, stats.lost);
+    ASSERT_EQ(0, pthread_join(writer, &status));
+    ASSERT_EQ(nullptr, status);
+    ASSERT_EQ(0, pirate_close(gd_r));
+}
+
+// Each block of 4 packets is followed by 2 parity packets. At most
+// 2 of 6 consecutive packets are dropped so every message is
+// recovered. Each fragment of 997 bytes is a separate packet.
+TEST(ChannelUdpSocketTest, ReliableFecRecovery) {
+    const char *config = "udp_socket,127.0.0.1,26434,0.0.0.0,0,mtu=1040,fec=4:2,rto_ms=50,drop=5";
+    static uint8_t expect[4000], buf[4000];
+    UdpSocketReliableArgs args;
+    pirate_stats_ex_t stats;
+    pthread_t writer;
+    void *status;
+    int gd_r;
+
+    gd_r = pirate_open_parse(config, O_RDONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, gd_r);
+    args.gd = pirate_open_parse(config, O_WRONLY);
+    ASSERT_EQ(0, errno);
+    ASSERT_NE(-1, args.gd);
+    ASSERT_EQ(256 * (1040 - 28 - 12 - 3), pirate_write_mtu(args.gd));
+    args.count = 50;
+    args.delay_us = 1000;
+    ASSERT_EQ(0, pthread_create(&writer, NULL, udp_socket_reliable_fec_writer, &args));
+
+    for (int i = 0; i < args.count; i++) {
+        ASSERT_EQ((ssize_t) sizeof(buf), pirate_read(gd_r, buf, sizeof(buf)));
+        ASSERT_EQ(0, errno);
+        udp_socket_reliable_message(expect, sizeof(expect), i);
+        ASSERT_EQ(0, memcmp(expect, buf, sizeof(buf)));
+    }
+    ASSERT_EQ(0, pirate_get_stats_ex(gd_r, &stats));
+    ASSERT_EQ(0u, stats.lost);
+    ASSERT_LT(0u, stats.recovered);
+    ASSERT_EQ(0, pthread_join(writer, &status));
+    ASSERT_EQ(nullptr, status);
+    ASSERT_EQ(0, pirate_close(gd_r));
+}
+#endif
+
 TEST(ChannelUdpSocketTest, WriterAddressAndPort) {
 #ifndef _WIN32
     char buf[80];
@@ -97,6 +97,42 @@ INSTANTIATE_TEST_SUITE_P(UnixSeqpacketFunctionalTest, UnixSeqpacketTest,
     Values(std::make_tuple(0, 0),
         std::make_tuple(TEST_BUF_LEN, TEST_MIN_TX_LEN)));
 
+class UnixSeqpacketBatchTest : public BatchTest
+{
+public:
+    void ChannelInit()
+    {
+        pirate_unix_seqpacket_param_t *param = &Reader.param.channel.unix_seqpacket;
+
+        pirate_init_channel_param(UNIX_SEQPACKET, &Reader.param);
+        strncpy(param->path, "/tmp/gaps.channel.test.seqpacket", PIRATE_LEN_NAME);
+        Writer.param = Reader.param;
+    }
+};
+
+TEST_F(UnixSeqpacketBatchTest, Run)
+{
+    Run();
+}
+
+class UnixSeqpacketPeekTest : public PeekTest
+{
+public:
+    void ChannelInit()
+    {
+        pirate_unix_seqpacket_param_t *param = &Reader.param.channel.unix_seqpacket;
+
+        pirate_init_channel_param(UNIX_SEQPACKET, &Reader.param);
+        strncpy(param->path, "/tmp/gaps.channel.test.seqpacket", PIRATE_LEN_NAME);
+        Writer.param = Reader.param;
+    }
+};
+
+TEST_F(UnixSeqpacketPeekTest, Run)
+{
+    Run();
+}
+
 class UnixSeqpacketCloseWriterTest : public ClosedWriterTest
 {
 public:
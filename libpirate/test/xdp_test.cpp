@@ -0,0 +1,195 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#include <net/if.h>
+#include "libpirate.h"
+#include "channel_test.hpp"
+
+namespace GAPS
+{
+
+using ::testing::WithParamInterface;
+using ::testing::TestWithParam;
+using ::testing::Values;
+
+// The functional tests run on a veth pair that is created with
+//   ip link add pxdp0 type veth peer name pxdp1
+//   ip link set pxdp0 up
+//   ip link set pxdp1 up
+// and are skipped when the pair does not exist
+#define XDP_TEST_WRITER_IF "pxdp0"
+#define XDP_TEST_READER_IF "pxdp1"
+
+static int XdpTestInterfaces()
+{
+    return (if_nametoindex(XDP_TEST_WRITER_IF) != 0) &&
+        (if_nametoindex(XDP_TEST_READER_IF) != 0);
+}
+
+TEST(ChannelXdpTest, ConfigurationParser)
+{
+    int rv;
+    pirate_channel_param_t param;
+    const pirate_xdp_param_t *xdp_param = &param.channel.xdp;
+    char opt[128];
+    const char *name = "xdp";
+    const char *ifname = "eth1";
+    const unsigned queue = 3;
+
+    snprintf(opt, sizeof(opt) - 1, "%s", name);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(EINVAL, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s", name, ifname);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(EINVAL, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,%u", name, ifname, queue);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(XDP, param.channel_type);
+    ASSERT_STREQ(ifname, xdp_param->ifname);
+    ASSERT_EQ(queue, xdp_param->queue);
+    ASSERT_EQ(0u, xdp_param->message_id);
+    ASSERT_EQ(0u, xdp_param->mtu);
+    ASSERT_EQ(PIRATE_GE_ETH_CRC_HEADER, xdp_param->crc);
+    ASSERT_EQ(0u, xdp_param->frames);
+    ASSERT_EQ(0u, xdp_param->busy_poll);
+    ASSERT_EQ(PIRATE_XDP_MODE_SKB, xdp_param->mode);
+
+    snprintf(opt, sizeof(opt) - 1,
+        "%s,%s,%u,msg_id=42,mtu=1000,crc=payload,frames=1024,busy_poll=50,mode=drv",
+        name, ifname, queue);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(0, errno);
+    ASSERT_EQ(0, rv);
+    ASSERT_EQ(XDP, param.channel_type);
+    ASSERT_STREQ(ifname, xdp_param->ifname);
+    ASSERT_EQ(queue, xdp_param->queue);
+    ASSERT_EQ(42u, xdp_param->message_id);
+    ASSERT_EQ(1000u, xdp_param->mtu);
+    ASSERT_EQ(PIRATE_GE_ETH_CRC_PAYLOAD, xdp_param->crc);
+    ASSERT_EQ(1024u, xdp_param->frames);
+    ASSERT_EQ(50u, xdp_param->busy_poll);
+    ASSERT_EQ(PIRATE_XDP_MODE_DRV, xdp_param->mode);
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,%u,mode=native", name, ifname, queue);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(EINVAL, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    snprintf(opt, sizeof(opt) - 1, "%s,%s,%u,window=16", name, ifname, queue);
+    rv = pirate_parse_channel_param(opt, &param);
+    ASSERT_EQ(EINVAL, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+}
+
+TEST(ChannelXdpTest, InvalidOpen)
+{
+    int rv;
+
+    rv = pirate_open_parse("xdp,pxdp_missing,0", O_RDONLY);
+    ASSERT_EQ(ENODEV, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    rv = pirate_open_parse("xdp,lo,0,frames=1000", O_RDONLY);
+    ASSERT_EQ(EINVAL, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+
+    rv = pirate_open_parse("xdp,lo,0,mtu=4096", O_WRONLY);
+    ASSERT_EQ(EINVAL, errno);
+    ASSERT_EQ(-1, rv);
+    errno = 0;
+}
+
+class XdpTest : public ChannelTest, public WithParamInterface<unsigned>
+{
+public:
+    void ChannelInit()
+    {
+        pirate_xdp_param_t *param = &Reader.param.channel.xdp;
+
+        pirate_init_channel_param(XDP, &Reader.param);
+        param->queue = 0;
+        param->message_id = 0x5F475243;
+        param->frames = 256;
+        unsigned mtu = GetParam();
+        if (mtu) {
+            param->mtu = mtu;
+        }
+
+        Writer.param = Reader.param;
+        snprintf(param->ifname, sizeof(param->ifname) - 1, XDP_TEST_READER_IF);
+        snprintf(Writer.param.channel.xdp.ifname,
+            sizeof(Writer.param.channel.xdp.ifname) - 1, XDP_TEST_WRITER_IF);
+    }
+
+    static const unsigned TEST_MTU_LEN = PIRATE_DEFAULT_GE_ETH_MTU / 2;
+};
+
+TEST_P(XdpTest, Run)
+{
+    if (XdpTestInterfaces()) {
+        Run();
+        ASSERT_EQ(1, nonblocking_IO_attempt);
+    } else {
+        ASSERT_EQ(ENODEV, errno);
+        errno = 0;
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(XdpFunctionalTest, XdpTest,
+                        Values(0, XdpTest::TEST_MTU_LEN));
+
+class XdpCrcPayloadBatchTest : public BatchTest
+{
+public:
+    void ChannelInit()
+    {
+        pirate_xdp_param_t *param = &Reader.param.channel.xdp;
+
+        pirate_init_channel_param(XDP, &Reader.param);
+        param->queue = 0;
+        param->message_id = 0x5F475243;
+        param->crc = PIRATE_GE_ETH_CRC_PAYLOAD;
+        param->frames = 256;
+
+        Writer.param = Reader.param;
+        snprintf(param->ifname, sizeof(param->ifname) - 1, XDP_TEST_READER_IF);
+        snprintf(Writer.param.channel.xdp.ifname,
+            sizeof(Writer.param.channel.xdp.ifname) - 1, XDP_TEST_WRITER_IF);
+    }
+};
+
+TEST_F(XdpCrcPayloadBatchTest, Run)
+{
+    if (XdpTestInterfaces()) {
+        Run();
+    } else {
+        ASSERT_EQ(ENODEV, errno);
+        errno = 0;
+    }
+}
+
+} // namespace
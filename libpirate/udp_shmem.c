@@ -63,41 +63,11 @@ struct pseudo_ip_hdr {
 } __attribute__((packed));
 
 #define UDP_HEADER_SIZE (sizeof(struct ip_hdr) + sizeof(struct udp_hdr))
-#define SPIN_ITERATIONS 100000
 
 #define IPV4(A, B, C, D)                                                       \
   ((uint32_t)(((A)&0xff) << 24) | (((B)&0xff) << 16) | (((C)&0xff) << 8) |     \
    ((D)&0xff))
 
-static inline uint8_t get_status(uint64_t value) {
-    return (value & 0xff00000000000000) >> 56;
-}
-
-static inline uint32_t get_write(uint64_t value) {
-    return (value & 0x00fffffff0000000) >> 28;
-}
-
-static inline uint32_t get_read(uint64_t value) {
-    return (value & 0x000000000fffffff);
-}
-
-static inline uint64_t create_position(uint32_t write, uint32_t read,
-                                       int writer) {
-    uint8_t status = 1;
-
-    if (read == write) {
-        status = writer ? 2 : 0;
-    }
-
-    return (((uint64_t)status) << 56) | (((uint64_t)write) << 28) | read;
-}
-
-static inline int is_empty(uint64_t value) { 
-    return get_status(value) == 0;
-}
-
-static inline int is_full(uint64_t value) { return get_status(value) == 2; }
-
 static inline unsigned char* shared_buffer(shmem_buffer_t *shmem_buffer) {
     return (unsigned char *)shmem_buffer + sizeof(shmem_buffer_t);
 }
@@ -112,6 +82,9 @@ static void udp_shmem_buffer_init_param(pirate_udp_shmem_param_t *param) {
     if (param->packet_count == 0) {
         param->packet_count = PIRATE_DEFAULT_UDP_SHMEM_PACKET_COUNT;
     }
+    if (param->spin_ns == 0) {
+        param->spin_ns = PIRATE_DEFAULT_SMEM_SPIN_NS;
+    }
 }
 
 int udp_shmem_buffer_parse_param(char *str, void *_param) {
@@ -137,12 +110,24 @@ int udp_shmem_buffer_parse_param(char *str, void *_param) {
         } else if (rv == 0) {
             continue;
         }
+        rv = shmem_buffer_parse_mem(key, val, &param->mem);
+        if (rv < 0) {
+            return rv;
+        } else if (rv > 0) {
+            continue;
+        }
         if (strncmp("buffer_size", key, strlen("buffer_size")) == 0) {
             param->buffer_size = strtol(val, NULL, 10);
         } else if (strncmp("packet_size", key, strlen("packet_size")) == 0) {
             param->packet_size = strtol(val, NULL, 10);
         } else if (strncmp("packet_count", key, strlen("packet_count")) == 0) {
             param->packet_count = strtol(val, NULL, 10);
+        } else if (strncmp("wait", key, strlen("wait")) == 0) {
+            if (shmem_buffer_parse_wait(val, &param->wait) < 0) {
+                return -1;
+            }
+        } else if (strncmp("spin_ns", key, strlen("spin_ns")) == 0) {
+            param->spin_ns = strtol(val, NULL, 10);
         } else {
             errno = EINVAL;
             return -1;
@@ -156,10 +141,15 @@ int udp_shmem_buffer_get_channel_description(const void *_param, char *desc, int
     char buffer_size_str[32];
     char packet_size_str[32];
     char packet_count_str[32];
+    char wait_str[32];
+    char spin_ns_str[32];
+    char mem_str[96];
 
     buffer_size_str[0] = 0;
     packet_size_str[0] = 0;
     packet_count_str[0] = 0;
+    wait_str[0] = 0;
+    spin_ns_str[0] = 0;
 
     if ((param->buffer_size != 0) && (param->buffer_size != PIRATE_DEFAULT_SMEM_BUF_LEN)) {
         snprintf(buffer_size_str, 32, ",buffer_size=%u", param->buffer_size);
@@ -170,18 +160,23 @@ int udp_shmem_buffer_get_channel_description(const void *_param, char *desc, int
     if ((param->packet_count != 0) && (param->packet_count != PIRATE_DEFAULT_UDP_SHMEM_PACKET_COUNT)) {
         snprintf(packet_count_str, 32, ",packet_count=%zd", param->packet_count);
     }
-    return snprintf(desc, len, "udp_shmem,%s%s%s%s",
-        param->path, buffer_size_str, packet_size_str, packet_count_str);
+    if ((param->wait != PIRATE_WAIT_ADAPTIVE) && (shmem_buffer_wait_name(param->wait) != NULL)) {
+        snprintf(wait_str, 32, ",wait=%s", shmem_buffer_wait_name(param->wait));
+    }
+    if ((param->spin_ns != 0) && (param->spin_ns != PIRATE_DEFAULT_SMEM_SPIN_NS)) {
+        snprintf(spin_ns_str, 32, ",spin_ns=%u", param->spin_ns);
+    }
+    shmem_buffer_mem_description(&param->mem, mem_str, sizeof(mem_str));
+    return snprintf(desc, len, "udp_shmem,%s%s%s%s%s%s%s",
+        param->path, buffer_size_str, packet_size_str, packet_count_str,
+        wait_str, spin_ns_str, mem_str);
 }
 
-static shmem_buffer_t *udp_shmem_buffer_init(int fd, pirate_udp_shmem_param_t *param) {
+static shmem_buffer_t *udp_shmem_buffer_init(int fd, pirate_udp_shmem_param_t *param, size_t alloc_size) {
     int rv;
     int err;
     int success = 0;
     const int buffer_size = param->packet_size * param->packet_count;
-    const size_t alloc_size = sizeof(shmem_buffer_t) + buffer_size;
-    pthread_mutexattr_t mutex_attr;
-    pthread_condattr_t cond_attr;
     shmem_buffer_t* shmem_buffer = NULL;
 
     if ((rv = ftruncate(fd, alloc_size)) != 0) {
@@ -191,19 +186,11 @@ static shmem_buffer_t *udp_shmem_buffer_init(int fd, pirate_udp_shmem_param_t *p
         return NULL;
     }
 
-    shmem_buffer = (shmem_buffer_t *)mmap(NULL, alloc_size,
-        PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-
+    shmem_buffer = (shmem_buffer_t *)shmem_buffer_mem_map(fd, alloc_size, &param->mem);
     if (shmem_buffer == MAP_FAILED) {
-        err = errno;
-        close(fd);
-        errno = err;
         return NULL;
     }
 
-    close(fd);
-    fd = -1;
-
     while (!success) {
         uint64_t init = atomic_load(&shmem_buffer->init);
         switch (init) {
@@ -239,43 +226,6 @@ static shmem_buffer_t *udp_shmem_buffer_init(int fd, pirate_udp_shmem_param_t *p
         goto error;
     }
 
-    if ((rv = pthread_mutexattr_init(&mutex_attr)) != 0) {
-        errno = rv;
-        goto error;
-    }
-
-    if ((rv = pthread_mutexattr_setpshared(&mutex_attr,
-                                         PTHREAD_PROCESS_SHARED)) != 0) {
-        errno = rv;
-        goto error;
-    }
-
-    if ((rv = pthread_mutex_init(&shmem_buffer->mutex, &mutex_attr)) != 0) {
-        errno = rv;
-        goto error;
-    }
-
-    if ((rv = pthread_condattr_init(&cond_attr)) != 0) {
-        errno = rv;
-        goto error;
-    }
-
-    if ((rv = pthread_condattr_setpshared(&cond_attr,
-                                        PTHREAD_PROCESS_SHARED)) != 0) {
-        errno = rv;
-        goto error;
-    }
-
-    if ((rv = pthread_cond_init(&shmem_buffer->is_not_empty, &cond_attr)) != 0) {
-        errno = rv;
-        goto error;
-    }
-
-    if ((rv = pthread_cond_init(&shmem_buffer->is_not_full, &cond_attr)) != 0) {
-        errno = rv;
-        goto error;
-    }
-
     atomic_store(&shmem_buffer->init, 2);
     return shmem_buffer;
 error:
@@ -301,13 +251,15 @@ int udp_shmem_buffer_open(void *_param, void *_ctx) {
     }
     // on successful shm_open (fd > 0) we must shm_unlink before exiting
     // this function
-    int fd = shm_open(param->path, O_RDWR | O_CREAT, 0660);
+    int fd = shmem_buffer_mem_open(param->path, &param->mem);
     if (fd < 0) {
         ctx->buf = NULL;
         return -1;
     }
 
-    buf = udp_shmem_buffer_init(fd, param);
+    ctx->alloc_size = shmem_buffer_mem_size(sizeof(shmem_buffer_t) +
+        param->packet_size * param->packet_count, &param->mem);
+    buf = udp_shmem_buffer_init(fd, param, ctx->alloc_size);
     ctx->buf = buf;
     if (ctx->buf == NULL) {
         goto error;
@@ -329,6 +281,7 @@ int udp_shmem_buffer_open(void *_param, void *_ctx) {
             atomic_store(&buf->reader_pid, 0);
             goto error;
         }
+        ctx->cached = atomic_load(&buf->writer);
     } else {
         if (!atomic_compare_exchange_strong(&buf->writer_pid, &init_pid,
                                             (uint64_t)getpid())) {
@@ -345,9 +298,10 @@ int udp_shmem_buffer_open(void *_param, void *_ctx) {
             atomic_store(&buf->writer_pid, 0);
             goto error;
         }
+        ctx->cached = atomic_load(&buf->reader);
     }
     err = errno;
-    if (shm_unlink(param->path) == -1) {
+    if (shmem_buffer_mem_unlink(param->path, &param->mem) == -1) {
         if (errno == ENOENT) {
             errno = err;
         } else {
@@ -359,7 +313,7 @@ int udp_shmem_buffer_open(void *_param, void *_ctx) {
 error:
     err = errno;
     ctx->buf = NULL;
-    shm_unlink(param->path);
+    shmem_buffer_mem_unlink(param->path, &param->mem);
     errno = err;
     return -1;
 }
@@ -368,82 +322,38 @@ int udp_shmem_buffer_close(void *_ctx) {
     udp_shmem_ctx *ctx = (udp_shmem_ctx *)_ctx;
     shmem_buffer_t* buf = ctx->buf;
     int access = ctx->flags & O_ACCMODE;
-    const size_t alloc_size = sizeof(shmem_buffer_t) + buf->size;
 
     if (access == O_RDONLY) {
         atomic_store(&buf->reader_pid, 0);
-        pthread_mutex_lock(&buf->mutex);
-        pthread_cond_signal(&buf->is_not_full);
-        pthread_mutex_unlock(&buf->mutex);
+        shmem_buffer_wake(buf, O_WRONLY);
     } else {
         atomic_store(&buf->writer_pid, 0);
-        pthread_mutex_lock(&buf->mutex);
-        pthread_cond_signal(&buf->is_not_empty);
-        pthread_mutex_unlock(&buf->mutex);
+        shmem_buffer_wake(buf, O_RDONLY);
     }
 
-    return munmap(buf, alloc_size);
+    return munmap(buf, ctx->alloc_size);
 }
 
-ssize_t udp_shmem_buffer_read(const void *_param, void *_ctx, void *buffer, size_t count) {
-    (void) _param;
-    udp_shmem_ctx *ctx = (udp_shmem_ctx *)_ctx;
-    uint64_t position;
-    int was_full;
-    uint32_t reader, writer;
+// Copies the packet in the slot at data_location into buffer
+// and verifies the UDP checksum. Returns the number of bytes
+// copied, or -1 if the checksum does not match.
+static ssize_t udp_shmem_buffer_unpack(unsigned char* data_location, void *buffer, size_t count) {
     struct ip_hdr ip_header;
     struct udp_hdr udp_header;
     uint16_t exp_csum, obs_csum;
     struct pseudo_ip_hdr pseudo_header;
-    unsigned char* data_location;
-
-    shmem_buffer_t* buf = ctx->buf;
-    if (buf == NULL) {
-        errno = EBADF;
-        return -1;
-    }
-
-    const size_t packet_size = buf->packet_size;
-    const size_t packet_count = buf->packet_count;
-
-    position = atomic_load(&buf->position);
-    for (int spin = 0; (spin < SPIN_ITERATIONS) && is_empty(position); spin++) {
-        position = atomic_load(&buf->position);
-    }
-
-    if (is_empty(position)) {
-        pthread_mutex_lock(&buf->mutex);
-        position = atomic_load(&buf->position);
-        while (is_empty(position)) {
-            // The reader returns 0 when the writer has closed
-            // the channel and the channel is empty. If the writer
-            // has closed the channel and the buffer has content
-            // then return the contents of the buffer.
-            if (atomic_load(&buf->writer_pid) == 0) {
-                pthread_mutex_unlock(&buf->mutex);
-                return 0;
-            }
-            pthread_cond_wait(&buf->is_not_empty, &buf->mutex);
-            position = atomic_load(&buf->position);
-        }
-        pthread_mutex_unlock(&buf->mutex);
-    }
+    cksum_t state;
 
-    reader = get_read(position);
-    writer = get_write(position);
-
-    atomic_thread_fence(memory_order_acquire);
-    memcpy(&ip_header, shared_buffer(buf) + (reader * packet_size),
-            sizeof(struct ip_hdr));
-    memcpy(&udp_header, shared_buffer(buf) + (reader * packet_size) +
-            sizeof(struct ip_hdr), sizeof(struct udp_hdr));
+    memcpy(&ip_header, data_location, sizeof(struct ip_hdr));
+    memcpy(&udp_header, data_location + sizeof(struct ip_hdr),
+            sizeof(struct udp_hdr));
     count = MIN(count, udp_header.len - sizeof(struct udp_hdr));
-    data_location = shared_buffer(buf) + (reader * packet_size) + UDP_HEADER_SIZE;
+    data_location += UDP_HEADER_SIZE;
     memcpy(buffer, data_location, count);
 
     exp_csum = ip_header.csum;
     ip_header.csum = 0;
-    obs_csum = cksum_avx2((void*) &ip_header, sizeof(struct ip_hdr), 0);
+    obs_csum = cksum(&ip_header, sizeof(struct ip_hdr), 0);
 
     pseudo_header.srcaddr = ip_header.srcaddr;
     pseudo_header.dstaddr = ip_header.dstaddr;
@@ -455,28 +365,12 @@ ssize_t udp_shmem_buffer_read(const void *_param, void *_ctx, void *buffer, size
     pseudo_header.len = ip_header.len;
     pseudo_header.csum = 0;
 
+    // The pseudo header and the payload are summed in one pass
     exp_csum = udp_header.csum;
-    obs_csum = cksum_avx2((void*) &pseudo_header,
-                            sizeof(struct pseudo_ip_hdr), 0);
-    obs_csum = cksum_avx2((void*) data_location,
-        udp_header.len - sizeof(struct udp_hdr), ~obs_csum);
-
-    for (;;) {
-        uint64_t update = create_position(writer, (reader + 1) % 
-                            packet_count, 0);
-        if (atomic_compare_exchange_weak(&buf->position, &position,
-                                     update)) {
-            was_full = is_full(position);
-            break;
-        }
-        writer = get_write(position);
-    }
-
-    if (was_full) {
-        pthread_mutex_lock(&buf->mutex);
-        pthread_cond_signal(&buf->is_not_full);
-        pthread_mutex_unlock(&buf->mutex);
-    }
+    cksum_init(&state, 0);
+    cksum_update(&state, &pseudo_header, sizeof(struct pseudo_ip_hdr));
+    cksum_update(&state, data_location, udp_header.len - sizeof(struct udp_hdr));
+    obs_csum = cksum_final(&state);
 
     if (exp_csum != obs_csum) {
         errno = EL2HLT;
@@ -491,30 +385,95 @@ ssize_t udp_shmem_buffer_read(const void *_param, void *_ctx, void *buffer, size
     return count;
 }
 
-ssize_t udp_shmem_buffer_write_mtu(const void *_param, void *_ctx) {
-    (void) _ctx;
+// Waits until the ring buffer is not empty and sets reader
+// to the position of the reader. Returns 1 when data is available
+// and 0 when the writer has closed the channel and the channel is empty.
+static int udp_shmem_buffer_read_wait(const pirate_udp_shmem_param_t *param, udp_shmem_ctx *ctx, uint64_t *reader) {
+    shmem_buffer_t* buf = ctx->buf;
+
+    *reader = atomic_load_explicit(&buf->reader, memory_order_relaxed);
+    // Only read the writer cache line when every packet
+    // observed on the previous load has been consumed.
+    if (ctx->cached == *reader) {
+        ctx->cached = shmem_buffer_wait(buf, O_RDONLY, *reader, param->wait, param->spin_ns, &ctx->wait_stats);
+    }
+
+    // The reader returns 0 when the writer has closed
+    // the channel and the channel is empty. If the writer
+    // has closed the channel and the buffer has content
+    // then return the contents of the buffer.
+    return ctx->cached != *reader;
+}
+
+// Moves the reader position past the consumed packets
+// and wakes up the writer if it is sleeping. The sequentially
+// consistent store is ordered before the load of writer_waiting
+// and writer_pollers.
+static void udp_shmem_buffer_read_publish(shmem_buffer_t* buf, uint64_t reader) {
+    atomic_store(&buf->reader, reader);
+
+    if (atomic_load(&buf->writer_waiting) || atomic_load(&buf->writer_pollers)) {
+        shmem_buffer_wake(buf, O_WRONLY);
+    }
+}
+
+ssize_t udp_shmem_buffer_read(const void *_param, void *_ctx, void *buffer, size_t count) {
     const pirate_udp_shmem_param_t *param = (const pirate_udp_shmem_param_t *)_param;
-    size_t mtu = param->mtu;
-    if (mtu == 0) {
+    udp_shmem_ctx *ctx = (udp_shmem_ctx *)_ctx;
+    uint64_t reader;
+    unsigned char* data_location;
+    ssize_t rv;
+
+    shmem_buffer_t* buf = ctx->buf;
+    if (buf == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+
+    const size_t packet_size = buf->packet_size;
+    const size_t packet_count = buf->packet_count;
+
+    if (udp_shmem_buffer_read_wait(param, ctx, &reader) == 0) {
         return 0;
     }
-    if (mtu < sizeof(pirate_header_t)) {
-        errno = EINVAL;
+
+    data_location = shared_buffer(buf) + ((reader % packet_count) * packet_size);
+    rv = udp_shmem_buffer_unpack(data_location, buffer, count);
+
+    udp_shmem_buffer_read_publish(buf, reader + 1);
+
+    return rv;
+}
+
+ssize_t udp_shmem_buffer_peek_len(const void *_param, void *_ctx) {
+    const pirate_udp_shmem_param_t *param = (const pirate_udp_shmem_param_t *)_param;
+    udp_shmem_ctx *ctx = (udp_shmem_ctx *)_ctx;
+    uint64_t reader;
+    unsigned char* data_location;
+    struct udp_hdr udp_header;
+
+    shmem_buffer_t* buf = ctx->buf;
+    if (buf == NULL) {
+        errno = EBADF;
         return -1;
     }
-    return mtu - sizeof(pirate_header_t);
+
+    if (udp_shmem_buffer_read_wait(param, ctx, &reader) == 0) {
+        return 0;
+    }
+
+    data_location = shared_buffer(buf) + ((reader % buf->packet_count) * buf->packet_size);
+    memcpy(&udp_header, data_location + sizeof(struct ip_hdr), sizeof(struct udp_hdr));
+    return udp_header.len - sizeof(struct udp_hdr);
 }
 
-ssize_t udp_shmem_buffer_write(const void *_param, void *_ctx, const void *buffer, size_t count) {
-    (void)_param;
+ssize_t udp_shmem_buffer_read_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen) {
+    const pirate_udp_shmem_param_t *param = (const pirate_udp_shmem_param_t *)_param;
     udp_shmem_ctx *ctx = (udp_shmem_ctx *)_ctx;
-    int was_empty;
-    uint32_t reader, writer;
-    uint64_t position;
-    uint16_t csum;
-    struct ip_hdr ip_header;
-    struct udp_hdr udp_header;
-    struct pseudo_ip_hdr pseudo_header;
+    uint64_t reader;
+    unsigned char* data_location;
+    ssize_t rv;
+    unsigned i;
 
     shmem_buffer_t* buf = ctx->buf;
     if (buf == NULL) {
@@ -525,10 +484,67 @@ ssize_t udp_shmem_buffer_write(const void *_param, void *_ctx, const void *buffe
     const size_t packet_size = buf->packet_size;
     const size_t packet_count = buf->packet_count;
 
-    if (count > (packet_size - UDP_HEADER_SIZE)) {
-        count = packet_size - UDP_HEADER_SIZE;
+    if (udp_shmem_buffer_read_wait(param, ctx, &reader) == 0) {
+        msgs[0].len = 0;
+        return 1;
     }
 
+    // Reads the packets that are available without blocking
+    // and releases them with a single update of the reader position.
+    // A packet with an invalid checksum ends the batch. It is
+    // consumed only when it is the first packet of the batch.
+    for (i = 0; i < vlen; i++) {
+        if (ctx->cached == reader) {
+            ctx->cached = atomic_load_explicit(&buf->writer, memory_order_acquire);
+            if (ctx->cached == reader) {
+                break;
+            }
+        }
+        data_location = shared_buffer(buf) + ((reader % packet_count) * packet_size);
+        rv = udp_shmem_buffer_unpack(data_location, msgs[i].buf, msgs[i].count);
+        if ((rv < 0) && (i > 0)) {
+            break;
+        }
+        reader += 1;
+        if (rv < 0) {
+            udp_shmem_buffer_read_publish(buf, reader);
+            return -1;
+        }
+        msgs[i].len = rv;
+    }
+
+    udp_shmem_buffer_read_publish(buf, reader);
+
+    return i;
+}
+
+ssize_t udp_shmem_buffer_write_mtu(const void *_param, void *_ctx) {
+    (void) _ctx;
+    const pirate_udp_shmem_param_t *param = (const pirate_udp_shmem_param_t *)_param;
+    size_t mtu = param->mtu;
+    if (mtu == 0) {
+        return 0;
+    }
+    if (mtu < sizeof(pirate_header_t)) {
+        errno = EINVAL;
+        return -1;
+    }
+    return mtu - sizeof(pirate_header_t);
+}
+
+// Writes the IP and UDP headers and count bytes of
+// buffer into the slot at data_location.
+// Packs the first count bytes of the iovec array into the slot.
+// The payload is copied first and the checksum is computed over
+// the copy, so the iovec boundaries do not need to be aligned.
+static void udp_shmem_buffer_pack(unsigned char* data_location, const struct iovec *iov, int iovcnt, size_t count) {
+    unsigned char *payload = data_location + UDP_HEADER_SIZE;
+    size_t remain = count, len;
+    cksum_t state;
+    struct ip_hdr ip_header;
+    struct udp_hdr udp_header;
+    struct pseudo_ip_hdr pseudo_header;
+
     memset(&ip_header, 0, sizeof(struct ip_hdr));
     ip_header.version = 4;
     ip_header.ihl = 5;
@@ -538,7 +554,7 @@ ssize_t udp_shmem_buffer_write(const void *_param, void *_ctx, const void *buffe
     ip_header.proto = 17; // UDP
     ip_header.srcaddr = IPV4(127, 0, 0, 1);
     ip_header.dstaddr = IPV4(127, 0, 0, 1);
-    ip_header.csum = cksum_avx2((void*) &ip_header, sizeof(struct ip_hdr), 0);
+    ip_header.csum = cksum(&ip_header, sizeof(struct ip_hdr), 0);
 
     udp_header.srcport = 0;
     udp_header.dstport = 0;
@@ -555,29 +571,35 @@ ssize_t udp_shmem_buffer_write(const void *_param, void *_ctx, const void *buffe
     pseudo_header.len = ip_header.len;
     pseudo_header.csum = 0;
 
-    csum = cksum_avx2((void*) &pseudo_header, sizeof(struct pseudo_ip_hdr), 0);
-    csum = cksum_avx2((void*) buffer, count, ~csum);
-    udp_header.csum = csum;
-
-    position = atomic_load(&buf->position);
-    for (int spin = 0; (spin < SPIN_ITERATIONS) && is_full(position); spin++) {
-        position = atomic_load(&buf->position);
+    for (int i = 0; (i < iovcnt) && (remain > 0); i++) {
+        len = MIN(iov[i].iov_len, remain);
+        memcpy(payload, iov[i].iov_base, len);
+        payload += len;
+        remain -= len;
     }
 
-    if (is_full(position)) {
-        pthread_mutex_lock(&buf->mutex);
-        position = atomic_load(&buf->position);
-        while (is_full(position)) {
-            if (atomic_load(&buf->reader_pid) == 0) {
-                pthread_mutex_unlock(&buf->mutex);
-                kill(getpid(), SIGPIPE);
-                errno = EPIPE;
-                return -1;
-            }
-            pthread_cond_wait(&buf->is_not_full, &buf->mutex);
-            position = atomic_load(&buf->position);
-        }
-        pthread_mutex_unlock(&buf->mutex);
+    cksum_init(&state, 0);
+    cksum_update(&state, &pseudo_header, sizeof(struct pseudo_ip_hdr));
+    cksum_update(&state, data_location + UDP_HEADER_SIZE, count);
+    udp_header.csum = cksum_final(&state);
+
+    memcpy(data_location, &ip_header, sizeof(struct ip_hdr));
+    memcpy(data_location + sizeof(struct ip_hdr), &udp_header,
+            sizeof(struct udp_hdr));
+}
+
+// Waits until the ring buffer has at least one free slot and
+// sets writer to the position of the writer. Returns the number
+// of free slots, or -1 when the reader has closed the channel.
+static ssize_t udp_shmem_buffer_write_wait(const pirate_udp_shmem_param_t *param, udp_shmem_ctx *ctx, uint64_t *writer) {
+    shmem_buffer_t* buf = ctx->buf;
+    const size_t packet_count = buf->packet_count;
+
+    *writer = atomic_load_explicit(&buf->writer, memory_order_relaxed);
+    // Only read the reader cache line when the buffer
+    // was full on the previous load.
+    while ((*writer - ctx->cached == packet_count) && (atomic_load(&buf->reader_pid) != 0)) {
+        ctx->cached = shmem_buffer_wait(buf, O_WRONLY, ctx->cached, param->wait, param->spin_ns, &ctx->wait_stats);
     }
 
     // The writer returns -1 when the reader has closed the channel.
@@ -588,33 +610,117 @@ ssize_t udp_shmem_buffer_write(const void *_param, void *_ctx, const void *buffe
         errno = EPIPE;
         return -1;
     }
-    reader = get_read(position);
-    writer = get_write(position);
-
-    memcpy(shared_buffer(buf) + (writer * packet_size), &ip_header,
-            sizeof(struct ip_hdr));
-    memcpy(shared_buffer(buf) + (writer * packet_size) + sizeof(struct ip_hdr),
-            &udp_header, sizeof(struct udp_hdr));
-    memcpy(shared_buffer(buf) + (writer * packet_size) + UDP_HEADER_SIZE, buffer,
-            count);
-    atomic_thread_fence(memory_order_release);
-
-    for (;;) {
-        uint64_t update = create_position((writer + 1) % packet_count,
-                                            reader, 1);
-        if (atomic_compare_exchange_weak(&buf->position, &position,
-                                            update)) {
-            was_empty = is_empty(position);
-            break;
-        }
-        reader = get_read(position);
+
+    return packet_count - (*writer - ctx->cached);
+}
+
+// Moves the writer position past the end of the written packets
+// and wakes up the reader if it is sleeping. The sequentially
+// consistent store is ordered after the packet contents
+// and before the load of reader_waiting and reader_pollers.
+static void udp_shmem_buffer_write_publish(shmem_buffer_t* buf, uint64_t writer) {
+    atomic_store(&buf->writer, writer);
+
+    if (atomic_load(&buf->reader_waiting) || atomic_load(&buf->reader_pollers)) {
+        shmem_buffer_wake(buf, O_RDONLY);
+    }
+}
+
+ssize_t udp_shmem_buffer_writev(const void *_param, void *_ctx, const struct iovec *iov, int iovcnt) {
+    const pirate_udp_shmem_param_t *param = (const pirate_udp_shmem_param_t *)_param;
+    udp_shmem_ctx *ctx = (udp_shmem_ctx *)_ctx;
+    uint64_t writer;
+    unsigned char* data_location;
+    size_t count = 0;
+
+    shmem_buffer_t* buf = ctx->buf;
+    if (buf == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+
+    if ((iovcnt < 0) || (iovcnt > PIRATE_IOV_MAX)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const size_t packet_size = buf->packet_size;
+    const size_t packet_count = buf->packet_count;
+
+    for (int i = 0; i < iovcnt; i++) {
+        count += iov[i].iov_len;
     }
 
-    if (was_empty) {
-        pthread_mutex_lock(&buf->mutex);
-        pthread_cond_signal(&buf->is_not_empty);
-        pthread_mutex_unlock(&buf->mutex);
+    if (count > (packet_size - UDP_HEADER_SIZE)) {
+        count = packet_size - UDP_HEADER_SIZE;
     }
 
+    if (udp_shmem_buffer_write_wait(param, ctx, &writer) < 0) {
+        return -1;
+    }
+
+    data_location = shared_buffer(buf) + ((writer % packet_count) * packet_size);
+    udp_shmem_buffer_pack(data_location, iov, iovcnt, count);
+
+    udp_shmem_buffer_write_publish(buf, writer + 1);
+
     return count;
 }
+
+ssize_t udp_shmem_buffer_write(const void *_param, void *_ctx, const void *buffer, size_t count) {
+    struct iovec iov;
+
+    iov.iov_base = (void*) buffer;
+    iov.iov_len = count;
+    return udp_shmem_buffer_writev(_param, _ctx, &iov, 1);
+}
+
+ssize_t udp_shmem_buffer_write_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen) {
+    const pirate_udp_shmem_param_t *param = (const pirate_udp_shmem_param_t *)_param;
+    udp_shmem_ctx *ctx = (udp_shmem_ctx *)_ctx;
+    uint64_t writer;
+    unsigned char* data_location;
+    struct iovec iov;
+    ssize_t nslots;
+    size_t count;
+    unsigned i;
+
+    shmem_buffer_t* buf = ctx->buf;
+    if (buf == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+
+    const size_t packet_size = buf->packet_size;
+    const size_t packet_count = buf->packet_count;
+
+    if ((nslots = udp_shmem_buffer_write_wait(param, ctx, &writer)) < 0) {
+        return -1;
+    }
+
+    // Only read the reader cache line when the free slots
+    // observed on the previous load cannot hold the batch.
+    if ((size_t) nslots < vlen) {
+        ctx->cached = atomic_load_explicit(&buf->reader, memory_order_acquire);
+        nslots = packet_count - (writer - ctx->cached);
+    }
+
+    // A truncated packet ends the batch.
+    vlen = MIN(vlen, (size_t) nslots);
+    for (i = 0; i < vlen; i++) {
+        count = MIN(msgs[i].count, packet_size - UDP_HEADER_SIZE);
+        data_location = shared_buffer(buf) + (((writer + i) % packet_count) * packet_size);
+        iov.iov_base = msgs[i].buf;
+        iov.iov_len = count;
+        udp_shmem_buffer_pack(data_location, &iov, 1, count);
+        msgs[i].len = count;
+        if (count < msgs[i].count) {
+            i++;
+            break;
+        }
+    }
+
+    udp_shmem_buffer_write_publish(buf, writer + i);
+
+    return i;
+}
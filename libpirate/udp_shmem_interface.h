@@ -22,6 +22,12 @@
 typedef struct {
     int flags;
     shmem_buffer_t *buf;
+    // length of the mapping of buf
+    size_t alloc_size;
+    // last observed position of the reader (for the writer)
+    // or of the writer (for the reader)
+    uint64_t cached;
+    shmem_wait_stats_t wait_stats;
 } udp_shmem_ctx;
 
 #ifdef PIRATE_SHMEM_FEATURE
@@ -33,12 +39,16 @@ int udp_shmem_buffer_close(void *_ctx);
 ssize_t udp_shmem_buffer_read(const void *_param, void *_ctx, void *buf, size_t count);
 ssize_t udp_shmem_buffer_write(const void *_param, void *_ctx, const void *buf,  size_t count);
 ssize_t udp_shmem_buffer_write_mtu(const void *_param, void *_ctx);
+ssize_t udp_shmem_buffer_write_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen);
+ssize_t udp_shmem_buffer_read_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen);
+ssize_t udp_shmem_buffer_writev(const void *_param, void *_ctx, const struct iovec *iov, int iovcnt);
+ssize_t udp_shmem_buffer_peek_len(const void *_param, void *_ctx);
 
-#define PIRATE_UDP_SHMEM_CHANNEL_FUNCS { udp_shmem_buffer_parse_param, udp_shmem_buffer_get_channel_description, udp_shmem_buffer_open, udp_shmem_buffer_close, udp_shmem_buffer_read, udp_shmem_buffer_write, udp_shmem_buffer_write_mtu }
+#define PIRATE_UDP_SHMEM_CHANNEL_FUNCS { udp_shmem_buffer_parse_param, udp_shmem_buffer_get_channel_description, udp_shmem_buffer_open, udp_shmem_buffer_close, udp_shmem_buffer_read, udp_shmem_buffer_write, udp_shmem_buffer_write_mtu, NULL, NULL, NULL, NULL, udp_shmem_buffer_write_batch, udp_shmem_buffer_read_batch, udp_shmem_buffer_writev, udp_shmem_buffer_peek_len }
 
 #else
 
-#define PIRATE_UDP_SHMEM_CHANNEL_FUNCS { NULL, NULL, NULL, NULL, NULL, NULL, NULL }
+#define PIRATE_UDP_SHMEM_CHANNEL_FUNCS { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL }
 
 #endif
 
@@ -84,7 +84,9 @@ int pirate_udp_socket_parse_param(char *str, void *_param) {
             param->buffer_size = strtol(val, NULL, 10);
         } else if (strncmp("mtu", key, strlen("mtu")) == 0) {
             param->mtu = strtol(val, NULL, 10);
-        } else {
+        } else if ((rv = pirate_reliable_parse_param(key, val, &param->reliable)) < 0) {
+            return -1;
+        } else if (rv == 0) {
             errno = EINVAL;
             return -1;
         }
@@ -96,19 +98,21 @@ int pirate_udp_socket_get_channel_description(const void *_param, char *desc, in
     const pirate_udp_socket_param_t *param = (const pirate_udp_socket_param_t *)_param;
     char buffer_size_str[32];
     char mtu_str[32];
+    char reliable_str[96];
 
     buffer_size_str[0] = 0;
     mtu_str[0] = 0;
+    pirate_reliable_description(&param->reliable, reliable_str, sizeof(reliable_str));
     if ((param->mtu != 0) && (param->mtu != PIRATE_DEFAULT_UDP_PACKET_SIZE)) {
         snprintf(mtu_str, 32, ",mtu=%u", param->mtu);
     }
     if (param->buffer_size != 0) {
         snprintf(buffer_size_str, 32, ",buffer_size=%u", param->buffer_size);
     }
-    return snprintf(desc, len, "udp_socket,%s,%u,%s,%u%s%s",
+    return snprintf(desc, len, "udp_socket,%s,%u,%s,%u%s%s%s",
         param->reader_addr, param->reader_port,
         param->writer_addr, param->writer_port,
-        buffer_size_str, mtu_str);
+        buffer_size_str, mtu_str, reliable_str);
 }
 
 static int populate_address(struct addrinfo *addr, int port, int *addr_any) {
@@ -345,6 +349,18 @@ int pirate_udp_socket_open(void *_param, void *_ctx) {
     } else {
         rv = pirate_udp_socket_writer_open(param, (common_ctx*) ctx);
     }
+    if ((rv >= 0) && (param->reliable.mode != PIRATE_RELIABLE_NONE)) {
+        ctx->reliable = pirate_reliable_open(&param->reliable, ctx->flags, ctx->sock,
+            (param->mtu > 28) ? param->mtu - 28 : 0, pirate_udp_socket_reliable_send, pirate_udp_socket_reliable_recv,
+            &ctx->sock, sizeof(ctx->sock));
+        if (ctx->reliable == NULL) {
+            int err = errno;
+            close(ctx->sock);
+            ctx->sock = -1;
+            errno = err;
+            return -1;
+        }
+    }
 
     return rv;
 }
@@ -358,6 +374,11 @@ int pirate_udp_socket_close(void *_ctx) {
         return -1;
     }
 
+    if (ctx->reliable != NULL) {
+        pirate_reliable_close(ctx->reliable);
+        ctx->reliable = NULL;
+    }
+
     err = errno;
     shutdown(ctx->sock, SHUT_RDWR);
     errno = err;
@@ -374,10 +395,22 @@ ssize_t pirate_udp_socket_read(const void *_param, void *_ctx, void *buf, size_t
         errno = EBADF;
         return -1;
     }
+    if (ctx->reliable != NULL) {
+        return pirate_reliable_read(ctx->reliable, buf, count);
+    }
 
     return recv(ctx->sock, buf, count, 0);
 }
 
+ssize_t pirate_udp_socket_peek_len(const void *_param, void *_ctx) {
+    (void) _param;
+    udp_socket_ctx *ctx = (udp_socket_ctx *)_ctx;
+    if (ctx->reliable != NULL) {
+        return pirate_reliable_peek_len(ctx->reliable);
+    }
+    return pirate_socket_peek_len(ctx->sock);
+}
+
 ssize_t pirate_udp_socket_write_mtu(const void *_param, void *_ctx) {
     (void) _ctx;
     pirate_udp_socket_param_t *param = (pirate_udp_socket_param_t *)_param;
@@ -394,30 +427,121 @@ ssize_t pirate_udp_socket_write_mtu(const void *_param, void *_ctx) {
         errno = EINVAL;
         return -1;
     }
+    if (param->reliable.mode != PIRATE_RELIABLE_NONE) {
+        return pirate_reliable_write_mtu(&param->reliable, mtu - 28);
+    }
     return mtu - 28;
 }
 
+// Arguments of the send calls that are retried
+// by pirate_send_retry_refused()
+typedef struct {
+    int sock;
+    size_t write_mtu;
+    const void *buf;
+    size_t count;
+    const struct iovec *iov;
+    int iovcnt;
+    pirate_mmsg_t *msgs;
+    unsigned vlen;
+} udp_socket_send_args;
+
+static ssize_t udp_socket_send(void *_args) {
+    udp_socket_send_args *args = (udp_socket_send_args *)_args;
+    return send(args->sock, args->buf, args->count, 0);
+}
+
+static ssize_t udp_socket_sendv(void *_args) {
+    udp_socket_send_args *args = (udp_socket_send_args *)_args;
+    return pirate_socket_writev(args->sock, args->write_mtu, args->iov, args->iovcnt);
+}
+
+static ssize_t udp_socket_send_batch(void *_args) {
+    udp_socket_send_args *args = (udp_socket_send_args *)_args;
+    return pirate_socket_write_batch(args->sock, args->write_mtu, args->msgs, args->vlen);
+}
+
 ssize_t pirate_udp_socket_write(const void *_param, void *_ctx, const void *buf, size_t count) {
     pirate_udp_socket_param_t *param = (pirate_udp_socket_param_t *)_param;
     udp_socket_ctx *ctx = (udp_socket_ctx *)_ctx;
-    int err;
-    ssize_t rv;
+    udp_socket_send_args args;
     size_t write_mtu = pirate_udp_socket_write_mtu(param, ctx);
 
     if (ctx->sock <= 0) {
         errno = EBADF;
         return -1;
     }
+    if (ctx->reliable != NULL) {
+        struct iovec iov = { (void*) buf, count };
+        return pirate_reliable_writev(ctx->reliable, &iov, 1);
+    }
     if ((write_mtu > 0) && (count > write_mtu)) {
         errno = EMSGSIZE;
         return -1;
     }
-    err = errno;
-    rv = send(ctx->sock, buf, count, 0);
-    if ((rv < 0) && (errno == ECONNREFUSED)) {
-        // TODO create a counter of undelivered messages
-        errno = err;
-        rv = send(ctx->sock, buf, count, 0);
+    memset(&args, 0, sizeof(args));
+    args.sock = ctx->sock;
+    args.buf = buf;
+    args.count = count;
+    return pirate_send_retry_refused(udp_socket_send, &args);
+}
+
+ssize_t pirate_udp_socket_writev(const void *_param, void *_ctx, const struct iovec *iov, int iovcnt) {
+    pirate_udp_socket_param_t *param = (pirate_udp_socket_param_t *)_param;
+    udp_socket_ctx *ctx = (udp_socket_ctx *)_ctx;
+    udp_socket_send_args args;
+
+    if (ctx->reliable != NULL) {
+        return pirate_reliable_writev(ctx->reliable, iov, iovcnt);
     }
-    return rv;
+    memset(&args, 0, sizeof(args));
+    args.sock = ctx->sock;
+    args.write_mtu = pirate_udp_socket_write_mtu(param, ctx);
+    args.iov = iov;
+    args.iovcnt = iovcnt;
+    return pirate_send_retry_refused(udp_socket_sendv, &args);
+}
+
+ssize_t pirate_udp_socket_write_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen) {
+    pirate_udp_socket_param_t *param = (pirate_udp_socket_param_t *)_param;
+    udp_socket_ctx *ctx = (udp_socket_ctx *)_ctx;
+    udp_socket_send_args args;
+
+    if (ctx->reliable != NULL) {
+        return pirate_reliable_write_batch(ctx->reliable, msgs, vlen);
+    }
+    memset(&args, 0, sizeof(args));
+    args.sock = ctx->sock;
+    args.write_mtu = pirate_udp_socket_write_mtu(param, ctx);
+    args.msgs = msgs;
+    args.vlen = vlen;
+    return pirate_send_retry_refused(udp_socket_send_batch, &args);
+}
+
+ssize_t pirate_udp_socket_read_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen) {
+    (void) _param;
+    udp_socket_ctx *ctx = (udp_socket_ctx *)_ctx;
+    if (ctx->reliable != NULL) {
+        return pirate_reliable_read_batch(ctx->reliable, msgs, vlen);
+    }
+    return pirate_socket_read_batch(ctx->sock, msgs, vlen);
+}
+
+ssize_t pirate_udp_socket_reliable_send(void *arg, const struct sockaddr *to, socklen_t tolen,
+    const struct iovec *iov, int iovcnt) {
+    int sock = *(int *) arg;
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = (void *) to;
+    msg.msg_namelen = tolen;
+    msg.msg_iov = (struct iovec *) iov;
+    msg.msg_iovlen = iovcnt;
+    return sendmsg(sock, &msg, 0);
+}
+
+ssize_t pirate_udp_socket_reliable_recv(void *arg, void *buf, size_t count, int flags,
+    struct sockaddr *from, socklen_t *fromlen) {
+    int sock = *(int *) arg;
+    return recvfrom(sock, buf, count, flags, from, fromlen);
 }
@@ -18,10 +18,13 @@
 
 #include "libpirate.h"
 #include "pirate_common.h"
+#include "reliable.h"
 
 typedef struct {
     int flags;
     int sock;
+    // non-NULL with the reliable option
+    pirate_reliable_t *reliable;
 } udp_socket_ctx;
 
 int pirate_udp_socket_parse_param(char *str, void *_param);
@@ -31,10 +34,21 @@ int pirate_udp_socket_close(void *_ctx);
 ssize_t pirate_udp_socket_read(const void *_param, void *_ctx, void *buf, size_t count);
 ssize_t pirate_udp_socket_write(const void *_param, void *_ctx, const void *buf, size_t count);
 ssize_t pirate_udp_socket_write_mtu(const void *_param, void *_ctx);
+ssize_t pirate_udp_socket_write_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen);
+ssize_t pirate_udp_socket_read_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen);
+ssize_t pirate_udp_socket_writev(const void *_param, void *_ctx, const struct iovec *iov, int iovcnt);
+ssize_t pirate_udp_socket_peek_len(const void *_param, void *_ctx);
 
 int pirate_udp_socket_reader_open(pirate_udp_socket_param_t *param, common_ctx *ctx);
 int pirate_udp_socket_writer_open(pirate_udp_socket_param_t *param, common_ctx *ctx);
 
-#define PIRATE_UDP_SOCKET_CHANNEL_FUNCS { pirate_udp_socket_parse_param, pirate_udp_socket_get_channel_description, pirate_udp_socket_open, pirate_udp_socket_close, pirate_udp_socket_read, pirate_udp_socket_write, pirate_udp_socket_write_mtu }
+// Functions of the reliable layer that send and receive
+// datagrams on the socket pointed to by arg
+ssize_t pirate_udp_socket_reliable_send(void *arg, const struct sockaddr *to, socklen_t tolen,
+    const struct iovec *iov, int iovcnt);
+ssize_t pirate_udp_socket_reliable_recv(void *arg, void *buf, size_t count, int flags,
+    struct sockaddr *from, socklen_t *fromlen);
+
+#define PIRATE_UDP_SOCKET_CHANNEL_FUNCS { pirate_udp_socket_parse_param, pirate_udp_socket_get_channel_description, pirate_udp_socket_open, pirate_udp_socket_close, pirate_udp_socket_read, pirate_udp_socket_write, pirate_udp_socket_write_mtu, NULL, NULL, NULL, NULL, pirate_udp_socket_write_batch, pirate_udp_socket_read_batch, pirate_udp_socket_writev, pirate_udp_socket_peek_len }
 
 #endif /* __PIRATE_CHANNEL_UDP_SOCKET_H */
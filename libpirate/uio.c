@@ -24,51 +24,14 @@
 #include "pirate_common.h"
 #include "uio_interface.h"
 
-// TODO: replace reader and writer with BipBuffer
-// https://ferrous-systems.com/blog/lock-free-ring-buffer/
-// use 20 bits for reader, 20 bits for writer, 20 bits for watermark
-// use remaining 4 bits for status
-// use status bits to indicate whether empty or full
-
 static inline int buffer_size() {
     return getpagesize() * 256;
 }
 
-static inline uint8_t get_status(uint64_t value) {
-    return (value & 0xff00000000000000) >> 56;
-}
-
-static inline uint32_t get_write(uint64_t value) {
-    return (value & 0x00fffffff0000000) >> 28;
-}
-
-static inline uint32_t get_read(uint64_t value) {
-    return (value & 0x000000000fffffff);
-}
-
 static inline uint8_t* shared_buffer(shmem_buffer_t *uio_buffer) {
     return (uint8_t *) uio_buffer + sizeof(shmem_buffer_t);
 }
 
-static inline uint64_t create_position(uint32_t write, uint32_t read,
-                                       int writer) {
-    uint8_t status = 1;
-
-    if (read == write) {
-        status = writer ? 2 : 0;
-    }
-
-    return (((uint64_t)status) << 56) | (((uint64_t)write) << 28) | read;
-}
-
-static inline int is_empty(uint64_t value) {
-    return get_status(value) == 0;
-}
-
-static inline int is_full(uint64_t value) {
-    return get_status(value) == 2;
-}
-
 static void pirate_uio_init_param(pirate_uio_param_t *param) {
     if (strnlen(param->path, 1) == 0) {
         snprintf(param->path, PIRATE_LEN_NAME - 1, PIRATE_UIO_DEFAULT_PATH);
@@ -163,6 +126,7 @@ int pirate_internal_uio_open(void *_param, void *_ctx) {
         do {
             init_pid = atomic_load(&buf->writer_pid);
         } while (!init_pid);
+        ctx->cached = atomic_load(&buf->writer);
     } else {
         if (!atomic_compare_exchange_strong(&buf->writer_pid, &init_pid,
                                             (uint64_t)getpid())) {
@@ -173,6 +137,7 @@ int pirate_internal_uio_open(void *_param, void *_ctx) {
         do {
             init_pid = atomic_load(&buf->reader_pid);
         } while (!init_pid);
+        ctx->cached = atomic_load(&buf->reader);
     }
 
     return pirate_next_gd();
@@ -212,10 +177,8 @@ int pirate_internal_uio_close(void *_ctx) {
 ssize_t pirate_internal_uio_read(const void *_param, void *_ctx, void *buffer, size_t count) {
     (void)_param;
     uio_ctx *ctx = (uio_ctx *)_ctx;
-    uint64_t position;
-    uint32_t reader, writer;
-    size_t nbytes, nbytes1, nbytes2;
-    int buffer_size;
+    uint64_t reader;
+    size_t nbytes, nbytes1, nbytes2, offset;
 
     shmem_buffer_t* buf = ctx->buf;
     if (buf == NULL) {
@@ -223,47 +186,32 @@ ssize_t pirate_internal_uio_read(const void *_param, void *_ctx, void *buffer, s
         return -1;
     }
 
-    for (;;) {
-        position = atomic_load(&buf->position);
-        if (!is_empty(position)) {
-            break;
-        }
+    count = MIN(count, 65536);
+    reader = atomic_load_explicit(&buf->reader, memory_order_relaxed);
+    // Only read the writer cache line when the data
+    // observed on the previous load is not sufficient.
+    if (ctx->cached - reader < count) {
+        ctx->cached = atomic_load_explicit(&buf->writer, memory_order_acquire);
+    }
 
+    while (ctx->cached == reader) {
         if (atomic_load(&buf->writer_pid) == 0) {
             return 0;
         }
+        ctx->cached = atomic_load_explicit(&buf->writer, memory_order_acquire);
     }
 
-    reader = get_read(position);
-    writer = get_write(position);
-    buffer_size = buf->size;
-
-    if (reader < writer) {
-        nbytes = writer - reader;
-    } else {
-        nbytes = buffer_size + writer - reader;
-    }
-
-    count = MIN(count, 65536);
-    nbytes = MIN(nbytes, count);
-    nbytes1 = MIN(buffer_size - reader, nbytes);
+    nbytes = MIN(ctx->cached - reader, count);
+    offset = reader % buf->size;
+    nbytes1 = MIN(buf->size - offset, nbytes);
     nbytes2 = nbytes - nbytes1;
-    atomic_thread_fence(memory_order_acquire);
-    memcpy(buffer, shared_buffer(buf) + reader, nbytes1);
+    memcpy(buffer, shared_buffer(buf) + offset, nbytes1);
 
     if (nbytes2 > 0) {
         memcpy(((char *)buffer) + nbytes1, shared_buffer(buf), nbytes2);
     }
 
-    for (;;) {
-        uint64_t update = create_position(writer,
-                                        (reader + nbytes) % buffer_size, 0);
-        if (atomic_compare_exchange_weak(&buf->position, &position,
-                                            update)) {
-            break;
-        }
-        writer = get_write(position);
-    }
+    atomic_store_explicit(&buf->reader, reader + nbytes, memory_order_release);
 
     return nbytes;
 }
@@ -285,10 +233,8 @@ ssize_t pirate_internal_uio_write_mtu(const void *_param, void *_ctx) {
 ssize_t pirate_internal_uio_write(const void *_param, void *_ctx, const void *buffer, size_t count) {
     (void)_param;
     uio_ctx *ctx = (uio_ctx *)_ctx;
-    int buffer_size;
-    size_t nbytes, nbytes1, nbytes2;
-    uint64_t position;
-    uint32_t reader, writer;
+    uint64_t writer;
+    size_t nbytes, nbytes1, nbytes2, offset;
 
     shmem_buffer_t* buf = ctx->buf;
     if (buf == NULL) {
@@ -296,49 +242,38 @@ ssize_t pirate_internal_uio_write(const void *_param, void *_ctx, const void *bu
         return -1;
     }
 
+    count = MIN(count, 65536);
+    writer = atomic_load_explicit(&buf->writer, memory_order_relaxed);
+    // Only read the reader cache line when the free space
+    // observed on the previous load is not sufficient.
+    if (buf->size - (writer - ctx->cached) < count) {
+        ctx->cached = atomic_load_explicit(&buf->reader, memory_order_acquire);
+    }
+
     // The writer returns -1 when the reader has closed the channel.
     // The reader returns 0 when the writer has closed the channel AND
     // the channel is empty.
-    do {
+    for (;;) {
         if (atomic_load(&buf->reader_pid) == 0) {
             return -1;
         }
-        position = atomic_load(&buf->position);
-    } while (is_full(position));
-
-    do {
-        position = atomic_load(&buf->position);
-    } while (is_full(position));
-
-    reader = get_read(position);
-    writer = get_write(position);
-    buffer_size = buf->size;
-
-    if (writer < reader) {
-        nbytes = reader - writer;
-    } else {
-        nbytes = buffer_size + reader - writer;
+        if (writer - ctx->cached < buf->size) {
+            break;
+        }
+        ctx->cached = atomic_load_explicit(&buf->reader, memory_order_acquire);
     }
 
-    count = MIN(count, 65536);
-    nbytes = MIN(nbytes, count);
-    nbytes1 = MIN(buffer_size - writer, nbytes);
+    nbytes = MIN(buf->size - (writer - ctx->cached), count);
+    offset = writer % buf->size;
+    nbytes1 = MIN(buf->size - offset, nbytes);
     nbytes2 = nbytes - nbytes1;
-    memcpy(shared_buffer(buf) + writer, buffer, nbytes1);
+    memcpy(shared_buffer(buf) + offset, buffer, nbytes1);
 
     if (nbytes2 > 0) {
         memcpy(shared_buffer(buf), ((char *)buffer) + nbytes1, nbytes2);
     }
 
-    atomic_thread_fence(memory_order_release);
-    for (;;) {
-        uint64_t update = create_position((writer + nbytes) % buffer_size,
-                                            reader, 1);
-        if (atomic_compare_exchange_weak(&buf->position, &position,
-                                            update)) {
-            break;
-        }
-        reader = get_read(position);
-    }
+    atomic_store_explicit(&buf->writer, writer + nbytes, memory_order_release);
+
     return nbytes;
 }
@@ -23,6 +23,9 @@ typedef struct {
     int flags;
     int fd;
     shmem_buffer_t *buf;
+    // last observed position of the reader (for the writer)
+    // or of the writer (for the reader)
+    uint64_t cached;
 } uio_ctx;
 
 #ifdef PIRATE_SHMEM_FEATURE
@@ -35,11 +38,11 @@ ssize_t pirate_internal_uio_read(const void *_param, void *_ctx, void *buf, size
 ssize_t pirate_internal_uio_write(const void *_param, void *_ctx, const void *buf, size_t count);
 ssize_t pirate_internal_uio_write_mtu(const void *_param, void *_ctx);
 
-#define PIRATE_UIO_CHANNEL_FUNCS { pirate_internal_uio_parse_param, pirate_internal_uio_get_channel_description, pirate_internal_uio_open, pirate_internal_uio_close, pirate_internal_uio_read, pirate_internal_uio_write, pirate_internal_uio_write_mtu }
+#define PIRATE_UIO_CHANNEL_FUNCS { pirate_internal_uio_parse_param, pirate_internal_uio_get_channel_description, pirate_internal_uio_open, pirate_internal_uio_close, pirate_internal_uio_read, pirate_internal_uio_write, pirate_internal_uio_write_mtu, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL }
 
 #else
 
-#define PIRATE_UIO_CHANNEL_FUNCS { NULL, NULL, NULL, NULL, NULL, NULL, NULL }
+#define PIRATE_UIO_CHANNEL_FUNCS { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL }
 
 #endif
 
@@ -257,6 +257,12 @@ ssize_t pirate_unix_seqpacket_read(const void *_param, void *_ctx, void *buf, si
     return recv(ctx->sock, buf, count, 0);
 }
 
+ssize_t pirate_unix_seqpacket_peek_len(const void *_param, void *_ctx) {
+    (void) _param;
+    unix_seqpacket_ctx *ctx = (unix_seqpacket_ctx *)_ctx;
+    return pirate_socket_peek_len(ctx->sock);
+}
+
 ssize_t pirate_unix_seqpacket_write_mtu(const void *_param, void *_ctx) {
     (void) _ctx;
     const pirate_unix_seqpacket_param_t *param = (const pirate_unix_seqpacket_param_t *)_param;
@@ -278,3 +284,23 @@ ssize_t pirate_unix_seqpacket_write(const void *_param, void *_ctx, const void *
     }
     return send(ctx->sock, buf, count, 0);
 }
+
+ssize_t pirate_unix_seqpacket_writev(const void *_param, void *_ctx, const struct iovec *iov, int iovcnt) {
+    const pirate_unix_seqpacket_param_t *param = (const pirate_unix_seqpacket_param_t *)_param;
+    unix_seqpacket_ctx *ctx = (unix_seqpacket_ctx *)_ctx;
+    size_t write_mtu = pirate_unix_seqpacket_write_mtu(param, ctx);
+    return pirate_socket_writev(ctx->sock, write_mtu, iov, iovcnt);
+}
+
+ssize_t pirate_unix_seqpacket_write_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen) {
+    const pirate_unix_seqpacket_param_t *param = (const pirate_unix_seqpacket_param_t *)_param;
+    unix_seqpacket_ctx *ctx = (unix_seqpacket_ctx *)_ctx;
+    size_t write_mtu = pirate_unix_seqpacket_write_mtu(param, ctx);
+    return pirate_socket_write_batch(ctx->sock, write_mtu, msgs, vlen);
+}
+
+ssize_t pirate_unix_seqpacket_read_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen) {
+    (void) _param;
+    unix_seqpacket_ctx *ctx = (unix_seqpacket_ctx *)_ctx;
+    return pirate_socket_read_batch(ctx->sock, msgs, vlen);
+}
@@ -31,8 +31,12 @@ int pirate_unix_seqpacket_close(void *_ctx);
 ssize_t pirate_unix_seqpacket_read(const void *_param, void *_ctx, void *buf, size_t count);
 ssize_t pirate_unix_seqpacket_write(const void *_param, void *_ctx, const void *buf, size_t count);
 ssize_t pirate_unix_seqpacket_write_mtu(const void *_param, void *_ctx);
+ssize_t pirate_unix_seqpacket_write_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen);
+ssize_t pirate_unix_seqpacket_read_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen);
+ssize_t pirate_unix_seqpacket_writev(const void *_param, void *_ctx, const struct iovec *iov, int iovcnt);
+ssize_t pirate_unix_seqpacket_peek_len(const void *_param, void *_ctx);
 
-#define PIRATE_UNIX_SEQPACKET_CHANNEL_FUNCS { pirate_unix_seqpacket_parse_param, pirate_unix_seqpacket_get_channel_description, pirate_unix_seqpacket_open, pirate_unix_seqpacket_close, pirate_unix_seqpacket_read, pirate_unix_seqpacket_write, pirate_unix_seqpacket_write_mtu }
+#define PIRATE_UNIX_SEQPACKET_CHANNEL_FUNCS { pirate_unix_seqpacket_parse_param, pirate_unix_seqpacket_get_channel_description, pirate_unix_seqpacket_open, pirate_unix_seqpacket_close, pirate_unix_seqpacket_read, pirate_unix_seqpacket_write, pirate_unix_seqpacket_write_mtu, NULL, NULL, NULL, NULL, pirate_unix_seqpacket_write_batch, pirate_unix_seqpacket_read_batch, pirate_unix_seqpacket_writev, pirate_unix_seqpacket_peek_len }
 
 
 #endif /* __PIRATE_CHANNEL_UNIX_SEQPACKET_H */
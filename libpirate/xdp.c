@@ -0,0 +1,834 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+
+#include "pirate_common.h"
+#include "ge_eth.h"
+#include "xdp.h"
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+#ifndef SO_BUSY_POLL_BUDGET
+#define SO_BUSY_POLL_BUDGET 70
+#endif
+
+// The kernel places received packets after 256 bytes of headroom
+#define XDP_HEADROOM          256u
+#define XDP_MAX_MTU           (PIRATE_XDP_FRAME_SIZE - XDP_HEADROOM - PIRATE_XDP_ETH_HLEN)
+#define XDP_MAX_FRAMES        (1u << 20)
+#define XDP_BUSY_POLL_BUDGET  64
+// The writer waits for the frames on the TX ring to
+// be sent for at most this many milliseconds on close
+#define XDP_CLOSE_WAIT_MS     100
+// The socket waits for the queue to be released by
+// a socket that was closed for at most this many
+// milliseconds on open
+#define XDP_BIND_WAIT_MS      500
+
+static const uint8_t xdp_broadcast[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+static void pirate_xdp_init_param(pirate_xdp_param_t *param) {
+    if (param->mtu == 0) {
+        param->mtu = PIRATE_DEFAULT_GE_ETH_MTU;
+    }
+    if (param->frames == 0) {
+        param->frames = PIRATE_DEFAULT_XDP_FRAMES;
+    }
+}
+
+int pirate_xdp_parse_param(char *str, void *_param) {
+    pirate_xdp_param_t *param = (pirate_xdp_param_t *)_param;
+    char *ptr = NULL, *key, *val;
+    char *saveptr1, *saveptr2;
+
+    if (((ptr = strtok_r(str, OPT_DELIM, &saveptr1)) == NULL) ||
+        (strcmp(ptr, "xdp") != 0)) {
+        return -1;
+    }
+
+    if ((ptr = strtok_r(NULL, OPT_DELIM, &saveptr1)) == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    strncpy(param->ifname, ptr, sizeof(param->ifname) - 1);
+
+    if ((ptr = strtok_r(NULL, OPT_DELIM, &saveptr1)) == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    param->queue = strtol(ptr, NULL, 10);
+
+    while ((ptr = strtok_r(NULL, OPT_DELIM, &saveptr1)) != NULL) {
+        int rv = pirate_parse_key_value(&key, &val, ptr, &saveptr2);
+        if (rv < 0) {
+            return rv;
+        } else if (rv == 0) {
+            continue;
+        }
+        if (strncmp("msg_id", key, strlen("msg_id")) == 0) {
+            param->message_id = strtol(val, NULL, 10);
+        } else if (strncmp("mtu", key, strlen("mtu")) == 0) {
+            param->mtu = strtol(val, NULL, 10);
+        } else if (strncmp("crc", key, strlen("crc")) == 0) {
+            if (strncmp("header", val, strlen("header")) == 0) {
+                param->crc = PIRATE_GE_ETH_CRC_HEADER;
+            } else if (strncmp("payload", val, strlen("payload")) == 0) {
+                param->crc = PIRATE_GE_ETH_CRC_PAYLOAD;
+            } else {
+                errno = EINVAL;
+                return -1;
+            }
+        } else if (strncmp("frames", key, strlen("frames")) == 0) {
+            param->frames = strtol(val, NULL, 10);
+        } else if (strncmp("busy_poll", key, strlen("busy_poll")) == 0) {
+            param->busy_poll = strtol(val, NULL, 10);
+        } else if (strncmp("mode", key, strlen("mode")) == 0) {
+            if (strncmp("skb", val, strlen("skb")) == 0) {
+                param->mode = PIRATE_XDP_MODE_SKB;
+            } else if (strncmp("drv", val, strlen("drv")) == 0) {
+                param->mode = PIRATE_XDP_MODE_DRV;
+            } else {
+                errno = EINVAL;
+                return -1;
+            }
+        } else {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int pirate_xdp_get_channel_description(const void *_param, char *desc, int len) {
+    const pirate_xdp_param_t *param = (const pirate_xdp_param_t *)_param;
+    char msg_id_str[32];
+    char mtu_str[32];
+    char crc_str[32];
+    char frames_str[32];
+    char busy_poll_str[32];
+    char mode_str[32];
+
+    msg_id_str[0] = 0;
+    mtu_str[0] = 0;
+    crc_str[0] = 0;
+    frames_str[0] = 0;
+    busy_poll_str[0] = 0;
+    mode_str[0] = 0;
+    if (param->message_id != 0) {
+        snprintf(msg_id_str, 32, ",msg_id=%u", param->message_id);
+    }
+    if (param->mtu != 0) {
+        snprintf(mtu_str, 32, ",mtu=%u", param->mtu);
+    }
+    if (param->crc == PIRATE_GE_ETH_CRC_PAYLOAD) {
+        snprintf(crc_str, 32, ",crc=payload");
+    }
+    if (param->frames != 0) {
+        snprintf(frames_str, 32, ",frames=%u", param->frames);
+    }
+    if (param->busy_poll != 0) {
+        snprintf(busy_poll_str, 32, ",busy_poll=%u", param->busy_poll);
+    }
+    if (param->mode == PIRATE_XDP_MODE_DRV) {
+        snprintf(mode_str, 32, ",mode=drv");
+    }
+    return snprintf(desc, len, "xdp,%s,%u%s%s%s%s%s%s",
+        param->ifname, param->queue, msg_id_str, mtu_str,
+        crc_str, frames_str, busy_poll_str, mode_str);
+}
+
+static int xdp_bpf(int cmd, union bpf_attr *attr) {
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+// Maps a ring of len entries of desc_size bytes
+static int xdp_ring_map(int fd, xdp_ring_t *ring, const struct xdp_ring_offset *off,
+    uint32_t len, size_t desc_size, off_t pgoff) {
+    uint8_t *map;
+
+    ring->map_len = off->desc + len * desc_size;
+    map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, fd, pgoff);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    ring->map = map;
+    ring->producer = (uint32_t *) (map + off->producer);
+    ring->consumer = (uint32_t *) (map + off->consumer);
+    ring->flags = (uint32_t *) (map + off->flags);
+    ring->desc = map + off->desc;
+    ring->mask = len - 1;
+    return 0;
+}
+
+static void xdp_ring_unmap(xdp_ring_t *ring) {
+    if (ring->map != NULL) {
+        munmap(ring->map, ring->map_len);
+        ring->map = NULL;
+    }
+}
+
+// Releases the resources of a partially or fully opened channel
+static void xdp_release(xdp_ctx *ctx) {
+    int err = errno;
+
+    if (ctx->link_fd > 0) {
+        close(ctx->link_fd);
+        ctx->link_fd = -1;
+    }
+    if (ctx->prog_fd > 0) {
+        close(ctx->prog_fd);
+        ctx->prog_fd = -1;
+    }
+    if (ctx->map_fd > 0) {
+        close(ctx->map_fd);
+        ctx->map_fd = -1;
+    }
+    xdp_ring_unmap(&ctx->fill);
+    xdp_ring_unmap(&ctx->comp);
+    xdp_ring_unmap(&ctx->rx);
+    xdp_ring_unmap(&ctx->tx);
+    if (ctx->umem != NULL) {
+        munmap(ctx->umem, ctx->umem_len);
+        ctx->umem = NULL;
+    }
+    if (ctx->free_frames != NULL) {
+        free(ctx->free_frames);
+        ctx->free_frames = NULL;
+    }
+    errno = err;
+}
+
+// Checks the frame length against the interface MTU
+// and reads the source address of the writer
+static int xdp_interface_info(const pirate_xdp_param_t *param, xdp_ctx *ctx) {
+    struct ifreq ifr;
+    int sock, err, rv = -1;
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    memset(&ifr, 0, sizeof(ifr));
+    memcpy(ifr.ifr_name, param->ifname, IFNAMSIZ - 1);
+    if (ioctl(sock, SIOCGIFMTU, &ifr) < 0) {
+        goto end;
+    }
+    if (param->mtu > (unsigned) ifr.ifr_mtu) {
+        errno = EINVAL;
+        goto end;
+    }
+    if (ioctl(sock, SIOCGIFHWADDR, &ifr) < 0) {
+        goto end;
+    }
+    memcpy(ctx->src_mac, ifr.ifr_hwaddr.sa_data, sizeof(ctx->src_mac));
+    rv = 0;
+end:
+    err = errno;
+    close(sock);
+    errno = err;
+    return rv;
+}
+
+// Registers the UMEM, maps the rings, and binds
+// the socket to the queue of the interface
+static int xdp_socket_open(const pirate_xdp_param_t *param, xdp_ctx *ctx,
+    int access, unsigned ifindex) {
+    struct xdp_umem_reg reg;
+    struct xdp_mmap_offsets off;
+    struct sockaddr_xdp sxdp;
+    socklen_t optlen;
+    uint32_t frames = param->frames;
+    uint32_t i;
+    int ring, err = errno;
+
+    ctx->umem_len = (size_t) frames * PIRATE_XDP_FRAME_SIZE;
+    ctx->umem = mmap(NULL, ctx->umem_len, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (ctx->umem == MAP_FAILED) {
+        ctx->umem = NULL;
+        return -1;
+    }
+
+    ctx->fd = socket(AF_XDP, SOCK_RAW, 0);
+    if (ctx->fd < 0) {
+        return -1;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.addr = (uintptr_t) ctx->umem;
+    reg.len = ctx->umem_len;
+    reg.chunk_size = PIRATE_XDP_FRAME_SIZE;
+    reg.headroom = 0;
+    if (setsockopt(ctx->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0) {
+        return -1;
+    }
+    ring = (access == O_RDONLY) ? XDP_RX_RING : XDP_TX_RING;
+    if ((setsockopt(ctx->fd, SOL_XDP, XDP_UMEM_FILL_RING, &frames, sizeof(frames)) < 0) ||
+        (setsockopt(ctx->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &frames, sizeof(frames)) < 0) ||
+        (setsockopt(ctx->fd, SOL_XDP, ring, &frames, sizeof(frames)) < 0)) {
+        return -1;
+    }
+
+    optlen = sizeof(off);
+    if (getsockopt(ctx->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0) {
+        return -1;
+    }
+    if ((xdp_ring_map(ctx->fd, &ctx->fill, &off.fr, frames, sizeof(uint64_t),
+            XDP_UMEM_PGOFF_FILL_RING) < 0) ||
+        (xdp_ring_map(ctx->fd, &ctx->comp, &off.cr, frames, sizeof(uint64_t),
+            XDP_UMEM_PGOFF_COMPLETION_RING) < 0)) {
+        return -1;
+    }
+    if (access == O_RDONLY) {
+        if (xdp_ring_map(ctx->fd, &ctx->rx, &off.rx, frames, sizeof(struct xdp_desc),
+                XDP_PGOFF_RX_RING) < 0) {
+            return -1;
+        }
+        // every frame is handed to the kernel
+        for (i = 0; i < frames; i++) {
+            ((uint64_t *) ctx->fill.desc)[i] = (uint64_t) i * PIRATE_XDP_FRAME_SIZE;
+        }
+        __atomic_store_n(ctx->fill.producer, frames, __ATOMIC_RELEASE);
+    } else {
+        if (xdp_ring_map(ctx->fd, &ctx->tx, &off.tx, frames, sizeof(struct xdp_desc),
+                XDP_PGOFF_TX_RING) < 0) {
+            return -1;
+        }
+        ctx->free_frames = calloc(frames, sizeof(uint64_t));
+        if (ctx->free_frames == NULL) {
+            return -1;
+        }
+        for (i = 0; i < frames; i++) {
+            ctx->free_frames[i] = (uint64_t) (frames - i - 1) * PIRATE_XDP_FRAME_SIZE;
+        }
+        ctx->free_count = frames;
+    }
+
+    if (param->busy_poll > 0) {
+        int one = 1, usec = param->busy_poll, budget = XDP_BUSY_POLL_BUDGET;
+        if ((setsockopt(ctx->fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one)) < 0) ||
+            (setsockopt(ctx->fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) < 0) ||
+            (setsockopt(ctx->fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &budget, sizeof(budget)) < 0)) {
+            return -1;
+        }
+    }
+
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = ifindex;
+    sxdp.sxdp_queue_id = param->queue;
+    sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP;
+    if (param->mode == PIRATE_XDP_MODE_SKB) {
+        sxdp.sxdp_flags |= XDP_COPY;
+    }
+    // The kernel releases the queue of a closed socket asynchronously
+    for (i = 0; ; i++) {
+        if (bind(ctx->fd, (struct sockaddr *) &sxdp, sizeof(sxdp)) == 0) {
+            errno = err;
+            return 0;
+        }
+        if ((errno != EBUSY) || (i == XDP_BIND_WAIT_MS)) {
+            return -1;
+        }
+        usleep(1000);
+    }
+}
+
+// Loads and attaches a program that redirects the frames
+// with the GAPS ethertype to the socket of their queue
+// and passes every other frame to the network stack:
+//
+//   if (data + ETH_HLEN > data_end) return XDP_PASS;
+//   if (eth->h_proto != htons(PIRATE_XDP_ETHERTYPE)) return XDP_PASS;
+//   return bpf_redirect_map(&xsks, rx_queue_index, XDP_PASS);
+static int xdp_program_attach(const pirate_xdp_param_t *param, xdp_ctx *ctx, unsigned ifindex) {
+    union bpf_attr attr;
+    uint32_t key = param->queue;
+    uint32_t value = ctx->fd;
+    static const char license[] = "Dual BSD/GPL";
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(uint32_t);
+    attr.max_entries = param->queue + 1;
+    strncpy(attr.map_name, "pirate_xsks", sizeof(attr.map_name) - 1);
+    if ((ctx->map_fd = xdp_bpf(BPF_MAP_CREATE, &attr)) < 0) {
+        return -1;
+    }
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = ctx->map_fd;
+    attr.key = (uintptr_t) &key;
+    attr.value = (uintptr_t) &value;
+    attr.flags = BPF_ANY;
+    if (xdp_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+        return -1;
+    }
+
+    struct bpf_insn insns[] = {
+        { BPF_ALU64 | BPF_MOV | BPF_X, 6, 1, 0, 0 },
+        { BPF_LDX | BPF_MEM | BPF_W, 2, 1, offsetof(struct xdp_md, data), 0 },
+        { BPF_LDX | BPF_MEM | BPF_W, 3, 1, offsetof(struct xdp_md, data_end), 0 },
+        { BPF_ALU64 | BPF_MOV | BPF_X, 4, 2, 0, 0 },
+        { BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, PIRATE_XDP_ETH_HLEN },
+        { BPF_JMP | BPF_JGT | BPF_X, 4, 3, 8, 0 },
+        { BPF_LDX | BPF_MEM | BPF_H, 4, 2, 12, 0 },
+        { BPF_JMP | BPF_JNE | BPF_K, 4, 0, 6, htons(PIRATE_XDP_ETHERTYPE) },
+        { BPF_LDX | BPF_MEM | BPF_W, 2, 6, offsetof(struct xdp_md, rx_queue_index), 0 },
+        { BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, ctx->map_fd },
+        { 0, 0, 0, 0, 0 },
+        { BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS },
+        { BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map },
+        { BPF_JMP | BPF_EXIT, 0, 0, 0, 0 },
+        { BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, XDP_PASS },
+        { BPF_JMP | BPF_EXIT, 0, 0, 0, 0 },
+    };
+
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.expected_attach_type = BPF_XDP;
+    attr.insns = (uintptr_t) insns;
+    attr.insn_cnt = sizeof(insns) / sizeof(insns[0]);
+    attr.license = (uintptr_t) license;
+    strncpy(attr.prog_name, "pirate_xdp", sizeof(attr.prog_name) - 1);
+    if ((ctx->prog_fd = xdp_bpf(BPF_PROG_LOAD, &attr)) < 0) {
+        return -1;
+    }
+
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = ctx->prog_fd;
+    attr.link_create.target_ifindex = ifindex;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = (param->mode == PIRATE_XDP_MODE_SKB) ?
+        XDP_FLAGS_SKB_MODE : XDP_FLAGS_DRV_MODE;
+    if ((ctx->link_fd = xdp_bpf(BPF_LINK_CREATE, &attr)) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int pirate_xdp_open(void *_param, void *_ctx) {
+    pirate_xdp_param_t *param = (pirate_xdp_param_t *)_param;
+    xdp_ctx *ctx = (xdp_ctx *)_ctx;
+    int access = ctx->flags & O_ACCMODE;
+    unsigned ifindex;
+
+    pirate_xdp_init_param(param);
+    if ((param->frames < 2) || (param->frames > XDP_MAX_FRAMES) ||
+        ((param->frames & (param->frames - 1)) != 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((ifindex = if_nametoindex(param->ifname)) == 0) {
+        return -1;
+    }
+    ctx->fd = -1;
+    if ((xdp_interface_info(param, ctx) < 0) ||
+        (xdp_socket_open(param, ctx, access, ifindex) < 0) ||
+        ((access == O_RDONLY) && (xdp_program_attach(param, ctx, ifindex) < 0))) {
+        xdp_release(ctx);
+        if (ctx->fd >= 0) {
+            int err = errno;
+            close(ctx->fd);
+            errno = err;
+        }
+        ctx->fd = -1;
+        return -1;
+    }
+    return ctx->fd;
+}
+
+// Kicks the kernel to send the frames on the TX ring
+static int xdp_tx_kick(xdp_ctx *ctx) {
+    int err = errno;
+
+    if (sendto(ctx->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0) {
+        // the frames that are not sent are sent on the next kick
+        if ((errno != EAGAIN) && (errno != EBUSY) && (errno != ENOBUFS)) {
+            return -1;
+        }
+    }
+    errno = err;
+    return 0;
+}
+
+// Moves the frames that have been sent onto the free stack
+static void xdp_tx_complete(xdp_ctx *ctx) {
+    uint32_t cons = *ctx->comp.consumer;
+    uint32_t prod = __atomic_load_n(ctx->comp.producer, __ATOMIC_ACQUIRE);
+
+    if (cons == prod) {
+        return;
+    }
+    while (cons != prod) {
+        ctx->free_frames[ctx->free_count++] = ((uint64_t *) ctx->comp.desc)[cons & ctx->comp.mask];
+        cons++;
+    }
+    __atomic_store_n(ctx->comp.consumer, cons, __ATOMIC_RELEASE);
+}
+
+int pirate_xdp_close(void *_ctx) {
+    xdp_ctx *ctx = (xdp_ctx *)_ctx;
+    int rv;
+
+    if (ctx->fd <= 0) {
+        xdp_release(ctx);
+        errno = ENODEV;
+        return -1;
+    }
+    if (ctx->tx.map != NULL) {
+        for (int i = 0; i < XDP_CLOSE_WAIT_MS; i++) {
+            xdp_tx_complete(ctx);
+            if (ctx->free_count == ctx->tx.mask + 1) {
+                break;
+            }
+            if (xdp_tx_kick(ctx) < 0) {
+                break;
+            }
+            xdp_tx_complete(ctx);
+            if (ctx->free_count == ctx->tx.mask + 1) {
+                break;
+            }
+            usleep(1000);
+        }
+    }
+    xdp_release(ctx);
+    rv = close(ctx->fd);
+    ctx->fd = -1;
+    return rv;
+}
+
+// Waits for a frame on the RX ring. Returns -1 with
+// errno EAGAIN for a nonblocking channel.
+static int xdp_rx_wait(const pirate_xdp_param_t *param, xdp_ctx *ctx) {
+    struct pollfd pfd;
+    int err;
+
+    for (;;) {
+        if (__atomic_load_n(ctx->rx.producer, __ATOMIC_ACQUIRE) != *ctx->rx.consumer) {
+            return 0;
+        }
+        if ((param->busy_poll > 0) || (ctx->flags & O_NONBLOCK)) {
+            // drives the busy poll loop of the driver or
+            // wakes the driver to consume the fill ring
+            if ((param->busy_poll > 0) || (*ctx->fill.flags & XDP_RING_NEED_WAKEUP)) {
+                err = errno;
+                recvfrom(ctx->fd, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+                errno = err;
+            }
+            if (ctx->flags & O_NONBLOCK) {
+                if (__atomic_load_n(ctx->rx.producer, __ATOMIC_ACQUIRE) != *ctx->rx.consumer) {
+                    return 0;
+                }
+                errno = EAGAIN;
+                return -1;
+            }
+            continue;
+        }
+        pfd.fd = ctx->fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, -1) < 0) {
+            return -1;
+        }
+    }
+}
+
+// Returns the GE_ETH header of the frame at the head of the
+// RX ring and the length of the packet data in the frame
+static const ge_header_t *xdp_rx_head(xdp_ctx *ctx, size_t *data_len) {
+    const struct xdp_desc *desc;
+
+    desc = &((const struct xdp_desc *) ctx->rx.desc)[*ctx->rx.consumer & ctx->rx.mask];
+    if (desc->len < PIRATE_XDP_ETH_HLEN + sizeof(ge_header_t)) {
+        return NULL;
+    }
+    *data_len = desc->len - PIRATE_XDP_ETH_HLEN - sizeof(ge_header_t);
+    return (const ge_header_t *) (ctx->umem + desc->addr + PIRATE_XDP_ETH_HLEN);
+}
+
+// Returns the frame at the head of the RX ring to the fill ring
+static void xdp_rx_release(xdp_ctx *ctx) {
+    uint32_t cons = *ctx->rx.consumer;
+    uint32_t prod = *ctx->fill.producer;
+    uint64_t addr;
+
+    addr = ((const struct xdp_desc *) ctx->rx.desc)[cons & ctx->rx.mask].addr;
+    ((uint64_t *) ctx->fill.desc)[prod & ctx->fill.mask] = addr & ~((uint64_t) PIRATE_XDP_FRAME_SIZE - 1);
+    __atomic_store_n(ctx->rx.consumer, cons + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(ctx->fill.producer, prod + 1, __ATOMIC_RELEASE);
+}
+
+// Copies the packet data of the frame at the head of the RX ring
+// into buf and releases the frame. Sets errno to EBADMSG when the
+// frame fails the crc=payload check.
+static ssize_t xdp_recv(const pirate_xdp_param_t *param, xdp_ctx *ctx, void *buf, size_t count) {
+    const ge_header_t *hdr;
+    size_t data_len = 0, len;
+    ssize_t rv = -1;
+
+    hdr = xdp_rx_head(ctx, &data_len);
+    if (hdr == NULL) {
+        errno = EBADMSG;
+    } else if (pirate_ge_eth_header_verify(hdr, hdr + 1, data_len, param->crc) == 0) {
+        len = MIN(MIN(be16toh(hdr->data_len), data_len), count);
+        memcpy(buf, hdr + 1, len);
+        rv = len;
+    }
+    xdp_rx_release(ctx);
+    return rv;
+}
+
+ssize_t pirate_xdp_read(const void *_param, void *_ctx, void *buf, size_t count) {
+    const pirate_xdp_param_t *param = (const pirate_xdp_param_t *)_param;
+    xdp_ctx *ctx = (xdp_ctx *)_ctx;
+
+    if ((ctx->fd <= 0) || (ctx->rx.map == NULL)) {
+        errno = EBADF;
+        return -1;
+    }
+    if (xdp_rx_wait(param, ctx) < 0) {
+        return -1;
+    }
+    return xdp_recv(param, ctx, buf, count);
+}
+
+ssize_t pirate_xdp_read_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen) {
+    const pirate_xdp_param_t *param = (const pirate_xdp_param_t *)_param;
+    xdp_ctx *ctx = (xdp_ctx *)_ctx;
+    uint32_t avail;
+    unsigned i, j;
+    ssize_t rv;
+    int err;
+
+    if ((ctx->fd <= 0) || (ctx->rx.map == NULL)) {
+        errno = EBADF;
+        return -1;
+    }
+    if (xdp_rx_wait(param, ctx) < 0) {
+        return -1;
+    }
+    // Frames that fail the crc=payload check are dropped
+    avail = __atomic_load_n(ctx->rx.producer, __ATOMIC_ACQUIRE) - *ctx->rx.consumer;
+    vlen = MIN(vlen, avail);
+    err = errno;
+    for (i = 0, j = 0; i < vlen; i++) {
+        rv = xdp_recv(param, ctx, msgs[j].buf, msgs[j].count);
+        if (rv >= 0) {
+            msgs[j++].len = rv;
+        }
+    }
+    if (j == 0) {
+        errno = EBADMSG;
+        return -1;
+    }
+    errno = err;
+    return j;
+}
+
+ssize_t pirate_xdp_peek_len(const void *_param, void *_ctx) {
+    const pirate_xdp_param_t *param = (const pirate_xdp_param_t *)_param;
+    xdp_ctx *ctx = (xdp_ctx *)_ctx;
+    const ge_header_t *hdr;
+    size_t data_len = 0;
+
+    if ((ctx->fd <= 0) || (ctx->rx.map == NULL)) {
+        errno = EBADF;
+        return -1;
+    }
+    if (xdp_rx_wait(param, ctx) < 0) {
+        return -1;
+    }
+    if ((hdr = xdp_rx_head(ctx, &data_len)) == NULL) {
+        return 0;
+    }
+    return MIN(be16toh(hdr->data_len), data_len);
+}
+
+ssize_t pirate_xdp_write_mtu(const void *_param, void *_ctx) {
+    (void) _ctx;
+    const pirate_xdp_param_t *param = (const pirate_xdp_param_t *)_param;
+    size_t mtu = param->mtu;
+    if (mtu == 0) {
+        mtu = PIRATE_DEFAULT_GE_ETH_MTU;
+    }
+    if ((mtu < sizeof(ge_header_t)) || (mtu > XDP_MAX_MTU)) {
+        errno = EINVAL;
+        return -1;
+    }
+    return mtu - sizeof(ge_header_t);
+}
+
+// Takes a frame from the free stack. The frames on the TX ring
+// are moved onto the free stack after they have been sent.
+static int xdp_tx_frame(xdp_ctx *ctx, uint64_t *addr) {
+    for (;;) {
+        xdp_tx_complete(ctx);
+        if (ctx->free_count > 0) {
+            *addr = ctx->free_frames[--ctx->free_count];
+            return 0;
+        }
+        if (xdp_tx_kick(ctx) < 0) {
+            return -1;
+        }
+        xdp_tx_complete(ctx);
+        if (ctx->free_count > 0) {
+            continue;
+        }
+        if (ctx->flags & O_NONBLOCK) {
+            errno = EAGAIN;
+            return -1;
+        }
+        sched_yield();
+    }
+}
+
+// Copies one packet into a frame and places the frame on
+// the TX ring. The frame is sent on the next kick.
+static ssize_t xdp_send(const pirate_xdp_param_t *param, xdp_ctx *ctx,
+    const struct iovec *iov, int iovcnt) {
+    struct xdp_desc *desc;
+    struct iovec data_iov;
+    ge_header_t *hdr;
+    uint8_t *frame, *data;
+    size_t count = 0;
+    uint64_t addr;
+    uint32_t prod;
+    int i;
+
+    if ((iovcnt < 0) || (iovcnt > PIRATE_IOV_MAX)) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        count += iov[i].iov_len;
+    }
+    if (count > (param->mtu - sizeof(ge_header_t))) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if (xdp_tx_frame(ctx, &addr) < 0) {
+        return -1;
+    }
+
+    frame = ctx->umem + addr;
+    memcpy(frame, xdp_broadcast, sizeof(xdp_broadcast));
+    memcpy(frame + 6, ctx->src_mac, sizeof(ctx->src_mac));
+    frame[12] = PIRATE_XDP_ETHERTYPE >> 8;
+    frame[13] = PIRATE_XDP_ETHERTYPE & 0xff;
+    hdr = (ge_header_t *) (frame + PIRATE_XDP_ETH_HLEN);
+    data = (uint8_t *) (hdr + 1);
+    for (i = 0; i < iovcnt; i++) {
+        memcpy(data, iov[i].iov_base, iov[i].iov_len);
+        data += iov[i].iov_len;
+    }
+    // The CRC-16 is computed over the copy in the frame
+    data_iov.iov_base = hdr + 1;
+    data_iov.iov_len = count;
+    pirate_ge_eth_header_pack(hdr, &data_iov, 1, count, param->message_id, param->crc);
+
+    prod = *ctx->tx.producer;
+    desc = &((struct xdp_desc *) ctx->tx.desc)[prod & ctx->tx.mask];
+    desc->addr = addr;
+    desc->len = PIRATE_XDP_ETH_HLEN + sizeof(ge_header_t) + count;
+    desc->options = 0;
+    __atomic_store_n(ctx->tx.producer, prod + 1, __ATOMIC_RELEASE);
+    return count;
+}
+
+ssize_t pirate_xdp_writev(const void *_param, void *_ctx, const struct iovec *iov, int iovcnt) {
+    const pirate_xdp_param_t *param = (const pirate_xdp_param_t *)_param;
+    xdp_ctx *ctx = (xdp_ctx *)_ctx;
+    ssize_t rv;
+
+    if ((ctx->fd <= 0) || (ctx->tx.map == NULL)) {
+        errno = EBADF;
+        return -1;
+    }
+    rv = xdp_send(param, ctx, iov, iovcnt);
+    if ((rv >= 0) && (xdp_tx_kick(ctx) < 0)) {
+        return -1;
+    }
+    return rv;
+}
+
+ssize_t pirate_xdp_write(const void *_param, void *_ctx, const void *buf, size_t count) {
+    struct iovec iov;
+
+    iov.iov_base = (void*) buf;
+    iov.iov_len = count;
+    return pirate_xdp_writev(_param, _ctx, &iov, 1);
+}
+
+// The frames of the batch are sent with one kick
+ssize_t pirate_xdp_write_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen) {
+    const pirate_xdp_param_t *param = (const pirate_xdp_param_t *)_param;
+    xdp_ctx *ctx = (xdp_ctx *)_ctx;
+    struct iovec iov;
+    unsigned i;
+    ssize_t rv;
+    int err = errno;
+
+    if ((ctx->fd <= 0) || (ctx->tx.map == NULL)) {
+        errno = EBADF;
+        return -1;
+    }
+    for (i = 0; i < vlen; i++) {
+        iov.iov_base = msgs[i].buf;
+        iov.iov_len = msgs[i].count;
+        if ((rv = xdp_send(param, ctx, &iov, 1)) < 0) {
+            break;
+        }
+        msgs[i].len = rv;
+    }
+    if (i == 0) {
+        return -1;
+    }
+    errno = err;
+    if (xdp_tx_kick(ctx) < 0) {
+        return -1;
+    }
+    return i;
+}
@@ -0,0 +1,82 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+#ifndef __PIRATE_CHANNEL_XDP_H
+#define __PIRATE_CHANNEL_XDP_H
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include "libpirate.h"
+
+// Frames are Ethernet broadcast frames with this ethertype
+// (IEEE 802 local experimental) followed by the GE_ETH header
+// and the packet data
+#define PIRATE_XDP_ETHERTYPE    0x88B5
+#define PIRATE_XDP_ETH_HLEN     14
+#define PIRATE_XDP_FRAME_SIZE   2048u
+
+// One of the four rings of an AF_XDP socket. The producer and
+// consumer indices are free running and the ring length is a
+// power of two. The fill and completion rings hold UMEM
+// addresses, the RX and TX rings hold struct xdp_desc.
+typedef struct {
+    uint32_t *producer;
+    uint32_t *consumer;
+    uint32_t *flags;
+    void *desc;
+    uint32_t mask;
+    void *map;
+    size_t map_len;
+} xdp_ring_t;
+
+// The reader socket uses the fill and RX rings and keeps every
+// UMEM frame on the fill ring that is not on the RX ring. The
+// writer socket uses the TX and completion rings and keeps every
+// UMEM frame that is not on the TX ring on the free stack.
+// The fill and completion rings are registered on both sockets
+// because the kernel requires both rings on each UMEM.
+typedef struct {
+    int flags;
+    int fd;
+    uint8_t *umem;
+    size_t umem_len;
+    xdp_ring_t fill;
+    xdp_ring_t comp;
+    xdp_ring_t rx;
+    xdp_ring_t tx;
+    uint64_t *free_frames;
+    uint32_t free_count;
+    uint8_t src_mac[6];
+    // the XDP program is detached when the link is closed
+    int prog_fd;
+    int map_fd;
+    int link_fd;
+} xdp_ctx;
+
+int pirate_xdp_parse_param(char *str, void *_param);
+int pirate_xdp_get_channel_description(const void *_param, char *desc, int len);
+int pirate_xdp_open(void *_param, void *_ctx);
+int pirate_xdp_close(void *_ctx);
+ssize_t pirate_xdp_read(const void *_param, void *_ctx, void *buf, size_t count);
+ssize_t pirate_xdp_write(const void *_param, void *_ctx, const void *buf, size_t count);
+ssize_t pirate_xdp_write_mtu(const void *_param, void *_ctx);
+ssize_t pirate_xdp_write_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen);
+ssize_t pirate_xdp_read_batch(const void *_param, void *_ctx, pirate_mmsg_t *msgs, unsigned vlen);
+ssize_t pirate_xdp_writev(const void *_param, void *_ctx, const struct iovec *iov, int iovcnt);
+ssize_t pirate_xdp_peek_len(const void *_param, void *_ctx);
+
+#define PIRATE_XDP_CHANNEL_FUNCS { pirate_xdp_parse_param, pirate_xdp_get_channel_description, pirate_xdp_open, pirate_xdp_close, pirate_xdp_read, pirate_xdp_write, pirate_xdp_write_mtu, NULL, NULL, NULL, NULL, pirate_xdp_write_batch, pirate_xdp_read_batch, pirate_xdp_writev, pirate_xdp_peek_len }
+
+#endif /* __PIRATE_CHANNEL_XDP_H */
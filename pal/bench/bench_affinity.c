@@ -0,0 +1,92 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+// Checks that the cpu affinity of an enclave is applied by launch().
+// The program launches itself as an enclave with `cpus: [0]`, and the
+// enclave reports the cpus returned by sched_getaffinity(). The check
+// passes if the enclave runs on cpu 0 only.
+
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "launch.h"
+
+#define BENCH_AFFINITY_ENCLAVE "bench_pal_affinity"
+#define BENCH_AFFINITY_CHILD "--enclave"
+
+static int report_affinity() {
+    cpu_set_t cpus;
+    int count = 0;
+
+    if (sched_getaffinity(0, sizeof(cpus), &cpus)) {
+        perror("sched_getaffinity");
+        return 1;
+    }
+    printf("enclave cpus        ");
+    for (int i = 0; i < CPU_SETSIZE; i++) {
+        if (CPU_ISSET(i, &cpus)) {
+            printf(" %d", i);
+            count++;
+        }
+    }
+    printf("\n");
+    fflush(stdout);
+    return ((count == 1) && CPU_ISSET(0, &cpus)) ? 0 : 1;
+}
+
+int main(int argc, char *argv[], char *envp[]) {
+    char *args[] = { BENCH_AFFINITY_CHILD };
+    uint32_t cpus[] = { 0 };
+    struct enclave enc;
+    struct app app;
+    int status;
+
+    if ((argc > 1) && (strcmp(argv[1], BENCH_AFFINITY_CHILD) == 0)) {
+        return report_affinity();
+    }
+
+    // The enclave is this executable
+    memset(&enc, 0, sizeof(enc));
+    memset(&app, 0, sizeof(app));
+    enc.enc_name = "affinity";
+    enc.enc_path = BENCH_AFFINITY_ENCLAVE;
+    enc.enc_args = args;
+    enc.enc_args_count = 1;
+    enc.enc_cpus = cpus;
+    enc.enc_cpus_count = 1;
+
+    if (launch(&app, argv[0], &enc, envp) || launch_status(&app)) {
+        fputs("failed to launch the enclave\n", stderr);
+        return 1;
+    }
+    close(app.pipe_fd);
+
+    if ((waitpid(app.pid, &status, 0) < 0) || !WIFEXITED(status)) {
+        fputs("enclave failed\n", stderr);
+        return 1;
+    }
+    if (WEXITSTATUS(status) != 0) {
+        fputs("enclave is not restricted to cpu 0\n", stderr);
+        return 1;
+    }
+    printf("cpu affinity         ok\n");
+    return 0;
+}
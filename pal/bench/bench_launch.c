@@ -0,0 +1,171 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+// Measures the time pal takes to start a number of enclaves, from the
+// first launch until every enclave has fetched its resources, passed a
+// barrier with all the other enclaves, and exited. The enclaves are
+// first launched one at a time, waiting for each one to be executed,
+// and served once all of them are launched, the way pal did before.
+// Then they are launched with launch_apps(), which answers the
+// enclaves that are running between launches.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "handle_apps.h"
+#include "launch.h"
+#include "resource_index.h"
+
+#define BENCH_LAUNCH_ENCLAVES 64
+#define BENCH_LAUNCH_ITERATIONS 10
+#define BENCH_LAUNCH_NAME_LEN 32
+#define BENCH_LAUNCH_ENCLAVE "bench_pal_launch_enclave"
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static char **make_ids(struct enclave *encs, unsigned count, const char *name) {
+    char **ids = calloc(count, sizeof(char *));
+
+    if (ids == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    for (unsigned i = 0; i < count; i++) {
+        if ((ids[i] = malloc(2 * BENCH_LAUNCH_NAME_LEN)) == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+        snprintf(ids[i], 2 * BENCH_LAUNCH_NAME_LEN, "%s/%s",
+            encs[i].enc_name, name);
+    }
+    return ids;
+}
+
+static uint64_t run_launch(char *self, struct enclave *encs, struct app *apps,
+        unsigned count, struct resource *barrier, struct resource_index *idx,
+        int serial, char **envp) {
+    uint64_t start = monotonic_ns(), ns;
+    int status;
+
+    barrier->r_contents.cc_broken = false;
+    if (serial) {
+        for (unsigned i = 0; i < count; i++) {
+            if (launch(&apps[i], self, &encs[i], envp) ||
+                launch_status(&apps[i])) {
+                fprintf(stderr, "failed to launch %s\n", encs[i].enc_name);
+                exit(1);
+            }
+        }
+        if (handle_apps(apps, count, idx) != 0) {
+            fputs("handle_apps failed\n", stderr);
+            exit(1);
+        }
+    } else if (launch_apps(apps, encs, count, self, envp, idx) != 0) {
+        fputs("launch_apps failed\n", stderr);
+        exit(1);
+    }
+    ns = monotonic_ns() - start;
+
+    for (unsigned i = 0; i < count; i++) {
+        if ((waitpid(apps[i].pid, &status, 0) < 0) ||
+            !WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+            fprintf(stderr, "enclave %s failed\n", encs[i].enc_name);
+            exit(1);
+        }
+    }
+    return ns;
+}
+
+int main(int argc, char *argv[], char *envp[]) {
+    unsigned count = BENCH_LAUNCH_ENCLAVES;
+    uint64_t serial_ns = UINT64_MAX, parallel_ns = UINT64_MAX;
+    int64_t value = 42;
+    struct resource rscs[2];
+    struct resource_index idx;
+    struct enclave *encs;
+    struct app *apps;
+
+    if (argc > 1) {
+        count = strtoul(argv[1], NULL, 10);
+    }
+    if (count == 0) {
+        fprintf(stderr, "usage: %s [enclaves]\n", argv[0]);
+        return 1;
+    }
+
+    encs = calloc(count, sizeof(struct enclave));
+    apps = calloc(count, sizeof(struct app));
+    if ((encs == NULL) || (apps == NULL)) {
+        perror("calloc");
+        return 1;
+    }
+    // The enclave executable is next to the benchmark
+    for (unsigned i = 0; i < count; i++) {
+        if ((encs[i].enc_name = malloc(BENCH_LAUNCH_NAME_LEN)) == NULL) {
+            perror("malloc");
+            return 1;
+        }
+        snprintf(encs[i].enc_name, BENCH_LAUNCH_NAME_LEN, "e%u", i);
+        encs[i].enc_path = BENCH_LAUNCH_ENCLAVE;
+    }
+
+    memset(rscs, 0, sizeof(rscs));
+    rscs[0].r_name = "value";
+    rscs[0].r_type = "integer";
+    rscs[0].r_ids = make_ids(encs, count, "value");
+    rscs[0].r_ids_count = count;
+    rscs[0].r_contents.cc_integer_value = &value;
+    rscs[1].r_name = "ready";
+    rscs[1].r_type = "barrier";
+    rscs[1].r_ids = make_ids(encs, count, "ready");
+    rscs[1].r_ids_count = count;
+    if (build_resource_index(&idx, rscs, 2)) {
+        return 1;
+    }
+
+    for (unsigned i = 0; i < BENCH_LAUNCH_ITERATIONS; i++) {
+        uint64_t ns;
+
+        ns = run_launch(argv[0], encs, apps, count, &rscs[1], &idx, 1, envp);
+        serial_ns = ns < serial_ns ? ns : serial_ns;
+        ns = run_launch(argv[0], encs, apps, count, &rscs[1], &idx, 0, envp);
+        parallel_ns = ns < parallel_ns ? ns : parallel_ns;
+    }
+
+    printf("enclaves             %u\n", count);
+    printf("serial launch        %.1f ms\n", serial_ns / 1000000.0);
+    printf("parallel launch      %.1f ms\n", parallel_ns / 1000000.0);
+    printf("speedup              %.1fx\n", (double) serial_ns / parallel_ns);
+
+    free_resource_index(&idx);
+    for (unsigned i = 0; i < count; i++) {
+        free(rscs[0].r_ids[i]);
+        free(rscs[1].r_ids[i]);
+        free(encs[i].enc_name);
+    }
+    free(rscs[0].r_ids);
+    free(rscs[1].r_ids);
+    free(encs);
+    free(apps);
+    return 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+// Enclave started by bench_pal_launch. libpal fetches the integer
+// resource before main runs, then the enclave waits on a barrier with
+// the other enclaves and exits.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <pal/pal.h>
+
+static int64_t value;
+
+struct pirate_resource bench_res_integer[]
+    __attribute__((used, section("pirate_res_integer"))) = {
+    { "value", &value, NULL, 0 },
+};
+
+#define BENCH_NO_RESOURCES(_type) \
+    struct pirate_resource bench_no_res_##_type[0] \
+        __attribute__((used, section("pirate_res_" #_type)))
+
+BENCH_NO_RESOURCES(string);
+BENCH_NO_RESOURCES(boolean);
+BENCH_NO_RESOURCES(file);
+BENCH_NO_RESOURCES(pirate_channel);
+
+int main() {
+    int err;
+
+    if (value != 42) {
+        fprintf(stderr, "unexpected value %ld\n", (long) value);
+        return 1;
+    }
+    if ((err = wait_barrier_res(get_pal_fd(), "ready"))) {
+        fprintf(stderr, "wait_barrier_res: %s\n",
+            err > 0 ? pal_strerror(err) : strerror(-err));
+        return 1;
+    }
+    return 0;
+}
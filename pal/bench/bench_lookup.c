@@ -0,0 +1,196 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+// Measures the requests/sec that pal can resolve and answer for a
+// synthetic configuration, with the resource index and with a linear
+// scan of every resource id. Each request looks up the resource and
+// the handler of its type and fills in the reply envelope.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pal/envelope.h>
+
+#include "handlers.h"
+#include "resource_index.h"
+
+#define BENCH_LOOKUP_RESOURCES 10000
+#define BENCH_LOOKUP_ENCLAVES 64
+#define BENCH_LOOKUP_REQUESTS 1000000
+#define BENCH_LOOKUP_LINEAR_REQUESTS 20000
+#define BENCH_LOOKUP_NAME_LEN 32
+
+struct request {
+    struct app *app;
+    char *name;
+};
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// The lookups pal used before the resource index
+static struct resource *linear_lookup_resource(char *app_name, char *rsc_name,
+        struct resource *rscs, size_t rscs_count) {
+    size_t id_size = strlen(app_name) + 1 + strlen(rsc_name) + 1;
+    char id[id_size];
+
+    snprintf(id, id_size, "%s/%s", app_name, rsc_name);
+    for (size_t i = 0; i < rscs_count; i++) {
+        for (size_t j = 0; j < rscs[i].r_ids_count; j++) {
+            if (!strcmp(id, rscs[i].r_ids[j])) {
+                return &rscs[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+static resource_handler_t *linear_lookup_handler(const char *type) {
+    for (size_t i = 0; i < HANDLER_TABLE_MAX && handler_table[i].type; i++) {
+        if (!strcmp(type, handler_table[i].type)) {
+            return handler_table[i].handler;
+        }
+    }
+    return NULL;
+}
+
+static void answer(struct request *req, struct resource *rsc,
+        resource_handler_t *handle) {
+    pal_env_t env = EMPTY_PAL_ENV(PAL_RESOURCE);
+
+    if ((rsc == NULL) || (handle == NULL) || handle(&env, req->app, rsc)) {
+        fprintf(stderr, "request for %s/%s failed\n",
+            req->app->name, req->name);
+        exit(1);
+    }
+    pal_free_env(&env);
+}
+
+static double run_linear(struct request *reqs, unsigned count,
+        struct resource *rscs, size_t rscs_count) {
+    uint64_t start = monotonic_ns();
+
+    for (unsigned i = 0; i < count; i++) {
+        struct request *req = &reqs[i];
+        answer(req,
+            linear_lookup_resource(req->app->name, req->name,
+                rscs, rscs_count),
+            linear_lookup_handler("integer"));
+    }
+    return count * 1e9 / (monotonic_ns() - start);
+}
+
+static double run_index(struct request *reqs, unsigned count,
+        struct resource_index *idx) {
+    uint64_t start = monotonic_ns();
+
+    for (unsigned i = 0; i < count; i++) {
+        struct request *req = &reqs[i];
+        answer(req,
+            index_lookup_resource(idx, req->app->name, req->name),
+            index_lookup_handler(idx, "integer"));
+    }
+    return count * 1e9 / (monotonic_ns() - start);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned rscs_count = BENCH_LOOKUP_RESOURCES;
+    struct app apps[BENCH_LOOKUP_ENCLAVES];
+    struct resource_index idx;
+    struct resource *rscs;
+    struct request *reqs;
+    int64_t *values;
+    char (*ids)[BENCH_LOOKUP_NAME_LEN];
+    char (*names)[BENCH_LOOKUP_NAME_LEN];
+    char **id_ptrs;
+    uint64_t start;
+
+    if (argc > 1) {
+        rscs_count = strtoul(argv[1], NULL, 10);
+    }
+    if (rscs_count == 0) {
+        fprintf(stderr, "usage: %s [resources]\n", argv[0]);
+        return 1;
+    }
+
+    rscs = calloc(rscs_count, sizeof(struct resource));
+    values = calloc(rscs_count, sizeof(int64_t));
+    ids = calloc(rscs_count, BENCH_LOOKUP_NAME_LEN);
+    names = calloc(rscs_count, BENCH_LOOKUP_NAME_LEN);
+    id_ptrs = calloc(rscs_count, sizeof(char *));
+    reqs = calloc(BENCH_LOOKUP_REQUESTS, sizeof(struct request));
+    if (!rscs || !values || !ids || !names || !id_ptrs || !reqs) {
+        perror("calloc");
+        return 1;
+    }
+
+    memset(apps, 0, sizeof(apps));
+    for (unsigned i = 0; i < BENCH_LOOKUP_ENCLAVES; i++) {
+        apps[i].name = malloc(BENCH_LOOKUP_NAME_LEN);
+        snprintf(apps[i].name, BENCH_LOOKUP_NAME_LEN, "enclave_%u", i);
+    }
+
+    // Resources are spread over the enclaves and named after their index
+    for (unsigned i = 0; i < rscs_count; i++) {
+        struct app *app = &apps[i % BENCH_LOOKUP_ENCLAVES];
+
+        snprintf(names[i], BENCH_LOOKUP_NAME_LEN, "resource_%u", i);
+        snprintf(ids[i], BENCH_LOOKUP_NAME_LEN, "%s/%s", app->name, names[i]);
+        values[i] = i;
+        id_ptrs[i] = ids[i];
+        rscs[i].r_name = names[i];
+        rscs[i].r_type = "integer";
+        rscs[i].r_ids = &id_ptrs[i];
+        rscs[i].r_ids_count = 1;
+        rscs[i].r_contents.cc_integer_value = &values[i];
+    }
+
+    srand(1);
+    for (unsigned i = 0; i < BENCH_LOOKUP_REQUESTS; i++) {
+        unsigned r = rand() % rscs_count;
+
+        reqs[i].app = &apps[r % BENCH_LOOKUP_ENCLAVES];
+        reqs[i].name = names[r];
+    }
+
+    start = monotonic_ns();
+    if (build_resource_index(&idx, rscs, rscs_count)) {
+        return 1;
+    }
+
+    printf("resources       %u\n", rscs_count);
+    printf("index build     %.1f ms\n", (monotonic_ns() - start) / 1e6);
+    printf("linear scan     %.0f requests/sec\n",
+        run_linear(reqs, BENCH_LOOKUP_LINEAR_REQUESTS, rscs, rscs_count));
+    printf("resource index  %.0f requests/sec\n",
+        run_index(reqs, BENCH_LOOKUP_REQUESTS, &idx));
+
+    free_resource_index(&idx);
+    for (unsigned i = 0; i < BENCH_LOOKUP_ENCLAVES; i++) {
+        free(apps[i].name);
+    }
+    free(rscs);
+    free(values);
+    free(ids);
+    free(names);
+    free(id_ptrs);
+    free(reqs);
+    return 0;
+}
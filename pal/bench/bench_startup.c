@@ -0,0 +1,277 @@
+/*
+ * This work was authored by Two Six Labs, LLC and is sponsored by a subcontract
+ * agreement with Galois, Inc.  This material is based upon work supported by
+ * the Defense Advanced Research Projects Agency (DARPA) under Contract No.
+ * HR0011-19-C-0103.
+ *
+ * The Government has unlimited rights to use, modify, reproduce, release,
+ * perform, display, or disclose computer software or computer software
+ * documentation marked with this legend. Any reproduction of technical data,
+ * computer software, or portions thereof marked with this legend must also
+ * reproduce this marking.
+ *
+ * Copyright 2020 Two Six Labs, LLC.  All rights reserved.
+ */
+
+// Measures the time an application takes to fetch its resources from
+// the launcher, with one request per resource and with a single
+// resource manifest. A forked process answers the requests over a
+// socket pair the way pal does, with an integer value per resource.
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <pal/envelope.h>
+#include <pal/pal.h>
+
+// libpal fetches the resources declared in these sections before main
+// runs. The benchmark declares none so that it can run without pal.
+#define BENCH_NO_RESOURCES(_type) \
+    struct pirate_resource bench_no_res_##_type[0] \
+        __attribute__((used, section("pirate_res_" #_type)))
+
+BENCH_NO_RESOURCES(string);
+BENCH_NO_RESOURCES(integer);
+BENCH_NO_RESOURCES(boolean);
+BENCH_NO_RESOURCES(file);
+BENCH_NO_RESOURCES(pirate_channel);
+
+#define BENCH_STARTUP_RESOURCES 1000
+#define BENCH_STARTUP_ITERATIONS 20
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int64_t resource_value(const char *name) {
+    return strtoll(name + 1, NULL, 10);
+}
+
+static void integer_env(pal_env_t *env, const char *name) {
+    int64_t value = resource_value(name);
+
+    if (pal_add_to_env(env, &value, sizeof(value))) {
+        fputs("pal_add_to_env failed\n", stderr);
+        _exit(1);
+    }
+}
+
+static void send_or_exit(int sock, pal_env_t *env) {
+    int err;
+
+    if ((err = pal_send_env(sock, env, 0))) {
+        fprintf(stderr, "pal_send_env: %s\n", strerror(-err));
+        _exit(1);
+    }
+}
+
+static void answer_request(int sock, pal_env_t *req) {
+    pal_env_t env = EMPTY_PAL_ENV(PAL_RESOURCE);
+    char *type, *name;
+
+    if (pal_parse_resource_request(req, &type, &name)) {
+        fputs("pal_parse_resource_request failed\n", stderr);
+        _exit(1);
+    }
+    integer_env(&env, name);
+    send_or_exit(sock, &env);
+    pal_free_env(&env);
+    free(type);
+    free(name);
+}
+
+static uint32_t answer_manifest(int sock, pal_env_t *chunk, uint32_t index,
+        pal_env_t *reply) {
+    pal_env_iterator_t it = pal_env_iterator_start(chunk);
+    pal_env_iterator_t end = pal_env_iterator_end(chunk);
+
+    while (it < end) {
+        pal_env_iterator_t name_it = pal_env_iterator_next(it);
+        pal_env_t env = EMPTY_PAL_ENV(PAL_RESOURCE);
+        char name[64];
+
+        snprintf(name, sizeof(name), "%.*s",
+            (int) pal_env_iterator_size(name_it),
+            (char *) pal_env_iterator_data(name_it));
+        integer_env(&env, name);
+        if (pal_add_resource_to_env(reply, index, 0, &env)) {
+            send_or_exit(sock, reply);
+            reply->size = 0;
+            if (pal_add_resource_to_env(reply, index, 0, &env)) {
+                fputs("pal_add_resource_to_env failed\n", stderr);
+                _exit(1);
+            }
+        }
+        pal_free_env(&env);
+        index++;
+        it = pal_env_iterator_next(name_it);
+    }
+    return index;
+}
+
+static void responder(int sock) {
+    pal_env_t reply = EMPTY_PAL_ENV(PAL_RESOURCES);
+    uint32_t index = 0;
+
+    for (;;) {
+        pal_env_t env = EMPTY_PAL_ENV(PAL_NO_TYPE);
+
+        if (pal_recv_env(sock, &env, 0)) {
+            break;
+        }
+        switch (env.type) {
+        case PAL_RESOURCE_REQUEST:
+            answer_request(sock, &env);
+            break;
+        case PAL_RESOURCE_MANIFEST:
+        case PAL_RESOURCE_MANIFEST_END:
+            index = answer_manifest(sock, &env, index, &reply);
+            if (env.type == PAL_RESOURCE_MANIFEST_END) {
+                if (reply.size > 0) {
+                    send_or_exit(sock, &reply);
+                }
+                reply.size = 0;
+                index = 0;
+            }
+            break;
+        }
+        pal_free_env(&env);
+    }
+    pal_free_env(&reply);
+    _exit(0);
+}
+
+static void check_value(const char *name, int64_t value) {
+    if (value != resource_value(name)) {
+        fprintf(stderr, "resource %s: unexpected value %ld\n",
+            name, (long) value);
+        exit(1);
+    }
+}
+
+static uint64_t run_requests(int sock, char **names, unsigned count) {
+    uint64_t start = monotonic_ns();
+
+    for (unsigned i = 0; i < count; i++) {
+        int64_t value;
+        int err;
+
+        if ((err = get_integer_res(sock, names[i], &value))) {
+            fprintf(stderr, "get_integer_res: %s\n",
+                err > 0 ? pal_strerror(err) : strerror(-err));
+            exit(1);
+        }
+        check_value(names[i], value);
+    }
+    return monotonic_ns() - start;
+}
+
+static uint64_t run_manifest(int sock, char **names, unsigned count,
+        struct pal_resource_request *reqs) {
+    uint64_t start = monotonic_ns();
+    int err;
+
+    for (unsigned i = 0; i < count; i++) {
+        reqs[i].type = "integer";
+        reqs[i].name = names[i];
+    }
+    if ((err = get_resources(sock, reqs, count))) {
+        fprintf(stderr, "get_resources: %s\n",
+            err > 0 ? pal_strerror(err) : strerror(-err));
+        exit(1);
+    }
+    for (unsigned i = 0; i < count; i++) {
+        pal_env_iterator_t it = pal_env_iterator_start(&reqs[i].env);
+        int64_t value;
+
+        if (reqs[i].status ||
+            (pal_env_iterator_size(it) != sizeof(value))) {
+            fprintf(stderr, "resource %s: bad reply\n", names[i]);
+            exit(1);
+        }
+        memcpy(&value, pal_env_iterator_data(it), sizeof(value));
+        check_value(names[i], value);
+        pal_free_env(&reqs[i].env);
+    }
+    return monotonic_ns() - start;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned count = BENCH_STARTUP_RESOURCES;
+    uint64_t requests_ns = UINT64_MAX, manifest_ns = UINT64_MAX;
+    struct pal_resource_request *reqs;
+    char **names;
+    int fds[2], status;
+    pid_t pid;
+
+    if (argc > 1) {
+        count = strtoul(argv[1], NULL, 10);
+    }
+    if (count == 0) {
+        fprintf(stderr, "usage: %s [resources]\n", argv[0]);
+        return 1;
+    }
+
+    names = calloc(count, sizeof(char *));
+    reqs = calloc(count, sizeof(struct pal_resource_request));
+    if ((names == NULL) || (reqs == NULL)) {
+        perror("calloc");
+        return 1;
+    }
+    for (unsigned i = 0; i < count; i++) {
+        if ((names[i] = malloc(16)) == NULL) {
+            perror("malloc");
+            return 1;
+        }
+        snprintf(names[i], 16, "r%u", i);
+    }
+
+    if (socketpair(AF_LOCAL, SOCK_STREAM, 0, fds)) {
+        perror("socketpair");
+        return 1;
+    }
+    if ((pid = fork()) < 0) {
+        perror("fork");
+        return 1;
+    } else if (pid == 0) {
+        close(fds[0]);
+        responder(fds[1]);
+    }
+    close(fds[1]);
+
+    for (unsigned i = 0; i < BENCH_STARTUP_ITERATIONS; i++) {
+        uint64_t ns;
+
+        ns = run_requests(fds[0], names, count);
+        requests_ns = ns < requests_ns ? ns : requests_ns;
+        ns = run_manifest(fds[0], names, count, reqs);
+        manifest_ns = ns < manifest_ns ? ns : manifest_ns;
+    }
+
+    close(fds[0]);
+    waitpid(pid, &status, 0);
+
+    printf("resources            %u\n", count);
+    printf("request per resource %.1f us (%u round trips)\n",
+        requests_ns / 1000.0, count);
+    printf("single manifest      %.1f us (1 round trip)\n",
+        manifest_ns / 1000.0);
+    printf("speedup              %.1fx\n",
+        (double) requests_ns / manifest_ns);
+
+    for (unsigned i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+    free(reqs);
+    return 0;
+}
@@ -15,7 +15,10 @@ typedef uint32_t pal_env_size_t;
 #define PAL_RESOURCE_REQUEST ((pal_env_type_t)1)
 #define PAL_RESOURCE         ((pal_env_type_t)2)
 #define PAL_REQUEST_FAILED   ((pal_env_type_t)3)
-#define _PAL_NUM_TYPES       (3)
+#define PAL_RESOURCE_MANIFEST     ((pal_env_type_t)4) // More chunks follow
+#define PAL_RESOURCE_MANIFEST_END ((pal_env_type_t)5) // Last manifest chunk
+#define PAL_RESOURCES        ((pal_env_type_t)6)
+#define _PAL_NUM_TYPES       (6)
 // ^ What other message types do we want? Errors?
 
 #define PAL_ERR_SUCCESS (0)
@@ -24,7 +27,8 @@ typedef uint32_t pal_env_size_t;
 #define PAL_ERR_TOOBIG  (3) // Message size exceeds PAL_MSG_MAX
 #define PAL_ERR_FTOOBIG (4) // File descriptor count exceeds PAL_FDS_MAX
 #define PAL_ERR_BADCTRL (5) // Received control message too big
-#define _PAL_ERR_MAX    (6)
+#define PAL_ERR_NORSC   (6) // Launcher could not provide the resource
+#define _PAL_ERR_MAX    (7)
 
 #define PAL_FDS_MAX (32)
 #define PAL_MSG_MAX (8192)
@@ -123,6 +127,56 @@ int pal_send_resource_request(int sock,
 int pal_recv_resource_request(int sock,
         char **typep, char **namep, int flags);
 
+/* Parse a resource request from an envelope received with `pal_recv_env`.
+ * If the call returns successfully, `*type` and `*name` point to memory that
+ * must be deallocated with `free()`.
+ *
+ * Return 0 on success. Return `PAL_ERR_BADREQ` if the resource request
+ * appears to be incorrectly formatted. Otherwise, return a negative `errno`
+ * value. If the call fails, `typep` and `namep` are left unchanged.
+ */
+int pal_parse_resource_request(pal_env_t *env, char **typep, char **namep);
+
+/*
+ * Bulk resource delivery. An application sends its whole resource manifest
+ * as a sequence of `PAL_RESOURCE_MANIFEST` envelopes terminated by a
+ * `PAL_RESOURCE_MANIFEST_END` envelope. Each manifest envelope holds
+ * (type, name) element pairs, and the position of a pair in the manifest
+ * is the index of the resource. The launcher answers with as few
+ * `PAL_RESOURCES` envelopes as fit in `PAL_MSG_MAX` bytes and
+ * `PAL_FDS_MAX` file descriptors, in manifest order. Each resource in a
+ * reply is a `pal_bulk_hdr_t` element followed by `data_count` data
+ * elements. Its `fds_count` file descriptors follow those of the previous
+ * resources in the envelope.
+ */
+
+typedef struct {
+    uint32_t index;      // Position of the resource in the manifest
+    int32_t status;      // 0 or a `PAL_ERR_*` value
+    uint32_t data_count; // Number of data elements that follow
+    uint32_t fds_count;  // Number of file descriptors of the resource
+} pal_bulk_hdr_t;
+
+/* Send a manifest of `count` resources on an existing socket. The `flags`
+ * field is passed directly to `sendmsg`.
+ *
+ * Return 0 on success. Return `PAL_ERR_TOOBIG` if a single (type, name)
+ * pair does not fit in an envelope. Otherwise, return a negative errno
+ * value.
+ */
+int pal_send_resource_manifest(int sock, const char **types,
+        const char **names, size_t count, int flags);
+
+/* Append the resource in `rsc`, which holds the data and file descriptors
+ * of a `PAL_RESOURCE` envelope, to the `PAL_RESOURCES` envelope `env`.
+ *
+ * Return 0 on success. Return `PAL_ERR_TOOBIG` or `PAL_ERR_FTOOBIG` if the
+ * resource does not fit in `env`, in which case `env` is left unchanged.
+ * Otherwise, return a negative errno value.
+ */
+int pal_add_resource_to_env(pal_env_t *env, uint32_t index, int32_t status,
+        pal_env_t *rsc);
+
 /*
  * Helper functions for iterating through the data elements in a
  * `pal_env_t`.
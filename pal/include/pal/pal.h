@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <libpirate.h>
+#include <pal/envelope.h>
 
 
 #ifdef __cplusplus
@@ -93,11 +94,52 @@ int get_file_res(int fd, const char *name, int *outp);
 /* Get a resource of type "gaps_channel" from the application launcher. After
  * a successful return, `outp` points to an
  *
+ * The shared memory of a channel with `managed: true` is passed as a file
+ * descriptor that this function closes, so such a channel must be opened
+ * through the `pirate_channel` resource type instead.
+ *
  * Return 0 on success. Return 1 if the format of the received resource
  * is incorrect. Otherwise, return a negative errno value.
  */
 int get_pirate_channel_cfg(int fd, const char *name, char **outp);
 
+/* Wait on a resource of type "barrier" from the application launcher. The
+ * launcher answers once every enclave in the ids of the barrier is
+ * waiting on it, so that the enclaves can start their main loops together.
+ * A barrier may be waited on again after it is released.
+ *
+ * Return 0 when every enclave has reached the barrier. Return
+ * `PAL_ERR_NORSC` if the barrier does not exist for this enclave or if an
+ * enclave in its ids exited first. Return 1 if the format of the received
+ * resource is incorrect. Otherwise, return a negative errno value.
+ */
+int wait_barrier_res(int fd, const char *name);
+
+/* A resource requested with `get_resources`. The caller fills in `type`
+ * and `name`. On return, `status` is 0 if the launcher provided the
+ * resource and a `PAL_ERR_*` value otherwise, and `env` holds the data and
+ * file descriptors of the resource in the format of a `PAL_RESOURCE`
+ * envelope. `env` must be freed with `pal_free_env`.
+ */
+struct pal_resource_request {
+    const char *type;
+    const char *name;
+    int status;
+    pal_env_t env;
+};
+
+/* Get `count` resources from the application launcher with one manifest
+ * and as few replies as fit in `PAL_MSG_MAX` bytes and `PAL_FDS_MAX` file
+ * descriptors.
+ *
+ * Return 0 if every request received a reply, in which case the status
+ * of each request must be checked. Return a positive `PAL_ERR_*` value if
+ * a reply is incorrectly formatted. Otherwise, return a negative errno
+ * value. On error, the `env` field of every request is freed and its file
+ * descriptors are closed.
+ */
+int get_resources(int fd, struct pal_resource_request *reqs, size_t count);
+
 #ifdef __cplusplus
 }
 #endif
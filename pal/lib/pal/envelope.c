@@ -16,6 +16,7 @@ static const char *errstrs[] = {
     "Message too big",
     "Too many file descriptors",
     "Bad control message",
+    "Resource not available",
 };
 
 _Static_assert(alen(errstrs) == _PAL_ERR_MAX,
@@ -266,16 +267,26 @@ static void *strdupnz(const char *src, size_t size)
 int pal_recv_resource_request(int sock, char **typep, char **namep, int flags)
 {
     pal_env_t env = EMPTY_PAL_ENV(PAL_NO_TYPE);
-    pal_env_iterator_t type_it, name_it, end_it;
-    char *type = NULL, *name = NULL;
     int res = 0;
 
     if((res = pal_recv_env(sock, &env, flags)))
         return res;
 
-    end_it = pal_env_iterator_end(&env);
+    res = pal_parse_resource_request(&env, typep, namep);
 
-    if((type_it = pal_env_iterator_start(&env)) >= end_it)
+    pal_free_env(&env);
+    return res;
+}
+
+int pal_parse_resource_request(pal_env_t *env, char **typep, char **namep)
+{
+    pal_env_iterator_t type_it, name_it, end_it;
+    char *type = NULL, *name = NULL;
+    int res = 0;
+
+    end_it = pal_env_iterator_end(env);
+
+    if((type_it = pal_env_iterator_start(env)) >= end_it)
         res = PAL_ERR_BADREQ; // No resource type present
     else if(!(type = strdupnz(pal_env_iterator_data(type_it),
                               pal_env_iterator_size(type_it))))
@@ -286,7 +297,6 @@ int pal_recv_resource_request(int sock, char **typep, char **namep, int flags)
                               pal_env_iterator_size(name_it))))
         res = -errno;
 
-    pal_free_env(&env);
     if(res) {
         free(type);
         free(name);
@@ -298,6 +308,95 @@ int pal_recv_resource_request(int sock, char **typep, char **namep, int flags)
     return res;
 }
 
+/* Flush a manifest envelope if adding `needed` more bytes would exceed
+ * `PAL_MSG_MAX`.
+ */
+static int flush_manifest(int sock, pal_env_t *env, size_t needed, int flags)
+{
+    int res;
+
+    if(env->size + needed <= PAL_MSG_MAX)
+        return 0;
+    if(env->size == 0)
+        return PAL_ERR_TOOBIG;
+    if((res = pal_send_env(sock, env, flags)))
+        return res;
+
+    env->size = 0;
+    return 0;
+}
+
+int pal_send_resource_manifest(int sock, const char **types,
+        const char **names, size_t count, int flags)
+{
+    int res = 0;
+    size_t i;
+    pal_env_t env = EMPTY_PAL_ENV(PAL_RESOURCE_MANIFEST);
+
+    for(i = 0; i < count && !res; ++i) {
+        size_t type_size = strlen(types[i]), name_size = strlen(names[i]);
+        size_t needed = 2 * sizeof(pal_env_size_t) + type_size + name_size;
+
+        if((res = flush_manifest(sock, &env, needed, flags)))
+            ;
+        else if((res = pal_add_to_env(&env, types[i], type_size)))
+            ;
+        else if((res = pal_add_to_env(&env, names[i], name_size)))
+            ;
+    }
+
+    if(!res) {
+        env.type = PAL_RESOURCE_MANIFEST_END;
+        res = pal_send_env(sock, &env, flags);
+    }
+
+    pal_free_env(&env);
+    return res;
+}
+
+int pal_add_resource_to_env(pal_env_t *env, uint32_t index, int32_t status,
+        pal_env_t *rsc)
+{
+    pal_bulk_hdr_t hdr = {
+        .index = index,
+        .status = status,
+        .data_count = 0,
+        .fds_count = rsc->fds_count,
+    };
+    pal_env_size_t old_size = env->size;
+    pal_env_iterator_t it, end;
+    int res;
+
+    if(env->fds_count + rsc->fds_count > PAL_FDS_MAX)
+        return PAL_ERR_FTOOBIG;
+    if(env->size + sizeof(pal_env_size_t) + sizeof hdr + rsc->size
+            > PAL_MSG_MAX)
+        return PAL_ERR_TOOBIG;
+
+    end = pal_env_iterator_end(rsc);
+    for(it = pal_env_iterator_start(rsc); it < end;
+            it = pal_env_iterator_next(it))
+        ++hdr.data_count;
+
+    if((res = pal_add_to_env(env, &hdr, sizeof hdr))) {
+        env->size = old_size;
+        return res;
+    }
+
+    for(it = pal_env_iterator_start(rsc); it < end;
+            it = pal_env_iterator_next(it))
+        if((res = pal_add_to_env(env, pal_env_iterator_data(it),
+                        pal_env_iterator_size(it)))) {
+            env->size = old_size;
+            return res;
+        }
+
+    memcpy(&env->fds[env->fds_count], rsc->fds, sizeof(int[rsc->fds_count]));
+    env->fds_count += rsc->fds_count;
+
+    return 0;
+}
+
 pal_env_iterator_t pal_env_iterator_start(pal_env_t *env)
 {
     return env->buf;
@@ -6,6 +6,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 /*
  * Application resource getters
@@ -41,219 +43,354 @@ char *lookup_pirate_resource_param(struct pirate_resource *pr,
     return NULL;
 }
 
-int get_boolean_res(int fd, const char *name, bool *outp)
+/* Parse the data or file descriptors of a `PAL_RESOURCE` envelope into
+ * the value of a resource.
+ *
+ * Return 0 on success. Return 1 if the format of the envelope is incorrect.
+ * Otherwise, return a negative errno value.
+ */
+typedef int (*parse_func_t)(pal_env_t *env, void *outp);
+
+static int parse_boolean_env(pal_env_t *env, bool *outp)
 {
-    int res = 0;
-    pal_env_t env = EMPTY_PAL_ENV(PAL_NO_TYPE);
+    pal_env_iterator_t it = pal_env_iterator_start(env);
 
-    if((res = pal_send_resource_request(fd, "boolean", name, 0)))
-        ;
-    else if((res = pal_recv_env(fd, &env, 0)))
-        ;
-    else if(env.type != PAL_RESOURCE)
-        res = 1;
-    else {
-        pal_env_iterator_t it = pal_env_iterator_start(&env);
+    if(it >= pal_env_iterator_end(env))
+        return 1;
+    if(pal_env_iterator_size(it) != sizeof(*outp))
+        return 1;
 
-        if(pal_env_iterator_size(it) != sizeof(*outp))
-            res = 1;
-        else
-            memcpy(outp, pal_env_iterator_data(it), sizeof(*outp));
-    }
+    memcpy(outp, pal_env_iterator_data(it), sizeof(*outp));
+    return 0;
+}
 
-    pal_free_env(&env);
+static int parse_integer_env(pal_env_t *env, int64_t *outp)
+{
+    pal_env_iterator_t it = pal_env_iterator_start(env);
 
-    return res;
+    if(it >= pal_env_iterator_end(env))
+        return 1;
+    if(pal_env_iterator_size(it) != sizeof(*outp))
+        return 1;
+
+    memcpy(outp, pal_env_iterator_data(it), sizeof(*outp));
+    return 0;
 }
 
-int get_integer_res(int fd, const char *name, int64_t *outp)
+static int parse_string_env(pal_env_t *env, char **outp)
 {
-    int res = 0;
-    pal_env_t env = EMPTY_PAL_ENV(PAL_NO_TYPE);
+    pal_env_iterator_t it = pal_env_iterator_start(env);
+    size_t size;
 
-    if((res = pal_send_resource_request(fd, "integer", name, 0)))
-        ;
-    else if((res = pal_recv_env(fd, &env, 0)))
-        ;
-    else if(env.type != PAL_RESOURCE)
-        res = 1;
-    else {
-        pal_env_iterator_t it = pal_env_iterator_start(&env);
+    if(it >= pal_env_iterator_end(env))
+        return 1;
 
-        if(pal_env_iterator_size(it) != sizeof(*outp))
-            res = 1;
-        else
-            memcpy(outp, pal_env_iterator_data(it), sizeof(*outp));
-    }
+    size = pal_env_iterator_size(it);
+    if(!(*outp = malloc(size + 1)))
+        return -errno;
 
-    pal_free_env(&env);
+    memcpy(*outp, pal_env_iterator_data(it), size);
+    (*outp)[size] = '\0';
+    return 0;
+}
 
-    return res;
+static int parse_file_env(pal_env_t *env, int *outp)
+{
+    if(env->fds_count != 1)
+        return 1;
+
+    *outp = env->fds[0];
+    return 0;
 }
 
-int get_string_res(int fd, const char *name, char **outp)
+/* Request a single resource and parse the reply.
+ */
+static int get_res(int fd, const char *type, const char *name,
+        parse_func_t parse, void *outp)
 {
     int res = 0;
-    size_t size;
     pal_env_t env = EMPTY_PAL_ENV(PAL_NO_TYPE);
 
-    if((res = pal_send_resource_request(fd, "string", name, 0)))
+    if((res = pal_send_resource_request(fd, type, name, 0)))
         ;
-    if((res = pal_recv_env(fd, &env, 0)))
+    else if((res = pal_recv_env(fd, &env, 0)))
         ;
     else if(env.type != PAL_RESOURCE)
         res = 1;
-    else {
-        pal_env_iterator_t it = pal_env_iterator_start(&env);
-
-        size = pal_env_iterator_size(it);
-        if(!(*outp = malloc(size + 1)))
-            res = -errno;
-        else {
-            memcpy(*outp, pal_env_iterator_data(it), size);
-            (*outp)[size] = '\0';
-        }
-    }
+    else
+        res = parse(&env, outp);
 
     pal_free_env(&env);
 
     return res;
 }
 
-int get_file_res(int fd, const char *name, int *outp)
+int get_boolean_res(int fd, const char *name, bool *outp)
 {
-    int res = 0;
-    pal_env_t env = EMPTY_PAL_ENV(PAL_NO_TYPE);
+    return get_res(fd, "boolean", name,
+            (parse_func_t)&parse_boolean_env, outp);
+}
 
-    if((res = pal_send_resource_request(fd, "file", name, 0)))
-        ;
-    else if((res = pal_recv_env(fd, &env, 0)))
-        ;
-    else if(env.type != PAL_RESOURCE)
-        res = 1;
-    else if(env.fds_count != 1)
-        res = 1;
-    else
-        *outp = env.fds[0];
+int get_integer_res(int fd, const char *name, int64_t *outp)
+{
+    return get_res(fd, "integer", name,
+            (parse_func_t)&parse_integer_env, outp);
+}
 
-    pal_free_env(&env);
+int get_string_res(int fd, const char *name, char **outp)
+{
+    return get_res(fd, "string", name,
+            (parse_func_t)&parse_string_env, outp);
+}
 
-    return res;
+int get_file_res(int fd, const char *name, int *outp)
+{
+    return get_res(fd, "file", name,
+            (parse_func_t)&parse_file_env, outp);
+}
+
+static int parse_pirate_channel_env(pal_env_t *env, char **outp)
+{
+    pal_close_env_fds(env);
+    return parse_string_env(env, outp);
 }
 
 int get_pirate_channel_cfg(int fd, const char *name, char **outp)
 {
-    int res = 0;
-    size_t size;
-    pal_env_t env = EMPTY_PAL_ENV(PAL_NO_TYPE);
+    return get_res(fd, "pirate_channel", name,
+            (parse_func_t)&parse_pirate_channel_env, outp);
+}
 
-    if((res = pal_send_resource_request(fd, "pirate_channel", name, 0)))
-        ;
-    if((res = pal_recv_env(fd, &env, 0)))
-        ;
-    else if(env.type != PAL_RESOURCE)
-        res = 1;
-    else {
-        pal_env_iterator_t it = pal_env_iterator_start(&env);
-
-        size = pal_env_iterator_size(it);
-        if(!(*outp = malloc(size + 1)))
-            res = -errno;
-        else {
-            memcpy(*outp, pal_env_iterator_data(it), size);
-            (*outp)[size] = '\0';
-        }
-    }
+int wait_barrier_res(int fd, const char *name)
+{
+    bool ready;
+    int res;
 
-    pal_free_env(&env);
+    if((res = get_res(fd, "barrier", name,
+                    (parse_func_t)&parse_boolean_env, &ready)))
+        ;
+    else if(!ready)
+        res = PAL_ERR_NORSC;
 
     return res;
 }
 
-/*
- * Automatic resource initializers
+/* Move the resources of a `PAL_RESOURCES` envelope into `reqs`. The file
+ * descriptors that are moved are set to -1 in `env`.
+ *
+ * Return 0 on success. Return `PAL_ERR_BADREQ` if the envelope is
+ * incorrectly formatted. Otherwise, return a negative errno value.
  */
+static int unpack_resources(pal_env_t *env,
+        struct pal_resource_request *reqs, size_t count, size_t *receivedp)
+{
+    pal_env_iterator_t it = pal_env_iterator_start(env);
+    pal_env_iterator_t end = pal_env_iterator_end(env);
+    size_t i, fd_idx = 0;
+    int res;
+
+    while(it < end) {
+        struct pal_resource_request *req;
+        pal_bulk_hdr_t hdr;
+
+        if(pal_env_iterator_size(it) != sizeof hdr)
+            return PAL_ERR_BADREQ;
+        memcpy(&hdr, pal_env_iterator_data(it), sizeof hdr);
+
+        if(hdr.index != *receivedp || hdr.index >= count)
+            return PAL_ERR_BADREQ; // Replies arrive in manifest order
+        if(hdr.fds_count > env->fds_count - fd_idx)
+            return PAL_ERR_BADREQ;
+
+        req = &reqs[hdr.index];
+        req->status = hdr.status;
+
+        for(i = 0; i < hdr.data_count; ++i) {
+            if((it = pal_env_iterator_next(it)) >= end)
+                return PAL_ERR_BADREQ;
+            if((res = pal_add_to_env(&req->env, pal_env_iterator_data(it),
+                            pal_env_iterator_size(it))))
+                return res;
+        }
 
-typedef int (*get_func_t)(int fd, const char *name, void *datap);
+        for(i = 0; i < hdr.fds_count; ++i, ++fd_idx) {
+            pal_add_fd_to_env(&req->env, env->fds[fd_idx]);
+            env->fds[fd_idx] = -1;
+        }
 
-static void init_resources_common(const char *type, get_func_t get_func,
-        struct pirate_resource *start, struct pirate_resource *stop)
+        ++*receivedp;
+        it = pal_env_iterator_next(it);
+    }
+
+    return 0;
+}
+
+int get_resources(int fd, struct pal_resource_request *reqs, size_t count)
 {
-    int fd;
-    struct pirate_resource *pr;
+    const char **types = NULL, **names = NULL;
+    size_t i, received = 0;
+    int res = 0;
 
-    if(start == stop)
-        return; // No resources present
+    if(count == 0)
+        return 0;
 
-    if((fd = get_pal_fd()) < 0) {
-        fputs("PAL resources declared, but no PAL_FD present in environment. "
-                "Are we running with PAL?\n", stderr);
-        exit(1);
+    for(i = 0; i < count; ++i) {
+        pal_env_t empty = EMPTY_PAL_ENV(PAL_RESOURCE);
+
+        reqs[i].env = empty;
+        reqs[i].status = PAL_ERR_NORSC;
     }
 
-    for(pr = start; pr < stop; ++pr) {
-        int err;
+    if(!(types = calloc(count, sizeof *types))
+            || !(names = calloc(count, sizeof *names)))
+        res = -errno;
+    else {
+        for(i = 0; i < count; ++i) {
+            types[i] = reqs[i].type;
+            names[i] = reqs[i].name;
+        }
+        res = pal_send_resource_manifest(fd, types, names, count, 0);
+    }
 
-        if(!pr || !pr->pr_name || !pr->pr_obj)
-            fprintf(stderr, "Invalid pirate resource section for `%s'\n",
-                    type);
+    free(types);
+    free(names);
 
-        if((err = get_func(fd, pr->pr_name, pr->pr_obj))) {
-            fprintf(stderr, "Fatal error getting %s resource %s: %s\n",
-                    type, pr->pr_name,
-                    err > 0 ? pal_strerror(err) : strerror(-err));
-            exit(1);
-        }
+    while(!res && received < count) {
+        pal_env_t env = EMPTY_PAL_ENV(PAL_NO_TYPE);
+
+        if((res = pal_recv_env(fd, &env, 0)))
+            break;
+
+        if(env.type != PAL_RESOURCES)
+            res = PAL_ERR_BADREQ;
+        else
+            res = unpack_resources(&env, reqs, count, &received);
+
+        pal_close_env_fds(&env);
+        pal_free_env(&env);
     }
-}
 
-extern struct pirate_resource __start_pirate_res_string[];
-extern struct pirate_resource __stop_pirate_res_string[];
+    if(res)
+        for(i = 0; i < count; ++i) {
+            pal_close_env_fds(&reqs[i].env);
+            pal_free_env(&reqs[i].env);
+        }
 
-void __attribute__((constructor)) init_string_resources()
-{
-    init_resources_common("string", (get_func_t)&get_string_res,
-            __start_pirate_res_string, __stop_pirate_res_string);
+    return res;
 }
 
+/*
+ * Automatic resource initializers
+ */
+
+extern struct pirate_resource __start_pirate_res_string[];
+extern struct pirate_resource __stop_pirate_res_string[];
 extern struct pirate_resource __start_pirate_res_integer[];
 extern struct pirate_resource __stop_pirate_res_integer[];
-
-void __attribute__((constructor)) init_integer_resources()
-{
-    init_resources_common("integer", (get_func_t)&get_integer_res,
-            __start_pirate_res_integer, __stop_pirate_res_integer);
-}
-
 extern struct pirate_resource __start_pirate_res_boolean[];
 extern struct pirate_resource __stop_pirate_res_boolean[];
-
-void __attribute__((constructor)) init_boolean_resources()
-{
-    init_resources_common("boolean", (get_func_t)&get_boolean_res,
-            __start_pirate_res_boolean, __stop_pirate_res_boolean);
-}
-
 extern struct pirate_resource __start_pirate_res_file[];
 extern struct pirate_resource __stop_pirate_res_file[];
+extern struct pirate_resource __start_pirate_res_pirate_channel[];
+extern struct pirate_resource __stop_pirate_res_pirate_channel[];
 
-void __attribute__((constructor)) init_file_resources()
+struct resource_section {
+    const char *type;
+    struct pirate_resource *start;
+    struct pirate_resource *stop;
+    parse_func_t parse; // NULL for pirate channels
+};
+
+static const struct resource_section resource_sections[] = {
+    { "string", __start_pirate_res_string, __stop_pirate_res_string,
+        (parse_func_t)&parse_string_env },
+    { "integer", __start_pirate_res_integer, __stop_pirate_res_integer,
+        (parse_func_t)&parse_integer_env },
+    { "boolean", __start_pirate_res_boolean, __stop_pirate_res_boolean,
+        (parse_func_t)&parse_boolean_env },
+    { "file", __start_pirate_res_file, __stop_pirate_res_file,
+        (parse_func_t)&parse_file_env },
+    { "pirate_channel", __start_pirate_res_pirate_channel,
+        __stop_pirate_res_pirate_channel, NULL },
+};
+
+#define RESOURCE_SECTIONS_COUNT \
+    (sizeof(resource_sections) / sizeof(*resource_sections))
+
+static void open_pirate_channel_res(struct pirate_resource *pr,
+        pal_env_t *env)
 {
-    init_resources_common("file", (get_func_t)&get_file_res,
-            __start_pirate_res_file, __stop_pirate_res_file);
-}
+    int err, perms = O_RDWR;
+    char *cfg, *permstr;
 
-extern struct pirate_resource __start_pirate_res_pirate_channel[];
-extern struct pirate_resource __stop_pirate_res_pirate_channel[];
+    if((err = parse_string_env(env, &cfg))) {
+        fprintf(stderr, "Fatal error getting pirate_channel %s: %s\n",
+                pr->pr_name,
+                err > 0 ? pal_strerror(err) : strerror(-err));
+        exit(1);
+    }
+
+    if((permstr = lookup_pirate_resource_param(pr, "permissions"))) {
+        if(!strcmp(permstr, "readonly"))
+            perms = O_RDONLY;
+        else if(!strcmp(permstr, "writeonly"))
+            perms = O_WRONLY;
+    }
+
+    /* A channel created by the launcher comes with the descriptor of its
+     * shared memory, which is opened in place of the path.
+     */
+    if(env->fds_count == 1) {
+        pirate_channel_param_t param;
+
+        if(pirate_parse_channel_param(cfg, &param) < 0
+                || param.channel_type != SHMEM) {
+            fprintf(stderr, "Fatal error parsing pirate_channel %s\n",
+                    pr->pr_name);
+            exit(1);
+        }
+        param.channel.shmem.fd = env->fds[0];
+        *(int *)pr->pr_obj = pirate_open_param(&param, perms);
+        close(env->fds[0]);
+        env->fds[0] = -1;
+    } else
+        *(int *)pr->pr_obj = pirate_open_parse(cfg, perms);
+
+    if(*(int *)pr->pr_obj == -1) {
+        fprintf(stderr, "Fatal error opening pirate_channel %s: %s\n",
+                pr->pr_name, strerror(errno));
+        exit(1);
+    }
 
-void __attribute__((constructor)) init_pirate_channel_resources()
+    free(cfg);
+}
+
+/* Fetch every resource declared in the application with a single manifest
+ * sent to the launcher, so that startup takes a constant number of round
+ * trips regardless of the number of resources.
+ */
+void __attribute__((constructor)) init_pirate_resources()
 {
-    int fd;
-    struct pirate_resource *pr;
-    struct pirate_resource *start = __start_pirate_res_pirate_channel;
-    struct pirate_resource *stop = __stop_pirate_res_pirate_channel;
+    int fd, err;
+    size_t i, count = 0;
+    struct pirate_resource *pr, **prs;
+    const struct resource_section **secs;
+    struct pal_resource_request *reqs;
+    const char *mlock_env;
+
+    /* Memory locks do not survive exec, so an enclave configured with
+     * `mlockall: true` is locked here rather than by the launcher.
+     */
+    if((mlock_env = getenv("PAL_MLOCKALL")) && !strcmp(mlock_env, "1")
+            && mlockall(MCL_CURRENT | MCL_FUTURE)) {
+        fprintf(stderr, "Fatal error locking memory: %s\n", strerror(errno));
+        exit(1);
+    }
 
-    if(start == stop)
+    for(i = 0; i < RESOURCE_SECTIONS_COUNT; ++i)
+        count += resource_sections[i].stop - resource_sections[i].start;
+
+    if(count == 0)
         return; // No resources present
 
     if((fd = get_pal_fd()) < 0) {
@@ -262,34 +399,59 @@ void __attribute__((constructor)) init_pirate_channel_resources()
         exit(1);
     }
 
-    for(pr = start; pr < stop; ++pr) {
-        int err, perms = O_RDWR;
-        char *cfg, *permstr;
-
-        if(!pr || !pr->pr_name || !pr->pr_obj)
-            fputs("Invalid pirate resource section for `pirate_channel'\n",
-                    stderr);
+    reqs = calloc(count, sizeof *reqs);
+    prs = calloc(count, sizeof *prs);
+    secs = calloc(count, sizeof *secs);
+    if(!reqs || !prs || !secs) {
+        fprintf(stderr, "Fatal error getting PAL resources: %s\n",
+                strerror(errno));
+        exit(1);
+    }
 
-        if((err = get_pirate_channel_cfg(fd, pr->pr_name, &cfg))) {
-            fprintf(stderr, "Fatal error getting pirate_channel %s: %s\n",
-                    pr->pr_name,
-                    err > 0 ? pal_strerror(err) : strerror(-err));
-            exit(1);
+    count = 0;
+    for(i = 0; i < RESOURCE_SECTIONS_COUNT; ++i) {
+        const struct resource_section *sec = &resource_sections[i];
+
+        for(pr = sec->start; pr < sec->stop; ++pr) {
+            if(!pr->pr_name || !pr->pr_obj) {
+                fprintf(stderr, "Invalid pirate resource section for `%s'\n",
+                        sec->type);
+                exit(1);
+            }
+
+            reqs[count].type = sec->type;
+            reqs[count].name = pr->pr_name;
+            prs[count] = pr;
+            secs[count] = sec;
+            ++count;
         }
+    }
 
-        if((permstr = lookup_pirate_resource_param(pr, "permissions"))) {
-            if(!strcmp(permstr, "readonly"))
-                perms = O_RDONLY;
-            else if(!strcmp(permstr, "writeonly"))
-                perms = O_WRONLY;
-        }
+    if((err = get_resources(fd, reqs, count))) {
+        fprintf(stderr, "Fatal error getting PAL resources: %s\n",
+                err > 0 ? pal_strerror(err) : strerror(-err));
+        exit(1);
+    }
 
-        if((*(int *)pr->pr_obj = pirate_open_parse(cfg, perms)) < 0) {
-            fprintf(stderr, "Fatal error opening pirate_channel %s: %s\n",
-                    pr->pr_name, strerror(errno));
+    for(i = 0; i < count; ++i) {
+        if((err = reqs[i].status))
+            ;
+        else if(!secs[i]->parse)
+            open_pirate_channel_res(prs[i], &reqs[i].env);
+        else
+            err = secs[i]->parse(&reqs[i].env, prs[i]->pr_obj);
+
+        if(err) {
+            fprintf(stderr, "Fatal error getting %s resource %s: %s\n",
+                    reqs[i].type, reqs[i].name,
+                    err > 0 ? pal_strerror(err) : strerror(-err));
             exit(1);
         }
 
-        free(cfg);
+        pal_free_env(&reqs[i].env);
     }
+
+    free(reqs);
+    free(prs);
+    free(secs);
 }
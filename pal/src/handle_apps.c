@@ -3,6 +3,7 @@
 #include <errno.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/epoll.h>
 #include <sys/socket.h>
@@ -11,67 +12,376 @@
 #include "handle_apps.h"
 #include "handlers.h"
 #include "log.h"
+#include "resource_index.h"
+
+static int add_app(int epfd, struct app *app)
+{
+    struct epoll_event event = {
+        .data = { .ptr = app },
+        .events = EPOLLIN,
+    };
+
+    if(epoll_ctl(epfd, EPOLL_CTL_ADD, app->pipe_fd, &event)) {
+        plog(LOGLVL_INFO, "Failed to add fd for %s to epoll instance: %s",
+                app->name, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
 
 static int make_epfd(struct app *apps, size_t apps_count)
 {
     size_t i;
     int epfd;
 
-    if((epfd = epoll_create(apps_count)) < 0) {
+    if((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
         plog(LOGLVL_INFO, "Failed to create epoll instance: %s",
                 strerror(errno));
         return -1;
     }
 
-    for(i = 0; i < apps_count; ++i) {
-        struct app *app = &apps[i];
-        struct epoll_event event = {
-            .data = { .ptr = app },
-            .events = EPOLLIN,
-        };
-
-        if(epoll_ctl(epfd, EPOLL_CTL_ADD, app->pipe_fd, &event)) {
-            plog(LOGLVL_INFO,
-                    "Failed to add fd for %s to epoll instance: %s",
-                    apps[i].name, strerror(errno));
+    for(i = 0; i < apps_count; ++i)
+        if(add_app(epfd, &apps[i])) {
             close(epfd);
             return -1;
         }
-    }
 
     return epfd;
 }
 
-static struct resource *lookup_resource(char *app_name, char *rsc_name,
-        struct resource *rscs, size_t rscs_count)
+/* Look up the resource named `name` of type `type` requested by `app` and
+ * fill in `env` using the handler for its type.
+ *
+ * Return 0 on success. Otherwise, print an error message and return -1.
+ */
+static int make_resource_env(pal_env_t *env, struct app *app,
+        char *type, char *name, struct resource_index *idx)
+{
+    struct resource *rsc;
+    resource_handler_t *handle;
+
+    if(!(rsc = index_lookup_resource(idx, app->name, name)))
+        error("Received request for unknown resource named %s "
+                "of type %s from %s", name, type, app->name);
+
+    else if(strcmp(rsc->r_type, type))
+        error("Type %s of resource %s requested by %s does not match "
+                "config (%s)", type, name, app->name, rsc->r_type);
+
+    else if(!(handle = index_lookup_handler(idx, type)))
+        error("Received request for resource named %s of unknown type %s "
+                "from %s", name, type, app->name);
+
+    else if(handle(env, app, rsc))
+        error("Handler failed for resource named %s of type %s requested "
+                "by %s", name, type, app->name);
+
+    else
+        return 0;
+
+    return -1;
+}
+
+/* Tell `app` whether the barrier named `name` was released with every
+ * enclave in its ids waiting on it.
+ */
+static void send_barrier(struct app *app, const char *name, bool ready)
+{
+    pal_env_t env = EMPTY_PAL_ENV(PAL_RESOURCE);
+    int err;
+
+    if(app->pipe_fd < 0)
+        ;
+
+    else if(pal_add_to_env(&env, &ready, sizeof ready))
+        error("Failed to create barrier %s for %s", name, app->name);
+
+    else if((err = pal_send_env(app->pipe_fd, &env, 0)))
+        error("Failed to release barrier %s for %s: %s",
+                name, app->name, strerror(-err));
+
+    pal_free_env(&env);
+}
+
+/* Release every enclave waiting on the barrier `rsc`. The barrier can then
+ * be waited on again.
+ */
+static void release_barrier(struct resource *rsc, bool ready)
 {
-    size_t id_size = strlen(app_name) + 1 + strlen(rsc_name) + 1;
-    char id[id_size];
+    struct rsc_contents *c = &rsc->r_contents;
     size_t i;
 
-    snprintf(id, id_size, "%s/%s", app_name, rsc_name);
+    plog(LOGLVL_INFO, "Releasing %lu enclaves from barrier %s%s",
+            c->cc_waiting_count, rsc->r_name, ready ? "" : " (broken)");
 
-    for(i = 0; i < rscs_count; ++i) {
-        size_t j;
-        struct resource *rsc = &rscs[i];
+    for(i = 0; i < c->cc_waiting_count; ++i)
+        send_barrier(c->cc_waiting[i], rsc->r_name, ready);
+    c->cc_waiting_count = 0;
+}
 
-        for(j = 0; j < rsc->r_ids_count; ++j)
-            if(!strcmp(id, rsc->r_ids[j]))
-                return rsc;
+/* Add `app` to the enclaves waiting on the barrier named `name`. The reply
+ * is deferred until every enclave in the ids of the barrier is waiting.
+ */
+static void wait_barrier(struct app *app, const char *name,
+        struct resource_index *idx)
+{
+    struct resource *rsc;
+    struct rsc_contents *c;
+    size_t i;
+
+    if(!(rsc = index_lookup_resource(idx, app->name, name))
+            || strcmp(rsc->r_type, "barrier")) {
+        error("Received wait on unknown barrier named %s from %s",
+                name, app->name);
+        send_barrier(app, name, false);
+        return;
     }
 
-    return NULL;
+    c = &rsc->r_contents;
+    if(c->cc_broken) {
+        send_barrier(app, name, false);
+        return;
+    }
+
+    for(i = 0; i < c->cc_waiting_count; ++i)
+        if(c->cc_waiting[i] == app) {
+            error("Received a second wait on barrier %s from %s",
+                    name, app->name);
+            send_barrier(app, name, false);
+            return;
+        }
+
+    if(!c->cc_waiting && !(c->cc_waiting
+                = calloc(rsc->r_ids_count, sizeof *c->cc_waiting)))
+        fatal("Failed to allocate barrier %s: %s", name, strerror(errno));
+
+    c->cc_waiting[c->cc_waiting_count++] = app;
+    plog(LOGLVL_DEBUG, "%s is waiting on barrier %s (%lu of %lu)",
+            app->name, name, c->cc_waiting_count, rsc->r_ids_count);
+
+    if(c->cc_waiting_count == rsc->r_ids_count)
+        release_barrier(rsc, true);
 }
 
-static resource_handler_t *lookup_handler(const char *type)
+/* Break every barrier that has `app` among its ids, since `app` can no
+ * longer wait on it. The enclaves already waiting are released with a
+ * failure, and so is any later wait.
+ */
+static void break_barriers(struct app *app, struct resource_index *idx)
 {
-    size_t i;
+    struct resource_index_entry *entry, *tmp;
+    size_t len = strlen(app->name);
+
+    HASH_ITER(hh, idx->rscs, entry, tmp) {
+        struct resource *rsc = entry->rsc;
+
+        if(strcmp(rsc->r_type, "barrier") || rsc->r_contents.cc_broken)
+            continue;
+
+        if(strncmp(entry->id, app->name, len) || entry->id[len] != '/')
+            continue;
+
+        rsc->r_contents.cc_broken = true;
+        release_barrier(rsc, false);
+    }
+}
+
+/* Free the waiting lists of the barriers.
+ */
+static void free_barriers(struct resource_index *idx)
+{
+    struct resource_index_entry *entry, *tmp;
+
+    HASH_ITER(hh, idx->rscs, entry, tmp) {
+        free(entry->rsc->r_contents.cc_waiting);
+        entry->rsc->r_contents.cc_waiting = NULL;
+        entry->rsc->r_contents.cc_waiting_count = 0;
+    }
+}
+
+/* Answer a single resource request.
+ */
+static void handle_request(struct app *app, pal_env_t *req,
+        struct resource_index *idx)
+{
+    char *name = NULL, *type = NULL;
+    pal_env_t env = EMPTY_PAL_ENV(PAL_RESOURCE);
+    int err;
+
+    if((err = pal_parse_resource_request(req, &type, &name))) {
+        plog(LOGLVL_INFO, "Encountered an error parsing resource request "
+                "from %s: %s", app->name,
+                err < 0 ? strerror(-err) : pal_strerror(err));
+        return;
+    }
+
+    plog(LOGLVL_INFO, "Received request for resource %s of type %s "
+            "from %s", name, type, app->name);
+
+    if(!strcmp(type, "barrier"))
+        wait_barrier(app, name, idx);
+
+    else if(make_resource_env(&env, app, type, name, idx))
+        ;
+
+    else if((err = pal_send_env(app->pipe_fd, &env, MSG_DONTWAIT)))
+        error("Failed to send resource named %s of type %s to %s: %s",
+                name, type, app->name, strerror(-err));
+
+    else
+        plog(LOGLVL_INFO, "Sent a %lu-byte envelope with %lu fds to %s",
+                env.size, env.fds_count, app->name);
+
+    free(type);
+    free(name);
+    pal_close_env_fds(&env);
+    pal_free_env(&env);
+}
+
+/* Send a `PAL_RESOURCES` envelope and close the file descriptors in it.
+ *
+ * Return 0 on success. Otherwise, print an error message and return -1.
+ */
+static int flush_resources(struct app *app, pal_env_t *env)
+{
+    int err;
+
+    if((err = pal_send_env(app->pipe_fd, env, 0))) {
+        error("Failed to send resources to %s: %s",
+                app->name, strerror(-err));
+        return -1;
+    }
+
+    plog(LOGLVL_DEBUG, "Sent a %lu-byte envelope with %lu fds to %s",
+            env->size, env->fds_count, app->name);
+
+    pal_close_env_fds(env);
+    env->size = 0;
+    env->fds_count = 0;
+
+    return 0;
+}
+
+/* Add a resource to the `PAL_RESOURCES` envelope `env`, sending `env`
+ * first if the resource does not fit. A resource that does not fit in an
+ * empty envelope is answered with an error status.
+ *
+ * Return 0 on success. Otherwise, print an error message and return -1.
+ */
+static int add_resource(struct app *app, pal_env_t *env,
+        uint32_t index, int32_t status, pal_env_t *rsc)
+{
+    pal_env_t empty = EMPTY_PAL_ENV(PAL_RESOURCE);
+    int err;
+
+    err = pal_add_resource_to_env(env, index, status, rsc);
+    if((err == PAL_ERR_TOOBIG || err == PAL_ERR_FTOOBIG)
+            && (env->size > 0 || env->fds_count > 0)) {
+        if(flush_resources(app, env))
+            return -1;
+        err = pal_add_resource_to_env(env, index, status, rsc);
+    }
+
+    if(err == 0)
+        return 0;
+
+    pal_close_env_fds(rsc);
+    if(err < 0 || (err = pal_add_resource_to_env(env, index, err, &empty))) {
+        error("Failed to add resource %u to envelope for %s: %s",
+                index, app->name,
+                err < 0 ? strerror(-err) : pal_strerror(err));
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Answer every resource in the manifest accumulated for `app`, in manifest
+ * order, with as few `PAL_RESOURCES` envelopes as possible.
+ */
+static void handle_manifest(struct app *app, struct resource_index *idx)
+{
+    pal_env_t manifest = EMPTY_PAL_ENV(PAL_RESOURCE_MANIFEST);
+    pal_env_t env = EMPTY_PAL_ENV(PAL_RESOURCES);
+    pal_env_iterator_t type_it, name_it, end_it;
+    uint32_t index = 0;
+    int err = 0;
+
+    manifest.buf = app->manifest;
+    manifest.buf_size = manifest.size = app->manifest_size;
+    end_it = pal_env_iterator_end(&manifest);
+
+    for(type_it = pal_env_iterator_start(&manifest); !err && type_it < end_it;
+            type_it = pal_env_iterator_next(name_it), ++index) {
+        pal_env_t rsc = EMPTY_PAL_ENV(PAL_RESOURCE);
+        char *type, *name;
+        int32_t status = 0;
+
+        if((name_it = pal_env_iterator_next(type_it)) >= end_it) {
+            error("Received incomplete resource manifest from %s",
+                    app->name);
+            break;
+        }
+
+        type = strndup(pal_env_iterator_data(type_it),
+                pal_env_iterator_size(type_it));
+        name = strndup(pal_env_iterator_data(name_it),
+                pal_env_iterator_size(name_it));
+
+        if(!type || !name)
+            fatal("Failed to allocate resource name: %s", strerror(errno));
+
+        plog(LOGLVL_DEBUG, "Received manifest entry for resource %s of "
+                "type %s from %s", name, type, app->name);
+
+        if(make_resource_env(&rsc, app, type, name, idx)) {
+            pal_close_env_fds(&rsc);
+            pal_free_env(&rsc);
+            rsc.fds_count = 0;
+            status = PAL_ERR_NORSC;
+        }
+
+        err = add_resource(app, &env, index, status, &rsc);
+
+        free(type);
+        free(name);
+        pal_free_env(&rsc);
+    }
+
+    if(!err && (env.size > 0 || env.fds_count > 0))
+        err = flush_resources(app, &env);
 
-    for(i = 0; i < HANDLER_TABLE_MAX && handler_table[i].type; ++i)
-        if(!strcmp(type, handler_table[i].type))
-            return handler_table[i].handler;
+    if(!err)
+        plog(LOGLVL_INFO, "Sent %u resources to %s", index, app->name);
 
-    return NULL;
+    pal_close_env_fds(&env);
+    pal_free_env(&env);
+    free(app->manifest);
+    app->manifest = NULL;
+    app->manifest_size = 0;
+}
+
+/* Append a manifest chunk to the manifest accumulated for `app`. Once the
+ * last chunk is received, answer the whole manifest.
+ */
+static void handle_manifest_chunk(struct app *app, pal_env_t *chunk,
+        struct resource_index *idx)
+{
+    size_t size = app->manifest_size + chunk->size;
+    char *manifest;
+
+    if(chunk->size > 0) {
+        if(!(manifest = realloc(app->manifest, size)))
+            fatal("Failed to allocate resource manifest for %s: %s",
+                    app->name, strerror(errno));
+        memcpy(&manifest[app->manifest_size], chunk->buf, chunk->size);
+        app->manifest = manifest;
+        app->manifest_size = size;
+    }
+
+    if(chunk->type == PAL_RESOURCE_MANIFEST_END)
+        handle_manifest(app, idx);
 }
 
 /* Handle an event received from `epoll_wait`. If that event indicates that
@@ -82,11 +392,9 @@ static resource_handler_t *lookup_handler(const char *type)
  * potentially be used. If an empty message is received, indicating the other
  * end has closed the connection, return -1.
  */
-static int handle_event(struct epoll_event *event,
-        struct resource *rscs, size_t rscs_count)
+static int handle_event(struct epoll_event *event, struct resource_index *idx)
 {
     struct app *app = (struct app *)event->data.ptr;
-    resource_handler_t *handle;
 
     plog(LOGLVL_DEBUG, "Received an epoll event from %s", app->name);
 
@@ -99,13 +407,10 @@ static int handle_event(struct epoll_event *event,
         plog(LOGLVL_DEFAULT, "Encountered an error on fd for %s", app->name);
 
     if(event->events & EPOLLIN) {
-        char *name = NULL, *type = NULL;
-        struct resource *rsc;
-        pal_env_t env = EMPTY_PAL_ENV(PAL_RESOURCE);
+        pal_env_t env = EMPTY_PAL_ENV(PAL_NO_TYPE);
         int err;
 
-        err = pal_recv_resource_request(app->pipe_fd, &type, &name,
-                MSG_DONTWAIT);
+        err = pal_recv_env(app->pipe_fd, &env, MSG_DONTWAIT);
         if(err == PAL_ERR_EMPTY) {
             plog(LOGLVL_INFO, "Received connection-terminating empty message "
                     "from %s", app->name);
@@ -117,66 +422,112 @@ static int handle_event(struct epoll_event *event,
             return 0;
         }
 
-        plog(LOGLVL_INFO, "Received request for resource %s of type %s "
-                "from %s", name, type, app->name);
+        switch(env.type) {
+            case PAL_RESOURCE_REQUEST:
+                handle_request(app, &env, idx);
+                break;
+            case PAL_RESOURCE_MANIFEST:
+            case PAL_RESOURCE_MANIFEST_END:
+                handle_manifest_chunk(app, &env, idx);
+                break;
+            default:
+                error("Received envelope of unknown type %u from %s",
+                        env.type, app->name);
+        }
 
-        if(err)
-            error("Encountered an error reading resource request from %s: %s",
-                    app->name, err > 0 ? pal_strerror(err) : strerror(-err));
+        pal_close_env_fds(&env);
+        pal_free_env(&env);
+    }
 
-        else if(!(rsc = lookup_resource(app->name, name, rscs, rscs_count)))
-            error("Received request for unknown resource named %s "
-                    "of type %s from %s", name, type, app->name);
+    return 0;
+}
 
-        else if(strcmp(rsc->r_type, type))
-            error("Type %s of resource %s requested by %s does not match "
-                    "config (%s)", type, name, app->name, rsc->r_type);
+/* Wait up to `timeout` milliseconds for an event and handle it. When an
+ * application closes its pipe, deregister it and decrement `*open_countp`.
+ *
+ * Return 1 if an event was handled and 0 if none arrived in time. Return -1
+ * if `epoll_wait` fails or an application failed to be executed.
+ */
+static int handle_next_event(int epfd, size_t *open_countp,
+        struct resource_index *idx, int timeout)
+{
+    struct epoll_event event;
+    struct app *app;
+    int n;
+
+    if((n = epoll_wait(epfd, &event, 1, timeout)) <= 0)
+        return n;
+
+    if(!handle_event(&event, idx))
+        return 1;
+
+    app = event.data.ptr;
+    if(epoll_ctl(epfd, EPOLL_CTL_DEL, app->pipe_fd, NULL))
+        error("Failed to deregister pipe fd for %s: %s",
+                app->name, strerror(errno));
+    else
+        plog(LOGLVL_DEBUG, "Deregistered pipe fd for %s", app->name);
+    app->pipe_fd = -1;
+    --*open_countp;
+
+    /* An application that fails before it is executed closes its pipe,
+     * at which point the failure is reported.
+     */
+    break_barriers(app, idx);
+    if(launch_status(app))
+        return -1;
 
-        else if(!(handle = lookup_handler(type)))
-            error("Received request for resource named %s of unknown type %s "
-                    "from %s", name, type, app->name);
+    return 1;
+}
 
-        else if(handle(&env, app, rsc))
-            error("Handler failed for resource named %s of type %s requested "
-                    "by %s", name, type, app->name);
+int handle_apps(struct app *apps, size_t apps_count,
+        struct resource_index *idx)
+{
+    int epfd, res = 0;
 
-        else if((err = pal_send_env(app->pipe_fd, &env, MSG_DONTWAIT)))
-            error("Failed to send resource named %s of type %s to %s: %s",
-                    name, type, app->name, strerror(-err));
+    if((epfd = make_epfd(apps, apps_count)) < 0)
+        return -1;
 
-        else
-            plog(LOGLVL_INFO, "Sent a %lu-byte envelope with %lu fds to %s",
-                    env.size, env.fds_count, app->name);
+    while(apps_count && res >= 0)
+        res = handle_next_event(epfd, &apps_count, idx, -1);
 
-        free(type);
-        free(name);
-        pal_free_env(&env);
-    }
+    free_barriers(idx);
+    close(epfd);
 
-    return 0;
+    return res < 0 ? -1 : (int)apps_count;
 }
 
-int handle_apps(struct app *apps, size_t apps_count,
-        struct resource *rscs, size_t rscs_count)
+int launch_apps(struct app *apps, struct enclave *encs, size_t apps_count,
+        char *cfg_path, char **envp, struct resource_index *idx)
 {
-    int epfd;
-    struct epoll_event event;
+    int epfd, res = 0;
+    size_t i, open_count = 0;
 
-    if((epfd = make_epfd(apps, apps_count)) < 0)
+    if((epfd = make_epfd(apps, 0)) < 0)
         return -1;
 
-    while(apps_count && epoll_wait(epfd, &event, 1, -1) != -1)
-        if(handle_event(&event, rscs, rscs_count)) {
-            struct app *app = event.data.ptr;
-
-            if(epoll_ctl(epfd, EPOLL_CTL_DEL, app->pipe_fd, NULL))
-                error("Failed to deregister pipe fd for %s: %s",
-                        app->name, strerror(errno));
-            else
-                plog(LOGLVL_DEBUG, "Deregistered pipe fd for %s", app->name);
-            app->pipe_fd = -1;
-            --apps_count;
+    /* The requests of the enclaves that are already running are answered
+     * between launches, instead of after every enclave has been launched.
+     */
+    for(i = 0; i < apps_count && res >= 0; ++i) {
+        if(launch(&apps[i], cfg_path, &encs[i], envp)) {
+            plog(LOGLVL_INFO, "Launching app %s failed", encs[i].enc_name);
+            res = -1;
+        } else if(add_app(epfd, &apps[i])) {
+            res = -1;
+        } else {
+            plog(LOGLVL_INFO, "Launched app %s", encs[i].enc_name);
+            ++open_count;
+            while((res = handle_next_event(epfd, &open_count, idx, 0)) > 0)
+                ;
         }
+    }
+
+    while(open_count && res >= 0)
+        res = handle_next_event(epfd, &open_count, idx, -1);
+
+    free_barriers(idx);
+    close(epfd);
 
-    return apps_count;
+    return res < 0 ? -1 : (int)open_count;
 }
@@ -2,14 +2,29 @@
 #define _PIRATE_PAL_HANDLE_APPS_H
 
 #include "launch.h"
-#include "yaml.h"
+#include "resource_index.h"
 
 /* Handle messages from applications in a loop. Return when there are no
- * application fds remaining, or on an unrecoverable error.
+ * application fds remaining, or on an unrecoverable error, which includes
+ * an application that failed to be executed.
  *
- * Return the number of application pipe fds remaining.
+ * Resources of type `barrier` are answered once every enclave in their
+ * ids has requested them, so that the enclaves are released together.
+ *
+ * Return the number of application pipe fds remaining, or -1 on error.
  */
 int handle_apps(struct app *apps, size_t apps_count,
-        struct resource *rscs, size_t rscs_count);
+        struct resource_index *idx);
+
+/* Launch `apps_count` enclaves from `encs` into `apps` and handle messages
+ * from them like `handle_apps`. Messages from the enclaves that are already
+ * running are handled between launches. If a launch fails, no more
+ * enclaves are launched and the `pid` of every app that was not launched
+ * is left untouched.
+ *
+ * Return the number of application pipe fds remaining, or -1 on error.
+ */
+int launch_apps(struct app *apps, struct enclave *encs, size_t apps_count,
+        char *cfg_path, char **envp, struct resource_index *idx);
 
 #endif // _PIRATE_PAL_HANDLE_APPS_H
@@ -1,8 +1,11 @@
+#include <errno.h>
 #include <libpirate.h>
 #include <string.h>
 #include <stdint.h>
+#include <unistd.h>
 
 #include "handlers.h"
+#include "log.h"
 
 int cstring_resource_handler(pal_env_t *env,
         const struct app *app, const struct resource *rsc)
@@ -23,6 +26,12 @@ int int64_resource_handler(pal_env_t *env,
 {
     const int64_t *n = rsc->r_contents.cc_integer_value;
 
+    /* The first cpu of the requesting enclave, so that the application can
+     * pin its own threads to the core it was placed on.
+     */
+    if(rsc->r_contents.cc_enclave_cpu)
+        n = app->cpu >= 0 ? &app->cpu : NULL;
+
     if(!n)
         return -1;
 
@@ -64,155 +73,171 @@ int file_resource_handler(pal_env_t *env,
     return 0;
 }
 
-int pirate_channel_resource_handler(pal_env_t *env,
-        const struct app *app, const struct resource *rsc)
+/* Fill in the channel parameters described by a `pirate_channel` resource.
+ */
+static void make_channel_param(const struct resource *rsc,
+        pirate_channel_param_t *params)
 {
-    pirate_channel_param_t params = {0};
-
-    params.channel_type = rsc->r_contents.cc_channel_type;
-    switch(params.channel_type) {
+    memset(params, 0, sizeof(*params));
+    params->channel_type = rsc->r_contents.cc_channel_type;
+    switch(params->channel_type) {
         case DEVICE:
             if(rsc->r_contents.cc_path)
-                strncpy(params.channel.device.path,
+                strncpy(params->channel.device.path,
                         rsc->r_contents.cc_path, PIRATE_LEN_NAME);
-            params.channel.device.min_tx
+            params->channel.device.min_tx
                     = rsc->r_contents.cc_min_tx_size;
-            params.channel.device.mtu
+            params->channel.device.mtu
                     = rsc->r_contents.cc_mtu;
             break;
         case PIPE:
             if(rsc->r_contents.cc_path)
-                strncpy(params.channel.pipe.path,
+                strncpy(params->channel.pipe.path,
                         rsc->r_contents.cc_path, PIRATE_LEN_NAME);
-            params.channel.pipe.min_tx
+            params->channel.pipe.min_tx
                     = rsc->r_contents.cc_min_tx_size;
-            params.channel.pipe.mtu
+            params->channel.pipe.mtu
                     = rsc->r_contents.cc_mtu;
             break;
         case UNIX_SOCKET:
             if(rsc->r_contents.cc_path)
-                strncpy(params.channel.unix_socket.path,
+                strncpy(params->channel.unix_socket.path,
                         rsc->r_contents.cc_path, PIRATE_LEN_NAME);
-            params.channel.unix_socket.min_tx
+            params->channel.unix_socket.min_tx
                     = rsc->r_contents.cc_min_tx_size;
-            params.channel.unix_socket.mtu
+            params->channel.unix_socket.mtu
                     = rsc->r_contents.cc_mtu;
-            params.channel.unix_socket.buffer_size
+            params->channel.unix_socket.buffer_size
                     = rsc->r_contents.cc_buffer_size;
             break;
         case TCP_SOCKET:
             if(rsc->r_contents.cc_reader_host)
-                strncpy(params.channel.tcp_socket.reader_addr,
+                strncpy(params->channel.tcp_socket.reader_addr,
                         rsc->r_contents.cc_reader_host, INET_ADDRSTRLEN);
             if(rsc->r_contents.cc_writer_host)
-                strncpy(params.channel.tcp_socket.writer_addr,
+                strncpy(params->channel.tcp_socket.writer_addr,
                         rsc->r_contents.cc_writer_host, INET_ADDRSTRLEN);
-            params.channel.tcp_socket.reader_port
+            params->channel.tcp_socket.reader_port
                     = rsc->r_contents.cc_reader_port;
-            params.channel.tcp_socket.writer_port
+            params->channel.tcp_socket.writer_port
                     = rsc->r_contents.cc_writer_port;
-            params.channel.tcp_socket.min_tx
+            params->channel.tcp_socket.min_tx
                     = rsc->r_contents.cc_min_tx_size;
-            params.channel.tcp_socket.mtu
+            params->channel.tcp_socket.mtu
                     = rsc->r_contents.cc_mtu;
-            params.channel.tcp_socket.buffer_size
+            params->channel.tcp_socket.buffer_size
                     = rsc->r_contents.cc_buffer_size;
             break;
         case UDP_SOCKET:
             if(rsc->r_contents.cc_reader_host)
-                strncpy(params.channel.udp_socket.reader_addr,
+                strncpy(params->channel.udp_socket.reader_addr,
                         rsc->r_contents.cc_reader_host, INET_ADDRSTRLEN);
             if(rsc->r_contents.cc_writer_host)
-                strncpy(params.channel.udp_socket.writer_addr,
+                strncpy(params->channel.udp_socket.writer_addr,
                         rsc->r_contents.cc_writer_host, INET_ADDRSTRLEN);
-            params.channel.udp_socket.reader_port
+            params->channel.udp_socket.reader_port
                     = rsc->r_contents.cc_reader_port;
-            params.channel.udp_socket.writer_port
+            params->channel.udp_socket.writer_port
                     = rsc->r_contents.cc_writer_port;
-            params.channel.udp_socket.mtu
+            params->channel.udp_socket.mtu
                     = rsc->r_contents.cc_mtu;
-            params.channel.udp_socket.buffer_size
+            params->channel.udp_socket.buffer_size
                     = rsc->r_contents.cc_buffer_size;
             break;
         case SHMEM:
-            strncpy(params.channel.shmem.path,
-                    rsc->r_contents.cc_path, PIRATE_LEN_NAME);
-            params.channel.shmem.mtu
+            /* The path of a managed channel only names the channel
+             */
+            if(rsc->r_contents.cc_path)
+                strncpy(params->channel.shmem.path,
+                        rsc->r_contents.cc_path, PIRATE_LEN_NAME);
+            else if(rsc->r_contents.cc_managed)
+                strncpy(params->channel.shmem.path,
+                        rsc->r_name, PIRATE_LEN_NAME);
+            params->channel.shmem.mtu
                     = rsc->r_contents.cc_mtu;
-            params.channel.shmem.max_tx
+            params->channel.shmem.max_tx
                     = rsc->r_contents.cc_max_tx_size;
-            params.channel.shmem.buffer_size
+            params->channel.shmem.buffer_size
                     = rsc->r_contents.cc_buffer_size;
             break;
         case UDP_SHMEM:
             if(rsc->r_contents.cc_path)
-                strncpy(params.channel.udp_shmem.path,
+                strncpy(params->channel.udp_shmem.path,
                         rsc->r_contents.cc_path, PIRATE_LEN_NAME);
-            params.channel.shmem.mtu
+            params->channel.shmem.mtu
                     = rsc->r_contents.cc_mtu;
-            params.channel.udp_shmem.buffer_size
+            params->channel.udp_shmem.buffer_size
                     = rsc->r_contents.cc_buffer_size;
-            params.channel.udp_shmem.packet_size
+            params->channel.udp_shmem.packet_size
                     = rsc->r_contents.cc_packet_size;
-            params.channel.udp_shmem.packet_count
+            params->channel.udp_shmem.packet_count
                     = rsc->r_contents.cc_packet_count;
             break;
         case UIO_DEVICE:
             if(rsc->r_contents.cc_path)
-                strncpy(params.channel.uio.path,
+                strncpy(params->channel.uio.path,
                         rsc->r_contents.cc_path, PIRATE_LEN_NAME);
-            params.channel.uio.mtu
+            params->channel.uio.mtu
                     = rsc->r_contents.cc_mtu;
-            params.channel.uio.max_tx
+            params->channel.uio.max_tx
                     = rsc->r_contents.cc_max_tx_size;
-            params.channel.uio.region
+            params->channel.uio.region
                     = rsc->r_contents.cc_region;
             break;
         case SERIAL:
             if(rsc->r_contents.cc_path)
-                strncpy(params.channel.serial.path,
+                strncpy(params->channel.serial.path,
                         rsc->r_contents.cc_path, PIRATE_LEN_NAME);
-            params.channel.serial.mtu
+            params->channel.serial.mtu
                     = rsc->r_contents.cc_mtu;
-            params.channel.serial.max_tx
+            params->channel.serial.max_tx
                     = rsc->r_contents.cc_max_tx_size;
-            params.channel.serial.baud
+            params->channel.serial.baud
                     = rsc->r_contents.cc_baud;
             break;
         case MERCURY:
-            params.channel.mercury.mtu
+            params->channel.mercury.mtu
                     = rsc->r_contents.cc_mtu;
-            params.channel.mercury.mode
+            params->channel.mercury.mode
                     = rsc->r_contents.cc_session->mode;
-            params.channel.mercury.session_id
+            params->channel.mercury.session_id
                     = rsc->r_contents.cc_session->session_id;
-            params.channel.mercury.message_id
+            params->channel.mercury.message_id
                     = rsc->r_contents.cc_session->message_id;
-            params.channel.mercury.data_tag
+            params->channel.mercury.data_tag
                     = rsc->r_contents.cc_session->data_tag;
-            params.channel.mercury.descriptor_tag
+            params->channel.mercury.descriptor_tag
                     = rsc->r_contents.cc_session->descriptor_tag;
             break;
         case GE_ETH:
             if(rsc->r_contents.cc_reader_host)
-                strncpy(params.channel.ge_eth.reader_addr,
+                strncpy(params->channel.ge_eth.reader_addr,
                         rsc->r_contents.cc_reader_host, INET_ADDRSTRLEN);
             if(rsc->r_contents.cc_writer_host)
-                strncpy(params.channel.ge_eth.writer_addr,
+                strncpy(params->channel.ge_eth.writer_addr,
                         rsc->r_contents.cc_writer_host, INET_ADDRSTRLEN);
-            params.channel.ge_eth.mtu
+            params->channel.ge_eth.mtu
                     = rsc->r_contents.cc_mtu;
-            params.channel.ge_eth.reader_port
+            params->channel.ge_eth.reader_port
                     = rsc->r_contents.cc_reader_port;
-            params.channel.ge_eth.writer_port
+            params->channel.ge_eth.writer_port
                     = rsc->r_contents.cc_writer_port;
-            params.channel.ge_eth.message_id
+            params->channel.ge_eth.message_id
                     = rsc->r_contents.cc_message_id;
             break;
         default:
             fatal("Pirate channel %s has unknown channel type: %d",
-                    rsc->r_name, params.channel_type);
+                    rsc->r_name, params->channel_type);
     }
+}
+
+int pirate_channel_resource_handler(pal_env_t *env,
+        const struct app *app, const struct resource *rsc)
+{
+    pirate_channel_param_t params;
+    int fd;
+
+    make_channel_param(rsc, &params);
 
     size_t pstr_len = pirate_unparse_channel_param(&params, NULL, 0);
     if(pstr_len <= 0)
@@ -225,9 +250,64 @@ int pirate_channel_resource_handler(pal_env_t *env,
     if(pal_add_to_env(env, pstr, pstr_len))
         return -1;
 
+    /* Each end gets its own descriptor of a region created by
+     * `create_managed_channels`.
+     */
+    if(rsc->r_contents.cc_managed) {
+        if((fd = dup(rsc->r_contents.cc_fd)) < 0)
+            return -1;
+        if(pal_add_fd_to_env(env, fd)) {
+            close(fd);
+            return -1;
+        }
+    }
+
     return 0;
 }
 
+int create_managed_channels(struct resource *rscs, size_t rscs_count)
+{
+    pirate_channel_param_t params;
+    size_t i;
+
+    for(i = 0; i < rscs_count; ++i) {
+        struct resource *rsc = &rscs[i];
+
+        if(strcmp(rsc->r_type, "pirate_channel")
+                || !rsc->r_contents.cc_managed)
+            continue;
+
+        if(rsc->r_contents.cc_channel_type != SHMEM) {
+            error("Pirate channel %s is managed but is not a shmem channel",
+                    rsc->r_name);
+            return -1;
+        }
+
+        make_channel_param(rsc, &params);
+        if((rsc->r_contents.cc_fd = pirate_shmem_create(&params)) < 0) {
+            error("Failed to create shared memory for pirate channel %s: %s",
+                    rsc->r_name, strerror(errno));
+            return -1;
+        }
+
+        plog(LOGLVL_DEBUG, "Created shared memory for pirate channel %s",
+                rsc->r_name);
+    }
+
+    return 0;
+}
+
+void close_managed_channels(struct resource *rscs, size_t rscs_count)
+{
+    size_t i;
+
+    for(i = 0; i < rscs_count; ++i)
+        if(rscs[i].r_contents.cc_managed && rscs[i].r_contents.cc_fd > 0) {
+            close(rscs[i].r_contents.cc_fd);
+            rscs[i].r_contents.cc_fd = 0;
+        }
+}
+
 struct handler_table_entry handler_table[HANDLER_TABLE_MAX] = {
     { "boolean",        &bool_resource_handler },
     { "file",           &file_resource_handler },
@@ -28,4 +28,17 @@ struct handler_table_entry {
 
 extern struct handler_table_entry handler_table[HANDLER_TABLE_MAX];
 
+/* Create the shared memory of every `pirate_channel` resource with
+ * `managed: true` before the applications are launched. The launcher
+ * keeps the shared memory open so that an application that is restarted
+ * reattaches to the same ring buffer.
+ *
+ * Return 0 on success. Otherwise, print an error message and return -1.
+ */
+int create_managed_channels(struct resource *rscs, size_t rscs_count);
+
+/* Close the shared memory created by `create_managed_channels`.
+ */
+void close_managed_channels(struct resource *rscs, size_t rscs_count);
+
 #endif // _PIRATE_PAL_HANDLERS_H
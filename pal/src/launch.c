@@ -1,10 +1,16 @@
+#define _GNU_SOURCE
 #include <errno.h>
 #include <fcntl.h>
-#include <spawn.h>
+#include <limits.h>
+#include <linux/mempolicy.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "launch.h"
@@ -12,6 +18,10 @@
 #define PARENT_END (0)
 #define CHILD_END (1)
 
+/* Size of the node mask passed to set_mempolicy()
+ */
+#define MAX_NUMA_NODES (1024)
+
 // TODO: Make things const when possible
 
 /* Make the path to the executable for exec:
@@ -49,27 +59,29 @@ static size_t count_envp(char **envp)
 }
 
 /* Set up an environment vector for the launched executable, containing
- * `env_count` strings from `env`, `old_envp_count` strings from
- * `old_envp`, and a final NULL terminator.
+ * `pal_env_count` strings from `pal_env`, `env_count` strings from `env`,
+ * `old_envp_count` strings from `old_envp`, and a final NULL terminator.
  *
  * The `new_envp` vector should contain space for at least
- * `env_count + old_envp_count + 2` strings.
+ * `pal_env_count + env_count + old_envp_count + 1` strings.
  */
-static void make_envp(char **new_envp, char *pal_fd_env,
+static void make_envp(char **new_envp,
+        char **pal_env, size_t pal_env_count,
         char **env, size_t env_count,
         char **old_envp, size_t old_envp_count)
 {
     size_t i;
 
-    new_envp[0] = pal_fd_env;
+    for(i = 0; i < pal_env_count; ++i)
+        *new_envp++ = pal_env[i];
 
     for(i = 0; i < env_count; ++i)
-        new_envp[i + 1] = env[i];
+        *new_envp++ = env[i];
 
     for(i = 0; i < old_envp_count; ++i)
-        new_envp[i + env_count + 1] = old_envp[i];
+        *new_envp++ = old_envp[i];
 
-    new_envp[env_count + old_envp_count + 1] = NULL;
+    *new_envp = NULL;
 }
 
 /* Set up an argument vector for the launched executable and put in
@@ -106,19 +118,129 @@ static int set_cloexec(int fd)
     return 0;
 }
 
+/* Apply the cpu affinity, NUMA memory policy, nice value, and scheduling
+ * policy in `enc` to the calling process. All of them are kept across exec.
+ *
+ * Return 0 on success. Otherwise, return -1, leave `errno` set, and point
+ * `*opp` to the name of the operation that failed.
+ */
+static int apply_controls(struct enclave *enc, const char **opp)
+{
+    size_t i;
+
+    if(enc->enc_cpus_count > 0) {
+        cpu_set_t cpus;
+
+        *opp = "set cpu affinity";
+        CPU_ZERO(&cpus);
+        for(i = 0; i < enc->enc_cpus_count; ++i) {
+            if(enc->enc_cpus[i] >= CPU_SETSIZE) {
+                errno = EINVAL;
+                return -1;
+            }
+            CPU_SET(enc->enc_cpus[i], &cpus);
+        }
+        if(sched_setaffinity(0, sizeof cpus, &cpus))
+            return -1;
+    }
+
+    if(enc->enc_numa_node) {
+        const size_t bits = sizeof(unsigned long) * CHAR_BIT;
+        unsigned long nodemask[MAX_NUMA_NODES
+            / (sizeof(unsigned long) * CHAR_BIT)];
+        uint32_t node = *enc->enc_numa_node;
+
+        *opp = "set NUMA memory policy";
+        if(node >= MAX_NUMA_NODES) {
+            errno = EINVAL;
+            return -1;
+        }
+        memset(nodemask, 0, sizeof nodemask);
+        nodemask[node / bits] = 1ul << (node % bits);
+        // A kernel built without NUMA support has only node 0
+        if(syscall(SYS_set_mempolicy, MPOL_BIND, nodemask, MAX_NUMA_NODES + 1)
+                && !(errno == ENOSYS && node == 0))
+            return -1;
+    }
+
+    if(enc->enc_nice) {
+        *opp = "set nice value";
+        if(setpriority(PRIO_PROCESS, 0, *enc->enc_nice))
+            return -1;
+    }
+
+    if(enc->enc_sched != ENC_SCHED_OTHER) {
+        int policy = enc->enc_sched == ENC_SCHED_FIFO ? SCHED_FIFO : SCHED_RR;
+        struct sched_param sp;
+
+        *opp = "set scheduling policy";
+        sp.sched_priority = enc->enc_priority ? (int)*enc->enc_priority
+            : sched_get_priority_min(policy);
+        if(sched_setscheduler(0, policy, &sp))
+            return -1;
+    }
+
+    /* Memory locks are dropped on exec and are taken by libpal instead.
+     * Raising the limit requires CAP_SYS_RESOURCE. Without it, the enclave
+     * is held to the limit inherited from pal.
+     */
+    if(enc->enc_mlockall) {
+        struct rlimit rl = { RLIM_INFINITY, RLIM_INFINITY };
+
+        setrlimit(RLIMIT_MEMLOCK, &rl);
+    }
+
+    return 0;
+}
+
+/* An error in the child before the enclave is executed, reported over a
+ * pipe that is closed by a successful exec.
+ */
+struct child_error {
+    char op[64];
+    int err;
+};
+
+/* Set up the child and execute the enclave. Never returns. This runs in
+ * the child of `vfork`, so it only makes system calls and writes to its
+ * own stack frame.
+ */
+static void exec_child(int err_fd, struct enclave *enc,
+        char *path, char **argv, char **envp)
+{
+    struct child_error ce = {{0}, 0};
+    const char *op = "change directory";
+
+    if(enc->enc_directory && chdir(enc->enc_directory))
+        ;
+    else if(apply_controls(enc, &op))
+        ;
+    else {
+        op = "execute enclave";
+        execve(path, argv, envp);
+    }
+
+    ce.err = errno;
+    strncpy(ce.op, op, sizeof ce.op - 1);
+    (void)!write(err_fd, &ce, sizeof ce);
+    _exit(127);
+}
+
 #define PERROR(_op) error("Failed to %s: %s", _op, strerror(errno))
 
 int launch(struct app *app, char *cfg_path,
         struct enclave *enc, char **envp)
 {
-    int fds[2];
+    int fds[2], err_fds[2];
     size_t envp_count = count_envp(envp);
     char *enc_path = enc->enc_path ? enc->enc_path : enc->enc_name;
     char *new_argv[1 /*progname*/ + enc->enc_args_count + 1 /*NULL*/];
-    char *new_envp[1 /*PAL_FD*/ + enc->enc_env_count + envp_count + 1 /*NULL*/];
+    char *pal_env[2 /*PAL_FD, PAL_MLOCKALL*/];
+    size_t pal_env_count = 0;
+    char *new_envp[2 /*pal_env*/ + enc->enc_env_count + envp_count + 1 /*NULL*/];
     char path[strlen(cfg_path) + strlen(enc_path) + 1 /*\0*/];
     char pal_fd_env[32]; // Large enough for "PAL_FD=XXXX"
-    int cwd = -1;
+    char pal_mlockall_env[] = "PAL_MLOCKALL=1";
 
     // Open pipe to child
     if(socketpair(AF_LOCAL, SOCK_STREAM, 0, fds)) {
@@ -127,35 +249,80 @@ int launch(struct app *app, char *cfg_path,
     }
     app->pipe_fd = fds[PARENT_END];
     app->hangup = false;
+    app->manifest = NULL;
+    app->manifest_size = 0;
+    app->cpu = enc->enc_cpus_count > 0 ? (int64_t)enc->enc_cpus[0] : -1;
+    app->launch_fd = -1;
+    app->launch_failed = false;
     snprintf(pal_fd_env, sizeof pal_fd_env, "PAL_FD=%d", fds[CHILD_END]);
+    pal_env[pal_env_count++] = pal_fd_env;
+    if(enc->enc_mlockall)
+        pal_env[pal_env_count++] = pal_mlockall_env;
 
     // Set up path, argument vector, and environment vector for app
     make_path(path, sizeof path, cfg_path, enc_path);
     make_argv(new_argv, path, enc->enc_args, enc->enc_args_count);
-    make_envp(new_envp, pal_fd_env,
+    make_envp(new_envp, pal_env, pal_env_count,
             enc->enc_env, enc->enc_env_count,
             envp, envp_count);
     app->name = enc->enc_name;
 
-    if (enc->enc_directory) {
-        cwd = open(".", O_RDONLY | O_CLOEXEC);
-        if (cwd < 0)
-            PERROR("open current directory");
-        if (chdir(enc->enc_directory))
-            PERROR("change directory");
+    if(set_cloexec(fds[PARENT_END])) {
+        PERROR("set FD_CLOEXEC on pipe");
+        close(fds[CHILD_END]);
+        return -1;
     }
 
-    if(set_cloexec(fds[PARENT_END]))
-        PERROR("set FD_CLOEXEC on pipe");
-    else if(posix_spawn(&app->pid, path, NULL, NULL, new_argv, new_envp))
-        PERROR("spawn process");
+    if(pipe2(err_fds, O_CLOEXEC)) {
+        PERROR("create error pipe");
+        close(fds[CHILD_END]);
+        return -1;
+    }
+
+    /* The parent is suspended until the child executes the enclave or
+     * exits, which is cheaper than copying the address space of pal.
+     */
+    if((app->pid = vfork()) < 0) {
+        PERROR("fork process");
+        app->pid = 0;
+    } else if(app->pid == 0) {
+        close(err_fds[PARENT_END]);
+        exec_child(err_fds[CHILD_END], enc, path, new_argv, new_envp);
+    }
 
     close(fds[CHILD_END]);
-    if (cwd >= 0) {
-        if (fchdir(cwd))
-            PERROR("revert directory");
-        if (close(cwd))
-            PERROR("close current directory");
+    close(err_fds[CHILD_END]);
+    if(!app->pid) {
+        close(err_fds[PARENT_END]);
+        return -1;
+    }
+
+    app->launch_fd = err_fds[PARENT_END];
+
+    return 0;
+}
+
+int launch_status(struct app *app)
+{
+    struct child_error ce;
+    ssize_t len;
+
+    if(app->launch_fd < 0)
+        return app->launch_failed ? -1 : 0;
+
+    // The pipe is closed without data once the enclave is executed
+    while((len = read(app->launch_fd, &ce, sizeof ce)) < 0 && errno == EINTR)
+        ;
+    close(app->launch_fd);
+    app->launch_fd = -1;
+
+    if(len == sizeof ce) {
+        error("Failed to %s for %s: %s", ce.op, app->name, strerror(ce.err));
+        waitpid(app->pid, NULL, 0);
+        app->pid = 0;
+        app->launch_failed = true;
+        return -1;
     }
+
     return 0;
 }
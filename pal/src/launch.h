@@ -2,6 +2,7 @@
 #define _PIRATE_PAL_LAUNCH_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 #include "yaml.h"
@@ -11,6 +12,11 @@ struct app {
     int pipe_fd;
     bool hangup;
     pid_t pid;
+    char *manifest;       // Resource manifest received so far
+    size_t manifest_size;
+    int64_t cpu;          // First cpu of the enclave or -1
+    int launch_fd;        // Reports a failure before the enclave is executed
+    bool launch_failed;
 };
 
 /* Launch and enclave and save information about it in `app`.
@@ -21,8 +27,25 @@ struct app {
  * Environment variables are inherited from envp, with any additional variables
  * in `enc` prepended to the front.
  *
+ * The cpu affinity, scheduling policy, nice value, and NUMA memory policy in
+ * `enc` are applied in the child before it executes the enclave. Memory
+ * locks do not survive exec, so `mlockall` is passed to the enclave as
+ * `PAL_MLOCKALL=1` and applied by libpal when the enclave starts.
+ *
+ * The outcome of the exec is not read here. It is collected later with
+ * `launch_status`, so that pal can answer the requests of the enclaves
+ * that are already running while the others are launched.
+ *
  * Return 0 on success. On error, return -1 and print an error message.
  */
 int launch(struct app *app, char *cfg_path, struct enclave *enc, char **envp);
 
+/* Wait until the enclave launched in `app` has been executed or the child
+ * process has failed before executing it.
+ *
+ * Return 0 if the enclave was executed. On error, return -1 and print an
+ * error message.
+ */
+int launch_status(struct app *app);
+
 #endif // _PIRATE_PAL_LAUNCH_H
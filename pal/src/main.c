@@ -1,6 +1,7 @@
 #include <errno.h>
 #include <signal.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
@@ -8,6 +9,7 @@
 #include "log.h"
 #include "launch.h"
 #include "handle_apps.h"
+#include "handlers.h"
 
 void kill_apps(struct app *apps, size_t apps_count)
 {
@@ -22,8 +24,8 @@ int main(int argc, char **argv, char **envp)
 {
     char *cfg_path;
     struct top_level *tlp;
+    struct resource_index idx;
     int err = 0;
-    size_t i;
 
     if(argc != 2)
         fatal("Usage: %s path/to/config.yaml", argv[0]);
@@ -36,22 +38,20 @@ int main(int argc, char **argv, char **envp)
 
     plog(LOGLVL_DEBUG, "Read configuration from `%s'", cfg_path);
 
+    if(build_resource_index(&idx, tlp->tl_rscs, tlp->tl_rscs_count))
+        fatal("Failed to index resources");
+
+    if(create_managed_channels(tlp->tl_rscs, tlp->tl_rscs_count))
+        fatal("Failed to create managed pirate channels");
+
     size_t apps_count = tlp->tl_encs_count;
     struct app apps[apps_count];
-    for(i = 0; i < apps_count; ++i) {
-        if(launch(&apps[i], cfg_path, &tlp->tl_encs[i], envp)) {
-            plog(LOGLVL_INFO, "Launching app %s failed",
-                    tlp->tl_encs[i].enc_name);
-
-            apps[i].pid = 0;
-            err = -1;
-        }
-        plog(LOGLVL_INFO, "Launched app %s", tlp->tl_encs[i].enc_name);
-    }
+    memset(apps, 0, sizeof apps);
 
-    if(err || handle_apps(apps, apps_count,
-                tlp->tl_rscs, tlp->tl_rscs_count) < 0)
+    if(launch_apps(apps, tlp->tl_encs, apps_count, cfg_path, envp, &idx) < 0) {
         error("Failed to start app handler");
+        err = -1;
+    }
 
     plog(LOGLVL_INFO, "Killing apps...");
     kill_apps(apps, apps_count);
@@ -60,6 +60,8 @@ int main(int argc, char **argv, char **envp)
     while(errno != ECHILD)
         wait(NULL);
 
+    close_managed_channels(tlp->tl_rscs, tlp->tl_rscs_count);
+    free_resource_index(&idx);
     free_yaml(tlp);
 
     return -err;
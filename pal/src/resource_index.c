@@ -0,0 +1,132 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "resource_index.h"
+
+static int add_resource(struct resource_index *idx,
+        const char *id, struct resource *rsc)
+{
+    struct resource_index_entry *entry;
+    size_t id_len = strlen(id);
+
+    HASH_FIND(hh, idx->rscs, id, id_len, entry);
+    if(entry) {
+        warn("Resource id %s is used by %s and %s. Using %s",
+                id, entry->rsc->r_name, rsc->r_name, entry->rsc->r_name);
+        return 0;
+    }
+
+    if(!(entry = malloc(sizeof *entry))) {
+        error("Failed to allocate index entry for %s: %s",
+                id, strerror(errno));
+        return -1;
+    }
+
+    entry->id = id;
+    entry->rsc = rsc;
+    HASH_ADD_KEYPTR(hh, idx->rscs, entry->id, id_len, entry);
+
+    if(id_len > idx->id_max)
+        idx->id_max = id_len;
+
+    return 0;
+}
+
+static int add_handler(struct resource_index *idx,
+        const char *type, resource_handler_t *handler)
+{
+    struct handler_index_entry *entry;
+
+    HASH_FIND_STR(idx->handlers, type, entry);
+    if(entry)
+        return 0; // The first entry in the table wins
+
+    if(!(entry = malloc(sizeof *entry))) {
+        error("Failed to allocate index entry for %s: %s",
+                type, strerror(errno));
+        return -1;
+    }
+
+    entry->type = type;
+    entry->handler = handler;
+    HASH_ADD_KEYPTR(hh, idx->handlers, entry->type, strlen(type), entry);
+
+    return 0;
+}
+
+int build_resource_index(struct resource_index *idx,
+        struct resource *rscs, size_t rscs_count)
+{
+    size_t i, j;
+
+    idx->rscs = NULL;
+    idx->handlers = NULL;
+    idx->id_max = 0;
+
+    for(i = 0; i < rscs_count; ++i)
+        for(j = 0; j < rscs[i].r_ids_count; ++j)
+            if(add_resource(idx, rscs[i].r_ids[j], &rscs[i])) {
+                free_resource_index(idx);
+                return -1;
+            }
+
+    for(i = 0; i < HANDLER_TABLE_MAX && handler_table[i].type; ++i)
+        if(add_handler(idx, handler_table[i].type,
+                    handler_table[i].handler)) {
+            free_resource_index(idx);
+            return -1;
+        }
+
+    plog(LOGLVL_DEBUG, "Indexed %u resource ids and %u resource types",
+            HASH_COUNT(idx->rscs), HASH_COUNT(idx->handlers));
+
+    return 0;
+}
+
+void free_resource_index(struct resource_index *idx)
+{
+    struct resource_index_entry *rsc, *rsc_tmp;
+    struct handler_index_entry *handler, *handler_tmp;
+
+    HASH_ITER(hh, idx->rscs, rsc, rsc_tmp) {
+        HASH_DEL(idx->rscs, rsc);
+        free(rsc);
+    }
+
+    HASH_ITER(hh, idx->handlers, handler, handler_tmp) {
+        HASH_DEL(idx->handlers, handler);
+        free(handler);
+    }
+}
+
+struct resource *index_lookup_resource(struct resource_index *idx,
+        const char *app_name, const char *rsc_name)
+{
+    struct resource_index_entry *entry;
+    size_t app_len = strlen(app_name), rsc_len = strlen(rsc_name);
+    size_t id_len = app_len + 1 + rsc_len;
+
+    if(id_len > idx->id_max)
+        return NULL; // Longer than every id, and keeps the key small
+
+    char id[id_len];
+    memcpy(id, app_name, app_len);
+    id[app_len] = '/';
+    memcpy(&id[app_len + 1], rsc_name, rsc_len);
+
+    HASH_FIND(hh, idx->rscs, id, id_len, entry);
+
+    return entry ? entry->rsc : NULL;
+}
+
+resource_handler_t *index_lookup_handler(struct resource_index *idx,
+        const char *type)
+{
+    struct handler_index_entry *entry;
+
+    HASH_FIND_STR(idx->handlers, type, entry);
+
+    return entry ? entry->handler : NULL;
+}
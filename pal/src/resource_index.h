@@ -0,0 +1,56 @@
+#ifndef _PIRATE_PAL_RESOURCE_INDEX_H
+#define _PIRATE_PAL_RESOURCE_INDEX_H
+
+#include <uthash.h>
+
+#include "handlers.h"
+#include "yaml.h"
+
+struct resource_index_entry {
+    const char *id; // "enclave/resource", owned by the resource
+    struct resource *rsc;
+    UT_hash_handle hh;
+};
+
+struct handler_index_entry {
+    const char *type;
+    resource_handler_t *handler;
+    UT_hash_handle hh;
+};
+
+/* Hash indexes over the ids of the resources in the configuration and
+ * over the types in `handler_table`.
+ */
+struct resource_index {
+    struct resource_index_entry *rscs;
+    struct handler_index_entry *handlers;
+    size_t id_max; // Length of the longest id
+};
+
+/* Build the indexes for `rscs_count` resources in `rscs`. If an id
+ * belongs to more than one resource, the first one is used.
+ *
+ * Return 0 on success. On error, return -1 and print an error message.
+ */
+int build_resource_index(struct resource_index *idx,
+        struct resource *rscs, size_t rscs_count);
+
+/* Free the indexes. The resources themselves are left untouched.
+ */
+void free_resource_index(struct resource_index *idx);
+
+/* Look up the resource with id "`app_name`/`rsc_name`".
+ *
+ * Return the resource if found. Otherwise, return NULL.
+ */
+struct resource *index_lookup_resource(struct resource_index *idx,
+        const char *app_name, const char *rsc_name);
+
+/* Look up the handler for resources of type `type`.
+ *
+ * Return the handler if found. Otherwise, return NULL.
+ */
+resource_handler_t *index_lookup_handler(struct resource_index *idx,
+        const char *type);
+
+#endif // _PIRATE_PAL_RESOURCE_INDEX_H
@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "yaml.h"
 
 static const cyaml_schema_value_t string_ptr_schema = {
@@ -8,6 +10,16 @@ static const cyaml_schema_value_t string_ptr_schema = {
  * struct enclave schemas
  */
 
+static const cyaml_schema_value_t uint_schema = {
+    CYAML_VALUE_UINT(CYAML_FLAG_DEFAULT, uint32_t),
+};
+
+static const cyaml_strval_t sched_strings[] = {
+    {"other",       ENC_SCHED_OTHER},
+    {"fifo",        ENC_SCHED_FIFO},
+    {"rr",          ENC_SCHED_RR},
+};
+
 static const cyaml_schema_field_t enclave_field_schema[] = {
     CYAML_FIELD_STRING_PTR("name", CYAML_FLAG_POINTER,
             struct enclave, enc_name, 0, CYAML_UNLIMITED),
@@ -19,6 +31,21 @@ static const cyaml_schema_field_t enclave_field_schema[] = {
             struct enclave, enc_args, &string_ptr_schema, 0, CYAML_UNLIMITED),
     CYAML_FIELD_SEQUENCE("environment", CYAML_FLAG_POINTER | CYAML_FLAG_OPTIONAL,
             struct enclave, enc_env, &string_ptr_schema, 0, CYAML_UNLIMITED),
+    CYAML_FIELD_SEQUENCE("cpus", CYAML_FLAG_POINTER | CYAML_FLAG_OPTIONAL,
+            struct enclave, enc_cpus, &uint_schema, 0, CYAML_UNLIMITED),
+    CYAML_FIELD_ENUM("sched", CYAML_FLAG_OPTIONAL,
+            struct enclave, enc_sched,
+            sched_strings, CYAML_ARRAY_LEN(sched_strings)),
+    CYAML_FIELD_UINT_PTR("priority",
+            CYAML_FLAG_POINTER_NULL | CYAML_FLAG_OPTIONAL,
+            struct enclave, enc_priority),
+    CYAML_FIELD_INT_PTR("nice", CYAML_FLAG_POINTER_NULL | CYAML_FLAG_OPTIONAL,
+            struct enclave, enc_nice),
+    CYAML_FIELD_BOOL("mlockall", CYAML_FLAG_OPTIONAL,
+            struct enclave, enc_mlockall),
+    CYAML_FIELD_UINT_PTR("numa_node",
+            CYAML_FLAG_POINTER_NULL | CYAML_FLAG_OPTIONAL,
+            struct enclave, enc_numa_node),
     CYAML_FIELD_END,
 };
 
@@ -133,6 +160,8 @@ static const cyaml_schema_field_t rsc_contents_field_schema[] = {
             struct rsc_contents, cc_session, session_field_schema),
     CYAML_FIELD_UINT("message_id", CYAML_FLAG_OPTIONAL,
             struct rsc_contents, cc_message_id),
+    CYAML_FIELD_BOOL("managed", CYAML_FLAG_OPTIONAL,
+            struct rsc_contents, cc_managed),
 
     /* Trivial resources
      */
@@ -142,6 +171,8 @@ static const cyaml_schema_field_t rsc_contents_field_schema[] = {
     CYAML_FIELD_INT_PTR("integer_value",
             CYAML_FLAG_POINTER_NULL | CYAML_FLAG_OPTIONAL,
             struct rsc_contents, cc_integer_value),
+    CYAML_FIELD_BOOL("enclave_cpu", CYAML_FLAG_OPTIONAL,
+            struct rsc_contents, cc_enclave_cpu),
     CYAML_FIELD_BOOL_PTR("boolean_value",
             CYAML_FLAG_POINTER_NULL | CYAML_FLAG_OPTIONAL,
             struct rsc_contents, cc_boolean_value),
@@ -232,16 +263,71 @@ static const cyaml_config_t cyaml_config = {
     .flags = CYAML_CFG_DEFAULT,
 };
 
+/* Return the resource, other than the barrier `rsc`, that also uses the
+ * `j`th id of the barrier, or the barrier itself when the id repeats an
+ * earlier id of the barrier. The resource index keeps only the first
+ * resource of an id, so such a barrier could never be released.
+ */
+static const struct resource *shadowed_barrier_id(const struct top_level *tl,
+        const struct resource *rsc, size_t j)
+{
+    const char *id = rsc->r_ids[j];
+    size_t i, k;
+
+    for(k = 0; k < j; ++k)
+        if(!strcmp(rsc->r_ids[k], id))
+            return rsc;
+
+    for(i = 0; i < tl->tl_rscs_count; ++i) {
+        const struct resource *other = &tl->tl_rscs[i];
+
+        if(other == rsc)
+            continue;
+        for(k = 0; k < other->r_ids_count; ++k)
+            if(!strcmp(other->r_ids[k], id))
+                return other;
+    }
+
+    return NULL;
+}
+
 struct top_level *load_yaml(const char *fname)
 {
     cyaml_err_t err;
     struct top_level *res = NULL;
+    size_t i;
 
     err = cyaml_load_file(fname, &cyaml_config, &top_level_schema,
             (void **)&res, 0);
     if(err != CYAML_OK)
         fatal("Unable to parse %s: %s", fname, cyaml_strerror(err));
 
+    /* The default scheduling policy has no priority, and would otherwise
+     * silently ignore it.
+     */
+    for(i = 0; i < res->tl_encs_count; ++i) {
+        struct enclave *enc = &res->tl_encs[i];
+
+        if(enc->enc_priority && enc->enc_sched == ENC_SCHED_OTHER)
+            fatal("Unable to parse %s: enclave %s sets a priority "
+                    "without sched fifo or rr", fname, enc->enc_name);
+    }
+
+    for(i = 0; i < res->tl_rscs_count; ++i) {
+        const struct resource *rsc = &res->tl_rscs[i], *other;
+        size_t j;
+
+        if(strcmp(rsc->r_type, "barrier"))
+            continue;
+        for(j = 0; j < rsc->r_ids_count; ++j)
+            if((other = shadowed_barrier_id(res, rsc, j)) == rsc)
+                fatal("Unable to parse %s: barrier %s repeats id %s",
+                        fname, rsc->r_name, rsc->r_ids[j]);
+            else if(other)
+                fatal("Unable to parse %s: barrier %s shares id %s with %s",
+                        fname, rsc->r_name, rsc->r_ids[j], other->r_name);
+    }
+
     return res;
 }
 
@@ -8,6 +8,14 @@
 
 #include "log.h"
 
+struct app;
+
+enum enclave_sched {
+    ENC_SCHED_OTHER,
+    ENC_SCHED_FIFO,
+    ENC_SCHED_RR,
+};
+
 struct enclave {
     char *enc_name;
     char *enc_path;
@@ -16,6 +24,16 @@ struct enclave {
     size_t enc_args_count;
     char **enc_env;
     size_t enc_env_count;
+
+    /* Scheduling and memory controls applied before the enclave is executed
+     */
+    uint32_t *enc_cpus;
+    size_t enc_cpus_count;
+    enum enclave_sched enc_sched;
+    uint32_t *enc_priority;     // fifo, rr
+    int64_t *enc_nice;
+    bool enc_mlockall;
+    uint32_t *enc_numa_node;
 };
 
 struct id {
@@ -58,17 +76,26 @@ struct rsc_contents {
     speed_t cc_baud;            // serial
     struct session *cc_session; // mercury
     uint32_t cc_message_id;     // ge_eth
+    bool cc_managed;            // shmem
+    int cc_fd;                  // shmem, set by the launcher when managed
 
     /* Trivial resources
      */
     char *cc_string_value;
     int64_t *cc_integer_value;
+    bool cc_enclave_cpu;        // integer set to the first cpu of the enclave
     bool *cc_boolean_value;
 
     /* File resource
      */
     char *cc_file_path;
     int *cc_file_flags;
+
+    /* Barrier resource, set by the launcher
+     */
+    struct app **cc_waiting;    // Enclaves waiting on the barrier
+    size_t cc_waiting_count;
+    bool cc_broken;             // An enclave exited before the release
 };
 
 struct resource {